@@ -0,0 +1,21 @@
+#LZ4 & zstd are optional. Support for each codec is compiled in if found.
+pkg_check_modules(LZ4 liblz4)
+pkg_check_modules(ZSTD libzstd)
+
+if( LZ4_FOUND )
+   message("liblz4 found. Will compile-in support for lz4 compression.")
+   SET(CMAKE_C_FLAGS "-DHAVE_LZ4 ${CMAKE_C_FLAGS}")
+   include_directories(${LZ4_INCLUDE_DIRS})
+   find_library( LZ4_LIBRARY lz4 PATHS ${LZ4_LIBRARY_DIRS} )
+else()
+   message("liblz4 not found. lz4 compression will not be supported.")
+endif()
+
+if( ZSTD_FOUND )
+   message("libzstd found. Will compile-in support for zstd compression.")
+   SET(CMAKE_C_FLAGS "-DHAVE_ZSTD ${CMAKE_C_FLAGS}")
+   include_directories(${ZSTD_INCLUDE_DIRS})
+   find_library( ZSTD_LIBRARY zstd PATHS ${ZSTD_LIBRARY_DIRS} )
+else()
+   message("libzstd not found. zstd compression will not be supported.")
+endif()
@@ -31,8 +31,40 @@ typedef struct _DataTransferHeader
    guint64 response_id;
    guint16 dataTransferType;
    guint16 nsegments;
+   guint16 flags;
 }DataTransferHeader;
 
+//DataTransferHeader flags
+//The data segments of this transfer may have other (non-preemptible) transfers
+// interleaved within them. When set, each data segment is sent as chunks of at
+// most DATATRANSFER_CHUNK_SIZE bytes (a zero-sized segment as 1 empty chunk),
+// and each chunk is preceded by a guint32 count of the complete transfers that
+// were interleaved at that point.
+#define DATATRANSFER_FLAG_PREEMPTIBLE (1 << 0)
+
+//The large data segments of this transfer are striped across the additional
+// CommsIO's (stripes) of the comms. Each segment of at least
+// DATATRANSFER_STRIPE_MIN_SIZE bytes is split into (nstripes + 1) pieces of
+// DATATRANSFER_STRIPE_PIECE_SIZE(size, nstripes + 1) bytes (the last ones may be
+// shorter, or empty). The first piece is sent on the main CommsIO, in place of
+// the whole segment, and piece i on stripe i-1. Empty pieces aren't sent.
+#define DATATRANSFER_FLAG_STRIPED (1 << 1)
+
+//Some of the data segments of this transfer are compressed, using the codec that
+// was negotiated for the connection. The DataSegmentHeader's are followed by a
+// guint64 per segment, holding its uncompressed size (or 0 if the segment isn't
+// compressed). The segmentSize of a compressed segment is its compressed size, and
+// everything else (chunking, striping) applies to the compressed data.
+#define DATATRANSFER_FLAG_COMPRESSED (1 << 2)
+
+#define DATATRANSFER_CHUNK_SIZE (256 * 1024)
+
+#define DATATRANSFER_STRIPE_MIN_SIZE (1024 * 1024)
+#define DATATRANSFER_STRIPE_ALIGN 4096
+#define DATATRANSFER_STRIPE_PIECE_SIZE(size, npieces) \
+   (((((size) + (npieces) - 1) / (npieces)) + DATATRANSFER_STRIPE_ALIGN - 1) & \
+    ~((guint64)DATATRANSFER_STRIPE_ALIGN - 1))
+
 typedef struct _DataSegmentHeader
 {
    guint64 segmentSize;
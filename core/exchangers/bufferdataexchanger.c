@@ -21,13 +21,21 @@
  */
 
 #include <string.h>
+#include <gst/base/gstbytewriter.h>
+#include <gst/base/gstbytereader.h>
+#include <gst/video/video.h>
 #include "bufferdataexchanger.h"
 #include "remoteoffloadmetaserializer.h"
 #include "remoteoffloadextregistry.h"
+#include "remoteoffloadmempool.h"
+#include "remoteoffloadcommschannel.h"
+#include "remoteoffloadcommsio.h"
+#include "remoteoffloadstreammemory.h"
 
 //Includes for "core" meta serializers
 #include "gstvideoroimetaserializer.h"
 #include "gstvideometaserializer.h"
+#include "gsttracemetaserializer.h"
 
 enum
 {
@@ -37,28 +45,6 @@ enum
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
 
-struct _BufferDataExchanger
-{
-  RemoteOffloadDataExchanger parent_instance;
-
-  /* Other members, including private data. */
-  BufferDataExchangerCallback *callback;
-
-  GHashTable *metaSerializerHash;
-  RemoteOffloadExtRegistry *ext_registry;
-
-};
-
-GST_DEBUG_CATEGORY_STATIC (buffer_data_exchanger_debug);
-#define GST_CAT_DEFAULT buffer_data_exchanger_debug
-
-G_DEFINE_TYPE_WITH_CODE(BufferDataExchanger, buffer_data_exchanger,
-REMOTEOFFLOADDATAEXCHANGER_TYPE,
-GST_DEBUG_CATEGORY_INIT (buffer_data_exchanger_debug, "remoteoffloadbufferdataexchanger", 0,
-  "debug category for remoteoffloadbufferdataexchanger"))
-
-static GQuark QUARK_BUFFER_RESPONSE_ID;
-
 typedef struct
 {
   guint64 pts; //presentation timestamp
@@ -70,17 +56,37 @@ typedef struct
   guint16 nmem;  //number of GstMemory's within GstBuffer (what gst_buffer_n_memory() returns)
   guint16 nserializedmeta;  //number of 'MetaHeaders' will be contained within
                             //BUFFEREXCHANGE_METAHEADER segment
+  guint16 nmetasegments;    //total number of meta segments that follow the
+                            //BUFFEREXCHANGE_METAHEADER segment
   GstFlowReturn returnVal;
 
 }BufferHeader;
 
-#define META_API_STR_SIZE 128
+//Instead of the meta api name, each meta is sent with an id that the sending
+// exchanger assigned to it. The first time an id is sent (or the first time since a
+// failed send), META_ID_DEFINE is set, and the api name is appended to the
+// BUFFEREXCHANGE_METAHEADER segment:
+//[MetaHeader] x BufferHeader.nserializedmeta
+//(for each MetaHeader with META_ID_DEFINE set):
+//[guint16 api_name_size (little-endian)][gchar *api_name] (api_name_size bytes, not NULL terminated)
 typedef struct
 {
-  gchar meta_api_str[META_API_STR_SIZE];
+  guint16 meta_id;
   guint16 nsegments; //number of segments to send for this
 }MetaHeader;
 
+#define META_ID_DEFINE 0x8000
+#define META_ID_MAX 0x7FFF
+
+typedef struct
+{
+   RemoteOffloadMetaSerializer *serializer; //NULL if this meta isn't serialized
+   guint16 meta_id;
+   gboolean defined;  //the remote side knows about meta_id
+   gboolean defining; //meta_id is being defined by the buffer being sent
+   gboolean sending;  //serializer's send_begin was called for the buffer being sent
+}MetaTypeEntry;
+
 enum
 {
    BUFFEREXCHANGE_HEADER_INDEX = 0,
@@ -88,32 +94,103 @@ enum
 
 typedef struct
 {
-   gchar *api_str;
+   MetaTypeEntry *type;
    GArray *metaMemArray;
+   gboolean bdefine;  //this entry carries the definition of type->meta_id
 }SerializedMetaEntry;
 
-typedef struct
+struct _BufferDataExchanger
 {
-   BufferDataExchanger *pThis;
-   GArray *serializedMetaEntries;
-}SerializeUserPtr;
+  RemoteOffloadDataExchanger parent_instance;
+
+  /* Other members, including private data. */
+  BufferDataExchangerCallback *callback;
+
+  GHashTable *metaSerializerHash;
+  RemoteOffloadExtRegistry *ext_registry;
+
+  //send side: meta api GType -> MetaTypeEntry
+  GHashTable *metaTypeHash;
+  guint16 next_meta_id;
+
+  //receive side: meta id -> RemoteOffloadMetaSerializer (or NULL if there is
+  // no serializer for it on this side). Accessed by both the thread that
+  // allocates data segments and the one that receives buffers.
+  GMutex metaidmutex;
+  GPtrArray *metaIdTable;
+
+  //Responses for buffers that have been sent, but whose
+  // GstFlowReturn has not yet been collected.
+  GMutex inflightmutex;
+  GQueue inflight_queue;
+  GQueue inflight_links;   //unused links for inflight_queue
+  GPtrArray *response_pool; //responses that can be reused
+  guint max_inflight;
+  GstFlowReturn sticky_flowret;
+
+  //send side scratch state, reused from one buffer to the next so that
+  // sending doesn't allocate once streaming. Protected by sendmutex.
+  GMutex sendmutex;
+  BufferHeader sendheader;
+  GstMemory *headermem;         //wraps sendheader
+  guint8 *metaheaderdata;
+  gsize metaheadercapacity;
+  GstMemory *metaheadermem;     //wraps metaheaderdata
+  GArray *metaentries;          //SerializedMetaEntry
+  guint nmetaentries;
+  GPtrArray *sendtypes;         //MetaTypeEntry's with 'sending' set
+  GPtrArray *sendmems;          //GstMemory * segments of the buffer being sent
+  GArray *memlistnodes;         //GList's, linked over sendmems
+
+  //Pools that received data segments are allocated from. GstBuffer memory
+  // segments come from mempool, buffer & meta headers from headerpool.
+  RemoteOffloadMemPool *mempool;
+  RemoteOffloadMemPool *headerpool;
+  gsize video_frame_size;
+
+  //receive GstBuffer memory as stream memories (set atomically)
+  gint streaming;
+
+};
+
+//max number of unused responses kept around for reuse
+#define RESPONSE_POOL_MAX 16
+
+//max number of unused blocks that each pool keeps around, per size class
+#define BUFFER_MEMPOOL_MAX_FREE 8
+#define HEADER_MEMPOOL_MAX_FREE 32
+
+GST_DEBUG_CATEGORY_STATIC (buffer_data_exchanger_debug);
+#define GST_CAT_DEFAULT buffer_data_exchanger_debug
+
+G_DEFINE_TYPE_WITH_CODE(BufferDataExchanger, buffer_data_exchanger,
+REMOTEOFFLOADDATAEXCHANGER_TYPE,
+GST_DEBUG_CATEGORY_INIT (buffer_data_exchanger_debug, "remoteoffloadbufferdataexchanger", 0,
+  "debug category for remoteoffloadbufferdataexchanger"))
+
+static GQuark QUARK_BUFFER_RESPONSE_ID;
 
 //some small helper functions
 
+//The data segments of a buffer are ordered as:
+// header, [metaheader, meta segments...], GstBuffer memory's...
+//The GstBuffer memory's are last, so that the buffer can be dispatched (in
+// streaming mode) once the header & meta have been received.
+
 //Get the start index & size (number of segments) of GstBuffer memory's
 static inline void GetBufferMemRange(BufferHeader *header, guint *start_index, guint *size)
 {
-   //the start index is always 1, because the mem segments always immediately follow the
-   // header (BUFFEREXCHANGE_HEADER_INDEX), which is 0
    *start_index = 1;
+   if( header->nserializedmeta )
+      *start_index += 1 + header->nmetasegments;
    *size = header->nmem;
 }
 
 static inline guint GetMetaHeaderIndex(BufferHeader *header)
 {
-   guint start_index, size;
-   GetBufferMemRange(header, &start_index, &size);
-   return start_index + size;
+   //the meta header always immediately follows the
+   // header (BUFFEREXCHANGE_HEADER_INDEX), which is 0
+   return 1;
 }
 
 typedef enum
@@ -129,42 +206,91 @@ static inline BufferExchangeDataSegmentType IndexToType(BufferHeader *header, gu
    if( index == 0 )
       return BUFFEREXCHANGE_SEG_TYPE_HEADER;
 
-   guint metaHeaderIndex = GetMetaHeaderIndex(header);
-   if( index < metaHeaderIndex )
+   guint mem_start_index, nmem;
+   GetBufferMemRange(header, &mem_start_index, &nmem);
+   if( index >= mem_start_index )
       return BUFFEREXCHANGE_SEG_TYPE_MEM;
 
-   if( index == metaHeaderIndex )
+   if( index == GetMetaHeaderIndex(header) )
       return BUFFEREXCHANGE_SEG_TYPE_METAHEADER;
 
    return BUFFEREXCHANGE_SEG_TYPE_META;
 }
 
-static gboolean _SerializeMeta(BufferDataExchanger *self,
-                               GstBuffer * buffer,
-                               GstMeta ** meta,
-                               SerializeUserPtr *pSerializeUserPtr)
+//Get the send-side MetaTypeEntry for a meta api, creating it the first time
+// that the api is seen.
+static MetaTypeEntry *GetMetaTypeEntry(BufferDataExchanger *self, GType api)
 {
+   MetaTypeEntry *type = g_hash_table_lookup(self->metaTypeHash, (gpointer)api);
+   if( G_LIKELY(type) )
+      return type;
 
-  RemoteOffloadMetaSerializer *metaserializer =
-        (RemoteOffloadMetaSerializer *)g_hash_table_lookup(self->metaSerializerHash,
-                                                           g_type_name ((*meta)->info->api));
+   type = g_malloc0(sizeof(MetaTypeEntry));
+   type->serializer = g_hash_table_lookup(self->metaSerializerHash, g_type_name(api));
+   if( type->serializer )
+   {
+      if( self->next_meta_id <= META_ID_MAX )
+      {
+         type->meta_id = self->next_meta_id++;
+      }
+      else
+      {
+         GST_WARNING_OBJECT (self, "Out of meta ids. Meta of type %s won't be sent",
+                             g_type_name(api));
+         type->serializer = NULL;
+      }
+   }
+   g_hash_table_insert(self->metaTypeHash, (gpointer)api, type);
+
+   return type;
+}
+
+static gboolean SerializeMeta(GstBuffer * buffer, GstMeta ** meta, gpointer user_data)
+{
+  BufferDataExchanger *self = (BufferDataExchanger *)user_data;
+
+  MetaTypeEntry *type = GetMetaTypeEntry(self, (*meta)->info->api);
+  RemoteOffloadMetaSerializer *metaserializer = type->serializer;
 
   if( metaserializer )
   {
-     SerializedMetaEntry *entry = (SerializedMetaEntry *)g_malloc( sizeof(SerializedMetaEntry) );
-     entry->metaMemArray = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
-     entry->api_str = g_strdup(g_type_name ((*meta)->info->api));
+     //entries (and their metaMemArray's) are reused from one buffer to the next
+     if( self->nmetaentries == self->metaentries->len )
+     {
+        SerializedMetaEntry newentry;
+        newentry.type = NULL;
+        newentry.metaMemArray = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
+        g_array_append_val(self->metaentries, newentry);
+     }
+
+     //serializers that keep per-connection state need to know when the
+     // data they produce is discarded rather than sent
+     if( !type->sending )
+     {
+        type->sending = TRUE;
+        g_ptr_array_add(self->sendtypes, type);
+        remote_offload_meta_send_begin(metaserializer);
+     }
+
+     SerializedMetaEntry *entry = &g_array_index(self->metaentries,
+                                                 SerializedMetaEntry,
+                                                 self->nmetaentries);
+     entry->type = type;
+     g_array_set_size(entry->metaMemArray, 0);
 
      if( remote_offload_meta_serialize(metaserializer,
                                         *meta,
                                         entry->metaMemArray) )
      {
-        g_array_append_val(pSerializeUserPtr->serializedMetaEntries, entry);
+        self->nmetaentries++;
      }
      else
      {
         GST_ERROR_OBJECT (self, "Error serializing meta of type %s\n",
                           g_type_name ((*meta)->info->api));
+        for( guint memi = 0; memi < entry->metaMemArray->len; memi++ )
+           gst_memory_unref(g_array_index(entry->metaMemArray, GstMemory *, memi));
+        g_array_set_size(entry->metaMemArray, 0);
         return FALSE;
      }
   }
@@ -172,34 +298,150 @@ static gboolean _SerializeMeta(BufferDataExchanger *self,
   return TRUE;
 }
 
-static gboolean SerializeMeta(GstBuffer * buffer, GstMeta ** meta, gpointer user_data)
+//Get the (reused) memory that the meta header segment is written to,
+// sized to 'size' bytes.
+static GstMemory *GetMetaHeaderMem(BufferDataExchanger *self, gsize size)
 {
-   SerializeUserPtr *pSerializeUserPtr = (SerializeUserPtr *)user_data;
+   if( size > self->metaheadercapacity )
+   {
+      if( self->metaheadermem )
+         gst_memory_unref(self->metaheadermem);
+
+      self->metaheadercapacity = MAX(size, 2 * self->metaheadercapacity);
+      self->metaheaderdata = g_malloc(self->metaheadercapacity);
+      self->metaheadermem = gst_memory_new_wrapped((GstMemoryFlags)0,
+                                                   self->metaheaderdata,
+                                                   self->metaheadercapacity,
+                                                   0,
+                                                   self->metaheadercapacity,
+                                                   self->metaheaderdata,
+                                                   g_free);
+   }
+
+   gst_memory_resize(self->metaheadermem, 0, size);
 
-   return _SerializeMeta(pSerializeUserPtr->pThis,
-                         buffer,
-                         meta,
-                         pSerializeUserPtr);
+   return self->metaheadermem;
 }
 
-static GstMemory* virt_to_mem(void *pVirt,
-                              gsize size)
+//Link the (reused) list nodes over the memories in sendmems. The list is only
+// valid until the next call.
+static GList *BuildMemList(BufferDataExchanger *self)
 {
-   GstMemory *mem = NULL;
+   guint n = self->sendmems->len;
+   if( !n )
+      return NULL;
 
-   if( pVirt && (size>0) )
+   g_array_set_size(self->memlistnodes, n);
+   GList *nodes = (GList *)self->memlistnodes->data;
+   for( guint i = 0; i < n; i++ )
    {
+      nodes[i].data = g_ptr_array_index(self->sendmems, i);
+      nodes[i].prev = (i > 0) ? &nodes[i - 1] : NULL;
+      nodes[i].next = (i + 1 < n) ? &nodes[i + 1] : NULL;
+   }
+
+   return nodes;
+}
+
+//Get a response object to send a buffer with, reusing one whose flow return
+// has already been collected if possible.
+// Note: inflightmutex must be held by the caller.
+static RemoteOffloadResponse *acquire_response(BufferDataExchanger *self)
+{
+   if( self->response_pool->len )
+      return g_ptr_array_remove_index_fast(self->response_pool, self->response_pool->len - 1);
 
-      mem = gst_memory_new_wrapped((GstMemoryFlags)0,
-                                   pVirt,
-                                   size,
-                                   0,
-                                   size,
-                                   NULL,
-                                   NULL);
+   return remote_offload_response_new();
+}
+
+// Note: inflightmutex must be held by the caller.
+static void release_response(BufferDataExchanger *self, RemoteOffloadResponse *pResponse)
+{
+   if( (self->response_pool->len < RESPONSE_POOL_MAX) &&
+       remote_offload_response_reset(pResponse) )
+   {
+      g_ptr_array_add(self->response_pool, pResponse);
+   }
+   else
+   {
+      g_object_unref(pResponse);
    }
+}
 
-   return mem;
+// Note: inflightmutex must be held by the caller.
+static void push_inflight(BufferDataExchanger *self, RemoteOffloadResponse *pResponse)
+{
+   GList *link = g_queue_pop_head_link(&self->inflight_links);
+   if( !link )
+      link = g_list_alloc();
+
+   link->data = pResponse;
+   g_queue_push_tail_link(&self->inflight_queue, link);
+}
+
+// Note: inflightmutex must be held by the caller.
+static RemoteOffloadResponse *pop_inflight(BufferDataExchanger *self)
+{
+   GList *link = g_queue_pop_head_link(&self->inflight_queue);
+   if( !link )
+      return NULL;
+
+   RemoteOffloadResponse *pResponse = link->data;
+   link->data = NULL;
+   g_queue_push_tail_link(&self->inflight_links, link);
+
+   return pResponse;
+}
+
+//Wait for the remote side to return the GstFlowReturn for a sent buffer
+static GstFlowReturn wait_flowreturn(BufferDataExchanger *self,
+                                     RemoteOffloadResponse *pResponse)
+{
+   GstFlowReturn flowReturn = GST_FLOW_OK;
+   if( remote_offload_response_wait(pResponse, 0) != REMOTEOFFLOADRESPONSE_RECEIVED )
+   {
+      GST_ERROR_OBJECT (self, "remote_offload_response_wait failed");
+      flowReturn = GST_FLOW_ERROR;
+   }
+   else
+   {
+     if( !remote_offload_copy_response(pResponse, &flowReturn, sizeof(flowReturn), 0))
+     {
+        GST_ERROR_OBJECT (self, "remote_offload_copy_response failed");
+        flowReturn = GST_FLOW_ERROR;
+     }
+   }
+
+   return flowReturn;
+}
+
+//Collect flow returns for in-flight buffers, oldest first. Acknowledgements
+// that have already arrived are always collected. If more than 'max_pending'
+// buffers are still in-flight, block until enough of them have been acknowledged.
+// The first failing flow return is latched into sticky_flowret.
+// Note: inflightmutex must be held by the caller.
+static void collect_inflight(BufferDataExchanger *self, guint max_pending)
+{
+   while( !g_queue_is_empty(&self->inflight_queue) )
+   {
+      RemoteOffloadResponse *pResponse = g_queue_peek_head(&self->inflight_queue);
+      if( (g_queue_get_length(&self->inflight_queue) <= max_pending) &&
+          !remote_offload_response_is_complete(pResponse) )
+      {
+         break;
+      }
+
+      pop_inflight(self);
+      GstFlowReturn flowReturn = wait_flowreturn(self, pResponse);
+      release_response(self, pResponse);
+
+      if( (flowReturn < GST_FLOW_OK) && (self->sticky_flowret >= GST_FLOW_OK) )
+      {
+         GST_DEBUG_OBJECT (self, "in-flight buffer returned %s",
+                           gst_flow_get_name(flowReturn));
+         self->sticky_flowret = flowReturn;
+      }
+   }
 }
 
 GstFlowReturn buffer_data_exchanger_send_buffer(BufferDataExchanger *bufferexchanger,
@@ -211,59 +453,118 @@ GstFlowReturn buffer_data_exchanger_send_buffer(BufferDataExchanger *bufferexcha
 
    gboolean ret;
 
-   BufferHeader bufheader;
+   //The header, meta entries & segment list are reused from one buffer to the
+   // next, so that nothing needs to be allocated for them once streaming.
+   g_mutex_lock(&bufferexchanger->sendmutex);
+
+   //If a previously sent buffer failed, report it now without serializing
+   // this one, as serializing can commit per-connection state (i.e. interned
+   // names) that the remote side would then never receive.
+   g_mutex_lock(&bufferexchanger->inflightmutex);
+   collect_inflight(bufferexchanger, MAX(bufferexchanger->max_inflight, 1) - 1);
+   GstFlowReturn sticky_flowret = bufferexchanger->sticky_flowret;
+   g_mutex_unlock(&bufferexchanger->inflightmutex);
+   if( sticky_flowret < GST_FLOW_OK )
+   {
+      g_mutex_unlock(&bufferexchanger->sendmutex);
+      return sticky_flowret;
+   }
 
-   //fill the "common" meta (various durations & flags)
-   bufheader.pts = GST_BUFFER_PTS (buffer);
-   bufheader.dts = GST_BUFFER_DTS (buffer);
-   bufheader.duration = GST_BUFFER_DURATION (buffer);
-   bufheader.offset = GST_BUFFER_OFFSET (buffer);
-   bufheader.offset_end = GST_BUFFER_OFFSET_END (buffer);
-   bufheader.flags = GST_BUFFER_FLAGS (buffer);
-   bufheader.nserializedmeta = 0; //initialize to 0
-   bufheader.nmem = (guint16)gst_buffer_n_memory(buffer);
+   BufferHeader *bufheader = &bufferexchanger->sendheader;
 
-   bufheader.returnVal = GST_FLOW_OK;
+   //fill the "common" meta (various durations & flags)
+   bufheader->pts = GST_BUFFER_PTS (buffer);
+   bufheader->dts = GST_BUFFER_DTS (buffer);
+   bufheader->duration = GST_BUFFER_DURATION (buffer);
+   bufheader->offset = GST_BUFFER_OFFSET (buffer);
+   bufheader->offset_end = GST_BUFFER_OFFSET_END (buffer);
+   bufheader->flags = GST_BUFFER_FLAGS (buffer);
+   bufheader->nserializedmeta = 0; //initialize to 0
+   bufheader->nmetasegments = 0;
+   bufheader->nmem = (guint16)gst_buffer_n_memory(buffer);
 
-   GList *memList = NULL;
-   memList = g_list_append (memList, virt_to_mem(&bufheader, sizeof(bufheader)));
+   bufheader->returnVal = GST_FLOW_OK;
 
-   for(guint memi = 0; memi < bufheader.nmem; memi++ )
-   {
-     memList = g_list_append (memList, gst_buffer_get_memory(buffer, memi));
-   }
+   g_ptr_array_set_size(bufferexchanger->sendmems, 0);
+   g_ptr_array_add(bufferexchanger->sendmems, bufferexchanger->headermem);
 
-   SerializeUserPtr user;
-   user.serializedMetaEntries = g_array_new(FALSE, FALSE, sizeof(SerializedMetaEntry *));
-   user.pThis = bufferexchanger;
-   gst_buffer_foreach_meta (buffer, SerializeMeta, &user);
+   bufferexchanger->nmetaentries = 0;
+   gst_buffer_foreach_meta (buffer, SerializeMeta, bufferexchanger);
 
-   bufheader.nserializedmeta = user.serializedMetaEntries->len;
+   bufheader->nserializedmeta = bufferexchanger->nmetaentries;
 
-   MetaHeader *metaHeaders = NULL;
+   //sendmems from this index on hold references that are owned by this call
+   guint first_owned_mem = 1;
+   gboolean bdefinesmetaid = FALSE;
 
-   if( bufheader.nserializedmeta > 0 )
+   if( bufheader->nserializedmeta > 0 )
    {
-      //build the vector of MetaHeader's
-      metaHeaders = (MetaHeader * )g_malloc(user.serializedMetaEntries->len * sizeof(MetaHeader));
-      for( guint mi = 0; mi < user.serializedMetaEntries->len; mi++)
+      //the vector of MetaHeader's, followed by the api names of
+      // meta ids that the remote side doesn't know about yet. A buffer can
+      // carry several metas of one type, but only the first of them defines it.
+      gsize metaHeadersSize = bufheader->nserializedmeta * sizeof(MetaHeader);
+      for( guint mi = 0; mi < bufheader->nserializedmeta; mi++)
+      {
+         SerializedMetaEntry *metaentry = &g_array_index(bufferexchanger->metaentries,
+                                                         SerializedMetaEntry,
+                                                         mi);
+         metaentry->bdefine = !metaentry->type->defined && !metaentry->type->defining;
+         if( metaentry->bdefine )
+         {
+            metaentry->type->defining = TRUE;
+            metaHeadersSize += sizeof(guint16) +
+               strnlen(remote_offload_meta_api_name(metaentry->type->serializer), G_MAXUINT16);
+         }
+      }
+
+      GstMemory *metaheadermem = GetMetaHeaderMem(bufferexchanger, metaHeadersSize);
+      GstByteWriter bw;
+      gst_byte_writer_init_with_data(&bw, bufferexchanger->metaheaderdata, metaHeadersSize, FALSE);
+
+      for( guint mi = 0; mi < bufheader->nserializedmeta; mi++)
       {
-         SerializedMetaEntry *metaentry = g_array_index(user.serializedMetaEntries,
-                                                        SerializedMetaEntry *,
-                                                        mi);
+         SerializedMetaEntry *metaentry = &g_array_index(bufferexchanger->metaentries,
+                                                         SerializedMetaEntry,
+                                                         mi);
+
+         MetaHeader metaHeader;
+         metaHeader.meta_id = metaentry->type->meta_id;
+         if( metaentry->bdefine )
+            metaHeader.meta_id |= META_ID_DEFINE;
+         metaHeader.nsegments = metaentry->metaMemArray->len;
+         gst_byte_writer_put_data(&bw, (const guint8 *)&metaHeader, sizeof(metaHeader));
+      }
 
-         g_strlcpy(metaHeaders[mi].meta_api_str, metaentry->api_str, META_API_STR_SIZE);
-         metaHeaders[mi].nsegments = metaentry->metaMemArray->len;
+      for( guint mi = 0; mi < bufheader->nserializedmeta; mi++)
+      {
+         SerializedMetaEntry *metaentry = &g_array_index(bufferexchanger->metaentries,
+                                                         SerializedMetaEntry,
+                                                         mi);
+         if( metaentry->bdefine )
+         {
+            const gchar *api_name =
+                  remote_offload_meta_api_name(metaentry->type->serializer);
+            guint16 api_name_size = (guint16)strnlen(api_name, G_MAXUINT16);
+            gst_byte_writer_put_uint16_le(&bw, api_name_size);
+            gst_byte_writer_put_data(&bw, (const guint8 *)api_name, api_name_size);
+
+            metaentry->type->defining = FALSE;
+            metaentry->type->defined = TRUE;
+            bdefinesmetaid = TRUE;
+         }
       }
 
-      memList = g_list_append (memList, virt_to_mem(metaHeaders,
-                                                    user.serializedMetaEntries->len *
-                                                    sizeof(MetaHeader)));
-      for( guint mi = 0; mi < user.serializedMetaEntries->len; mi++)
+      //the header was sized exactly, so nothing within it is left unwritten
+      g_warn_if_fail(gst_byte_writer_get_pos(&bw) == metaHeadersSize);
+
+      g_ptr_array_add(bufferexchanger->sendmems, metaheadermem);
+      first_owned_mem++;
+
+      for( guint mi = 0; mi < bufheader->nserializedmeta; mi++)
       {
-         SerializedMetaEntry *metaentry = g_array_index(user.serializedMetaEntries,
-                                                     SerializedMetaEntry *,
-                                                     mi);
+         SerializedMetaEntry *metaentry = &g_array_index(bufferexchanger->metaentries,
+                                                         SerializedMetaEntry,
+                                                         mi);
 
          for( guint memi = 0; memi < metaentry->metaMemArray->len; memi++ )
          {
@@ -271,76 +572,176 @@ GstFlowReturn buffer_data_exchanger_send_buffer(BufferDataExchanger *bufferexcha
                                            GstMemory *,
                                            memi);
 
-            memList = g_list_append (memList, mem);
+            g_ptr_array_add(bufferexchanger->sendmems, mem);
+            bufheader->nmetasegments++;
          }
       }
    }
 
+   for(guint memi = 0; memi < bufheader->nmem; memi++ )
+   {
+     //buffer memory stays valid for as long as it's referenced, so the
+     // CommsIO may hold on to it instead of copying it.
+     g_ptr_array_add(bufferexchanger->sendmems,
+                     remote_offload_comms_io_make_mem_shareable(gst_buffer_get_memory(buffer, memi)));
+   }
 
-   RemoteOffloadResponse *pResponse = remote_offload_response_new();
+   GList *memList = BuildMemList(bufferexchanger);
 
+   GstFlowReturn flowReturn = GST_FLOW_OK;
+   gboolean bsent = FALSE;
 
-   ret = remote_offload_data_exchanger_write((RemoteOffloadDataExchanger *)bufferexchanger,
-                                                       memList,
-                                                       pResponse);
+   g_mutex_lock(&bufferexchanger->inflightmutex);
 
+   guint window = MAX(bufferexchanger->max_inflight, 1);
 
-   GstFlowReturn flowReturn = GST_FLOW_OK;
-   if( ret )
+   //make room within the window for this buffer
+   collect_inflight(bufferexchanger, window - 1);
+
+   if( bufferexchanger->sticky_flowret < GST_FLOW_OK )
+   {
+      //a previously sent buffer failed. Report it now, instead of sending this one.
+      flowReturn = bufferexchanger->sticky_flowret;
+   }
+   else
    {
-      if( remote_offload_response_wait(pResponse, 0) != REMOTEOFFLOADRESPONSE_RECEIVED )
+      RemoteOffloadResponse *pResponse = acquire_response(bufferexchanger);
+
+      ret = remote_offload_data_exchanger_write((RemoteOffloadDataExchanger *)bufferexchanger,
+                                                memList,
+                                                pResponse);
+
+      bsent = ret;
+      if( ret )
       {
-         GST_ERROR_OBJECT (bufferexchanger, "remote_offload_response_wait failed");
-         flowReturn = GST_FLOW_ERROR;
+         if( window == 1 )
+         {
+            flowReturn = wait_flowreturn(bufferexchanger, pResponse);
+         }
+         else
+         {
+            //The flow return for this buffer will be collected by a later
+            // call to send_buffer, or buffer_data_exchanger_drain().
+            push_inflight(bufferexchanger, pResponse);
+            pResponse = NULL;
+         }
       }
       else
       {
-        if( !remote_offload_copy_response(pResponse, &flowReturn, sizeof(flowReturn), 0))
-        {
-           GST_ERROR_OBJECT (bufferexchanger, "remote_offload_copy_response failed");
-           flowReturn = GST_FLOW_ERROR;
-        }
+         flowReturn = GST_FLOW_ERROR;
       }
+
+      if( pResponse )
+         release_response(bufferexchanger, pResponse);
    }
-   else
+
+   for( guint ti = 0; ti < bufferexchanger->sendtypes->len; ti++ )
    {
-      flowReturn = GST_FLOW_ERROR;
+      MetaTypeEntry *type = g_ptr_array_index(bufferexchanger->sendtypes, ti);
+      remote_offload_meta_send_end(type->serializer, bsent);
+      type->sending = FALSE;
    }
+   g_ptr_array_set_size(bufferexchanger->sendtypes, 0);
 
-   g_object_unref(pResponse);
+   if( bdefinesmetaid && !bsent )
+   {
+      //the remote side didn't receive the definitions within this
+      // buffer's meta header, so send them again with the next one.
+      GHashTableIter iter;
+      gpointer value;
+      g_hash_table_iter_init(&iter, bufferexchanger->metaTypeHash);
+      while( g_hash_table_iter_next(&iter, NULL, &value) )
+         ((MetaTypeEntry *)value)->defined = FALSE;
+   }
 
-   if( metaHeaders )
+   g_mutex_unlock(&bufferexchanger->inflightmutex);
+
+   //the header & meta header memories are kept for the next buffer
+   for( guint memi = first_owned_mem; memi < bufferexchanger->sendmems->len; memi++ )
    {
-      g_free(metaHeaders);
+      gst_memory_unref((GstMemory *)g_ptr_array_index(bufferexchanger->sendmems, memi));
    }
+   g_ptr_array_set_size(bufferexchanger->sendmems, 0);
+
+   g_mutex_unlock(&bufferexchanger->sendmutex);
+
+   return flowReturn;
+}
+
 
-   if( memList )
+//Register the meta ids that are defined within a (mapped) BUFFEREXCHANGE_METAHEADER
+// segment. Note: metaidmutex must be held by the caller.
+static gboolean _RegisterMetaIds(BufferDataExchanger *self,
+                                const guint8 *data,
+                                gsize size,
+                                guint16 nmetaheaders)
+{
+   GstByteReader br;
+   gst_byte_reader_init(&br, data, size);
+
+   const guint8 *pMetaHeaders;
+   if( !gst_byte_reader_get_data(&br, nmetaheaders * sizeof(MetaHeader), &pMetaHeaders) )
+      return FALSE;
+
+   for( guint16 mhi = 0; mhi < nmetaheaders; mhi++ )
    {
-      for(GList *li = memList; li != NULL; li = li->next )
+      MetaHeader metaHeader = ((const MetaHeader *)pMetaHeaders)[mhi];
+      if( !(metaHeader.meta_id & META_ID_DEFINE) )
+         continue;
+
+      guint16 api_name_size;
+      const guint8 *api_name;
+      if( !gst_byte_reader_get_uint16_le(&br, &api_name_size) ||
+          !gst_byte_reader_get_data(&br, api_name_size, &api_name) )
+         return FALSE;
+
+      guint16 meta_id = metaHeader.meta_id & ~META_ID_DEFINE;
+      if( meta_id >= self->metaIdTable->len )
+         g_ptr_array_set_size(self->metaIdTable, meta_id + 1);
+
+      gchar *name = g_strndup((const gchar *)api_name, api_name_size);
+      RemoteOffloadMetaSerializer *metaserializer =
+            g_hash_table_lookup(self->metaSerializerHash, name);
+      if( !metaserializer )
       {
-         GstMemory *mem = (GstMemory *)li->data;
-         gst_memory_unref(mem);
+         GST_WARNING_OBJECT (self, "No Meta Serializer available for type %s", name);
       }
-
-      g_list_free(memList);
+      else if( g_ptr_array_index(self->metaIdTable, meta_id) != metaserializer )
+      {
+         GST_DEBUG_OBJECT (self, "meta id %u = %s", meta_id, name);
+      }
+      g_ptr_array_index(self->metaIdTable, meta_id) = metaserializer;
+      g_free(name);
    }
 
-   for( guint mi = 0; mi < user.serializedMetaEntries->len; mi++)
-   {
-      SerializedMetaEntry *metaentry = g_array_index(user.serializedMetaEntries,
-                                                     SerializedMetaEntry *,
-                                                     mi);
-
-      g_free(metaentry->api_str);
-      g_array_free(metaentry->metaMemArray, TRUE);
-      g_free( metaentry );
-   }
+   return TRUE;
+}
 
-   g_array_free(user.serializedMetaEntries, TRUE);
+static gboolean RegisterMetaIds(BufferDataExchanger *self,
+                                const guint8 *data,
+                                gsize size,
+                                guint16 nmetaheaders)
+{
+   g_mutex_lock(&self->metaidmutex);
+   gboolean ret = _RegisterMetaIds(self, data, size, nmetaheaders);
+   g_mutex_unlock(&self->metaidmutex);
 
-   return flowReturn;
+   return ret;
 }
 
+static inline RemoteOffloadMetaSerializer *LookupMetaSerializer(BufferDataExchanger *self,
+                                                                guint16 meta_id)
+{
+   RemoteOffloadMetaSerializer *metaserializer = NULL;
+   meta_id &= ~META_ID_DEFINE;
+
+   g_mutex_lock(&self->metaidmutex);
+   if( G_LIKELY(meta_id < self->metaIdTable->len) )
+      metaserializer = g_ptr_array_index(self->metaIdTable, meta_id);
+   g_mutex_unlock(&self->metaidmutex);
+
+   return metaserializer;
+}
 
 gboolean buffer_data_exchanger_received(RemoteOffloadDataExchanger *exchanger,
                                       const GArray *segment_mem_array,
@@ -397,21 +798,29 @@ gboolean buffer_data_exchanger_received(RemoteOffloadDataExchanger *exchanger,
 
      MetaHeader *pMetaHeader = (MetaHeader *)mapMetaHeader.data;
 
+     if( !RegisterMetaIds(self, mapMetaHeader.data, mapMetaHeader.size,
+                          pBufferHeader->nserializedmeta) )
+     {
+        GST_ERROR_OBJECT (self, "Malformed meta header segment");
+     }
+
+     guint mem_start_index, nmem;
+     GetBufferMemRange(pBufferHeader, &mem_start_index, &nmem);
      gsize meta_mem_segment_index = metaHeaderIndex + 1;
      for( int mhi = 0; mhi < pBufferHeader->nserializedmeta; mhi++ )
      {
         GArray *metaMemArray = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
         for( int si = 0; si < pMetaHeader[mhi].nsegments; si++ )
         {
-           if( meta_mem_segment_index < segment_mem_array->len )
+           if( meta_mem_segment_index < MIN(mem_start_index, segment_mem_array->len) )
            {
              g_array_append_val(metaMemArray, gstmemarray[meta_mem_segment_index++]);
            }
         }
 
         //Alright, we can deserialize & attach this meta segment now
-        RemoteOffloadMetaSerializer *metaserializer = (RemoteOffloadMetaSerializer *)
-                    g_hash_table_lookup(self->metaSerializerHash, pMetaHeader[mhi].meta_api_str);
+        RemoteOffloadMetaSerializer *metaserializer =
+              LookupMetaSerializer(self, pMetaHeader[mhi].meta_id);
         if( metaserializer )
         {
            if( !remote_offload_meta_deserialize(metaserializer,
@@ -422,11 +831,6 @@ gboolean buffer_data_exchanger_received(RemoteOffloadDataExchanger *exchanger,
            }
 
         }
-        else
-        {
-           GST_WARNING_OBJECT (self, "No Meta Serializer available for type %s",
-                               pMetaHeader[mhi].meta_api_str);
-        }
 
         g_array_free(metaMemArray, TRUE);
 
@@ -461,6 +865,79 @@ gboolean buffer_data_exchanger_received(RemoteOffloadDataExchanger *exchanger,
    return ret;
 }
 
+void buffer_data_exchanger_set_max_inflight(BufferDataExchanger *bufferexchanger,
+                                            guint max_inflight)
+{
+   if( !DATAEXCHANGER_IS_BUFFER(bufferexchanger) )
+      return;
+
+   g_mutex_lock(&bufferexchanger->inflightmutex);
+   bufferexchanger->max_inflight = CLAMP(max_inflight, 1, REMOTEOFFLOAD_MAX_INFLIGHT_BUFFERS);
+   g_mutex_unlock(&bufferexchanger->inflightmutex);
+}
+
+GstFlowReturn buffer_data_exchanger_drain(BufferDataExchanger *bufferexchanger)
+{
+   if( !DATAEXCHANGER_IS_BUFFER(bufferexchanger) )
+      return GST_FLOW_ERROR;
+
+   g_mutex_lock(&bufferexchanger->inflightmutex);
+   collect_inflight(bufferexchanger, 0);
+   GstFlowReturn flowReturn = bufferexchanger->sticky_flowret;
+   g_mutex_unlock(&bufferexchanger->inflightmutex);
+
+   return flowReturn;
+}
+
+void buffer_data_exchanger_reset_flowreturn(BufferDataExchanger *bufferexchanger)
+{
+   if( !DATAEXCHANGER_IS_BUFFER(bufferexchanger) )
+      return;
+
+   g_mutex_lock(&bufferexchanger->inflightmutex);
+   bufferexchanger->sticky_flowret = GST_FLOW_OK;
+   g_mutex_unlock(&bufferexchanger->inflightmutex);
+}
+
+void buffer_data_exchanger_set_streaming(BufferDataExchanger *bufferexchanger,
+                                         gboolean streaming)
+{
+   if( !DATAEXCHANGER_IS_BUFFER(bufferexchanger) )
+      return;
+
+   g_atomic_int_set(&bufferexchanger->streaming, streaming ? TRUE : FALSE);
+}
+
+void buffer_data_exchanger_set_caps(BufferDataExchanger *bufferexchanger,
+                                    GstCaps *caps)
+{
+   if( !DATAEXCHANGER_IS_BUFFER(bufferexchanger) ||
+       !GST_IS_CAPS(caps) )
+      return;
+
+   gsize frame_size = 0;
+   if( gst_caps_is_fixed(caps) &&
+       gst_structure_has_name(gst_caps_get_structure(caps, 0), "video/x-raw") &&
+       gst_caps_features_is_equal(gst_caps_get_features(caps, 0),
+                                  GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY) )
+   {
+      GstVideoInfo info;
+      if( gst_video_info_from_caps(&info, caps) )
+         frame_size = GST_VIDEO_INFO_SIZE(&info);
+   }
+
+   if( frame_size != bufferexchanger->video_frame_size )
+   {
+      GST_DEBUG_OBJECT (bufferexchanger, "video frame size changed from %"G_GSIZE_FORMAT
+                        " to %"G_GSIZE_FORMAT", flushing memory pool",
+                        bufferexchanger->video_frame_size, frame_size);
+      bufferexchanger->video_frame_size = frame_size;
+
+      //blocks sized for the previous caps won't be requested again
+      remote_offload_mem_pool_flush(bufferexchanger->mempool);
+   }
+}
+
 //Send the result of gst_pad_push(src, buffer)
 gboolean buffer_data_exchanger_send_buffer_flowreturn(BufferDataExchanger *bufferexchanger,
                                                   GstBuffer *buffer,
@@ -496,6 +973,19 @@ gboolean buffer_data_exchanger_send_buffer_flowreturn(BufferDataExchanger *buffe
 
 }
 
+gboolean buffer_data_exchanger_flowreturn_pending(BufferDataExchanger *bufferexchanger,
+                                                  GstBuffer *buffer)
+{
+   if( !DATAEXCHANGER_IS_BUFFER(bufferexchanger) ||
+       !GST_IS_BUFFER(buffer) )
+   {
+      return FALSE;
+   }
+
+   return gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer),
+                                    QUARK_BUFFER_RESPONSE_ID) != NULL;
+}
+
 static GstMemory *_AllocMetaDataSegment(BufferDataExchanger *self,
                                         guint16 segmentIndex,
                                         guint64 segmentSize,
@@ -550,9 +1040,11 @@ static GstMemory *_AllocMetaDataSegment(BufferDataExchanger *self,
                       g_array_append_val(metamemarraysofar, segmentMemsSoFar[si]);
                    }
 
-                   RemoteOffloadMetaSerializer *metaserializer = (RemoteOffloadMetaSerializer *)
-                           g_hash_table_lookup(self->metaSerializerHash,
-                                               pMetaHeader[meta_header_index].meta_api_str);
+                   //The buffer's meta ids may be defined within its own meta header.
+                   RegisterMetaIds(self, mapMetaHeader.data, mapMetaHeader.size,
+                                   pBufferHeader->nserializedmeta);
+                   RemoteOffloadMetaSerializer *metaserializer =
+                         LookupMetaSerializer(self, pMetaHeader[meta_header_index].meta_id);
 
                    if( metaserializer )
                    {
@@ -586,8 +1078,7 @@ static GstMemory* buffer_data_exchanger_allocate_data_segment(RemoteOffloadDataE
 
    if( segmentIndex == BUFFEREXCHANGE_HEADER_INDEX )
    {
-      //this is the header. Just use default allocator
-      mem = gst_allocator_alloc (NULL, segmentSize, NULL);
+      mem = remote_offload_mem_pool_acquire(self->headerpool, segmentSize);
    }
    else
    {
@@ -602,8 +1093,7 @@ static GstMemory* buffer_data_exchanger_allocate_data_segment(RemoteOffloadDataE
          {
             case BUFFEREXCHANGE_SEG_TYPE_METAHEADER:
             {
-              //this is the meta header. Just use default allocator
-              mem = gst_allocator_alloc (NULL, segmentSize, NULL);
+              mem = remote_offload_mem_pool_acquire(self->headerpool, segmentSize);
             }
             break;
             case BUFFEREXCHANGE_SEG_TYPE_MEM:
@@ -614,8 +1104,13 @@ static GstMemory* buffer_data_exchanger_allocate_data_segment(RemoteOffloadDataE
                }
                else
                {
-                  mem = gst_allocator_alloc (NULL, segmentSize, NULL);
+                  mem = remote_offload_mem_pool_acquire(self->mempool, segmentSize);
                }
+
+               //In streaming mode, the buffer is dispatched as soon as this (the first
+               // memory segment) is allocated. Whoever maps the memory waits for its data.
+               if( mem && g_atomic_int_get(&self->streaming) )
+                  mem = remote_offload_stream_memory_new(mem);
             }
             break;
             case BUFFEREXCHANGE_SEG_TYPE_META:
@@ -630,8 +1125,8 @@ static GstMemory* buffer_data_exchanger_allocate_data_segment(RemoteOffloadDataE
             default:
             break;
          }
+         gst_memory_unmap(segmentMemsSoFar[BUFFEREXCHANGE_HEADER_INDEX], &mapBufferHeader);
       }
-      gst_memory_unmap(segmentMemsSoFar[BUFFEREXCHANGE_HEADER_INDEX], &mapBufferHeader);
    }
 
    return mem;
@@ -664,9 +1159,35 @@ buffer_data_exchanger_finalize (GObject *object)
 {
   BufferDataExchanger *self = DATAEXCHANGER_BUFFER(object);
 
+  g_hash_table_destroy(self->metaTypeHash);
+  g_ptr_array_free(self->metaIdTable, TRUE);
+  g_mutex_clear(&self->metaidmutex);
   g_hash_table_destroy(self->metaSerializerHash);
   remote_offload_ext_registry_unref(self->ext_registry);
 
+  //The comms channel holds its own reference to any response that
+  // is still being waited on, so it's safe to just drop ours.
+  g_queue_foreach(&self->inflight_queue, (GFunc)g_object_unref, NULL);
+  g_queue_clear(&self->inflight_queue);
+  g_queue_clear(&self->inflight_links);
+  g_ptr_array_free(self->response_pool, TRUE);
+  g_mutex_clear(&self->inflightmutex);
+
+  for( guint i = 0; i < self->metaentries->len; i++ )
+     g_array_free(g_array_index(self->metaentries, SerializedMetaEntry, i).metaMemArray, TRUE);
+  g_array_free(self->metaentries, TRUE);
+  g_ptr_array_free(self->sendmems, TRUE);
+  g_ptr_array_free(self->sendtypes, TRUE);
+  g_array_free(self->memlistnodes, TRUE);
+  gst_memory_unref(self->headermem);
+  if( self->metaheadermem )
+     gst_memory_unref(self->metaheadermem);
+  g_mutex_clear(&self->sendmutex);
+
+  //memory that is still in use downstream holds its own reference to the pool
+  g_object_unref(self->mempool);
+  g_object_unref(self->headerpool);
+
   G_OBJECT_CLASS (buffer_data_exchanger_parent_class)->finalize (object);
 }
 
@@ -709,10 +1230,44 @@ static void
 buffer_data_exchanger_init (BufferDataExchanger *self)
 {
   self->callback = NULL;
+  g_mutex_init(&self->inflightmutex);
+  g_queue_init(&self->inflight_queue);
+  g_queue_init(&self->inflight_links);
+  self->response_pool = g_ptr_array_new_with_free_func(g_object_unref);
+  self->max_inflight = 1;
+  self->sticky_flowret = GST_FLOW_OK;
+  self->mempool = remote_offload_mem_pool_new(BUFFER_MEMPOOL_MAX_FREE);
+  self->headerpool = remote_offload_mem_pool_new(HEADER_MEMPOOL_MAX_FREE);
+  self->video_frame_size = 0;
+  self->streaming = FALSE;
+  g_mutex_init(&self->sendmutex);
+  memset(&self->sendheader, 0, sizeof(self->sendheader));
+  self->headermem = gst_memory_new_wrapped((GstMemoryFlags)0,
+                                           &self->sendheader,
+                                           sizeof(self->sendheader),
+                                           0,
+                                           sizeof(self->sendheader),
+                                           NULL,
+                                           NULL);
+  self->metaheaderdata = NULL;
+  self->metaheadercapacity = 0;
+  self->metaheadermem = NULL;
+  self->metaentries = g_array_new(FALSE, FALSE, sizeof(SerializedMetaEntry));
+  self->nmetaentries = 0;
+  self->sendmems = g_ptr_array_new();
+  self->sendtypes = g_ptr_array_new();
+  self->memlistnodes = g_array_new(FALSE, TRUE, sizeof(GList));
   self->metaSerializerHash = g_hash_table_new_full(g_str_hash,
                                                    g_str_equal,
                                                    KeyDestroyNotify,
                                                    ValueDestroyNotify);
+  self->metaTypeHash = g_hash_table_new_full(g_direct_hash,
+                                             g_direct_equal,
+                                             NULL,
+                                             g_free);
+  self->next_meta_id = 0;
+  g_mutex_init(&self->metaidmutex);
+  self->metaIdTable = g_ptr_array_new();
 
   //TODO: move to constructed method
   self->ext_registry = remote_offload_ext_registry_get_instance();
@@ -755,6 +1310,12 @@ buffer_data_exchanger_init (BufferDataExchanger *self)
                       g_strdup (remote_offload_meta_api_name(pVideoMetaSerializer)),
                       pVideoMetaSerializer);
 
+  RemoteOffloadMetaSerializer *pTraceMetaSerializer =
+        (RemoteOffloadMetaSerializer *)gst_trace_metaserializer_new();
+  g_hash_table_insert(self->metaSerializerHash,
+                      g_strdup (remote_offload_meta_api_name(pTraceMetaSerializer)),
+                      pTraceMetaSerializer);
+
 }
 
 BufferDataExchanger *buffer_data_exchanger_new (RemoteOffloadCommsChannel *channel,
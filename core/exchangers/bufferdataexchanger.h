@@ -43,14 +43,48 @@ typedef struct _BufferDataExchangerCallback
 BufferDataExchanger *buffer_data_exchanger_new (RemoteOffloadCommsChannel *channel,
                                                 BufferDataExchangerCallback *callback);
 
+//Send a buffer to the remote side. If max_inflight is 1 (the default), this blocks
+// until the remote side returns the GstFlowReturn for this buffer. Otherwise, this only
+// blocks while the window of in-flight buffers is full, and returns the first error
+// (or FLUSHING, EOS, etc.) collected from a previously sent buffer.
 GstFlowReturn buffer_data_exchanger_send_buffer(BufferDataExchanger *bufferexchanger,
                                                 GstBuffer *buffer);
 
+//Set the max number of buffers that may be sent before their GstFlowReturn
+// has been received. Clamped to REMOTEOFFLOAD_MAX_INFLIGHT_BUFFERS.
+void buffer_data_exchanger_set_max_inflight(BufferDataExchanger *bufferexchanger,
+                                            guint max_inflight);
+
+//Wait for all in-flight buffers to be acknowledged. Returns the
+// first failing GstFlowReturn collected, or GST_FLOW_OK.
+GstFlowReturn buffer_data_exchanger_drain(BufferDataExchanger *bufferexchanger);
+
+//Clear a previously collected failing GstFlowReturn (i.e. upon FLUSH_STOP)
+void buffer_data_exchanger_reset_flowreturn(BufferDataExchanger *bufferexchanger);
+
+//Inform the exchanger of the caps that received buffers will use. For raw video
+// in system memory, this sizes the pool that buffer memory is received into to
+// the frame size, and drops blocks pooled for previous caps.
+void buffer_data_exchanger_set_caps(BufferDataExchanger *bufferexchanger,
+                                    GstCaps *caps);
+
+//Enable / disable streaming receive. When enabled, a received buffer is passed to
+// the buffer_received callback as soon as its header & meta have arrived. Its memory
+// is still being received at that point, and mapping it blocks until the mapped
+// range has landed.
+void buffer_data_exchanger_set_streaming(BufferDataExchanger *bufferexchanger,
+                                         gboolean streaming);
+
 //Send the result of gst_pad_push(src, buffer)
 gboolean buffer_data_exchanger_send_buffer_flowreturn(BufferDataExchanger *bufferexchanger,
                                                   GstBuffer *buffer,
                                                   GstFlowReturn returnVal);
 
+//Returns TRUE if the sender of this (received) buffer is still waiting
+// for a call to buffer_data_exchanger_send_buffer_flowreturn()
+gboolean buffer_data_exchanger_flowreturn_pending(BufferDataExchanger *bufferexchanger,
+                                                  GstBuffer *buffer);
+
 G_END_DECLS
 
 #endif
@@ -307,7 +307,6 @@ generic_data_exchanger_class_init (GenericDataExchangerClass *klass)
                                      obj_properties);
 
   parent_class->received = generic_data_exchanger_received;
-  parent_class->allocate_data_segment = NULL;
 }
 
 static void
@@ -34,6 +34,7 @@
 #include "heartbeatdataexchanger.h"
 #include "remoteoffloadbinserializer.h"
 #include "remoteoffloadpipelinelogger.h"
+#include "remoteoffloadfilecache.h"
 #include "remoteoffloaddevice.h"
 #include "remoteoffloadutils.h"
 
@@ -90,8 +91,11 @@ typedef struct {
 
    gint32 logmode;
    gchar *gst_debug;
+   RemoteConnectionParams connectionparams;
    RemoteOffloadPipelineLogger *logger;
 
+   RemoteOffloadFileCache *filecache;
+
 }RemoteOffloadPipelinePrivate;
 
 struct _RemoteOffloadPipeline
@@ -303,6 +307,7 @@ remote_offload_pipeline_finalize (GObject *gobject)
   g_object_unref(self->priv.pPingExchanger);
   g_object_unref(self->priv.pGenericDataExchanger);
   g_object_unref(self->priv.pBinSerializer);
+  remote_offload_file_cache_free(self->priv.filecache);
 
   if( self->priv.gst_debug )
      g_free(self->priv.gst_debug);
@@ -402,6 +407,7 @@ remote_offload_pipeline_init (RemoteOffloadPipeline *self)
   self->priv.pGenericDataExchanger = NULL;
 
   self->priv.pBinSerializer = remote_offload_bin_serializer_new();
+  self->priv.filecache = remote_offload_file_cache_new();
   self->priv.deserializationOK = FALSE;
   self->priv.deserializationReceived = FALSE;
   g_mutex_init(&self->priv.rop_state_mutex);
@@ -413,6 +419,11 @@ remote_offload_pipeline_init (RemoteOffloadPipeline *self)
   self->priv.instanceparamsOK = FALSE;
 
   self->priv.logmode = REMOTEOFFLOAD_LOG_DISABLED;
+  self->priv.connectionparams.max_inflight_buffers = 1;
+  self->priv.connectionparams.early_ack_queue_depth = 0;
+  self->priv.connectionparams.streaming_receive = FALSE;
+  //the negotiation query cache is only used on the host side
+  self->priv.connectionparams.query_cache = FALSE;
   self->priv.logger = NULL;
   self->priv.gst_debug = NULL;
 
@@ -589,7 +600,8 @@ static gboolean BinSerializationReceived(RemoteOffloadPipeline *self,
    {
       if( AssembleRemoteConnections(pBin,
                                     remoteconnectioncandidates,
-                                    self->priv.id_to_channel_hash) )
+                                    self->priv.id_to_channel_hash,
+                                    &self->priv.connectionparams) )
       {
 
          if( gst_bin_add(GST_BIN(pipeline),
@@ -752,6 +764,14 @@ static gboolean GenericCallback(guint32 transfer_type, GArray *memblocks, void *
         return BinSerializationReceived(self, memblocks);
      break;
 
+     case BINPIPELINE_EXCHANGE_FILECACHE_QUERY:
+        return remote_offload_file_cache_query_received(self->priv.filecache, memblocks);
+     break;
+
+     case BINPIPELINE_EXCHANGE_FILECACHE_CHUNK:
+        return remote_offload_file_cache_chunk_received(self->priv.filecache, memblocks);
+     break;
+
      case BINPIPELINE_EXCHANGE_ROPINSTANCEPARAMS:
      {
         self->priv.instanceparamsOK = FALSE;
@@ -772,6 +792,12 @@ static gboolean GenericCallback(guint32 transfer_type, GArray *memblocks, void *
                           (RemoteOffloadInstanceParams *)memmap.data;
 
                     self->priv.logmode = params->logmode;
+                    self->priv.connectionparams.max_inflight_buffers =
+                          MAX(params->max_inflight_buffers, 1);
+                    self->priv.connectionparams.early_ack_queue_depth =
+                          params->early_ack_queue_depth;
+                    self->priv.connectionparams.streaming_receive =
+                          params->streaming_receive ? TRUE : FALSE;
                     self->priv.instanceparamsOK = TRUE;
                     if( params->gst_debug_set )
                     {
@@ -0,0 +1,187 @@
+/*
+ *  gsttracemetaserializer.c - GstTraceMetaSerializer object
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include "gsttracemetaserializer.h"
+#include "remoteoffloadmetaserializer.h"
+#include "remoteoffloadtracemeta.h"
+
+struct _GstTraceMetaSerializer
+{
+  GObject parent_instance;
+};
+
+static void gst_trace_metaserializer_interface_init (RemoteOffloadMetaSerializerInterface *iface);
+
+GST_DEBUG_CATEGORY_STATIC (trace_metaserializer_debug);
+#define GST_CAT_DEFAULT trace_metaserializer_debug
+
+G_DEFINE_TYPE_WITH_CODE (
+      GstTraceMetaSerializer, gst_trace_metaserializer, G_TYPE_OBJECT,
+      G_IMPLEMENT_INTERFACE (REMOTEOFFLOADMETASERIALIZER_TYPE,
+      gst_trace_metaserializer_interface_init)
+      GST_DEBUG_CATEGORY_INIT (trace_metaserializer_debug, "remoteoffloadtracemetaserializer", 0,
+      "debug category for GstTraceMetaSerializer"))
+
+
+//followed by 'nhops' RemoteOffloadTraceHop's
+typedef struct
+{
+   guint32 nhops;
+   guint8  domain;
+   guint8  overflowed;
+   guint16 reserved;
+} TraceMetaHeader;
+
+static const gchar* gst_trace_metaserializer_api_name(RemoteOffloadMetaSerializer *serializer)
+{
+   return "RemoteOffloadTraceMetaAPI";
+}
+
+static void SerializedDestroy(gpointer data)
+{
+   g_free(data);
+}
+
+static gboolean gst_trace_metaserializer_serialize(RemoteOffloadMetaSerializer *serializer,
+                                       GstMeta *meta,
+                                       GArray *metaMemArray)
+{
+   RemoteOffloadTraceMeta *trace_meta = (RemoteOffloadTraceMeta *)meta;
+
+   //The send hop is only added to the serialized copy, so that the buffer
+   // being sent (which may not be writable) isn't modified.
+   guint nhops = MIN(trace_meta->nhops + 1, REMOTEOFFLOAD_TRACE_META_MAX_HOPS);
+   gsize size = sizeof(TraceMetaHeader) + nhops * sizeof(RemoteOffloadTraceHop);
+
+   guint8 *data = (guint8 *)g_malloc0(size);
+   TraceMetaHeader *header = (TraceMetaHeader *)data;
+   RemoteOffloadTraceHop *hops = (RemoteOffloadTraceHop *)(data + sizeof(TraceMetaHeader));
+
+   header->nhops = nhops;
+   header->domain = trace_meta->domain;
+   header->overflowed = trace_meta->overflowed;
+   memcpy(hops, trace_meta->hops, trace_meta->nhops * sizeof(RemoteOffloadTraceHop));
+
+   if( nhops > trace_meta->nhops )
+   {
+      RemoteOffloadTraceHop *sendhop = &hops[trace_meta->nhops];
+      sendhop->ts = gst_util_get_timestamp();
+      sendhop->stage = REMOTEOFFLOAD_TRACE_STAGE_SEND;
+      sendhop->domain = trace_meta->domain;
+   }
+   else
+   {
+      header->overflowed = TRUE;
+   }
+
+   GstMemory *mem = gst_memory_new_wrapped((GstMemoryFlags)0,
+                                           data,
+                                           size,
+                                           0,
+                                           size,
+                                           data,
+                                           SerializedDestroy);
+
+   g_array_append_val(metaMemArray, mem);
+
+   return TRUE;
+}
+
+static gboolean gst_trace_metaserializer_deserialize(RemoteOffloadMetaSerializer *serializer,
+                                         GstBuffer *buffer,
+                                         const GArray *metaMemArray)
+{
+   if( metaMemArray->len != 1 )
+   {
+      GST_ERROR_OBJECT (serializer, "metaMemArray has incorrect size!");
+      return FALSE;
+   }
+
+   GstMemory **gstmems = (GstMemory **)metaMemArray->data;
+
+   GstMapInfo mapInfo;
+   if( !gst_memory_map (gstmems[0], &mapInfo, GST_MAP_READ) )
+   {
+     GST_ERROR_OBJECT (serializer, "Error mapping mem for reading.");
+     return FALSE;
+   }
+
+   TraceMetaHeader *header = (TraceMetaHeader *)mapInfo.data;
+   if( (mapInfo.size < sizeof(TraceMetaHeader)) ||
+       (header->nhops > REMOTEOFFLOAD_TRACE_META_MAX_HOPS) ||
+       (mapInfo.size < sizeof(TraceMetaHeader) + header->nhops * sizeof(RemoteOffloadTraceHop)) )
+   {
+      GST_ERROR_OBJECT (serializer, "Wrong size of serialized data.");
+      gst_memory_unmap(gstmems[0], &mapInfo);
+      return FALSE;
+   }
+
+   gboolean ret = TRUE;
+   RemoteOffloadTraceMeta *trace_meta = remote_offload_buffer_add_trace_meta(buffer);
+   if( trace_meta )
+   {
+      //the buffer has crossed into the next clock domain
+      trace_meta->domain = header->domain + 1;
+      trace_meta->overflowed = header->overflowed;
+      trace_meta->nhops = header->nhops;
+      memcpy(trace_meta->hops, mapInfo.data + sizeof(TraceMetaHeader),
+             header->nhops * sizeof(RemoteOffloadTraceHop));
+
+      remote_offload_trace_meta_add_hop(trace_meta, REMOTEOFFLOAD_TRACE_STAGE_RECEIVE);
+   }
+   else
+   {
+      GST_ERROR_OBJECT (serializer, "Error in remote_offload_buffer_add_trace_meta");
+      ret = FALSE;
+   }
+
+   gst_memory_unmap(gstmems[0], &mapInfo);
+
+   return ret;
+}
+
+
+static void gst_trace_metaserializer_interface_init (RemoteOffloadMetaSerializerInterface *iface)
+{
+  iface->api_name = gst_trace_metaserializer_api_name;
+  iface->serialize = gst_trace_metaserializer_serialize;
+  iface->deserialize = gst_trace_metaserializer_deserialize;
+  iface->allocate_data_segment = NULL;
+}
+
+static void
+gst_trace_metaserializer_class_init (GstTraceMetaSerializerClass *klass)
+{
+
+}
+
+static void
+gst_trace_metaserializer_init (GstTraceMetaSerializer *self)
+{
+
+}
+
+GstTraceMetaSerializer *gst_trace_metaserializer_new()
+{
+  return g_object_new(GSTTRACEMETASERIALIZER_TYPE, NULL);
+}
@@ -21,17 +21,37 @@
  */
 
 #include <gst/base/gstbytewriter.h>
+#include <gst/base/gstbytereader.h>
 #include <gst/video/gstvideometa.h>
 #ifndef NO_SAFESTR
   #include <safe_mem_lib.h>
+#else
+  #include <string.h>
 #endif
 #include "gstvideoroimetaserializer.h"
 #include "remoteoffloadmetaserializer.h"
+#include "remoteoffloadstructureserializer.h"
+#include "remoteoffloadutils.h"
+#include "remoteoffloadmempool.h"
+
+//max number of released serialized segments (of each size) kept for reuse
+#define SERIALIZED_MEMPOOL_MAX_FREE 16
 
 struct _GstVideoRegionOfInterestMetaSerializer
 {
   GObject parent_instance;
 
+  //param structure field names are interned per connection
+  RemoteOffloadStructureWriter *writer;
+  RemoteOffloadStructureReader *reader;
+
+  //writer mark at send_begin, to roll back to if the buffer is discarded
+  guint writer_mark;
+
+  //each meta is serialized into bw, and copied out to a block from pool, so
+  // that neither is allocated per meta once streaming.
+  GstByteWriter bw;
+  RemoteOffloadMemPool *pool;
 };
 
 static void
@@ -66,91 +86,62 @@ typedef struct
 } VideoROIMetaParamHeader;
 
 //Serialized GstVideoRegionOfInterestMeta looks like this:
+//segment 0:
 //[VideoROIMetaHeader]
 //[gchar *roi_str] (roi_type_strsize bytes)
 //(for each VideoROIMetaHeader.nparams):
 //[VideoROIMetaParamHeader]
-//[guint32 str_str_size]
-//[gchar *str_string] (str_str_size bytes)
-//VideoROIMetaParamHeader.data_buffer_size bytes
+//[param GstStructure] (see remoteoffloadstructureserializer.h)
+//segments 1..n:
+//The data_buffer of each param whose VideoROIMetaParamHeader.data_buffer_size > 0,
+// in param order, wrapped (not copied) from the 'data_buffer' GVariant.
 
-static void SerializedDestroy(gpointer data)
-{
-   g_free(data);
-}
+//'data_buffer' is sent as its own segment, and 'data' is a pointer into it.
+static const gchar * const param_skip_fields[] = {"data_buffer", "data", NULL};
 
-static inline void AddStringToBW(GstByteWriter *bw, char *str)
+typedef struct
 {
-   if( str )
-   {
-     guint32 size =
-#ifndef NO_SAFESTR
-           strnlen_s(str, RSIZE_MAX_STR) + 1;
-#else
-           strlen(str) + 1;
-#endif
-     gst_byte_writer_put_data( bw, (const guint8 *)&size, sizeof(size));
-     gst_byte_writer_put_data( bw, (const guint8 *)str, size);
-   }
-   else
-   {
-     guint32 size = 1;
-     gst_byte_writer_put_data( bw, (const guint8 *)&size, sizeof(size));
-     gst_byte_writer_put_uint8 (bw, 0);
-   }
-}
+   GstVideoRegionOfInterestMetaSerializer *self;
+   GstByteWriter *bw;
+   GArray *metaMemArray;
+} SerializeParamsContext;
 
 static void SerializeParams(gpointer       data,
                             gpointer       user_data)
 {
   GstStructure* s = (GstStructure*)data;
-  GstByteWriter *bw = (GstByteWriter *)user_data;
+  SerializeParamsContext *ctx = (SerializeParamsContext *)user_data;
+  GstByteWriter *bw = ctx->bw;
 
   VideoROIMetaParamHeader header;
   header.is_data_buffer = 0;
   header.data_buffer_size = 0;
 
-  GstStructure *s_cpy = NULL;
-  const void *array_data = NULL;
+  GstMemory *data_buffer_mem = NULL;
   const GValue *f = gst_structure_get_value(s, "data_buffer");
   if( f )
   {
      header.is_data_buffer = 1;
-     GVariant *v = g_value_get_variant(f);
-     gsize n_elem;
-     array_data = g_variant_get_fixed_array(v, &n_elem, 1);
-     if( array_data )
+     data_buffer_mem = remote_offload_variant_to_mem(g_value_get_variant(f));
+     if( data_buffer_mem )
      {
-        header.data_buffer_size = n_elem;
+        header.data_buffer_size = gst_memory_get_sizes(data_buffer_mem, NULL, NULL);
      }
-
-     s_cpy = gst_structure_copy(s);
-     gst_structure_remove_field(s_cpy, "data_buffer");
-     gst_structure_remove_field(s_cpy, "data");
-
-     s = s_cpy;
   }
 
   gst_byte_writer_put_data( bw, (const guint8 *)&header, sizeof(header));
 
-  //FIXME: For GVA classification results, the labels field (a string) might be really huge.
-  // 1. We get hit with an extra performance penalty for serializing this data.
-  // 2. It could very easily exceed safestring limits (4096 characters), which can
-  //    lead to undefined behavior.
-  // As this probably is unused by downstream elements (it's more informational),
-  //  remove this field from the structure before serializing it to a string.
-  gst_structure_remove_field(s, "labels");
-
-  gchar *str_string = gst_structure_to_string(s);
-  AddStringToBW(bw, str_string);
-  if( str_string )
-     g_free(str_string);
-  if( s_cpy )
-     gst_structure_free(s_cpy);
-
-  if( array_data )
+  if( !remote_offload_structure_write(ctx->self->writer, s, param_skip_fields, bw) )
+  {
+     GST_WARNING_OBJECT (ctx->self, "Unable to serialize param structure");
+     GstStructure *empty = gst_structure_new_empty(gst_structure_get_name(s));
+     remote_offload_structure_write(ctx->self->writer, empty, NULL, bw);
+     gst_structure_free(empty);
+  }
+
+  if( data_buffer_mem )
   {
-    gst_byte_writer_put_data( bw, (const guint8 *)array_data, header.data_buffer_size);
+    g_array_append_val(ctx->metaMemArray, data_buffer_mem);
   }
 
 }
@@ -165,10 +156,11 @@ static gboolean gst_videoroi_metaserializer_serialize(RemoteOffloadMetaSerialize
                                        GstMeta *meta,
                                        GArray *metaMemArray)
 {
+   GstVideoRegionOfInterestMetaSerializer *self = METASERIALIZER_VIDEOROI(serializer);
    GstVideoRegionOfInterestMeta* vidroi_meta = (GstVideoRegionOfInterestMeta*) meta;
 
-   GstByteWriter bw;
-   gst_byte_writer_init (&bw);
+   GstByteWriter *bw = &self->bw;
+   gst_byte_writer_set_pos (bw, 0);
 
    //build the VideoROIMetaHeader
    VideoROIMetaHeader gvaMetaHeader;
@@ -195,30 +187,43 @@ static gboolean gst_videoroi_metaserializer_serialize(RemoteOffloadMetaSerialize
       gvaMetaHeader.nparams = g_list_length(vidroi_meta->params);
    }
 
-   gst_byte_writer_put_data (&bw, (const guint8 *)&gvaMetaHeader, sizeof(gvaMetaHeader));
+   gst_byte_writer_put_data (bw, (const guint8 *)&gvaMetaHeader, sizeof(gvaMetaHeader));
 
    //write the roi_str
    if( gvaMetaHeader.roi_type_strsize )
-     gst_byte_writer_put_data (&bw, (const guint8 *)roi_str, gvaMetaHeader.roi_type_strsize);
+     gst_byte_writer_put_data (bw, (const guint8 *)roi_str, gvaMetaHeader.roi_type_strsize);
+
+   //data_buffer segments are appended as the parameters are serialized, so
+   // the header segment is inserted in front of them afterwards.
+   guint header_segment_index = metaMemArray->len;
 
    //serialize the parameters
    if( vidroi_meta->params )
    {
-      g_list_foreach(vidroi_meta->params, SerializeParams, &bw);
+      SerializeParamsContext ctx = {self, bw, metaMemArray};
+      g_list_foreach(vidroi_meta->params, SerializeParams, &ctx);
    }
 
-   gsize mem_size = gst_byte_writer_get_pos(&bw);
+   gsize mem_size = gst_byte_writer_get_pos(bw);
 
-   void *bwdata = gst_byte_writer_reset_and_get_data(&bw);
-   GstMemory *mem = gst_memory_new_wrapped((GstMemoryFlags)0,
-                                            bwdata,
-                                            mem_size,
-                                            0,
-                                            mem_size,
-                                            bwdata,
-                                            SerializedDestroy);
+   GstMemory *mem = remote_offload_mem_pool_acquire(self->pool, mem_size);
+   GstMapInfo mapInfo;
+   if( !mem || !gst_memory_map(mem, &mapInfo, GST_MAP_WRITE) )
+   {
+      GST_ERROR_OBJECT (serializer, "Error getting memory for serialized meta");
+      if( mem )
+         gst_memory_unref(mem);
+      return FALSE;
+   }
 
-   g_array_append_val(metaMemArray, mem);
+#ifndef NO_SAFESTR
+   memcpy_s(mapInfo.data, mem_size, bw->parent.data, mem_size);
+#else
+   memcpy(mapInfo.data, bw->parent.data, mem_size);
+#endif
+   gst_memory_unmap(mem, &mapInfo);
+
+   g_array_insert_val(metaMemArray, header_segment_index, mem);
 
    return TRUE;
 }
@@ -228,7 +233,7 @@ static gboolean gst_videoroi_metaserializer_deserialize(RemoteOffloadMetaSeriali
                                          GstBuffer *buffer,
                                          const GArray *metaMemArray)
 {
-   if( metaMemArray->len != 1 )
+   if( metaMemArray->len < 1 )
    {
       GST_ERROR_OBJECT (serializer, "metaMemArray has incorrect size!");
       return FALSE;
@@ -243,59 +248,122 @@ static gboolean gst_videoroi_metaserializer_deserialize(RemoteOffloadMetaSeriali
      return FALSE;
    }
 
-   guint8 *pSerialized = mapInfo.data;
-   VideoROIMetaHeader *pMetaHeader = (VideoROIMetaHeader *)pSerialized;
-   pSerialized += sizeof(VideoROIMetaHeader);
-   gchar *roi_type_str = 0;
-   if( pMetaHeader->roi_type_strsize )
+   GstVideoRegionOfInterestMetaSerializer *self = METASERIALIZER_VIDEOROI(serializer);
+   GstByteReader br;
+   gst_byte_reader_init(&br, mapInfo.data, mapInfo.size);
+
+   const guint8 *pHeader = NULL;
+   if( !gst_byte_reader_get_data(&br, sizeof(VideoROIMetaHeader), &pHeader) )
+   {
+      GST_ERROR_OBJECT (serializer, "Serialized meta is too small");
+      gst_memory_unmap(gstmems[0], &mapInfo);
+      return FALSE;
+   }
+   VideoROIMetaHeader metaHeader = *(const VideoROIMetaHeader *)pHeader;
+
+   const guint8 *roi_type_str = NULL;
+   if( metaHeader.roi_type_strsize &&
+       !gst_byte_reader_get_data(&br, metaHeader.roi_type_strsize, &roi_type_str) )
    {
-      roi_type_str = (gchar *)pSerialized;
-      pSerialized += pMetaHeader->roi_type_strsize;
+      GST_ERROR_OBJECT (serializer, "Serialized meta is too small");
+      gst_memory_unmap(gstmems[0], &mapInfo);
+      return FALSE;
    }
 
    //at this point, we can add the video roi meta to the buffer
    GstVideoRegionOfInterestMeta *meta = gst_buffer_add_video_region_of_interest_meta(
-            buffer, roi_type_str, pMetaHeader->x, pMetaHeader->y, pMetaHeader->w, pMetaHeader->h);
+            buffer, (const gchar *)roi_type_str, metaHeader.x, metaHeader.y, metaHeader.w, metaHeader.h);
 
    //for each param, deserialize it and add it to the meta
-   for(guint32 parami = 0; parami < pMetaHeader->nparams; parami++ )
+   gboolean ret = TRUE;
+   guint data_segment_index = 1;
+   for(guint32 parami = 0; parami < metaHeader.nparams; parami++ )
    {
-      VideoROIMetaParamHeader *pParamHeader = (VideoROIMetaParamHeader *)pSerialized;
-      pSerialized += sizeof(VideoROIMetaParamHeader);
-
-      guint32 *size = (guint32 *)pSerialized;
-      pSerialized += sizeof(guint32);
-
-      gchar *str = (gchar *)pSerialized;
-      pSerialized += *size;
-
+      const guint8 *pParamHeader = NULL;
+      if( !gst_byte_reader_get_data(&br, sizeof(VideoROIMetaParamHeader), &pParamHeader) )
+      {
+         ret = FALSE;
+         break;
+      }
+      VideoROIMetaParamHeader paramHeader = *(const VideoROIMetaParamHeader *)pParamHeader;
 
-      GstStructure *s = gst_structure_from_string(str, NULL);
+      GstStructure *s = remote_offload_structure_read(self->reader, &br);
       if( s == NULL )
       {
-         GST_WARNING_OBJECT (serializer, "gst_structure_from_string returned NULL");
+         ret = FALSE;
+         break;
       }
 
-      if( pParamHeader->is_data_buffer )
+      if( paramHeader.is_data_buffer )
       {
+         GVariant *v = NULL;
+         if( paramHeader.data_buffer_size )
+         {
+            //the segment needs to be the size that the header claims
+            if( (data_segment_index < metaMemArray->len) &&
+                (gst_memory_get_sizes(gstmems[data_segment_index], NULL, NULL) ==
+                 paramHeader.data_buffer_size) )
+            {
+               v = remote_offload_mem_to_byte_variant(gstmems[data_segment_index++]);
+            }
+            else
+            {
+               GST_ERROR_OBJECT (serializer, "data_buffer segment doesn't match its size (%u)",
+                                 paramHeader.data_buffer_size);
+            }
+
+            if( !v )
+            {
+               gst_structure_free(s);
+               ret = FALSE;
+               break;
+            }
+         }
+         else
+         {
+            v = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, NULL, 0, 1);
+         }
+
          gsize n_elem;
-         GVariant *v = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                                 pSerialized,
-                                                 pParamHeader->data_buffer_size, 1);
          gst_structure_set(s, "data_buffer", G_TYPE_VARIANT, v, "data", G_TYPE_POINTER,
                        g_variant_get_fixed_array(v, &n_elem, 1), NULL);
-
-         pSerialized += pParamHeader->data_buffer_size;
       }
 
       gst_video_region_of_interest_meta_add_param(meta, s);
    }
 
+   //every data_buffer segment that was sent should belong to a param
+   if( ret && (data_segment_index != metaMemArray->len) )
+   {
+      GST_ERROR_OBJECT (serializer, "%u segments were sent, but the params account for %u",
+                        metaMemArray->len, data_segment_index);
+      ret = FALSE;
+   }
+
+   if( !ret )
+   {
+      GST_ERROR_OBJECT (serializer, "Malformed serialized param");
+   }
+
    gst_memory_unmap(gstmems[0], &mapInfo);
 
-   return TRUE;
+   return ret;
+}
+
+
+static void gst_videoroi_metaserializer_send_begin(RemoteOffloadMetaSerializer *serializer)
+{
+   GstVideoRegionOfInterestMetaSerializer *self = METASERIALIZER_VIDEOROI(serializer);
+   self->writer_mark = remote_offload_structure_writer_get_mark(self->writer);
 }
 
+static void gst_videoroi_metaserializer_send_end(RemoteOffloadMetaSerializer *serializer,
+                                                 gboolean bsent)
+{
+   GstVideoRegionOfInterestMetaSerializer *self = METASERIALIZER_VIDEOROI(serializer);
+   if( !bsent )
+      remote_offload_structure_writer_rollback(self->writer, self->writer_mark);
+}
 
 static void
 gst_videoroi_metaserializer_interface_init (RemoteOffloadMetaSerializerInterface *iface)
@@ -304,19 +372,38 @@ gst_videoroi_metaserializer_interface_init (RemoteOffloadMetaSerializerInterface
   iface->serialize = gst_videoroi_metaserializer_serialize;
   iface->deserialize = gst_videoroi_metaserializer_deserialize;
   iface->allocate_data_segment = NULL;
+  iface->send_begin = gst_videoroi_metaserializer_send_begin;
+  iface->send_end = gst_videoroi_metaserializer_send_end;
+}
+
+static void
+gst_videoroi_metaserializer_finalize (GObject *gobject)
+{
+  GstVideoRegionOfInterestMetaSerializer *self = METASERIALIZER_VIDEOROI(gobject);
+
+  remote_offload_structure_writer_free(self->writer);
+  remote_offload_structure_reader_free(self->reader);
+  gst_byte_writer_reset(&self->bw);
+  g_object_unref(self->pool);
+
+  G_OBJECT_CLASS (gst_videoroi_metaserializer_parent_class)->finalize (gobject);
 }
 
 static void
 gst_videoroi_metaserializer_class_init (GstVideoRegionOfInterestMetaSerializerClass *klass)
 {
-  //GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->finalize = gst_videoroi_metaserializer_finalize;
 }
 
 static void
 gst_videoroi_metaserializer_init (GstVideoRegionOfInterestMetaSerializer *self)
 {
-
+  self->writer = remote_offload_structure_writer_new();
+  self->reader = remote_offload_structure_reader_new();
+  gst_byte_writer_init(&self->bw);
+  self->pool = remote_offload_mem_pool_new(SERIALIZED_MEMPOOL_MAX_FREE);
 }
 
 GstVideoRegionOfInterestMetaSerializer *gst_videoroi_metaserializer_new()
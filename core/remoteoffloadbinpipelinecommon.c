@@ -28,11 +28,13 @@
 
 gboolean AssembleRemoteConnections(GstBin *bin,
                                    GArray *remoteconnectioncandidates,
-                                   GHashTable *id_to_channel_hash)
+                                   GHashTable *id_to_channel_hash,
+                                   const RemoteConnectionParams *params)
 {
    if( !GST_IS_BIN(bin) ) return FALSE;
    if( !remoteconnectioncandidates ) return FALSE;
    if( !id_to_channel_hash ) return FALSE;
+   if( !params ) return FALSE;
 
    RemoteElementConnectionCandidate *connections =
                (RemoteElementConnectionCandidate *)remoteconnectioncandidates->data;
@@ -80,6 +82,8 @@ gboolean AssembleRemoteConnections(GstBin *bin,
             }
 
             g_object_set (pRemoteOffloadSink, "commschannel", (gpointer)channel,
+                                              "max-inflight-buffers", params->max_inflight_buffers,
+                                              "query-cache", params->query_cache,
                                               NULL);
 
             //add this appsink to the bin
@@ -127,6 +131,9 @@ gboolean AssembleRemoteConnections(GstBin *bin,
             }
 
             g_object_set (pRemoteOffloadSrc, "commschannel", (gpointer)channel,
+                                              "early-ack-queue-depth", params->early_ack_queue_depth,
+                                              "streaming-receive", params->streaming_receive,
+                                              "query-cache", params->query_cache,
                                               NULL);
             //add this appsrc to our bin
             if( !gst_bin_add(bin, pRemoteOffloadSrc) )
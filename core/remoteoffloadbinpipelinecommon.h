@@ -30,13 +30,27 @@ typedef enum
   BINPIPELINE_EXCHANGE_ROPREADY = 0x100,
   BINPIPELINE_EXCHANGE_ROPINSTANCEPARAMS,
   BINPIPELINE_EXCHANGE_BINSERIALIZATION,
-  BINPIPELINE_EXCHANGE_LOGMESSAGE
+  BINPIPELINE_EXCHANGE_LOGMESSAGE,
+  BINPIPELINE_EXCHANGE_FILECACHE_QUERY,
+  BINPIPELINE_EXCHANGE_FILECACHE_CHUNK
 }BinPipelineGenericTransferCodes;
 
 typedef struct _RemoteOffloadComms RemoteOffloadComms;
+
+//Settings applied to the remoteoffloadingress / remoteoffloadegress
+// elements created by AssembleRemoteConnections
+typedef struct _RemoteConnectionParams
+{
+  guint max_inflight_buffers;   //ingress "max-inflight-buffers"
+  guint early_ack_queue_depth;  //egress "early-ack-queue-depth"
+  gboolean streaming_receive;   //egress "streaming-receive"
+  gboolean query_cache;         //ingress & egress "query-cache"
+}RemoteConnectionParams;
+
 gboolean AssembleRemoteConnections(GstBin *bin,
                                    GArray *remoteconnectioncandidates,
-                                   GHashTable *id_to_channel_hash);
+                                   GHashTable *id_to_channel_hash,
+                                   const RemoteConnectionParams *params);
 
 /**
  * RemoteOffloadLogMode:
@@ -70,6 +84,9 @@ typedef struct _RemoteOffloadInstanceParams
   gint32 logmode;
   gint32 gst_debug_set;
   gchar gst_debug[ROP_INSTANCEPARAMS_GST_DEBUG_STRINGSIZE];
+  guint32 max_inflight_buffers;
+  guint32 early_ack_queue_depth;
+  gint32 streaming_receive;
 }RemoteOffloadInstanceParams;
 
 
@@ -22,6 +22,7 @@
 #include "remoteoffloadbinserializer.h"
 #include "remoteoffloadelementserializer.h"
 #include "orderedghashtable.h"
+#include "remoteoffloadfilecache.h"
 
 //Example, Bin Description for 3 elements, 6 pads
 //
@@ -264,7 +265,9 @@ static gboolean serialize_elements(RemoteOffloadBinSerializer *serializer,
             // into our "small property" bytewriter stream. We take the hit of an extra copy
             // here, but probably save cycles / latency overall as compared with having to
             // send a small isolated memory block as a separate transfer.
-            if( memblocksize < SMALL_PROP_THRESHOLD )
+            // File refs are never merged, as they need to be found in the memblock
+            // array by remote_offload_file_cache_sync.
+            if( (memblocksize < SMALL_PROP_THRESHOLD) && !remote_offload_file_ref_is_ref(mem) )
             {
                GstMapInfo mapInfo;
                if( gst_memory_map (mem, &mapInfo, GST_MAP_READ) )
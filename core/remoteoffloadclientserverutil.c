@@ -23,8 +23,10 @@
 #include <stdlib.h>
 #include <gst/gst.h>
 #include <sys/wait.h>
+#include <unistd.h>
 #include "remoteoffloadclientserverutil.h"
 #include "remoteoffloadcommsio.h"
+#include "remoteoffloadcommsiorecord.h"
 #include "remoteoffloadcomms.h"
 #include "remoteoffloadcommschannel.h"
 #include "gstremoteoffloadpipeline.h"
@@ -99,6 +101,101 @@ static void CommsValDestroy(gpointer data)
    g_object_unref(comms);
 }
 
+static void StripesValDestroy(gpointer data)
+{
+   g_array_free((GArray *)data, TRUE);
+}
+
+//Group the stripe entries of the pair array by the commsio of the channel
+// that they were registered with. Returns a commsio to GArray (of stripe
+// RemoteOffloadCommsIO*'s) hash, or NULL upon error.
+static GHashTable *id_commsio_pair_array_to_stripes_hash(GArray *id_commsio_pair_array)
+{
+   GHashTable *commsio_to_stripes_hash =
+         g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, StripesValDestroy);
+
+   ChannelIdCommsIOPair *pairs = (ChannelIdCommsIOPair *)id_commsio_pair_array->data;
+   for( guint pairi = 0; pairi < id_commsio_pair_array->len; pairi++)
+   {
+      if( !pairs[pairi].stripe )
+         continue;
+
+      RemoteOffloadCommsIO *channelcommsio = NULL;
+      for( guint i = 0; i < id_commsio_pair_array->len; i++ )
+      {
+         if( !pairs[i].stripe && (pairs[i].channel_id == pairs[pairi].channel_id) )
+         {
+            channelcommsio = pairs[i].commsio;
+            break;
+         }
+      }
+
+      if( !channelcommsio )
+      {
+         GST_ERROR("Stripe commsio(%p) refers to unknown channel-id=%d",
+                   pairs[pairi].commsio, pairs[pairi].channel_id);
+         g_hash_table_destroy(commsio_to_stripes_hash);
+         return NULL;
+      }
+
+      GArray *stripes = g_hash_table_lookup(commsio_to_stripes_hash, channelcommsio);
+      if( !stripes )
+      {
+         stripes = g_array_new(FALSE, FALSE, sizeof(RemoteOffloadCommsIO *));
+         g_hash_table_insert(commsio_to_stripes_hash, channelcommsio, stripes);
+      }
+      g_array_append_val(stripes, pairs[pairi].commsio);
+   }
+
+   return commsio_to_stripes_hash;
+}
+
+//If GST_REMOTEOFFLOAD_RECORD=<prefix> is set, return a CommsIO that records the
+// traffic of commsio to <prefix>-<pid>-<n>.rotrace. Payloads are recorded, unless
+// GST_REMOTEOFFLOAD_RECORD_HASH_ONLY is set. Otherwise, returns a new ref of commsio.
+static RemoteOffloadCommsIO *wrap_commsio_for_recording(GArray *id_commsio_pair_array,
+                                                        RemoteOffloadCommsIO *commsio,
+                                                        gboolean bstriped)
+{
+   static gint tracecount = 0;
+
+   const gchar *prefix = g_getenv("GST_REMOTEOFFLOAD_RECORD");
+   if( !prefix || !*prefix )
+      return g_object_ref(commsio);
+
+   //part of the traffic of a striped comms would bypass the recorder
+   if( bstriped )
+   {
+      GST_WARNING("Not recording commsio(%p), as recording striped comms isn't supported",
+                  commsio);
+      return g_object_ref(commsio);
+   }
+
+   gchar *tracefile = g_strdup_printf("%s-%d-%d.rotrace", prefix, (gint)getpid(),
+                                      g_atomic_int_add(&tracecount, 1));
+   gboolean bpayload = (g_getenv("GST_REMOTEOFFLOAD_RECORD_HASH_ONLY") == NULL);
+
+   GArray *channel_ids = g_array_new(FALSE, FALSE, sizeof(gint));
+   ChannelIdCommsIOPair *pairs = (ChannelIdCommsIOPair *)id_commsio_pair_array->data;
+   for( guint pairi = 0; pairi < id_commsio_pair_array->len; pairi++ )
+   {
+      if( !pairs[pairi].stripe && (pairs[pairi].commsio == commsio) )
+         g_array_append_val(channel_ids, pairs[pairi].channel_id);
+   }
+
+   RemoteOffloadCommsIO *recorder =
+         (RemoteOffloadCommsIO *)remote_offload_comms_io_record_new(commsio, tracefile,
+                                                                    channel_ids, bpayload);
+   g_array_free(channel_ids, TRUE);
+   g_free(tracefile);
+
+   //recording is best-effort, don't fail the connection because of it.
+   if( !recorder )
+      return g_object_ref(commsio);
+
+   return recorder;
+}
+
 GHashTable *id_commsio_pair_array_to_id_to_channel_hash(GArray *id_commsio_pair_array)
 {
    register_debug_category();
@@ -106,13 +203,22 @@ GHashTable *id_commsio_pair_array_to_id_to_channel_hash(GArray *id_commsio_pair_
          g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, CommsValDestroy);
    GHashTable *id_to_channel_hash =
          g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, ChannelValDestroy);
+   GHashTable *commsio_to_stripes_hash = NULL;
    gboolean bokay = TRUE;
 
    if( id_commsio_pair_array && id_commsio_pair_array->len )
    {
+      commsio_to_stripes_hash = id_commsio_pair_array_to_stripes_hash(id_commsio_pair_array);
+      if( !commsio_to_stripes_hash )
+         bokay = FALSE;
+
       ChannelIdCommsIOPair *pairs = (ChannelIdCommsIOPair *)id_commsio_pair_array->data;
-      for( guint pairi = 0; pairi < id_commsio_pair_array->len; pairi++)
+      for( guint pairi = 0; bokay && (pairi < id_commsio_pair_array->len); pairi++)
       {
+         //stripes are attached to the comms of their channel, below.
+         if( pairs[pairi].stripe )
+            continue;
+
          RemoteOffloadCommsIO *commsio = pairs[pairi].commsio;
 
          //If we haven't yet create a comms object from this commsio, create one.
@@ -120,7 +226,15 @@ GHashTable *id_commsio_pair_array_to_id_to_channel_hash(GArray *id_commsio_pair_
          if( !comms )
          {
             //create one.
-            comms = remote_offload_comms_new(commsio);
+            GArray *stripes = g_hash_table_lookup(commsio_to_stripes_hash, commsio);
+            RemoteOffloadCommsIO *commscommsio =
+                  wrap_commsio_for_recording(id_commsio_pair_array, commsio,
+                                             stripes != NULL);
+            if( stripes )
+               comms = remote_offload_comms_new_striped(commscommsio, stripes);
+            else
+               comms = remote_offload_comms_new(commscommsio);
+            g_object_unref(commscommsio);
             if( !comms )
             {
                bokay = FALSE;
@@ -128,6 +242,9 @@ GHashTable *id_commsio_pair_array_to_id_to_channel_hash(GArray *id_commsio_pair_
                break;
             }
             g_hash_table_insert(commsio_to_comms_hash, commsio, comms);
+
+            if( pairs[pairi].compression.codec != REMOTEOFFLOAD_COMPRESSION_NONE )
+               remote_offload_comms_set_compression(comms, &pairs[pairi].compression);
          }
 
          //create a comms channel, using this comms
@@ -158,6 +275,8 @@ GHashTable *id_commsio_pair_array_to_id_to_channel_hash(GArray *id_commsio_pair_
    }
 
    g_hash_table_destroy(commsio_to_comms_hash);
+   if( commsio_to_stripes_hash )
+      g_hash_table_destroy(commsio_to_stripes_hash);
    if( !bokay )
    {
       g_hash_table_destroy(id_to_channel_hash);
@@ -346,7 +465,9 @@ typedef enum
   COMMSIOSTARTUP_NEW_PIPELINE_PLACEHOLDER = 0x77,
   COMMSIOSTARTUP_REGISTER_CHANNEL,
   COMMSIOSTARTUP_DONE,
-  COMMSIOSTARTUP_START_PIPELINE
+  COMMSIOSTARTUP_START_PIPELINE,
+  COMMSIOSTARTUP_REGISTER_STRIPE,
+  COMMSIOSTARTUP_NEGOTIATE_COMPRESSION
 }CommsIOStartupCodes;
 
 typedef enum
@@ -377,7 +498,8 @@ gboolean remote_offload_request_new_pipeline(GArray *id_commsio_pair_array)
          status_okay = FALSE;
       }
 
-      if( !g_hash_table_insert(hash_id_to_comms_channel,
+      if( !pairs[i].stripe &&
+          !g_hash_table_insert(hash_id_to_comms_channel,
                                GINT_TO_POINTER(pairs[i].channel_id), NULL) )
       {
          GST_ERROR("id_commsio_pair_array contains two entries with channel-id=%d",
@@ -400,6 +522,24 @@ gboolean remote_offload_request_new_pipeline(GArray *id_commsio_pair_array)
       }
    }
 
+   //a commsio that's used for a stripe can't be used for anything else
+   for( guint i = 0; status_okay && (i < id_commsio_pair_array->len); i++ )
+   {
+      if( !pairs[i].stripe )
+         continue;
+
+      for( guint j = 0; j < id_commsio_pair_array->len; j++ )
+      {
+         if( (j != i) && (pairs[j].commsio == pairs[i].commsio) )
+         {
+            GST_ERROR("stripe commsio (%p) is used by more than one entry of "
+                      "id_commsio_pair_array", pairs[i].commsio);
+            status_okay = FALSE;
+            break;
+         }
+      }
+   }
+
    guint64 handle = 0;
    if( status_okay )
    {
@@ -455,13 +595,76 @@ gboolean remote_offload_request_new_pipeline(GArray *id_commsio_pair_array)
       }
    }
 
-   //need to register each channel
+   //negotiate the compression of each commsio that carries channels, before
+   // registering them. The server replies with the codec that it accepted.
+   for( guint i = 0; status_okay && (i < id_commsio_pair_array->len); i++ )
+   {
+      if( pairs[i].stripe || (pairs[i].compression.codec == REMOTEOFFLOAD_COMPRESSION_NONE) )
+         continue;
+
+      //only negotiate once per commsio
+      gboolean negotiated = FALSE;
+      for( guint j = 0; j < i; j++ )
+      {
+         if( !pairs[j].stripe && (pairs[j].commsio == pairs[i].commsio) )
+         {
+            negotiated = TRUE;
+            break;
+         }
+      }
+
+      if( negotiated )
+         continue;
+
+      guint code = COMMSIOSTARTUP_NEGOTIATE_COMPRESSION;
+      guint32 params[2] = { (guint32)pairs[i].compression.codec,
+                            pairs[i].compression.threshold };
+      guint32 accepted = REMOTEOFFLOAD_COMPRESSION_NONE;
+      guint32 server_status = 0;
+      if( (remote_offload_comms_io_write(pairs[i].commsio, (guint8 *)&code, sizeof(code)) !=
+           REMOTEOFFLOADCOMMSIO_SUCCESS) ||
+          (remote_offload_comms_io_write(pairs[i].commsio, (guint8 *)params, sizeof(params)) !=
+           REMOTEOFFLOADCOMMSIO_SUCCESS) ||
+          (remote_offload_comms_io_read(pairs[i].commsio, (guint8 *)&accepted,
+                                        sizeof(accepted)) != REMOTEOFFLOADCOMMSIO_SUCCESS) ||
+          (remote_offload_comms_io_read(pairs[i].commsio, (guint8 *)&server_status,
+                                        sizeof(server_status)) != REMOTEOFFLOADCOMMSIO_SUCCESS) )
+      {
+         status_okay = FALSE;
+         GST_ERROR("Error negotiating compression");
+         break;
+      }
+
+      if( server_status != COMMSIOSTARTUP_OKAY )
+      {
+         status_okay = FALSE;
+         GST_ERROR("Server sent bad startup status");
+         break;
+      }
+
+      if( accepted != params[0] )
+      {
+         GST_WARNING("Server doesn't support %s compression. Continuing without compression.",
+                     remote_offload_compression_codec_name(pairs[i].compression.codec));
+         accepted = REMOTEOFFLOAD_COMPRESSION_NONE;
+      }
+
+      for( guint j = i; j < id_commsio_pair_array->len; j++ )
+      {
+         if( !pairs[j].stripe && (pairs[j].commsio == pairs[i].commsio) )
+            pairs[j].compression.codec = (RemoteOffloadCompressionCodec)accepted;
+      }
+   }
+
+   //need to register each channel (and stripe). Note that each is registered
+   // before moving onto the next, so the server sees the stripes in the same order.
    if( status_okay )
    {
      for( guint i = 0; i < id_commsio_pair_array->len; i++ )
      {
         RemoteOffloadCommsIOResult res;
-        guint code = COMMSIOSTARTUP_REGISTER_CHANNEL;
+        guint code = pairs[i].stripe ? COMMSIOSTARTUP_REGISTER_STRIPE :
+                                       COMMSIOSTARTUP_REGISTER_CHANNEL;
         res = remote_offload_comms_io_write(pairs[i].commsio,
                                             (guint8 *)&code,
                                             sizeof(code));
@@ -598,6 +801,9 @@ static gpointer CommsIOTemporaryThread(void *arg)
    gboolean start_pipeline = FALSE;
    guint64 handle = 0;
 
+   //the compression that was negotiated for this commsio (if any)
+   RemoteOffloadCompressionParams compression = { REMOTEOFFLOAD_COMPRESSION_NONE, 0 };
+
    //reader loop
    while(1)
    {
@@ -647,6 +853,7 @@ static gpointer CommsIOTemporaryThread(void *arg)
          break;
 
          case COMMSIOSTARTUP_REGISTER_CHANNEL:
+         case COMMSIOSTARTUP_REGISTER_STRIPE:
          {
             GST_DEBUG_OBJECT(pcommsio,
                             "CommsIOTemporaryThread: COMMSIOSTARTUP_REGISTER_CHANNEL start");
@@ -683,6 +890,8 @@ static gpointer CommsIOTemporaryThread(void *arg)
                ChannelIdCommsIOPair pair;
                pair.channel_id = channel_id;
                pair.commsio = g_object_ref(pcommsio);
+               pair.stripe = (startup_code == COMMSIOSTARTUP_REGISTER_STRIPE);
+               pair.compression = compression;
                g_array_append_val(placeholder->id_commsio_pair_array, pair);
             }
             else
@@ -698,6 +907,39 @@ static gpointer CommsIOTemporaryThread(void *arg)
          }
          break;
 
+         case COMMSIOSTARTUP_NEGOTIATE_COMPRESSION:
+         {
+            guint32 params[2];
+            res = remote_offload_comms_io_read(pcommsio, (guint8 *)params, sizeof(params));
+            if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            {
+               GST_ERROR_OBJECT(pcommsio, "Error in remote_offload_comms_io_read");
+               status_ok = FALSE;
+               break;
+            }
+
+            //accept the requested codec only if this side supports it too
+            guint32 accepted = REMOTEOFFLOAD_COMPRESSION_NONE;
+            if( remote_offload_compression_codec_supported((RemoteOffloadCompressionCodec)params[0]) )
+               accepted = params[0];
+
+            GST_DEBUG_OBJECT(pcommsio, "CommsIOTemporaryThread: COMMSIOSTARTUP_NEGOTIATE_COMPRESSION "
+                             "requested=%u, accepted=%u, threshold=%u",
+                             params[0], accepted, params[1]);
+
+            compression.codec = (RemoteOffloadCompressionCodec)accepted;
+            compression.threshold = params[1];
+
+            res = remote_offload_comms_io_write(pcommsio, (guint8 *)&accepted, sizeof(accepted));
+            if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            {
+               GST_ERROR_OBJECT(pcommsio, "Error in remote_offload_comms_io_write");
+               status_ok = FALSE;
+               break;
+            }
+         }
+         break;
+
          case COMMSIOSTARTUP_DONE:
          {
             GST_DEBUG_OBJECT(pcommsio, "CommsIOTemporaryThread: COMMSIOSTARTUP_DONE");
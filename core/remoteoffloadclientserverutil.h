@@ -25,6 +25,7 @@
 #define _REMOTEOFFLOAD_CLIENTSERVER_UTIL_H_
 
 #include <glib-object.h>
+#include "remoteoffloadcompression.h"
 
 G_BEGIN_DECLS
 
@@ -37,6 +38,18 @@ typedef struct _ChannelIdCommsIOPair
 {
    gint channel_id;
    RemoteOffloadCommsIO *commsio;
+
+   //If TRUE, commsio doesn't carry a channel of its own. Instead, it's an additional
+   // stripe of the comms that channel_id's commsio is used for, which large data
+   // segments are striped across. The stripes of a comms are used in the order that
+   // they appear in the array.
+   gboolean stripe;
+
+   //The compression requested for commsio (by the client). All of the (non-stripe)
+   // entries that share a commsio need to request the same compression. It is
+   // negotiated with the server by remote_offload_request_new_pipeline, which
+   // updates the codec to the one that the server accepted.
+   RemoteOffloadCompressionParams compression;
 }ChannelIdCommsIOPair;
 
 //Request that the server spawns a pipeline with the following channel_id / commsio pairs
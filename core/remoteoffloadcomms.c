@@ -19,9 +19,12 @@
  *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
  *  Boston, MA 02110-1301 USA
  */
+#include <string.h>
 #include "remoteoffloadcomms.h"
 #include "remoteoffloadprivateinterfaces.h"
 #include "remoteoffloadcommschannel.h"
+#include "remoteoffloadstreammemory.h"
+#include "remoteoffloadmempool.h"
 
 enum
 {
@@ -32,21 +35,51 @@ enum
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
 
 #define DEFAULT_DATA_SEGMENT_HEADER_BUFFER_CAPACITY 128
+#define COMPRESSION_MEMPOOL_MAX_FREE 8
 
 /* Private structure definition. */
 typedef struct {
    RemoteOffloadCommsIO *pcommsio;
    GThread *reader_thread;
    gboolean is_state_okay;
-   GMutex writemutex; //will ensure that writes are serialized
+   GMutex writemutex; //protects the write state below
+   GCond writecond;
+   gboolean write_in_progress; //TRUE while a thread owns the CommsIO for writing
+   gboolean preemptible_in_progress; //TRUE while that write accepts interleaved writes
+   gint32 preemptible_channel_id; //channel id of the preemptible write in progress
+   guint ncontrol_waiters;
+   GQueue *pending_interleaved_writes; //PendingInterleavedWrite's, to interleave in current write
    GMutex statemutex;
    guint16 datasegmentheaderbuffercapacity;
    DataSegmentHeader *pDataSegmentHeaderWriteBuffer;
 
+   //Memories that the headers of a transfer are written from. These, and the
+   // write lists, are reused so that writing doesn't allocate once streaming.
+   GstMemory *datasegheadermem; //wraps pDataSegmentHeaderWriteBuffer
+   GstMemory *nointerleavedmem; //interleave count of 0
+   guint32 ninterleaved;
+   GstMemory *interleavedmem;   //wraps ninterleaved
+   struct _WriteList *preemptible_write_list;
+   struct _WriteList *routine_write_list;
+
    GMutex hashprotectmutex;
    GHashTable *hash_id_to_comms_channel;
 
    gboolean breject_writes;
+
+   //Additional CommsIO's that large data segments are striped across.
+   // Each has a StripeWorker for writing, and one for reading.
+   GPtrArray *stripe_writers;
+   GPtrArray *stripe_readers;
+   struct _StripeJob *stripe_write_jobs;
+   struct _StripeJob *stripe_read_jobs;
+
+   RemoteOffloadCompressionParams compression;
+   GMutex compressionstatsmutex;
+   GHashTable *compression_stats; //channel id -> RemoteOffloadCompressionStats*
+   RemoteOffloadMemPool *compressionpool; //recycled output blocks for compressed segments
+   GMutex compressionscratchmutex;
+   GPtrArray *compressionscratch; //unused CompressedSegments
 }RemoteOffloadCommsPrivate;
 
 struct _RemoteOffloadComms
@@ -67,6 +100,158 @@ GST_DEBUG_CATEGORY_INIT (remote_offload_comms_debug, "remoteoffloadcomms", 0,
 
 static gpointer RemoteOffloadCommsReader(gpointer data);
 
+//A piece of a striped data segment, to be read or written by a StripeWorker
+typedef struct _StripeJob
+{
+   gsize offset;    //offset of this piece within the segment
+   gsize size;
+   guint8 *data;    //destination of a read
+   GstMemory *mem;  //source of a write
+   RemoteOffloadCommsIOResult res;
+   gboolean done;
+}StripeJob;
+
+//Each stripe has a thread for writing, and another for reading, so that (just like
+// the main CommsIO) both directions make progress independently of each other.
+typedef struct
+{
+   RemoteOffloadCommsIO *commsio;
+   GThread *thread;
+   GMutex mutex;
+   GCond cond;
+   StripeJob *job; //job to be performed, or NULL
+   gboolean bThreadRun;
+}StripeWorker;
+
+static gpointer StripeWorkerThread(gpointer data)
+{
+   StripeWorker *worker = (StripeWorker *)data;
+
+   g_mutex_lock(&worker->mutex);
+   while( 1 )
+   {
+      while( worker->bThreadRun && !worker->job )
+         g_cond_wait(&worker->cond, &worker->mutex);
+
+      if( !worker->bThreadRun )
+         break;
+
+      StripeJob *job = worker->job;
+      g_mutex_unlock(&worker->mutex);
+
+      RemoteOffloadCommsIOResult res;
+      if( job->mem )
+         res = remote_offload_comms_io_write_mem(worker->commsio, job->mem);
+      else
+         res = remote_offload_comms_io_read(worker->commsio, job->data, job->size);
+
+      g_mutex_lock(&worker->mutex);
+      job->res = res;
+      job->done = TRUE;
+      worker->job = NULL;
+      g_cond_broadcast(&worker->cond);
+   }
+
+   //complete a job that was submitted after we were told to stop
+   if( worker->job )
+   {
+      worker->job->res = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      worker->job->done = TRUE;
+      worker->job = NULL;
+      g_cond_broadcast(&worker->cond);
+   }
+   g_mutex_unlock(&worker->mutex);
+
+   return NULL;
+}
+
+static StripeWorker *stripe_worker_new(RemoteOffloadCommsIO *commsio,
+                                       const gchar *name)
+{
+   StripeWorker *worker = g_malloc(sizeof(StripeWorker));
+   worker->commsio = g_object_ref(commsio);
+   g_mutex_init(&worker->mutex);
+   g_cond_init(&worker->cond);
+   worker->job = NULL;
+   worker->bThreadRun = TRUE;
+   worker->thread = g_thread_new(name, (GThreadFunc)StripeWorkerThread, worker);
+
+   return worker;
+}
+
+static void stripe_worker_free(gpointer data)
+{
+   StripeWorker *worker = (StripeWorker *)data;
+
+   g_mutex_lock(&worker->mutex);
+   worker->bThreadRun = FALSE;
+   g_cond_broadcast(&worker->cond);
+   g_mutex_unlock(&worker->mutex);
+   g_thread_join(worker->thread);
+
+   g_object_unref(worker->commsio);
+   g_mutex_clear(&worker->mutex);
+   g_cond_clear(&worker->cond);
+   g_free(worker);
+}
+
+static void stripe_worker_submit(StripeWorker *worker, StripeJob *job)
+{
+   job->res = REMOTEOFFLOADCOMMSIO_FAIL;
+   job->done = FALSE;
+
+   g_mutex_lock(&worker->mutex);
+   worker->job = job;
+   g_cond_broadcast(&worker->cond);
+   g_mutex_unlock(&worker->mutex);
+}
+
+static RemoteOffloadCommsIOResult stripe_worker_wait(StripeWorker *worker, StripeJob *job)
+{
+   g_mutex_lock(&worker->mutex);
+   while( !job->done )
+      g_cond_wait(&worker->cond, &worker->mutex);
+   g_mutex_unlock(&worker->mutex);
+
+   return job->res;
+}
+
+static inline guint remote_offload_comms_nstripes(RemoteOffloadComms *pComms)
+{
+   return pComms->priv.stripe_writers ? pComms->priv.stripe_writers->len : 0;
+}
+
+//Shut down the stripe CommsIO's, so that stripe jobs in progress are aborted.
+static void remote_offload_comms_shutdown_stripes(RemoteOffloadComms *pComms)
+{
+   for( guint i = 0; i < remote_offload_comms_nstripes(pComms); i++ )
+   {
+      StripeWorker *worker = g_ptr_array_index(pComms->priv.stripe_writers, i);
+      remote_offload_comms_io_shutdown(worker->commsio);
+   }
+}
+
+//Set the offset & size of the jobs for pieces 1..nstripes of a striped segment
+// of size bytes, and return the size of the piece (0) that goes to the main
+// CommsIO. Pieces that are empty get a job size of 0, and aren't transferred.
+static gsize remote_offload_comms_stripe_pieces(RemoteOffloadComms *pComms,
+                                                StripeJob *jobs,
+                                                gsize size)
+{
+   guint nstripes = remote_offload_comms_nstripes(pComms);
+   gsize piecesize = DATATRANSFER_STRIPE_PIECE_SIZE(size, nstripes + 1);
+
+   for( guint i = 0; i < nstripes; i++ )
+   {
+      jobs[i].offset = MIN((i + 1) * piecesize, size);
+      jobs[i].size = MIN(piecesize, size - jobs[i].offset);
+      jobs[i].data = NULL;
+      jobs[i].mem = NULL;
+   }
+
+   return MIN(piecesize, size);
+}
+
 void remote_offload_comms_error_state(RemoteOffloadComms *pComms)
 {
    if( !REMOTEOFFLOAD_IS_COMMS(pComms) )
@@ -80,10 +265,12 @@ void remote_offload_comms_error_state(RemoteOffloadComms *pComms)
       //Trigger closure of our read thread.
       if( pComms->priv.pcommsio)
          remote_offload_comms_io_shutdown(pComms->priv.pcommsio);
+      remote_offload_comms_shutdown_stripes(pComms);
 
       //And then prevent further writes taking place over this comms-channel
       g_mutex_lock(&pComms->priv.writemutex);
       pComms->priv.breject_writes = TRUE;
+      g_cond_broadcast(&pComms->priv.writecond);
       g_mutex_unlock(&pComms->priv.writemutex);
    }
    g_mutex_unlock(&pComms->priv.statemutex);
@@ -117,154 +304,685 @@ static void declare_comms_error(RemoteOffloadComms *pComms)
 }
 
 
-static gpointer RemoteOffloadCommsReader(gpointer data)
+//Obtain the compression stats of the given channel.
+// This should be called with the compressionstatsmutex locked.
+static RemoteOffloadCompressionStats *compression_stats_for_channel(RemoteOffloadComms *pComms,
+                                                                    gint32 id)
+{
+   RemoteOffloadCompressionStats *stats =
+         g_hash_table_lookup(pComms->priv.compression_stats, GINT_TO_POINTER(id));
+   if( !stats )
+   {
+      stats = g_new0(RemoteOffloadCompressionStats, 1);
+      g_hash_table_insert(pComms->priv.compression_stats, GINT_TO_POINTER(id), stats);
+   }
+
+   return stats;
+}
+
+//Buffer that the DataSegmentHeader's of a received transfer are read into
+typedef struct
+{
+   DataSegmentHeader *headers;
+   guint64 *uncompressed_sizes; //same capacity as headers
+   guint16 capacity;
+
+   //compressed segments are received into here, before being decompressed
+   guint8 *scratch;
+   gsize scratchsize;
+}DataSegmentHeaderReadBuffer;
+
+//Size of the received data segment segi, once it's been decompressed
+static inline gsize ReceivedSegmentSize(const DataTransferHeader *header,
+                                        const DataSegmentHeaderReadBuffer *dsbuf,
+                                        guint16 segi)
+{
+   if( (header->flags & DATATRANSFER_FLAG_COMPRESSED) && dsbuf->uncompressed_sizes[segi] )
+      return (gsize)dsbuf->uncompressed_sizes[segi];
+
+   return (gsize)dsbuf->headers[segi].segmentSize;
+}
+
+static RemoteOffloadCommsIOResult ReceiveDataTransfer(RemoteOffloadComms *pComms,
+                                                      DataSegmentHeaderReadBuffer *dsbuf,
+                                                      DataSegmentHeaderReadBuffer *interleaveddsbuf,
+                                                      gboolean *bEnd);
+
+//Receive the transfers that the writer interleaved before the next chunk
+// of a preemptible transfer.
+static RemoteOffloadCommsIOResult ReceiveInterleavedTransfers(RemoteOffloadComms *pComms,
+                                                    DataSegmentHeaderReadBuffer *interleaveddsbuf)
+{
+   guint32 ninterleaved = 0;
+   RemoteOffloadCommsIOResult res = remote_offload_comms_io_read(pComms->priv.pcommsio,
+                                                                 (guint8 *)&ninterleaved,
+                                                                 sizeof(ninterleaved));
+   if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+   {
+      if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+      {
+         GST_ERROR_OBJECT (pComms, "Error in remote_offload_comms_read for interleave count");
+         declare_comms_error(pComms);
+      }
+      return res;
+   }
+
+   for( guint32 i = 0; i < ninterleaved; i++ )
+   {
+      gboolean bEnd = FALSE;
+
+      //interleaved transfers are never preemptible themselves, so there's no
+      // need for another level of buffer here.
+      res = ReceiveDataTransfer(pComms, interleaveddsbuf, NULL, &bEnd);
+      if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+         return res;
+
+      if( G_UNLIKELY(bEnd) )
+      {
+         GST_ERROR_OBJECT (pComms, "Received end of read loop within an interleaved transfer");
+         declare_comms_error(pComms);
+         return REMOTEOFFLOADCOMMSIO_FAIL;
+      }
+   }
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+//Receive size bytes of a data segment into data, in pieces of at most DATATRANSFER_CHUNK_SIZE.
+// For a preemptible transfer, the transfers interleaved before each chunk (except the
+// first, which the caller receives) are received too. If streammem is set, it's
+// informed as each piece lands.
+static RemoteOffloadCommsIOResult ReceiveSegmentChunks(RemoteOffloadComms *pComms,
+                                                    guint8 *data,
+                                                    gsize size,
+                                                    gboolean bpreemptible,
+                                                    DataSegmentHeaderReadBuffer *interleaveddsbuf,
+                                                    GstMemory *streammem)
+{
+   RemoteOffloadCommsIOResult res = REMOTEOFFLOADCOMMSIO_SUCCESS;
+   for( gsize offset = 0; offset < size; offset += DATATRANSFER_CHUNK_SIZE )
+   {
+      if( bpreemptible && (offset > 0) )
+      {
+         res = ReceiveInterleavedTransfers(pComms, interleaveddsbuf);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
+      }
+
+      gsize chunkSize = MIN(size - offset, DATATRANSFER_CHUNK_SIZE);
+      res = remote_offload_comms_io_read(pComms->priv.pcommsio, data + offset, chunkSize);
+      if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      {
+         if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+         {
+            GST_ERROR_OBJECT (pComms,
+                              "Error in remote_offload_comms_read for data segment chunk "
+                              "(%"G_GSIZE_FORMAT" bytes)", chunkSize);
+            declare_comms_error(pComms);
+         }
+         break;
+      }
+
+      if( streammem )
+         remote_offload_stream_memory_advance(streammem, chunkSize);
+   }
+
+   return res;
+}
+
+//Receive a data segment of a transfer with the given DataTransferHeader flags into data.
+// If the segment is striped, the pieces that were sent on the stripes are received
+// in parallel with the piece that was sent on the main CommsIO.
+static RemoteOffloadCommsIOResult ReceiveSegmentData(RemoteOffloadComms *pComms,
+                                                    guint8 *data,
+                                                    gsize size,
+                                                    guint16 flags,
+                                                    DataSegmentHeaderReadBuffer *interleaveddsbuf,
+                                                    GstMemory *streammem)
+{
+   gboolean bpreemptible = (flags & DATATRANSFER_FLAG_PREEMPTIBLE) != 0;
+
+   if( !(flags & DATATRANSFER_FLAG_STRIPED) || (size < DATATRANSFER_STRIPE_MIN_SIZE) )
+      return ReceiveSegmentChunks(pComms, data, size, bpreemptible, interleaveddsbuf, streammem);
+
+   guint nstripes = remote_offload_comms_nstripes(pComms);
+   if( G_UNLIKELY(!nstripes) )
+   {
+      GST_ERROR_OBJECT (pComms, "Received a striped transfer, but this comms has no stripes");
+      declare_comms_error(pComms);
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+   }
+
+   StripeJob *jobs = pComms->priv.stripe_read_jobs;
+   gsize mainSize = remote_offload_comms_stripe_pieces(pComms, jobs, size);
+   for( guint i = 0; i < nstripes; i++ )
+   {
+      if( jobs[i].size )
+      {
+         jobs[i].data = data + jobs[i].offset;
+         stripe_worker_submit(g_ptr_array_index(pComms->priv.stripe_readers, i), &jobs[i]);
+      }
+   }
+
+   RemoteOffloadCommsIOResult res = ReceiveSegmentChunks(pComms, data, mainSize, bpreemptible,
+                                                         interleaveddsbuf, streammem);
+
+   //The rest of this transfer won't arrive, so don't wait for it.
+   if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      remote_offload_comms_shutdown_stripes(pComms);
+
+   for( guint i = 0; i < nstripes; i++ )
+   {
+      if( !jobs[i].size )
+         continue;
+
+      RemoteOffloadCommsIOResult striperes =
+            stripe_worker_wait(g_ptr_array_index(pComms->priv.stripe_readers, i), &jobs[i]);
+      if( (res == REMOTEOFFLOADCOMMSIO_SUCCESS) && (striperes != REMOTEOFFLOADCOMMSIO_SUCCESS) )
+      {
+         res = striperes;
+         if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+         {
+            GST_ERROR_OBJECT (pComms, "Error reading piece of striped data segment from stripe %u "
+                              "(%"G_GSIZE_FORMAT" bytes)", i, jobs[i].size);
+            declare_comms_error(pComms);
+         }
+      }
+   }
+
+   if( (res == REMOTEOFFLOADCOMMSIO_SUCCESS) && streammem )
+      remote_offload_stream_memory_advance(streammem, size - mainSize);
+
+   return res;
+}
+
+//Receive a data segment of size bytes into data. A compressed segment (one whose
+// wiresize differs from its size) is received into the scratch buffer of dsbuf, and
+// then decompressed into data.
+static RemoteOffloadCommsIOResult ReceiveSegment(RemoteOffloadComms *pComms,
+                                                 const DataTransferHeader *header,
+                                                 DataSegmentHeaderReadBuffer *dsbuf,
+                                                 DataSegmentHeaderReadBuffer *interleaveddsbuf,
+                                                 guint8 *data,
+                                                 gsize size,
+                                                 gsize wiresize,
+                                                 GstMemory *streammem)
+{
+   if( wiresize == size )
+      return ReceiveSegmentData(pComms, data, size, header->flags, interleaveddsbuf, streammem);
+
+   if( wiresize > dsbuf->scratchsize )
+   {
+      g_free(dsbuf->scratch);
+      dsbuf->scratch = g_try_malloc(wiresize);
+      if( !dsbuf->scratch )
+      {
+         GST_ERROR_OBJECT (pComms, "Error allocating decompression buffer (%"G_GSIZE_FORMAT" bytes)",
+                           wiresize);
+         dsbuf->scratchsize = 0;
+         declare_comms_error(pComms);
+         return REMOTEOFFLOADCOMMSIO_FAIL;
+      }
+      dsbuf->scratchsize = wiresize;
+   }
+
+   RemoteOffloadCommsIOResult res = ReceiveSegmentData(pComms, dsbuf->scratch, wiresize,
+                                                       header->flags, interleaveddsbuf, NULL);
+   if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      return res;
+
+   guint64 start = remote_offload_compression_thread_cpu_time_ns();
+   gboolean bdecompressed = remote_offload_decompress(pComms->priv.compression.codec,
+                                                      dsbuf->scratch, wiresize, data, size);
+   guint64 cpu_ns = remote_offload_compression_thread_cpu_time_ns() - start;
+
+   if( !bdecompressed )
+   {
+      GST_ERROR_OBJECT (pComms, "Error decompressing data segment (%"G_GSIZE_FORMAT
+                        " -> %"G_GSIZE_FORMAT" bytes)", wiresize, size);
+      declare_comms_error(pComms);
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+   }
+
+   g_mutex_lock(&pComms->priv.compressionstatsmutex);
+   RemoteOffloadCompressionStats *stats = compression_stats_for_channel(pComms, header->id);
+   stats->nsegments_decompressed++;
+   stats->bytes_decompressed += size;
+   stats->decompress_cpu_ns += cpu_ns;
+   g_mutex_unlock(&pComms->priv.compressionstatsmutex);
+
+   if( streammem )
+      remote_offload_stream_memory_advance(streammem, size);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+//Obtain a GstMemory to receive a data segment into.
+// Based on the receiveheader.id, the comms channel object is requested,
+// which in turn requests it from the data exchanger that this transfer is
+// destined for. Falls back to the default allocator. Returns NULL (and declares
+// a comms error) upon failure.
+static GstMemory *AllocateDataSegment(RemoteOffloadComms *pComms,
+                                      RemoteOffloadCommsCallback *pCallback,
+                                      const DataTransferHeader *receiveheader,
+                                      guint16 segi,
+                                      gsize segmentSize,
+                                      const GArray *segmemarray)
+{
+   GstMemory *mem = remote_offload_comms_callback_allocate_data_segment(pCallback,
+                                                                receiveheader->dataTransferType,
+                                                                segi,
+                                                                segmentSize,
+                                                                segmemarray);
+   if( mem )
+   {
+      gsize offset, maxsize;
+      gsize memsize = gst_memory_get_sizes(mem, &offset, &maxsize);
+      if( memsize != segmentSize )
+      {
+         if( (maxsize - offset) < segmentSize )
+         {
+            GST_WARNING_OBJECT (pComms, "Allocated segment too small (%"G_GSIZE_FORMAT
+                                " < %"G_GSIZE_FORMAT"), using default allocator",
+                                maxsize - offset, segmentSize);
+            gst_memory_unref(mem);
+            mem = NULL;
+         }
+         else
+         {
+            gst_memory_resize(mem, 0, segmentSize);
+         }
+      }
+   }
+
+   if( !mem )
+   {
+      mem = gst_allocator_alloc (NULL, segmentSize, NULL);
+      if( !mem )
+      {
+         GST_ERROR_OBJECT (pComms, "Error allocating data segment (%"G_GSIZE_FORMAT" bytes)",
+                           segmentSize);
+         declare_comms_error(pComms);
+      }
+   }
+
+   return mem;
+}
+
+//Receive a single data transfer, and pass it to the comms channel that it's destined for.
+// bEnd is set if the remote side sent the instruction to end the read loop.
+static RemoteOffloadCommsIOResult ReceiveDataTransfer(RemoteOffloadComms *pComms,
+                                                      DataSegmentHeaderReadBuffer *dsbuf,
+                                                      DataSegmentHeaderReadBuffer *interleaveddsbuf,
+                                                      gboolean *bEnd)
 {
-   RemoteOffloadComms *pComms = REMOTEOFFLOAD_COMMS(data);
    RemoteOffloadCommsIO *pcommsio = pComms->priv.pcommsio;
+   RemoteOffloadCommsIOResult res;
 
-   GST_DEBUG_OBJECT (pComms, "Comms thread start");
+   //step 1: receive the data transfer header
+   DataTransferHeader receiveheader;
 
-   guint16 current_dsheaderbuf_capacity =  DEFAULT_DATA_SEGMENT_HEADER_BUFFER_CAPACITY;
-   DataSegmentHeader *pDataSegmentHeaderBuffer =
-         (DataSegmentHeader *)g_malloc(current_dsheaderbuf_capacity*sizeof(DataSegmentHeader));
-   if( !pDataSegmentHeaderBuffer )
+   res = remote_offload_comms_io_read(pcommsio, (guint8 *)&receiveheader,
+                                      sizeof(receiveheader));
+   if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
    {
-      GST_ERROR_OBJECT (pComms, "Error allocating DataSegmentHeader buffer");
-      return NULL;
+      if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+      {
+        GST_ERROR_OBJECT (pComms, "Error in remote_offload_comms_read for receiveheader");
+        declare_comms_error(pComms);
+      }
+      return res;
    }
 
-   while(1)
+   if( receiveheader.id == -1 )
    {
-     RemoteOffloadCommsIOResult res;
+      GST_DEBUG_OBJECT (pComms, "Received instruction to end read loop");
+      *bEnd = TRUE;
+      return REMOTEOFFLOADCOMMSIO_SUCCESS;
+   }
 
-     //step 1: receive the data transfer header
-     DataTransferHeader receiveheader;
+   gboolean bpreemptible = (receiveheader.flags & DATATRANSFER_FLAG_PREEMPTIBLE) != 0;
+   gboolean bcompressed = (receiveheader.flags & DATATRANSFER_FLAG_COMPRESSED) != 0;
+   if( G_UNLIKELY(bpreemptible && !interleaveddsbuf) )
+   {
+      GST_ERROR_OBJECT (pComms, "Received a preemptible transfer within an interleaved transfer");
+      declare_comms_error(pComms);
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+   }
 
-     res = remote_offload_comms_io_read(pcommsio, (guint8 *)&receiveheader,
-                                        sizeof(receiveheader));
-     if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
-     {
-        if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+   //only preemptible transfers are striped
+   if( G_UNLIKELY((receiveheader.flags & DATATRANSFER_FLAG_STRIPED) && !bpreemptible) )
+   {
+      GST_ERROR_OBJECT (pComms, "Received a striped transfer that isn't preemptible");
+      declare_comms_error(pComms);
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+   }
+
+   if( G_UNLIKELY(bcompressed &&
+                  (pComms->priv.compression.codec == REMOTEOFFLOAD_COMPRESSION_NONE)) )
+   {
+      GST_ERROR_OBJECT (pComms, "Received a compressed transfer, but compression isn't enabled");
+      declare_comms_error(pComms);
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+   }
+
+   //given the header channel-id, retrieve the callback object
+   RemoteOffloadCommsCallback *pCallback =
+         g_hash_table_lookup (pComms->priv.hash_id_to_comms_channel,
+                              GINT_TO_POINTER(receiveheader.id));
+
+   if( !pCallback )
+   {
+      GST_ERROR_OBJECT (pComms,
+                        "Error retrieving callback object for channel-id=%d", receiveheader.id);
+      declare_comms_error(pComms);
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+   }
+
+   //step 2: receive the data segment headers
+   if( receiveheader.nsegments > 0 )
+   {
+      if( receiveheader.nsegments > dsbuf->capacity )
+      {
+
+        GST_INFO_OBJECT (pComms, "Resizing DataSegmentHeader buffer capacity from %u to %u",
+                         dsbuf->capacity, receiveheader.nsegments);
+        dsbuf->capacity = receiveheader.nsegments;
+
+        dsbuf->headers =
+              g_realloc(dsbuf->headers,
+              dsbuf->capacity*sizeof(DataSegmentHeader));
+        dsbuf->uncompressed_sizes =
+              g_realloc(dsbuf->uncompressed_sizes,
+              dsbuf->capacity*sizeof(guint64));
+        if( !dsbuf->headers || !dsbuf->uncompressed_sizes )
         {
-          GST_ERROR_OBJECT (pComms, "Error in remote_offload_comms_read for receiveheader");
+          GST_ERROR_OBJECT (pComms, "Error resizing DataSegmentHeader buffer to a capacity of %u",
+                            receiveheader.nsegments);
+          dsbuf->capacity = 0;
           declare_comms_error(pComms);
+          return REMOTEOFFLOADCOMMSIO_FAIL;
         }
-        break;
-     }
+      }
 
-     if( receiveheader.id == -1 )
-     {
-        GST_DEBUG_OBJECT (pComms, "Received instruction to end read loop");
-        break;
-     }
+      res = remote_offload_comms_io_read(pcommsio, (guint8 *)dsbuf->headers,
+                                         receiveheader.nsegments*sizeof(DataSegmentHeader));
+      if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      {
+         if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+         {
+           GST_ERROR_OBJECT (pComms,
+                             "Error in remote_offload_comms_read for data segment headers "
+                             "(%"G_GSIZE_FORMAT" bytes)",
+                             receiveheader.nsegments*sizeof(DataTransferHeader));
+           declare_comms_error(pComms);
+         }
+         return res;
+      }
 
-     //given the header channel-id, retrieve the callback object
-     RemoteOffloadCommsCallback *pCallback =
-           g_hash_table_lookup (pComms->priv.hash_id_to_comms_channel,
-                                GINT_TO_POINTER(receiveheader.id));
+      if( bcompressed )
+      {
+         res = remote_offload_comms_io_read(pcommsio, (guint8 *)dsbuf->uncompressed_sizes,
+                                            receiveheader.nsegments*sizeof(guint64));
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+         {
+            if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+            {
+              GST_ERROR_OBJECT (pComms,
+                                "Error in remote_offload_comms_read for uncompressed segment sizes");
+              declare_comms_error(pComms);
+            }
+            return res;
+         }
+      }
+   }
 
-     if( !pCallback )
-     {
-        GST_ERROR_OBJECT (pComms,
-                          "Error retrieving callback object for channel-id=%d", receiveheader.id);
-        declare_comms_error(pComms);
-        break;
-     }
+   GArray *segmemarray = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
 
-     //step 2: receive the data segment headers
-     if( receiveheader.nsegments > 0 )
-     {
-        if( receiveheader.nsegments > current_dsheaderbuf_capacity )
-        {
+   //Once the transfer has been dispatched early (cut-through), this holds our own
+   // reference to the stream memories of segments streamstart..nsegments-1
+   GArray *streammemarray = NULL;
+   guint16 streamstart = 0;
+
+   //step 3: Receive each data segment
+   for( guint16 segi = 0; segi < receiveheader.nsegments; segi++ )
+   {
+      //Other transfers may have been interleaved before the first chunk of this segment.
+      if( bpreemptible )
+      {
+         res = ReceiveInterleavedTransfers(pComms, interleaveddsbuf);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
+      }
+
+      //segmentSize is the size that the segment will have once it's been received,
+      // and wireSize the (possibly compressed) number of bytes to read for it.
+      gsize wireSize = (gsize)dsbuf->headers[segi].segmentSize;
+      gsize segmentSize = ReceivedSegmentSize(&receiveheader, dsbuf, segi);
+
+      if( streammemarray )
+      {
+         GstMemory *streammem = g_array_index(streammemarray, GstMemory *, segi - streamstart);
+         res = ReceiveSegment(pComms,
+                              &receiveheader,
+                              dsbuf,
+                              interleaveddsbuf,
+                              remote_offload_stream_memory_get_data(streammem),
+                              segmentSize,
+                              wireSize,
+                              streammem);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
+
+         continue;
+      }
 
-          GST_INFO_OBJECT (pComms, "Resizing DataSegmentHeader buffer capacity from %u to %u",
-                           current_dsheaderbuf_capacity, receiveheader.nsegments);
-          current_dsheaderbuf_capacity = receiveheader.nsegments;
-
-          pDataSegmentHeaderBuffer =
-                g_realloc(pDataSegmentHeaderBuffer,
-                current_dsheaderbuf_capacity*sizeof(DataSegmentHeader));
-          if( !pDataSegmentHeaderBuffer )
-          {
-            GST_ERROR_OBJECT (pComms, "Error resizing DataSegmentHeader buffer to a capacity of %u",
-                              receiveheader.nsegments);
+      //Segments that are received in chunks, or need to be decompressed, are
+      // received through a mapping of the memory they end up in.
+      gboolean bmapped = (wireSize != segmentSize) ||
+                         (bpreemptible && (wireSize > DATATRANSFER_CHUNK_SIZE));
+
+      //If the CommsIO can hand over the segment directly (i.e. as a reference
+      // to the memory that the peer wrote), there's nothing to allocate or copy.
+      GstMemory *mem = NULL;
+      if( !bmapped )
+         res = remote_offload_comms_io_read_mem_ref(pcommsio, segmentSize, &mem);
+      if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      {
+         if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+         {
+           GST_ERROR_OBJECT (pComms,
+                             "Error in remote_offload_comms_io_read_mem_ref for data segment "
+                             "(%"G_GSIZE_FORMAT" bytes)",
+                             segmentSize);
+           declare_comms_error(pComms);
+         }
+         break;
+      }
+
+      if( mem )
+      {
+         g_array_append_val (segmemarray, mem);
+         continue;
+      }
+
+      mem = AllocateDataSegment(pComms, pCallback, &receiveheader, segi, segmentSize, segmemarray);
+      if( !mem )
+      {
+         res = REMOTEOFFLOADCOMMSIO_FAIL;
+         break;
+      }
+
+      g_array_append_val (segmemarray, mem);
+
+      //If the exchanger handed back a stream memory, it wants the transfer
+      // dispatched as soon as possible. Obtain the memories for the remaining segments
+      // now, (wrapping them as stream memories too), and pass the transfer to the
+      // channel before receiving the data for any of them.
+      if( remote_offload_stream_memory_is_stream(mem) )
+      {
+         for( guint16 si = segi + 1; si < receiveheader.nsegments; si++ )
+         {
+            GstMemory *streammem = AllocateDataSegment(pComms, pCallback, &receiveheader, si,
+                                                       ReceivedSegmentSize(&receiveheader,
+                                                                           dsbuf, si),
+                                                       segmemarray);
+            if( streammem && !remote_offload_stream_memory_is_stream(streammem) )
+               streammem = remote_offload_stream_memory_new(streammem);
+
+            if( !streammem )
+            {
+               GST_ERROR_OBJECT (pComms, "Error obtaining stream memory for data segment %u", si);
+               declare_comms_error(pComms);
+               res = REMOTEOFFLOADCOMMSIO_FAIL;
+               break;
+            }
+
+            g_array_append_val (segmemarray, streammem);
+         }
+
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
+
+         streamstart = segi;
+         streammemarray = g_array_sized_new(FALSE, FALSE, sizeof(GstMemory *),
+                                            receiveheader.nsegments - segi);
+         for( guint si = segi; si < receiveheader.nsegments; si++ )
+         {
+            GstMemory *streammem = gst_memory_ref(g_array_index(segmemarray, GstMemory *, si));
+            g_array_append_val (streammemarray, streammem);
+         }
+
+         GST_LOG_OBJECT (pComms, "Dispatching transfer before segments %u-%u have been received",
+                         segi, receiveheader.nsegments - 1);
+         remote_offload_comms_callback_data_transfer_received(pCallback, &receiveheader,
+                                                              segmemarray);
+         g_array_unref(segmemarray);
+         segmemarray = NULL;
+
+         res = ReceiveSegment(pComms,
+                              &receiveheader,
+                              dsbuf,
+                              interleaveddsbuf,
+                              remote_offload_stream_memory_get_data(mem),
+                              segmentSize,
+                              wireSize,
+                              mem);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
+
+         continue;
+      }
+
+      //receive this data segment
+      if( bmapped )
+      {
+         GstMapInfo map;
+         if( !gst_memory_map (mem, &map, GST_MAP_WRITE) )
+         {
+            GST_ERROR_OBJECT (pComms, "Error mapping data segment for writing");
             declare_comms_error(pComms);
+            res = REMOTEOFFLOADCOMMSIO_FAIL;
             break;
-          }
-        }
+         }
 
-        res = remote_offload_comms_io_read(pcommsio, (guint8 *)pDataSegmentHeaderBuffer,
-                                           receiveheader.nsegments*sizeof(DataSegmentHeader));
-        if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
-        {
-           if( res == REMOTEOFFLOADCOMMSIO_FAIL )
-           {
-             GST_ERROR_OBJECT (pComms,
-                               "Error in remote_offload_comms_read for data segment headers "
-                               "(%"G_GSIZE_FORMAT" bytes)",
-                               receiveheader.nsegments*sizeof(DataTransferHeader));
-             declare_comms_error(pComms);
-           }
-           break;
-        }
-     }
+         //errors are already handled within
+         res = ReceiveSegment(pComms, &receiveheader, dsbuf, interleaveddsbuf,
+                              map.data, map.size, wireSize, NULL);
+         gst_memory_unmap(mem, &map);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
 
-     GArray *segmemarray = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
+         continue;
+      }
 
-     //step 3: Receive each data segment
-     for( guint16 segi = 0; segi < receiveheader.nsegments; segi++ )
-     {
-        //We need to obtain a GstMemory to receive this segment into.
-        // Based on the receiveheader.id, retrieve the comms channel object
-        // to request from
-        GstMemory *mem =
-              gst_allocator_alloc (NULL, pDataSegmentHeaderBuffer[segi].segmentSize, NULL);
-       //TOD0: We should really be using the below call that up-requests the memblock allocation
-       // from the comms channel
-#if 0
-        GstMemory *mem =
-              remote_offload_comms_callback_allocate_data_segment(pCallback,
-                                                                  receiveheader.dataTransferType,
-                                                                  segi,
-                                                                  dsHeaders[segi].segmentSize,
-                                                                  segmemarray);
-#endif
-        g_array_append_val (segmemarray, mem);
-
-        GstMapInfo map;
-        gst_memory_map (mem, &map, GST_MAP_WRITE);
-
-        //receive this data segment
-        res = remote_offload_comms_io_read(pcommsio,
-                                           (guint8 *)map.data,
-                                           pDataSegmentHeaderBuffer[segi].segmentSize);
-        if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
-        {
-           if( res == REMOTEOFFLOADCOMMSIO_FAIL )
-           {
-             GST_ERROR_OBJECT (pComms,
-                               "Error in remote_offload_comms_read for data segment headers "
-                               "(%"G_GSIZE_FORMAT" bytes)",
-                               receiveheader.nsegments*sizeof(DataTransferHeader));
-             declare_comms_error(pComms);
-           }
-           break;
-        }
+      res = remote_offload_comms_io_read_mem(pcommsio, mem);
+      if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      {
+         if( res == REMOTEOFFLOADCOMMSIO_FAIL )
+         {
+           GST_ERROR_OBJECT (pComms,
+                             "Error in remote_offload_comms_read_mem for data segment "
+                             "(%"G_GSIZE_FORMAT" bytes)",
+                             segmentSize);
+           declare_comms_error(pComms);
+         }
+         break;
+      }
+   }
 
-        gst_memory_unmap (mem, &map);
-     }
+   //The transfer was already dispatched, so just drop our references to the
+   // stream memories. If the rest of the data won't arrive, wake up whoever
+   // may be waiting for it.
+   if( streammemarray )
+   {
+      for( guint i = 0; i < streammemarray->len; i++ )
+      {
+         GstMemory *streammem = g_array_index(streammemarray, GstMemory *, i);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            remote_offload_stream_memory_abort(streammem);
+         gst_memory_unref(streammem);
+      }
+      g_array_unref(streammemarray);
 
-     if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
-        break;
+      return res;
+   }
 
-     //inform the channel of the received message
-     //i.e. comms_channel_message_received(pchannel, &receiveheader, segmemlist);
-     remote_offload_comms_callback_data_transfer_received(pCallback, &receiveheader, segmemarray);
+   if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+   {
+      //release the partially received segments, so that any that were
+      // obtained from a pool are returned to it.
+      for( guint i = 0; i < segmemarray->len; i++ )
+         gst_memory_unref(g_array_index(segmemarray, GstMemory *, i));
+      g_array_unref(segmemarray);
+      return res;
+   }
+
+   //inform the channel of the received message
+   //i.e. comms_channel_message_received(pchannel, &receiveheader, segmemlist);
+   remote_offload_comms_callback_data_transfer_received(pCallback, &receiveheader, segmemarray);
+
+   g_array_unref(segmemarray);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static gpointer RemoteOffloadCommsReader(gpointer data)
+{
+   RemoteOffloadComms *pComms = REMOTEOFFLOAD_COMMS(data);
+
+   GST_DEBUG_OBJECT (pComms, "Comms thread start");
+
+   //one buffer for the transfer currently being received, and one for
+   // control transfers that are interleaved within it.
+   DataSegmentHeaderReadBuffer dsbuf[2];
+   for( guint i = 0; i < 2; i++ )
+   {
+      dsbuf[i].capacity = DEFAULT_DATA_SEGMENT_HEADER_BUFFER_CAPACITY;
+      dsbuf[i].headers =
+            (DataSegmentHeader *)g_malloc(dsbuf[i].capacity*sizeof(DataSegmentHeader));
+      dsbuf[i].uncompressed_sizes =
+            (guint64 *)g_malloc(dsbuf[i].capacity*sizeof(guint64));
+      dsbuf[i].scratch = NULL;
+      dsbuf[i].scratchsize = 0;
+   }
 
-     g_array_unref(segmemarray);
+   while(1)
+   {
+     gboolean bEnd = FALSE;
+     if( ReceiveDataTransfer(pComms, &dsbuf[0], &dsbuf[1], &bEnd) != REMOTEOFFLOADCOMMSIO_SUCCESS )
+        break;
+
+     if( bEnd )
+        break;
    }
 
-   g_free(pDataSegmentHeaderBuffer);
+   for( guint i = 0; i < 2; i++ )
+   {
+      g_free(dsbuf[i].headers);
+      g_free(dsbuf[i].uncompressed_sizes);
+      g_free(dsbuf[i].scratch);
+   }
 
    GST_DEBUG_OBJECT (pComms, "Reader thread end");
 
@@ -291,10 +1009,111 @@ static GstMemory* virt_to_mem(void *pVirt,
    return mem;
 }
 
-//this should be called with the write_mutex locked.
-static inline RemoteOffloadCommsIOResult remote_offload_comms_write_routine(RemoteOffloadComms *comms,
-                                                                            DataTransferHeader *pheader,
-                                                                            GList *memList)
+//the interleave count for chunks that have nothing interleaved
+static const guint32 nointerleaved = 0;
+
+//Link the GList nodes of 'nodes' over the memories of 'mems', so that they can be
+// passed on as a GList without allocating one.
+static GList *link_mem_list(GArray *nodes, GPtrArray *mems)
+{
+   guint n = mems->len;
+   if( !n )
+      return NULL;
+
+   g_array_set_size(nodes, n);
+   GList *list = (GList *)nodes->data;
+   for( guint i = 0; i < n; i++ )
+   {
+      list[i].data = g_ptr_array_index(mems, i);
+      list[i].prev = (i > 0) ? &list[i - 1] : NULL;
+      list[i].next = (i + 1 < n) ? &list[i + 1] : NULL;
+   }
+
+   return list;
+}
+
+//The memories of the next call to write to the CommsIO. These are reused from
+// one write to the next, so that building the list doesn't allocate once streaming.
+typedef struct _WriteList
+{
+   DataTransferHeader header; //copy of the header being written
+   GstMemory *headermem;      //wraps header
+   GPtrArray *mems;           //memories to write
+   GPtrArray *owned;          //memories within mems that are unref'd once written
+   GArray *nodes;             //GList nodes that link mems together
+   gsize accumulated;         //data segment bytes within mems
+}WriteList;
+
+static WriteList *write_list_new()
+{
+   WriteList *wl = g_new0(WriteList, 1);
+   wl->headermem = virt_to_mem(&wl->header, sizeof(wl->header));
+   wl->mems = g_ptr_array_new();
+   wl->owned = g_ptr_array_new_with_free_func((GDestroyNotify)gst_memory_unref);
+   wl->nodes = g_array_new(FALSE, FALSE, sizeof(GList));
+   wl->accumulated = 0;
+
+   return wl;
+}
+
+static void write_list_free(WriteList *wl)
+{
+   if( !wl ) return;
+
+   gst_memory_unref(wl->headermem);
+   g_ptr_array_free(wl->mems, TRUE);
+   g_ptr_array_free(wl->owned, TRUE);
+   g_array_free(wl->nodes, TRUE);
+   g_free(wl);
+}
+
+//Append mem to the write list. If bowned, the write list takes ownership of it.
+static inline void write_list_append(WriteList *wl, GstMemory *mem, gboolean bowned)
+{
+   g_ptr_array_add(wl->mems, mem);
+   if( bowned )
+      g_ptr_array_add(wl->owned, mem);
+}
+
+static inline void write_list_clear(WriteList *wl)
+{
+   g_ptr_array_set_size(wl->mems, 0);
+   g_ptr_array_set_size(wl->owned, 0);
+   wl->accumulated = 0;
+}
+
+//Write out (and clear) the write list.
+static RemoteOffloadCommsIOResult write_list_flush(RemoteOffloadComms *comms, WriteList *wl)
+{
+   RemoteOffloadCommsIOResult ret = REMOTEOFFLOADCOMMSIO_SUCCESS;
+   GList *memList = link_mem_list(wl->nodes, wl->mems);
+   if( memList )
+      ret = remote_offload_comms_io_write_mem_list(comms->priv.pcommsio, memList);
+
+   write_list_clear(wl);
+
+   return ret;
+}
+
+//A write that is waiting to be interleaved within the preemptible write
+// that currently owns the CommsIO.
+typedef struct
+{
+   DataTransferHeader *pheader;
+   GList *memList;
+   GstMemory *sizesmem; //uncompressed segment sizes, or NULL if not compressed
+   RemoteOffloadCommsIOResult res;
+   gboolean done;
+   gint64 start_time; //when the bulk writer started writing it (0 if it never did)
+   GList link;        //within pending_interleaved_writes
+}PendingInterleavedWrite;
+
+//Validate the memList, set pheader->nsegments, and fill the DataSegmentHeader
+// write buffer. This should only be called by the thread that owns the CommsIO
+// for writing.
+static RemoteOffloadCommsIOResult remote_offload_comms_prepare_transfer(RemoteOffloadComms *comms,
+                                                                       DataTransferHeader *pheader,
+                                                                       GList *memList)
 {
    pheader->nsegments = 0;
 
@@ -338,6 +1157,11 @@ static inline RemoteOffloadCommsIOResult remote_offload_comms_write_routine(Remo
       }
 
       comms->priv.datasegmentheaderbuffercapacity = pheader->nsegments;
+
+      //the memory that wrapped the old buffer can't be used anymore
+      gst_memory_unref(comms->priv.datasegheadermem);
+      comms->priv.datasegheadermem = virt_to_mem(comms->priv.pDataSegmentHeaderWriteBuffer,
+                                     pheader->nsegments*sizeof(DataSegmentHeader));
    }
 
    //write the DataSegmentHeader values
@@ -352,66 +1176,614 @@ static inline RemoteOffloadCommsIOResult remote_offload_comms_write_routine(Remo
       memindex++;
    }
 
-   GList *write_mem_list = NULL;
-   GstMemory *headermem = virt_to_mem(pheader, sizeof(DataTransferHeader));
-   write_mem_list = g_list_append (write_mem_list,
-                                   headermem);
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+//Append the DataTransferHeader & DataSegmentHeader's of a prepared transfer
+// (followed by the uncompressed segment sizes, if the transfer is compressed) to
+// the write list.
+static void remote_offload_comms_append_transfer_headers(RemoteOffloadComms *comms,
+                                                         WriteList *wl,
+                                                         const DataTransferHeader *pheader,
+                                                         GstMemory *sizesmem)
+{
+   wl->header = *pheader;
+   write_list_append(wl, wl->headermem, FALSE);
 
-   GstMemory *datasegheadermem = NULL;
    if( pheader->nsegments > 0 )
    {
-      datasegheadermem = virt_to_mem(comms->priv.pDataSegmentHeaderWriteBuffer,
-                           pheader->nsegments * sizeof(DataSegmentHeader));
-      write_mem_list = g_list_append (write_mem_list,
-                                      datasegheadermem);
+      gst_memory_resize(comms->priv.datasegheadermem, 0,
+                        pheader->nsegments * sizeof(DataSegmentHeader));
+      write_list_append(wl, comms->priv.datasegheadermem, FALSE);
+
+      if( sizesmem )
+         write_list_append(wl, sizesmem, FALSE);
    }
+}
 
-   for(li = memList; li != NULL; li = li->next )
+//Write a complete, non-preemptible transfer.
+// This should only be called by the thread that owns the CommsIO for writing.
+static RemoteOffloadCommsIOResult remote_offload_comms_write_routine(RemoteOffloadComms *comms,
+                                                                     DataTransferHeader *pheader,
+                                                                     GList *memList,
+                                                                     GstMemory *sizesmem)
+{
+   pheader->flags = sizesmem ? DATATRANSFER_FLAG_COMPRESSED : 0;
+   RemoteOffloadCommsIOResult ret = remote_offload_comms_prepare_transfer(comms, pheader, memList);
+   if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      return ret;
+
+   //routine writes are never nested within each other, so they can all share
+   // this write list.
+   WriteList *wl = comms->priv.routine_write_list;
+   remote_offload_comms_append_transfer_headers(comms, wl, pheader, sizesmem);
+
+   for(GList *li = memList; li != NULL; li = li->next )
    {
-      GstMemory *mem = (GstMemory *)li->data;
-      write_mem_list = g_list_append (write_mem_list,
-                                      mem);
+      write_list_append(wl, (GstMemory *)li->data, FALSE);
    }
 
    //call the subclass to actually perform the write here
-   RemoteOffloadCommsIOResult ret = remote_offload_comms_io_write_mem_list(comms->priv.pcommsio, write_mem_list);
+   return write_list_flush(comms, wl);
+}
+
+//Complete the given pending interleaved writes with the given result.
+// This should be called with the writemutex locked.
+static void complete_pending_interleaved_writes(RemoteOffloadComms *comms,
+                                            GList *pendingList,
+                                            RemoteOffloadCommsIOResult res)
+{
+   for(GList *li = pendingList; li != NULL; )
+   {
+      PendingInterleavedWrite *pending = (PendingInterleavedWrite *)li->data;
+
+      //the link belongs to the waiting writer, which returns once this is done
+      li = li->next;
+      pending->res = res;
+      pending->done = TRUE;
+   }
+
+   if( pendingList )
+      g_cond_broadcast(&comms->priv.writecond);
+}
+
+//Write a transfer which may have other (pending) writes interleaved within it.
+// Each data segment is written as chunks of at most DATATRANSFER_CHUNK_SIZE bytes,
+// and the pending writes are serviced at every chunk boundary, so they wait for
+// at most one chunk to be written. While nothing is pending, chunks are
+// accumulated so that they're still written with few calls to the CommsIO.
+// This should only be called by the thread that owns the CommsIO for writing.
+static RemoteOffloadCommsIOResult remote_offload_comms_write_preemptible(RemoteOffloadComms *comms,
+                                                                         DataTransferHeader *pheader,
+                                                                         GList *memList,
+                                                                         GstMemory *sizesmem)
+{
+   pheader->flags = DATATRANSFER_FLAG_PREEMPTIBLE;
+   if( remote_offload_comms_nstripes(comms) )
+      pheader->flags |= DATATRANSFER_FLAG_STRIPED;
+   if( sizesmem )
+      pheader->flags |= DATATRANSFER_FLAG_COMPRESSED;
+
+   RemoteOffloadCommsIOResult ret = remote_offload_comms_prepare_transfer(comms, pheader, memList);
+   if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      return ret;
+
+   WriteList *wl = comms->priv.preemptible_write_list;
+   remote_offload_comms_append_transfer_headers(comms, wl, pheader, sizesmem);
 
-   gst_memory_unref(headermem);
-   if( datasegheadermem )
-      gst_memory_unref(datasegheadermem);
+   for(GList *li = memList; (li != NULL) && (ret == REMOTEOFFLOADCOMMSIO_SUCCESS); li = li->next )
+   {
+      GstMemory *mem = (GstMemory *)li->data;
+      gsize segmentSize = gst_memory_get_sizes(mem, NULL, NULL);
+      gsize offset = 0;
+
+      //Of a striped segment, only the first piece is written to the main CommsIO.
+      // The stripe writers write the rest of it in the meantime.
+      gboolean bstriped = (pheader->flags & DATATRANSFER_FLAG_STRIPED) &&
+                          (segmentSize >= DATATRANSFER_STRIPE_MIN_SIZE);
+      gsize mainSize = segmentSize;
+      if( bstriped )
+      {
+         StripeJob *jobs = comms->priv.stripe_write_jobs;
+         mainSize = remote_offload_comms_stripe_pieces(comms, jobs, segmentSize);
+         for( guint i = 0; i < remote_offload_comms_nstripes(comms); i++ )
+         {
+            if( jobs[i].size )
+            {
+               jobs[i].mem = remote_offload_comms_io_share_mem(mem, jobs[i].offset, jobs[i].size);
+               if( !jobs[i].mem )
+               {
+                  GST_ERROR_OBJECT (comms, "Error sharing stripe %u of data segment", i);
+                  jobs[i].size = 0;
+                  ret = REMOTEOFFLOADCOMMSIO_FAIL;
+                  continue;
+               }
+
+               stripe_worker_submit(g_ptr_array_index(comms->priv.stripe_writers, i), &jobs[i]);
+            }
+         }
+      }
 
-   g_list_free(write_mem_list);
+      //note that a zero-sized segment is still written as 1 (empty) chunk
+      do
+      {
+         if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            break;
+
+         gsize chunkSize = MIN(mainSize - offset, DATATRANSFER_CHUNK_SIZE);
+
+         //grab the writes that have queued up since the last chunk
+         g_mutex_lock(&comms->priv.writemutex);
+         GQueue pending = *comms->priv.pending_interleaved_writes;
+         g_queue_init(comms->priv.pending_interleaved_writes);
+         gboolean breject = comms->priv.breject_writes;
+         g_mutex_unlock(&comms->priv.writemutex);
+
+         if( breject )
+         {
+            ret = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+            g_mutex_lock(&comms->priv.writemutex);
+            complete_pending_interleaved_writes(comms, pending.head, ret);
+            g_mutex_unlock(&comms->priv.writemutex);
+            break;
+         }
+
+         if( pending.head )
+         {
+            //flush what's accumulated so far, along with the interleave count,
+            // before writing the interleaved transfers.
+            comms->priv.ninterleaved = pending.length;
+            write_list_append(wl, comms->priv.interleavedmem, FALSE);
+            ret = write_list_flush(comms, wl);
+
+            for(GList *pi = pending.head; pi != NULL; )
+            {
+               PendingInterleavedWrite *pendingwrite = (PendingInterleavedWrite *)pi->data;
+
+               //the link belongs to the waiting writer, which returns once this is done
+               pi = pi->next;
+
+               pendingwrite->start_time = g_get_monotonic_time();
+               if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+                  ret = remote_offload_comms_write_routine(comms, pendingwrite->pheader,
+                                                           pendingwrite->memList,
+                                                           pendingwrite->sizesmem);
+
+               g_mutex_lock(&comms->priv.writemutex);
+               pendingwrite->res = ret;
+               pendingwrite->done = TRUE;
+               g_cond_broadcast(&comms->priv.writecond);
+               g_mutex_unlock(&comms->priv.writemutex);
+            }
+
+            if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+               break;
+         }
+         else
+         {
+            write_list_append(wl, comms->priv.nointerleavedmem, FALSE);
+         }
+
+         if( chunkSize == segmentSize )
+         {
+            write_list_append(wl, mem, FALSE);
+         }
+         else if( chunkSize > 0 )
+         {
+            GstMemory *chunkmem = remote_offload_comms_io_share_mem(mem, offset, chunkSize);
+            if( !chunkmem )
+            {
+               GST_ERROR_OBJECT (comms, "Error sharing chunk of data segment");
+               ret = REMOTEOFFLOADCOMMSIO_FAIL;
+               break;
+            }
+
+            write_list_append(wl, chunkmem, TRUE);
+         }
+
+         wl->accumulated += chunkSize;
+         offset += chunkSize;
+
+         //write out once a chunk's worth has accumulated, so that
+         // pending writes are checked for at least that often.
+         if( wl->accumulated >= DATATRANSFER_CHUNK_SIZE )
+         {
+            ret = write_list_flush(comms, wl);
+            if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+               break;
+         }
+      }
+      while( offset < mainSize );
+
+      if( bstriped )
+      {
+         //The remote reader starts reading the stripes once it has reached this
+         // segment, so everything up to here needs to be written before waiting on them.
+         if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+            ret = write_list_flush(comms, wl);
+
+         if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            remote_offload_comms_shutdown_stripes(comms);
+
+         StripeJob *jobs = comms->priv.stripe_write_jobs;
+         for( guint i = 0; i < remote_offload_comms_nstripes(comms); i++ )
+         {
+            if( !jobs[i].size )
+               continue;
+
+            RemoteOffloadCommsIOResult striperet =
+                  stripe_worker_wait(g_ptr_array_index(comms->priv.stripe_writers, i), &jobs[i]);
+            gst_memory_unref(jobs[i].mem);
+            jobs[i].mem = NULL;
+
+            if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+               ret = striperet;
+         }
+      }
+   }
+
+   if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+      ret = write_list_flush(comms, wl);
+   else
+      write_list_clear(wl);
 
    return ret;
 }
 
+//Wait for, and take ownership of the CommsIO for writing.
+// This should be called with the writemutex locked. Returns FALSE if writes are
+// being rejected.
+static gboolean remote_offload_comms_acquire_writer(RemoteOffloadComms *comms,
+                                                    RemoteOffloadCommsPriority priority)
+{
+   if( priority == REMOTEOFFLOADCOMMS_PRIORITY_CONTROL )
+   {
+      comms->priv.ncontrol_waiters++;
+      while( !comms->priv.breject_writes && comms->priv.write_in_progress )
+         g_cond_wait(&comms->priv.writecond, &comms->priv.writemutex);
+      comms->priv.ncontrol_waiters--;
+   }
+   else
+   {
+      //bulk writers also give way to control writers that are waiting
+      while( !comms->priv.breject_writes &&
+             (comms->priv.write_in_progress || comms->priv.ncontrol_waiters) )
+         g_cond_wait(&comms->priv.writecond, &comms->priv.writemutex);
+   }
+
+   if( comms->priv.breject_writes )
+      return FALSE;
+
+   comms->priv.write_in_progress = TRUE;
+
+   return TRUE;
+}
+
+//Release ownership of the CommsIO, after writing any control writes that were
+// queued after the last segment boundary. This should be called with the
+// writemutex locked.
+static void remote_offload_comms_release_writer(RemoteOffloadComms *comms,
+                                                RemoteOffloadCommsIOResult *ret)
+{
+   GList *link;
+   while( (link = g_queue_pop_head_link(comms->priv.pending_interleaved_writes)) )
+   {
+      PendingInterleavedWrite *pending = (PendingInterleavedWrite *)link->data;
+
+      if( *ret == REMOTEOFFLOADCOMMSIO_SUCCESS && !comms->priv.breject_writes )
+      {
+         pending->start_time = g_get_monotonic_time();
+         g_mutex_unlock(&comms->priv.writemutex);
+         pending->res = remote_offload_comms_write_routine(comms,
+                                                           pending->pheader,
+                                                           pending->memList,
+                                                           pending->sizesmem);
+         g_mutex_lock(&comms->priv.writemutex);
+
+         //a failure here is a failure of the CommsIO, just as if it
+         // had happened while writing the bulk transfer.
+         *ret = pending->res;
+      }
+      else
+      {
+         pending->res = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      }
+
+      pending->done = TRUE;
+   }
+
+   comms->priv.write_in_progress = FALSE;
+   comms->priv.preemptible_in_progress = FALSE;
+   g_cond_broadcast(&comms->priv.writecond);
+}
+
+//The data segments of a write, with the compressed ones substituted in. These
+// are recycled, so that compressing doesn't allocate once streaming.
+typedef struct _CompressedSegments
+{
+   GPtrArray *mems;     //a reference to each data segment
+   GArray *nodes;       //GList nodes that link mems together
+   GList *memList;      //mems, as linked by nodes
+   guint64 *sizes;      //original size of each compressed segment (0 if written as-is)
+   guint capacity;      //of sizes
+   GstMemory *sizesmem; //wraps sizes
+}CompressedSegments;
+
+static void compressed_segments_free(CompressedSegments *compressed)
+{
+   g_ptr_array_free(compressed->mems, TRUE);
+   g_array_free(compressed->nodes, TRUE);
+   if( compressed->sizesmem )
+      gst_memory_unref(compressed->sizesmem);
+   g_free(compressed->sizes);
+   g_free(compressed);
+}
+
+static CompressedSegments *compressed_segments_acquire(RemoteOffloadComms *comms,
+                                                       guint nsegments)
+{
+   CompressedSegments *compressed = NULL;
+
+   g_mutex_lock(&comms->priv.compressionscratchmutex);
+   if( comms->priv.compressionscratch->len )
+      compressed = g_ptr_array_remove_index_fast(comms->priv.compressionscratch,
+                                                 comms->priv.compressionscratch->len - 1);
+   g_mutex_unlock(&comms->priv.compressionscratchmutex);
+
+   if( !compressed )
+   {
+      compressed = g_new0(CompressedSegments, 1);
+      compressed->mems = g_ptr_array_new_with_free_func((GDestroyNotify)gst_memory_unref);
+      compressed->nodes = g_array_new(FALSE, FALSE, sizeof(GList));
+   }
+
+   if( nsegments > compressed->capacity )
+   {
+      compressed->sizes = g_renew(guint64, compressed->sizes, nsegments);
+      compressed->capacity = nsegments;
+      if( compressed->sizesmem )
+         gst_memory_unref(compressed->sizesmem);
+      compressed->sizesmem = virt_to_mem(compressed->sizes, nsegments * sizeof(guint64));
+   }
+
+   memset(compressed->sizes, 0, nsegments * sizeof(guint64));
+   gst_memory_resize(compressed->sizesmem, 0, nsegments * sizeof(guint64));
+
+   return compressed;
+}
+
+static void compressed_segments_release(RemoteOffloadComms *comms,
+                                        CompressedSegments *compressed)
+{
+   g_ptr_array_set_size(compressed->mems, 0);
+   compressed->memList = NULL;
+
+   g_mutex_lock(&comms->priv.compressionscratchmutex);
+   g_ptr_array_add(comms->priv.compressionscratch, compressed);
+   g_mutex_unlock(&comms->priv.compressionscratchmutex);
+}
+
+//Compress the data segments of memList that are at least as large as the
+// compression threshold. Returns the segments (along with a table of the
+// original sizes of the compressed ones, 0 for the segments that are written
+// as-is) with the compressed segments substituted in, to be released with
+// compressed_segments_release. Returns NULL if no segment got compressed.
+static CompressedSegments *remote_offload_comms_compress_segments(RemoteOffloadComms *comms,
+                                                                  gint32 id,
+                                                                  GList *memList)
+{
+   RemoteOffloadCompressionCodec codec = comms->priv.compression.codec;
+   gsize threshold = comms->priv.compression.threshold;
+
+   CompressedSegments *compressed = NULL;
+   guint nsegments = g_list_length(memList);
+   guint64 ncompressed = 0, nincompressible = 0, bytes_in = 0, bytes_out = 0, cpu_ns = 0;
+
+   guint memindex = 0;
+   for(GList *li = memList; li != NULL; li = li->next, memindex++ )
+   {
+      GstMemory *mem = (GstMemory *)li->data;
+      if( !mem )
+         break;
+
+      gsize size = gst_memory_get_sizes(mem, NULL, NULL);
+      GstMemory *compressedmem = NULL;
+
+      if( size >= threshold )
+      {
+         GstMapInfo srcmap, dstmap;
+         compressedmem = remote_offload_mem_pool_acquire(comms->priv.compressionpool, size);
+         if( compressedmem && gst_memory_map(compressedmem, &dstmap, GST_MAP_WRITE) )
+         {
+            if( gst_memory_map(mem, &srcmap, GST_MAP_READ) )
+            {
+               guint64 start = remote_offload_compression_thread_cpu_time_ns();
+               //only worth it if it comes out smaller
+               gsize compressedsize = remote_offload_compress(codec, srcmap.data, srcmap.size,
+                                                              dstmap.data, size - 1);
+               cpu_ns += remote_offload_compression_thread_cpu_time_ns() - start;
+               gst_memory_unmap(mem, &srcmap);
+
+               gst_memory_unmap(compressedmem, &dstmap);
+               if( compressedsize )
+               {
+                  gst_memory_resize(compressedmem, 0, compressedsize);
+                  ncompressed++;
+                  bytes_in += size;
+                  bytes_out += compressedsize;
+               }
+               else
+               {
+                  nincompressible++;
+                  gst_memory_unref(compressedmem);
+                  compressedmem = NULL;
+               }
+            }
+            else
+            {
+               gst_memory_unmap(compressedmem, &dstmap);
+               gst_memory_unref(compressedmem);
+               compressedmem = NULL;
+            }
+         }
+         else if( compressedmem )
+         {
+            gst_memory_unref(compressedmem);
+            compressedmem = NULL;
+         }
+      }
+
+      if( compressedmem && !compressed )
+      {
+         //this is the first compressed segment, so pick up the ones before it
+         compressed = compressed_segments_acquire(comms, nsegments);
+         for(GList *pi = memList; pi != li; pi = pi->next )
+            g_ptr_array_add(compressed->mems, gst_memory_ref((GstMemory *)pi->data));
+      }
+
+      if( compressed )
+      {
+         if( compressedmem )
+            compressed->sizes[memindex] = size;
+         g_ptr_array_add(compressed->mems, compressedmem ? compressedmem : gst_memory_ref(mem));
+      }
+   }
+
+   if( ncompressed || nincompressible )
+   {
+      g_mutex_lock(&comms->priv.compressionstatsmutex);
+      RemoteOffloadCompressionStats *stats = compression_stats_for_channel(comms, id);
+      stats->nsegments_compressed += ncompressed;
+      stats->nsegments_incompressible += nincompressible;
+      stats->bytes_in += bytes_in;
+      stats->bytes_out += bytes_out;
+      stats->compress_cpu_ns += cpu_ns;
+      g_mutex_unlock(&comms->priv.compressionstatsmutex);
+   }
+
+   //a NULL mem is left for remote_offload_comms_prepare_transfer to reject
+   if( compressed && (memindex < nsegments) )
+   {
+      compressed_segments_release(comms, compressed);
+      return NULL;
+   }
+
+   if( compressed )
+      compressed->memList = link_mem_list(compressed->nodes, compressed->mems);
+
+   return compressed;
+}
+
 RemoteOffloadCommsIOResult remote_offload_comms_write(RemoteOffloadComms *comms,
                                                       DataTransferHeader *pheader,
-                                                      GList *memList)
+                                                      GList *memList,
+                                                      RemoteOffloadCommsPriority priority,
+                                                      gint64 *writelock_wait_us)
 {
+   if( writelock_wait_us )
+      *writelock_wait_us = 0;
+
    if( !pheader || !comms )
    {
       return REMOTEOFFLOADCOMMSIO_FAIL;
    }
 
+   //Compression is done here, by the writing thread, before the CommsIO is
+   // acquired, so that it overlaps with whatever other thread is currently writing.
+   CompressedSegments *compressed = NULL;
+   GstMemory *sizesmem = NULL;
+   if( comms->priv.compression.codec != REMOTEOFFLOAD_COMPRESSION_NONE )
+   {
+      compressed = remote_offload_comms_compress_segments(comms, pheader->id, memList);
+      if( compressed )
+      {
+         memList = compressed->memList;
+         sizesmem = compressed->sizesmem;
+      }
+   }
+
    RemoteOffloadCommsIOResult ret = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
    gboolean bdeclare_comms_failure = FALSE;
 
-   //only allow 1 thread to write at a time
+   gint64 lock_start_time = writelock_wait_us ? g_get_monotonic_time() : 0;
    g_mutex_lock(&(comms->priv.writemutex));
-   if( !comms->priv.breject_writes )
+
+   //If a bulk transfer is currently being written, a control write (or any write
+   // from another channel) is handed to that writer, to be interleaved at its next
+   // chunk boundary. This keeps one channel's large frames from blocking the other
+   // channels that share this comms.
+   if( comms->priv.preemptible_in_progress &&
+       ((priority == REMOTEOFFLOADCOMMS_PRIORITY_CONTROL) ||
+        (pheader->id != comms->priv.preemptible_channel_id)) &&
+       !comms->priv.breject_writes )
    {
-      ret = remote_offload_comms_write_routine(comms,
-                                               pheader,
-                                               memList);
+      PendingInterleavedWrite pending;
+      pending.pheader = pheader;
+      pending.memList = memList;
+      pending.sizesmem = sizesmem;
+      pending.res = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      pending.done = FALSE;
+      pending.start_time = 0;
+
+      pending.link.data = &pending;
+      pending.link.prev = NULL;
+      pending.link.next = NULL;
+
+      g_queue_push_tail_link(comms->priv.pending_interleaved_writes, &pending.link);
+      while( !pending.done )
+         g_cond_wait(&comms->priv.writecond, &comms->priv.writemutex);
+      g_mutex_unlock(&(comms->priv.writemutex));
+
+      if( writelock_wait_us )
+      {
+         *writelock_wait_us = (pending.start_time ? pending.start_time : g_get_monotonic_time())
+                              - lock_start_time;
+      }
 
-      if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+      if( compressed )
+         compressed_segments_release(comms, compressed);
+
+      //the bulk writer is responsible for declaring the comms error, if
+      // any write fails.
+      return pending.res;
+   }
+
+   //only allow 1 thread to write at a time
+   gboolean bacquired = remote_offload_comms_acquire_writer(comms, priority);
+   if( writelock_wait_us )
+      *writelock_wait_us = g_get_monotonic_time() - lock_start_time;
+
+   if( bacquired )
+   {
+      //Bulk transfers are preemptible, unless there's no data segment to
+      // interleave other writes with.
+      gboolean bpreemptible = (priority == REMOTEOFFLOADCOMMS_PRIORITY_BULK) &&
+                              (memList != NULL);
+      comms->priv.preemptible_in_progress = bpreemptible;
+      comms->priv.preemptible_channel_id = pheader->id;
+      g_mutex_unlock(&(comms->priv.writemutex));
+
+      if( bpreemptible )
+         ret = remote_offload_comms_write_preemptible(comms, pheader, memList, sizesmem);
+      else
+         ret = remote_offload_comms_write_routine(comms, pheader, memList, sizesmem);
+
+      g_mutex_lock(&(comms->priv.writemutex));
+      remote_offload_comms_release_writer(comms, &ret);
+
+      //If writes were rejected while this write was in progress, the
+      // comms error has already been declared.
+      if( (ret != REMOTEOFFLOADCOMMSIO_SUCCESS) && !comms->priv.breject_writes )
       {
          comms->priv.breject_writes = TRUE;
          bdeclare_comms_failure = TRUE;
       }
    }
    g_mutex_unlock(&(comms->priv.writemutex));
+
+   if( compressed )
+      compressed_segments_release(comms, compressed);
+
    if( bdeclare_comms_failure )
    {
       declare_comms_error(comms);
@@ -434,6 +1806,11 @@ static void remote_offload_comms_constructed(GObject *object)
   {
      GST_ERROR_OBJECT (pComms, "Error allocating DataSegmentHeader write buffer");
   }
+  else
+  {
+     pComms->priv.datasegheadermem = virt_to_mem(pComms->priv.pDataSegmentHeaderWriteBuffer,
+           pComms->priv.datasegmentheaderbuffercapacity*sizeof(DataSegmentHeader));
+  }
 
   if( pComms->priv.pcommsio && pComms->priv.pDataSegmentHeaderWriteBuffer)
   {
@@ -473,21 +1850,27 @@ void remote_offload_comms_finish(RemoteOffloadComms *pComms)
 {
    if( !REMOTEOFFLOAD_IS_COMMS(pComms) ) return;
    g_mutex_lock(&(pComms->priv.writemutex));
-   if( !pComms->priv.breject_writes )
+   if( remote_offload_comms_acquire_writer(pComms, REMOTEOFFLOADCOMMS_PRIORITY_BULK) )
    {
+       g_mutex_unlock(&(pComms->priv.writemutex));
+
        //Send special header that triggers the remote comms
        // reader thread to close.
        DataTransferHeader header;
        header.id = -1;
        header.dataTransferType = 0;
        header.nsegments = 0;
+       header.flags = 0;
        header.response_id = 0;
        GST_DEBUG_OBJECT(pComms, "Sending special close header");
        remote_offload_comms_io_write(pComms->priv.pcommsio,
                                      (guint8 *)&header,
                                      sizeof(header));
 
+       g_mutex_lock(&(pComms->priv.writemutex));
        pComms->priv.breject_writes = TRUE;
+       pComms->priv.write_in_progress = FALSE;
+       g_cond_broadcast(&pComms->priv.writecond);
     }
    g_mutex_unlock(&(pComms->priv.writemutex));
 }
@@ -511,7 +1894,47 @@ remote_offload_comms_finalize (GObject *gobject)
   if( pComms->priv.pcommsio)
     remote_offload_comms_io_shutdown(pComms->priv.pcommsio);
 
+  if( pComms->priv.stripe_writers )
+  {
+     remote_offload_comms_shutdown_stripes(pComms);
+
+     //freeing the workers joins their threads
+     g_ptr_array_free(pComms->priv.stripe_writers, TRUE);
+     g_ptr_array_free(pComms->priv.stripe_readers, TRUE);
+     g_free(pComms->priv.stripe_write_jobs);
+     g_free(pComms->priv.stripe_read_jobs);
+  }
+
+  if( pComms->priv.compression.codec != REMOTEOFFLOAD_COMPRESSION_NONE )
+  {
+     GHashTableIter iter;
+     gpointer key, value;
+     g_hash_table_iter_init(&iter, pComms->priv.compression_stats);
+     while( g_hash_table_iter_next(&iter, &key, &value) )
+     {
+        RemoteOffloadCompressionStats *stats = (RemoteOffloadCompressionStats *)value;
+        GST_INFO_OBJECT (pComms, "channel-id=%d %s: compressed %"G_GUINT64_FORMAT" segments "
+                         "(%"G_GUINT64_FORMAT" incompressible), ratio=%.2f, compress cpu=%"
+                         G_GUINT64_FORMAT" us, decompressed %"G_GUINT64_FORMAT" segments, "
+                         "decompress cpu=%"G_GUINT64_FORMAT" us",
+                         GPOINTER_TO_INT(key),
+                         remote_offload_compression_codec_name(pComms->priv.compression.codec),
+                         stats->nsegments_compressed, stats->nsegments_incompressible,
+                         stats->bytes_out ? (gdouble)stats->bytes_in / stats->bytes_out : 1.0,
+                         stats->compress_cpu_ns / 1000,
+                         stats->nsegments_decompressed,
+                         stats->decompress_cpu_ns / 1000);
+     }
+  }
+  g_hash_table_destroy(pComms->priv.compression_stats);
+  g_mutex_clear(&(pComms->priv.compressionstatsmutex));
+  g_object_unref(pComms->priv.compressionpool);
+  g_ptr_array_free(pComms->priv.compressionscratch, TRUE);
+  g_mutex_clear(&(pComms->priv.compressionscratchmutex));
+
   g_mutex_clear(&(pComms->priv.writemutex));
+  g_cond_clear(&(pComms->priv.writecond));
+  g_queue_free(pComms->priv.pending_interleaved_writes);
   g_mutex_clear(&(pComms->priv.hashprotectmutex));
   g_mutex_clear(&(pComms->priv.statemutex));
 
@@ -520,6 +1943,12 @@ remote_offload_comms_finalize (GObject *gobject)
 
   g_hash_table_destroy(pComms->priv.hash_id_to_comms_channel);
 
+  write_list_free(pComms->priv.preemptible_write_list);
+  write_list_free(pComms->priv.routine_write_list);
+  gst_memory_unref(pComms->priv.interleavedmem);
+  gst_memory_unref(pComms->priv.nointerleavedmem);
+  if( pComms->priv.datasegheadermem )
+     gst_memory_unref(pComms->priv.datasegheadermem);
   g_free(pComms->priv.pDataSegmentHeaderWriteBuffer);
 
   G_OBJECT_CLASS (remote_offload_comms_parent_class)->finalize (gobject);
@@ -558,10 +1987,36 @@ remote_offload_comms_init (RemoteOffloadComms *self)
   self->priv.pcommsio = NULL;
   self->priv.pDataSegmentHeaderWriteBuffer = NULL;
   self->priv.datasegmentheaderbuffercapacity = 0;
+  self->priv.datasegheadermem = NULL;
+  self->priv.nointerleavedmem = virt_to_mem((void *)&nointerleaved, sizeof(nointerleaved));
+  self->priv.ninterleaved = 0;
+  self->priv.interleavedmem = virt_to_mem(&self->priv.ninterleaved,
+                                          sizeof(self->priv.ninterleaved));
+  self->priv.preemptible_write_list = write_list_new();
+  self->priv.routine_write_list = write_list_new();
   self->priv.reader_thread = NULL;
   self->priv.is_state_okay = FALSE;
   self->priv.breject_writes = FALSE;
+  self->priv.write_in_progress = FALSE;
+  self->priv.preemptible_in_progress = FALSE;
+  self->priv.preemptible_channel_id = -1;
+  self->priv.ncontrol_waiters = 0;
+  self->priv.pending_interleaved_writes = g_queue_new();
+  self->priv.stripe_writers = NULL;
+  self->priv.stripe_readers = NULL;
+  self->priv.stripe_write_jobs = NULL;
+  self->priv.stripe_read_jobs = NULL;
+  self->priv.compression.codec = REMOTEOFFLOAD_COMPRESSION_NONE;
+  self->priv.compression.threshold = REMOTEOFFLOAD_COMPRESSION_DEFAULT_THRESHOLD;
+  g_mutex_init(&(self->priv.compressionstatsmutex));
+  self->priv.compression_stats = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                       NULL, g_free);
+  self->priv.compressionpool = remote_offload_mem_pool_new(COMPRESSION_MEMPOOL_MAX_FREE);
+  g_mutex_init(&(self->priv.compressionscratchmutex));
+  self->priv.compressionscratch =
+        g_ptr_array_new_with_free_func((GDestroyNotify)compressed_segments_free);
   g_mutex_init(&(self->priv.writemutex));
+  g_cond_init(&(self->priv.writecond));
   g_mutex_init(&(self->priv.hashprotectmutex));
   g_mutex_init(&(self->priv.statemutex));
   self->priv.hash_id_to_comms_channel = g_hash_table_new(g_direct_hash, g_direct_equal);
@@ -584,6 +2039,100 @@ RemoteOffloadComms *remote_offload_comms_new(RemoteOffloadCommsIO *pcommsio)
   return pComms;
 }
 
+RemoteOffloadComms *remote_offload_comms_new_striped(RemoteOffloadCommsIO *pcommsio,
+                                                     GArray *stripe_commsio_array)
+{
+  if( !stripe_commsio_array )
+     return NULL;
+
+  for( guint i = 0; i < stripe_commsio_array->len; i++ )
+  {
+     if( !REMOTEOFFLOAD_IS_COMMSIO(g_array_index(stripe_commsio_array,
+                                                 RemoteOffloadCommsIO *, i)) )
+     {
+        GST_ERROR("stripe_commsio_array[%u] is not a valid CommsIO object", i);
+        return NULL;
+     }
+  }
+
+  RemoteOffloadComms *pComms = remote_offload_comms_new(pcommsio);
+
+  if( pComms && stripe_commsio_array->len )
+  {
+     guint nstripes = stripe_commsio_array->len;
+     pComms->priv.stripe_writers = g_ptr_array_new_with_free_func(stripe_worker_free);
+     pComms->priv.stripe_readers = g_ptr_array_new_with_free_func(stripe_worker_free);
+     pComms->priv.stripe_write_jobs = g_malloc0(nstripes * sizeof(StripeJob));
+     pComms->priv.stripe_read_jobs = g_malloc0(nstripes * sizeof(StripeJob));
+
+     for( guint i = 0; i < nstripes; i++ )
+     {
+        RemoteOffloadCommsIO *commsio =
+              g_array_index(stripe_commsio_array, RemoteOffloadCommsIO *, i);
+
+        gchar *name = g_strdup_printf("CommsStripe%uWr", i);
+        g_ptr_array_add(pComms->priv.stripe_writers, stripe_worker_new(commsio, name));
+        g_free(name);
+
+        name = g_strdup_printf("CommsStripe%uRd", i);
+        g_ptr_array_add(pComms->priv.stripe_readers, stripe_worker_new(commsio, name));
+        g_free(name);
+     }
+
+     GST_INFO_OBJECT (pComms, "Striping large data segments across %u additional CommsIO's",
+                      nstripes);
+  }
+
+  return pComms;
+}
+
+void remote_offload_comms_set_compression(RemoteOffloadComms *comms,
+                                          const RemoteOffloadCompressionParams *params)
+{
+   if( !REMOTEOFFLOAD_IS_COMMS(comms) || !params )
+      return;
+
+   if( !remote_offload_compression_codec_supported(params->codec) )
+   {
+      GST_ERROR_OBJECT (comms, "Compression codec %s is not supported by this build",
+                        remote_offload_compression_codec_name(params->codec));
+      return;
+   }
+
+   comms->priv.compression = *params;
+
+   if( params->codec != REMOTEOFFLOAD_COMPRESSION_NONE )
+   {
+      GST_INFO_OBJECT (comms, "Compressing data segments of at least %u bytes with %s",
+                       params->threshold, remote_offload_compression_codec_name(params->codec));
+   }
+}
+
+RemoteOffloadCompressionCodec remote_offload_comms_get_compression_codec(RemoteOffloadComms *comms)
+{
+   if( !REMOTEOFFLOAD_IS_COMMS(comms) )
+      return REMOTEOFFLOAD_COMPRESSION_NONE;
+
+   return comms->priv.compression.codec;
+}
+
+gboolean remote_offload_comms_get_compression_stats(RemoteOffloadComms *comms,
+                                                    gint channel_id,
+                                                    RemoteOffloadCompressionStats *stats)
+{
+   if( !REMOTEOFFLOAD_IS_COMMS(comms) || !stats )
+      return FALSE;
+
+   if( comms->priv.compression.codec == REMOTEOFFLOAD_COMPRESSION_NONE )
+      return FALSE;
+
+   g_mutex_lock(&comms->priv.compressionstatsmutex);
+   *stats = *compression_stats_for_channel(comms, channel_id);
+   g_mutex_unlock(&comms->priv.compressionstatsmutex);
+
+   return TRUE;
+}
+
 GList *remote_offload_comms_get_consumable_memfeatures(RemoteOffloadComms *comms)
 {
    if( !REMOTEOFFLOAD_IS_COMMS(comms) )
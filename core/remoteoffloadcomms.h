@@ -27,6 +27,7 @@
 #include <gst/gstmemory.h>
 #include "remoteoffloadcommsio.h"
 #include "datatransferdefs.h"
+#include "remoteoffloadcompression.h"
 
 G_BEGIN_DECLS
 
@@ -34,14 +35,34 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (RemoteOffloadComms, remote_offload_comms, REMOTEOFFLOAD, COMMS, GObject)
 
 
+//Priority of a write. CONTROL writes (and writes from other channels) may be
+// interleaved within a BULK write that is in progress, at boundaries of at most
+// DATATRANSFER_CHUNK_SIZE bytes, so that they don't have to wait for a large
+// transfer (i.e. a video frame) to be completely written.
+typedef enum
+{
+   REMOTEOFFLOADCOMMS_PRIORITY_BULK = 0,
+   REMOTEOFFLOADCOMMS_PRIORITY_CONTROL
+}RemoteOffloadCommsPriority;
+
 //public interfaces
 RemoteOffloadComms *remote_offload_comms_new(RemoteOffloadCommsIO *pcommsio);
 
+//Create a comms that, in addition to pcommsio, owns the CommsIO's in
+// stripe_commsio_array (GArray of RemoteOffloadCommsIO*). Large data segments
+// are striped across all of them in parallel. The remote side must create its
+// comms with the same stripes, in the same order.
+RemoteOffloadComms *remote_offload_comms_new_striped(RemoteOffloadCommsIO *pcommsio,
+                                                     GArray *stripe_commsio_array);
+
 //The following functions should be called exclusively from RemoteOffloadCommsChannel.
-// memList is a GList of GstMemory*
+// memList is a GList of GstMemory*. If writelock_wait_us is non-NULL, it's set to
+// the time spent waiting for the comms to be free for this write.
 RemoteOffloadCommsIOResult remote_offload_comms_write(RemoteOffloadComms *comms,
                                                       DataTransferHeader *pheader,
-                                                      GList *memList);
+                                                      GList *memList,
+                                                      RemoteOffloadCommsPriority priority,
+                                                      gint64 *writelock_wait_us);
 
 // Called when all messages are done being sent. This triggers closure of the
 //  remote comms reader thread.
@@ -51,6 +72,23 @@ typedef struct _RemoteOffloadCommsChannel RemoteOffloadCommsChannel;
 gboolean remote_offload_comms_register_channel(RemoteOffloadComms *comms,
                                                RemoteOffloadCommsChannel *channel);
 
+//Compress the large data segments that are written by this comms, and decompress
+// the ones that are received, with the given codec. This needs to be called before
+// any channels are registered, with the params that were negotiated with the
+// remote side.
+void remote_offload_comms_set_compression(RemoteOffloadComms *comms,
+                                          const RemoteOffloadCompressionParams *params);
+
+//Obtain the codec that this comms compresses with (REMOTEOFFLOAD_COMPRESSION_NONE
+// if it doesn't).
+RemoteOffloadCompressionCodec remote_offload_comms_get_compression_codec(RemoteOffloadComms *comms);
+
+//Obtain the compression stats of the given channel. Returns FALSE if
+// compression isn't enabled for this comms.
+gboolean remote_offload_comms_get_compression_stats(RemoteOffloadComms *comms,
+                                                    gint channel_id,
+                                                    RemoteOffloadCompressionStats *stats);
+
 GList *remote_offload_comms_get_consumable_memfeatures(RemoteOffloadComms *comms);
 GList *remote_offload_comms_get_producible_memfeatures(RemoteOffloadComms *comms);
 
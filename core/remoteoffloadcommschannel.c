@@ -29,6 +29,7 @@
 #include "remoteoffloadprivateinterfaces.h"
 #include "remoteoffloaddataexchanger.h"
 #include "remoteoffloadresponse.h"
+#include "remoteoffloadtransportstats.h"
 
 
 #define DEFAULT_NUM_RESPONSE_POOL_ENTRIES 32
@@ -63,8 +64,73 @@ enum DataExchangerType
    DE_NUM_TYPES
 };
 
+//names of the DataExchangerType's, as reported in the stats structure
+static const gchar *data_exchanger_type_names[DE_NUM_TYPES] =
+{
+   "unknown",
+   "response",
+   "query",
+   "event",
+   "buffer",
+   "bin",
+   "eos",
+   "statechange",
+   "pipelineerror",
+   "ping",
+   "ping-response",
+   "queuestats",
+   "queuestats-response",
+   "heartbeat",
+   "generic",
+};
+
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
 
+//Received data transfers are dispatched to data exchangers by one of these
+// lanes, each with its own thread. Control messages (heartbeats, pings, state
+// changes, etc.) use their own lane, so that they don't wait behind buffers
+// that are taking a long time to be consumed. Buffers, events, and queries
+// share the data lane, as they need to be handled in the order they were sent.
+enum ReceiverLaneIndex
+{
+   RECEIVER_LANE_DATA = 0,
+   RECEIVER_LANE_CONTROL,
+   RECEIVER_NUM_LANES
+};
+
+//Responses being waited on are held in a fixed-size table of slots. The
+// response id sent along with a request encodes the slot (low 32 bits, +1
+// so that an id is never 0) and the generation of the slot when it was
+// claimed (high 32 bits), so a late or duplicate response for a slot that
+// has since been reused is detected. Claiming and releasing a slot are
+// single compare-and-exchange operations on its state.
+#define RESPONSE_NUM_SLOTS 1024
+G_STATIC_ASSERT(REMOTEOFFLOAD_MAX_INFLIGHT_BUFFERS <= RESPONSE_NUM_SLOTS / 4);
+
+//ResponseSlot.state is (generation << 2) | one of:
+#define RESPONSE_SLOT_FREE     0
+#define RESPONSE_SLOT_CLAIMING 1  //claimed, response not yet stored
+#define RESPONSE_SLOT_BUSY     2  //response stored & being waited on
+#define RESPONSE_SLOT_STATE_MASK 3
+
+typedef struct
+{
+   gsize state;
+   RemoteOffloadResponse *response; //ref'd while BUSY
+   guint16 dataTransferType;        //of the request
+   gint64 sent_time;
+}ResponseSlot;
+
+typedef struct _ReceiverLane
+{
+   RemoteOffloadCommsChannel *channel;
+   guint index;
+   GCond  receiverthrcond;
+   GThread *receiver_thread;
+   gboolean bIdle;
+   GQueue *activedataTransferEntryQueue;
+}ReceiverLane;
+
 /* Private structure definition. */
 typedef struct {
    //only used for initialization
@@ -72,14 +138,17 @@ typedef struct {
    gboolean is_state_okay;
    gint id;
 
-   gboolean bcancelledstate;
+   gint bcancelledstate; //set atomically
 
    GMutex failcallbackmutex;
    comms_failure_callback_f comms_failure_callback;
    void *comms_failure_callback_user_data;
 
-   GMutex responsePoolMutex;
-   GHashTable *activeWaitingEntryMap;
+   ResponseSlot responseSlots[RESPONSE_NUM_SLOTS];
+   guint nextResponseSlot; //where the search for a free slot starts (atomic)
+
+   //per DataExchangerType
+   RemoteOffloadTransportStats stats[DE_NUM_TYPES];
 
    GArray *exchangerArray;
    GList *cachedDataTransferList;  //list of data transfers that have been
@@ -88,13 +157,10 @@ typedef struct {
                                    // contain entries at startup.
 
    GMutex receiverthrmutex;
-   GCond  receiverthrcond;
    GCond  idlecond;
-   GThread *receiver_thread;
    gboolean bThreadRun;
-   gboolean bIdle;
+   ReceiverLane lanes[RECEIVER_NUM_LANES];
 
-   GQueue *activedataTransferEntryQueue;
    GQueue *dataTransferEntryFreePool;
 }RemoteOffloadCommsChannelPrivate;
 
@@ -108,7 +174,7 @@ struct _RemoteOffloadCommsChannel
 
 static void
 remote_offload_comms_channel_callback_interface_init (RemoteOffloadCommsCallbackInterface *iface);
-static gpointer remote_offload_comms_channel_receiver_thread(RemoteOffloadCommsChannel *self);
+static gpointer remote_offload_comms_channel_receiver_thread(ReceiverLane *lane);
 
 //Cancel a response currently (or in the process of getting) waited on.
 static void remote_offload_response_cancel(RemoteOffloadResponse *response);
@@ -130,6 +196,7 @@ typedef struct
    GCond responsecond;
    GArray *response_mem_array;
    gboolean canceled;
+   gboolean registered; //held within a comms channel's response table
 }RemoteOffloadResponsePrivate;
 
 struct _RemoteOffloadResponse
@@ -161,6 +228,7 @@ typedef struct
 {
    DataTransferHeader header;
    GArray *dataSegments;
+   gint64 received_time;
 }DataTransferReceivedEntry;
 
 static inline DataTransferReceivedEntry *data_transfer_received_entry_malloc()
@@ -209,6 +277,57 @@ data_transfer_received_entry_done(RemoteOffloadCommsChannel *pCommsChannel,
    g_mutex_unlock (&(pCommsChannel->priv.receiverthrmutex));
 }
 
+//Obtain the lane that received transfers of the given type are dispatched by
+static inline ReceiverLane *receiver_lane_for_type(RemoteOffloadCommsChannel *channel,
+                                                   guint16 dataTransferType)
+{
+   switch(dataTransferType)
+   {
+      case DE_TYPE_STATECHANGE:
+      case DE_TYPE_PING:
+      case DE_TYPE_PING_RESPONSE:
+      case DE_TYPE_QUEUESTATS:
+      case DE_TYPE_QUEUESTATS_RESPONSE:
+      case DE_TYPE_HEARTBEAT:
+         return &channel->priv.lanes[RECEIVER_LANE_CONTROL];
+
+      default:
+         return &channel->priv.lanes[RECEIVER_LANE_DATA];
+   }
+}
+
+//Obtain the priority that transfers of the given type are written with.
+// Bulk transfers (buffers, bins) may have control transfers interleaved
+// between their data segments.
+static inline RemoteOffloadCommsPriority comms_priority_for_type(guint16 dataTransferType)
+{
+   switch(dataTransferType)
+   {
+      case DE_TYPE_BUFFER:
+      case DE_TYPE_BIN:
+      case DE_TYPE_EOS:
+      case DE_TYPE_PIPELINEERROR:
+      case DE_TYPE_GENERIC:
+         return REMOTEOFFLOADCOMMS_PRIORITY_BULK;
+
+      default:
+         return REMOTEOFFLOADCOMMS_PRIORITY_CONTROL;
+   }
+}
+
+//Returns TRUE if none of the lanes are dispatching a data transfer, and all of
+// their queues are empty. This should be called with the receiverthrmutex locked.
+static inline gboolean receiver_lanes_idle(RemoteOffloadCommsChannel *channel)
+{
+   for( guint i = 0; i < RECEIVER_NUM_LANES; i++ )
+   {
+      if( !channel->priv.lanes[i].bIdle )
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
 
 //This is called right after _init() and set_properties calls for default
 // props passed into g_object_new()
@@ -218,12 +337,16 @@ static void remote_offload_comms_channel_constructed(GObject *object)
 
   if( pCommsChannel->priv.pcomms && (pCommsChannel->priv.id >= 0) )
   {
-     gchar name[25];
-     g_snprintf(name, 25, "CommsChannel%d", pCommsChannel->priv.id);
-     pCommsChannel->priv.receiver_thread =
-        g_thread_new (name,
-                      (GThreadFunc) remote_offload_comms_channel_receiver_thread,
-                      pCommsChannel);
+     for( guint i = 0; i < RECEIVER_NUM_LANES; i++ )
+     {
+        gchar name[25];
+        g_snprintf(name, 25, "CommsChannel%d%s", pCommsChannel->priv.id,
+                   (i == RECEIVER_LANE_CONTROL) ? "Ctrl" : "");
+        pCommsChannel->priv.lanes[i].receiver_thread =
+           g_thread_new (name,
+                         (GThreadFunc) remote_offload_comms_channel_receiver_thread,
+                         &pCommsChannel->priv.lanes[i]);
+     }
 
      //pCommsChannel->priv.reader_thread =
      //   g_thread_new ("CommsReader", (GThreadFunc) RemoteOffloadCommsReader, object);
@@ -326,28 +449,142 @@ static inline void
 remote_offload_comms_channel_push_entry_to_active_queue(RemoteOffloadCommsChannel *channel,
                                                         DataTransferReceivedEntry *entry)
 {
+   ReceiverLane *lane = receiver_lane_for_type(channel, entry->header.dataTransferType);
    g_mutex_lock (&(channel->priv.receiverthrmutex));
-   g_queue_push_tail(channel->priv.activedataTransferEntryQueue, entry);
-   g_cond_broadcast(&(channel->priv.receiverthrcond));
+   g_queue_push_tail(lane->activedataTransferEntryQueue, entry);
+   g_cond_broadcast(&(lane->receiverthrcond));
    g_mutex_unlock (&(channel->priv.receiverthrmutex));
 }
 
+static inline RemoteOffloadTransportStats *
+transport_stats_for_type(RemoteOffloadCommsChannel *channel, guint16 dataTransferType)
+{
+   if( G_UNLIKELY(dataTransferType >= DE_NUM_TYPES) )
+      dataTransferType = DE_TYPE_UNKNOWN;
+
+   return &channel->priv.stats[dataTransferType];
+}
+
+static inline gsize mem_list_size(GList *mem_list, guint *nsegments)
+{
+   gsize size = 0;
+   guint n = 0;
+   for( GList *li = mem_list; li != NULL; li = li->next )
+   {
+      size += gst_memory_get_sizes((GstMemory *)li->data, NULL, NULL);
+      n++;
+   }
+
+   *nsegments = n;
+   return size;
+}
+
+static inline guint64 response_id_make(guint slotindex, gsize generation)
+{
+   return ((guint64)(generation & G_MAXUINT32) << 32) | (guint64)(slotindex + 1);
+}
+
+//Claim a free slot for response, taking a reference to it.
+// Returns the response id, or 0 if all slots are in use.
+static guint64 response_slot_register(RemoteOffloadCommsChannel *channel,
+                                      RemoteOffloadResponse *response,
+                                      guint16 dataTransferType)
+{
+   guint start = (guint)g_atomic_int_add(&channel->priv.nextResponseSlot, 1);
+   for( guint i = 0; i < RESPONSE_NUM_SLOTS; i++ )
+   {
+      guint slotindex = (start + i) % RESPONSE_NUM_SLOTS;
+      ResponseSlot *slot = &channel->priv.responseSlots[slotindex];
+
+      gsize state = (gsize)g_atomic_pointer_get(&slot->state);
+      if( (state & RESPONSE_SLOT_STATE_MASK) != RESPONSE_SLOT_FREE )
+         continue;
+
+      gsize generation = (state >> 2) + 1;
+      if( g_atomic_pointer_compare_and_exchange(&slot->state,
+                                                state,
+                                                (generation << 2) | RESPONSE_SLOT_CLAIMING) )
+      {
+         g_mutex_lock(&response->priv.responsemutex);
+         response->priv.registered = TRUE;
+         g_mutex_unlock(&response->priv.responsemutex);
+
+         //only the claiming thread writes the slot until it's BUSY
+         slot->dataTransferType = dataTransferType;
+         slot->sent_time = g_get_monotonic_time();
+         g_atomic_pointer_set(&slot->response, g_object_ref(response));
+         g_atomic_pointer_set(&slot->state, (generation << 2) | RESPONSE_SLOT_BUSY);
+         g_atomic_int_inc(&transport_stats_for_type(channel, dataTransferType)->inflight);
+         return response_id_make(slotindex, generation);
+      }
+   }
+
+   return 0;
+}
+
+//Release the slot that response_id refers to. Returns the (ref'd) response
+// that was waiting on it, or NULL if response_id is stale / unknown. If
+// non-NULL, *stats is set to the transport stats of the request's type, and
+// *sent_time to when it was registered.
+static RemoteOffloadResponse *response_slot_release(RemoteOffloadCommsChannel *channel,
+                                                    guint64 response_id,
+                                                    RemoteOffloadTransportStats **stats,
+                                                    gint64 *sent_time)
+{
+   guint64 slotnumber = response_id & G_MAXUINT32;
+   if( (slotnumber == 0) || (slotnumber > RESPONSE_NUM_SLOTS) )
+      return NULL;
+
+   ResponseSlot *slot = &channel->priv.responseSlots[slotnumber - 1];
+   gsize state = (gsize)g_atomic_pointer_get(&slot->state);
+   if( ((state & RESPONSE_SLOT_STATE_MASK) != RESPONSE_SLOT_BUSY) ||
+       (((state >> 2) & G_MAXUINT32) != (response_id >> 32)) )
+      return NULL;
+
+   //read before releasing the slot, as it can be claimed again right after
+   RemoteOffloadResponse *response = g_atomic_pointer_get(&slot->response);
+   guint16 dataTransferType = slot->dataTransferType;
+   gint64 slot_sent_time = slot->sent_time;
+   if( !g_atomic_pointer_compare_and_exchange(&slot->state,
+                                              state,
+                                              state & ~(gsize)RESPONSE_SLOT_STATE_MASK) )
+      return NULL;
+
+   RemoteOffloadTransportStats *typestats = transport_stats_for_type(channel, dataTransferType);
+   g_atomic_int_add(&typestats->inflight, -1);
+   if( stats )
+      *stats = typestats;
+   if( sent_time )
+      *sent_time = slot_sent_time;
+
+   return response;
+}
+
 void remote_offload_comms_channel_cancel_all(RemoteOffloadCommsChannel *channel)
 {
    if( !REMOTEOFFLOAD_IS_COMMSCHANNEL(channel) ) return;
 
-   g_mutex_lock(&channel->priv.responsePoolMutex);
-   channel->priv.bcancelledstate = TRUE;
-   GHashTableIter iter;
-   gpointer key, value;
-   g_hash_table_iter_init (&iter, channel->priv.activeWaitingEntryMap);
-   while (g_hash_table_iter_next (&iter, &key, &value))
+   //Writers check this after registering their response, so any response
+   // that is registered after the sweep below has passed its slot is
+   // cancelled by the writer itself.
+   g_atomic_int_set(&channel->priv.bcancelledstate, TRUE);
+
+   for( guint slotindex = 0; slotindex < RESPONSE_NUM_SLOTS; slotindex++ )
    {
-      RemoteOffloadResponse *response = (RemoteOffloadResponse *)value;
-      g_hash_table_iter_remove (&iter);
-      remote_offload_response_cancel(response);
+      ResponseSlot *slot = &channel->priv.responseSlots[slotindex];
+      gsize state = (gsize)g_atomic_pointer_get(&slot->state);
+      if( (state & RESPONSE_SLOT_STATE_MASK) != RESPONSE_SLOT_BUSY )
+         continue;
+
+      RemoteOffloadResponse *response =
+            response_slot_release(channel, response_id_make(slotindex, state >> 2),
+                                  NULL, NULL);
+      if( response )
+      {
+         remote_offload_response_cancel(response);
+         g_object_unref(response);
+      }
    }
-   g_mutex_unlock(&(channel->priv.responsePoolMutex));
 }
 
 void remote_offload_comms_channel_error_state(RemoteOffloadCommsChannel *channel)
@@ -389,28 +626,42 @@ remote_offload_comms_channel_callback_data_transfer_received(RemoteOffloadCommsC
 
    //special case for RESPONSES. Add the segment_mem_array directly
    // to the response object
+   guint nsegments = segment_mem_array ? segment_mem_array->len : 0;
+   gsize bytes = 0;
+   for( guint i = 0; i < nsegments; i++ )
+      bytes += gst_memory_get_sizes(g_array_index(segment_mem_array, GstMemory *, i), NULL, NULL);
+   remote_offload_transport_stats_add_rx(transport_stats_for_type(channel,
+                                                                  header->dataTransferType),
+                                         bytes, nsegments);
+
    if( header->dataTransferType == DE_TYPE_RESPONSE )
    {
-       RemoteOffloadResponse* response = NULL;
-       g_mutex_lock(&channel->priv.responsePoolMutex);
-       response = g_hash_table_lookup (channel->priv.activeWaitingEntryMap,
-                                      (gconstpointer)(gulong)header->response_id);
-       g_hash_table_remove(channel->priv.activeWaitingEntryMap,
-                           (gconstpointer)(gulong)header->response_id);
-
-       g_mutex_unlock(&(channel->priv.responsePoolMutex));
+       RemoteOffloadTransportStats *requeststats = NULL;
+       gint64 sent_time = 0;
+       RemoteOffloadResponse* response = response_slot_release(channel,
+                                                               header->response_id,
+                                                               &requeststats,
+                                                               &sent_time);
 
        if( response )
        {
+          remote_offload_stats_histogram_add(&requeststats->response_rtt,
+                                             g_get_monotonic_time() - sent_time);
+
           g_mutex_lock(&response->priv.responsemutex);
           response->priv.response_mem_array = g_array_ref(segment_mem_array);
+          response->priv.registered = FALSE;
           g_cond_broadcast(&response->priv.responsecond);
           g_mutex_unlock(&response->priv.responsemutex);
+
+          //the table's reference. The waiter may have already given up on
+          // (and dropped) the response, so this is done last.
+          g_object_unref(response);
        }
        else
        {
           GST_WARNING_OBJECT (channel,
-                              "id %"G_GUINT64_FORMAT" not found in response map",
+                              "id %"G_GUINT64_FORMAT" not found in response table",
                               header->response_id);
 
           //need to unref the memory
@@ -428,24 +679,26 @@ remote_offload_comms_channel_callback_data_transfer_received(RemoteOffloadCommsC
       DataTransferReceivedEntry *entry = data_transfer_received_entry_request(channel);
       entry->dataSegments = g_array_ref(segment_mem_array);
       entry->header = *header;
+      entry->received_time = g_get_monotonic_time();
 
       remote_offload_comms_channel_push_entry_to_active_queue(channel, entry);
    }
 }
 
-static gpointer remote_offload_comms_channel_receiver_thread(RemoteOffloadCommsChannel *self)
+static gpointer remote_offload_comms_channel_receiver_thread(ReceiverLane *lane)
 {
-   GST_DEBUG_OBJECT (self, "CommsChannel id=%d thread start", self->priv.id);
+   RemoteOffloadCommsChannel *self = lane->channel;
+   GST_DEBUG_OBJECT (self, "CommsChannel id=%d lane %u thread start", self->priv.id, lane->index);
 
    //Within this loop, the state of this mutex is LOCKED except when:
    // 1. The queue is empty, and this thread is waiting on a new queue entry
    //    to be pushed.
    // 2. This thread is currently executing a data exchanger's 'received' method.
    g_mutex_lock (&(self->priv.receiverthrmutex));
-   self->priv.bIdle = FALSE;
+   lane->bIdle = FALSE;
    while( 1 )
    {
-      DataTransferReceivedEntry *entry = g_queue_pop_head(self->priv.activedataTransferEntryQueue);
+      DataTransferReceivedEntry *entry = g_queue_pop_head(lane->activedataTransferEntryQueue);
       //if there were no entries in the queue
       if(!entry)
       {
@@ -453,7 +706,7 @@ static gpointer remote_offload_comms_channel_receiver_thread(RemoteOffloadCommsC
          // Set the flag and wake up any potential thread waiting on
          // an idle status (within remote_offload_comms_channel_unregister_exchanger
          // method )
-         self->priv.bIdle = TRUE;
+         lane->bIdle = TRUE;
          g_cond_broadcast (&(self->priv.idlecond));
 
          //Note that the position of this check/break means that this thread
@@ -463,8 +716,8 @@ static gpointer remote_offload_comms_channel_receiver_thread(RemoteOffloadCommsC
             break;
 
          //wait to be signaled (by thread who pushes new entry into queue)
-         g_cond_wait (&(self->priv.receiverthrcond), &(self->priv.receiverthrmutex));
-         self->priv.bIdle = FALSE;
+         g_cond_wait (&(lane->receiverthrcond), &(self->priv.receiverthrmutex));
+         lane->bIdle = FALSE;
       }
 
       RemoteOffloadCommsCallback *exchanger = NULL;
@@ -481,6 +734,10 @@ static gpointer remote_offload_comms_channel_receiver_thread(RemoteOffloadCommsC
 
          if( exchanger )
          {
+            remote_offload_stats_histogram_add(
+                  &transport_stats_for_type(self, entry->header.dataTransferType)->receive_latency,
+                  g_get_monotonic_time() - entry->received_time);
+
             //don't hold the mutex while this thread resides within data exchanger's 'received' method.
             g_mutex_unlock (&(self->priv.receiverthrmutex));
             remote_offload_comms_callback_data_transfer_received(exchanger,
@@ -507,7 +764,7 @@ static gpointer remote_offload_comms_channel_receiver_thread(RemoteOffloadCommsC
    }
    g_mutex_unlock (&(self->priv.receiverthrmutex));
 
-   GST_DEBUG_OBJECT (self, "CommsChannel id=%d thread end", self->priv.id);
+   GST_DEBUG_OBJECT (self, "CommsChannel id=%d lane %u thread end", self->priv.id, lane->index);
 
    return NULL;
 }
@@ -538,27 +795,30 @@ remote_offload_comms_channel_finalize (GObject *gobject)
 {
   RemoteOffloadCommsChannel *pCommsChannel = REMOTEOFFLOAD_COMMSCHANNEL(gobject);
 
-  if( pCommsChannel->priv.receiver_thread)
-  {
-    g_mutex_lock (&(pCommsChannel->priv.receiverthrmutex));
-    pCommsChannel->priv.bThreadRun = FALSE;
-    g_cond_broadcast (&(pCommsChannel->priv.receiverthrcond));
-    g_mutex_unlock (&(pCommsChannel->priv.receiverthrmutex));
-    g_thread_join (pCommsChannel->priv.receiver_thread);
-  }
+  g_mutex_lock (&(pCommsChannel->priv.receiverthrmutex));
+  pCommsChannel->priv.bThreadRun = FALSE;
+  for( guint i = 0; i < RECEIVER_NUM_LANES; i++ )
+    g_cond_broadcast (&(pCommsChannel->priv.lanes[i].receiverthrcond));
+  g_mutex_unlock (&(pCommsChannel->priv.receiverthrmutex));
 
-  //move the active entries to the free queue. This will in turn unref the GstMemory's
-  // in the array, as well as the array itself
+  for( guint i = 0; i < RECEIVER_NUM_LANES; i++ )
   {
-     DataTransferReceivedEntry *pEntry =
-           g_queue_pop_head(pCommsChannel->priv.activedataTransferEntryQueue);
-     while( pEntry != NULL )
-     {
-        data_transfer_received_entry_done(pCommsChannel, pEntry);
-        pEntry = g_queue_pop_head(pCommsChannel->priv.activedataTransferEntryQueue);
-     }
+    ReceiverLane *lane = &pCommsChannel->priv.lanes[i];
+    if( lane->receiver_thread )
+      g_thread_join (lane->receiver_thread);
+
+    //move the active entries to the free queue. This will in turn unref the GstMemory's
+    // in the array, as well as the array itself
+    DataTransferReceivedEntry *pEntry =
+          g_queue_pop_head(lane->activedataTransferEntryQueue);
+    while( pEntry != NULL )
+    {
+       data_transfer_received_entry_done(pCommsChannel, pEntry);
+       pEntry = g_queue_pop_head(lane->activedataTransferEntryQueue);
+    }
+    g_queue_free(lane->activedataTransferEntryQueue);
+    g_cond_clear(&(lane->receiverthrcond));
   }
-  g_queue_free(pCommsChannel->priv.activedataTransferEntryQueue);
 
   //if there are cached data entries, move them to the free pool also
   if( pCommsChannel->priv.cachedDataTransferList )
@@ -588,7 +848,6 @@ remote_offload_comms_channel_finalize (GObject *gobject)
 
 
   g_mutex_clear(&(pCommsChannel->priv.receiverthrmutex));
-  g_cond_clear(&(pCommsChannel->priv.receiverthrcond));
   g_cond_clear(&(pCommsChannel->priv.idlecond));
 
   if( pCommsChannel->priv.pcomms )
@@ -596,9 +855,12 @@ remote_offload_comms_channel_finalize (GObject *gobject)
      g_object_unref(pCommsChannel->priv.pcomms);
   }
 
-  g_mutex_clear(&(pCommsChannel->priv.responsePoolMutex));
-
-  g_hash_table_destroy(pCommsChannel->priv.activeWaitingEntryMap);
+  for( guint slotindex = 0; slotindex < RESPONSE_NUM_SLOTS; slotindex++ )
+  {
+     ResponseSlot *slot = &pCommsChannel->priv.responseSlots[slotindex];
+     if( (slot->state & RESPONSE_SLOT_STATE_MASK) == RESPONSE_SLOT_BUSY )
+        g_object_unref(slot->response);
+  }
 
   g_array_free(pCommsChannel->priv.exchangerArray, TRUE);
 
@@ -640,19 +902,12 @@ remote_offload_comms_channel_class_init (RemoteOffloadCommsChannelClass *klass)
    object_class->finalize = remote_offload_comms_channel_finalize;
 }
 
-static void ActiveWaitingResponseDestroy (gpointer data)
-{
-   RemoteOffloadResponse *resp = (RemoteOffloadResponse *)data;
-   g_object_unref(resp);
-}
-
 static void
 remote_offload_comms_channel_init (RemoteOffloadCommsChannel *self)
 {
   self->priv.pcomms = NULL;
   self->priv.is_state_okay = FALSE;
   self->priv.id = -1;
-  g_mutex_init(&(self->priv.responsePoolMutex));
 
   g_mutex_init(&self->priv.failcallbackmutex);
   self->priv.comms_failure_callback = NULL;
@@ -660,10 +915,9 @@ remote_offload_comms_channel_init (RemoteOffloadCommsChannel *self)
 
   self->priv.bcancelledstate = FALSE;
 
-  self->priv.activeWaitingEntryMap = g_hash_table_new_full(g_direct_hash,
-                                                           g_direct_equal,
-                                                           NULL,
-                                                           ActiveWaitingResponseDestroy);
+  memset(self->priv.responseSlots, 0, sizeof(self->priv.responseSlots));
+  memset(self->priv.stats, 0, sizeof(self->priv.stats));
+  self->priv.nextResponseSlot = 0;
 
   self->priv.exchangerArray = g_array_sized_new(FALSE,
                                                 TRUE,
@@ -674,13 +928,18 @@ remote_offload_comms_channel_init (RemoteOffloadCommsChannel *self)
   self->priv.cachedDataTransferList = NULL;
 
   g_mutex_init(&(self->priv.receiverthrmutex));
-  g_cond_init(&(self->priv.receiverthrcond));
   g_cond_init(&(self->priv.idlecond));
-  self->priv.receiver_thread = 0;
   self->priv.bThreadRun = TRUE;
-  self->priv.bIdle = TRUE;
-
-  self->priv.activedataTransferEntryQueue = g_queue_new();
+  for( guint i = 0; i < RECEIVER_NUM_LANES; i++ )
+  {
+     ReceiverLane *lane = &self->priv.lanes[i];
+     lane->channel = self;
+     lane->index = i;
+     g_cond_init(&(lane->receiverthrcond));
+     lane->receiver_thread = 0;
+     lane->bIdle = TRUE;
+     lane->activedataTransferEntryQueue = g_queue_new();
+  }
   self->priv.dataTransferEntryFreePool = g_queue_new();
 
   for( int i = 0; i < DEFAULT_NUM_DATA_TRANSFER_RECEIVED_ENTRIES; i++ )
@@ -726,12 +985,12 @@ gboolean remote_offload_comms_channel_unregister_exchanger(RemoteOffloadCommsCha
 
 
    g_mutex_lock (&(channel->priv.receiverthrmutex));
-   //wait for receiver thread to become idle.
+   //wait for all receiver lanes to become idle.
    // This ensures 2 things:
-   // 1. That the receiver thread isn't currently within the current data exchanger's
+   // 1. That no receiver thread is currently within the current data exchanger's
    //    'received' function.
    // 2. That all pending received tasks for this have been completed.
-   while( !channel->priv.bIdle )
+   while( !receiver_lanes_idle(channel) )
    {
       g_cond_wait (&(channel->priv.idlecond), &(channel->priv.receiverthrmutex));
    }
@@ -868,6 +1127,7 @@ gboolean remote_offload_comms_channel_register_exchanger(RemoteOffloadCommsChann
    // exchanger that we just registered, push them to the active queue.
    {
       GList *entrylisti = channel->priv.cachedDataTransferList;
+      ReceiverLane *lane = receiver_lane_for_type(channel, id);
       gboolean bwakeup = FALSE;
       while (entrylisti != NULL )
       {
@@ -883,7 +1143,7 @@ gboolean remote_offload_comms_channel_register_exchanger(RemoteOffloadCommsChann
             //push this entry to the active queue
             //Note, we don't call remote_offload_comms_channel_push_entry_to_active_queue
             // here because we are already holding the lock
-            g_queue_push_tail(channel->priv.activedataTransferEntryQueue, entry);
+            g_queue_push_tail(lane->activedataTransferEntryQueue, entry);
             bwakeup = TRUE;
          }
 
@@ -892,7 +1152,7 @@ gboolean remote_offload_comms_channel_register_exchanger(RemoteOffloadCommsChann
 
       //if we pushed something into the queue, wake up the receiver thread.
       if( bwakeup )
-         g_cond_broadcast(&(channel->priv.receiverthrcond));
+         g_cond_broadcast(&(lane->receiverthrcond));
    }
    g_mutex_unlock (&(channel->priv.receiverthrmutex));
 
@@ -929,6 +1189,7 @@ remote_offload_response_init (RemoteOffloadResponse *self)
   g_mutex_init(&self->priv.responsemutex);
   g_cond_init(&self->priv.responsecond);
   self->priv.canceled = FALSE;
+  self->priv.registered = FALSE;
 }
 
 RemoteOffloadResponse *remote_offload_response_new()
@@ -976,6 +1237,18 @@ RemoteOffloadResponseStatus remote_offload_response_wait(RemoteOffloadResponse *
    return status;
 }
 
+gboolean remote_offload_response_is_complete(RemoteOffloadResponse *response)
+{
+   if( !REMOTEOFFLOAD_IS_RESPONSE(response) )
+      return FALSE;
+
+   g_mutex_lock(&response->priv.responsemutex);
+   gboolean ret = (response->priv.response_mem_array != NULL) || response->priv.canceled;
+   g_mutex_unlock(&response->priv.responsemutex);
+
+   return ret;
+}
+
 void remote_offload_response_cancel(RemoteOffloadResponse *response)
 {
    if( !REMOTEOFFLOAD_IS_RESPONSE(response) )
@@ -983,6 +1256,7 @@ void remote_offload_response_cancel(RemoteOffloadResponse *response)
 
    g_mutex_lock(&response->priv.responsemutex);
    response->priv.canceled = TRUE;
+   response->priv.registered = FALSE;
    g_cond_broadcast(&response->priv.responsecond);
    g_mutex_unlock(&response->priv.responsemutex);
 }
@@ -1002,6 +1276,25 @@ GArray *remote_offload_response_steal_mem_array(RemoteOffloadResponse *response)
    return mem_array;
 }
 
+gboolean remote_offload_response_reset(RemoteOffloadResponse *response)
+{
+   if( !REMOTEOFFLOAD_IS_RESPONSE(response) ) return FALSE;
+
+   g_mutex_lock(&response->priv.responsemutex);
+   //a comms channel may still complete (or cancel) it
+   if( response->priv.registered )
+   {
+      g_mutex_unlock(&response->priv.responsemutex);
+      return FALSE;
+   }
+
+   clear_response_memarray(response);
+   response->priv.canceled = FALSE;
+   g_mutex_unlock(&response->priv.responsemutex);
+
+   return TRUE;
+}
+
 gboolean remote_offload_copy_response(RemoteOffloadResponse *response,
                                       void *dest,
                                       gsize size,
@@ -1073,41 +1366,68 @@ gboolean remote_offload_comms_channel_write(RemoteOffloadCommsChannel *channel,
       return FALSE;
 
    header->id = channel->priv.id;
-   header->response_id = (guint64)(gulong)response;
-
-
-   g_mutex_lock(&(channel->priv.responsePoolMutex));
-   gboolean bcancelled = channel->priv.bcancelledstate;
-   g_mutex_unlock(&(channel->priv.responsePoolMutex));
+   header->response_id = 0;
 
    RemoteOffloadCommsIOResult res = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
-   if( G_LIKELY(!bcancelled) )
+   if( G_LIKELY(!g_atomic_int_get(&channel->priv.bcancelledstate)) )
    {
       if( response )
       {
-         g_mutex_lock(&(channel->priv.responsePoolMutex));
-         if( G_UNLIKELY(!g_hash_table_insert(channel->priv.activeWaitingEntryMap,
-                             response, g_object_ref(response))) )
+         header->response_id = response_slot_register(channel, response,
+                                                      header->dataTransferType);
+         if( G_UNLIKELY(!header->response_id) )
          {
-            GST_WARNING_OBJECT(response, "response %p already present in active waiting list",
-                               response);
+            GST_ERROR_OBJECT(channel, "All %d response slots are in use",
+                             RESPONSE_NUM_SLOTS);
+            return FALSE;
+         }
+
+         //cancel_all may have swept the table before this response was registered
+         if( G_UNLIKELY(g_atomic_int_get(&channel->priv.bcancelledstate)) )
+         {
+            RemoteOffloadResponse *released =
+                  response_slot_release(channel, header->response_id, NULL, NULL);
+            if( released )
+            {
+               remote_offload_response_cancel(released);
+               g_object_unref(released);
+            }
+            return FALSE;
          }
-         g_mutex_unlock(&(channel->priv.responsePoolMutex));
       }
 
+      guint nsegments;
+      gsize bytes = mem_list_size(mem_list, &nsegments);
+      gint64 writelock_wait_us = 0;
+      gint64 write_start_time = g_get_monotonic_time();
       res = remote_offload_comms_write(channel->priv.pcomms,
                                        header,
-                                       mem_list);
-      if( G_UNLIKELY(res!=REMOTEOFFLOADCOMMSIO_SUCCESS) )
+                                       mem_list,
+                                       comms_priority_for_type(header->dataTransferType),
+                                       &writelock_wait_us);
+      if( G_LIKELY(res==REMOTEOFFLOADCOMMSIO_SUCCESS) )
+      {
+         remote_offload_transport_stats_add_tx(transport_stats_for_type(channel,
+                                                                        header->dataTransferType),
+                                               bytes, nsegments,
+                                               g_get_monotonic_time() - write_start_time,
+                                               writelock_wait_us);
+      }
+      else
       {
          GST_ERROR_OBJECT(channel, "remote_offload_comms_write failed. return=%d", res);
-         g_mutex_lock(&(channel->priv.responsePoolMutex));
          if( response )
          {
-            g_hash_table_remove(channel->priv.activeWaitingEntryMap,
-                                response);
+            RemoteOffloadResponse *released =
+                  response_slot_release(channel, header->response_id, NULL, NULL);
+            if( released )
+            {
+               g_mutex_lock(&released->priv.responsemutex);
+               released->priv.registered = FALSE;
+               g_mutex_unlock(&released->priv.responsemutex);
+               g_object_unref(released);
+            }
          }
-         g_mutex_unlock(&(channel->priv.responsePoolMutex));
       }
    }
 
@@ -1124,22 +1444,33 @@ gboolean remote_offload_comms_channel_write_response(RemoteOffloadCommsChannel *
       return FALSE;
    }
 
-   g_mutex_lock(&(channel->priv.responsePoolMutex));
-   gboolean bcancelled = channel->priv.bcancelledstate;
-   g_mutex_unlock(&(channel->priv.responsePoolMutex));
-
    RemoteOffloadCommsIOResult res = REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
-   if( G_LIKELY(!bcancelled) )
+   if( G_LIKELY(!g_atomic_int_get(&channel->priv.bcancelledstate)) )
    {
       DataTransferHeader header;
       header.id = channel->priv.id;
       header.dataTransferType = DE_TYPE_RESPONSE;
       header.response_id = response_id;
 
+      guint nsegments;
+      gsize bytes = mem_list_size(mem_list_response, &nsegments);
+      gint64 writelock_wait_us = 0;
+      gint64 write_start_time = g_get_monotonic_time();
+
+      //responses are always small, and something is waiting on them
       res = remote_offload_comms_write(channel->priv.pcomms,
                                        &header,
-                                       mem_list_response);
-      if( G_UNLIKELY(res != REMOTEOFFLOADCOMMSIO_SUCCESS) )
+                                       mem_list_response,
+                                       REMOTEOFFLOADCOMMS_PRIORITY_CONTROL,
+                                       &writelock_wait_us);
+      if( G_LIKELY(res == REMOTEOFFLOADCOMMSIO_SUCCESS) )
+      {
+         remote_offload_transport_stats_add_tx(&channel->priv.stats[DE_TYPE_RESPONSE],
+                                               bytes, nsegments,
+                                               g_get_monotonic_time() - write_start_time,
+                                               writelock_wait_us);
+      }
+      else
       {
          GST_ERROR_OBJECT(channel, "remote_offload_comms_write failed. return=%d", res);
       }
@@ -1169,3 +1500,69 @@ GList *remote_offload_comms_channel_get_producible_memfeatures(RemoteOffloadComm
 
    return NULL;
 }
+
+GstStructure *remote_offload_comms_channel_get_stats(RemoteOffloadCommsChannel *channel)
+{
+   if( !REMOTEOFFLOAD_IS_COMMSCHANNEL(channel) )
+     return NULL;
+
+   GstStructure *structure = gst_structure_new("channel-stats",
+                                               "id", G_TYPE_INT, channel->priv.id,
+                                               NULL);
+
+   for( guint type = 0; type < DE_NUM_TYPES; type++ )
+   {
+      RemoteOffloadTransportStats snapshot;
+      remote_offload_transport_stats_snapshot(&channel->priv.stats[type], &snapshot);
+
+      //only report the types that have been used
+      if( !snapshot.tx_messages && !snapshot.rx_messages && !snapshot.inflight )
+         continue;
+
+      GstStructure *typestructure =
+            remote_offload_transport_stats_to_structure(&snapshot,
+                                                        data_exchanger_type_names[type]);
+      gst_structure_set(structure, data_exchanger_type_names[type],
+                        GST_TYPE_STRUCTURE, typestructure, NULL);
+      gst_structure_free(typestructure);
+   }
+
+   RemoteOffloadCompressionStats compression;
+   if( remote_offload_comms_channel_get_compression_stats(channel, &compression) )
+   {
+      RemoteOffloadCompressionCodec codec =
+            remote_offload_comms_get_compression_codec(channel->priv.pcomms);
+      GstStructure *compressionstructure =
+            gst_structure_new("compression",
+                              "codec", G_TYPE_STRING, remote_offload_compression_codec_name(codec),
+                              "segments-compressed", G_TYPE_UINT64,
+                              compression.nsegments_compressed,
+                              "segments-incompressible", G_TYPE_UINT64,
+                              compression.nsegments_incompressible,
+                              "bytes-in", G_TYPE_UINT64, compression.bytes_in,
+                              "bytes-out", G_TYPE_UINT64, compression.bytes_out,
+                              "segments-decompressed", G_TYPE_UINT64,
+                              compression.nsegments_decompressed,
+                              "bytes-decompressed", G_TYPE_UINT64, compression.bytes_decompressed,
+                              NULL);
+      gst_structure_set(structure, "compression",
+                        GST_TYPE_STRUCTURE, compressionstructure, NULL);
+      gst_structure_free(compressionstructure);
+   }
+
+   return structure;
+}
+
+gboolean remote_offload_comms_channel_get_compression_stats(RemoteOffloadCommsChannel *channel,
+                                                            RemoteOffloadCompressionStats *stats)
+{
+   if( !REMOTEOFFLOAD_IS_COMMSCHANNEL(channel) )
+     return FALSE;
+
+   if( channel->priv.pcomms )
+      return remote_offload_comms_get_compression_stats(channel->priv.pcomms,
+                                                        channel->priv.id,
+                                                        stats);
+
+   return FALSE;
+}
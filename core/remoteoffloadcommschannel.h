@@ -25,7 +25,9 @@
 
 #include <glib-object.h>
 #include <gst/gstmemory.h>
+#include <gst/gststructure.h>
 #include "datatransferdefs.h"
+#include "remoteoffloadcompression.h"
 
 G_BEGIN_DECLS
 
@@ -36,6 +38,12 @@ G_DECLARE_FINAL_TYPE (RemoteOffloadCommsChannel,
 
 typedef struct _RemoteOffloadComms RemoteOffloadComms;
 
+//Upper bound of "max-inflight-buffers". Each in-flight buffer holds one of the
+// channel's response slots until its flow return is received, so this is kept
+// well below the number of slots, leaving room for the requests of the other
+// exchangers (queries, events, state changes, ...) sharing the channel.
+#define REMOTEOFFLOAD_MAX_INFLIGHT_BUFFERS 256
+
 //Create a new comms channel
 // The comms channel instance will internally register itself with the passed in comms object
 //  during construction. There is no need to do that separately.
@@ -74,6 +82,18 @@ gboolean remote_offload_comms_channel_unregister_exchanger(RemoteOffloadCommsCha
 GList *remote_offload_comms_channel_get_consumable_memfeatures(RemoteOffloadCommsChannel *channel);
 GList *remote_offload_comms_channel_get_producible_memfeatures(RemoteOffloadCommsChannel *channel);
 
+//Obtain the transport stats of this channel, as a "channel-stats" structure
+// holding the channel "id", and a structure per type of data transfer that has
+// been sent or received (see remote_offload_transport_stats_to_structure).
+// If the comms compresses, a "compression" structure holds the codec name, and
+// the compression stats of this channel. The caller owns the returned structure.
+GstStructure *remote_offload_comms_channel_get_stats(RemoteOffloadCommsChannel *channel);
+
+//Obtain the compression stats of this channel. Returns FALSE if its comms
+// doesn't compress.
+gboolean remote_offload_comms_channel_get_compression_stats(RemoteOffloadCommsChannel *channel,
+                                                            RemoteOffloadCompressionStats *stats);
+
 //1. All calls to comms_channel_write / comms_channel_write response will fail
 //   after this is called.
 //2. This will trigger all responses that are currently being waited on to return.
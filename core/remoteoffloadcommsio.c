@@ -20,6 +20,7 @@
  *  Boston, MA 02110-1301 USA
  */
 #include "remoteoffloadcommsio.h"
+#include "remoteoffloadviewmemory.h"
 
 G_DEFINE_INTERFACE (RemoteOffloadCommsIO, remote_offload_comms_io, G_TYPE_OBJECT)
 
@@ -155,6 +156,23 @@ RemoteOffloadCommsIOResult remote_offload_comms_io_read_mem_list(RemoteOffloadCo
   return REMOTEOFFLOADCOMMSIO_FAIL;
 }
 
+RemoteOffloadCommsIOResult remote_offload_comms_io_read_mem_ref(RemoteOffloadCommsIO *commsio,
+                                                                guint64 size,
+                                                                GstMemory **mem)
+{
+  RemoteOffloadCommsIOInterface *iface;
+
+  if( !REMOTEOFFLOAD_IS_COMMSIO(commsio) || !mem ) return REMOTEOFFLOADCOMMSIO_FAIL;
+
+  *mem = NULL;
+
+  iface = REMOTEOFFLOAD_COMMSIO_GET_IFACE(commsio);
+
+  if( iface->read_mem_ref )
+     return iface->read_mem_ref(commsio, size, mem);
+
+  return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
 
 RemoteOffloadCommsIOResult remote_offload_comms_io_write(RemoteOffloadCommsIO *commsio,
                                                          guint8 *buf,
@@ -261,6 +279,43 @@ RemoteOffloadCommsIOResult remote_offload_comms_io_write_mem_list(RemoteOffloadC
   return REMOTEOFFLOADCOMMSIO_FAIL;
 }
 
+GstMemory *remote_offload_comms_io_make_mem_shareable(GstMemory *mem)
+{
+  if( !mem ) return NULL;
+
+  //Only system memory is known to be safely readable by the peer for as long
+  // as it's referenced. A view keeps the original memory alive, and makes it
+  // non-writable, so whoever owns it will copy-on-write instead of modifying
+  // the data underneath the peer.
+  if( gst_memory_is_type(mem, GST_ALLOCATOR_SYSMEM) &&
+      !GST_MEMORY_FLAG_IS_SET(mem, GST_MEMORY_FLAG_NO_SHARE) )
+  {
+     GstMemory *shared = remote_offload_view_memory_new(mem, 0, mem->size, TRUE);
+     if( shared )
+     {
+        gst_memory_unref(mem);
+        return shared;
+     }
+  }
+
+  return mem;
+}
+
+gboolean remote_offload_comms_io_mem_is_shareable(GstMemory *mem)
+{
+  return remote_offload_view_memory_is_shareable(mem);
+}
+
+GstMemory *remote_offload_comms_io_share_mem(GstMemory *mem,
+                                             gsize offset,
+                                             gsize size)
+{
+  if( !mem ) return NULL;
+
+  return remote_offload_view_memory_new(mem, offset, size,
+                                        remote_offload_comms_io_mem_is_shareable(mem));
+}
+
 GList *remote_offload_comms_io_get_consumable_memfeatures(RemoteOffloadCommsIO *commsio)
 {
    RemoteOffloadCommsIOInterface *iface;
@@ -52,6 +52,14 @@ struct _RemoteOffloadCommsIOInterface
    RemoteOffloadCommsIOResult (*read_mem_list)(RemoteOffloadCommsIO *commsio,
                                                GList *mem_list);
 
+   //Optional. Receive the next 'size' bytes as a GstMemory owned by the
+   // CommsIO, instead of into caller-provided memory. If that isn't possible
+   // for the next 'size' bytes, set *mem to NULL, consume nothing, and
+   // return REMOTEOFFLOADCOMMSIO_SUCCESS.
+   RemoteOffloadCommsIOResult (*read_mem_ref)(RemoteOffloadCommsIO *commsio,
+                                              guint64 size,
+                                              GstMemory **mem);
+
    //At least one of the following WRITE interfaces are required be implemented.
    RemoteOffloadCommsIOResult (*write)(RemoteOffloadCommsIO *commsio,
                                        guint8 *buf,
@@ -95,6 +103,12 @@ RemoteOffloadCommsIOResult remote_offload_comms_io_read_mem(RemoteOffloadCommsIO
 RemoteOffloadCommsIOResult remote_offload_comms_io_read_mem_list(RemoteOffloadCommsIO *commsio,
                                                                  GList *mem_list);
 
+//If read_mem_ref isn't implemented, *mem is set to NULL and
+// REMOTEOFFLOADCOMMSIO_SUCCESS is returned.
+RemoteOffloadCommsIOResult remote_offload_comms_io_read_mem_ref(RemoteOffloadCommsIO *commsio,
+                                                                guint64 size,
+                                                                GstMemory **mem);
+
 RemoteOffloadCommsIOResult remote_offload_comms_io_write(RemoteOffloadCommsIO *commsio,
                                                         guint8 *buf,
                                                         guint64 size);
@@ -106,6 +120,25 @@ RemoteOffloadCommsIOResult remote_offload_comms_io_write_mem(RemoteOffloadCommsI
 RemoteOffloadCommsIOResult remote_offload_comms_io_write_mem_list(RemoteOffloadCommsIO *commsio,
                                                                   GList *mem_list);
 
+//Given a memory that is about to be written, return a memory referring to the
+// same data that is marked as shareable, or mem itself if this isn't possible.
+// Takes ownership of mem.
+GstMemory *remote_offload_comms_io_make_mem_shareable(GstMemory *mem);
+
+//Returns TRUE if mem (passed to write_mem / write_mem_list) was returned by
+// remote_offload_comms_io_make_mem_shareable, meaning that its contents will
+// stay valid & unmodified for as long as a reference to it is held. A CommsIO
+// may then keep a reference to the memory instead of copying it. Other memories
+// are only guaranteed to be valid for the duration of the write call.
+gboolean remote_offload_comms_io_mem_is_shareable(GstMemory *mem);
+
+//Return a read-only memory referring to 'size' bytes of mem, starting at
+// 'offset', in the way that gst_memory_share() would. It is shareable if mem is.
+// Unlike gst_memory_share(), this doesn't allocate once streaming.
+GstMemory *remote_offload_comms_io_share_mem(GstMemory *mem,
+                                             gsize offset,
+                                             gsize size);
+
 GList *remote_offload_comms_io_get_consumable_memfeatures(RemoteOffloadCommsIO *commsio);
 GList *remote_offload_comms_io_get_producible_memfeatures(RemoteOffloadCommsIO *commsio);
 
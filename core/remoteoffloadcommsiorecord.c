@@ -0,0 +1,334 @@
+/*
+ *  remoteoffloadcommsiorecord.c - CommsIO decorator that records wire traffic to a trace file
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "remoteoffloadcommsiorecord.h"
+
+/* Private structure definition. */
+typedef struct
+{
+   RemoteOffloadCommsIO *inner;
+   gboolean bpayload;
+
+   //serializes records, as reads & writes are made from different threads
+   GMutex filemutex;
+   FILE *fp;
+   gboolean bwriteerror;
+   gint64 start_time;
+} RemoteOffloadCommsIORecordPrivate;
+
+struct _RemoteOffloadCommsIORecord
+{
+  GObject parent_instance;
+
+  /* Other members, including private data. */
+  RemoteOffloadCommsIORecordPrivate priv;
+};
+
+GST_DEBUG_CATEGORY_STATIC (comms_io_record_debug);
+#define GST_CAT_DEFAULT comms_io_record_debug
+
+static void remote_offload_comms_io_record_interface_init (RemoteOffloadCommsIOInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RemoteOffloadCommsIORecord, remote_offload_comms_io_record, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADCOMMSIO_TYPE,
+                         remote_offload_comms_io_record_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (comms_io_record_debug,
+                         "remoteoffloadcommsiorecord", 0,
+                         "debug category for RemoteOffloadCommsIORecord"))
+
+static guint64 fnv1a_hash(const guint8 *data, guint64 size)
+{
+   guint64 hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+   for( guint64 i = 0; i < size; i++ )
+   {
+      hash ^= data[i];
+      hash *= G_GUINT64_CONSTANT(0x100000001b3);
+   }
+
+   return hash;
+}
+
+static void record_bytes(RemoteOffloadCommsIORecord *self,
+                         RemoteOffloadTraceDirection direction,
+                         const guint8 *data,
+                         guint64 size)
+{
+   RemoteOffloadTraceRecord record = {0};
+   record.size = size;
+   record.direction = direction;
+   record.content = self->priv.bpayload ? REMOTEOFFLOAD_TRACE_CONTENT_PAYLOAD :
+                                          REMOTEOFFLOAD_TRACE_CONTENT_HASH;
+
+   //hash outside of the lock
+   guint64 hash = 0;
+   if( !self->priv.bpayload )
+      hash = fnv1a_hash(data, size);
+
+   g_mutex_lock(&self->priv.filemutex);
+   if( !self->priv.bwriteerror )
+   {
+      record.timestamp_us = g_get_monotonic_time() - self->priv.start_time;
+
+      gboolean bokay = (fwrite(&record, sizeof(record), 1, self->priv.fp) == 1);
+      if( bokay )
+      {
+         if( self->priv.bpayload )
+            bokay = (fwrite(data, 1, size, self->priv.fp) == size);
+         else
+            bokay = (fwrite(&hash, sizeof(hash), 1, self->priv.fp) == 1);
+      }
+
+      //a partial trace is still useful, but a torn record would make the
+      // rest of it unreadable, so stop recording.
+      if( !bokay )
+      {
+         GST_ERROR_OBJECT(self, "Error writing to trace file. Recording stopped.");
+         self->priv.bwriteerror = TRUE;
+      }
+   }
+   g_mutex_unlock(&self->priv.filemutex);
+}
+
+static void record_mem(RemoteOffloadCommsIORecord *self,
+                       RemoteOffloadTraceDirection direction,
+                       GstMemory *mem)
+{
+   GstMapInfo map;
+   if( gst_memory_map(mem, &map, GST_MAP_READ) )
+   {
+      record_bytes(self, direction, map.data, map.size);
+      gst_memory_unmap(mem, &map);
+   }
+   else
+   {
+      GST_WARNING_OBJECT(self, "Unable to map memory for recording. Recording it as empty.");
+      record_bytes(self, direction, NULL, 0);
+   }
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_read(RemoteOffloadCommsIO *commsio,
+                                                                      guint8 *buf,
+                                                                      guint64 size)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   RemoteOffloadCommsIOResult ret = remote_offload_comms_io_read(self->priv.inner, buf, size);
+   if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+      record_bytes(self, REMOTEOFFLOAD_TRACE_DIRECTION_READ, buf, size);
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_read_mem(RemoteOffloadCommsIO *commsio,
+                                                                          GstMemory *mem)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   RemoteOffloadCommsIOResult ret = remote_offload_comms_io_read_mem(self->priv.inner, mem);
+   if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+      record_mem(self, REMOTEOFFLOAD_TRACE_DIRECTION_READ, mem);
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_read_mem_list(RemoteOffloadCommsIO *commsio,
+                                                                               GList *mem_list)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   RemoteOffloadCommsIOResult ret =
+         remote_offload_comms_io_read_mem_list(self->priv.inner, mem_list);
+   if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+   {
+      for( GList *li = mem_list; li != NULL; li = li->next )
+         record_mem(self, REMOTEOFFLOAD_TRACE_DIRECTION_READ, (GstMemory *)li->data);
+   }
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_read_mem_ref(RemoteOffloadCommsIO *commsio,
+                                                                              guint64 size,
+                                                                              GstMemory **mem)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   RemoteOffloadCommsIOResult ret =
+         remote_offload_comms_io_read_mem_ref(self->priv.inner, size, mem);
+   if( (ret == REMOTEOFFLOADCOMMSIO_SUCCESS) && *mem )
+      record_mem(self, REMOTEOFFLOAD_TRACE_DIRECTION_READ, *mem);
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_write(RemoteOffloadCommsIO *commsio,
+                                                                       guint8 *buf,
+                                                                       guint64 size)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   //record before writing, as the peer may respond before the write returns
+   record_bytes(self, REMOTEOFFLOAD_TRACE_DIRECTION_WRITE, buf, size);
+
+   return remote_offload_comms_io_write(self->priv.inner, buf, size);
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_write_mem(RemoteOffloadCommsIO *commsio,
+                                                                           GstMemory *mem)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   record_mem(self, REMOTEOFFLOAD_TRACE_DIRECTION_WRITE, mem);
+
+   return remote_offload_comms_io_write_mem(self->priv.inner, mem);
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_record_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                                                                GList *mem_list)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   for( GList *li = mem_list; li != NULL; li = li->next )
+      record_mem(self, REMOTEOFFLOAD_TRACE_DIRECTION_WRITE, (GstMemory *)li->data);
+
+   return remote_offload_comms_io_write_mem_list(self->priv.inner, mem_list);
+}
+
+static GList *remote_offload_comms_io_record_get_consumable_memfeatures(RemoteOffloadCommsIO *commsio)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   return remote_offload_comms_io_get_consumable_memfeatures(self->priv.inner);
+}
+
+static GList *remote_offload_comms_io_record_get_producible_memfeatures(RemoteOffloadCommsIO *commsio)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   return remote_offload_comms_io_get_producible_memfeatures(self->priv.inner);
+}
+
+static void remote_offload_comms_io_record_shutdown(RemoteOffloadCommsIO *commsio)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(commsio);
+
+   remote_offload_comms_io_shutdown(self->priv.inner);
+
+   g_mutex_lock(&self->priv.filemutex);
+   fflush(self->priv.fp);
+   g_mutex_unlock(&self->priv.filemutex);
+}
+
+static void
+remote_offload_comms_io_record_interface_init (RemoteOffloadCommsIOInterface *iface)
+{
+   iface->read = remote_offload_comms_io_record_read;
+   iface->read_mem = remote_offload_comms_io_record_read_mem;
+   iface->read_mem_list = remote_offload_comms_io_record_read_mem_list;
+   iface->read_mem_ref = remote_offload_comms_io_record_read_mem_ref;
+   iface->write = remote_offload_comms_io_record_write;
+   iface->write_mem = remote_offload_comms_io_record_write_mem;
+   iface->write_mem_list = remote_offload_comms_io_record_write_mem_list;
+   iface->get_consumable_memfeatures = remote_offload_comms_io_record_get_consumable_memfeatures;
+   iface->get_producible_memfeatures = remote_offload_comms_io_record_get_producible_memfeatures;
+   iface->shutdown = remote_offload_comms_io_record_shutdown;
+}
+
+static void
+remote_offload_comms_io_record_finalize (GObject *gobject)
+{
+   RemoteOffloadCommsIORecord *self = REMOTEOFFLOAD_COMMSIORECORD(gobject);
+
+   if( self->priv.fp )
+      fclose(self->priv.fp);
+
+   if( self->priv.inner )
+      g_object_unref(self->priv.inner);
+
+   g_mutex_clear(&self->priv.filemutex);
+
+   G_OBJECT_CLASS (remote_offload_comms_io_record_parent_class)->finalize (gobject);
+}
+
+static void
+remote_offload_comms_io_record_class_init (RemoteOffloadCommsIORecordClass *klass)
+{
+   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+   object_class->finalize = remote_offload_comms_io_record_finalize;
+}
+
+static void
+remote_offload_comms_io_record_init (RemoteOffloadCommsIORecord *self)
+{
+   self->priv.inner = NULL;
+   self->priv.bpayload = TRUE;
+   g_mutex_init(&self->priv.filemutex);
+   self->priv.fp = NULL;
+   self->priv.bwriteerror = FALSE;
+   self->priv.start_time = 0;
+}
+
+RemoteOffloadCommsIORecord *remote_offload_comms_io_record_new(RemoteOffloadCommsIO *inner,
+                                                               const gchar *tracefile,
+                                                               GArray *channel_ids,
+                                                               gboolean bpayload)
+{
+   if( !REMOTEOFFLOAD_IS_COMMSIO(inner) || !tracefile || !channel_ids )
+      return NULL;
+
+   RemoteOffloadCommsIORecord *self =
+         g_object_new(REMOTEOFFLOADCOMMSIORECORD_TYPE, NULL);
+
+   self->priv.fp = g_fopen(tracefile, "wb");
+   if( !self->priv.fp )
+   {
+      GST_ERROR_OBJECT(self, "Unable to open trace file %s for writing", tracefile);
+      g_object_unref(self);
+      return NULL;
+   }
+
+   RemoteOffloadTraceFileHeader header = {{0}};
+   memcpy(header.magic, REMOTEOFFLOAD_TRACE_MAGIC, sizeof(header.magic));
+   header.version = REMOTEOFFLOAD_TRACE_VERSION;
+   header.flags = bpayload ? REMOTEOFFLOAD_TRACE_FLAG_PAYLOAD : 0;
+   header.nchannels = channel_ids->len;
+   if( (fwrite(&header, sizeof(header), 1, self->priv.fp) != 1) ||
+       (fwrite(channel_ids->data, sizeof(gint32), channel_ids->len,
+               self->priv.fp) != channel_ids->len) )
+   {
+      GST_ERROR_OBJECT(self, "Error writing header of trace file %s", tracefile);
+      g_object_unref(self);
+      return NULL;
+   }
+
+   self->priv.inner = g_object_ref(inner);
+   self->priv.bpayload = bpayload;
+   self->priv.start_time = g_get_monotonic_time();
+
+   GST_INFO_OBJECT(self, "Recording traffic of commsio(%p) to %s (%s)",
+                   inner, tracefile, bpayload ? "payloads" : "hashes");
+
+   return self;
+}
@@ -0,0 +1,87 @@
+/*
+ *  remoteoffloadcommsiorecord.h - CommsIO decorator that records wire traffic to a trace file
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifndef __REMOTEOFFLOAD_COMMS_IO_RECORD_H__
+#define __REMOTEOFFLOAD_COMMS_IO_RECORD_H__
+
+#include <glib-object.h>
+#include "remoteoffloadcommsio.h"
+
+G_BEGIN_DECLS
+
+//Trace file layout (host byte order):
+// RemoteOffloadTraceFileHeader, then the (gint32) ids of the channels that were
+// carried by the CommsIO, then one RemoteOffloadTraceRecord per read / write
+// made through it. Each record is followed by either the
+// bytes that were transferred, or a 64-bit FNV-1a hash of them.
+#define REMOTEOFFLOAD_TRACE_MAGIC "ROTRACE1"
+#define REMOTEOFFLOAD_TRACE_VERSION 1
+
+//Set in the file header if the records carry payloads (instead of hashes)
+#define REMOTEOFFLOAD_TRACE_FLAG_PAYLOAD (1 << 0)
+
+typedef enum
+{
+   REMOTEOFFLOAD_TRACE_DIRECTION_READ = 0,
+   REMOTEOFFLOAD_TRACE_DIRECTION_WRITE = 1,
+} RemoteOffloadTraceDirection;
+
+typedef enum
+{
+   REMOTEOFFLOAD_TRACE_CONTENT_PAYLOAD = 0,
+   REMOTEOFFLOAD_TRACE_CONTENT_HASH = 1,
+} RemoteOffloadTraceContent;
+
+typedef struct _RemoteOffloadTraceFileHeader
+{
+   gchar magic[8];
+   guint32 version;
+   guint32 flags;
+   guint32 nchannels;
+   guint32 reserved;
+}RemoteOffloadTraceFileHeader;
+
+typedef struct _RemoteOffloadTraceRecord
+{
+   guint64 timestamp_us;  //time since the recording started
+   guint64 size;          //number of bytes transferred
+   guint8 direction;      //RemoteOffloadTraceDirection
+   guint8 content;        //RemoteOffloadTraceContent
+   guint16 reserved0;
+   guint32 reserved1;
+}RemoteOffloadTraceRecord;
+
+#define REMOTEOFFLOADCOMMSIORECORD_TYPE (remote_offload_comms_io_record_get_type ())
+G_DECLARE_FINAL_TYPE (RemoteOffloadCommsIORecord, remote_offload_comms_io_record,
+                      REMOTEOFFLOAD, COMMSIORECORD, GObject)
+
+//Create a CommsIO that passes everything through to 'inner', and records the
+// traffic to 'tracefile'. channel_ids is a GArray of the (gint) ids of the channels
+// that 'inner' carries. If bpayload is FALSE, only a hash of the bytes is recorded,
+// which keeps traces small but can't be replayed.
+RemoteOffloadCommsIORecord *remote_offload_comms_io_record_new(RemoteOffloadCommsIO *inner,
+                                                               const gchar *tracefile,
+                                                               GArray *channel_ids,
+                                                               gboolean bpayload);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOAD_COMMS_IO_RECORD_H__ */
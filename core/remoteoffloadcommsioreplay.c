@@ -0,0 +1,419 @@
+/*
+ *  remoteoffloadcommsioreplay.c - CommsIO that replays a recorded trace
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <string.h>
+#include "remoteoffloadcommsioreplay.h"
+#include "remoteoffloadcommsiorecord.h"
+
+//A recorded read, which is served to readers of the replay CommsIO
+typedef struct
+{
+   guint64 timestamp_us;
+   const guint8 *data;
+   guint64 size;
+   guint64 written_before; //bytes that were written before this read was recorded
+}ReplayEntry;
+
+//If the pipeline being replayed into stops writing while a read is waiting on
+// it, the session has diverged from the recording. Rather than hang, the read
+// is released after this long without any write.
+#define REPLAY_WRITE_STALL_TIMEOUT_US (5 * G_TIME_SPAN_SECOND)
+
+/* Private structure definition. */
+typedef struct
+{
+   GMappedFile *mappedfile;
+   GArray *entries; //array of ReplayEntry's
+   GArray *channel_ids; //array of gint's
+   gdouble speed;
+
+   //read position
+   guint entryi;
+   guint64 entryoffset;
+   guint64 first_timestamp_us;
+   gint64 start_time;
+
+   //protects the members below, and is signalled when they change
+   GMutex shutdownmutex;
+   GCond shutdowncond;
+   gboolean shutdownAsserted;
+   guint64 bytes_written;
+} RemoteOffloadCommsIOReplayPrivate;
+
+struct _RemoteOffloadCommsIOReplay
+{
+  GObject parent_instance;
+
+  /* Other members, including private data. */
+  RemoteOffloadCommsIOReplayPrivate priv;
+};
+
+GST_DEBUG_CATEGORY_STATIC (comms_io_replay_debug);
+#define GST_CAT_DEFAULT comms_io_replay_debug
+
+static void remote_offload_comms_io_replay_interface_init (RemoteOffloadCommsIOInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RemoteOffloadCommsIOReplay, remote_offload_comms_io_replay, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADCOMMSIO_TYPE,
+                         remote_offload_comms_io_replay_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (comms_io_replay_debug,
+                         "remoteoffloadcommsioreplay", 0,
+                         "debug category for RemoteOffloadCommsIOReplay"))
+
+//Parse the mapped trace into entries. Returns FALSE if it's malformed,
+// or can't be replayed.
+static gboolean parse_trace(RemoteOffloadCommsIOReplay *self,
+                            const gchar *tracefile)
+{
+   const guint8 *data = (const guint8 *)g_mapped_file_get_contents(self->priv.mappedfile);
+   gsize size = g_mapped_file_get_length(self->priv.mappedfile);
+
+   RemoteOffloadTraceFileHeader header;
+   if( size < sizeof(header) )
+   {
+      GST_ERROR_OBJECT(self, "%s is too small to be a trace file", tracefile);
+      return FALSE;
+   }
+
+   memcpy(&header, data, sizeof(header));
+   if( memcmp(header.magic, REMOTEOFFLOAD_TRACE_MAGIC, sizeof(header.magic)) ||
+       (header.version != REMOTEOFFLOAD_TRACE_VERSION) )
+   {
+      GST_ERROR_OBJECT(self, "%s isn't a (version %d) trace file",
+                       tracefile, REMOTEOFFLOAD_TRACE_VERSION);
+      return FALSE;
+   }
+
+   if( !(header.flags & REMOTEOFFLOAD_TRACE_FLAG_PAYLOAD) )
+   {
+      GST_ERROR_OBJECT(self, "%s was recorded without payloads, and can't be replayed",
+                       tracefile);
+      return FALSE;
+   }
+
+   gsize offset = sizeof(header);
+   if( ((size - offset) / sizeof(gint32)) < header.nchannels )
+   {
+      GST_ERROR_OBJECT(self, "%s is truncated", tracefile);
+      return FALSE;
+   }
+
+   for( guint32 i = 0; i < header.nchannels; i++ )
+   {
+      gint32 id;
+      memcpy(&id, data + offset, sizeof(id));
+      offset += sizeof(id);
+      gint channel_id = id;
+      g_array_append_val(self->priv.channel_ids, channel_id);
+   }
+
+   guint64 written = 0;
+   while( offset < size )
+   {
+      RemoteOffloadTraceRecord record;
+      if( (size - offset) < sizeof(record) )
+         break;
+      memcpy(&record, data + offset, sizeof(record));
+      offset += sizeof(record);
+
+      guint64 contentsize = (record.content == REMOTEOFFLOAD_TRACE_CONTENT_PAYLOAD) ?
+                             record.size : sizeof(guint64);
+      if( (size - offset) < contentsize )
+         break;
+
+      if( record.direction == REMOTEOFFLOAD_TRACE_DIRECTION_READ )
+      {
+         if( record.content != REMOTEOFFLOAD_TRACE_CONTENT_PAYLOAD )
+         {
+            GST_ERROR_OBJECT(self, "%s contains a read without payload", tracefile);
+            return FALSE;
+         }
+
+         if( record.size )
+         {
+            ReplayEntry entry = {record.timestamp_us, data + offset, record.size, written};
+            g_array_append_val(self->priv.entries, entry);
+         }
+      }
+      else
+      {
+         written += record.size;
+      }
+
+      offset += contentsize;
+   }
+
+   //a recording that was cut short (e.g. the process was killed) can still
+   // be replayed up to its last complete record.
+   if( offset != size )
+      GST_WARNING_OBJECT(self, "%s ends with a partial record, which is ignored", tracefile);
+
+   if( self->priv.entries->len )
+      self->priv.first_timestamp_us =
+            g_array_index(self->priv.entries, ReplayEntry, 0).timestamp_us;
+
+   GST_INFO_OBJECT(self, "Loaded %u reads from %s", self->priv.entries->len, tracefile);
+
+   return TRUE;
+}
+
+//Wait until entry is due: first until as many bytes have been written to us
+// as had been written before it was recorded (i.e. the pipeline has sent
+// whatever the recorded peer was responding to), then until its time on the
+// recorded timeline. Returns FALSE if shutdown was asserted in the meantime.
+static gboolean wait_until_due(RemoteOffloadCommsIOReplay *self,
+                               ReplayEntry *entry)
+{
+   gboolean ret;
+
+   g_mutex_lock(&self->priv.shutdownmutex);
+   while( !self->priv.shutdownAsserted &&
+          (self->priv.bytes_written < entry->written_before) )
+   {
+      guint64 bytes_written = self->priv.bytes_written;
+      gint64 stall_time = g_get_monotonic_time() + REPLAY_WRITE_STALL_TIMEOUT_US;
+      while( !self->priv.shutdownAsserted &&
+             (self->priv.bytes_written == bytes_written) )
+      {
+         if( !g_cond_wait_until(&self->priv.shutdowncond, &self->priv.shutdownmutex,
+                                stall_time) )
+            break;
+      }
+
+      if( !self->priv.shutdownAsserted &&
+          (self->priv.bytes_written == bytes_written) )
+      {
+         GST_WARNING_OBJECT(self, "Replay has diverged from the recording: "
+                            "%" G_GUINT64_FORMAT " bytes were written before the next read, "
+                            "but only %" G_GUINT64_FORMAT " have been written since. "
+                            "Not waiting for the rest.",
+                            entry->written_before, bytes_written);
+         break;
+      }
+   }
+
+   //the recorded timeline starts with the first read
+   if( !self->priv.start_time )
+      self->priv.start_time = g_get_monotonic_time();
+
+   if( self->priv.speed > 0 )
+   {
+      gint64 due_time = self->priv.start_time +
+            (gint64)((entry->timestamp_us - self->priv.first_timestamp_us) / self->priv.speed);
+      while( !self->priv.shutdownAsserted )
+      {
+         if( !g_cond_wait_until(&self->priv.shutdowncond, &self->priv.shutdownmutex, due_time) )
+            break;
+      }
+   }
+   ret = !self->priv.shutdownAsserted;
+   g_mutex_unlock(&self->priv.shutdownmutex);
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_replay_read(RemoteOffloadCommsIO *commsio,
+                                                                      guint8 *buf,
+                                                                      guint64 size)
+{
+   RemoteOffloadCommsIOReplay *self = REMOTEOFFLOAD_COMMSIOREPLAY(commsio);
+
+   while( size )
+   {
+      if( self->priv.entryi >= self->priv.entries->len )
+      {
+         GST_INFO_OBJECT(self, "End of trace");
+         return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      }
+
+      ReplayEntry *entry = &g_array_index(self->priv.entries, ReplayEntry, self->priv.entryi);
+      if( !self->priv.entryoffset )
+      {
+         if( !wait_until_due(self, entry) )
+            return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      }
+
+      guint64 ncopy = MIN(size, entry->size - self->priv.entryoffset);
+      memcpy(buf, entry->data + self->priv.entryoffset, ncopy);
+      buf += ncopy;
+      size -= ncopy;
+
+      self->priv.entryoffset += ncopy;
+      if( self->priv.entryoffset == entry->size )
+      {
+         self->priv.entryi++;
+         self->priv.entryoffset = 0;
+      }
+   }
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+//The peer of a replayed session is the trace, so writes go nowhere. They're
+// only counted, to pace the reads.
+static void add_bytes_written(RemoteOffloadCommsIOReplay *self,
+                              guint64 size)
+{
+   g_mutex_lock(&self->priv.shutdownmutex);
+   self->priv.bytes_written += size;
+   g_cond_broadcast(&self->priv.shutdowncond);
+   g_mutex_unlock(&self->priv.shutdownmutex);
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_replay_write(RemoteOffloadCommsIO *commsio,
+                                                                       guint8 *buf,
+                                                                       guint64 size)
+{
+   (void)buf;
+
+   add_bytes_written(REMOTEOFFLOAD_COMMSIOREPLAY(commsio), size);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_replay_write_mem(RemoteOffloadCommsIO *commsio,
+                                                                           GstMemory *mem)
+{
+   add_bytes_written(REMOTEOFFLOAD_COMMSIOREPLAY(commsio),
+                     gst_memory_get_sizes(mem, NULL, NULL));
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static RemoteOffloadCommsIOResult remote_offload_comms_io_replay_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                                                                GList *mem_list)
+{
+   guint64 size = 0;
+   for( GList *li = mem_list; li != NULL; li = li->next )
+      size += gst_memory_get_sizes((GstMemory *)li->data, NULL, NULL);
+
+   add_bytes_written(REMOTEOFFLOAD_COMMSIOREPLAY(commsio), size);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static void remote_offload_comms_io_replay_shutdown(RemoteOffloadCommsIO *commsio)
+{
+   RemoteOffloadCommsIOReplay *self = REMOTEOFFLOAD_COMMSIOREPLAY(commsio);
+
+   g_mutex_lock(&self->priv.shutdownmutex);
+   self->priv.shutdownAsserted = TRUE;
+   g_cond_broadcast(&self->priv.shutdowncond);
+   g_mutex_unlock(&self->priv.shutdownmutex);
+}
+
+static void
+remote_offload_comms_io_replay_interface_init (RemoteOffloadCommsIOInterface *iface)
+{
+   iface->read = remote_offload_comms_io_replay_read;
+   iface->write = remote_offload_comms_io_replay_write;
+   iface->write_mem = remote_offload_comms_io_replay_write_mem;
+   iface->write_mem_list = remote_offload_comms_io_replay_write_mem_list;
+   iface->get_consumable_memfeatures = NULL;
+   iface->get_producible_memfeatures = NULL;
+   iface->shutdown = remote_offload_comms_io_replay_shutdown;
+}
+
+static void
+remote_offload_comms_io_replay_finalize (GObject *gobject)
+{
+   RemoteOffloadCommsIOReplay *self = REMOTEOFFLOAD_COMMSIOREPLAY(gobject);
+
+   g_array_free(self->priv.entries, TRUE);
+   g_array_free(self->priv.channel_ids, TRUE);
+
+   if( self->priv.mappedfile )
+      g_mapped_file_unref(self->priv.mappedfile);
+
+   g_mutex_clear(&self->priv.shutdownmutex);
+   g_cond_clear(&self->priv.shutdowncond);
+
+   G_OBJECT_CLASS (remote_offload_comms_io_replay_parent_class)->finalize (gobject);
+}
+
+static void
+remote_offload_comms_io_replay_class_init (RemoteOffloadCommsIOReplayClass *klass)
+{
+   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+   object_class->finalize = remote_offload_comms_io_replay_finalize;
+}
+
+static void
+remote_offload_comms_io_replay_init (RemoteOffloadCommsIOReplay *self)
+{
+   self->priv.mappedfile = NULL;
+   self->priv.entries = g_array_new(FALSE, FALSE, sizeof(ReplayEntry));
+   self->priv.channel_ids = g_array_new(FALSE, FALSE, sizeof(gint));
+   self->priv.speed = 1.0;
+   self->priv.entryi = 0;
+   self->priv.entryoffset = 0;
+   self->priv.first_timestamp_us = 0;
+   self->priv.start_time = 0;
+   g_mutex_init(&self->priv.shutdownmutex);
+   g_cond_init(&self->priv.shutdowncond);
+   self->priv.shutdownAsserted = FALSE;
+   self->priv.bytes_written = 0;
+}
+
+RemoteOffloadCommsIOReplay *remote_offload_comms_io_replay_new(const gchar *tracefile,
+                                                               gdouble speed)
+{
+   if( !tracefile )
+      return NULL;
+
+   RemoteOffloadCommsIOReplay *self =
+         g_object_new(REMOTEOFFLOADCOMMSIOREPLAY_TYPE, NULL);
+
+   GError *error = NULL;
+   self->priv.mappedfile = g_mapped_file_new(tracefile, FALSE, &error);
+   if( !self->priv.mappedfile )
+   {
+      GST_ERROR_OBJECT(self, "Unable to open trace file %s: %s",
+                       tracefile, error ? error->message : "unknown");
+      g_clear_error(&error);
+      g_object_unref(self);
+      return NULL;
+   }
+
+   if( !parse_trace(self, tracefile) )
+   {
+      g_object_unref(self);
+      return NULL;
+   }
+
+   self->priv.speed = speed;
+
+   return self;
+}
+
+GArray *remote_offload_comms_io_replay_get_channel_ids(RemoteOffloadCommsIOReplay *commsio)
+{
+   if( !REMOTEOFFLOAD_IS_COMMSIOREPLAY(commsio) )
+      return NULL;
+
+   GArray *channel_ids = g_array_sized_new(FALSE, FALSE, sizeof(gint),
+                                           commsio->priv.channel_ids->len);
+   g_array_append_vals(channel_ids, commsio->priv.channel_ids->data,
+                       commsio->priv.channel_ids->len);
+
+   return channel_ids;
+}
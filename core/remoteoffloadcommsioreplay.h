@@ -0,0 +1,51 @@
+/*
+ *  remoteoffloadcommsioreplay.h - CommsIO that replays a recorded trace
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifndef __REMOTEOFFLOAD_COMMS_IO_REPLAY_H__
+#define __REMOTEOFFLOAD_COMMS_IO_REPLAY_H__
+
+#include <glib-object.h>
+#include "remoteoffloadcommsio.h"
+
+G_BEGIN_DECLS
+
+#define REMOTEOFFLOADCOMMSIOREPLAY_TYPE (remote_offload_comms_io_replay_get_type ())
+G_DECLARE_FINAL_TYPE (RemoteOffloadCommsIOReplay, remote_offload_comms_io_replay,
+                      REMOTEOFFLOAD, COMMSIOREPLAY, GObject)
+
+//Create a CommsIO that plays back the bytes that were read by the recorded
+// CommsIO (see remoteoffloadcommsiorecord.h), and discards anything written to it.
+// Each recorded read is held back until as many bytes have been written to the
+// replay as had been written to the recorded CommsIO before it.
+// speed: 1.0 delivers the bytes at their recorded times (relative to the first
+//        read), 2.0 at twice that rate, etc. <= 0 delivers them as soon as the
+//        writes that preceded them have been made.
+// Returns NULL if tracefile can't be loaded, or doesn't contain payloads.
+RemoteOffloadCommsIOReplay *remote_offload_comms_io_replay_new(const gchar *tracefile,
+                                                               gdouble speed);
+
+//Get the ids of the channels that were carried by the recorded CommsIO.
+// Returns a GArray of gint's, which the caller is responsible for freeing.
+GArray *remote_offload_comms_io_replay_get_channel_ids(RemoteOffloadCommsIOReplay *commsio);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOAD_COMMS_IO_REPLAY_H__ */
@@ -0,0 +1,158 @@
+/*
+ *  remoteoffloadcompression.c - Data segment compression codecs
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  The codecs are optional. Support for each is compiled in when its library
+ *   is found at configure time (HAVE_LZ4 / HAVE_ZSTD).
+ */
+#include <time.h>
+#include "remoteoffloadcompression.h"
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+
+//favor speed; the link is only worth compressing for if we keep up with it.
+#define REMOTEOFFLOAD_ZSTD_LEVEL 1
+#endif
+
+gboolean remote_offload_compression_codec_from_string(const gchar *name,
+                                                      RemoteOffloadCompressionCodec *codec)
+{
+   if( !name || !codec )
+      return FALSE;
+
+   if( g_ascii_strcasecmp(name, "none") == 0 )
+      *codec = REMOTEOFFLOAD_COMPRESSION_NONE;
+   else if( g_ascii_strcasecmp(name, "lz4") == 0 )
+      *codec = REMOTEOFFLOAD_COMPRESSION_LZ4;
+   else if( g_ascii_strcasecmp(name, "zstd") == 0 )
+      *codec = REMOTEOFFLOAD_COMPRESSION_ZSTD;
+   else
+      return FALSE;
+
+   return TRUE;
+}
+
+const gchar *remote_offload_compression_codec_name(RemoteOffloadCompressionCodec codec)
+{
+   switch( codec )
+   {
+      case REMOTEOFFLOAD_COMPRESSION_NONE: return "none";
+      case REMOTEOFFLOAD_COMPRESSION_LZ4: return "lz4";
+      case REMOTEOFFLOAD_COMPRESSION_ZSTD: return "zstd";
+   }
+
+   return "unknown";
+}
+
+gboolean remote_offload_compression_codec_supported(RemoteOffloadCompressionCodec codec)
+{
+   switch( codec )
+   {
+      case REMOTEOFFLOAD_COMPRESSION_NONE:
+         return TRUE;
+#ifdef HAVE_LZ4
+      case REMOTEOFFLOAD_COMPRESSION_LZ4:
+         return TRUE;
+#endif
+#ifdef HAVE_ZSTD
+      case REMOTEOFFLOAD_COMPRESSION_ZSTD:
+         return TRUE;
+#endif
+      default:
+         return FALSE;
+   }
+}
+
+gsize remote_offload_compress(RemoteOffloadCompressionCodec codec,
+                              const guint8 *src,
+                              gsize srcsize,
+                              guint8 *dst,
+                              gsize dstcapacity)
+{
+   switch( codec )
+   {
+#ifdef HAVE_LZ4
+      case REMOTEOFFLOAD_COMPRESSION_LZ4:
+      {
+         if( (srcsize > LZ4_MAX_INPUT_SIZE) || (dstcapacity > G_MAXINT) )
+            return 0;
+
+         int compressed = LZ4_compress_default((const char *)src, (char *)dst,
+                                               (int)srcsize, (int)dstcapacity);
+         return compressed > 0 ? (gsize)compressed : 0;
+      }
+#endif
+#ifdef HAVE_ZSTD
+      case REMOTEOFFLOAD_COMPRESSION_ZSTD:
+      {
+         size_t compressed = ZSTD_compress(dst, dstcapacity, src, srcsize,
+                                           REMOTEOFFLOAD_ZSTD_LEVEL);
+         return ZSTD_isError(compressed) ? 0 : compressed;
+      }
+#endif
+      default:
+         return 0;
+   }
+}
+
+gboolean remote_offload_decompress(RemoteOffloadCompressionCodec codec,
+                                   const guint8 *src,
+                                   gsize srcsize,
+                                   guint8 *dst,
+                                   gsize dstsize)
+{
+   switch( codec )
+   {
+#ifdef HAVE_LZ4
+      case REMOTEOFFLOAD_COMPRESSION_LZ4:
+      {
+         if( (srcsize > G_MAXINT) || (dstsize > G_MAXINT) )
+            return FALSE;
+
+         int decompressed = LZ4_decompress_safe((const char *)src, (char *)dst,
+                                                (int)srcsize, (int)dstsize);
+         return (decompressed >= 0) && ((gsize)decompressed == dstsize);
+      }
+#endif
+#ifdef HAVE_ZSTD
+      case REMOTEOFFLOAD_COMPRESSION_ZSTD:
+      {
+         size_t decompressed = ZSTD_decompress(dst, dstsize, src, srcsize);
+         return !ZSTD_isError(decompressed) && (decompressed == dstsize);
+      }
+#endif
+      default:
+         return FALSE;
+   }
+}
+
+guint64 remote_offload_compression_thread_cpu_time_ns(void)
+{
+   struct timespec ts;
+   if( clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0 )
+      return 0;
+
+   return (guint64)ts.tv_sec * G_GUINT64_CONSTANT(1000000000) + (guint64)ts.tv_nsec;
+}
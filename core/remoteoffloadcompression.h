@@ -0,0 +1,93 @@
+/*
+ *  remoteoffloadcompression.h - Data segment compression codecs
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADCOMPRESSION_H__
+#define __REMOTEOFFLOADCOMPRESSION_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+//Note that these values are sent over the wire during connection setup
+typedef enum
+{
+   REMOTEOFFLOAD_COMPRESSION_NONE = 0,
+   REMOTEOFFLOAD_COMPRESSION_LZ4,
+   REMOTEOFFLOAD_COMPRESSION_ZSTD
+}RemoteOffloadCompressionCodec;
+
+//Data segments smaller than this aren't worth compressing, by default.
+#define REMOTEOFFLOAD_COMPRESSION_DEFAULT_THRESHOLD 4096
+
+typedef struct _RemoteOffloadCompressionParams
+{
+   RemoteOffloadCompressionCodec codec;
+   guint32 threshold; //only segments of at least this many bytes are compressed
+}RemoteOffloadCompressionParams;
+
+//Compression statistics, kept per channel
+typedef struct _RemoteOffloadCompressionStats
+{
+   //write side
+   guint64 nsegments_compressed;
+   guint64 nsegments_incompressible; //above the threshold, but didn't get smaller
+   guint64 bytes_in;                 //uncompressed size of the compressed segments
+   guint64 bytes_out;                //compressed size of the compressed segments
+   guint64 compress_cpu_ns;          //including segments that turned out incompressible
+
+   //read side
+   guint64 nsegments_decompressed;
+   guint64 bytes_decompressed;       //uncompressed size of the decompressed segments
+   guint64 decompress_cpu_ns;
+}RemoteOffloadCompressionStats;
+
+//Parse a codec name ("none", "lz4", "zstd"). Returns FALSE if it's not a known name.
+gboolean remote_offload_compression_codec_from_string(const gchar *name,
+                                                      RemoteOffloadCompressionCodec *codec);
+
+const gchar *remote_offload_compression_codec_name(RemoteOffloadCompressionCodec codec);
+
+//Returns TRUE if support for the codec was compiled in.
+gboolean remote_offload_compression_codec_supported(RemoteOffloadCompressionCodec codec);
+
+//Compress srcsize bytes of src into dst. Returns the compressed size, or 0 upon failure
+// (i.e. if the compressed data doesn't fit into dstcapacity bytes).
+gsize remote_offload_compress(RemoteOffloadCompressionCodec codec,
+                              const guint8 *src,
+                              gsize srcsize,
+                              guint8 *dst,
+                              gsize dstcapacity);
+
+//Decompress srcsize bytes of src into dst. Returns TRUE only if exactly
+// dstsize bytes were produced.
+gboolean remote_offload_decompress(RemoteOffloadCompressionCodec codec,
+                                   const guint8 *src,
+                                   gsize srcsize,
+                                   guint8 *dst,
+                                   gsize dstsize);
+
+//CPU time consumed by the calling thread, in nanoseconds
+guint64 remote_offload_compression_thread_cpu_time_ns(void);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADCOMPRESSION_H__ */
@@ -0,0 +1,712 @@
+/*
+ *  remoteoffloadfilecache.c - Content-addressed cache of host files on the remote side
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  Files are cached as <cache dir>/<sha256 of the contents>. A file that is
+ *   being received is written to a uniquely named temporary file within the
+ *   cache dir, and only renamed to its final name once its digest has been
+ *   verified, so that concurrent pipelines (or processes) never see a partial file.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include "remoteoffloadfilecache.h"
+#include "remoteoffloadbinpipelinecommon.h"
+#include "genericdataexchanger.h"
+
+GST_DEBUG_CATEGORY_STATIC (remote_offload_file_cache_debug);
+#define GST_CAT_DEFAULT remote_offload_file_cache_debug
+
+static void register_debug_category()
+{
+   static gsize debugRegistered = 0;
+   if( g_once_init_enter(&debugRegistered) )
+   {
+      GST_DEBUG_CATEGORY_INIT (remote_offload_file_cache_debug,
+                               "remoteoffloadfilecache", 0,
+                               "debug category for the remote file cache");
+      g_once_init_leave (&debugRegistered, 1);
+   }
+}
+
+//Header of a BINPIPELINE_EXCHANGE_FILECACHE_CHUNK. It's followed by a memblock
+// holding the chunk (unless the file is empty).
+typedef struct _FileCacheChunkHeader
+{
+   gchar digest[REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE];
+   guint64 offset;    //offset of this chunk within the file
+   guint64 filesize;  //total size of the file
+}FileCacheChunkHeader;
+
+static GQuark file_ref_path_quark()
+{
+   static GQuark quark = 0;
+   if( !quark )
+      quark = g_quark_from_static_string("remoteoffload-file-ref-path");
+
+   return quark;
+}
+
+static GstMemory* virt_to_mem(void *pVirt,
+                              gsize size)
+{
+   GstMemory *mem = NULL;
+
+   if( pVirt && (size>0) )
+   {
+
+      mem = gst_memory_new_wrapped((GstMemoryFlags)0,
+                                   pVirt,
+                                   size,
+                                   0,
+                                   size,
+                                   NULL,
+                                   NULL);
+   }
+
+   return mem;
+}
+
+//The digests computed on the host side, by path. An entry is only used while
+// the file still has the size & modification time that it had when its digest
+// was computed, so a large model is only read again once it has changed.
+typedef struct
+{
+   guint64 size;
+   gint64 mtime_ns;
+   gchar digest[REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE];
+}FileDigestMemo;
+
+G_LOCK_DEFINE_STATIC(digest_memo);
+static GHashTable *digest_memo_hash = NULL; //path -> FileDigestMemo*
+
+static inline gint64 stat_mtime_ns(const struct stat *st)
+{
+   return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec;
+}
+
+//Look up the memoized digest of filename. Returns FALSE if there isn't one
+// for the given size & modification time.
+static gboolean digest_memo_lookup(const gchar *filename,
+                                   const struct stat *st,
+                                   RemoteOffloadFileRef *ref)
+{
+   gboolean bfound = FALSE;
+
+   G_LOCK(digest_memo);
+   FileDigestMemo *memo = digest_memo_hash ? g_hash_table_lookup(digest_memo_hash, filename) :
+                                             NULL;
+   if( memo && (memo->size == (guint64)st->st_size) && (memo->mtime_ns == stat_mtime_ns(st)) )
+   {
+      memcpy(ref->digest, memo->digest, sizeof(ref->digest));
+      ref->size = memo->size;
+      bfound = TRUE;
+   }
+   G_UNLOCK(digest_memo);
+
+   return bfound;
+}
+
+static void digest_memo_insert(const gchar *filename,
+                               const struct stat *st,
+                               const RemoteOffloadFileRef *ref)
+{
+   FileDigestMemo *memo = g_malloc0(sizeof(FileDigestMemo));
+   memo->size = ref->size;
+   memo->mtime_ns = stat_mtime_ns(st);
+   memcpy(memo->digest, ref->digest, sizeof(memo->digest));
+
+   G_LOCK(digest_memo);
+   if( !digest_memo_hash )
+      digest_memo_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+   g_hash_table_replace(digest_memo_hash, g_strdup(filename), memo);
+   G_UNLOCK(digest_memo);
+}
+
+//Read the whole file to compute its digest
+static gboolean compute_file_ref(FILE *fp, RemoteOffloadFileRef *ref)
+{
+   GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+   guint8 *chunk = g_malloc(REMOTEOFFLOAD_FILECACHE_CHUNK_SIZE);
+   guint64 size = 0;
+   gsize nread;
+   while( (nread = fread(chunk, 1, REMOTEOFFLOAD_FILECACHE_CHUNK_SIZE, fp)) > 0 )
+   {
+      g_checksum_update(checksum, chunk, nread);
+      size += nread;
+   }
+   gboolean bok = !ferror(fp);
+   g_free(chunk);
+
+   if( bok )
+   {
+      g_strlcpy(ref->digest, g_checksum_get_string(checksum), sizeof(ref->digest));
+      ref->size = size;
+   }
+   g_checksum_free(checksum);
+
+   return bok;
+}
+
+GstMemory *remote_offload_file_ref_new(const gchar *filename)
+{
+   register_debug_category();
+
+   if( !filename )
+      return NULL;
+
+   FILE *fp = g_fopen(filename, "rb");
+   if( !fp )
+   {
+      GST_ERROR("Error opening %s", filename);
+      return NULL;
+   }
+
+   RemoteOffloadFileRef *ref = g_malloc0(sizeof(RemoteOffloadFileRef));
+
+   //the stat is taken before reading, so that a change made while the digest
+   // is being computed is seen the next time around.
+   struct stat st;
+   gboolean bstat = (fstat(fileno(fp), &st) == 0);
+   gboolean bok;
+   if( bstat && digest_memo_lookup(filename, &st, ref) )
+   {
+      GST_DEBUG("%s: using memoized digest", filename);
+      bok = TRUE;
+   }
+   else
+   {
+      bok = compute_file_ref(fp, ref);
+      if( bok && bstat )
+         digest_memo_insert(filename, &st, ref);
+   }
+   fclose(fp);
+
+   if( !bok )
+   {
+      GST_ERROR("Error reading %s", filename);
+      g_free(ref);
+      return NULL;
+   }
+
+   GST_INFO("%s: sha256=%s, size=%"G_GUINT64_FORMAT, filename, ref->digest, ref->size);
+
+   GstMemory *mem = gst_memory_new_wrapped((GstMemoryFlags)0,
+                                           ref,
+                                           sizeof(RemoteOffloadFileRef),
+                                           0,
+                                           sizeof(RemoteOffloadFileRef),
+                                           ref,
+                                           g_free);
+
+   gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(mem), file_ref_path_quark(),
+                             g_strdup(filename), g_free);
+
+   return mem;
+}
+
+gboolean remote_offload_file_ref_is_ref(GstMemory *mem)
+{
+   return mem &&
+          (gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem), file_ref_path_quark()) != NULL);
+}
+
+//Stream the contents of a file to the remote side. The last chunk is sent blocking,
+// and the remote side returns whether it has verified & cached the file.
+static gboolean stream_file(GenericDataExchanger *exchanger,
+                            const gchar *filename,
+                            const RemoteOffloadFileRef *ref)
+{
+   FILE *fp = g_fopen(filename, "rb");
+   if( !fp )
+   {
+      GST_ERROR("Error opening %s", filename);
+      return FALSE;
+   }
+
+   FileCacheChunkHeader header;
+   memcpy(header.digest, ref->digest, sizeof(header.digest));
+   header.filesize = ref->size;
+   header.offset = 0;
+
+   guint8 *chunk = g_malloc(REMOTEOFFLOAD_FILECACHE_CHUNK_SIZE);
+   gboolean ret = TRUE;
+   do
+   {
+      gsize chunksize = (gsize)MIN(ref->size - header.offset,
+                                   REMOTEOFFLOAD_FILECACHE_CHUNK_SIZE);
+      if( fread(chunk, 1, chunksize, fp) != chunksize )
+      {
+         GST_ERROR("Error reading %s (did it change since it was serialized?)", filename);
+         ret = FALSE;
+         break;
+      }
+
+      gboolean blast = (header.offset + chunksize) == ref->size;
+
+      GArray *memblocks = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
+      GstMemory *headermem = virt_to_mem(&header, sizeof(header));
+      g_array_append_val(memblocks, headermem);
+      GstMemory *chunkmem = virt_to_mem(chunk, chunksize);
+      if( chunkmem )
+         g_array_append_val(memblocks, chunkmem);
+
+      ret = generic_data_exchanger_send(exchanger,
+                                        BINPIPELINE_EXCHANGE_FILECACHE_CHUNK,
+                                        memblocks,
+                                        blast);
+
+      gst_memory_unref(headermem);
+      if( chunkmem )
+         gst_memory_unref(chunkmem);
+      g_array_free(memblocks, TRUE);
+
+      header.offset += chunksize;
+   }
+   while( ret && (header.offset < ref->size) );
+
+   g_free(chunk);
+   fclose(fp);
+
+   return ret;
+}
+
+gboolean remote_offload_file_cache_sync(GenericDataExchanger *exchanger,
+                                        GArray *memblocks)
+{
+   register_debug_category();
+
+   if( !exchanger || !memblocks )
+      return FALSE;
+
+   gboolean ret = TRUE;
+
+   //the same file may be referenced more than once (i.e. by multiple elements)
+   GHashTable *synced = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+   for( guint i = 0; ret && (i < memblocks->len); i++ )
+   {
+      GstMemory *mem = g_array_index(memblocks, GstMemory *, i);
+      if( !remote_offload_file_ref_is_ref(mem) )
+         continue;
+
+      const gchar *filename = gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem),
+                                                        file_ref_path_quark());
+
+      RemoteOffloadFileRef ref;
+      GstMapInfo map;
+      if( !gst_memory_map(mem, &map, GST_MAP_READ) )
+      {
+         GST_ERROR("Error mapping file ref for %s", filename);
+         ret = FALSE;
+         break;
+      }
+      memcpy(&ref, map.data, sizeof(ref));
+      gst_memory_unmap(mem, &map);
+
+      if( g_hash_table_contains(synced, ref.digest) )
+         continue;
+
+      if( generic_data_exchanger_send_virt(exchanger,
+                                           BINPIPELINE_EXCHANGE_FILECACHE_QUERY,
+                                           &ref,
+                                           sizeof(ref),
+                                           TRUE) )
+      {
+         GST_INFO("%s (%s) is already cached by the remote side", filename, ref.digest);
+      }
+      else
+      {
+         GST_INFO("Sending %s (%"G_GUINT64_FORMAT" bytes) to the remote file cache",
+                  filename, ref.size);
+         ret = stream_file(exchanger, filename, &ref);
+         if( !ret )
+            GST_ERROR("Error sending %s to the remote file cache", filename);
+      }
+
+      g_hash_table_add(synced, g_strdup(ref.digest));
+   }
+
+   g_hash_table_destroy(synced);
+
+   return ret;
+}
+
+typedef struct
+{
+   GChecksum *checksum;
+   FILE *fp;
+   gchar *tmppath;
+   guint64 received;
+}PartialFile;
+
+struct _RemoteOffloadFileCache
+{
+   gchar *dir;
+   guint64 max_size; //in bytes, 0 if the cache isn't pruned
+   GHashTable *partial_hash; //digest -> PartialFile*
+};
+
+static void PartialFileDestroy(gpointer data)
+{
+   PartialFile *partial = (PartialFile *)data;
+   if( partial->fp )
+   {
+      //it never completed
+      fclose(partial->fp);
+      g_unlink(partial->tmppath);
+   }
+   g_checksum_free(partial->checksum);
+   g_free(partial->tmppath);
+   g_free(partial);
+}
+
+static gchar *file_cache_dir()
+{
+   const gchar *envdir = g_getenv(REMOTEOFFLOAD_FILECACHE_DIR_ENV);
+   if( envdir && *envdir )
+      return g_strdup(envdir);
+
+   return g_build_filename(g_get_user_cache_dir(), "gstremoteoffload", "files", NULL);
+}
+
+static guint64 file_cache_max_size()
+{
+   guint64 max_mb = REMOTEOFFLOAD_FILECACHE_DEFAULT_MAX_MB;
+   const gchar *envmax = g_getenv(REMOTEOFFLOAD_FILECACHE_MAX_MB_ENV);
+   if( envmax && *envmax )
+      max_mb = g_ascii_strtoull(envmax, NULL, 10);
+
+   return max_mb * 1024 * 1024;
+}
+
+//the digest is used as a file name, so make sure that it's only hex digits
+static gboolean digest_is_valid(const gchar *digest)
+{
+   gsize len = 0;
+   for( ; (len < REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE) && digest[len]; len++ )
+   {
+      if( !g_ascii_isxdigit(digest[len]) )
+         return FALSE;
+   }
+
+   return len == (REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE - 1);
+}
+
+RemoteOffloadFileCache *remote_offload_file_cache_new()
+{
+   register_debug_category();
+
+   RemoteOffloadFileCache *cache = g_malloc0(sizeof(RemoteOffloadFileCache));
+   cache->dir = file_cache_dir();
+   cache->max_size = file_cache_max_size();
+   cache->partial_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, PartialFileDestroy);
+
+   return cache;
+}
+
+void remote_offload_file_cache_free(RemoteOffloadFileCache *cache)
+{
+   if( !cache )
+      return;
+
+   g_hash_table_destroy(cache->partial_hash);
+   g_free(cache->dir);
+   g_free(cache);
+}
+
+gchar *remote_offload_file_cache_lookup(const RemoteOffloadFileRef *ref)
+{
+   register_debug_category();
+
+   if( !ref || !digest_is_valid(ref->digest) )
+      return NULL;
+
+   gchar *dir = file_cache_dir();
+   gchar *path = g_build_filename(dir, ref->digest, NULL);
+   g_free(dir);
+
+   GStatBuf st;
+   if( (g_stat(path, &st) != 0) || !S_ISREG(st.st_mode) || ((guint64)st.st_size != ref->size) )
+   {
+      g_free(path);
+      return NULL;
+   }
+
+   //the modification time of a cached file is its last use, which eviction goes by
+   g_utime(path, NULL);
+
+   return path;
+}
+
+gboolean remote_offload_file_cache_query_received(RemoteOffloadFileCache *cache,
+                                                  GArray *memblocks)
+{
+   if( !cache || !memblocks || (memblocks->len != 1) )
+      return FALSE;
+
+   GstMemory *mem = g_array_index(memblocks, GstMemory *, 0);
+   GstMapInfo map;
+   if( !gst_memory_map(mem, &map, GST_MAP_READ) )
+      return FALSE;
+
+   gchar *path = NULL;
+   if( map.size == sizeof(RemoteOffloadFileRef) )
+   {
+      RemoteOffloadFileRef ref;
+      memcpy(&ref, map.data, sizeof(ref));
+      ref.digest[REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE - 1] = 0;
+      path = remote_offload_file_cache_lookup(&ref);
+      GST_INFO("%s: %s", ref.digest, path ? "cache hit" : "cache miss");
+   }
+   gst_memory_unmap(mem, &map);
+
+   gboolean bcached = (path != NULL);
+   g_free(path);
+
+   return bcached;
+}
+
+//Start receiving a file into a temporary file within the cache dir
+static PartialFile *partial_file_new(RemoteOffloadFileCache *cache, const gchar *digest)
+{
+   if( g_mkdir_with_parents(cache->dir, 0755) != 0 )
+   {
+      GST_ERROR("Error creating file cache directory %s", cache->dir);
+      return NULL;
+   }
+
+   gchar *tmpl = g_strdup_printf("%s.XXXXXX", digest);
+   gchar *tmppath = g_build_filename(cache->dir, tmpl, NULL);
+   g_free(tmpl);
+
+   gint fd = g_mkstemp_full(tmppath, O_WRONLY, 0644);
+   FILE *fp = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+   if( !fp )
+   {
+      GST_ERROR("Error creating %s", tmppath);
+      if( fd >= 0 )
+      {
+         close(fd);
+         g_unlink(tmppath);
+      }
+      g_free(tmppath);
+      return NULL;
+   }
+
+   PartialFile *partial = g_malloc0(sizeof(PartialFile));
+   partial->checksum = g_checksum_new(G_CHECKSUM_SHA256);
+   partial->fp = fp;
+   partial->tmppath = tmppath;
+   partial->received = 0;
+
+   return partial;
+}
+
+typedef struct
+{
+   gchar *path;
+   guint64 size;
+   gint64 mtime;
+}CachedFile;
+
+static gint cached_file_compare_mtime(gconstpointer a, gconstpointer b)
+{
+   const CachedFile *fa = (const CachedFile *)a;
+   const CachedFile *fb = (const CachedFile *)b;
+
+   return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+//Remove the least recently used files, until the cache holds at most max_size
+// bytes. The file with keep_digest (which was just added) is never removed.
+static void file_cache_evict(RemoteOffloadFileCache *cache, const gchar *keep_digest)
+{
+   if( !cache->max_size )
+      return;
+
+   GDir *dir = g_dir_open(cache->dir, 0, NULL);
+   if( !dir )
+      return;
+
+   GArray *files = g_array_new(FALSE, FALSE, sizeof(CachedFile));
+   guint64 total = 0;
+   const gchar *name;
+   while( (name = g_dir_read_name(dir)) )
+   {
+      //this skips the temporary files of the files that are being received
+      if( !digest_is_valid(name) )
+         continue;
+
+      gchar *path = g_build_filename(cache->dir, name, NULL);
+      GStatBuf st;
+      if( (g_stat(path, &st) != 0) || !S_ISREG(st.st_mode) )
+      {
+         g_free(path);
+         continue;
+      }
+
+      total += st.st_size;
+      if( g_strcmp0(name, keep_digest) == 0 )
+      {
+         g_free(path);
+         continue;
+      }
+
+      CachedFile file = { path, st.st_size, st.st_mtime };
+      g_array_append_val(files, file);
+   }
+   g_dir_close(dir);
+
+   g_array_sort(files, cached_file_compare_mtime);
+   for( guint i = 0; i < files->len; i++ )
+   {
+      CachedFile *file = &g_array_index(files, CachedFile, i);
+      if( (total > cache->max_size) && (g_unlink(file->path) == 0) )
+      {
+         GST_INFO("Evicted %s (%"G_GUINT64_FORMAT" bytes)", file->path, file->size);
+         total -= file->size;
+      }
+      g_free(file->path);
+   }
+   g_array_free(files, TRUE);
+}
+
+//Verify the digest of a completely received file, and move it into place
+static gboolean partial_file_commit(RemoteOffloadFileCache *cache,
+                                    PartialFile *partial,
+                                    const gchar *digest)
+{
+   gboolean bclosed = (fclose(partial->fp) == 0);
+   partial->fp = NULL;
+
+   if( !bclosed || (g_strcmp0(g_checksum_get_string(partial->checksum), digest) != 0) )
+   {
+      GST_ERROR("Received file failed verification (expected sha256=%s)", digest);
+      g_unlink(partial->tmppath);
+      return FALSE;
+   }
+
+   gchar *path = g_build_filename(cache->dir, digest, NULL);
+   gboolean ret = (g_rename(partial->tmppath, path) == 0);
+   if( ret )
+   {
+      GST_INFO("Cached %s", path);
+      file_cache_evict(cache, digest);
+   }
+   else
+   {
+      GST_ERROR("Error renaming %s to %s", partial->tmppath, path);
+      g_unlink(partial->tmppath);
+   }
+   g_free(path);
+
+   return ret;
+}
+
+gboolean remote_offload_file_cache_chunk_received(RemoteOffloadFileCache *cache,
+                                                  GArray *memblocks)
+{
+   if( !cache || !memblocks || (memblocks->len < 1) || (memblocks->len > 2) )
+      return FALSE;
+
+   GstMemory *headermem = g_array_index(memblocks, GstMemory *, 0);
+   FileCacheChunkHeader header;
+   GstMapInfo map;
+   if( !gst_memory_map(headermem, &map, GST_MAP_READ) )
+      return FALSE;
+   gboolean bheaderok = (map.size == sizeof(header));
+   if( bheaderok )
+      memcpy(&header, map.data, sizeof(header));
+   gst_memory_unmap(headermem, &map);
+
+   if( !bheaderok )
+   {
+      GST_ERROR("Invalid file cache chunk header");
+      return FALSE;
+   }
+
+   header.digest[REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE - 1] = 0;
+   if( !digest_is_valid(header.digest) )
+   {
+      GST_ERROR("Invalid digest in file cache chunk header");
+      return FALSE;
+   }
+
+   PartialFile *partial = g_hash_table_lookup(cache->partial_hash, header.digest);
+   if( header.offset == 0 )
+   {
+      //(re)start receiving this file
+      g_hash_table_remove(cache->partial_hash, header.digest);
+      partial = partial_file_new(cache, header.digest);
+      if( !partial )
+         return FALSE;
+      g_hash_table_insert(cache->partial_hash, g_strdup(header.digest), partial);
+   }
+
+   if( !partial || (partial->received != header.offset) )
+   {
+      GST_ERROR("Unexpected chunk at offset %"G_GUINT64_FORMAT" of %s",
+                header.offset, header.digest);
+      g_hash_table_remove(cache->partial_hash, header.digest);
+      return FALSE;
+   }
+
+   gboolean ret = TRUE;
+   if( memblocks->len == 2 )
+   {
+      GstMemory *chunkmem = g_array_index(memblocks, GstMemory *, 1);
+      if( gst_memory_map(chunkmem, &map, GST_MAP_READ) )
+      {
+         if( ((partial->received + map.size) <= header.filesize) &&
+             (fwrite(map.data, 1, map.size, partial->fp) == map.size) )
+         {
+            g_checksum_update(partial->checksum, map.data, map.size);
+            partial->received += map.size;
+         }
+         else
+         {
+            GST_ERROR("Error writing chunk of %s", header.digest);
+            ret = FALSE;
+         }
+         gst_memory_unmap(chunkmem, &map);
+      }
+      else
+      {
+         ret = FALSE;
+      }
+   }
+
+   if( ret && (partial->received == header.filesize) )
+   {
+      ret = partial_file_commit(cache, partial, header.digest);
+      g_hash_table_remove(cache->partial_hash, header.digest);
+   }
+   else if( !ret )
+   {
+      g_hash_table_remove(cache->partial_hash, header.digest);
+   }
+
+   return ret;
+}
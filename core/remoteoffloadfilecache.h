@@ -0,0 +1,97 @@
+/*
+ *  remoteoffloadfilecache.h - Content-addressed cache of host files on the remote side
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADFILECACHE_H__
+#define __REMOTEOFFLOADFILECACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+//Host files that a property serializer needs on the remote side (i.e. models) are
+// serialized as a RemoteOffloadFileRef, instead of as their contents. Before the
+// serialized bin is sent, the host asks the remote side whether it already holds
+// each referenced file in its (persistent, on-disk) cache, and streams only the
+// ones that it doesn't, in chunks of REMOTEOFFLOAD_FILECACHE_CHUNK_SIZE.
+
+//sha256, as a NULL-terminated hex string
+#define REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE 65
+
+#define REMOTEOFFLOAD_FILECACHE_CHUNK_SIZE (4*1024*1024)
+
+//The cache directory defaults to $XDG_CACHE_HOME/gstremoteoffload/files, and
+// can be overridden with this environment variable.
+#define REMOTEOFFLOAD_FILECACHE_DIR_ENV "REMOTEOFFLOAD_FILE_CACHE_DIR"
+
+//Once a file has been added, the least recently used files are removed until
+// the cache holds at most this many megabytes (the new file is always kept).
+// 0 means that the cache is never pruned.
+#define REMOTEOFFLOAD_FILECACHE_MAX_MB_ENV "REMOTEOFFLOAD_FILE_CACHE_MAX_MB"
+#define REMOTEOFFLOAD_FILECACHE_DEFAULT_MAX_MB 4096
+
+typedef struct _RemoteOffloadFileRef
+{
+   gchar digest[REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE];
+   guint64 size;
+}RemoteOffloadFileRef;
+
+//HOST SIDE
+
+//Create a GstMemory holding a RemoteOffloadFileRef for the given file. The file
+// is read (in chunks) to compute its digest, unless it has the same size &
+// modification time as when its digest was last computed. Returns NULL upon error.
+GstMemory *remote_offload_file_ref_new(const gchar *filename);
+
+//Returns TRUE if mem was created by remote_offload_file_ref_new
+gboolean remote_offload_file_ref_is_ref(GstMemory *mem);
+
+typedef struct _GenericDataExchanger GenericDataExchanger;
+
+//For each file ref within memblocks, ask the remote side whether it already
+// holds the file, and stream it there if it doesn't. Returns FALSE if any
+// file couldn't be transferred.
+gboolean remote_offload_file_cache_sync(GenericDataExchanger *exchanger,
+                                        GArray *memblocks);
+
+//REMOTE SIDE
+typedef struct _RemoteOffloadFileCache RemoteOffloadFileCache;
+
+RemoteOffloadFileCache *remote_offload_file_cache_new();
+void remote_offload_file_cache_free(RemoteOffloadFileCache *cache);
+
+//Handle a BINPIPELINE_EXCHANGE_FILECACHE_QUERY. Returns TRUE if the file is cached.
+gboolean remote_offload_file_cache_query_received(RemoteOffloadFileCache *cache,
+                                                  GArray *memblocks);
+
+//Handle a BINPIPELINE_EXCHANGE_FILECACHE_CHUNK. Upon the last chunk of a file,
+// its digest is verified before it's added to the cache.
+gboolean remote_offload_file_cache_chunk_received(RemoteOffloadFileCache *cache,
+                                                  GArray *memblocks);
+
+//Obtain the path of the cached copy of the referenced file, or NULL if it
+// isn't cached. This counts as a use of the file, for eviction. The returned
+// string should be freed with g_free.
+gchar *remote_offload_file_cache_lookup(const RemoteOffloadFileRef *ref);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADFILECACHE_H__ */
@@ -0,0 +1,241 @@
+/*
+ *  remoteoffloadmempool.c - RemoteOffloadMemPool object
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  Receiving a large data segment (i.e. a raw 4K video frame) into a freshly
+ *   allocated GstMemory means a new malloc, and a page-fault for every page of it,
+ *   every frame. This object keeps released blocks around, and hands them back
+ *   out for the next request of the same size class.
+ *
+ *  Blocks are recycled using the GstMiniObject dispose hook, in the same way
+ *   that GstBufferPool recycles GstBuffer's. Each block that is in use holds a
+ *   reference to the pool, so the pool stays alive until every block has been
+ *   returned to it.
+ */
+#include "remoteoffloadmempool.h"
+
+#define MEMPOOL_PAGE_SIZE 4096
+#define MEMPOOL_CACHELINE_SIZE 64
+
+struct _RemoteOffloadMemPool
+{
+  GObject parent_instance;
+
+  /* Other members, including private data. */
+  GMutex mutex;
+  GHashTable *freeblocks; //block size -> GQueue of unused GstMemory's
+  guint max_free_per_size;
+
+  guint64 nallocated;
+  guint64 nrecycled;
+};
+
+GST_DEBUG_CATEGORY_STATIC (mem_pool_debug);
+#define GST_CAT_DEFAULT mem_pool_debug
+
+G_DEFINE_TYPE_WITH_CODE(RemoteOffloadMemPool, remote_offload_mem_pool, G_TYPE_OBJECT,
+GST_DEBUG_CATEGORY_INIT (mem_pool_debug, "remoteoffloadmempool", 0,
+  "debug category for RemoteOffloadMemPool"))
+
+static GQuark QUARK_MEMPOOL_BLOCK;
+
+//Kept as qdata of each block that came from a pool. The link is used to queue
+// the block while it's unused, so that releasing a block doesn't allocate.
+typedef struct
+{
+   RemoteOffloadMemPool *pool;
+   GList link;
+}MemPoolBlock;
+
+//Round the requested size up to the size class that it will be allocated from
+static inline gsize mem_pool_block_size(gsize size)
+{
+   if( size <= MEMPOOL_PAGE_SIZE )
+   {
+      gsize block_size = MEMPOOL_CACHELINE_SIZE;
+      while( block_size < size )
+         block_size <<= 1;
+
+      return block_size;
+   }
+
+   return (size + MEMPOOL_PAGE_SIZE - 1) & ~((gsize)MEMPOOL_PAGE_SIZE - 1);
+}
+
+//Called when the last reference to a block that came from the pool is dropped.
+static gboolean remote_offload_mem_pool_block_dispose(GstMiniObject *obj)
+{
+   GstMemory *mem = (GstMemory *)obj;
+   MemPoolBlock *block = (MemPoolBlock *)gst_mini_object_get_qdata(obj, QUARK_MEMPOOL_BLOCK);
+   RemoteOffloadMemPool *pool = block->pool;
+   gboolean do_free = TRUE;
+
+   g_mutex_lock(&pool->mutex);
+   GQueue *queue = g_hash_table_lookup(pool->freeblocks, GSIZE_TO_POINTER(mem->maxsize));
+   if( !queue )
+   {
+      queue = g_queue_new();
+      g_hash_table_insert(pool->freeblocks, GSIZE_TO_POINTER(mem->maxsize), queue);
+   }
+
+   if( g_queue_get_length(queue) < pool->max_free_per_size )
+   {
+      //resurrect the block, and reset it for the next user
+      gst_memory_ref(mem);
+      mem->offset = 0;
+      mem->size = mem->maxsize;
+      GST_MINI_OBJECT_FLAG_UNSET(mem, GST_MEMORY_FLAG_READONLY);
+      g_queue_push_tail_link(queue, &block->link);
+      do_free = FALSE;
+   }
+   g_mutex_unlock(&pool->mutex);
+
+   //drop the reference that this block held while it was in use
+   g_object_unref(pool);
+
+   return do_free;
+}
+
+static void FreeBlock(gpointer data)
+{
+   GstMemory *mem = (GstMemory *)data;
+   GST_MINI_OBJECT_CAST(mem)->dispose = NULL;
+   gst_memory_unref(mem);
+}
+
+static void FreeBlockQueue(gpointer data)
+{
+   GQueue *queue = (GQueue *)data;
+   GList *link;
+   while( (link = g_queue_pop_head_link(queue)) )
+      FreeBlock(link->data);
+
+   g_queue_free(queue);
+}
+
+GstMemory *remote_offload_mem_pool_acquire(RemoteOffloadMemPool *pool,
+                                           gsize size)
+{
+   if( !REMOTEOFFLOAD_IS_MEMPOOL(pool) )
+      return NULL;
+
+   gsize block_size = mem_pool_block_size(size);
+   GstMemory *mem = NULL;
+
+   g_mutex_lock(&pool->mutex);
+   GQueue *queue = g_hash_table_lookup(pool->freeblocks, GSIZE_TO_POINTER(block_size));
+   if( queue )
+   {
+      GList *link = g_queue_pop_head_link(queue);
+      if( link )
+         mem = (GstMemory *)link->data;
+   }
+
+   if( mem )
+      pool->nrecycled++;
+   else
+      pool->nallocated++;
+   g_mutex_unlock(&pool->mutex);
+
+   if( !mem )
+   {
+      GstAllocationParams params;
+      gst_allocation_params_init(&params);
+      params.align = (block_size >= MEMPOOL_PAGE_SIZE) ? MEMPOOL_PAGE_SIZE - 1 :
+                                                         MEMPOOL_CACHELINE_SIZE - 1;
+
+      mem = gst_allocator_alloc(NULL, block_size, &params);
+      if( !mem )
+      {
+         GST_ERROR_OBJECT (pool, "Error allocating block of size %"G_GSIZE_FORMAT, block_size);
+         return NULL;
+      }
+
+      GST_LOG_OBJECT (pool, "Allocated new block of size %"G_GSIZE_FORMAT, block_size);
+
+      MemPoolBlock *block = g_new0(MemPoolBlock, 1);
+      block->pool = pool;
+      block->link.data = mem;
+      gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(mem), QUARK_MEMPOOL_BLOCK, block, g_free);
+      GST_MINI_OBJECT_CAST(mem)->dispose = remote_offload_mem_pool_block_dispose;
+   }
+
+   g_object_ref(pool);
+
+   gst_memory_resize(mem, 0, size);
+
+   return mem;
+}
+
+void remote_offload_mem_pool_flush(RemoteOffloadMemPool *pool)
+{
+   if( !REMOTEOFFLOAD_IS_MEMPOOL(pool) )
+      return;
+
+   g_mutex_lock(&pool->mutex);
+   g_hash_table_remove_all(pool->freeblocks);
+   g_mutex_unlock(&pool->mutex);
+}
+
+static void
+remote_offload_mem_pool_finalize (GObject *gobject)
+{
+  RemoteOffloadMemPool *self = REMOTEOFFLOAD_MEMPOOL(gobject);
+
+  GST_DEBUG_OBJECT (self, "blocks allocated=%"G_GUINT64_FORMAT", recycled=%"G_GUINT64_FORMAT,
+                    self->nallocated, self->nrecycled);
+
+  g_hash_table_destroy(self->freeblocks);
+  g_mutex_clear(&self->mutex);
+
+  G_OBJECT_CLASS (remote_offload_mem_pool_parent_class)->finalize (gobject);
+}
+
+static void
+remote_offload_mem_pool_class_init (RemoteOffloadMemPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  QUARK_MEMPOOL_BLOCK = g_quark_from_static_string ("remoteoffload-mempool-block");
+
+  object_class->finalize = remote_offload_mem_pool_finalize;
+}
+
+static void
+remote_offload_mem_pool_init (RemoteOffloadMemPool *self)
+{
+  g_mutex_init(&self->mutex);
+  self->freeblocks = g_hash_table_new_full(g_direct_hash,
+                                           g_direct_equal,
+                                           NULL,
+                                           FreeBlockQueue);
+  self->max_free_per_size = 1;
+  self->nallocated = 0;
+  self->nrecycled = 0;
+}
+
+RemoteOffloadMemPool *remote_offload_mem_pool_new(guint max_free_per_size)
+{
+  RemoteOffloadMemPool *pool = g_object_new(REMOTEOFFLOADMEMPOOL_TYPE, NULL);
+
+  pool->max_free_per_size = MAX(max_free_per_size, 1);
+
+  return pool;
+}
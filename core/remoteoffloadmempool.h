@@ -0,0 +1,53 @@
+/*
+ *  remoteoffloadmempool.h - RemoteOffloadMemPool object
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADMEMPOOL_H__
+#define __REMOTEOFFLOADMEMPOOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define REMOTEOFFLOADMEMPOOL_TYPE (remote_offload_mem_pool_get_type ())
+G_DECLARE_FINAL_TYPE (RemoteOffloadMemPool, remote_offload_mem_pool,
+                      REMOTEOFFLOAD, MEMPOOL, GObject)
+
+//Create a new pool of recycled GstMemory blocks.
+// Requested sizes are rounded up to a block size class (a power of 2 for
+// small blocks, a multiple of the page size for large ones), and blocks are
+// aligned to a cache line (small) or a page (large).
+// max_free_per_size is the max number of unused blocks kept per size class.
+RemoteOffloadMemPool *remote_offload_mem_pool_new(guint max_free_per_size);
+
+//Obtain a GstMemory of exactly 'size' bytes. When the last reference to the
+// returned memory is dropped, the block goes back to the pool instead of
+// being freed. MT-safe.
+GstMemory *remote_offload_mem_pool_acquire(RemoteOffloadMemPool *pool,
+                                           gsize size);
+
+//Free all unused blocks that are currently held by the pool.
+// Blocks that are in use will still be returned to the pool when released.
+void remote_offload_mem_pool_flush(RemoteOffloadMemPool *pool);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADMEMPOOL_H__ */
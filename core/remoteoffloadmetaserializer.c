@@ -21,6 +21,10 @@
  */
 
 #include "remoteoffloadmetaserializer.h"
+#include "remoteoffloadmempool.h"
+
+//max number of unused blocks kept per size class, in each serializer's pool
+#define META_MEMPOOL_MAX_FREE 16
 
 G_DEFINE_INTERFACE (RemoteOffloadMetaSerializer, remote_offload_meta_serializer, G_TYPE_OBJECT)
 
@@ -75,6 +79,27 @@ gboolean remote_offload_meta_deserialize(RemoteOffloadMetaSerializer *serializer
 }
 
 
+//Obtain the small-block pool used to receive this serializer's segments,
+// creating it upon first use.
+static RemoteOffloadMemPool *meta_serializer_get_mem_pool(RemoteOffloadMetaSerializer *serializer)
+{
+   static GMutex poolmutex;
+
+   g_mutex_lock(&poolmutex);
+   RemoteOffloadMemPool *pool =
+         (RemoteOffloadMemPool *)g_object_get_data(G_OBJECT(serializer),
+                                                   "remoteoffload-meta-mempool");
+   if( !pool )
+   {
+      pool = remote_offload_mem_pool_new(META_MEMPOOL_MAX_FREE);
+      g_object_set_data_full(G_OBJECT(serializer), "remoteoffload-meta-mempool",
+                             pool, g_object_unref);
+   }
+   g_mutex_unlock(&poolmutex);
+
+   return pool;
+}
+
 GstMemory *remote_offload_meta_allocate_data_segment(RemoteOffloadMetaSerializer *serializer,
                                                      guint16 metaSegmentIndex,
                                                      guint64 metaSegmentSize,
@@ -95,6 +120,32 @@ GstMemory *remote_offload_meta_allocate_data_segment(RemoteOffloadMetaSerializer
    }
    else
    {
-      return gst_allocator_alloc (NULL, metaSegmentSize, NULL);
+      return remote_offload_mem_pool_acquire(meta_serializer_get_mem_pool(serializer),
+                                             metaSegmentSize);
    }
 }
+
+void remote_offload_meta_send_begin(RemoteOffloadMetaSerializer *serializer)
+{
+   RemoteOffloadMetaSerializerInterface *iface;
+
+   if( !REMOTEOFFLOAD_IS_METASERIALIZER(serializer) ) return;
+
+   iface = REMOTEOFFLOAD_METASERIALIZER_GET_IFACE(serializer);
+
+   if( iface->send_begin )
+      iface->send_begin(serializer);
+}
+
+void remote_offload_meta_send_end(RemoteOffloadMetaSerializer *serializer,
+                                  gboolean bsent)
+{
+   RemoteOffloadMetaSerializerInterface *iface;
+
+   if( !REMOTEOFFLOAD_IS_METASERIALIZER(serializer) ) return;
+
+   iface = REMOTEOFFLOAD_METASERIALIZER_GET_IFACE(serializer);
+
+   if( iface->send_end )
+      iface->send_end(serializer, bsent);
+}
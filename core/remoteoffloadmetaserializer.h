@@ -61,11 +61,21 @@ struct _RemoteOffloadMetaSerializerInterface
    // metaSegmentSize: The allocation size needed to transfer into
    // metaSegmentMemArraySoFar: The Meta GstMemory objects that have been read in so far.
    //                           Typically, this has 'metaSegmentIndex' number of entries.
-   //Optional to implement.
+   //Optional to implement. If not implemented, segments are allocated from a
+   // small-block pool owned by this serializer.
    GstMemory* (*allocate_data_segment)(RemoteOffloadMetaSerializer *serializer,
                                     guint16 metaSegmentIndex,
                                     guint64 metaSegmentSize,
                                     const GArray *metaSegmentMemArraySoFar);
+
+   //Called by BufferExchanger before the first meta of a buffer is serialized
+   // with this serializer, and once the buffer has been sent (bsent=TRUE) or
+   // discarded (bsent=FALSE). Serializers that keep per-connection state (i.e.
+   // interned names) must undo what was added since send_begin when the
+   // serialized data is discarded, as the remote side never saw it.
+   //Optional to implement.
+   void (*send_begin)(RemoteOffloadMetaSerializer *serializer);
+   void (*send_end)(RemoteOffloadMetaSerializer *serializer, gboolean bsent);
 };
 
 const gchar* remote_offload_meta_api_name(RemoteOffloadMetaSerializer *serializer);
@@ -85,6 +95,11 @@ GstMemory *remote_offload_meta_allocate_data_segment(RemoteOffloadMetaSerializer
                                                      guint64 metaSegmentSize,
                                                      const GArray *metaSegmentMemArraySoFar);
 
+void remote_offload_meta_send_begin(RemoteOffloadMetaSerializer *serializer);
+
+void remote_offload_meta_send_end(RemoteOffloadMetaSerializer *serializer,
+                                  gboolean bsent);
+
 
 
 G_END_DECLS
@@ -0,0 +1,201 @@
+/*
+ *  remoteoffloadquerycache.c - Cache of answers to remote negotiation queries
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include "remoteoffloadquerycache.h"
+
+//Upon reaching this many entries, the cache is cleared. Negotiation
+// normally only involves a handful of distinct filters.
+#define QUERY_CACHE_MAX_ENTRIES 64
+
+struct _RemoteOffloadQueryCache
+{
+   GMutex mutex;
+   GHashTable *key_to_answer; //gchar * -> GstStructure *
+   guint generation;
+   RemoteOffloadQueryCacheStats stats;
+};
+
+RemoteOffloadQueryCache *remote_offload_query_cache_new(void)
+{
+   RemoteOffloadQueryCache *cache = g_malloc0(sizeof(RemoteOffloadQueryCache));
+   g_mutex_init(&cache->mutex);
+   cache->key_to_answer = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free,
+                                                (GDestroyNotify)gst_structure_free);
+   return cache;
+}
+
+void remote_offload_query_cache_free(RemoteOffloadQueryCache *cache)
+{
+   if( !cache )
+      return;
+
+   g_hash_table_destroy(cache->key_to_answer);
+   g_mutex_clear(&cache->mutex);
+   g_free(cache);
+}
+
+//Returns NULL for queries that aren't cacheable
+static gchar *query_cache_key(GstQuery *query)
+{
+   GstCaps *caps = NULL;
+   gboolean need_pool = FALSE;
+   const gchar *prefix;
+
+   switch( GST_QUERY_TYPE(query) )
+   {
+      case GST_QUERY_CAPS:
+         gst_query_parse_caps(query, &caps);
+         prefix = "caps";
+      break;
+
+      case GST_QUERY_ACCEPT_CAPS:
+         gst_query_parse_accept_caps(query, &caps);
+         prefix = "accept-caps";
+      break;
+
+      case GST_QUERY_ALLOCATION:
+         gst_query_parse_allocation(query, &caps, &need_pool);
+         prefix = need_pool ? "allocation-pool" : "allocation";
+      break;
+
+      default:
+         return NULL;
+   }
+
+   gchar *capsstr = caps ? gst_caps_to_string(caps) : NULL;
+   gchar *key = g_strdup_printf("%s|%s", prefix, capsstr ? capsstr : "NULL");
+   g_free(capsstr);
+
+   return key;
+}
+
+static gboolean
+set_field (GQuark field_id, const GValue * value, gpointer user_data)
+{
+  GstStructure *structure = (GstStructure *)user_data;
+
+  gst_structure_id_set_value (structure, field_id, value);
+
+  return TRUE;
+}
+
+gboolean remote_offload_query_cache_lookup(RemoteOffloadQueryCache *cache,
+                                           GstQuery *query,
+                                           gboolean *result,
+                                           guint *generation)
+{
+   if( !cache || !query )
+      return FALSE;
+
+   gchar *key = query_cache_key(query);
+   if( !key )
+      return FALSE;
+
+   gboolean bhit = FALSE;
+   g_mutex_lock(&cache->mutex);
+   GstStructure *answer = g_hash_table_lookup(cache->key_to_answer, key);
+   if( answer )
+   {
+      GstStructure *structure = gst_query_writable_structure(query);
+      gst_structure_remove_all_fields(structure);
+      gst_structure_foreach(answer, set_field, structure);
+      cache->stats.hits++;
+      bhit = TRUE;
+   }
+   else
+   {
+      cache->stats.misses++;
+   }
+
+   if( generation )
+      *generation = cache->generation;
+   g_mutex_unlock(&cache->mutex);
+
+   if( bhit )
+   {
+      GST_LOG("query cache hit for %s", key);
+      if( result )
+         *result = TRUE;
+   }
+
+   g_free(key);
+
+   return bhit;
+}
+
+void remote_offload_query_cache_store(RemoteOffloadQueryCache *cache,
+                                      GstQuery *query,
+                                      gboolean result,
+                                      guint generation)
+{
+   if( !cache || !query || !result )
+      return;
+
+   //buffer pools are live objects, and can't be handed out to more than one peer
+   if( (GST_QUERY_TYPE(query) == GST_QUERY_ALLOCATION) &&
+       (gst_query_get_n_allocation_pools(query) > 0) )
+      return;
+
+   const GstStructure *structure = gst_query_get_structure(query);
+   if( !structure )
+      return;
+
+   gchar *key = query_cache_key(query);
+   if( !key )
+      return;
+
+   g_mutex_lock(&cache->mutex);
+   if( generation == cache->generation )
+   {
+      if( g_hash_table_size(cache->key_to_answer) >= QUERY_CACHE_MAX_ENTRIES )
+         g_hash_table_remove_all(cache->key_to_answer);
+
+      g_hash_table_replace(cache->key_to_answer, key, gst_structure_copy(structure));
+      key = NULL;
+   }
+   g_mutex_unlock(&cache->mutex);
+
+   g_free(key);
+}
+
+void remote_offload_query_cache_invalidate(RemoteOffloadQueryCache *cache)
+{
+   if( !cache )
+      return;
+
+   g_mutex_lock(&cache->mutex);
+   g_hash_table_remove_all(cache->key_to_answer);
+   cache->generation++;
+   cache->stats.invalidations++;
+   g_mutex_unlock(&cache->mutex);
+}
+
+void remote_offload_query_cache_get_stats(RemoteOffloadQueryCache *cache,
+                                          RemoteOffloadQueryCacheStats *stats)
+{
+   if( !cache || !stats )
+      return;
+
+   g_mutex_lock(&cache->mutex);
+   *stats = cache->stats;
+   g_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,70 @@
+/*
+ *  remoteoffloadquerycache.h - Cache of answers to remote negotiation queries
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADQUERYCACHE_H__
+#define __REMOTEOFFLOADQUERYCACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+//Caches the answers that the remote side gave to CAPS, ACCEPT_CAPS & ALLOCATION
+// queries, keyed by query type + (serialized) caps, so that repeated negotiation
+// queries don't each cost a round trip. Other query types are never cached.
+// The owner is expected to invalidate the cache whenever the answers may have
+// changed (i.e. RECONFIGURE or CAPS events).
+typedef struct _RemoteOffloadQueryCache RemoteOffloadQueryCache;
+
+typedef struct _RemoteOffloadQueryCacheStats
+{
+   guint64 hits;
+   guint64 misses;
+   guint64 invalidations;
+}RemoteOffloadQueryCacheStats;
+
+RemoteOffloadQueryCache *remote_offload_query_cache_new(void);
+void remote_offload_query_cache_free(RemoteOffloadQueryCache *cache);
+
+//Returns TRUE if an answer to this query is cached, in which case the answer
+// has been written into query, and *result is set to what the remote side
+// returned for it. Upon a miss, *generation is set to the value to pass
+// to remote_offload_query_cache_store once the query has been answered.
+gboolean remote_offload_query_cache_lookup(RemoteOffloadQueryCache *cache,
+                                           GstQuery *query,
+                                           gboolean *result,
+                                           guint *generation);
+
+//Store the answer to a query. It's dropped if the cache was invalidated
+// since the lookup that returned generation, or if result is FALSE.
+void remote_offload_query_cache_store(RemoteOffloadQueryCache *cache,
+                                      GstQuery *query,
+                                      gboolean result,
+                                      guint generation);
+
+void remote_offload_query_cache_invalidate(RemoteOffloadQueryCache *cache);
+
+void remote_offload_query_cache_get_stats(RemoteOffloadQueryCache *cache,
+                                          RemoteOffloadQueryCacheStats *stats);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADQUERYCACHE_H__ */
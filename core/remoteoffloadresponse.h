@@ -46,6 +46,11 @@ typedef enum
 RemoteOffloadResponseStatus remote_offload_response_wait(RemoteOffloadResponse *response,
                                                          gint32 timeoutmilliseconds);
 
+//Check, without blocking, whether a response has been received
+// (or cancelled). If this returns TRUE, a subsequent call to
+// remote_offload_response_wait() will return immediately.
+gboolean remote_offload_response_is_complete(RemoteOffloadResponse *response);
+
 //Steal the GArray of GstMemory objects (i.e. the response) from
 // the response object. The caller takes full ownership of the
 // GstMemory objects, as well as the GArray itself.
@@ -55,6 +60,11 @@ RemoteOffloadResponseStatus remote_offload_response_wait(RemoteOffloadResponse *
 GArray *remote_offload_response_steal_mem_array(RemoteOffloadResponse *response);
 
 
+//Return a completed response to its initial state, so that it can be
+// used for another request. This fails (returning FALSE) while a comms
+// channel is still waiting on the response.
+gboolean remote_offload_response_reset(RemoteOffloadResponse *response);
+
 //Picturing the N GstMemory's stored within the internal GArray as
 // a contiguous chunk of memory, copy 'size' bytes into dest, starting at
 // offset 'offset'.
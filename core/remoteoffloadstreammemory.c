@@ -0,0 +1,312 @@
+/*
+ *  remoteoffloadstreammemory.c - GstMemory that is filled while in use
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  A stream memory lets a received GstBuffer be pushed downstream while its
+ *   (large) memory segments are still being read from the CommsIO. Elements that
+ *   only look at the buffer's timestamps / meta never wait for the data, and
+ *   elements that map the memory wait only until the range they mapped has landed.
+ *
+ *  The backing memory stays mapped for the lifetime of the stream memory, and the
+ *   state that the reader & the waiting map's share is reference counted, as
+ *   memories that are shared (gst_memory_share) from a stream memory use it too.
+ */
+#include <string.h>
+#include "remoteoffloadstreammemory.h"
+
+GST_DEBUG_CATEGORY_STATIC (stream_memory_debug);
+#define GST_CAT_DEFAULT stream_memory_debug
+
+#define REMOTEOFFLOAD_STREAM_MEMORY_TYPE "RemoteOffloadStreamMemory"
+
+typedef struct
+{
+   gint refcount;
+   GstMemory *backing;
+   GstMapInfo backingmap;
+
+   GMutex mutex;
+   GCond cond;
+   gsize landed;   //number of (contiguous) bytes received so far
+   gboolean aborted;
+}StreamState;
+
+typedef struct
+{
+   GstMemory mem;
+   StreamState *state;
+}RemoteOffloadStreamMemory;
+
+typedef struct
+{
+   GstAllocator parent;
+}RemoteOffloadStreamAllocator;
+
+typedef struct
+{
+   GstAllocatorClass parent_class;
+}RemoteOffloadStreamAllocatorClass;
+
+static GType remote_offload_stream_allocator_get_type(void);
+G_DEFINE_TYPE(RemoteOffloadStreamAllocator, remote_offload_stream_allocator, GST_TYPE_ALLOCATOR);
+
+static GstAllocator *_stream_allocator = NULL;
+
+static inline StreamState *stream_state_ref(StreamState *state)
+{
+   g_atomic_int_inc(&state->refcount);
+   return state;
+}
+
+static inline void stream_state_unref(StreamState *state)
+{
+   if( g_atomic_int_dec_and_test(&state->refcount) )
+   {
+      gst_memory_unmap(state->backing, &state->backingmap);
+      gst_memory_unref(state->backing);
+      g_mutex_clear(&state->mutex);
+      g_cond_clear(&state->cond);
+      g_free(state);
+   }
+}
+
+static RemoteOffloadStreamMemory *stream_memory_new(StreamState *state,
+                                                    GstMemoryFlags flags,
+                                                    GstMemory *parent,
+                                                    gsize maxsize,
+                                                    gsize align,
+                                                    gsize offset,
+                                                    gsize size)
+{
+   RemoteOffloadStreamMemory *smem = g_slice_new(RemoteOffloadStreamMemory);
+   gst_memory_init(GST_MEMORY_CAST(smem), flags, _stream_allocator, parent,
+                   maxsize, align, offset, size);
+   smem->state = stream_state_ref(state);
+
+   return smem;
+}
+
+static GstMemory *stream_memory_alloc(GstAllocator *allocator,
+                                      gsize size,
+                                      GstAllocationParams *params)
+{
+   //stream memories are only created by remote_offload_stream_memory_new
+   return NULL;
+}
+
+static void stream_memory_free(GstAllocator *allocator, GstMemory *mem)
+{
+   RemoteOffloadStreamMemory *smem = (RemoteOffloadStreamMemory *)mem;
+   stream_state_unref(smem->state);
+   g_slice_free(RemoteOffloadStreamMemory, smem);
+}
+
+static gpointer stream_memory_map(GstMemory *mem, gsize maxsize, GstMapFlags flags)
+{
+   StreamState *state = ((RemoteOffloadStreamMemory *)mem)->state;
+   gsize needed = mem->offset + mem->size;
+
+   g_mutex_lock(&state->mutex);
+   while( (state->landed < needed) && !state->aborted )
+      g_cond_wait(&state->cond, &state->mutex);
+   gboolean blanded = (state->landed >= needed);
+   g_mutex_unlock(&state->mutex);
+
+   if( !blanded )
+   {
+      GST_WARNING("Stream memory %p was aborted before %"G_GSIZE_FORMAT" bytes landed",
+                  mem, needed);
+      return NULL;
+   }
+
+   return state->backingmap.data;
+}
+
+static void stream_memory_unmap(GstMemory *mem)
+{
+   //the backing memory stays mapped until the stream memory is freed
+}
+
+static GstMemory *stream_memory_share(GstMemory *mem, gssize offset, gssize size)
+{
+   RemoteOffloadStreamMemory *smem = (RemoteOffloadStreamMemory *)mem;
+
+   GstMemory *parent = mem->parent ? mem->parent : mem;
+
+   if( size == -1 )
+      size = mem->size - offset;
+
+   RemoteOffloadStreamMemory *sub =
+         stream_memory_new(smem->state,
+                           GST_MINI_OBJECT_FLAGS(parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+                           parent,
+                           mem->maxsize,
+                           mem->align,
+                           mem->offset + offset,
+                           size);
+
+   return GST_MEMORY_CAST(sub);
+}
+
+static GstMemory *stream_memory_copy(GstMemory *mem, gssize offset, gssize size)
+{
+   if( size == -1 )
+      size = mem->size > offset ? mem->size - offset : 0;
+
+   GstMemory *copy = gst_allocator_alloc(NULL, size, NULL);
+   if( !copy )
+      return NULL;
+
+   GstMapInfo srcmap, dstmap;
+   if( !gst_memory_map(mem, &srcmap, GST_MAP_READ) )
+   {
+      gst_memory_unref(copy);
+      return NULL;
+   }
+
+   if( !gst_memory_map(copy, &dstmap, GST_MAP_WRITE) )
+   {
+      gst_memory_unmap(mem, &srcmap);
+      gst_memory_unref(copy);
+      return NULL;
+   }
+
+   memcpy(dstmap.data, srcmap.data + offset, size);
+
+   gst_memory_unmap(copy, &dstmap);
+   gst_memory_unmap(mem, &srcmap);
+
+   return copy;
+}
+
+static gboolean stream_memory_is_span(GstMemory *mem1, GstMemory *mem2, gsize *offset)
+{
+   return FALSE;
+}
+
+static void
+remote_offload_stream_allocator_class_init (RemoteOffloadStreamAllocatorClass *klass)
+{
+   GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+   allocator_class->alloc = stream_memory_alloc;
+   allocator_class->free = stream_memory_free;
+}
+
+static void
+remote_offload_stream_allocator_init (RemoteOffloadStreamAllocator *self)
+{
+   GstAllocator *allocator = GST_ALLOCATOR_CAST (self);
+
+   allocator->mem_type = REMOTEOFFLOAD_STREAM_MEMORY_TYPE;
+   allocator->mem_map = stream_memory_map;
+   allocator->mem_unmap = stream_memory_unmap;
+   allocator->mem_share = stream_memory_share;
+   allocator->mem_copy = stream_memory_copy;
+   allocator->mem_is_span = stream_memory_is_span;
+
+   GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+static void stream_allocator_ensure()
+{
+   static gsize initialized = 0;
+   if( g_once_init_enter(&initialized) )
+   {
+      GST_DEBUG_CATEGORY_INIT (stream_memory_debug, "remoteoffloadstreammemory", 0,
+                               "debug category for RemoteOffloadStreamMemory");
+      _stream_allocator = g_object_new(remote_offload_stream_allocator_get_type(), NULL);
+      gst_object_ref_sink(_stream_allocator);
+      g_once_init_leave(&initialized, 1);
+   }
+}
+
+GstMemory *remote_offload_stream_memory_new(GstMemory *backing)
+{
+   if( !backing )
+      return NULL;
+
+   stream_allocator_ensure();
+
+   StreamState *state = g_new0(StreamState, 1);
+   state->refcount = 1;
+   state->backing = backing;
+   if( !gst_memory_map(backing, &state->backingmap, GST_MAP_READWRITE) )
+   {
+      GST_ERROR("Error mapping backing memory for writing");
+      gst_memory_unref(backing);
+      g_free(state);
+      return NULL;
+   }
+   g_mutex_init(&state->mutex);
+   g_cond_init(&state->cond);
+   state->landed = 0;
+   state->aborted = FALSE;
+
+   RemoteOffloadStreamMemory *smem = stream_memory_new(state,
+                                                       (GstMemoryFlags)0,
+                                                       NULL,
+                                                       state->backingmap.size,
+                                                       0,
+                                                       0,
+                                                       state->backingmap.size);
+
+   //smem holds its own reference now
+   stream_state_unref(state);
+
+   return GST_MEMORY_CAST(smem);
+}
+
+gboolean remote_offload_stream_memory_is_stream(GstMemory *mem)
+{
+   return mem && _stream_allocator && (mem->allocator == _stream_allocator);
+}
+
+guint8 *remote_offload_stream_memory_get_data(GstMemory *mem)
+{
+   if( !remote_offload_stream_memory_is_stream(mem) )
+      return NULL;
+
+   return ((RemoteOffloadStreamMemory *)mem)->state->backingmap.data;
+}
+
+void remote_offload_stream_memory_advance(GstMemory *mem, gsize nbytes)
+{
+   if( !remote_offload_stream_memory_is_stream(mem) )
+      return;
+
+   StreamState *state = ((RemoteOffloadStreamMemory *)mem)->state;
+   g_mutex_lock(&state->mutex);
+   state->landed += nbytes;
+   g_cond_broadcast(&state->cond);
+   g_mutex_unlock(&state->mutex);
+}
+
+void remote_offload_stream_memory_abort(GstMemory *mem)
+{
+   if( !remote_offload_stream_memory_is_stream(mem) )
+      return;
+
+   StreamState *state = ((RemoteOffloadStreamMemory *)mem)->state;
+   g_mutex_lock(&state->mutex);
+   state->aborted = TRUE;
+   g_cond_broadcast(&state->cond);
+   g_mutex_unlock(&state->mutex);
+}
@@ -0,0 +1,54 @@
+/*
+ *  remoteoffloadstreammemory.h - GstMemory that is filled while in use
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADSTREAMMEMORY_H__
+#define __REMOTEOFFLOADSTREAMMEMORY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+//A stream memory wraps a (mappable) backing GstMemory whose contents are still
+// being received. It can be handed downstream before the data has arrived:
+// gst_memory_map() of a stream memory (or of a memory shared from it) blocks
+// until the bytes that it covers have landed, and fails if the transfer was
+// aborted.
+
+//Create a new stream memory. Takes ownership of backing.
+// Returns NULL (and unrefs backing) if backing can't be mapped for writing.
+GstMemory *remote_offload_stream_memory_new(GstMemory *backing);
+
+gboolean remote_offload_stream_memory_is_stream(GstMemory *mem);
+
+//Obtain the address that the contents of a stream memory should be
+// received into. This is only valid for as long as mem is referenced.
+guint8 *remote_offload_stream_memory_get_data(GstMemory *mem);
+
+//Inform waiting map's that nbytes more (contiguous) bytes have landed
+void remote_offload_stream_memory_advance(GstMemory *mem, gsize nbytes);
+
+//Inform waiting (and future) map's that the rest of the data won't arrive.
+void remote_offload_stream_memory_abort(GstMemory *mem);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADSTREAMMEMORY_H__ */
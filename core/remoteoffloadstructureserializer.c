@@ -0,0 +1,711 @@
+/*
+ *  remoteoffloadstructureserializer.c - Binary GstStructure serialization
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  An encoded structure looks like this:
+ *  [name]
+ *  [guint32 nfields]
+ *  (for each field):
+ *  [name]
+ *  [guint8 value type]
+ *  [value]
+ *
+ *  A name is a guint16 id. If NAME_ID_DEFINE is set, the id is being assigned
+ *  to the name that follows it ([guint16 size][chars], not NULL terminated).
+ *  NAME_ID_INLINE is followed by a name that isn't interned (once the writer
+ *  has assigned all available ids).
+ *  All integers are little-endian.
+ */
+#include <string.h>
+#include "remoteoffloadstructureserializer.h"
+
+GST_DEBUG_CATEGORY_STATIC (remote_offload_structure_serializer_debug);
+#define GST_CAT_DEFAULT remote_offload_structure_serializer_debug
+
+static void register_debug_category()
+{
+   static gsize debugRegistered = 0;
+   if( g_once_init_enter(&debugRegistered) )
+   {
+      GST_DEBUG_CATEGORY_INIT (remote_offload_structure_serializer_debug,
+                               "remoteoffloadstructureserializer", 0,
+                               "debug category for binary GstStructure serialization");
+      g_once_init_leave (&debugRegistered, 1);
+   }
+}
+
+#define NAME_ID_INLINE 0x7FFF
+#define NAME_ID_DEFINE 0x8000
+
+//guards against malformed (or malicious) input recursing without bound
+#define MAX_NESTING_DEPTH 16
+
+#define STRING_NULL G_MAXUINT32
+
+typedef enum
+{
+   VALUE_TYPE_INT = 1,
+   VALUE_TYPE_UINT,
+   VALUE_TYPE_INT64,
+   VALUE_TYPE_UINT64,
+   VALUE_TYPE_FLOAT,
+   VALUE_TYPE_DOUBLE,
+   VALUE_TYPE_BOOLEAN,
+   VALUE_TYPE_STRING,
+   VALUE_TYPE_STRUCTURE,
+   VALUE_TYPE_ARRAY,      //GstValueArray
+   VALUE_TYPE_LIST,       //GstValueList
+   VALUE_TYPE_VARIANT,    //[type string][guint32 size][serialized GVariant]
+   VALUE_TYPE_TEXT        //[GType name string][gst_value_serialize string]
+}StructureValueType;
+
+struct _RemoteOffloadStructureWriter
+{
+   GHashTable *quark_to_id;
+   GArray *id_to_quark;   //so that ids assigned by a failed write can be rolled back
+};
+
+struct _RemoteOffloadStructureReader
+{
+   GArray *id_to_quark;
+};
+
+RemoteOffloadStructureWriter *remote_offload_structure_writer_new(void)
+{
+   register_debug_category();
+
+   RemoteOffloadStructureWriter *writer = g_malloc0(sizeof(RemoteOffloadStructureWriter));
+   writer->quark_to_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+   writer->id_to_quark = g_array_new(FALSE, FALSE, sizeof(GQuark));
+
+   return writer;
+}
+
+void remote_offload_structure_writer_free(RemoteOffloadStructureWriter *writer)
+{
+   if( !writer )
+      return;
+
+   g_hash_table_destroy(writer->quark_to_id);
+   g_array_free(writer->id_to_quark, TRUE);
+   g_free(writer);
+}
+
+RemoteOffloadStructureReader *remote_offload_structure_reader_new(void)
+{
+   register_debug_category();
+
+   RemoteOffloadStructureReader *reader = g_malloc0(sizeof(RemoteOffloadStructureReader));
+   reader->id_to_quark = g_array_new(FALSE, TRUE, sizeof(GQuark));
+
+   return reader;
+}
+
+void remote_offload_structure_reader_free(RemoteOffloadStructureReader *reader)
+{
+   if( !reader )
+      return;
+
+   g_array_free(reader->id_to_quark, TRUE);
+   g_free(reader);
+}
+
+static inline gboolean put_string32(GstByteWriter *bw, const gchar *str)
+{
+   if( !str )
+      return gst_byte_writer_put_uint32_le(bw, STRING_NULL);
+
+   gsize len = strlen(str);
+   if( len >= STRING_NULL )
+      return FALSE;
+
+   return gst_byte_writer_put_uint32_le(bw, (guint32)len) &&
+          gst_byte_writer_put_data(bw, (const guint8 *)str, len);
+}
+
+static inline gboolean put_string16(GstByteWriter *bw, const gchar *str)
+{
+   gsize len = strlen(str);
+   if( len > G_MAXUINT16 )
+      return FALSE;
+
+   return gst_byte_writer_put_uint16_le(bw, (guint16)len) &&
+          gst_byte_writer_put_data(bw, (const guint8 *)str, len);
+}
+
+static gboolean write_name(RemoteOffloadStructureWriter *writer,
+                           GQuark name,
+                           GstByteWriter *bw)
+{
+   gpointer id;
+   if( g_hash_table_lookup_extended(writer->quark_to_id, GUINT_TO_POINTER(name), NULL, &id) )
+   {
+      return gst_byte_writer_put_uint16_le(bw, (guint16)GPOINTER_TO_UINT(id));
+   }
+
+   if( writer->id_to_quark->len < NAME_ID_INLINE )
+   {
+      guint16 newid = (guint16)writer->id_to_quark->len;
+      g_array_append_val(writer->id_to_quark, name);
+      g_hash_table_insert(writer->quark_to_id, GUINT_TO_POINTER(name), GUINT_TO_POINTER(newid));
+
+      return gst_byte_writer_put_uint16_le(bw, newid | NAME_ID_DEFINE) &&
+             put_string16(bw, g_quark_to_string(name));
+   }
+
+   return gst_byte_writer_put_uint16_le(bw, NAME_ID_INLINE) &&
+          put_string16(bw, g_quark_to_string(name));
+}
+
+//Forget the names that were assigned an id after the first nids ones, as the
+// data that defined them has been discarded.
+static void writer_rollback(RemoteOffloadStructureWriter *writer, guint nids)
+{
+   for( guint id = nids; id < writer->id_to_quark->len; id++ )
+   {
+      GQuark name = g_array_index(writer->id_to_quark, GQuark, id);
+      g_hash_table_remove(writer->quark_to_id, GUINT_TO_POINTER(name));
+   }
+   g_array_set_size(writer->id_to_quark, nids);
+}
+
+guint remote_offload_structure_writer_get_mark(RemoteOffloadStructureWriter *writer)
+{
+   if( !writer )
+      return 0;
+
+   return writer->id_to_quark->len;
+}
+
+void remote_offload_structure_writer_rollback(RemoteOffloadStructureWriter *writer,
+                                              guint mark)
+{
+   if( !writer || (mark > writer->id_to_quark->len) )
+      return;
+
+   writer_rollback(writer, mark);
+}
+
+static gboolean write_structure(RemoteOffloadStructureWriter *writer,
+                                const GstStructure *structure,
+                                const gchar * const *skip_fields,
+                                GstByteWriter *bw,
+                                guint depth);
+
+static gboolean write_value(RemoteOffloadStructureWriter *writer,
+                            const GValue *value,
+                            GstByteWriter *bw,
+                            guint depth)
+{
+   GType type = G_VALUE_TYPE(value);
+
+   if( type == G_TYPE_INT )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_INT) &&
+             gst_byte_writer_put_int32_le(bw, g_value_get_int(value));
+
+   if( type == G_TYPE_UINT )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_UINT) &&
+             gst_byte_writer_put_uint32_le(bw, g_value_get_uint(value));
+
+   if( type == G_TYPE_INT64 )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_INT64) &&
+             gst_byte_writer_put_int64_le(bw, g_value_get_int64(value));
+
+   if( type == G_TYPE_UINT64 )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_UINT64) &&
+             gst_byte_writer_put_uint64_le(bw, g_value_get_uint64(value));
+
+   if( type == G_TYPE_FLOAT )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_FLOAT) &&
+             gst_byte_writer_put_float32_le(bw, g_value_get_float(value));
+
+   if( type == G_TYPE_DOUBLE )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_DOUBLE) &&
+             gst_byte_writer_put_float64_le(bw, g_value_get_double(value));
+
+   if( type == G_TYPE_BOOLEAN )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_BOOLEAN) &&
+             gst_byte_writer_put_uint8(bw, g_value_get_boolean(value) ? 1 : 0);
+
+   if( type == G_TYPE_STRING )
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_STRING) &&
+             put_string32(bw, g_value_get_string(value));
+
+   if( type == GST_TYPE_STRUCTURE )
+   {
+      const GstStructure *nested = gst_value_get_structure(value);
+      if( !nested || (depth >= MAX_NESTING_DEPTH) )
+         return FALSE;
+
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_STRUCTURE) &&
+             write_structure(writer, nested, NULL, bw, depth + 1);
+   }
+
+   if( (type == GST_TYPE_ARRAY) || (type == GST_TYPE_LIST) )
+   {
+      gboolean barray = (type == GST_TYPE_ARRAY);
+      guint n = barray ? gst_value_array_get_size(value) : gst_value_list_get_size(value);
+      if( depth >= MAX_NESTING_DEPTH )
+         return FALSE;
+
+      if( !gst_byte_writer_put_uint8(bw, barray ? VALUE_TYPE_ARRAY : VALUE_TYPE_LIST) ||
+          !gst_byte_writer_put_uint32_le(bw, n) )
+         return FALSE;
+
+      for( guint i = 0; i < n; i++ )
+      {
+         const GValue *element = barray ? gst_value_array_get_value(value, i) :
+                                          gst_value_list_get_value(value, i);
+         if( !write_value(writer, element, bw, depth + 1) )
+            return FALSE;
+      }
+
+      return TRUE;
+   }
+
+   if( type == G_TYPE_VARIANT )
+   {
+      GVariant *variant = g_value_get_variant(value);
+      if( !variant )
+         return FALSE;
+
+      gsize size = g_variant_get_size(variant);
+      if( size >= G_MAXUINT32 )
+         return FALSE;
+
+      return gst_byte_writer_put_uint8(bw, VALUE_TYPE_VARIANT) &&
+             put_string32(bw, g_variant_get_type_string(variant)) &&
+             gst_byte_writer_put_uint32_le(bw, (guint32)size) &&
+             ((size == 0) ||
+              gst_byte_writer_put_data(bw, g_variant_get_data(variant), size));
+   }
+
+   //fall back to the text representation of anything else.
+   gchar *str = gst_value_serialize(value);
+   if( !str )
+      return FALSE;
+
+   gboolean ret = gst_byte_writer_put_uint8(bw, VALUE_TYPE_TEXT) &&
+                  put_string32(bw, g_type_name(type)) &&
+                  put_string32(bw, str);
+   g_free(str);
+
+   return ret;
+}
+
+typedef struct
+{
+   RemoteOffloadStructureWriter *writer;
+   GstByteWriter *bw;
+   const gchar * const *skip_fields;
+   guint depth;
+   guint32 nfields;
+   gboolean ok;
+}WriteFieldContext;
+
+static gboolean write_field(GQuark field_id, const GValue *value, gpointer user_data)
+{
+   WriteFieldContext *ctx = (WriteFieldContext *)user_data;
+
+   if( ctx->skip_fields )
+   {
+      const gchar *fieldname = g_quark_to_string(field_id);
+      for( const gchar * const *skip = ctx->skip_fields; *skip; skip++ )
+      {
+         if( g_strcmp0(fieldname, *skip) == 0 )
+            return TRUE;
+      }
+   }
+
+   guint pos = gst_byte_writer_get_pos(ctx->bw);
+   guint nids = ctx->writer->id_to_quark->len;
+
+   if( write_name(ctx->writer, field_id, ctx->bw) &&
+       write_value(ctx->writer, value, ctx->bw, ctx->depth) )
+   {
+      ctx->nfields++;
+   }
+   else
+   {
+      GST_DEBUG("skipping field %s of type %s, which can't be serialized",
+                g_quark_to_string(field_id), G_VALUE_TYPE_NAME(value));
+      gst_byte_writer_set_pos(ctx->bw, pos);
+      writer_rollback(ctx->writer, nids);
+   }
+
+   return TRUE;
+}
+
+static gboolean write_structure(RemoteOffloadStructureWriter *writer,
+                                const GstStructure *structure,
+                                const gchar * const *skip_fields,
+                                GstByteWriter *bw,
+                                guint depth)
+{
+   if( !write_name(writer, gst_structure_get_name_id(structure), bw) )
+      return FALSE;
+
+   //the number of fields written is only known at the end
+   guint nfieldspos = gst_byte_writer_get_pos(bw);
+   if( !gst_byte_writer_put_uint32_le(bw, 0) )
+      return FALSE;
+
+   WriteFieldContext ctx = {writer, bw, skip_fields, depth, 0, TRUE};
+   gst_structure_foreach(structure, write_field, &ctx);
+
+   guint endpos = gst_byte_writer_get_pos(bw);
+   gst_byte_writer_set_pos(bw, nfieldspos);
+   gst_byte_writer_put_uint32_le(bw, ctx.nfields);
+   gst_byte_writer_set_pos(bw, endpos);
+
+   return ctx.ok;
+}
+
+gboolean remote_offload_structure_write(RemoteOffloadStructureWriter *writer,
+                                        const GstStructure *structure,
+                                        const gchar * const *skip_fields,
+                                        GstByteWriter *bw)
+{
+   if( !writer || !structure || !bw )
+      return FALSE;
+
+   guint pos = gst_byte_writer_get_pos(bw);
+   guint nids = writer->id_to_quark->len;
+   if( !write_structure(writer, structure, skip_fields, bw, 0) )
+   {
+      gst_byte_writer_set_pos(bw, pos);
+      writer_rollback(writer, nids);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+static gboolean read_string16(GstByteReader *br, gchar **str)
+{
+   guint16 len;
+   const guint8 *data;
+   if( !gst_byte_reader_get_uint16_le(br, &len) ||
+       !gst_byte_reader_get_data(br, len, &data) )
+      return FALSE;
+
+   *str = g_strndup((const gchar *)data, len);
+   return TRUE;
+}
+
+//*str is set to NULL for a NULL string
+static gboolean read_string32(GstByteReader *br, gchar **str)
+{
+   guint32 len;
+   const guint8 *data;
+   if( !gst_byte_reader_get_uint32_le(br, &len) )
+      return FALSE;
+
+   if( len == STRING_NULL )
+   {
+      *str = NULL;
+      return TRUE;
+   }
+
+   if( !gst_byte_reader_get_data(br, len, &data) )
+      return FALSE;
+
+   *str = g_strndup((const gchar *)data, len);
+   return TRUE;
+}
+
+//Returns 0 upon failure
+static GQuark read_name(RemoteOffloadStructureReader *reader, GstByteReader *br)
+{
+   guint16 id;
+   if( !gst_byte_reader_get_uint16_le(br, &id) )
+      return 0;
+
+   if( (id == NAME_ID_INLINE) || (id & NAME_ID_DEFINE) )
+   {
+      gchar *name;
+      if( !read_string16(br, &name) )
+         return 0;
+
+      GQuark quark = g_quark_from_string(name);
+      g_free(name);
+
+      if( id != NAME_ID_INLINE )
+      {
+         id &= ~NAME_ID_DEFINE;
+         if( id >= reader->id_to_quark->len )
+            g_array_set_size(reader->id_to_quark, id + 1);
+         g_array_index(reader->id_to_quark, GQuark, id) = quark;
+      }
+
+      return quark;
+   }
+
+   if( (id >= reader->id_to_quark->len) || !g_array_index(reader->id_to_quark, GQuark, id) )
+   {
+      GST_ERROR("Reference to name id %u, which hasn't been defined", id);
+      return 0;
+   }
+
+   return g_array_index(reader->id_to_quark, GQuark, id);
+}
+
+static GstStructure *read_structure(RemoteOffloadStructureReader *reader,
+                                    GstByteReader *br,
+                                    guint depth);
+
+//Returns FALSE if the data is malformed. If the value can't be represented
+// on this side (i.e. a type that isn't registered), value is left unset.
+static gboolean read_value(RemoteOffloadStructureReader *reader,
+                           GstByteReader *br,
+                           GValue *value,
+                           guint depth)
+{
+   guint8 type;
+   if( !gst_byte_reader_get_uint8(br, &type) )
+      return FALSE;
+
+   switch( type )
+   {
+      case VALUE_TYPE_INT:
+      {
+         gint32 v;
+         if( !gst_byte_reader_get_int32_le(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_INT);
+         g_value_set_int(value, v);
+      }
+      break;
+
+      case VALUE_TYPE_UINT:
+      {
+         guint32 v;
+         if( !gst_byte_reader_get_uint32_le(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_UINT);
+         g_value_set_uint(value, v);
+      }
+      break;
+
+      case VALUE_TYPE_INT64:
+      {
+         gint64 v;
+         if( !gst_byte_reader_get_int64_le(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_INT64);
+         g_value_set_int64(value, v);
+      }
+      break;
+
+      case VALUE_TYPE_UINT64:
+      {
+         guint64 v;
+         if( !gst_byte_reader_get_uint64_le(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_UINT64);
+         g_value_set_uint64(value, v);
+      }
+      break;
+
+      case VALUE_TYPE_FLOAT:
+      {
+         gfloat v;
+         if( !gst_byte_reader_get_float32_le(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_FLOAT);
+         g_value_set_float(value, v);
+      }
+      break;
+
+      case VALUE_TYPE_DOUBLE:
+      {
+         gdouble v;
+         if( !gst_byte_reader_get_float64_le(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_DOUBLE);
+         g_value_set_double(value, v);
+      }
+      break;
+
+      case VALUE_TYPE_BOOLEAN:
+      {
+         guint8 v;
+         if( !gst_byte_reader_get_uint8(br, &v) )
+            return FALSE;
+         g_value_init(value, G_TYPE_BOOLEAN);
+         g_value_set_boolean(value, v ? TRUE : FALSE);
+      }
+      break;
+
+      case VALUE_TYPE_STRING:
+      {
+         gchar *str;
+         if( !read_string32(br, &str) )
+            return FALSE;
+         g_value_init(value, G_TYPE_STRING);
+         g_value_take_string(value, str);
+      }
+      break;
+
+      case VALUE_TYPE_STRUCTURE:
+      {
+         if( depth >= MAX_NESTING_DEPTH )
+            return FALSE;
+
+         GstStructure *nested = read_structure(reader, br, depth + 1);
+         if( !nested )
+            return FALSE;
+         g_value_init(value, GST_TYPE_STRUCTURE);
+         g_value_take_boxed(value, nested);
+      }
+      break;
+
+      case VALUE_TYPE_ARRAY:
+      case VALUE_TYPE_LIST:
+      {
+         guint32 n;
+         if( (depth >= MAX_NESTING_DEPTH) || !gst_byte_reader_get_uint32_le(br, &n) )
+            return FALSE;
+
+         gboolean barray = (type == VALUE_TYPE_ARRAY);
+         g_value_init(value, barray ? GST_TYPE_ARRAY : GST_TYPE_LIST);
+         for( guint32 i = 0; i < n; i++ )
+         {
+            GValue element = G_VALUE_INIT;
+            if( !read_value(reader, br, &element, depth + 1) )
+            {
+               g_value_unset(value);
+               return FALSE;
+            }
+
+            if( G_IS_VALUE(&element) )
+            {
+               if( barray )
+                  gst_value_array_append_and_take_value(value, &element);
+               else
+                  gst_value_list_append_and_take_value(value, &element);
+            }
+         }
+      }
+      break;
+
+      case VALUE_TYPE_VARIANT:
+      {
+         gchar *typestr;
+         guint32 size;
+         const guint8 *data = NULL;
+         if( !read_string32(br, &typestr) )
+            return FALSE;
+
+         if( !typestr || !g_variant_type_string_is_valid(typestr) ||
+             !gst_byte_reader_get_uint32_le(br, &size) ||
+             !gst_byte_reader_get_data(br, size, &data) )
+         {
+            g_free(typestr);
+            return FALSE;
+         }
+
+         GBytes *bytes = g_bytes_new(data, size);
+         GVariant *variant = g_variant_new_from_bytes(G_VARIANT_TYPE(typestr), bytes, FALSE);
+         g_bytes_unref(bytes);
+         g_free(typestr);
+
+         g_value_init(value, G_TYPE_VARIANT);
+         g_value_take_variant(value, variant);
+      }
+      break;
+
+      case VALUE_TYPE_TEXT:
+      {
+         gchar *typename = NULL;
+         gchar *str = NULL;
+         if( !read_string32(br, &typename) || !read_string32(br, &str) )
+         {
+            g_free(typename);
+            return FALSE;
+         }
+
+         GType gtype = typename ? g_type_from_name(typename) : G_TYPE_INVALID;
+         if( gtype && str )
+         {
+            g_value_init(value, gtype);
+            if( !gst_value_deserialize(value, str) )
+            {
+               GST_WARNING("Unable to deserialize value of type %s", typename);
+               g_value_unset(value);
+            }
+         }
+         else
+         {
+            GST_WARNING("Dropping value of unknown type %s", typename ? typename : "(null)");
+         }
+
+         g_free(typename);
+         g_free(str);
+      }
+      break;
+
+      default:
+         GST_ERROR("Unknown value type %u", type);
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+static GstStructure *read_structure(RemoteOffloadStructureReader *reader,
+                                    GstByteReader *br,
+                                    guint depth)
+{
+   GQuark name = read_name(reader, br);
+   guint32 nfields;
+   if( !name || !gst_byte_reader_get_uint32_le(br, &nfields) )
+      return NULL;
+
+   GstStructure *structure = gst_structure_new_id_empty(name);
+   for( guint32 i = 0; i < nfields; i++ )
+   {
+      GQuark field = read_name(reader, br);
+      GValue value = G_VALUE_INIT;
+      if( !field || !read_value(reader, br, &value, depth) )
+      {
+         gst_structure_free(structure);
+         return NULL;
+      }
+
+      if( G_IS_VALUE(&value) )
+         gst_structure_id_take_value(structure, field, &value);
+   }
+
+   return structure;
+}
+
+GstStructure *remote_offload_structure_read(RemoteOffloadStructureReader *reader,
+                                            GstByteReader *br)
+{
+   if( !reader || !br )
+      return NULL;
+
+   GstStructure *structure = read_structure(reader, br, 0);
+   if( !structure )
+      GST_ERROR("Malformed serialized structure");
+
+   return structure;
+}
@@ -0,0 +1,76 @@
+/*
+ *  remoteoffloadstructureserializer.h - Binary GstStructure serialization
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADSTRUCTURESERIALIZER_H__
+#define __REMOTEOFFLOADSTRUCTURESERIALIZER_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbytewriter.h>
+#include <gst/base/gstbytereader.h>
+
+G_BEGIN_DECLS
+
+//Typed, binary serialization of GstStructure's, for meta serializers that need to
+// transfer them for every buffer (as opposed to gst_structure_to_string /
+// gst_structure_from_string).
+//
+//Integers, floating point values, booleans, strings, nested structures,
+// GstValueArray / GstValueList and GVariant's are encoded in binary. Values of
+// any other type fall back to gst_value_serialize, and are skipped if that fails
+// (i.e. pointers).
+//
+//Structure & field names are interned: the first time that a writer encodes a
+// name, the name is sent along with an id, and from then on only the id is
+// sent. A writer / reader pair therefore keeps state for the lifetime of a
+// connection. Everything written by a writer must be read, in the same
+// order, by its (one) reader. Writers and readers are not thread-safe.
+typedef struct _RemoteOffloadStructureWriter RemoteOffloadStructureWriter;
+typedef struct _RemoteOffloadStructureReader RemoteOffloadStructureReader;
+
+RemoteOffloadStructureWriter *remote_offload_structure_writer_new(void);
+void remote_offload_structure_writer_free(RemoteOffloadStructureWriter *writer);
+
+//Append the encoding of structure to bw. Fields named within skip_fields (a NULL
+// terminated array, or NULL) aren't written.
+gboolean remote_offload_structure_write(RemoteOffloadStructureWriter *writer,
+                                        const GstStructure *structure,
+                                        const gchar * const *skip_fields,
+                                        GstByteWriter *bw);
+
+//Names interned so far. If data written after taking a mark is discarded
+// (never read by the reader), the writer must be rolled back to the mark, or
+// it would go on referencing names that the reader was never given.
+guint remote_offload_structure_writer_get_mark(RemoteOffloadStructureWriter *writer);
+void remote_offload_structure_writer_rollback(RemoteOffloadStructureWriter *writer,
+                                              guint mark);
+
+RemoteOffloadStructureReader *remote_offload_structure_reader_new(void);
+void remote_offload_structure_reader_free(RemoteOffloadStructureReader *reader);
+
+//Decode a structure written by remote_offload_structure_write. Returns NULL
+// if the data is malformed.
+GstStructure *remote_offload_structure_read(RemoteOffloadStructureReader *reader,
+                                            GstByteReader *br);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADSTRUCTURESERIALIZER_H__ */
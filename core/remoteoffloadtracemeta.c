@@ -0,0 +1,237 @@
+/*
+ *  remoteoffloadtracemeta.c - Per-hop timestamps carried by traced buffers
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <string.h>
+#include "remoteoffloadtracemeta.h"
+
+GType remote_offload_trace_meta_api_get_type (void)
+{
+   static gsize type = 0;
+   //no tags, as the timestamps describe the buffer's journey rather than
+   // its contents, so the meta should survive any transform
+   static const gchar *tags[] = { NULL };
+
+   if( g_once_init_enter(&type) )
+   {
+      GType _type = gst_meta_api_type_register("RemoteOffloadTraceMetaAPI", tags);
+      g_once_init_leave(&type, _type);
+   }
+
+   return (GType)type;
+}
+
+static gboolean remote_offload_trace_meta_init(GstMeta *meta,
+                                               gpointer params,
+                                               GstBuffer *buffer)
+{
+   RemoteOffloadTraceMeta *tmeta = (RemoteOffloadTraceMeta *)meta;
+   tmeta->domain = 0;
+   tmeta->overflowed = FALSE;
+   tmeta->nhops = 0;
+
+   return TRUE;
+}
+
+static gboolean remote_offload_trace_meta_transform(GstBuffer *dest,
+                                                    GstMeta *meta,
+                                                    GstBuffer *buffer,
+                                                    GQuark type,
+                                                    gpointer data)
+{
+   RemoteOffloadTraceMeta *smeta = (RemoteOffloadTraceMeta *)meta;
+
+   RemoteOffloadTraceMeta *dmeta = remote_offload_buffer_get_trace_meta(dest);
+   if( !dmeta )
+   {
+      dmeta = remote_offload_buffer_add_trace_meta(dest);
+      if( !dmeta )
+         return FALSE;
+   }
+
+   dmeta->domain = smeta->domain;
+   dmeta->overflowed = smeta->overflowed;
+   dmeta->nhops = smeta->nhops;
+   memcpy(dmeta->hops, smeta->hops, smeta->nhops * sizeof(RemoteOffloadTraceHop));
+
+   return TRUE;
+}
+
+const GstMetaInfo *remote_offload_trace_meta_get_info (void)
+{
+   static const GstMetaInfo *meta_info = NULL;
+
+   if( g_once_init_enter((GstMetaInfo **)&meta_info) )
+   {
+      const GstMetaInfo *mi =
+            gst_meta_register(REMOTEOFFLOAD_TRACE_META_API_TYPE,
+                              "RemoteOffloadTraceMeta",
+                              sizeof(RemoteOffloadTraceMeta),
+                              remote_offload_trace_meta_init,
+                              (GstMetaFreeFunction)NULL,
+                              remote_offload_trace_meta_transform);
+      g_once_init_leave((GstMetaInfo **)&meta_info, (GstMetaInfo *)mi);
+   }
+
+   return meta_info;
+}
+
+RemoteOffloadTraceMeta *remote_offload_buffer_add_trace_meta(GstBuffer *buffer)
+{
+   g_return_val_if_fail(GST_IS_BUFFER(buffer), NULL);
+
+   return (RemoteOffloadTraceMeta *)gst_buffer_add_meta(buffer,
+                                                        REMOTEOFFLOAD_TRACE_META_INFO,
+                                                        NULL);
+}
+
+gboolean remote_offload_trace_meta_add_hop(RemoteOffloadTraceMeta *meta,
+                                           RemoteOffloadTraceStage stage)
+{
+   if( !meta )
+      return FALSE;
+
+   if( meta->nhops >= REMOTEOFFLOAD_TRACE_META_MAX_HOPS )
+   {
+      meta->overflowed = TRUE;
+      return FALSE;
+   }
+
+   RemoteOffloadTraceHop *hop = &meta->hops[meta->nhops++];
+   memset(hop, 0, sizeof(RemoteOffloadTraceHop));
+   hop->ts = gst_util_get_timestamp();
+   hop->stage = (guint8)stage;
+   hop->domain = meta->domain;
+
+   return TRUE;
+}
+
+void remote_offload_buffer_trace_hop(GstBuffer **buffer,
+                                     RemoteOffloadTraceStage stage)
+{
+   if( G_LIKELY(!remote_offload_buffer_get_trace_meta(*buffer)) )
+      return;
+
+   //only traced buffers pay for this. The meta is copied along with the
+   // rest of the buffer's metadata, if a copy needed to be made.
+   *buffer = gst_buffer_make_writable(*buffer);
+   remote_offload_trace_meta_add_hop(remote_offload_buffer_get_trace_meta(*buffer),
+                                     stage);
+}
+
+const gchar *remote_offload_trace_stage_name(RemoteOffloadTraceStage stage)
+{
+   switch( stage )
+   {
+      case REMOTEOFFLOAD_TRACE_STAGE_SOURCE: return "source";
+      case REMOTEOFFLOAD_TRACE_STAGE_INGRESS: return "ingress";
+      case REMOTEOFFLOAD_TRACE_STAGE_SEND: return "send";
+      case REMOTEOFFLOAD_TRACE_STAGE_RECEIVE: return "receive";
+      case REMOTEOFFLOAD_TRACE_STAGE_EGRESS: return "egress";
+      case REMOTEOFFLOAD_TRACE_STAGE_SINK: return "sink";
+   }
+
+   return "unknown";
+}
+
+void remote_offload_trace_clock_sync_reset(RemoteOffloadTraceClockSync *sync)
+{
+   if( !sync )
+      return;
+
+   sync->valid = FALSE;
+   sync->offset = 0;
+   sync->delay = 0;
+   sync->age = 0;
+}
+
+gboolean remote_offload_trace_clock_sync_update(RemoteOffloadTraceClockSync *sync,
+                                                const RemoteOffloadTraceMeta *meta)
+{
+   if( !sync || !meta )
+      return FALSE;
+
+   //t1: last hop in domain 0 (the send), t2 & t3: first & last hops in
+   // domain 1, t4: first hop back in domain 2 (the receive).
+   gint i1 = -1, i2 = -1, i3 = -1, i4 = -1;
+   for( guint i = 0; i < meta->nhops; i++ )
+   {
+      guint8 domain = meta->hops[i].domain;
+      if( domain == 0 )
+      {
+         i1 = i;
+      }
+      else if( domain == 1 )
+      {
+         if( i2 < 0 )
+            i2 = i;
+         i3 = i;
+      }
+      else
+      {
+         i4 = i;
+         break;
+      }
+   }
+
+   if( (i1 < 0) || (i2 < 0) || (i4 < 0) )
+      return FALSE;
+
+   gint64 t1 = (gint64)meta->hops[i1].ts;
+   gint64 t2 = (gint64)meta->hops[i2].ts;
+   gint64 t3 = (gint64)meta->hops[i3].ts;
+   gint64 t4 = (gint64)meta->hops[i4].ts;
+
+   gint64 delay = (t4 - t1) - (t3 - t2);
+   if( delay < 0 )
+      return FALSE;
+
+   gint64 offset = ((t2 - t1) + (t3 - t4)) / 2;
+
+   sync->age++;
+   if( !sync->valid ||
+       ((guint64)delay <= sync->delay) ||
+       (sync->age >= REMOTEOFFLOAD_TRACE_CLOCK_SYNC_WINDOW) )
+   {
+      sync->valid = TRUE;
+      sync->offset = offset;
+      sync->delay = (guint64)delay;
+      sync->age = 0;
+   }
+
+   return TRUE;
+}
+
+GstClockTime remote_offload_trace_clock_sync_to_origin(const RemoteOffloadTraceClockSync *sync,
+                                                       guint8 domain,
+                                                       GstClockTime ts)
+{
+   if( !(domain & 1) )
+      return ts;
+
+   if( !sync || !sync->valid )
+      return GST_CLOCK_TIME_NONE;
+
+   gint64 origin_ts = (gint64)ts - sync->offset;
+   if( origin_ts < 0 )
+      return 0;
+
+   return (GstClockTime)origin_ts;
+}
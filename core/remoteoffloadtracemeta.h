@@ -0,0 +1,124 @@
+/*
+ *  remoteoffloadtracemeta.h - Per-hop timestamps carried by traced buffers
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifndef __REMOTEOFFLOADTRACEMETA_H__
+#define __REMOTEOFFLOADTRACEMETA_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define REMOTEOFFLOAD_TRACE_META_API_TYPE (remote_offload_trace_meta_api_get_type())
+#define REMOTEOFFLOAD_TRACE_META_INFO (remote_offload_trace_meta_get_info())
+
+//Enough for a buffer to make a round trip through two levels of offload
+#define REMOTEOFFLOAD_TRACE_META_MAX_HOPS 24
+
+//Number of samples after which the clock offset estimate is replaced, even
+// if the new sample had a longer round trip.
+#define REMOTEOFFLOAD_TRACE_CLOCK_SYNC_WINDOW 256
+
+typedef enum
+{
+   REMOTEOFFLOAD_TRACE_STAGE_SOURCE = 0,  //the trace was started (e.g. by a bps latency-source)
+   REMOTEOFFLOAD_TRACE_STAGE_INGRESS,     //entered a remoteoffloadingress
+   REMOTEOFFLOAD_TRACE_STAGE_SEND,        //serialized by a BufferDataExchanger, to be sent
+   REMOTEOFFLOAD_TRACE_STAGE_RECEIVE,     //deserialized by the receiving BufferDataExchanger
+   REMOTEOFFLOAD_TRACE_STAGE_EGRESS,      //pushed out of a remoteoffloadegress
+   REMOTEOFFLOAD_TRACE_STAGE_SINK,        //the trace was ended (never stored in the meta)
+}RemoteOffloadTraceStage;
+
+typedef struct _RemoteOffloadTraceHop
+{
+   //gst_util_get_timestamp() of the process that 'domain' refers to
+   guint64 ts;
+   guint8 stage;  //RemoteOffloadTraceStage
+   //clock domain that ts was taken in. The trace starts in domain 0, and each
+   // time the buffer is sent over a comms channel the domain is incremented.
+   guint8 domain;
+   guint8 reserved[6];
+}RemoteOffloadTraceHop;
+
+//Hops are appended in the order that the buffer passed through them.
+typedef struct _RemoteOffloadTraceMeta
+{
+   GstMeta meta;
+
+   guint8 domain; //domain that the buffer is currently in
+   gboolean overflowed; //hops were dropped, as the buffer made more than MAX_HOPS
+   guint nhops;
+   RemoteOffloadTraceHop hops[REMOTEOFFLOAD_TRACE_META_MAX_HOPS];
+}RemoteOffloadTraceMeta;
+
+GType remote_offload_trace_meta_api_get_type (void);
+const GstMetaInfo *remote_offload_trace_meta_get_info (void);
+
+//Attach a new (empty) trace meta to buffer, which must be writable.
+RemoteOffloadTraceMeta *remote_offload_buffer_add_trace_meta(GstBuffer *buffer);
+
+#define remote_offload_buffer_get_trace_meta(b) \
+   ((RemoteOffloadTraceMeta *)gst_buffer_get_meta((b), REMOTEOFFLOAD_TRACE_META_API_TYPE))
+
+//Append a hop, timestamped now, to the meta of a traced buffer. Returns FALSE
+// (and marks the meta as overflowed) if it already has MAX_HOPS hops.
+gboolean remote_offload_trace_meta_add_hop(RemoteOffloadTraceMeta *meta,
+                                           RemoteOffloadTraceStage stage);
+
+//Stamp buffer with the given stage, if it's being traced. The buffer is made
+// writable first, so *buffer may be replaced.
+void remote_offload_buffer_trace_hop(GstBuffer **buffer,
+                                     RemoteOffloadTraceStage stage);
+
+//Short name of a stage, i.e. "ingress".
+const gchar *remote_offload_trace_stage_name(RemoteOffloadTraceStage stage);
+
+//Estimate of the offset between the clock of domain 1 and the clock of the
+// domain that the trace started in, taken NTP-style from the four
+// timestamps of a round trip (send, receive, send back, receive back). Of the
+// recent samples, the one with the shortest round trip is kept, as it's the
+// least skewed by queueing on one of the two legs.
+typedef struct _RemoteOffloadTraceClockSync
+{
+   gboolean valid;
+   gint64 offset;   //domain 1 clock - domain 0 clock, in ns
+   guint64 delay;   //round trip time of the sample, excluding the remote side, in ns
+   guint age;       //samples since the estimate was taken
+}RemoteOffloadTraceClockSync;
+
+void remote_offload_trace_clock_sync_reset(RemoteOffloadTraceClockSync *sync);
+
+//Update the estimate from the first round trip recorded in meta. Returns
+// FALSE if meta doesn't hold a round trip.
+gboolean remote_offload_trace_clock_sync_update(RemoteOffloadTraceClockSync *sync,
+                                                const RemoteOffloadTraceMeta *meta);
+
+//Convert a timestamp taken in the given domain to the clock of domain 0.
+// Even domains are assumed to be on the same host as domain 0 (i.e. the
+// buffer has made a round trip), and odd domains on the remote host, so only
+// one level of offload is corrected for. Returns GST_CLOCK_TIME_NONE if the
+// offset of that domain isn't known yet.
+GstClockTime remote_offload_trace_clock_sync_to_origin(const RemoteOffloadTraceClockSync *sync,
+                                                       guint8 domain,
+                                                       GstClockTime ts);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADTRACEMETA_H__ */
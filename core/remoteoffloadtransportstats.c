@@ -0,0 +1,148 @@
+/*
+ *  remoteoffloadtransportstats.c - Counters & latency histograms for comms channels
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include "remoteoffloadtransportstats.h"
+
+static void histogram_snapshot(RemoteOffloadStatsHistogram *histogram,
+                               RemoteOffloadStatsHistogram *snapshot)
+{
+   for( guint bin = 0; bin < REMOTEOFFLOAD_STATS_HISTOGRAM_BINS; bin++ )
+      snapshot->bins[bin] = (gsize)g_atomic_pointer_get(&histogram->bins[bin]);
+}
+
+void remote_offload_transport_stats_snapshot(RemoteOffloadTransportStats *stats,
+                                             RemoteOffloadTransportStats *snapshot)
+{
+   if( !stats || !snapshot )
+      return;
+
+   //Each field is read atomically, but not the set of them, so counters
+   // of a transfer that's in progress may be partially included.
+   snapshot->tx_messages = (gsize)g_atomic_pointer_get(&stats->tx_messages);
+   snapshot->tx_bytes = (gsize)g_atomic_pointer_get(&stats->tx_bytes);
+   snapshot->tx_segments = (gsize)g_atomic_pointer_get(&stats->tx_segments);
+   snapshot->rx_messages = (gsize)g_atomic_pointer_get(&stats->rx_messages);
+   snapshot->rx_bytes = (gsize)g_atomic_pointer_get(&stats->rx_bytes);
+   snapshot->rx_segments = (gsize)g_atomic_pointer_get(&stats->rx_segments);
+   snapshot->writelock_wait_us = (gsize)g_atomic_pointer_get(&stats->writelock_wait_us);
+   snapshot->inflight = g_atomic_int_get(&stats->inflight);
+   histogram_snapshot(&stats->send_latency, &snapshot->send_latency);
+   histogram_snapshot(&stats->receive_latency, &snapshot->receive_latency);
+   histogram_snapshot(&stats->response_rtt, &snapshot->response_rtt);
+}
+
+guint64 remote_offload_stats_histogram_percentile(const RemoteOffloadStatsHistogram *histogram,
+                                                  gdouble percentile)
+{
+   if( !histogram )
+      return 0;
+
+   guint64 total = 0;
+   for( guint bin = 0; bin < REMOTEOFFLOAD_STATS_HISTOGRAM_BINS; bin++ )
+      total += histogram->bins[bin];
+
+   if( !total )
+      return 0;
+
+   guint64 rank = (guint64)((CLAMP(percentile, 0., 100.) / 100.) * total);
+   if( rank < 1 )
+      rank = 1;
+
+   guint64 accumulated = 0;
+   guint bin = 0;
+   for( ; bin < REMOTEOFFLOAD_STATS_HISTOGRAM_BINS - 1; bin++ )
+   {
+      accumulated += histogram->bins[bin];
+      if( accumulated >= rank )
+         break;
+   }
+
+   //upper bound of the bin. The last bin is open-ended, so report its lower bound.
+   if( bin == REMOTEOFFLOAD_STATS_HISTOGRAM_BINS - 1 )
+      return G_GUINT64_CONSTANT(1) << (bin - 1);
+
+   return G_GUINT64_CONSTANT(1) << bin;
+}
+
+static void set_histogram_fields(GstStructure *structure,
+                                 const gchar *prefix,
+                                 const RemoteOffloadStatsHistogram *histogram)
+{
+   GValue array = G_VALUE_INIT;
+   g_value_init(&array, GST_TYPE_ARRAY);
+   for( guint bin = 0; bin < REMOTEOFFLOAD_STATS_HISTOGRAM_BINS; bin++ )
+   {
+      GValue count = G_VALUE_INIT;
+      g_value_init(&count, G_TYPE_UINT64);
+      g_value_set_uint64(&count, histogram->bins[bin]);
+      gst_value_array_append_and_take_value(&array, &count);
+   }
+
+   gchar *field = g_strdup_printf("%s-histogram", prefix);
+   gst_structure_take_value(structure, field, &array);
+   g_free(field);
+
+   static const struct
+   {
+      const gchar *suffix;
+      gdouble percentile;
+   }percentiles[] =
+   {
+      {"p50-us", 50.},
+      {"p90-us", 90.},
+      {"p99-us", 99.},
+   };
+
+   for( guint i = 0; i < G_N_ELEMENTS(percentiles); i++ )
+   {
+      field = g_strdup_printf("%s-%s", prefix, percentiles[i].suffix);
+      gst_structure_set(structure, field, G_TYPE_UINT64,
+                        remote_offload_stats_histogram_percentile(histogram,
+                                                                  percentiles[i].percentile),
+                        NULL);
+      g_free(field);
+   }
+}
+
+GstStructure *remote_offload_transport_stats_to_structure(const RemoteOffloadTransportStats *snapshot,
+                                                          const gchar *name)
+{
+   if( !snapshot || !name )
+      return NULL;
+
+   GstStructure *structure =
+         gst_structure_new(name,
+                           "tx-messages", G_TYPE_UINT64, (guint64)snapshot->tx_messages,
+                           "tx-bytes", G_TYPE_UINT64, (guint64)snapshot->tx_bytes,
+                           "tx-segments", G_TYPE_UINT64, (guint64)snapshot->tx_segments,
+                           "rx-messages", G_TYPE_UINT64, (guint64)snapshot->rx_messages,
+                           "rx-bytes", G_TYPE_UINT64, (guint64)snapshot->rx_bytes,
+                           "rx-segments", G_TYPE_UINT64, (guint64)snapshot->rx_segments,
+                           "writelock-wait-us", G_TYPE_UINT64, (guint64)snapshot->writelock_wait_us,
+                           "in-flight", G_TYPE_INT, snapshot->inflight,
+                           NULL);
+
+   set_histogram_fields(structure, "send-latency", &snapshot->send_latency);
+   set_histogram_fields(structure, "receive-latency", &snapshot->receive_latency);
+   set_histogram_fields(structure, "response-rtt", &snapshot->response_rtt);
+
+   return structure;
+}
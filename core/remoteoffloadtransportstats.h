@@ -0,0 +1,121 @@
+/*
+ *  remoteoffloadtransportstats.h - Counters & latency histograms for comms channels
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifndef __REMOTEOFFLOADTRANSPORTSTATS_H__
+#define __REMOTEOFFLOADTRANSPORTSTATS_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+//Latency histograms have power-of-2 bins, in microseconds. Bin 0 counts
+// latencies below 1us, bin i (i > 0) counts latencies within [2^(i-1), 2^i) us,
+// and the last bin counts everything from 2^(BINS-2) us (~8.4 s) up.
+#define REMOTEOFFLOAD_STATS_HISTOGRAM_BINS 25
+
+typedef struct _RemoteOffloadStatsHistogram
+{
+   gsize bins[REMOTEOFFLOAD_STATS_HISTOGRAM_BINS];
+}RemoteOffloadStatsHistogram;
+
+//Transport stats of one type of data transfer (i.e. buffers, queries, etc.) on
+// one comms channel. All fields are updated atomically, without locking, so
+// that they can be collected on the hot paths of the comms channel.
+typedef struct _RemoteOffloadTransportStats
+{
+   gsize tx_messages;
+   gsize tx_bytes;
+   gsize tx_segments;
+   gsize rx_messages;
+   gsize rx_bytes;
+   gsize rx_segments;
+
+   //total time that writers waited for the comms to be free
+   gsize writelock_wait_us;
+
+   //number of responses currently being waited on
+   gint inflight;
+
+   //time taken to write a transfer (including the writelock wait)
+   RemoteOffloadStatsHistogram send_latency;
+
+   //time from a transfer being received, to it being dispatched to its
+   // data exchanger
+   RemoteOffloadStatsHistogram receive_latency;
+
+   //time from a transfer being written, to its response being received
+   RemoteOffloadStatsHistogram response_rtt;
+}RemoteOffloadTransportStats;
+
+static inline void remote_offload_stats_histogram_add(RemoteOffloadStatsHistogram *histogram,
+                                                      gint64 usec)
+{
+   guint bin = 0;
+   if( usec > 0 )
+   {
+      bin = g_bit_storage((gulong)usec);
+      if( bin >= REMOTEOFFLOAD_STATS_HISTOGRAM_BINS )
+         bin = REMOTEOFFLOAD_STATS_HISTOGRAM_BINS - 1;
+   }
+
+   g_atomic_pointer_add(&histogram->bins[bin], 1);
+}
+
+static inline void remote_offload_transport_stats_add_tx(RemoteOffloadTransportStats *stats,
+                                                         gsize bytes,
+                                                         guint nsegments,
+                                                         gint64 send_latency_us,
+                                                         gint64 writelock_wait_us)
+{
+   g_atomic_pointer_add(&stats->tx_messages, 1);
+   g_atomic_pointer_add(&stats->tx_bytes, bytes);
+   g_atomic_pointer_add(&stats->tx_segments, nsegments);
+   g_atomic_pointer_add(&stats->writelock_wait_us, writelock_wait_us);
+   remote_offload_stats_histogram_add(&stats->send_latency, send_latency_us);
+}
+
+static inline void remote_offload_transport_stats_add_rx(RemoteOffloadTransportStats *stats,
+                                                         gsize bytes,
+                                                         guint nsegments)
+{
+   g_atomic_pointer_add(&stats->rx_messages, 1);
+   g_atomic_pointer_add(&stats->rx_bytes, bytes);
+   g_atomic_pointer_add(&stats->rx_segments, nsegments);
+}
+
+//Take a (non-atomic) copy of stats
+void remote_offload_transport_stats_snapshot(RemoteOffloadTransportStats *stats,
+                                             RemoteOffloadTransportStats *snapshot);
+
+//Estimate the given percentile (0-100) of a histogram, as the upper bound (in
+// microseconds) of the bin it falls in. Returns 0 for an empty histogram.
+guint64 remote_offload_stats_histogram_percentile(const RemoteOffloadStatsHistogram *histogram,
+                                                  gdouble percentile);
+
+//Convert a snapshot into a GstStructure named 'name', with the counters,
+// the histograms (as GstValueArray's of bin counts) and their
+// 50th / 90th / 99th percentiles.
+GstStructure *remote_offload_transport_stats_to_structure(const RemoteOffloadTransportStats *snapshot,
+                                                          const gchar *name);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADTRANSPORTSTATS_H__ */
@@ -21,6 +21,7 @@
  *  Boston, MA 02110-1301 USA
  */
 #include "remoteoffloadutils.h"
+#include "remoteoffloadcommsio.h"
 
 static void destroy_garray_element(gpointer data)
 {
@@ -126,3 +127,61 @@ GArray *gst_bin_get_by_factory_type(GstBin *bin, gchar **factory_name_array)
    return elem_list;
 }
 
+
+GstMemory *remote_offload_variant_to_mem(GVariant *variant)
+{
+   if( !variant )
+      return NULL;
+
+   gsize size = g_variant_get_size(variant);
+   gconstpointer data = g_variant_get_data(variant);
+   if( !size || !data )
+      return NULL;
+
+   GstMemory *mem = gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
+                                           (gpointer)data,
+                                           size,
+                                           0,
+                                           size,
+                                           g_variant_ref(variant),
+                                           (GDestroyNotify)g_variant_unref);
+
+   //GVariant's are immutable, so the data can't change underneath the peer.
+   return remote_offload_comms_io_make_mem_shareable(mem);
+}
+
+typedef struct
+{
+   GstMemory *mem;
+   GstMapInfo mapInfo;
+}MappedMem;
+
+static void mapped_mem_free(gpointer data)
+{
+   MappedMem *mapped = (MappedMem *)data;
+   gst_memory_unmap(mapped->mem, &mapped->mapInfo);
+   gst_memory_unref(mapped->mem);
+   g_free(mapped);
+}
+
+GVariant *remote_offload_mem_to_byte_variant(GstMemory *mem)
+{
+   if( !mem )
+      return NULL;
+
+   MappedMem *mapped = g_malloc(sizeof(MappedMem));
+   mapped->mem = gst_memory_ref(mem);
+   if( !gst_memory_map(mapped->mem, &mapped->mapInfo, GST_MAP_READ) )
+   {
+      gst_memory_unref(mapped->mem);
+      g_free(mapped);
+      return NULL;
+   }
+
+   return g_variant_new_from_data(G_VARIANT_TYPE_BYTESTRING,
+                                  mapped->mapInfo.data,
+                                  mapped->mapInfo.size,
+                                  TRUE,
+                                  mapped_mem_free,
+                                  mapped);
+}
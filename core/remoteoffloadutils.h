@@ -40,6 +40,17 @@ G_BEGIN_DECLS
 // NULL is only returned for error cases.
 GArray *gst_bin_get_by_factory_type(GstBin *bin, gchar **);
 
+//Wrap the data of a fixed-size-element array GVariant (i.e. "ay") in a
+// (read-only) GstMemory, without copying it. The memory holds a
+// reference to variant for as long as it's alive.
+// Returns NULL if variant is empty.
+GstMemory *remote_offload_variant_to_mem(GVariant *variant);
+
+//Create a byte array ("ay") GVariant directly on top of the data of mem,
+// without copying it. The variant keeps mem mapped (and referenced) until
+// it's freed. Returns a floating reference.
+GVariant *remote_offload_mem_to_byte_variant(GstMemory *mem);
+
 G_END_DECLS
 
 #endif
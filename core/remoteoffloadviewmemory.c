@@ -0,0 +1,246 @@
+/*
+ *  remoteoffloadviewmemory.c - Recycled read-only views of GstMemory's
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  Every buffer memory that is sent zero-copy, and every chunk / stripe of a
+ *   large data segment, is handed to the CommsIO as a memory that refers to
+ *   (part of) the original one. gst_memory_share() would allocate a new one each
+ *   time, so views are recycled using the GstMiniObject dispose hook instead, in
+ *   the same way that RemoteOffloadMemPool recycles its blocks.
+ *
+ *  The memory underneath a view stays mapped for reading for as long as the
+ *   view is in use, and is released as soon as the view is.
+ */
+#include "remoteoffloadviewmemory.h"
+
+GST_DEBUG_CATEGORY_STATIC (view_memory_debug);
+#define GST_CAT_DEFAULT view_memory_debug
+
+#define REMOTEOFFLOAD_VIEW_MEMORY_TYPE "RemoteOffloadViewMemory"
+
+//max number of released views kept around for reuse
+#define VIEW_MEMORY_MAX_FREE 256
+
+typedef struct
+{
+   GstMemory mem;
+   GstMapInfo parentmap; //mem.parent, mapped for reading while the view is in use
+   gboolean bshareable;
+   GList link;           //within view_memory_free, while released
+}RemoteOffloadViewMemory;
+
+typedef struct
+{
+   GstAllocator parent;
+}RemoteOffloadViewAllocator;
+
+typedef struct
+{
+   GstAllocatorClass parent_class;
+}RemoteOffloadViewAllocatorClass;
+
+static GType remote_offload_view_allocator_get_type(void);
+G_DEFINE_TYPE(RemoteOffloadViewAllocator, remote_offload_view_allocator, GST_TYPE_ALLOCATOR);
+
+static GstAllocator *_view_allocator = NULL;
+
+//released views, linked through their own 'link'
+G_LOCK_DEFINE_STATIC(view_memory_free);
+static GQueue view_memory_free = G_QUEUE_INIT;
+
+//Called when the last reference to a view is dropped.
+static gboolean view_memory_dispose(GstMiniObject *obj)
+{
+   RemoteOffloadViewMemory *vmem = (RemoteOffloadViewMemory *)obj;
+   GstMemory *mem = GST_MEMORY_CAST(vmem);
+
+   //release the memory underneath right away, as gst_memory_share'd memory would be
+   gst_memory_unmap(mem->parent, &vmem->parentmap);
+   gst_memory_unlock(mem->parent, GST_LOCK_FLAG_EXCLUSIVE);
+   gst_memory_unref(mem->parent);
+   mem->parent = NULL;
+
+   gboolean do_free = TRUE;
+   G_LOCK(view_memory_free);
+   if( view_memory_free.length < VIEW_MEMORY_MAX_FREE )
+   {
+      //resurrect the view, for the next remote_offload_view_memory_new
+      gst_memory_ref(mem);
+      g_queue_push_tail_link(&view_memory_free, &vmem->link);
+      do_free = FALSE;
+   }
+   G_UNLOCK(view_memory_free);
+
+   return do_free;
+}
+
+static GstMemory *view_memory_alloc(GstAllocator *allocator,
+                                    gsize size,
+                                    GstAllocationParams *params)
+{
+   //views are only created by remote_offload_view_memory_new
+   return NULL;
+}
+
+static void view_memory_free_func(GstAllocator *allocator, GstMemory *mem)
+{
+   g_slice_free(RemoteOffloadViewMemory, (RemoteOffloadViewMemory *)mem);
+}
+
+static gpointer view_memory_map(GstMemory *mem, gsize maxsize, GstMapFlags flags)
+{
+   return ((RemoteOffloadViewMemory *)mem)->parentmap.data;
+}
+
+static void view_memory_unmap(GstMemory *mem)
+{
+   //the memory underneath stays mapped until the view is released
+}
+
+static GstMemory *view_memory_share(GstMemory *mem, gssize offset, gssize size)
+{
+   if( size == -1 )
+      size = mem->size > offset ? mem->size - offset : 0;
+
+   return remote_offload_view_memory_new(mem, offset, size,
+                                         ((RemoteOffloadViewMemory *)mem)->bshareable);
+}
+
+static GstMemory *view_memory_copy(GstMemory *mem, gssize offset, gssize size)
+{
+   if( size == -1 )
+      size = mem->size > offset ? mem->size - offset : 0;
+
+   return gst_memory_copy(mem->parent, mem->offset + offset, size);
+}
+
+static gboolean view_memory_is_span(GstMemory *mem1, GstMemory *mem2, gsize *offset)
+{
+   return FALSE;
+}
+
+static void
+remote_offload_view_allocator_class_init (RemoteOffloadViewAllocatorClass *klass)
+{
+   GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+   allocator_class->alloc = view_memory_alloc;
+   allocator_class->free = view_memory_free_func;
+}
+
+static void
+remote_offload_view_allocator_init (RemoteOffloadViewAllocator *self)
+{
+   GstAllocator *allocator = GST_ALLOCATOR_CAST (self);
+
+   allocator->mem_type = REMOTEOFFLOAD_VIEW_MEMORY_TYPE;
+   allocator->mem_map = view_memory_map;
+   allocator->mem_unmap = view_memory_unmap;
+   allocator->mem_share = view_memory_share;
+   allocator->mem_copy = view_memory_copy;
+   allocator->mem_is_span = view_memory_is_span;
+
+   GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+static void view_allocator_ensure()
+{
+   static gsize initialized = 0;
+   if( g_once_init_enter(&initialized) )
+   {
+      GST_DEBUG_CATEGORY_INIT (view_memory_debug, "remoteoffloadviewmemory", 0,
+                               "debug category for RemoteOffloadViewMemory");
+      _view_allocator = g_object_new(remote_offload_view_allocator_get_type(), NULL);
+      gst_object_ref_sink(_view_allocator);
+      g_once_init_leave(&initialized, 1);
+   }
+}
+
+GstMemory *remote_offload_view_memory_new(GstMemory *mem,
+                                          gsize offset,
+                                          gsize size,
+                                          gboolean bshareable)
+{
+   if( !mem )
+      return NULL;
+
+   view_allocator_ensure();
+
+   //a view of a view refers to the memory underneath both
+   if( remote_offload_view_memory_is_view(mem) )
+   {
+      offset += mem->offset;
+      mem = mem->parent;
+   }
+
+   G_LOCK(view_memory_free);
+   GList *link = g_queue_pop_head_link(&view_memory_free);
+   G_UNLOCK(view_memory_free);
+
+   RemoteOffloadViewMemory *vmem;
+   if( link )
+   {
+      //gst_memory_init takes another reference to the allocator below
+      vmem = (RemoteOffloadViewMemory *)link->data;
+      gst_object_unref(GST_MEMORY_CAST(vmem)->allocator);
+   }
+   else
+   {
+      vmem = g_slice_new(RemoteOffloadViewMemory);
+      vmem->link.data = vmem;
+      vmem->link.prev = NULL;
+      vmem->link.next = NULL;
+   }
+
+   if( !gst_memory_map(mem, &vmem->parentmap, GST_MAP_READ) )
+   {
+      GST_ERROR("Error mapping memory %p for reading", mem);
+      g_slice_free(RemoteOffloadViewMemory, vmem);
+      return NULL;
+   }
+
+   if( offset + size > vmem->parentmap.size )
+   {
+      GST_ERROR("View of %"G_GSIZE_FORMAT" bytes at %"G_GSIZE_FORMAT" is out of range "
+                "of a memory of %"G_GSIZE_FORMAT" bytes", size, offset, vmem->parentmap.size);
+      gst_memory_unmap(mem, &vmem->parentmap);
+      g_slice_free(RemoteOffloadViewMemory, vmem);
+      return NULL;
+   }
+
+   //like gst_memory_share(), this locks mem so that it can't be written to
+   gst_memory_init(GST_MEMORY_CAST(vmem), GST_MEMORY_FLAG_READONLY, _view_allocator, mem,
+                   vmem->parentmap.size, 0, offset, size);
+   GST_MINI_OBJECT_CAST(vmem)->dispose = view_memory_dispose;
+   vmem->bshareable = bshareable;
+
+   return GST_MEMORY_CAST(vmem);
+}
+
+gboolean remote_offload_view_memory_is_view(GstMemory *mem)
+{
+   return mem && _view_allocator && (mem->allocator == _view_allocator);
+}
+
+gboolean remote_offload_view_memory_is_shareable(GstMemory *mem)
+{
+   return remote_offload_view_memory_is_view(mem) &&
+          ((RemoteOffloadViewMemory *)mem)->bshareable;
+}
@@ -0,0 +1,52 @@
+/*
+ *  remoteoffloadviewmemory.h - Recycled read-only views of GstMemory's
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REMOTEOFFLOADVIEWMEMORY_H__
+#define __REMOTEOFFLOADVIEWMEMORY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+//A view memory refers to a range of another (mappable) GstMemory, in the same
+// way as a memory shared from it with gst_memory_share(): it's read-only, and
+// the memory that it refers to can't be written to for as long as the view
+// exists. Unlike gst_memory_share(), views are recycled once released, so
+// creating one doesn't allocate once streaming.
+
+//Create a view of 'size' bytes of mem, starting at 'offset'. If mem is itself a
+// view, the new view refers to the memory underneath it. bshareable is kept
+// along with the view (see remote_offload_view_memory_is_shareable).
+// Returns NULL if mem can't be mapped for reading.
+GstMemory *remote_offload_view_memory_new(GstMemory *mem,
+                                          gsize offset,
+                                          gsize size,
+                                          gboolean bshareable);
+
+gboolean remote_offload_view_memory_is_view(GstMemory *mem);
+
+//Returns TRUE if mem is a view that was created as shareable
+gboolean remote_offload_view_memory_is_shareable(GstMemory *mem);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOADVIEWMEMORY_H__ */
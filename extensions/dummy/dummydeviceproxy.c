@@ -22,6 +22,7 @@
 #include "dummydeviceproxy.h"
 #include "remoteoffloaddeviceproxy.h"
 #include "remoteoffloadcommsio_dummy.h"
+#include "remoteoffloadcommsioreplay.h"
 #include "remoteoffloadclientserverutil.h"
 #include "gstremoteoffloadpipeline.h"
 
@@ -31,6 +32,14 @@ typedef struct
   GOptionContext *option_context;
   GArray *option_entries; //array of GOptionEntry's
   GThread *remoteoffloadinstance_thread;
+  gint nstripes;
+  gchar *compression_name;
+  gint compression_threshold;
+  gchar *replay_file;
+  gdouble replay_speed;
+
+  //parsed from the options above
+  RemoteOffloadCompressionParams compression;
 
 } DummyDeviceProxyPrivate;
 
@@ -90,6 +99,87 @@ static gpointer DummyRemotePipelineInstanceThread (GHashTable *id_to_channel_has
 
    return NULL;
 }
+
+//Create nstripes connected pairs of dummy commsio's, and append them as stripes of
+// channel_id to stripe_pairs_host / stripe_pairs_remote. The created commsio's
+// are also added to stripe_commsios, which holds a reference to them.
+static gboolean dummy_deviceproxy_create_stripes(DummyDeviceProxy *self,
+                                                 gint channel_id,
+                                                 GArray *stripe_pairs_host,
+                                                 GArray *stripe_pairs_remote,
+                                                 GPtrArray *stripe_commsios)
+{
+   for( gint stripei = 0; stripei < self->priv.nstripes; stripei++ )
+   {
+      RemoteOffloadCommsIO *stripe_host =
+            (RemoteOffloadCommsIO *)remote_offload_comms_io_dummy_new();
+      RemoteOffloadCommsIO *stripe_remote =
+            (RemoteOffloadCommsIO *)remote_offload_comms_io_dummy_new();
+      if( !stripe_host || !stripe_remote )
+      {
+         GST_ERROR_OBJECT (self, "Error creating RemoteOffloadCommsIODummy instance for stripe");
+         if( stripe_host ) g_object_unref(stripe_host);
+         if( stripe_remote ) g_object_unref(stripe_remote);
+         return FALSE;
+      }
+
+      g_ptr_array_add(stripe_commsios, stripe_host);
+      g_ptr_array_add(stripe_commsios, stripe_remote);
+
+      if( !connect_dummyio_pair((RemoteOffloadCommsIODummy*)stripe_host,
+                                (RemoteOffloadCommsIODummy*)stripe_remote) )
+      {
+         GST_ERROR_OBJECT (self, "Error in connect_dummyio_pair() for stripe");
+         return FALSE;
+      }
+
+      ChannelIdCommsIOPair pair_host = {channel_id, stripe_host, TRUE};
+      g_array_append_val(stripe_pairs_host, pair_host);
+      ChannelIdCommsIOPair pair_remote = {channel_id, stripe_remote, TRUE};
+      g_array_append_val(stripe_pairs_remote, pair_remote);
+   }
+
+   return TRUE;
+}
+
+//Instead of spawning a remote pipeline, connect the channels to a replay of
+// what the remote pipeline sent in a recorded (host-side) session.
+static GHashTable* dummy_deviceproxy_generate_replay(DummyDeviceProxy *self,
+                                                     GArray *commschannelrequests)
+{
+   RemoteOffloadCommsIO *commsio_replay =
+         (RemoteOffloadCommsIO *)remote_offload_comms_io_replay_new(self->priv.replay_file,
+                                                                    self->priv.replay_speed);
+   if( !commsio_replay )
+   {
+      GST_ERROR_OBJECT (self, "Error creating RemoteOffloadCommsIOReplay for %s",
+                        self->priv.replay_file);
+      return NULL;
+   }
+
+   CommsChannelRequest *requests = (CommsChannelRequest *)commschannelrequests->data;
+   GArray *id_commsio_pair_array = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
+   for( guint requesti = 0; requesti < commschannelrequests->len; requesti++ )
+   {
+      ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio_replay,
+                                   FALSE, self->priv.compression};
+      g_array_append_val(id_commsio_pair_array, pair);
+   }
+
+   GHashTable *id_to_channel_hash =
+         id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array);
+   if( !id_to_channel_hash )
+   {
+      GST_ERROR_OBJECT (self, "Error in id_commsio_pair_array_to_id_to_channel_hash"
+                        "(id_commsio_pair_array_replay)");
+   }
+
+   g_array_free(id_commsio_pair_array, TRUE);
+   g_object_unref(commsio_replay);
+
+   return id_to_channel_hash;
+}
+
 //Given a GArray of CommsChannelRequest's,
 // return a channel_id(gint) to RemoteOffloadCommsChannel*
 static GHashTable* dummy_deviceproxy_generate(RemoteOffloadDeviceProxy *proxy,
@@ -105,21 +195,41 @@ static GHashTable* dummy_deviceproxy_generate(RemoteOffloadDeviceProxy *proxy,
 
    DummyDeviceProxy *self = DEVICEPROXY_DUMMY (proxy);
 
+   if( self->priv.replay_file )
+      return dummy_deviceproxy_generate_replay(self, commschannelrequests);
+
    GHashTable *id_to_channel_hash_host = NULL;
 
+   //All channels share one comms, which the stripes (if any) are attached to.
+   CommsChannelRequest *requests = (CommsChannelRequest *)commschannelrequests->data;
+   GArray *stripe_pairs_host = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
+   GArray *stripe_pairs_remote = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
+   GPtrArray *stripe_commsios = g_ptr_array_new_with_free_func(g_object_unref);
+   if( !dummy_deviceproxy_create_stripes(self, requests[0].channel_id,
+                                         stripe_pairs_host, stripe_pairs_remote,
+                                         stripe_commsios) )
+   {
+      g_array_free(stripe_pairs_host, TRUE);
+      g_array_free(stripe_pairs_remote, TRUE);
+      g_ptr_array_free(stripe_commsios, TRUE);
+      return NULL;
+   }
+
    //host-side
    RemoteOffloadCommsIO *commsio_host = (RemoteOffloadCommsIO *)remote_offload_comms_io_dummy_new();
    if( commsio_host )
    {
-      CommsChannelRequest *requests = (CommsChannelRequest *)commschannelrequests->data;
       GArray *id_commsio_pair_array_host = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
       for( guint requesti = 0; requesti < commschannelrequests->len; requesti++ )
       {
-         ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio_host};
+         ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio_host,
+                                      FALSE, self->priv.compression};
          g_array_append_val(id_commsio_pair_array_host, pair);
          GST_INFO_OBJECT (self, "id_commsio_pair_array_host[%d] = (%d,%p)",
                           requesti, pair.channel_id, pair.commsio);
       }
+      g_array_append_vals(id_commsio_pair_array_host,
+                          stripe_pairs_host->data, stripe_pairs_host->len);
 
       id_to_channel_hash_host =
             id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array_host);
@@ -142,11 +252,14 @@ static GHashTable* dummy_deviceproxy_generate(RemoteOffloadDeviceProxy *proxy,
                      g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
                for( guint requesti = 0; requesti < commschannelrequests->len; requesti++ )
                {
-                  ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio_remote};
+                  ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio_remote,
+                                               FALSE, self->priv.compression};
                   g_array_append_val(id_commsio_pair_array_remote, pair);
                   GST_INFO_OBJECT (self, "id_commsio_pair_array_remote[%d] = (%d,%p)",
                                    requesti, pair.channel_id, pair.commsio);
                }
+               g_array_append_vals(id_commsio_pair_array_remote,
+                                   stripe_pairs_remote->data, stripe_pairs_remote->len);
 
                GHashTable *id_to_channel_hash_remote =
                      id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array_remote);
@@ -212,6 +325,11 @@ static GHashTable* dummy_deviceproxy_generate(RemoteOffloadDeviceProxy *proxy,
       GST_ERROR_OBJECT (self, "Error creating host-side RemoteOffloadCommsIODummy instance");
    }
 
+   //the comms objects hold their own references to the stripes
+   g_array_free(stripe_pairs_host, TRUE);
+   g_array_free(stripe_pairs_remote, TRUE);
+   g_ptr_array_free(stripe_commsios, TRUE);
+
    return id_to_channel_hash_host;
 }
 
@@ -224,6 +342,47 @@ static gboolean dummy_deviceproxy_set_arguments(RemoteOffloadDeviceProxy *proxy,
    if( !arguments_string )
       return TRUE;
 
+   DummyDeviceProxy *self = DEVICEPROXY_DUMMY (proxy);
+
+   if( !remote_offload_deviceproxy_parse_arguments_string(self->priv.option_context,
+                                                          arguments_string) )
+      return FALSE;
+
+   if( self->priv.nstripes < 0 )
+   {
+      GST_ERROR_OBJECT (self, "Invalid stripes=%d", self->priv.nstripes);
+      return FALSE;
+   }
+
+   //the stripes of the recorded session aren't part of its trace
+   if( self->priv.replay_file && self->priv.nstripes )
+   {
+      GST_ERROR_OBJECT (self, "replay can't be combined with stripes");
+      return FALSE;
+   }
+
+   //both "sides" live in this process, so there's nothing to negotiate
+   if( self->priv.compression_name )
+   {
+      if( !remote_offload_compression_codec_from_string(self->priv.compression_name,
+                                                        &self->priv.compression.codec) ||
+          (self->priv.compression_threshold < 0) )
+      {
+         GST_ERROR_OBJECT (self, "Invalid compression=%s, compression-threshold=%d",
+                           self->priv.compression_name, self->priv.compression_threshold);
+         return FALSE;
+      }
+
+      if( !remote_offload_compression_codec_supported(self->priv.compression.codec) )
+      {
+         GST_WARNING_OBJECT (self, "%s compression isn't supported by this build. "
+                             "Continuing without compression.", self->priv.compression_name);
+         self->priv.compression.codec = REMOTEOFFLOAD_COMPRESSION_NONE;
+      }
+
+      self->priv.compression.threshold = (guint32)self->priv.compression_threshold;
+   }
+
    return TRUE;
 }
 
@@ -245,6 +404,8 @@ dummy_device_proxy_finalize (GObject *gobject)
      self->priv.remoteoffloadinstance_thread = NULL;
   }
 
+  g_free(self->priv.compression_name);
+  g_free(self->priv.replay_file);
   g_option_context_free(self->priv.option_context);
   g_array_free(self->priv.option_entries, TRUE);
   G_OBJECT_CLASS (dummy_device_proxy_parent_class)->finalize (gobject);
@@ -267,6 +428,47 @@ dummy_device_proxy_init (DummyDeviceProxy *self)
    g_option_context_set_summary(self->priv.option_context,
                                 "Dummy Comms Channel Generator Options:");
 
+   self->priv.nstripes = 0;
+   GOptionEntry stripes_entry =
+     { "stripes", 0, 0, G_OPTION_ARG_INT,
+     &self->priv.nstripes,
+     "Number of additional dummy connections that large transfers are striped across",
+     NULL};
+   g_array_append_val(self->priv.option_entries, stripes_entry);
+
+   self->priv.compression.codec = REMOTEOFFLOAD_COMPRESSION_NONE;
+   self->priv.compression.threshold = REMOTEOFFLOAD_COMPRESSION_DEFAULT_THRESHOLD;
+   self->priv.compression_name = NULL;
+   GOptionEntry compression_entry =
+     { "compression", 0, 0, G_OPTION_ARG_STRING,
+     &self->priv.compression_name,
+     "Compress large data segments with the given codec: none, lz4 or zstd (default=none)",
+     NULL};
+   g_array_append_val(self->priv.option_entries, compression_entry);
+
+   self->priv.compression_threshold = REMOTEOFFLOAD_COMPRESSION_DEFAULT_THRESHOLD;
+   GOptionEntry compression_threshold_entry =
+     { "compression-threshold", 0, 0, G_OPTION_ARG_INT,
+     &self->priv.compression_threshold,
+     "Only compress data segments of at least this many bytes (default=4096)", NULL};
+   g_array_append_val(self->priv.option_entries, compression_threshold_entry);
+
+   self->priv.replay_file = NULL;
+   GOptionEntry replay_entry =
+     { "replay", 0, 0, G_OPTION_ARG_FILENAME,
+     &self->priv.replay_file,
+     "Instead of running a remote pipeline, replay the traffic that it sent, "
+     "from a host-side trace recorded with GST_REMOTEOFFLOAD_RECORD", NULL};
+   g_array_append_val(self->priv.option_entries, replay_entry);
+
+   self->priv.replay_speed = 1.0;
+   GOptionEntry replay_speed_entry =
+     { "replay-speed", 0, 0, G_OPTION_ARG_DOUBLE,
+     &self->priv.replay_speed,
+     "Rate to replay at, relative to the recording. 0=as fast as possible (default=1.0)",
+     NULL};
+   g_array_append_val(self->priv.option_entries, replay_speed_entry);
+
    GOptionEntry null_entry = { NULL };
    g_array_append_val(self->priv.option_entries, null_entry);
 
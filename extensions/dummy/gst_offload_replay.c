@@ -0,0 +1,126 @@
+/*
+ *  gst_offload_replay.c - Replays a recorded server-side session into a remote pipeline
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <gst/gst.h>
+#include "remoteoffloadclientserverutil.h"
+#include "gstremoteoffloadpipeline.h"
+#include "remoteoffloadcommsioreplay.h"
+
+GST_DEBUG_CATEGORY_STATIC (remote_offload_replay_debug);
+#define GST_CAT_DEFAULT remote_offload_replay_debug
+
+int main(int argc, char *argv[])
+{
+   gchar *tracefile = NULL;
+   gdouble speed = 1.0;
+
+   GOptionEntry entries[] =
+   {
+      { "trace", 't', 0, G_OPTION_ARG_FILENAME, &tracefile,
+        "Trace of a server-side session, recorded with GST_REMOTEOFFLOAD_RECORD", NULL },
+      { "speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed,
+        "Rate to replay at, relative to the recording. 0=as fast as possible (default=1.0)",
+        NULL },
+      { NULL }
+   };
+
+   GOptionContext *context = g_option_context_new(" - Remote Offload Session Replay");
+   g_option_context_add_main_entries(context, entries, NULL);
+   g_option_context_add_group(context, gst_init_get_option_group());
+
+   GError *error = NULL;
+   if( !g_option_context_parse(context, &argc, &argv, &error) )
+   {
+      g_print("Error parsing options: %s\n", error ? error->message : "unknown");
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return -1;
+   }
+   g_option_context_free(context);
+
+   GST_DEBUG_CATEGORY_INIT (remote_offload_replay_debug,
+                               "remoteoffloadreplay", 0,
+                             "debug category for Remote Offload Session Replay");
+
+   if( !tracefile )
+   {
+      g_print("--trace is required\n");
+      return -1;
+   }
+
+   RemoteOffloadCommsIOReplay *commsio = remote_offload_comms_io_replay_new(tracefile, speed);
+   if( !commsio )
+   {
+      g_print("Unable to load trace %s\n", tracefile);
+      g_free(tracefile);
+      return -1;
+   }
+
+   GArray *channel_ids = remote_offload_comms_io_replay_get_channel_ids(commsio);
+   GArray *id_commsio_pair_array = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
+   for( guint i = 0; i < channel_ids->len; i++ )
+   {
+      ChannelIdCommsIOPair pair = {g_array_index(channel_ids, gint, i),
+                                   (RemoteOffloadCommsIO *)commsio, FALSE};
+      g_array_append_val(id_commsio_pair_array, pair);
+   }
+   g_array_free(channel_ids, TRUE);
+
+   int ret = -1;
+   GHashTable *id_to_channel_hash =
+         id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array);
+   if( id_to_channel_hash )
+   {
+      RemoteOffloadPipeline *pPipeline =
+            remote_offload_pipeline_new(NULL, id_to_channel_hash);
+
+      if( pPipeline )
+      {
+         gint64 start_time = g_get_monotonic_time();
+
+         if( remote_offload_pipeline_run(pPipeline) )
+            ret = 0;
+         else
+            GST_ERROR("remote_offload_pipeline_run failed");
+
+         g_print("Replayed %s in %.3f s\n", tracefile,
+                 (g_get_monotonic_time() - start_time) / 1000000.);
+
+         g_object_unref(pPipeline);
+      }
+      else
+      {
+         GST_ERROR("Error in remote_offload_pipeline_new");
+      }
+
+      g_hash_table_unref(id_to_channel_hash);
+   }
+   else
+   {
+      GST_ERROR("Error in id_commsio_pair_array_to_id_to_channel_hash");
+   }
+
+   g_array_free(id_commsio_pair_array, TRUE);
+   g_object_unref(commsio);
+   g_free(tracefile);
+
+   return ret;
+}
@@ -27,10 +27,14 @@
 #else
   #include <string.h>
 #endif
+
+//Each entry holds a reference to one written memory, mapped for reading.
+// Entries are handed to the peer as-is, so a memory marked as shareable
+// by the writer reaches the reader without being copied.
 typedef struct
 {
-   guint8 *data;
-   guint64 size;
+   GstMemory *mem;
+   GstMapInfo map;
 }QueueEntry;
 
 /* Private structure definition. */
@@ -70,6 +74,56 @@ G_DEFINE_TYPE_WITH_CODE (RemoteOffloadCommsIODummy, remote_offload_comms_io_dumm
                          "remoteoffloadcommsiodummy", 0,
                          "debug category for RemoteOffloadCommsIODummy"))
 
+static QueueEntry *queue_entry_new(GstMemory *mem)
+{
+   QueueEntry *entry = g_malloc(sizeof(QueueEntry));
+   if( !gst_memory_map(mem, &entry->map, GST_MAP_READ) )
+   {
+      GST_ERROR("Error mapping memory for reading");
+      g_free(entry);
+      return NULL;
+   }
+
+   entry->mem = mem;
+
+   return entry;
+}
+
+static void queue_entry_free(QueueEntry *entry)
+{
+   gst_memory_unmap(entry->mem, &entry->map);
+   gst_memory_unref(entry->mem);
+   g_free(entry);
+}
+
+//Return the entry at the head of the receive queue, waiting for one
+// if the queue is empty. Returns NULL if shutdown was asserted.
+static QueueEntry *wait_for_entry(RemoteOffloadCommsIODummy *pCommsIODummy,
+                                  gboolean *bShutdown)
+{
+   g_mutex_lock(&pCommsIODummy->priv.datareceivedmutex);
+   QueueEntry *entry = g_queue_peek_head(pCommsIODummy->priv.dataReceivedQueue);
+   if( !entry && !pCommsIODummy->priv.shutdownAsserted )
+   {
+      //no notification buf's in the queue. wait for one.
+      g_cond_wait (&pCommsIODummy->priv.datareceivedcond, &pCommsIODummy->priv.datareceivedmutex);
+
+      entry = g_queue_peek_head(pCommsIODummy->priv.dataReceivedQueue);
+   }
+   *bShutdown = pCommsIODummy->priv.shutdownAsserted;
+   g_mutex_unlock(&pCommsIODummy->priv.datareceivedmutex);
+
+   return entry;
+}
+
+static void pop_entry(RemoteOffloadCommsIODummy *pCommsIODummy)
+{
+   pCommsIODummy->priv.currentOffset = 0;
+   g_mutex_lock(&pCommsIODummy->priv.datareceivedmutex);
+   g_queue_pop_head(pCommsIODummy->priv.dataReceivedQueue);
+   g_mutex_unlock(&pCommsIODummy->priv.datareceivedmutex);
+}
+
 static RemoteOffloadCommsIOResult
 remote_offload_comms_io_dummy_read(RemoteOffloadCommsIO *commsio,
                                    guint8 *buf,
@@ -83,18 +137,8 @@ remote_offload_comms_io_dummy_read(RemoteOffloadCommsIO *commsio,
   guint64 bytes_to_receive = size;
   while(bytes_to_receive > 0)
   {
-     g_mutex_lock(&pCommsIODummy->priv.datareceivedmutex);
-     gboolean bShutdown = pCommsIODummy->priv.shutdownAsserted;
-     QueueEntry *entry = g_queue_peek_head(pCommsIODummy->priv.dataReceivedQueue);
-     if( !entry && !bShutdown )
-     {
-        //no notification buf's in the queue. wait for one.
-        g_cond_wait (&pCommsIODummy->priv.datareceivedcond, &pCommsIODummy->priv.datareceivedmutex);
-
-        entry = g_queue_peek_head(pCommsIODummy->priv.dataReceivedQueue);
-     }
-     bShutdown = pCommsIODummy->priv.shutdownAsserted;
-     g_mutex_unlock(&pCommsIODummy->priv.datareceivedmutex);
+     gboolean bShutdown;
+     QueueEntry *entry = wait_for_entry(pCommsIODummy, &bShutdown);
 
      if( bShutdown )
      {
@@ -106,12 +150,12 @@ remote_offload_comms_io_dummy_read(RemoteOffloadCommsIO *commsio,
         return REMOTEOFFLOADCOMMSIO_FAIL;
      }
 
-     guint64 bytes_left_in_entry = entry->size - pCommsIODummy->priv.currentOffset;
+     guint64 bytes_left_in_entry = entry->map.size - pCommsIODummy->priv.currentOffset;
 
      if( bytes_left_in_entry )
-     {;
+     {
         guint64 bytes_to_copy = MIN(bytes_to_receive, bytes_left_in_entry);
-        guint8 *entry_data = entry->data + pCommsIODummy->priv.currentOffset;
+        guint8 *entry_data = entry->map.data + pCommsIODummy->priv.currentOffset;
 
 #ifndef NO_SAFESTR
         memcpy_s(buf,
@@ -133,13 +177,8 @@ remote_offload_comms_io_dummy_read(RemoteOffloadCommsIO *commsio,
 
      if( !bytes_left_in_entry )
      {
-        pCommsIODummy->priv.currentOffset = 0;
-        g_mutex_lock(&pCommsIODummy->priv.datareceivedmutex);
-        g_queue_pop_head(pCommsIODummy->priv.dataReceivedQueue);
-        g_mutex_unlock(&pCommsIODummy->priv.datareceivedmutex);
-
-        g_free(entry->data);
-        g_free(entry);
+        pop_entry(pCommsIODummy);
+        queue_entry_free(entry);
      }
 
   }
@@ -147,6 +186,88 @@ remote_offload_comms_io_dummy_read(RemoteOffloadCommsIO *commsio,
   return REMOTEOFFLOADCOMMSIO_SUCCESS;
 }
 
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_dummy_read_mem_ref(RemoteOffloadCommsIO *commsio,
+                                           guint64 size,
+                                           GstMemory **mem)
+{
+  RemoteOffloadCommsIODummy *pCommsIODummy = REMOTEOFFLOAD_COMMSIODUMMY(commsio);
+
+  *mem = NULL;
+
+  if( !size )
+     return REMOTEOFFLOADCOMMSIO_SUCCESS;
+
+  gboolean bShutdown;
+  QueueEntry *entry = wait_for_entry(pCommsIODummy, &bShutdown);
+
+  if( bShutdown )
+  {
+     return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+  }
+
+  if( G_UNLIKELY(!entry) )
+  {
+     return REMOTEOFFLOADCOMMSIO_FAIL;
+  }
+
+  //We can only hand over the memory if the requested range is exactly
+  // the (unread) memory that the peer wrote. Otherwise, let the caller read it.
+  if( (pCommsIODummy->priv.currentOffset == 0) && (entry->map.size == size) )
+  {
+     pop_entry(pCommsIODummy);
+     *mem = gst_memory_ref(entry->mem);
+     queue_entry_free(entry);
+  }
+
+  return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+//Copy size bytes from buf into a newly allocated memory
+static GstMemory *copy_to_new_mem(const guint8 *buf, gsize size)
+{
+   GstMemory *mem = gst_allocator_alloc(NULL, size, NULL);
+   if( !mem )
+   {
+      GST_ERROR("Error in gst_allocator_alloc(%"G_GSIZE_FORMAT")", size);
+      return NULL;
+   }
+
+   GstMapInfo map;
+   if( !gst_memory_map(mem, &map, GST_MAP_WRITE) )
+   {
+      GST_ERROR("Error mapping memory for writing");
+      gst_memory_unref(mem);
+      return NULL;
+   }
+
+#ifndef NO_SAFESTR
+   memcpy_s(map.data, size, buf, size);
+#else
+   memcpy(map.data, buf, size);
+#endif
+
+   gst_memory_unmap(mem, &map);
+
+   return mem;
+}
+
+//push a list of entries to the peer's queue
+static void push_entries_to_peer(RemoteOffloadCommsIODummy *pCommsIODummy,
+                                 GQueue *entries)
+{
+  RemoteOffloadCommsIODummy *peer = pCommsIODummy->priv.peer;
+
+  g_mutex_lock(&peer->priv.datareceivedmutex);
+  QueueEntry *entry;
+  while( (entry = g_queue_pop_head(entries)) )
+  {
+     g_queue_push_tail(peer->priv.dataReceivedQueue, entry);
+  }
+  g_cond_broadcast(&peer->priv.datareceivedcond);
+  g_mutex_unlock(&peer->priv.datareceivedmutex);
+}
+
 RemoteOffloadCommsIOResult remote_offload_comms_io_dummy_write(RemoteOffloadCommsIO *commsio,
                                                                guint8 *buf,
                                                                guint64 size)
@@ -163,31 +284,89 @@ RemoteOffloadCommsIOResult remote_offload_comms_io_dummy_write(RemoteOffloadComm
    if( !pCommsIODummy->priv.peer )
       return REMOTEOFFLOADCOMMSIO_FAIL;
 
-   QueueEntry *entry = g_malloc(sizeof(QueueEntry));
-   entry->data = g_malloc(size);
-   if( !entry->data )
+   GstMemory *mem = copy_to_new_mem(buf, size);
+   if( !mem )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   QueueEntry *entry = queue_entry_new(mem);
+   if( !entry )
    {
-      GST_ERROR("Error in g_malloc(%"G_GUINT64_FORMAT")", size);
-      g_free(entry);
+      gst_memory_unref(mem);
       return REMOTEOFFLOADCOMMSIO_FAIL;
    }
 
-   entry->size = size;
+   GQueue entries = G_QUEUE_INIT;
+   g_queue_push_tail(&entries, entry);
+   push_entries_to_peer(pCommsIODummy, &entries);
 
-  #ifndef NO_SAFESTR
-       memcpy_s(entry->data, size, buf, size);
-  #else
-       memcpy(entry->data, buf, size);
-  #endif
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
 
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_dummy_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                             GList *mem_list)
+{
+   RemoteOffloadCommsIODummy *pCommsIODummy = REMOTEOFFLOAD_COMMSIODUMMY(commsio);
 
-  //push this data entry to the peer's queue
-  g_mutex_lock(&pCommsIODummy->priv.peer->priv.datareceivedmutex);
-  g_queue_push_tail(pCommsIODummy->priv.peer->priv.dataReceivedQueue, entry);
-  g_cond_broadcast(&pCommsIODummy->priv.peer->priv.datareceivedcond);
-  g_mutex_unlock(&pCommsIODummy->priv.peer->priv.datareceivedmutex);
+   //TODO: probably not thread safe here.
+   if( pCommsIODummy->priv.shutdownAsserted )
+      return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
 
-  return REMOTEOFFLOADCOMMSIO_SUCCESS;
+   if( !pCommsIODummy->priv.peer )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   //Build all of the entries first, so that the peer sees either the whole
+   // list, or none of it.
+   GQueue entries = G_QUEUE_INIT;
+   for( GList *li = mem_list; li != NULL; li = li->next )
+   {
+      GstMemory *srcmem = (GstMemory *)li->data;
+      if( !srcmem )
+         goto fail;
+
+      if( gst_memory_get_sizes(srcmem, NULL, NULL) == 0 )
+         continue;
+
+      GstMemory *mem = NULL;
+      if( remote_offload_comms_io_mem_is_shareable(srcmem) )
+      {
+         mem = gst_memory_ref(srcmem);
+      }
+      else
+      {
+         //this memory may not be valid after we return, so copy it.
+         GstMapInfo srcmap;
+         if( !gst_memory_map(srcmem, &srcmap, GST_MAP_READ) )
+         {
+            GST_ERROR("Error mapping memory for reading");
+            goto fail;
+         }
+
+         mem = copy_to_new_mem(srcmap.data, srcmap.size);
+         gst_memory_unmap(srcmem, &srcmap);
+      }
+
+      if( !mem )
+         goto fail;
+
+      QueueEntry *entry = queue_entry_new(mem);
+      if( !entry )
+      {
+         gst_memory_unref(mem);
+         goto fail;
+      }
+
+      g_queue_push_tail(&entries, entry);
+   }
+
+   push_entries_to_peer(pCommsIODummy, &entries);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+
+fail:
+   g_queue_foreach(&entries, (GFunc)queue_entry_free, NULL);
+   g_queue_clear(&entries);
+   return REMOTEOFFLOADCOMMSIO_FAIL;
 }
 
 static void remote_offload_comms_io_dummy_shutdown(RemoteOffloadCommsIO *commsio)
@@ -218,7 +397,9 @@ static void
 remote_offload_comms_io_dummy_interface_init (RemoteOffloadCommsIOInterface *iface)
 {
   iface->read = remote_offload_comms_io_dummy_read;
+  iface->read_mem_ref = remote_offload_comms_io_dummy_read_mem_ref;
   iface->write = remote_offload_comms_io_dummy_write;
+  iface->write_mem_list = remote_offload_comms_io_dummy_write_mem_list;
   iface->shutdown = remote_offload_comms_io_dummy_shutdown;
   iface->get_consumable_memfeatures = remote_offload_comms_io_dummy_get_consumable_memfeatures;
 }
@@ -256,8 +437,7 @@ remote_offload_comms_io_dummy_finalize (GObject *gobject)
 
      if( entry )
      {
-        g_free(entry->data);
-        g_free(entry);
+        queue_entry_free(entry);
      }
   }
 
@@ -24,6 +24,7 @@
 #include <glib/gprintf.h>
 #include "gvaelementpropertyserializer.h"
 #include "remoteoffloadelementpropertyserializer.h"
+#include "remoteoffloadfilecache.h"
 
 #ifndef NO_SAFESTR
   #include <safe_mem_lib.h>
@@ -93,54 +94,17 @@ static GstMemory* virt_to_gstmemory(void *pVirt, gsize size)
    return mem;
 }
 
-GstMemory *FileToGstMemory(RemoteOffloadElementPropertySerializer *propserializer, gchar *filename)
+//Files are serialized as a RemoteOffloadFileRef (content digest + size), rather than
+// their contents. remoteoffloadbin makes sure that the remote side's file cache holds
+// them before sending the serialized bin, so only files that the remote side hasn't
+// seen before are actually transferred.
+GstMemory *FileToFileRef(RemoteOffloadElementPropertySerializer *propserializer, gchar *filename)
 {
-   GST_INFO_OBJECT(propserializer, "FileToGstMemory for %s\n", filename);
-   GstMemory *mem = NULL;
-   if( filename )
+   GST_INFO_OBJECT(propserializer, "FileToFileRef for %s\n", filename);
+   GstMemory *mem = remote_offload_file_ref_new(filename);
+   if( !mem )
    {
-      GFile *file = g_file_new_for_path(filename);
-      if( file )
-      {
-         GError *err = NULL;
-         gchar *contents = NULL;
-         gsize length;
-
-         gboolean fileloadstatus = g_file_load_contents(file,
-                                                        NULL, // GCancellable *cancellable
-                                                        &contents,
-                                                        &length,
-                                                        NULL,
-                                                        &err);
-
-
-          if( fileloadstatus )
-          {
-            //wrap the contents into a GstMemory chunk and append to memArray
-            mem = gst_memory_new_wrapped((GstMemoryFlags)0,
-                                         contents,
-                                         length,
-                                         0,
-                                         length,
-                                         contents,
-                                         GFreeDestroy);
-          }
-          else
-          {
-             GST_ERROR_OBJECT(propserializer, "g_file_load_contents for %s, failed\n", filename);
-             if( err )
-             {
-                GST_ERROR_OBJECT(propserializer, "%s", err->message);
-                g_clear_error (&err);
-             }
-          }
-
-          g_object_unref(file);
-       }
-       else
-       {
-          GST_ERROR_OBJECT(propserializer, "g_file_new_for_path for %s, failed\n", filename);
-       }
+      GST_ERROR_OBJECT(propserializer, "remote_offload_file_ref_new for %s, failed\n", filename);
    }
 
    return mem;
@@ -227,7 +191,7 @@ gva_element_property_serialize(RemoteOffloadElementPropertySerializer *propseria
        }
 
        GstMemory *pHeaderMem = virt_to_gstmemory(pHeader, sizeof(GVAPropFileHeader));
-       GstMemory *filemem = FileToGstMemory(propserializer, propertyfilename);
+       GstMemory *filemem = FileToFileRef(propserializer, propertyfilename);
 
        if( filemem )
        {
@@ -257,7 +221,7 @@ gva_element_property_serialize(RemoteOffloadElementPropertySerializer *propseria
           gchar *binfilename = g_strdup_printf("%s.bin", tokens[0]);
           g_sprintf(binfilename, "%s.bin", tokens[0]);
 
-          GstMemory *binfilemem = FileToGstMemory(propserializer, binfilename);
+          GstMemory *binfilemem = FileToFileRef(propserializer, binfilename);
           if( binfilemem )
           {
              g_array_append_val(memArray, binfilemem);
@@ -289,7 +253,7 @@ gva_element_property_serialize(RemoteOffloadElementPropertySerializer *propseria
       g_object_get(pElement, "model-proc", &modelprocfilename, NULL);
       if( modelprocfilename )
       {
-         GstMemory *modelprocmem = FileToGstMemory(propserializer, modelprocfilename);
+         GstMemory *modelprocmem = FileToFileRef(propserializer, modelprocfilename);
 
          if( modelprocmem )
          {
@@ -324,116 +288,94 @@ gva_element_property_serialize(RemoteOffloadElementPropertySerializer *propseria
    return ret;
 }
 
-static gboolean WriteGstMemoryToFile(GVAElementPropertySerializer *propserializer,
-                                     GstMemory *mem, gchar *filename)
+//Create a tmp directory to hold the links to cached files. Returns the path
+// of the directory (to be freed with g_free), or NULL upon failure.
+static gchar *MakeTmpDir(GVAElementPropertySerializer *propserializer)
 {
-   GST_INFO_OBJECT(propserializer,
-                   "WriteGstMemoryToFile: GstMemory=%p filename=%s", mem, filename);
-   gboolean ret = FALSE;
-
-   GstMapInfo mapInfo;
-   if( gst_memory_map(mem, &mapInfo, GST_MAP_READ) )
+   GError *err = NULL;
+   gchar *dirname = g_dir_make_tmp("model-XXXXXX", &err);
+   if( dirname )
    {
-      GError *err = NULL;
-      if( g_file_set_contents(filename, (gchar *)mapInfo.data, mapInfo.size, &err) )
-      {
-        ret = TRUE;
-      }
-      else
-      {
-         GST_ERROR_OBJECT(propserializer, "g_file_set_contents failed\n");
-         if( err )
-         {
-            GST_ERROR_OBJECT(propserializer, "%s", err->message);
-            g_clear_error (&err);
-         }
-         ret = FALSE;
-      }
-
-       gst_memory_unmap(mem, &mapInfo);
+      GST_INFO_OBJECT(propserializer, "Created tmp dir: %s", dirname);
+      propserializer->tmpFileList = g_list_append (propserializer->tmpFileList,
+                                                   g_file_new_for_path(dirname));
    }
    else
    {
-      GST_ERROR_OBJECT(propserializer, "gst_memory_map(%p, .., GST_MAP_READ) failed\n", mem);
+      GST_ERROR_OBJECT(propserializer, "g_dir_make_tmp failed\n");
+      if( err )
+      {
+         GST_ERROR_OBJECT(propserializer, "%s", err->message);
+         g_clear_error (&err);
+      }
    }
 
-   return ret;
+   return dirname;
 }
 
-//template should be some string that has six consecutive X's. ex: "model-XXXXXX.xml"
-static GFile *
-GstMemoryToTmpFile(GVAElementPropertySerializer *propserializer,
-                   GstMemory *mem,
-                   const char *template)
+//Create a link named dirname/linkname to the cached copy of the file referred to
+// by refmem. GVA elements infer the name of some files from others (i.e. the .bin
+// from the .xml), so the cached files (which are named by digest) can't be used
+// directly. Returns the path of the link (to be freed with g_free), or NULL upon failure.
+static gchar *LinkToCachedFile(GVAElementPropertySerializer *propserializer,
+                               GstMemory *refmem,
+                               const gchar *dirname,
+                               const gchar *linkname)
 {
-  if( !mem || !template )
-  {
-    return NULL;
-  }
-
-  GFile *tmpfile = NULL;
-  GFileIOStream *stream = NULL;
-  GError *err = NULL;
-  tmpfile = g_file_new_tmp (template, &stream, &err);
-  if( stream ) g_object_unref (stream);
-  if( tmpfile )
-  {
-     gchar *tmpfilename = g_file_get_path (tmpfile);
-     GST_INFO_OBJECT(propserializer, "Created tmp file: %s", tmpfilename);
-
-     if( !WriteGstMemoryToFile(propserializer, mem, tmpfilename) )
-     {
-        GST_ERROR_OBJECT(propserializer, "WriteGstMemoryToFile\n");
-        g_object_unref(tmpfile);
-        tmpfile = NULL;
-     }
+   if( !refmem || !dirname )
+   {
+      return NULL;
+   }
 
-     g_free(tmpfilename);
-  }
-  else
-  {
-     GST_ERROR_OBJECT(propserializer, "g_file_new_tmp(%s,..) failed\n", template);
-     if( err )
-     {
-        GST_ERROR_OBJECT(propserializer, "%s", err->message);
-        g_clear_error (&err);
-     }
-  }
+   RemoteOffloadFileRef ref;
+   GstMapInfo mapInfo;
+   if( !gst_memory_map(refmem, &mapInfo, GST_MAP_READ) )
+   {
+      GST_ERROR_OBJECT(propserializer, "gst_memory_map(%p, .., GST_MAP_READ) failed\n", refmem);
+      return NULL;
+   }
 
-  if( tmpfile )
-     propserializer->tmpFileList = g_list_append (propserializer->tmpFileList, tmpfile);
+   if( mapInfo.size != sizeof(ref) )
+   {
+      GST_ERROR_OBJECT(propserializer, "Invalid size for file ref");
+      gst_memory_unmap(refmem, &mapInfo);
+      return NULL;
+   }
+   ref = *(RemoteOffloadFileRef *)mapInfo.data;
+   gst_memory_unmap(refmem, &mapInfo);
+   ref.digest[REMOTEOFFLOAD_FILECACHE_DIGEST_SIZE - 1] = 0;
 
-  return tmpfile;
-}
+   gchar *cachedfilename = remote_offload_file_cache_lookup(&ref);
+   if( !cachedfilename )
+   {
+      GST_ERROR_OBJECT(propserializer, "File with sha256=%s is not in the file cache\n", ref.digest);
+      return NULL;
+   }
 
-static GFile *GstMemoryToFile(GVAElementPropertySerializer *propserializer,
-                              GstMemory *mem,
-                              gchar *filename)
-{
-  if( !mem || !filename )
-  {
-    return NULL;
-  }
-
-  GFile *file = g_file_new_for_path(filename);
-  if( file )
-  {
-     if( !WriteGstMemoryToFile(propserializer, mem, filename) )
-     {
-        GST_ERROR_OBJECT(propserializer, "WriteGstMemoryToFile failed\n");
-        g_object_unref(file);
-        file = NULL;
-     }
-  }
-  else
-  {
-     GST_ERROR_OBJECT(propserializer, "g_file_new_for_path(%s) failed\n", filename);
-  }
+   gchar *linkfilename = g_build_filename(dirname, linkname, NULL);
+   GFile *link = g_file_new_for_path(linkfilename);
+   GError *err = NULL;
+   if( g_file_make_symbolic_link(link, cachedfilename, NULL, &err) )
+   {
+      GST_INFO_OBJECT(propserializer, "Linked %s to %s", linkfilename, cachedfilename);
+      propserializer->tmpFileList = g_list_append (propserializer->tmpFileList, link);
+   }
+   else
+   {
+      GST_ERROR_OBJECT(propserializer, "g_file_make_symbolic_link(%s) failed\n", linkfilename);
+      if( err )
+      {
+         GST_ERROR_OBJECT(propserializer, "%s", err->message);
+         g_clear_error (&err);
+      }
+      g_object_unref(link);
+      g_free(linkfilename);
+      linkfilename = NULL;
+   }
 
-  if( file )
-     propserializer->tmpFileList = g_list_append (propserializer->tmpFileList, file);
+   g_free(cachedfilename);
 
-  return file;
+   return linkfilename;
 }
 
 
@@ -511,18 +453,20 @@ gva_element_property_deserialize(RemoteOffloadElementPropertySerializer *propser
      {
         if( memArray->len >= 2 )
         {
-           GFile *blobtmpfile = GstMemoryToTmpFile(self, propmemarray[1], "model-XXXXXX.blob");
-           if( blobtmpfile )
+           gchar *tmpdirname = MakeTmpDir(self);
+           gchar *blobfilename = LinkToCachedFile(self, propmemarray[1], tmpdirname, "model.blob");
+           if( blobfilename )
            {
-              gchar *blobfilename = g_file_get_path (blobtmpfile);
               GST_INFO_OBJECT(self, "Setting \"model\" property to %s", blobfilename);
               g_object_set(pElement, "model", blobfilename, NULL);
               ret = REMOTEOFFLOAD_PROPSERIALIZER_SUCCESS;
+              g_free(blobfilename);
            }
            else
            {
-              GST_ERROR_OBJECT(self, "GstMemoryToTmpFile for blob file failed\n");
+              GST_ERROR_OBJECT(self, "LinkToCachedFile for blob file failed\n");
            }
+           g_free(tmpdirname);
         }
         else
         {
@@ -533,40 +477,31 @@ gva_element_property_deserialize(RemoteOffloadElementPropertySerializer *propser
      {
         if( memArray->len >= 3 )
         {
-           GFile *xmltmpfile = GstMemoryToTmpFile(self, propmemarray[1], "model-XXXXXX.xml");
-           if( xmltmpfile )
+           //the .bin needs to reside next to the .xml, with the same base name
+           gchar *tmpdirname = MakeTmpDir(self);
+           gchar *xmlfilename = LinkToCachedFile(self, propmemarray[1], tmpdirname, "model.xml");
+           if( xmlfilename )
            {
-              gchar *xmlfilename = g_file_get_path (xmltmpfile);
-
-              GST_INFO_OBJECT(self, "Setting \"model\" property to %s", xmlfilename);
-              g_object_set(pElement, "model", xmlfilename, NULL);
-
-              gchar **tokens = g_strsplit(xmlfilename, ".xml", 2);
-              if( tokens )
+              gchar *binfilename = LinkToCachedFile(self, propmemarray[2], tmpdirname, "model.bin");
+              if( binfilename )
               {
-                 gchar *binfilename = g_strdup_printf("%s.bin", tokens[0]);
-                 GFile *binfile = GstMemoryToFile(self, propmemarray[2], binfilename);
-                 if( binfile )
-                 {
-                    ret = REMOTEOFFLOAD_PROPSERIALIZER_SUCCESS;
-                 }
-                 else
-                 {
-                    GST_ERROR_OBJECT(self, "GstMemoryToFile for bin file failed\n");
-                 }
-
+                 GST_INFO_OBJECT(self, "Setting \"model\" property to %s", xmlfilename);
+                 g_object_set(pElement, "model", xmlfilename, NULL);
+                 ret = REMOTEOFFLOAD_PROPSERIALIZER_SUCCESS;
                  g_free(binfilename);
-                 g_strfreev(tokens);
               }
               else
               {
-                 GST_ERROR_OBJECT(self, "g_strsplit(\"%s\", \".xml\", 2) failed", xmlfilename);
+                 GST_ERROR_OBJECT(self, "LinkToCachedFile for bin file failed\n");
               }
+
+              g_free(xmlfilename);
            }
            else
            {
-              GST_ERROR_OBJECT(self, "GstMemoryToTmpFile for xml file failed\n");
+              GST_ERROR_OBJECT(self, "LinkToCachedFile for xml file failed\n");
            }
+           g_free(tmpdirname);
         }
         else
         {
@@ -589,21 +524,22 @@ gva_element_property_deserialize(RemoteOffloadElementPropertySerializer *propser
       //1 for the header, 1 for the json file
       if( memArray->len == 2 )
       {
-         GFile *jsontmpfile = GstMemoryToTmpFile(self, propmemarray[1], "model-XXXXXX.json");
-         if( jsontmpfile )
+         gchar *tmpdirname = MakeTmpDir(self);
+         gchar *jsonfilename = LinkToCachedFile(self, propmemarray[1], tmpdirname, "model-proc.json");
+         if( jsonfilename )
          {
-            gchar *jsontmpfilename = g_file_get_path (jsontmpfile);
-            GST_INFO_OBJECT(self, "Setting \"model-proc\" property to %s", jsontmpfilename);
-            g_object_set(pElement, "model-proc", jsontmpfilename, NULL);
+            GST_INFO_OBJECT(self, "Setting \"model-proc\" property to %s", jsonfilename);
+            g_object_set(pElement, "model-proc", jsonfilename, NULL);
 
             ret = REMOTEOFFLOAD_PROPSERIALIZER_SUCCESS;
 
-            g_free(jsontmpfilename);
+            g_free(jsonfilename);
          }
          else
          {
-            GST_ERROR_OBJECT(self, "GstMemoryToTmpFile for json file failed\n");
+            GST_ERROR_OBJECT(self, "LinkToCachedFile for json file failed\n");
          }
+         g_free(tmpdirname);
       }
       else
       {
@@ -636,8 +572,10 @@ gva_element_property_serializer_finalize (GObject *gobject)
 
    if( self->tmpFileList )
    {
+      //delete in reverse order of creation, so that the tmp dirs are
+      // empty by the time that they are deleted.
       GList *li;
-      for(li = self->tmpFileList; li != NULL; li = li->next )
+      for(li = g_list_last(self->tmpFileList); li != NULL; li = li->prev )
       {
          GFile *file = (GFile *)li->data;
          if( file )
@@ -21,20 +21,23 @@
  */
 
 #include <gst/base/gstbytewriter.h>
+#include <gst/base/gstbytereader.h>
 #include "gvatensormetaserializer.h"
 #include "remoteoffloadmetaserializer.h"
+#include "remoteoffloadstructureserializer.h"
+#include "remoteoffloadutils.h"
 #include "gva_tensor_meta.h"
 
-#ifndef NO_SAFESTR
-  #include <safe_mem_lib.h>
-#else
-  #include <string.h>
-#endif
-
 struct _GVATensorMetaSerializer
 {
   GObject parent_instance;
 
+  //'data' structure field names are interned per connection
+  RemoteOffloadStructureWriter *writer;
+  RemoteOffloadStructureReader *reader;
+
+  //writer mark at send_begin, to roll back to if the buffer is discarded
+  guint writer_mark;
 };
 
 static void gva_tensor_metaserializer_interface_init (RemoteOffloadMetaSerializerInterface *iface);
@@ -50,10 +53,14 @@ G_DEFINE_TYPE_WITH_CODE (GVATensorMetaSerializer, gva_tensor_metaserializer, G_T
                                                   "debug category for GVATensorMetaSerializer"))
 
 //Serialized GstGVATensorMeta looks like this:
-//guint32 data_buffer_size
-//guint8* data_buffer (data_buffer_size bytes)
-//guint32 str_size
-//char *str (str_size bytes)
+//segment 0:
+// guint32 data_buffer_size
+// 'data' GstStructure, minus data_buffer & data (see remoteoffloadstructureserializer.h)
+//segment 1 (only if data_buffer_size > 0):
+// data_buffer, wrapped (not copied) from the 'data_buffer' GVariant
+
+//'data_buffer' is sent as raw bytes, and 'data' is a pointer into it.
+static const gchar * const data_skip_fields[] = {"data_buffer", "data", NULL};
 
 static const gchar* gva_tensor_metaserializer_api_name(RemoteOffloadMetaSerializer *serializer)
 {
@@ -65,31 +72,11 @@ static void SerializedDestroy(gpointer data)
    g_free(data);
 }
 
-static inline void AddStringToBW(GstByteWriter *bw, char *str)
-{
-   if( str )
-   {
-     guint32 size =
-#ifndef NO_SAFESTR
-           strnlen_s(str, RSIZE_MAX_STR) + 1;
-#else
-           strlen(str) + 1;
-#endif
-     gst_byte_writer_put_data( bw, (const guint8 *)&size, sizeof(size));
-     gst_byte_writer_put_data( bw, (const guint8 *)str, size);
-   }
-   else
-   {
-     guint32 size = 1;
-     gst_byte_writer_put_data( bw, (const guint8 *)&size, sizeof(size));
-     gst_byte_writer_put_uint8 (bw, 0);
-   }
-}
-
 static gboolean gva_tensor_metaserializer_serialize(RemoteOffloadMetaSerializer *serializer,
                                                     GstMeta *meta,
                                                     GArray *metaMemArray)
 {
+   GVATensorMetaSerializer *self = METASERIALIZER_GVATENSOR(serializer);
    GstGVATensorMeta* gva_meta = (GstGVATensorMeta*) meta;
 
    GstByteWriter bw;
@@ -97,30 +84,27 @@ static gboolean gva_tensor_metaserializer_serialize(RemoteOffloadMetaSerializer
 
    if( gva_meta->data )
    {
-      guint32 data_buffer_size = 0;
-      gconstpointer data_buffer = NULL;
+      GstMemory *data_buffer_mem = NULL;
       const GValue *data_buffer_val = gst_structure_get_value(gva_meta->data, "data_buffer");
       if( data_buffer_val )
       {
-         GVariant *v = g_value_get_variant(data_buffer_val);
-         gsize size;
-         data_buffer =  g_variant_get_fixed_array(v, &size, 1);
-         data_buffer_size = size;
+         data_buffer_mem = remote_offload_variant_to_mem(g_value_get_variant(data_buffer_val));
       }
 
-      gst_byte_writer_put_data( &bw, (const guint8 *)&data_buffer_size, sizeof(data_buffer_size));
-      if( data_buffer )
+      guint32 data_buffer_size = 0;
+      if( data_buffer_mem )
+         data_buffer_size = gst_memory_get_sizes(data_buffer_mem, NULL, NULL);
+      gst_byte_writer_put_uint32_le( &bw, data_buffer_size);
+
+      if( !remote_offload_structure_write(self->writer, gva_meta->data, data_skip_fields, &bw) )
       {
-         gst_byte_writer_put_data( &bw, (const guint8 *)data_buffer, data_buffer_size);
-         gst_structure_remove_field(gva_meta->data, "data_buffer");
-         gst_structure_remove_field(gva_meta->data, "data");
+         GST_ERROR_OBJECT (serializer, "Unable to serialize GstGVATensorMeta 'data'");
+         g_free(gst_byte_writer_reset_and_get_data(&bw));
+         if( data_buffer_mem )
+            gst_memory_unref(data_buffer_mem);
+         return FALSE;
       }
 
-      gchar *str = gst_structure_to_string(gva_meta->data);
-      AddStringToBW( &bw, str);
-      if( str )
-         g_free(str);
-
       gsize mem_size = gst_byte_writer_get_pos(&bw);
       void *bwdata = gst_byte_writer_reset_and_get_data(&bw);
       GstMemory *mem = gst_memory_new_wrapped((GstMemoryFlags)0,
@@ -132,6 +116,9 @@ static gboolean gva_tensor_metaserializer_serialize(RemoteOffloadMetaSerializer
                                                SerializedDestroy);
 
       g_array_append_val(metaMemArray, mem);
+
+      if( data_buffer_mem )
+         g_array_append_val(metaMemArray, data_buffer_mem);
    }
    else
    {
@@ -141,22 +128,11 @@ static gboolean gva_tensor_metaserializer_serialize(RemoteOffloadMetaSerializer
    return TRUE;
 }
 
-gchar *ExtractStringFromSerialization(guint8** pSerialized)
-{
-    guint32 *size = (guint32 *)*pSerialized;
-    *pSerialized += sizeof(guint32);
-
-    gchar *str = (gchar *)*pSerialized;
-    *pSerialized += *size;
-
-    return str;
-}
-
 static gboolean gva_tensor_metaserializer_deserialize(RemoteOffloadMetaSerializer *serializer,
                                          GstBuffer *buffer,
                                          const GArray *metaMemArray)
 {
-   if( metaMemArray->len != 1 )
+   if( (metaMemArray->len < 1) || (metaMemArray->len > 2) )
    {
       GST_ERROR_OBJECT (serializer, "metaMemArray has incorrect size!");
       return FALSE;
@@ -170,30 +146,26 @@ static gboolean gva_tensor_metaserializer_deserialize(RemoteOffloadMetaSerialize
      return FALSE;
    }
 
-   guint8 *pSerialized = mapInfo.data;
-
-   guint32 data_size = *((guint32 *)pSerialized);
-   pSerialized += sizeof(guint32);
-   guint8* pData = NULL;
-   if( data_size )
-   {
-      pData = (guint8 *)pSerialized;
-   }
-   pSerialized += data_size;
+   GVATensorMetaSerializer *self = METASERIALIZER_GVATENSOR(serializer);
+   GstByteReader br;
+   gst_byte_reader_init(&br, mapInfo.data, mapInfo.size);
 
-   guint32 str_size = *((guint32 *)pSerialized);
-   pSerialized += sizeof(guint32);
-   gchar* pStr = NULL;
-   if( str_size )
+   //a data segment is sent if (and only if) there's data, and it needs to be
+   // the size that the header claims
+   guint32 data_size = 0;
+   if( !gst_byte_reader_get_uint32_le(&br, &data_size) ||
+       (metaMemArray->len != (data_size ? 2 : 1)) ||
+       (data_size && (gst_memory_get_sizes(gstmems[1], NULL, NULL) != data_size)) )
    {
-      pStr = (gchar *)pSerialized;
+      GST_ERROR_OBJECT (serializer, "Malformed serialized meta");
+      gst_memory_unmap(gstmems[0], &mapInfo);
+      return FALSE;
    }
-   pSerialized += str_size;
 
-   GstStructure *struct_from_string =
-         gst_structure_from_string(pStr, NULL);
+   GstStructure *data_structure =
+         remote_offload_structure_read(self->reader, &br);
 
-   if( struct_from_string )
+   if( data_structure )
    {
       GstGVATensorMeta *meta = GST_GVA_TENSOR_META_ADD(buffer);
       if( !meta )
@@ -206,7 +178,7 @@ static gboolean gva_tensor_metaserializer_deserialize(RemoteOffloadMetaSerialize
       //replace GstStrucure within meta with ours.
       if( meta->data )
          gst_structure_free(meta->data);
-      meta->data = struct_from_string;
+      meta->data = data_structure;
 
       //implementation of gst_gva_tensor_meta_init sets name
       // of gst structure to "meta". Not sure if this matters
@@ -214,10 +186,11 @@ static gboolean gva_tensor_metaserializer_deserialize(RemoteOffloadMetaSerialize
       gst_structure_set_name(meta->data, "meta");
 
       //add 'data_buffer', 'data' fields
-      if( pData )
+      GVariant *v = NULL;
+      if( data_size )
+         v = remote_offload_mem_to_byte_variant(gstmems[1]);
+      if( v )
       {
-         GVariant *v =
-               g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, pData, data_size, 1);
          gsize n_elem;
          gst_structure_set(meta->data, "data_buffer", G_TYPE_VARIANT, v, "data", G_TYPE_POINTER,
                            g_variant_get_fixed_array(v, &n_elem, 1), NULL);
@@ -225,7 +198,7 @@ static gboolean gva_tensor_metaserializer_deserialize(RemoteOffloadMetaSerialize
    }
    else
    {
-      GST_ERROR_OBJECT (serializer, "gst_structure_from_string failed.");
+      GST_ERROR_OBJECT (serializer, "remote_offload_structure_read failed.");
    }
 
    gst_memory_unmap(gstmems[0], &mapInfo);
@@ -233,24 +206,54 @@ static gboolean gva_tensor_metaserializer_deserialize(RemoteOffloadMetaSerialize
    return TRUE;
 }
 
+static void gva_tensor_metaserializer_send_begin(RemoteOffloadMetaSerializer *serializer)
+{
+   GVATensorMetaSerializer *self = METASERIALIZER_GVATENSOR(serializer);
+   self->writer_mark = remote_offload_structure_writer_get_mark(self->writer);
+}
+
+static void gva_tensor_metaserializer_send_end(RemoteOffloadMetaSerializer *serializer,
+                                               gboolean bsent)
+{
+   GVATensorMetaSerializer *self = METASERIALIZER_GVATENSOR(serializer);
+   if( !bsent )
+      remote_offload_structure_writer_rollback(self->writer, self->writer_mark);
+}
+
 static void gva_tensor_metaserializer_interface_init (RemoteOffloadMetaSerializerInterface *iface)
 {
    iface->api_name = gva_tensor_metaserializer_api_name;
    iface->serialize = gva_tensor_metaserializer_serialize;
    iface->deserialize = gva_tensor_metaserializer_deserialize;
    iface->allocate_data_segment = NULL;
+   iface->send_begin = gva_tensor_metaserializer_send_begin;
+   iface->send_end = gva_tensor_metaserializer_send_end;
+}
+
+static void
+gva_tensor_metaserializer_finalize (GObject *gobject)
+{
+  GVATensorMetaSerializer *self = METASERIALIZER_GVATENSOR(gobject);
+
+  remote_offload_structure_writer_free(self->writer);
+  remote_offload_structure_reader_free(self->reader);
+
+  G_OBJECT_CLASS (gva_tensor_metaserializer_parent_class)->finalize (gobject);
 }
 
 static void
 gva_tensor_metaserializer_class_init (GVATensorMetaSerializerClass *klass)
 {
-//   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+   object_class->finalize = gva_tensor_metaserializer_finalize;
 }
 
 static void
 gva_tensor_metaserializer_init (GVATensorMetaSerializer *self)
 {
-
+  self->writer = remote_offload_structure_writer_new();
+  self->reader = remote_offload_structure_reader_new();
 }
 
 GVATensorMetaSerializer *gva_tensor_metaserializer_new()
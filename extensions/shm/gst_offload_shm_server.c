@@ -0,0 +1,187 @@
+/*
+ *  gst_offload_shm_server.c - Remote Offload Shared-Memory Server Application
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "remoteoffloadclientserverutil.h"
+#include "gstremoteoffloadpipeline.h"
+#include "remoteoffloadcommsio_shm.h"
+
+GST_DEBUG_CATEGORY_STATIC (remote_offload_shm_server_debug);
+#define GST_CAT_DEFAULT remote_offload_shm_server_debug
+
+static void shm_server_sig_handler(int sig);
+
+static volatile sig_atomic_t g_bserver_exit = 0;
+static int g_listenfd = -1;
+
+static void shm_server_run_ropinstance(GArray *id_commsio_pair_array, void *user_data)
+{
+   (void)user_data;
+
+   GHashTable *id_to_channel_hash =
+            id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array);
+
+   if( id_to_channel_hash )
+   {
+      RemoteOffloadPipeline *pPipeline =
+            remote_offload_pipeline_new(NULL, id_to_channel_hash);
+
+      if( pPipeline )
+      {
+         if( !remote_offload_pipeline_run(pPipeline) )
+         {
+            GST_ERROR("remote_offload_pipeline_run failed");
+         }
+
+         g_object_unref(pPipeline);
+      }
+      else
+      {
+         GST_ERROR("Error in remote_offload_pipeline_new");
+      }
+
+      g_hash_table_unref(id_to_channel_hash);
+   }
+   else
+   {
+      GST_ERROR("Invalid PipelinePlaceholder");
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, shm_server_sig_handler);
+   signal(SIGTERM, shm_server_sig_handler);
+
+   gchar *socket_path = NULL;
+
+   GOptionEntry entries[] =
+   {
+      { "socket", 's', 0, G_OPTION_ARG_STRING, &socket_path,
+        "Unix socket path to listen on (default=" SHM_COMMSIO_DEFAULT_SOCKET_PATH ")", NULL },
+      { NULL }
+   };
+
+   GOptionContext *context = g_option_context_new(" - Remote Offload Shared-Memory Server");
+   g_option_context_add_main_entries(context, entries, NULL);
+   g_option_context_add_group(context, gst_init_get_option_group());
+
+   GError *error = NULL;
+   if( !g_option_context_parse(context, &argc, &argv, &error) )
+   {
+      g_print("Error parsing options: %s\n", error ? error->message : "unknown");
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return -1;
+   }
+   g_option_context_free(context);
+
+   GST_DEBUG_CATEGORY_INIT (remote_offload_shm_server_debug,
+                               "remoteoffloadshmserver", 0,
+                             "debug category for Remote Offload Shared-Memory Server");
+
+   if( !socket_path )
+      socket_path = g_strdup(SHM_COMMSIO_DEFAULT_SOCKET_PATH);
+
+   g_listenfd = remote_offload_comms_io_shm_listen(socket_path);
+   if( g_listenfd < 0 )
+   {
+      g_print("Unable to listen on %s\n", socket_path);
+      g_free(socket_path);
+      return -1;
+   }
+
+   g_print("Listening on %s\n", socket_path);
+   //a parent process (e.g. a test) may be waiting for this line on a pipe
+   fflush(stdout);
+
+   RemoteOffloadPipelineSpawner *spawner = remote_offload_pipeline_spawner_new();
+   if( !spawner )
+   {
+     g_print("Error creating RemoteOffloadPipelineSpawner\n");
+     close(g_listenfd);
+     unlink(socket_path);
+     g_free(socket_path);
+     return -1;
+   }
+
+   remote_offload_pipeline_set_callback(spawner,
+                                        shm_server_run_ropinstance,
+                                        NULL);
+
+   while( !g_bserver_exit )
+   {
+      gboolean listen_error = FALSE;
+      RemoteOffloadCommsIOShm *commsio =
+            remote_offload_comms_io_shm_accept(g_listenfd, &listen_error);
+
+      if( !commsio )
+      {
+         if( listen_error )
+         {
+            if( !g_bserver_exit )
+               g_print("Error accepting new connection\n");
+            break;
+         }
+
+         //error was specific to this connection
+         continue;
+      }
+
+      //the spawner takes ownership of commsio
+      if( !remote_offload_pipeline_spawner_add_connection(spawner,
+                                                          (RemoteOffloadCommsIO *)commsio))
+      {
+         g_print("Error in remote_offload_pipeline_spawner_add_connection for commsio=%p\n",
+                 commsio);
+         g_object_unref(commsio);
+         break;
+      }
+   }
+
+   close(g_listenfd);
+   unlink(socket_path);
+   g_free(socket_path);
+
+   g_object_unref(spawner);
+
+   return 0;
+}
+
+static void shm_server_sig_handler(int sig)
+{
+   //reset the signal handler(s) back to their default case,
+   // in case the user performs another Ctrl^C / kill -15.
+   //  On the second attempt we want to force-ably quit.
+   signal(SIGINT, SIG_DFL);
+   signal(SIGTERM, SIG_DFL);
+
+   //shutting down the listening socket will cause the
+   // main thread blocked in accept() to return with an error.
+   g_bserver_exit = 1;
+   if( g_listenfd >= 0 )
+      shutdown(g_listenfd, SHUT_RDWR);
+}
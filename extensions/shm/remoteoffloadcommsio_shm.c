@@ -0,0 +1,904 @@
+/*
+ *  remoteoffloadcommsio_shm.c - RemoteOffloadCommsIOShm object
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "remoteoffloadcommsio_shm.h"
+#include "remoteoffloadcommsio.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <string.h>
+#ifndef NO_SAFESTR
+  #include <safe_mem_lib.h>
+#endif
+
+#define SHM_COMMSIO_MAGIC 0x524F5348 //'ROSH' in ASCII
+#define SHM_COMMSIO_VERSION 1
+
+//size reserved for the region header. Ring data starts at this offset.
+#define SHM_REGION_HEADER_SIZE 4096
+
+//Max time to sleep in FUTEX_WAIT before checking whether
+// the peer is still alive (100 ms).
+#define SHM_WAIT_TIMEOUT_NS 100000000
+
+//Segments at least this large are handed over (by read_mem_ref) as a memory
+// that wraps the rx ring, instead of being copied out of it.
+#define SHM_WRAP_MIN_SIZE (16 * 1024)
+
+//Shared state for a single-producer / single-consumer byte ring.
+// head & tail are free-running byte counters. Producer-owned and
+// consumer-owned fields are kept on separate cache lines.
+typedef struct
+{
+   guint64 head;             //total bytes written by producer
+   guint32 data_seq;         //futex word. bumped by producer after advancing head
+   guint32 consumer_waiting;
+   guint8 pad0[48];
+
+   guint64 tail;             //total bytes read by consumer
+   guint32 space_seq;        //futex word. bumped by consumer after advancing tail
+   guint32 producer_waiting;
+   guint8 pad1[48];
+}ShmRing;
+
+typedef struct
+{
+   guint32 magic;
+   guint32 version;
+   guint64 ring_size;
+   guint32 closed; //set by either side upon shutdown
+   guint8 pad[44];
+
+   //rings[0] is client->server, rings[1] is server->client
+   ShmRing rings[2];
+}ShmRegionHeader;
+
+G_STATIC_ASSERT(sizeof(ShmRegionHeader) <= SHM_REGION_HEADER_SIZE);
+
+/* Private structure definition. */
+typedef struct
+{
+  //unix socket connected to the peer. Only used for
+  // the initial handshake & to detect a dead peer.
+  int sockfd;
+
+  guint8 *region;
+  gsize region_size;
+  ShmRegionHeader *header;
+  guint64 ring_size;
+
+  ShmRing *txring;
+  guint8 *txdata;
+  ShmRing *rxring;
+  guint8 *rxdata;
+
+  //The rx ring's tail only advances past bytes that have been read *and* aren't
+  // wrapped by a memory that's still in use, so it may lag behind rxcursor.
+  guint64 rxcursor; //total bytes read. Only accessed by the reading thread
+  GMutex pinmutex; //protects pinned, and the advancing of rxring->tail
+  GQueue *pinned; //ShmPinnedRegion's wrapped by memories, in ring order
+
+  GMutex shutdownmutex;
+  gboolean shutdownAsserted;
+
+  /* stuff */
+} RemoteOffloadCommsIOShmPrivate;
+
+struct _RemoteOffloadCommsIOShm
+{
+  GObject parent_instance;
+
+
+  /* Other members, including private data. */
+  RemoteOffloadCommsIOShmPrivate priv;
+};
+
+//A range of the rx ring that's wrapped by a memory returned from read_mem_ref
+typedef struct
+{
+   RemoteOffloadCommsIOShm *commsio;
+   guint64 start;
+   guint64 end;
+   gboolean released;
+}ShmPinnedRegion;
+
+GST_DEBUG_CATEGORY_STATIC (comms_io_shm_debug);
+#define GST_CAT_DEFAULT comms_io_shm_debug
+
+static void remote_offload_comms_io_shm_interface_init (RemoteOffloadCommsIOInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RemoteOffloadCommsIOShm, remote_offload_comms_io_shm, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADCOMMSIO_TYPE,
+                         remote_offload_comms_io_shm_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (comms_io_shm_debug,
+                         "remoteoffloadcommsioshm", 0,
+                         "debug category for RemoteOffloadCommsIOShm"))
+
+static inline void shm_futex_wait(guint32 *addr, guint32 val)
+{
+   struct timespec ts = { 0, SHM_WAIT_TIMEOUT_NS };
+
+   //Note: not FUTEX_PRIVATE_FLAG, as the futex word is shared across processes.
+   syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static inline void shm_futex_wake(guint32 *addr)
+{
+   syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static gboolean remote_offload_comms_io_shm_peer_alive(RemoteOffloadCommsIOShm *self)
+{
+   if( __atomic_load_n(&self->priv.header->closed, __ATOMIC_ACQUIRE) )
+      return FALSE;
+
+   //Nothing is sent over the unix socket after the handshake, so any
+   // readable / hangup event means that the peer has gone away.
+   struct pollfd pfd = { self->priv.sockfd, POLLIN | POLLRDHUP, 0 };
+   if( poll(&pfd, 1, 0) > 0 )
+   {
+      if( pfd.revents & (POLLIN | POLLRDHUP | POLLHUP | POLLERR) )
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+//Block until *counter no longer equals counter_val.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_wait(RemoteOffloadCommsIOShm *self,
+                                 guint32 *seq,
+                                 guint32 *waiting,
+                                 guint64 *counter,
+                                 guint64 counter_val)
+{
+   while( 1 )
+   {
+      guint32 seqval = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+
+      //Advertise that we are about to wait, and then re-check. The other side
+      // bumps seq *before* checking 'waiting', so either it sees our flag and
+      // wakes us, or we see the updated counter / seq here.
+      __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+
+      if( __atomic_load_n(counter, __ATOMIC_SEQ_CST) != counter_val )
+         break;
+
+      if( self->priv.shutdownAsserted ||
+          !remote_offload_comms_io_shm_peer_alive(self) )
+      {
+         __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+         return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      }
+
+      shm_futex_wait(seq, seqval);
+
+      __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+
+      if( __atomic_load_n(counter, __ATOMIC_ACQUIRE) != counter_val )
+         break;
+   }
+
+   __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static inline void shm_signal(guint32 *seq, guint32 *waiting)
+{
+   __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+   if( __atomic_load_n(waiting, __ATOMIC_SEQ_CST) )
+      shm_futex_wake(seq);
+}
+
+//Copy size bytes from buf into the tx ring, directly from the
+// caller's memory. Blocks while the ring is full.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_write_buf(RemoteOffloadCommsIOShm *self,
+                                      const guint8 *buf,
+                                      guint64 size)
+{
+   ShmRing *ring = self->priv.txring;
+   const guint64 ring_size = self->priv.ring_size;
+
+   //only this side advances head, so a relaxed load is fine
+   guint64 head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+   while( size > 0 )
+   {
+      guint64 tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      guint64 space = ring_size - (head - tail);
+
+      if( !space )
+      {
+         RemoteOffloadCommsIOResult res =
+               remote_offload_comms_io_shm_wait(self, &ring->space_seq,
+                                                &ring->producer_waiting,
+                                                &ring->tail, tail);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            return res;
+
+         continue;
+      }
+
+      if( __atomic_load_n(&self->priv.header->closed, __ATOMIC_ACQUIRE) )
+         return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+
+      guint64 offset = head % ring_size;
+      guint64 bytes_to_copy = MIN(size, space);
+      bytes_to_copy = MIN(bytes_to_copy, ring_size - offset);
+
+#ifndef NO_SAFESTR
+      memcpy_s(self->priv.txdata + offset, bytes_to_copy, buf, bytes_to_copy);
+#else
+      memcpy(self->priv.txdata + offset, buf, bytes_to_copy);
+#endif
+
+      buf += bytes_to_copy;
+      size -= bytes_to_copy;
+      head += bytes_to_copy;
+
+      __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+      shm_signal(&ring->data_seq, &ring->consumer_waiting);
+   }
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+//Give the space up to the oldest pinned region that's still in use (or, if there
+// isn't one, up to rxcursor) back to the producer.
+// Note: pinmutex must be held by the caller.
+static void remote_offload_comms_io_shm_release_consumed(RemoteOffloadCommsIOShm *self)
+{
+   ShmPinnedRegion *region;
+   while( (region = g_queue_peek_head(self->priv.pinned)) && region->released )
+   {
+      g_queue_pop_head(self->priv.pinned);
+      g_free(region);
+   }
+
+   ShmRing *ring = self->priv.rxring;
+   guint64 tail = region ? region->start : self->priv.rxcursor;
+   if( tail != __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) )
+   {
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+      shm_signal(&ring->space_seq, &ring->producer_waiting);
+   }
+}
+
+//Copy size bytes out of the rx ring, directly into the caller's memory.
+// Blocks while the ring is empty.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_read_buf(RemoteOffloadCommsIOShm *self,
+                                     guint8 *buf,
+                                     guint64 size)
+{
+   ShmRing *ring = self->priv.rxring;
+   const guint64 ring_size = self->priv.ring_size;
+
+   guint64 tail = self->priv.rxcursor;
+
+   while( size > 0 )
+   {
+      guint64 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      guint64 avail = head - tail;
+
+      if( !avail )
+      {
+         RemoteOffloadCommsIOResult res =
+               remote_offload_comms_io_shm_wait(self, &ring->data_seq,
+                                                &ring->consumer_waiting,
+                                                &ring->head, head);
+         if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+            return res;
+
+         continue;
+      }
+
+      guint64 offset = tail % ring_size;
+      guint64 bytes_to_copy = MIN(size, avail);
+      bytes_to_copy = MIN(bytes_to_copy, ring_size - offset);
+
+#ifndef NO_SAFESTR
+      memcpy_s(buf, bytes_to_copy, self->priv.rxdata + offset, bytes_to_copy);
+#else
+      memcpy(buf, self->priv.rxdata + offset, bytes_to_copy);
+#endif
+
+      buf += bytes_to_copy;
+      size -= bytes_to_copy;
+      tail += bytes_to_copy;
+
+      g_mutex_lock(&self->priv.pinmutex);
+      self->priv.rxcursor = tail;
+      remote_offload_comms_io_shm_release_consumed(self);
+      g_mutex_unlock(&self->priv.pinmutex);
+   }
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static void shm_pinned_region_release(gpointer data)
+{
+   ShmPinnedRegion *region = (ShmPinnedRegion *)data;
+   RemoteOffloadCommsIOShm *self = region->commsio;
+
+   g_mutex_lock(&self->priv.pinmutex);
+   region->released = TRUE;
+   remote_offload_comms_io_shm_release_consumed(self);
+   g_mutex_unlock(&self->priv.pinmutex);
+
+   //the ring stays mapped for as long as a memory wraps part of it
+   g_object_unref(self);
+}
+
+//Hand over the next size bytes as a memory that wraps the rx ring, without
+// copying them. The ring space is given back to the producer once the memory
+// is freed. This is only done if the bytes are contiguous within the ring, and
+// if the bytes held back by earlier regions still in use, plus these, fit within
+// half of the ring, so that the producer keeps room for the transfers that follow.
+// Otherwise, *mem is set to NULL, and the caller reads the bytes itself.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_read_mem_ref(RemoteOffloadCommsIO *commsio,
+                                         guint64 size,
+                                         GstMemory **mem)
+{
+   RemoteOffloadCommsIOShm *self = REMOTEOFFLOAD_COMMSIOSHM(commsio);
+   ShmRing *ring = self->priv.rxring;
+   const guint64 ring_size = self->priv.ring_size;
+
+   *mem = NULL;
+
+   if( size < SHM_WRAP_MIN_SIZE )
+      return REMOTEOFFLOADCOMMSIO_SUCCESS;
+
+   guint64 start = self->priv.rxcursor;
+   guint64 offset = start % ring_size;
+   if( offset + size > ring_size )
+      return REMOTEOFFLOADCOMMSIO_SUCCESS;
+
+   //only this thread advances the tail, apart from releases (which only advance
+   // it), so this is an upper bound of the space held back.
+   if( (start + size - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) > ring_size / 2 )
+      return REMOTEOFFLOADCOMMSIO_SUCCESS;
+
+   //wait for the whole segment to arrive. This can't stall on the pinned
+   // regions, as the producer has room to write all of it.
+   guint64 head;
+   while( ((head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) - start) < size )
+   {
+      RemoteOffloadCommsIOResult res =
+            remote_offload_comms_io_shm_wait(self, &ring->data_seq,
+                                             &ring->consumer_waiting,
+                                             &ring->head, head);
+      if( res != REMOTEOFFLOADCOMMSIO_SUCCESS )
+         return res;
+   }
+
+   ShmPinnedRegion *region = g_new(ShmPinnedRegion, 1);
+   region->commsio = g_object_ref(self);
+   region->start = start;
+   region->end = start + size;
+   region->released = FALSE;
+
+   g_mutex_lock(&self->priv.pinmutex);
+   g_queue_push_tail(self->priv.pinned, region);
+   self->priv.rxcursor = region->end;
+   g_mutex_unlock(&self->priv.pinmutex);
+
+   *mem = gst_memory_new_wrapped(0, self->priv.rxdata + offset, size, 0, size,
+                                 region, shm_pinned_region_release);
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_read(RemoteOffloadCommsIO *commsio,
+                                 guint8 *buf,
+                                 guint64 size)
+{
+   RemoteOffloadCommsIOShm *pCommsIOShm = REMOTEOFFLOAD_COMMSIOSHM(commsio);
+
+   if( !buf || !size )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   return remote_offload_comms_io_shm_read_buf(pCommsIOShm, buf, size);
+}
+
+//read each GstMemory in mem_list directly from the ring, without
+// staging through an intermediate buffer.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_read_mem_list(RemoteOffloadCommsIO *commsio,
+                                          GList *mem_list)
+{
+   RemoteOffloadCommsIOShm *pCommsIOShm = REMOTEOFFLOAD_COMMSIOSHM(commsio);
+
+   RemoteOffloadCommsIOResult ret = REMOTEOFFLOADCOMMSIO_SUCCESS;
+   for( GList *li = mem_list; li != NULL; li = li->next )
+   {
+      GstMemory *mem = (GstMemory *)li->data;
+      GstMapInfo mapInfo;
+      if( !gst_memory_map (mem, &mapInfo, GST_MAP_WRITE) )
+      {
+         GST_ERROR_OBJECT(pCommsIOShm, "Error mapping mem %p for write", mem);
+         return REMOTEOFFLOADCOMMSIO_FAIL;
+      }
+
+      if( mapInfo.size )
+         ret = remote_offload_comms_io_shm_read_buf(pCommsIOShm, mapInfo.data, mapInfo.size);
+
+      gst_memory_unmap(mem, &mapInfo);
+
+      if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+         break;
+   }
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_write(RemoteOffloadCommsIO *commsio,
+                                  guint8 *buf,
+                                  guint64 size)
+{
+   RemoteOffloadCommsIOShm *pCommsIOShm = REMOTEOFFLOAD_COMMSIOSHM(commsio);
+
+   if( !buf || !size )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   if( pCommsIOShm->priv.shutdownAsserted )
+      return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+
+   return remote_offload_comms_io_shm_write_buf(pCommsIOShm, buf, size);
+}
+
+//write each GstMemory in mem_list directly into the ring, without
+// staging through an intermediate buffer.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_shm_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                           GList *mem_list)
+{
+   RemoteOffloadCommsIOShm *pCommsIOShm = REMOTEOFFLOAD_COMMSIOSHM(commsio);
+
+   if( pCommsIOShm->priv.shutdownAsserted )
+      return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+
+   RemoteOffloadCommsIOResult ret = REMOTEOFFLOADCOMMSIO_SUCCESS;
+   for( GList *li = mem_list; li != NULL; li = li->next )
+   {
+      GstMemory *mem = (GstMemory *)li->data;
+      GstMapInfo mapInfo;
+      if( !gst_memory_map (mem, &mapInfo, GST_MAP_READ) )
+      {
+         GST_ERROR_OBJECT(pCommsIOShm, "Error mapping mem %p for read", mem);
+         return REMOTEOFFLOADCOMMSIO_FAIL;
+      }
+
+      if( mapInfo.size )
+         ret = remote_offload_comms_io_shm_write_buf(pCommsIOShm, mapInfo.data, mapInfo.size);
+
+      gst_memory_unmap(mem, &mapInfo);
+
+      if( ret != REMOTEOFFLOADCOMMSIO_SUCCESS )
+         break;
+   }
+
+   return ret;
+}
+
+static void remote_offload_comms_io_shm_shutdown(RemoteOffloadCommsIO *commsio)
+{
+   RemoteOffloadCommsIOShm *pCommsIOShm = REMOTEOFFLOAD_COMMSIOSHM(commsio);
+
+   g_mutex_lock(&pCommsIOShm->priv.shutdownmutex);
+   if( !pCommsIOShm->priv.shutdownAsserted )
+   {
+      pCommsIOShm->priv.shutdownAsserted = TRUE;
+
+      //Flag the closure for both sides, and wake any thread (local or remote)
+      // waiting on either ring. Any data already in the rings can still be
+      // read by the peer.
+      __atomic_store_n(&pCommsIOShm->priv.header->closed, 1, __ATOMIC_SEQ_CST);
+      for( guint i = 0; i < 2; i++ )
+      {
+         ShmRing *ring = &pCommsIOShm->priv.header->rings[i];
+         __atomic_add_fetch(&ring->data_seq, 1, __ATOMIC_SEQ_CST);
+         __atomic_add_fetch(&ring->space_seq, 1, __ATOMIC_SEQ_CST);
+         shm_futex_wake(&ring->data_seq);
+         shm_futex_wake(&ring->space_seq);
+      }
+   }
+   else
+   {
+      GST_WARNING_OBJECT (pCommsIOShm,
+                          "shutdown has previously been asserted.");
+   }
+   g_mutex_unlock(&pCommsIOShm->priv.shutdownmutex);
+}
+
+static GList * remote_offload_comms_io_shm_get_consumable_memfeatures
+        (RemoteOffloadCommsIO *commsio)
+{
+   GList *consumable_mem_features = NULL;
+
+   //As far as can be observed from testing, memory:VASurface is mappable from a READ
+   // perspective.
+   consumable_mem_features = g_list_append(consumable_mem_features,
+                                gst_caps_features_new("memory:VASurface", NULL));
+
+   return consumable_mem_features;
+}
+
+static void
+remote_offload_comms_io_shm_interface_init (RemoteOffloadCommsIOInterface *iface)
+{
+  iface->read = remote_offload_comms_io_shm_read;
+  iface->read_mem_list = remote_offload_comms_io_shm_read_mem_list;
+  iface->read_mem_ref = remote_offload_comms_io_shm_read_mem_ref;
+  iface->write = remote_offload_comms_io_shm_write;
+  iface->write_mem_list = remote_offload_comms_io_shm_write_mem_list;
+  iface->shutdown = remote_offload_comms_io_shm_shutdown;
+  iface->get_consumable_memfeatures = remote_offload_comms_io_shm_get_consumable_memfeatures;
+}
+
+static void
+remote_offload_comms_io_shm_finalize (GObject *gobject)
+{
+  RemoteOffloadCommsIOShm *pCommsIOShm = REMOTEOFFLOAD_COMMSIOSHM(gobject);
+
+  if( pCommsIOShm->priv.region )
+     munmap(pCommsIOShm->priv.region, pCommsIOShm->priv.region_size);
+
+  if( pCommsIOShm->priv.sockfd >= 0 )
+     close(pCommsIOShm->priv.sockfd);
+
+  //every pinned region holds a reference, so they've all been released by now
+  g_queue_free_full(pCommsIOShm->priv.pinned, g_free);
+  g_mutex_clear(&pCommsIOShm->priv.pinmutex);
+  g_mutex_clear(&pCommsIOShm->priv.shutdownmutex);
+
+  G_OBJECT_CLASS (remote_offload_comms_io_shm_parent_class)->finalize (gobject);
+}
+
+static void
+remote_offload_comms_io_shm_class_init (RemoteOffloadCommsIOShmClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = remote_offload_comms_io_shm_finalize;
+}
+
+static void
+remote_offload_comms_io_shm_init (RemoteOffloadCommsIOShm *self)
+{
+  self->priv.sockfd = -1;
+  self->priv.region = NULL;
+  self->priv.region_size = 0;
+  self->priv.header = NULL;
+  self->priv.ring_size = 0;
+  self->priv.txring = NULL;
+  self->priv.txdata = NULL;
+  self->priv.rxring = NULL;
+  self->priv.rxdata = NULL;
+  self->priv.rxcursor = 0;
+  g_mutex_init(&self->priv.pinmutex);
+  self->priv.pinned = g_queue_new();
+  g_mutex_init(&self->priv.shutdownmutex);
+  self->priv.shutdownAsserted = FALSE;
+}
+
+//Create a new commsio object, given a mapped region & connected unix socket.
+// Ownership of both is passed to the returned object.
+static RemoteOffloadCommsIOShm *
+remote_offload_comms_io_shm_new(int sockfd,
+                                guint8 *region,
+                                gsize region_size,
+                                gboolean bserver)
+{
+   RemoteOffloadCommsIOShm *pCommsIOShm =
+         g_object_new(REMOTEOFFLOADCOMMSIOSHM_TYPE, NULL);
+
+   pCommsIOShm->priv.sockfd = sockfd;
+   pCommsIOShm->priv.region = region;
+   pCommsIOShm->priv.region_size = region_size;
+   pCommsIOShm->priv.header = (ShmRegionHeader *)region;
+   pCommsIOShm->priv.ring_size = pCommsIOShm->priv.header->ring_size;
+
+   guint8 *ring0data = region + SHM_REGION_HEADER_SIZE;
+   guint8 *ring1data = ring0data + pCommsIOShm->priv.ring_size;
+
+   if( bserver )
+   {
+      pCommsIOShm->priv.rxring = &pCommsIOShm->priv.header->rings[0];
+      pCommsIOShm->priv.rxdata = ring0data;
+      pCommsIOShm->priv.txring = &pCommsIOShm->priv.header->rings[1];
+      pCommsIOShm->priv.txdata = ring1data;
+   }
+   else
+   {
+      pCommsIOShm->priv.txring = &pCommsIOShm->priv.header->rings[0];
+      pCommsIOShm->priv.txdata = ring0data;
+      pCommsIOShm->priv.rxring = &pCommsIOShm->priv.header->rings[1];
+      pCommsIOShm->priv.rxdata = ring1data;
+   }
+
+   return pCommsIOShm;
+}
+
+static gboolean shm_fill_sockaddr(const gchar *socket_path, struct sockaddr_un *addr)
+{
+   memset(addr, 0, sizeof(*addr));
+   addr->sun_family = AF_UNIX;
+
+   if( strlen(socket_path) >= sizeof(addr->sun_path) )
+   {
+      GST_ERROR("socket path too long: %s", socket_path);
+      return FALSE;
+   }
+
+   g_strlcpy(addr->sun_path, socket_path, sizeof(addr->sun_path));
+
+   return TRUE;
+}
+
+RemoteOffloadCommsIOShm *remote_offload_comms_io_shm_connect (const gchar *socket_path,
+                                                              guint64 ring_size)
+{
+   g_type_ensure(REMOTEOFFLOADCOMMSIOSHM_TYPE);
+
+   if( !socket_path || !ring_size )
+      return NULL;
+
+   struct sockaddr_un addr;
+   if( !shm_fill_sockaddr(socket_path, &addr) )
+      return NULL;
+
+   gsize region_size = SHM_REGION_HEADER_SIZE + 2*ring_size;
+
+   int memfd = memfd_create("gst-remote-offload-shm", MFD_CLOEXEC);
+   if( memfd < 0 )
+   {
+      GST_ERROR("memfd_create failed: %s", g_strerror(errno));
+      return NULL;
+   }
+
+   if( ftruncate(memfd, region_size) < 0 )
+   {
+      GST_ERROR("ftruncate(%"G_GSIZE_FORMAT") failed: %s", region_size, g_strerror(errno));
+      close(memfd);
+      return NULL;
+   }
+
+   guint8 *region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+   if( region == MAP_FAILED )
+   {
+      GST_ERROR("mmap failed: %s", g_strerror(errno));
+      close(memfd);
+      return NULL;
+   }
+
+   //ftruncate'd memory is zero-filled, so only the non-zero fields need to be set
+   ShmRegionHeader *header = (ShmRegionHeader *)region;
+   header->magic = SHM_COMMSIO_MAGIC;
+   header->version = SHM_COMMSIO_VERSION;
+   header->ring_size = ring_size;
+
+   int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if( sockfd < 0 )
+   {
+      GST_ERROR("socket failed: %s", g_strerror(errno));
+      munmap(region, region_size);
+      close(memfd);
+      return NULL;
+   }
+
+   if( connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 )
+   {
+      GST_ERROR("Unable to connect to %s: %s", socket_path, g_strerror(errno));
+      close(sockfd);
+      munmap(region, region_size);
+      close(memfd);
+      return NULL;
+   }
+
+   //send the memfd to the server, along with the ring size
+   union
+   {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   }cmsgbuf;
+   memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+
+   struct iovec iov = { &ring_size, sizeof(ring_size) };
+   struct msghdr msg = {0};
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = cmsgbuf.buf;
+   msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+   ssize_t sent;
+   do
+   {
+      sent = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+   } while( (sent < 0) && (errno == EINTR) );
+
+   //the mapping stays valid after the memfd is closed.
+   close(memfd);
+
+   if( sent != sizeof(ring_size) )
+   {
+      GST_ERROR("Error sending shared memory fd to %s", socket_path);
+      close(sockfd);
+      munmap(region, region_size);
+      return NULL;
+   }
+
+   GST_DEBUG("Connected to %s, ring_size=%"G_GUINT64_FORMAT, socket_path, ring_size);
+
+   return remote_offload_comms_io_shm_new(sockfd, region, region_size, FALSE);
+}
+
+int remote_offload_comms_io_shm_listen (const gchar *socket_path)
+{
+   g_type_ensure(REMOTEOFFLOADCOMMSIOSHM_TYPE);
+
+   if( !socket_path )
+      return -1;
+
+   struct sockaddr_un addr;
+   if( !shm_fill_sockaddr(socket_path, &addr) )
+      return -1;
+
+   int listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if( listenfd < 0 )
+   {
+      GST_ERROR("socket failed: %s", g_strerror(errno));
+      return -1;
+   }
+
+   //remove a stale socket left behind from a previous run
+   unlink(socket_path);
+
+   if( (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+       (listen(listenfd, SOMAXCONN) < 0) )
+   {
+      GST_ERROR("Unable to listen on %s: %s", socket_path, g_strerror(errno));
+      close(listenfd);
+      return -1;
+   }
+
+   return listenfd;
+}
+
+RemoteOffloadCommsIOShm *remote_offload_comms_io_shm_accept (int listenfd,
+                                                             gboolean *listen_error)
+{
+   if( listen_error )
+      *listen_error = FALSE;
+
+   int sockfd;
+   do
+   {
+      sockfd = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+   } while( (sockfd < 0) && ((errno == EINTR) || (errno == ECONNABORTED)) );
+
+   if( sockfd < 0 )
+   {
+      if( listen_error )
+         *listen_error = TRUE;
+      return NULL;
+   }
+
+   union
+   {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   }cmsgbuf;
+   memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+
+   guint64 ring_size = 0;
+   struct iovec iov = { &ring_size, sizeof(ring_size) };
+   struct msghdr msg = {0};
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = cmsgbuf.buf;
+   msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+   ssize_t received;
+   do
+   {
+      received = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+   } while( (received < 0) && (errno == EINTR) );
+
+   int memfd = -1;
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   if( cmsg &&
+       (cmsg->cmsg_level == SOL_SOCKET) &&
+       (cmsg->cmsg_type == SCM_RIGHTS) &&
+       (cmsg->cmsg_len == CMSG_LEN(sizeof(int))) )
+   {
+      memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+   }
+
+   if( (received != sizeof(ring_size)) || (memfd < 0) || !ring_size )
+   {
+      GST_ERROR("Invalid handshake from client");
+      if( memfd >= 0 )
+         close(memfd);
+      close(sockfd);
+      return NULL;
+   }
+
+   gsize region_size = SHM_REGION_HEADER_SIZE + 2*ring_size;
+
+   //make sure that the client didn't lie about the region size
+   struct stat st;
+   if( (fstat(memfd, &st) < 0) || ((gsize)st.st_size < region_size) )
+   {
+      GST_ERROR("Shared memory region is smaller than expected");
+      close(memfd);
+      close(sockfd);
+      return NULL;
+   }
+
+   guint8 *region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+   close(memfd);
+
+   if( region == MAP_FAILED )
+   {
+      GST_ERROR("mmap failed: %s", g_strerror(errno));
+      close(sockfd);
+      return NULL;
+   }
+
+   ShmRegionHeader *header = (ShmRegionHeader *)region;
+   if( (header->magic != SHM_COMMSIO_MAGIC) ||
+       (header->version != SHM_COMMSIO_VERSION) ||
+       (header->ring_size != ring_size) )
+   {
+      GST_ERROR("Invalid shared memory region header");
+      munmap(region, region_size);
+      close(sockfd);
+      return NULL;
+   }
+
+   GST_DEBUG("Accepted new connection, ring_size=%"G_GUINT64_FORMAT, ring_size);
+
+   return remote_offload_comms_io_shm_new(sockfd, region, region_size, TRUE);
+}
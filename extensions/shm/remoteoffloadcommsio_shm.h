@@ -0,0 +1,62 @@
+/*
+ *  remoteoffloadcommsio_shm.h - RemoteOffloadCommsIOShm object
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef __REMOTEOFFLOAD_COMMS_IO_SHM_H__
+#define __REMOTEOFFLOAD_COMMS_IO_SHM_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+//unix socket path used by client & server to exchange the
+// shared memory file descriptor, if not explicitly specified
+#define SHM_COMMSIO_DEFAULT_SOCKET_PATH "/tmp/gst-remote-offload-shm"
+
+//default size of each (per-direction) ring buffer
+#define SHM_COMMSIO_DEFAULT_RING_SIZE (8*1024*1024)
+
+#define REMOTEOFFLOADCOMMSIOSHM_TYPE (remote_offload_comms_io_shm_get_type ())
+G_DECLARE_FINAL_TYPE (RemoteOffloadCommsIOShm,
+                      remote_offload_comms_io_shm,
+                      REMOTEOFFLOAD, COMMSIOSHM, GObject)
+
+//Client-side: Create a new shared-memory region containing two ring buffers
+// (one per direction) of ring_size bytes each, and pass it to the server
+// listening on socket_path.
+RemoteOffloadCommsIOShm *remote_offload_comms_io_shm_connect (const gchar *socket_path,
+                                                              guint64 ring_size);
+
+//Server-side: Create a unix socket, listening on socket_path.
+// Returns the listening socket fd, or -1 on failure.
+int remote_offload_comms_io_shm_listen (const gchar *socket_path);
+
+//Server-side: Accept a new connection on listenfd, and create a new
+// CommsIO object from the shared-memory region sent by the client.
+// On failure, *listen_error is set to TRUE if the error was with the
+// listening socket itself (as opposed to this particular connection).
+RemoteOffloadCommsIOShm *remote_offload_comms_io_shm_accept (int listenfd,
+                                                             gboolean *listen_error);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOAD_COMMS_IO_SHM_H__ */
@@ -0,0 +1,96 @@
+/*
+ *  remoteoffloadextensionshm.c - RemoteOffloadExtensionShm object
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <gst/gst.h>
+#include "remoteoffloadextension.h"
+#include "shmdeviceproxy.h"
+#include "remoteoffloaddeviceproxy.h"
+
+#define REMOTEOFFLOADEXTENSIONSHM_TYPE (remote_offload_extension_shm_get_type ())
+G_DECLARE_FINAL_TYPE (RemoteOffloadExtensionShm,
+                      remote_offload_extension_shm, REMOTEOFFLOAD, EXTENSIONSHM, GObject)
+
+struct _RemoteOffloadExtensionShm
+{
+  GObject parent_instance;
+};
+
+GST_DEBUG_CATEGORY_STATIC (shm_extension_debug);
+#define GST_CAT_DEFAULT shm_extension_debug
+
+static void remote_offload_extension_shm_interface_init (RemoteOffloadExtensionInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RemoteOffloadExtensionShm, remote_offload_extension_shm, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADEXTENSION_TYPE,
+                         remote_offload_extension_shm_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (shm_extension_debug,
+                         "remoteoffloadextensionshm", 0,
+                         "debug category for RemoteOffloadExtensionShm"))
+
+
+static GArray *remote_offload_extension_shm_generate(RemoteOffloadExtension *ext,
+                                                     GType type)
+{
+   if( type == REMOTEOFFLOADDEVICEPROXY_TYPE )
+   {
+      GArray *commschannelarray = g_array_new(FALSE, FALSE, sizeof(RemoteOffloadExtTypePair));
+
+      ShmDeviceProxy *proxy = shm_device_proxy_new();
+      RemoteOffloadExtTypePair pair = {"shm", (GObject *)proxy};
+      if( proxy )
+      {
+         g_array_append_val(commschannelarray, pair);
+         return commschannelarray;
+      }
+      else
+      {
+         GST_ERROR_OBJECT(ext, "shm_device_proxy_new failed");
+         g_array_free(commschannelarray, TRUE);
+      }
+   }
+
+   return NULL;
+}
+
+static void
+remote_offload_extension_shm_interface_init (RemoteOffloadExtensionInterface *iface)
+{
+  iface->generate = remote_offload_extension_shm_generate;
+}
+
+static void
+remote_offload_extension_shm_class_init (RemoteOffloadExtensionShmClass *klass)
+{
+
+}
+
+static void
+remote_offload_extension_shm_init (RemoteOffloadExtensionShm *self)
+{
+
+}
+
+__attribute__ ((visibility ("default"))) RemoteOffloadExtension* remoteoffload_extension_entry();
+
+RemoteOffloadExtension* remoteoffload_extension_entry()
+{
+   return g_object_new(REMOTEOFFLOADEXTENSIONSHM_TYPE, NULL);
+}
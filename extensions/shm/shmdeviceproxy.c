@@ -0,0 +1,264 @@
+/*
+ *  shmdeviceproxy.c - ShmDeviceProxy object
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include "shmdeviceproxy.h"
+#include "remoteoffloaddeviceproxy.h"
+#include "remoteoffloadclientserverutil.h"
+#include "remoteoffloadcommsio_shm.h"
+
+typedef struct
+{
+   GArray *commsio_array; //GArray of RemoteOffloadCommsIO* that this obj. generated.
+
+   GOptionContext *option_context;
+   GArray *option_entries; //array of GOptionEntry's
+   gboolean bsharedconnection;
+
+   gchar *socket_path;
+   gint ring_size;
+} ShmDeviceProxyPrivate;
+
+struct _ShmDeviceProxy
+{
+  GObject parent_instance;
+
+  /* Other members, including private data. */
+  ShmDeviceProxyPrivate priv;
+};
+
+GST_DEBUG_CATEGORY_STATIC (shm_device_proxy_debug);
+#define GST_CAT_DEFAULT shm_device_proxy_debug
+
+static void
+shm_device_proxy_interface_init (RemoteOffloadDeviceProxyInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (ShmDeviceProxy, shm_device_proxy, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADDEVICEPROXY_TYPE,
+                         shm_device_proxy_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (shm_device_proxy_debug,
+                         "remoteoffloadcommschannelgeneratorshm", 0,
+                         "debug category for ShmDeviceProxy"))
+
+//Create nconnections shared-memory connections to the server. Each one
+// is handed to the server's pipeline spawner as a separate connection.
+static GArray* shm_comms_channel_generate_commsio(ShmDeviceProxy *self,
+                                                  guint nconnections)
+{
+   const gchar *socket_path = self->priv.socket_path ?
+                              self->priv.socket_path : SHM_COMMSIO_DEFAULT_SOCKET_PATH;
+
+   if( self->priv.ring_size <= 0 )
+   {
+      GST_ERROR_OBJECT (self, "Invalid ringsize=%d", self->priv.ring_size);
+      return NULL;
+   }
+
+   GArray *commsio_array = g_array_new(FALSE, FALSE, sizeof(RemoteOffloadCommsIO *));
+
+   for( guint i = 0; i < nconnections; i++ )
+   {
+      RemoteOffloadCommsIOShm *commsio =
+            remote_offload_comms_io_shm_connect(socket_path, self->priv.ring_size);
+
+      if( !commsio )
+      {
+         GST_ERROR_OBJECT (self, "Error connecting to %s", socket_path);
+
+         for( guint j = 0; j < commsio_array->len; j++ )
+         {
+            g_object_unref(g_array_index(commsio_array, RemoteOffloadCommsIO *, j));
+         }
+         g_array_free(commsio_array, TRUE);
+         return NULL;
+      }
+
+      g_array_append_val(commsio_array, commsio);
+   }
+
+   GST_INFO_OBJECT (self, "Opened %u connection(s) to %s", nconnections, socket_path);
+
+   return commsio_array;
+}
+
+//Given a GArray of CommsChannelRequest's,
+// return a channel_id(gint) to RemoteOffloadCommsChannel*
+static GHashTable* shm_deviceproxy_generate(RemoteOffloadDeviceProxy *proxy,
+                                            GstBin *bin,
+                                            GArray *commschannelrequests)
+{
+   (void)bin;
+
+   if( !DEVICEPROXY_IS_SHM(proxy) ||
+         !commschannelrequests ||
+         (commschannelrequests->len < 1) )
+      return NULL;
+
+   ShmDeviceProxy *self = DEVICEPROXY_SHM (proxy);
+
+   guint nconnections = self->priv.bsharedconnection ? 1 : commschannelrequests->len;
+
+   self->priv.commsio_array = shm_comms_channel_generate_commsio(self, nconnections);
+   if( !self->priv.commsio_array )
+   {
+      GST_ERROR_OBJECT (self, "Error in shm_comms_channel_generate_commsio");
+      return NULL;
+   }
+
+   CommsChannelRequest *requests = (CommsChannelRequest *)commschannelrequests->data;
+   GArray *id_commsio_pair_array = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
+
+   for( guint requesti = 0; requesti < commschannelrequests->len; requesti++ )
+   {
+      guint commsio_index = self->priv.bsharedconnection ? 0 : requesti;
+
+      RemoteOffloadCommsIO *commsio = g_array_index(self->priv.commsio_array,
+                                                    RemoteOffloadCommsIO *,
+                                                    commsio_index);
+
+      ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio};
+      g_array_append_val(id_commsio_pair_array, pair);
+      GST_DEBUG_OBJECT (self, "id_commsio_pair_array[%d] = (%d,%p)",
+                       requesti, pair.channel_id, pair.commsio);
+   }
+
+   GHashTable *id_to_channel_hash = NULL;
+   if( remote_offload_request_new_pipeline(id_commsio_pair_array) )
+   {
+      id_to_channel_hash = id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array);
+
+      if( !id_to_channel_hash )
+      {
+         GST_ERROR_OBJECT (self, "Error in id_commsio_pair_array_to_id_to_channel_hash");
+      }
+   }
+   else
+   {
+      GST_ERROR_OBJECT (self, "Error in remote_offload_request_new_pipeline");
+   }
+
+   g_array_free(id_commsio_pair_array, TRUE);
+
+   return id_to_channel_hash;
+}
+
+static gboolean
+shm_deviceproxy_set_arguments(RemoteOffloadDeviceProxy *proxy,
+                              gchar *arguments_string)
+{
+   if( !DEVICEPROXY_IS_SHM(proxy) )
+      return FALSE;
+
+   if( !arguments_string )
+      return TRUE;
+
+   ShmDeviceProxy *self = DEVICEPROXY_SHM (proxy);
+
+   gboolean ret =
+         remote_offload_deviceproxy_parse_arguments_string(self->priv.option_context,
+                                                           arguments_string);
+
+   return ret;
+}
+
+static void
+shm_device_proxy_interface_init (RemoteOffloadDeviceProxyInterface *iface)
+{
+   iface->deviceproxy_generate_commschannels = shm_deviceproxy_generate;
+   iface->deviceproxy_set_arguments = shm_deviceproxy_set_arguments;
+}
+
+static void
+shm_device_proxy_finalize (GObject *gobject)
+{
+  ShmDeviceProxy *self = DEVICEPROXY_SHM (gobject);
+
+  if( self->priv.commsio_array )
+  {
+     for( guint i = 0; i < self->priv.commsio_array->len; i++ )
+     {
+        RemoteOffloadCommsIO *commsio =
+              g_array_index(self->priv.commsio_array,
+                            RemoteOffloadCommsIO *,
+                            i);
+        g_object_unref(commsio);
+     }
+
+     g_array_free(self->priv.commsio_array, TRUE);
+  }
+
+  g_free(self->priv.socket_path);
+
+  g_option_context_free(self->priv.option_context);
+  g_array_free(self->priv.option_entries, TRUE);
+
+  G_OBJECT_CLASS (shm_device_proxy_parent_class)->finalize (gobject);
+}
+
+static void
+shm_device_proxy_class_init (ShmDeviceProxyClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = shm_device_proxy_finalize;
+}
+
+static void
+shm_device_proxy_init (ShmDeviceProxy *self)
+{
+   self->priv.commsio_array = NULL;
+
+   self->priv.option_context = g_option_context_new(" - Shared-Memory Comms Channel Generator");
+   self->priv.option_entries = g_array_new(FALSE, FALSE, sizeof(GOptionEntry));
+
+   self->priv.socket_path = NULL;
+   GOptionEntry socket_entry =
+     { "socket", 0, 0, G_OPTION_ARG_STRING,
+       &self->priv.socket_path,
+     "Unix socket path that the shm server is listening on "
+     "(default=" SHM_COMMSIO_DEFAULT_SOCKET_PATH ")", NULL};
+   g_array_append_val(self->priv.option_entries, socket_entry);
+
+   self->priv.ring_size = SHM_COMMSIO_DEFAULT_RING_SIZE;
+   GOptionEntry ringsize_entry =
+     { "ringsize", 0, 0, G_OPTION_ARG_INT,
+       &self->priv.ring_size,
+     "Size, in bytes, of each (per-direction) shared memory ring buffer", NULL};
+   g_array_append_val(self->priv.option_entries, ringsize_entry);
+
+   self->priv.bsharedconnection = FALSE;
+   GOptionEntry sharedconnection_entry =
+     { "sharedconnection", 0, 0, G_OPTION_ARG_NONE,
+     &self->priv.bsharedconnection,
+     "Share a single shared memory connection for all data/control streams", NULL};
+   g_array_append_val(self->priv.option_entries, sharedconnection_entry);
+
+   GOptionEntry null_entry = { NULL };
+   g_array_append_val(self->priv.option_entries, null_entry);
+
+   g_option_context_set_help_enabled(self->priv.option_context, FALSE);
+   g_option_context_add_main_entries (self->priv.option_context,
+                                      (GOptionEntry*)self->priv.option_entries->data, NULL);
+}
+
+ShmDeviceProxy *shm_device_proxy_new ()
+{
+   return g_object_new(SHMDEVICEPROXY_TYPE, NULL);
+}
@@ -0,0 +1,40 @@
+/*
+ *  shmdeviceproxy.h - ShmDeviceProxy object
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef __SHMDEVICEPROXY_H__
+#define __SHMDEVICEPROXY_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define SHMDEVICEPROXY_TYPE (shm_device_proxy_get_type ())
+G_DECLARE_FINAL_TYPE (ShmDeviceProxy,
+                      shm_device_proxy, DEVICEPROXY, SHM, GObject)
+
+ShmDeviceProxy *shm_device_proxy_new ();
+
+G_END_DECLS
+
+
+
+#endif /* __SHMDEVICEPROXY_H__ */
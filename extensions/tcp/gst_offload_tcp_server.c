@@ -0,0 +1,261 @@
+/*
+ *  gst_offload_tcp_server.c - Remote Offload TCP Server Application
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "remoteoffloadclientserverutil.h"
+#include "gstremoteoffloadpipeline.h"
+#include "remoteoffloadcommsio_tcp.h"
+
+GST_DEBUG_CATEGORY_STATIC (remote_offload_tcp_server_debug);
+#define GST_CAT_DEFAULT remote_offload_tcp_server_debug
+
+static void tcp_server_sig_handler(int sig);
+
+static volatile sig_atomic_t g_bserver_exit = 0;
+static int g_listenfd = -1;
+
+static void tcp_server_run_ropinstance(GArray *id_commsio_pair_array, void *user_data)
+{
+   (void)user_data;
+
+   GHashTable *id_to_channel_hash =
+            id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array);
+
+   if( id_to_channel_hash )
+   {
+      RemoteOffloadPipeline *pPipeline =
+            remote_offload_pipeline_new(NULL, id_to_channel_hash);
+
+      if( pPipeline )
+      {
+         if( !remote_offload_pipeline_run(pPipeline) )
+         {
+            GST_ERROR("remote_offload_pipeline_run failed");
+         }
+
+         g_object_unref(pPipeline);
+      }
+      else
+      {
+         GST_ERROR("Error in remote_offload_pipeline_new");
+      }
+
+      g_hash_table_unref(id_to_channel_hash);
+   }
+   else
+   {
+      GST_ERROR("Invalid PipelinePlaceholder");
+   }
+}
+
+//Create a socket bound to bindaddr:port, and start listening on it.
+static int tcp_server_listen(const gchar *bindaddr,
+                             gint port,
+                             const TCPCommsIOSocketParams *params)
+{
+   gchar portstr[8];
+   g_snprintf(portstr, sizeof(portstr), "%d", port);
+
+   struct addrinfo hints = {0};
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_protocol = IPPROTO_TCP;
+   hints.ai_flags = AI_PASSIVE;
+
+   struct addrinfo *result = NULL;
+   int err = getaddrinfo(bindaddr, portstr, &hints, &result);
+   if( err )
+   {
+      g_print("getaddrinfo failed: %s\n", gai_strerror(err));
+      return -1;
+   }
+
+   int listenfd = -1;
+   for( struct addrinfo *rp = result; rp != NULL; rp = rp->ai_next )
+   {
+      listenfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+      if( listenfd < 0 )
+         continue;
+
+      int reuse = 1;
+      setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+      //accepted sockets inherit the buffer sizes of the listening socket,
+      // which need to be set before listen() to affect the TCP window scale.
+      remote_offload_comms_io_tcp_apply_socket_params(listenfd, params);
+
+      if( (bind(listenfd, rp->ai_addr, rp->ai_addrlen) == 0) &&
+          (listen(listenfd, SOMAXCONN) == 0) )
+      {
+         break;
+      }
+
+      close(listenfd);
+      listenfd = -1;
+   }
+
+   freeaddrinfo(result);
+
+   return listenfd;
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, tcp_server_sig_handler);
+   signal(SIGTERM, tcp_server_sig_handler);
+
+   gint port = TCP_COMMSIO_DEFAULT_PORT;
+   gchar *bindaddr = NULL;
+   gboolean bdisable_nodelay = FALSE;
+   gint sndbuf = 0;
+   gint rcvbuf = 0;
+
+   GOptionEntry entries[] =
+   {
+      { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+        "Port to listen on", NULL },
+      { "bind", 'b', 0, G_OPTION_ARG_STRING, &bindaddr,
+        "Address to bind to (default=all interfaces)", NULL },
+      { "disable_nodelay", 0, 0, G_OPTION_ARG_NONE, &bdisable_nodelay,
+        "Don't set TCP_NODELAY on accepted connections", NULL },
+      { "sndbuf", 0, 0, G_OPTION_ARG_INT, &sndbuf,
+        "Socket send buffer size, in bytes (0=OS default)", NULL },
+      { "rcvbuf", 0, 0, G_OPTION_ARG_INT, &rcvbuf,
+        "Socket receive buffer size, in bytes (0=OS default)", NULL },
+      { NULL }
+   };
+
+   GOptionContext *context = g_option_context_new(" - Remote Offload TCP Server");
+   g_option_context_add_main_entries(context, entries, NULL);
+   g_option_context_add_group(context, gst_init_get_option_group());
+
+   GError *error = NULL;
+   if( !g_option_context_parse(context, &argc, &argv, &error) )
+   {
+      g_print("Error parsing options: %s\n", error ? error->message : "unknown");
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return -1;
+   }
+   g_option_context_free(context);
+
+   GST_DEBUG_CATEGORY_INIT (remote_offload_tcp_server_debug,
+                               "remoteoffloadtcpserver", 0,
+                             "debug category for Remote Offload TCP Server");
+
+   if( (port <= 0) || (port > G_MAXUINT16) )
+   {
+      g_print("Invalid port=%d\n", port);
+      return -1;
+   }
+
+   TCPCommsIOSocketParams params;
+   params.nodelay = !bdisable_nodelay;
+   params.sndbuf = sndbuf;
+   params.rcvbuf = rcvbuf;
+
+   g_listenfd = tcp_server_listen(bindaddr, port, &params);
+   if( g_listenfd < 0 )
+   {
+      g_print("Unable to listen on %s:%d\n", bindaddr ? bindaddr : "*", port);
+      g_free(bindaddr);
+      return -1;
+   }
+
+   g_print("Listening on %s:%d\n", bindaddr ? bindaddr : "*", port);
+   //a parent process (e.g. a test) may be waiting for this line on a pipe
+   fflush(stdout);
+
+   RemoteOffloadPipelineSpawner *spawner = remote_offload_pipeline_spawner_new();
+   if( !spawner )
+   {
+     g_print("Error creating RemoteOffloadPipelineSpawner\n");
+     close(g_listenfd);
+     g_free(bindaddr);
+     return -1;
+   }
+
+   remote_offload_pipeline_set_callback(spawner,
+                                        tcp_server_run_ropinstance,
+                                        NULL);
+
+   while( !g_bserver_exit )
+   {
+      int connfd = accept(g_listenfd, NULL, NULL);
+      if( connfd < 0 )
+      {
+         if( (errno == EINTR) || (errno == ECONNABORTED) )
+            continue;
+
+         if( !g_bserver_exit )
+            g_print("Error in accept: %s\n", g_strerror(errno));
+         break;
+      }
+
+      //ownership of connfd is passed to the commsio object
+      RemoteOffloadCommsIOTCP *commsio = remote_offload_comms_io_tcp_new(connfd, &params);
+      if( !commsio )
+      {
+         g_print("Error creating TCP commsio for new connection\n");
+         continue;
+      }
+
+      //the spawner takes ownership of commsio
+      if( !remote_offload_pipeline_spawner_add_connection(spawner,
+                                                          (RemoteOffloadCommsIO *)commsio))
+      {
+         g_print("Error in remote_offload_pipeline_spawner_add_connection for commsio=%p\n",
+                 commsio);
+         g_object_unref(commsio);
+         break;
+      }
+   }
+
+   close(g_listenfd);
+   g_free(bindaddr);
+
+   g_object_unref(spawner);
+
+   return 0;
+}
+
+static void tcp_server_sig_handler(int sig)
+{
+   //reset the signal handler(s) back to their default case,
+   // in case the user performs another Ctrl^C / kill -15.
+   //  On the second attempt we want to force-ably quit.
+   signal(SIGINT, SIG_DFL);
+   signal(SIGTERM, SIG_DFL);
+
+   //shutting down the listening socket will cause the
+   // main thread blocked in accept() to return with an error.
+   g_bserver_exit = 1;
+   if( g_listenfd >= 0 )
+      shutdown(g_listenfd, SHUT_RDWR);
+}
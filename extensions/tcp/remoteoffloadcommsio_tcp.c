@@ -0,0 +1,461 @@
+/*
+ *  remoteoffloadcommsio_tcp.c - RemoteOffloadCommsIOTCP object
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "remoteoffloadcommsio_tcp.h"
+#include "remoteoffloadcommsio.h"
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+//Number of GstMemory's that can be mapped for a single readv/writev
+// without needing to allocate the GstMapInfo / iovec arrays from the heap.
+#define TCP_COMMSIO_STACK_IOV_COUNT 16
+
+/* Private structure definition. */
+typedef struct
+{
+  int sockfd;
+
+  GMutex shutdownmutex;
+  gboolean shutdownAsserted;
+
+  /* stuff */
+} RemoteOffloadCommsIOTCPPrivate;
+
+struct _RemoteOffloadCommsIOTCP
+{
+  GObject parent_instance;
+
+
+  /* Other members, including private data. */
+  RemoteOffloadCommsIOTCPPrivate priv;
+};
+
+GST_DEBUG_CATEGORY_STATIC (comms_io_tcp_debug);
+#define GST_CAT_DEFAULT comms_io_tcp_debug
+
+static void remote_offload_comms_io_tcp_interface_init (RemoteOffloadCommsIOInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RemoteOffloadCommsIOTCP, remote_offload_comms_io_tcp, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADCOMMSIO_TYPE,
+                         remote_offload_comms_io_tcp_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (comms_io_tcp_debug,
+                         "remoteoffloadcommsiotcp", 0,
+                         "debug category for RemoteOffloadCommsIOTCP"))
+
+//Transfer (send or receive) the entire contents described by iov.
+// Note that the contents of the iov array are modified as
+// partial transfers are completed.
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_tcp_transfer_iov(RemoteOffloadCommsIOTCP *pCommsIOTCP,
+                                         struct iovec *iov,
+                                         int iovcnt,
+                                         gboolean bwrite)
+{
+   while( iovcnt > 0 )
+   {
+      ssize_t n;
+      int cnt = MIN(iovcnt, IOV_MAX);
+
+      if( bwrite )
+      {
+         //This is writev(), but using sendmsg w/ MSG_NOSIGNAL so that
+         // a closed peer results in EPIPE instead of a SIGPIPE.
+         struct msghdr msg = {0};
+         msg.msg_iov = iov;
+         msg.msg_iovlen = cnt;
+         n = sendmsg(pCommsIOTCP->priv.sockfd, &msg, MSG_NOSIGNAL);
+      }
+      else
+      {
+         n = readv(pCommsIOTCP->priv.sockfd, iov, cnt);
+      }
+
+      if( n < 0 )
+      {
+         if( errno == EINTR )
+            continue;
+
+         if( pCommsIOTCP->priv.shutdownAsserted ||
+             (errno == EPIPE) ||
+             (errno == ECONNRESET) )
+         {
+            return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+         }
+
+         GST_ERROR_OBJECT(pCommsIOTCP, "%s failed: %s",
+                          bwrite ? "sendmsg" : "readv", g_strerror(errno));
+         return REMOTEOFFLOADCOMMSIO_FAIL;
+      }
+
+      //peer has performed an orderly shutdown
+      if( !bwrite && (n == 0) )
+      {
+         return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+      }
+
+      //skip past the iovec entries that were fully transferred
+      while( (iovcnt > 0) && ((size_t)n >= iov->iov_len) )
+      {
+         n -= iov->iov_len;
+         iov++;
+         iovcnt--;
+      }
+
+      //and adjust the partially transferred one
+      if( n > 0 )
+      {
+         iov->iov_base = (guint8 *)iov->iov_base + n;
+         iov->iov_len -= n;
+      }
+   }
+
+   return REMOTEOFFLOADCOMMSIO_SUCCESS;
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_tcp_transfer_mem_list(RemoteOffloadCommsIOTCP *pCommsIOTCP,
+                                              GList *mem_list,
+                                              gboolean bwrite)
+{
+   guint nmems = g_list_length(mem_list);
+   if( !nmems )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   GstMapInfo stack_mapinfo[TCP_COMMSIO_STACK_IOV_COUNT];
+   struct iovec stack_iov[TCP_COMMSIO_STACK_IOV_COUNT];
+   GstMapInfo *mapinfo = stack_mapinfo;
+   struct iovec *iov = stack_iov;
+   if( nmems > TCP_COMMSIO_STACK_IOV_COUNT )
+   {
+      mapinfo = g_new(GstMapInfo, nmems);
+      iov = g_new(struct iovec, nmems);
+   }
+
+   RemoteOffloadCommsIOResult ret = REMOTEOFFLOADCOMMSIO_SUCCESS;
+   guint nmapped = 0;
+   int iovcnt = 0;
+   for( GList *li = mem_list; li != NULL; li = li->next )
+   {
+      GstMemory *mem = (GstMemory *)li->data;
+      if( !gst_memory_map(mem, &mapinfo[nmapped], bwrite ? GST_MAP_READ : GST_MAP_WRITE) )
+      {
+         GST_ERROR_OBJECT(pCommsIOTCP, "Error mapping mem %p", mem);
+         ret = REMOTEOFFLOADCOMMSIO_FAIL;
+         break;
+      }
+
+      //zero-sized entries are left out, as a readv() returning 0
+      // would otherwise be mistaken for a closed connection.
+      if( mapinfo[nmapped].size )
+      {
+         iov[iovcnt].iov_base = mapinfo[nmapped].data;
+         iov[iovcnt].iov_len = mapinfo[nmapped].size;
+         iovcnt++;
+      }
+
+      nmapped++;
+   }
+
+   if( ret == REMOTEOFFLOADCOMMSIO_SUCCESS )
+   {
+      ret = remote_offload_comms_io_tcp_transfer_iov(pCommsIOTCP, iov, iovcnt, bwrite);
+   }
+
+   guint memi = 0;
+   for( GList *li = mem_list; (li != NULL) && (memi < nmapped); li = li->next, memi++ )
+   {
+      gst_memory_unmap((GstMemory *)li->data, &mapinfo[memi]);
+   }
+
+   if( mapinfo != stack_mapinfo )
+   {
+      g_free(mapinfo);
+      g_free(iov);
+   }
+
+   return ret;
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_tcp_read(RemoteOffloadCommsIO *commsio,
+                                 guint8 *buf,
+                                 guint64 size)
+{
+   RemoteOffloadCommsIOTCP *pCommsIOTCP = REMOTEOFFLOAD_COMMSIOTCP(commsio);
+
+   if( !buf || !size )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   struct iovec iov = { buf, size };
+   return remote_offload_comms_io_tcp_transfer_iov(pCommsIOTCP, &iov, 1, FALSE);
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_tcp_read_mem_list(RemoteOffloadCommsIO *commsio,
+                                          GList *mem_list)
+{
+   RemoteOffloadCommsIOTCP *pCommsIOTCP = REMOTEOFFLOAD_COMMSIOTCP(commsio);
+
+   return remote_offload_comms_io_tcp_transfer_mem_list(pCommsIOTCP, mem_list, FALSE);
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_tcp_write(RemoteOffloadCommsIO *commsio,
+                                  guint8 *buf,
+                                  guint64 size)
+{
+   RemoteOffloadCommsIOTCP *pCommsIOTCP = REMOTEOFFLOAD_COMMSIOTCP(commsio);
+
+   if( !buf || !size )
+      return REMOTEOFFLOADCOMMSIO_FAIL;
+
+   if( pCommsIOTCP->priv.shutdownAsserted )
+      return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+
+   struct iovec iov = { buf, size };
+   return remote_offload_comms_io_tcp_transfer_iov(pCommsIOTCP, &iov, 1, TRUE);
+}
+
+static RemoteOffloadCommsIOResult
+remote_offload_comms_io_tcp_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                           GList *mem_list)
+{
+   RemoteOffloadCommsIOTCP *pCommsIOTCP = REMOTEOFFLOAD_COMMSIOTCP(commsio);
+
+   if( pCommsIOTCP->priv.shutdownAsserted )
+      return REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED;
+
+   return remote_offload_comms_io_tcp_transfer_mem_list(pCommsIOTCP, mem_list, TRUE);
+}
+
+static void remote_offload_comms_io_tcp_shutdown(RemoteOffloadCommsIO *commsio)
+{
+   RemoteOffloadCommsIOTCP *pCommsIOTCP = REMOTEOFFLOAD_COMMSIOTCP(commsio);
+
+   g_mutex_lock(&pCommsIOTCP->priv.shutdownmutex);
+   if( !pCommsIOTCP->priv.shutdownAsserted )
+   {
+      pCommsIOTCP->priv.shutdownAsserted = TRUE;
+
+      //This will cause a thread blocked within readv to return 0,
+      // and the peer to receive a FIN once all pending data has been sent.
+      // The socket itself is closed upon finalize.
+      if( shutdown(pCommsIOTCP->priv.sockfd, SHUT_RDWR) < 0 )
+      {
+         GST_WARNING_OBJECT (pCommsIOTCP, "shutdown(SHUT_RDWR) failed: %s",
+                             g_strerror(errno));
+      }
+   }
+   else
+   {
+      GST_WARNING_OBJECT (pCommsIOTCP,
+                          "shutdown has previously been asserted.");
+   }
+   g_mutex_unlock(&pCommsIOTCP->priv.shutdownmutex);
+}
+
+static GList * remote_offload_comms_io_tcp_get_consumable_memfeatures
+        (RemoteOffloadCommsIO *commsio)
+{
+   GList *consumable_mem_features = NULL;
+
+   //As far as can be observed from testing, memory:VASurface is mappable from a READ
+   // perspective.
+   consumable_mem_features = g_list_append(consumable_mem_features,
+                                gst_caps_features_new("memory:VASurface", NULL));
+
+   return consumable_mem_features;
+}
+
+static void
+remote_offload_comms_io_tcp_interface_init (RemoteOffloadCommsIOInterface *iface)
+{
+  iface->read = remote_offload_comms_io_tcp_read;
+  iface->read_mem_list = remote_offload_comms_io_tcp_read_mem_list;
+  iface->write = remote_offload_comms_io_tcp_write;
+  iface->write_mem_list = remote_offload_comms_io_tcp_write_mem_list;
+  iface->shutdown = remote_offload_comms_io_tcp_shutdown;
+  iface->get_consumable_memfeatures = remote_offload_comms_io_tcp_get_consumable_memfeatures;
+}
+
+static void
+remote_offload_comms_io_tcp_finalize (GObject *gobject)
+{
+  RemoteOffloadCommsIOTCP *pCommsIOTCP = REMOTEOFFLOAD_COMMSIOTCP(gobject);
+
+  if( pCommsIOTCP->priv.sockfd >= 0 )
+  {
+     close(pCommsIOTCP->priv.sockfd);
+     pCommsIOTCP->priv.sockfd = -1;
+  }
+
+  g_mutex_clear(&pCommsIOTCP->priv.shutdownmutex);
+
+  G_OBJECT_CLASS (remote_offload_comms_io_tcp_parent_class)->finalize (gobject);
+}
+
+static void
+remote_offload_comms_io_tcp_class_init (RemoteOffloadCommsIOTCPClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = remote_offload_comms_io_tcp_finalize;
+}
+
+static void
+remote_offload_comms_io_tcp_init (RemoteOffloadCommsIOTCP *self)
+{
+  self->priv.sockfd = -1;
+  g_mutex_init(&self->priv.shutdownmutex);
+  self->priv.shutdownAsserted = FALSE;
+}
+
+gboolean remote_offload_comms_io_tcp_apply_socket_params(int sockfd,
+                                                         const TCPCommsIOSocketParams *params)
+{
+   if( sockfd < 0 || !params )
+      return FALSE;
+
+   //make sure our debug category is registered
+   g_type_ensure(REMOTEOFFLOADCOMMSIOTCP_TYPE);
+
+   gboolean ret = TRUE;
+
+   if( params->sndbuf > 0 )
+   {
+      if( setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF,
+                     &params->sndbuf, sizeof(params->sndbuf)) < 0 )
+      {
+         GST_ERROR("setsockopt(SO_SNDBUF=%d) failed: %s", params->sndbuf, g_strerror(errno));
+         ret = FALSE;
+      }
+   }
+
+   if( params->rcvbuf > 0 )
+   {
+      if( setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF,
+                     &params->rcvbuf, sizeof(params->rcvbuf)) < 0 )
+      {
+         GST_ERROR("setsockopt(SO_RCVBUF=%d) failed: %s", params->rcvbuf, g_strerror(errno));
+         ret = FALSE;
+      }
+   }
+
+   int nodelay = params->nodelay ? 1 : 0;
+   if( setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0 )
+   {
+      //Not fatal.. this is expected for a listening AF_UNIX socket, etc.
+      GST_WARNING("setsockopt(TCP_NODELAY=%d) failed: %s", nodelay, g_strerror(errno));
+   }
+
+   return ret;
+}
+
+RemoteOffloadCommsIOTCP *remote_offload_comms_io_tcp_new (int sockfd,
+                                                          const TCPCommsIOSocketParams *params)
+{
+  if( sockfd < 0 )
+     return NULL;
+
+  RemoteOffloadCommsIOTCP *pCommsIOTCP =
+        g_object_new(REMOTEOFFLOADCOMMSIOTCP_TYPE, NULL);
+
+  if( pCommsIOTCP )
+  {
+     pCommsIOTCP->priv.sockfd = sockfd;
+
+     if( params &&
+         !remote_offload_comms_io_tcp_apply_socket_params(sockfd, params) )
+     {
+        GST_ERROR_OBJECT(pCommsIOTCP, "Error applying socket params");
+        g_object_unref(pCommsIOTCP);
+        pCommsIOTCP = NULL;
+     }
+  }
+
+  return pCommsIOTCP;
+}
+
+RemoteOffloadCommsIOTCP *remote_offload_comms_io_tcp_connect (const gchar *host,
+                                                              guint16 port,
+                                                              const TCPCommsIOSocketParams *params)
+{
+   if( !host )
+      return NULL;
+
+   g_type_ensure(REMOTEOFFLOADCOMMSIOTCP_TYPE);
+
+   gchar portstr[8];
+   g_snprintf(portstr, sizeof(portstr), "%u", port);
+
+   struct addrinfo hints = {0};
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_protocol = IPPROTO_TCP;
+
+   struct addrinfo *result = NULL;
+   int err = getaddrinfo(host, portstr, &hints, &result);
+   if( err )
+   {
+      GST_ERROR("getaddrinfo(%s:%s) failed: %s", host, portstr, gai_strerror(err));
+      return NULL;
+   }
+
+   int sockfd = -1;
+   for( struct addrinfo *rp = result; rp != NULL; rp = rp->ai_next )
+   {
+      sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+      if( sockfd < 0 )
+         continue;
+
+      //buffer sizes need to be set before connect() for
+      // them to affect the TCP window scale negotiation.
+      if( params )
+         remote_offload_comms_io_tcp_apply_socket_params(sockfd, params);
+
+      if( connect(sockfd, rp->ai_addr, rp->ai_addrlen) == 0 )
+         break;
+
+      close(sockfd);
+      sockfd = -1;
+   }
+
+   freeaddrinfo(result);
+
+   if( sockfd < 0 )
+   {
+      GST_ERROR("Unable to connect to %s:%s", host, portstr);
+      return NULL;
+   }
+
+   GST_DEBUG("Connected to %s:%s", host, portstr);
+
+   //on failure, sockfd will have been closed by remote_offload_comms_io_tcp_new
+   return remote_offload_comms_io_tcp_new(sockfd, params);
+}
@@ -0,0 +1,66 @@
+/*
+ *  remoteoffloadcommsio_tcp.h - RemoteOffloadCommsIOTCP object
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef __REMOTEOFFLOAD_COMMS_IO_TCP_H__
+#define __REMOTEOFFLOAD_COMMS_IO_TCP_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+//port that the client & server use, if not explicitly specified
+#define TCP_COMMSIO_DEFAULT_PORT 6600
+
+typedef struct _TCPCommsIOSocketParams
+{
+   gboolean nodelay; //set TCP_NODELAY (disable Nagle)
+   gint sndbuf;      //SO_SNDBUF size in bytes. 0 = leave OS default
+   gint rcvbuf;      //SO_RCVBUF size in bytes. 0 = leave OS default
+}TCPCommsIOSocketParams;
+
+#define REMOTEOFFLOADCOMMSIOTCP_TYPE (remote_offload_comms_io_tcp_get_type ())
+G_DECLARE_FINAL_TYPE (RemoteOffloadCommsIOTCP,
+                      remote_offload_comms_io_tcp,
+                      REMOTEOFFLOAD, COMMSIOTCP, GObject)
+
+//Create a new TCP CommsIO object from an already-connected socket.
+// The returned object takes ownership of sockfd, and will close it
+// when finalized.
+RemoteOffloadCommsIOTCP *remote_offload_comms_io_tcp_new (int sockfd,
+                                                          const TCPCommsIOSocketParams *params);
+
+//Connect to a listening server at host:port, and create a new TCP CommsIO
+// object from the connected socket.
+RemoteOffloadCommsIOTCP *remote_offload_comms_io_tcp_connect (const gchar *host,
+                                                              guint16 port,
+                                                              const TCPCommsIOSocketParams *params);
+
+//Apply the given socket parameters to sockfd. This is exposed so that
+// a server can apply buffer sizes to its listening socket, as the receive
+// buffer size needs to be set before listen() to affect the TCP window scale.
+gboolean remote_offload_comms_io_tcp_apply_socket_params(int sockfd,
+                                                         const TCPCommsIOSocketParams *params);
+
+G_END_DECLS
+
+#endif /* __REMOTEOFFLOAD_COMMS_IO_TCP_H__ */
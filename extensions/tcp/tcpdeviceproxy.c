@@ -0,0 +1,370 @@
+/*
+ *  tcpdeviceproxy.c - TCPDeviceProxy object
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include "tcpdeviceproxy.h"
+#include "remoteoffloaddeviceproxy.h"
+#include "remoteoffloadclientserverutil.h"
+#include "remoteoffloadcommsio_tcp.h"
+
+typedef struct
+{
+   GArray *commsio_array; //GArray of RemoteOffloadCommsIO* that this obj. generated.
+
+   GOptionContext *option_context;
+   GArray *option_entries; //array of GOptionEntry's
+   gboolean bsharedconnection;
+   gint nstripes;
+   gchar *compression;
+   gint compression_threshold;
+
+   gchar *host;
+   gint port;
+   gboolean bdisable_nodelay;
+   gint sndbuf;
+   gint rcvbuf;
+} TCPDeviceProxyPrivate;
+
+struct _TCPDeviceProxy
+{
+  GObject parent_instance;
+
+  /* Other members, including private data. */
+  TCPDeviceProxyPrivate priv;
+};
+
+GST_DEBUG_CATEGORY_STATIC (tcp_device_proxy_debug);
+#define GST_CAT_DEFAULT tcp_device_proxy_debug
+
+#define DEFAULT_TCP_HOST "127.0.0.1"
+
+static void
+tcp_device_proxy_interface_init (RemoteOffloadDeviceProxyInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TCPDeviceProxy, tcp_device_proxy, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADDEVICEPROXY_TYPE,
+                         tcp_device_proxy_interface_init)
+                         GST_DEBUG_CATEGORY_INIT (tcp_device_proxy_debug,
+                         "remoteoffloadcommschannelgeneratortcp", 0,
+                         "debug category for TCPDeviceProxy"))
+
+//Open nconnections to the server. Each connection is a separate
+// TCP socket, and so will be handled by the server as a
+// separate connection passed to the pipeline spawner.
+static GArray* tcp_comms_channel_generate_commsio(TCPDeviceProxy *self,
+                                                  guint nconnections)
+{
+   const gchar *host = self->priv.host ? self->priv.host : DEFAULT_TCP_HOST;
+
+   if( (self->priv.port <= 0) || (self->priv.port > G_MAXUINT16) )
+   {
+      GST_ERROR_OBJECT (self, "Invalid port=%d", self->priv.port);
+      return NULL;
+   }
+
+   TCPCommsIOSocketParams params;
+   params.nodelay = !self->priv.bdisable_nodelay;
+   params.sndbuf = self->priv.sndbuf;
+   params.rcvbuf = self->priv.rcvbuf;
+
+   GArray *commsio_array = g_array_new(FALSE, FALSE, sizeof(RemoteOffloadCommsIO *));
+
+   for( guint i = 0; i < nconnections; i++ )
+   {
+      RemoteOffloadCommsIOTCP *commsio =
+            remote_offload_comms_io_tcp_connect(host, (guint16)self->priv.port, &params);
+
+      if( !commsio )
+      {
+         GST_ERROR_OBJECT (self, "Error connecting to %s:%d", host, self->priv.port);
+
+         for( guint j = 0; j < commsio_array->len; j++ )
+         {
+            g_object_unref(g_array_index(commsio_array, RemoteOffloadCommsIO *, j));
+         }
+         g_array_free(commsio_array, TRUE);
+         return NULL;
+      }
+
+      g_array_append_val(commsio_array, commsio);
+   }
+
+   GST_INFO_OBJECT (self, "Opened %u connection(s) to %s:%d", nconnections,
+                    host, self->priv.port);
+
+   return commsio_array;
+}
+
+//Given a GArray of CommsChannelRequest's,
+// return a channel_id(gint) to RemoteOffloadCommsChannel*
+static GHashTable* tcp_deviceproxy_generate(RemoteOffloadDeviceProxy *proxy,
+                                            GstBin *bin,
+                                            GArray *commschannelrequests)
+{
+   (void)bin;
+
+   if( !DEVICEPROXY_IS_TCP(proxy) ||
+         !commschannelrequests ||
+         (commschannelrequests->len < 1) )
+      return NULL;
+
+   TCPDeviceProxy *self = DEVICEPROXY_TCP (proxy);
+
+   if( self->priv.nstripes < 0 )
+   {
+      GST_ERROR_OBJECT (self, "Invalid stripes=%d", self->priv.nstripes);
+      return NULL;
+   }
+
+   //Each connection that carries channels gets nstripes additional connections,
+   // which its large transfers are striped across.
+   guint ncomms = self->priv.bsharedconnection ? 1 : commschannelrequests->len;
+   guint nstripes = (guint)self->priv.nstripes;
+   guint nconnections = ncomms * (1 + nstripes);
+
+   RemoteOffloadCompressionParams compression = { REMOTEOFFLOAD_COMPRESSION_NONE, 0 };
+   if( self->priv.compression )
+   {
+      if( !remote_offload_compression_codec_from_string(self->priv.compression,
+                                                        &compression.codec) ||
+          (self->priv.compression_threshold < 0) )
+      {
+         GST_ERROR_OBJECT (self, "Invalid compression=%s, compression-threshold=%d",
+                           self->priv.compression, self->priv.compression_threshold);
+         return NULL;
+      }
+
+      if( !remote_offload_compression_codec_supported(compression.codec) )
+      {
+         GST_WARNING_OBJECT (self, "%s compression isn't supported by this build. "
+                             "Continuing without compression.", self->priv.compression);
+         compression.codec = REMOTEOFFLOAD_COMPRESSION_NONE;
+      }
+
+      compression.threshold = (guint32)self->priv.compression_threshold;
+   }
+
+   self->priv.commsio_array = tcp_comms_channel_generate_commsio(self, nconnections);
+   if( !self->priv.commsio_array )
+   {
+      GST_ERROR_OBJECT (self, "Error in tcp_comms_channel_generate_commsio");
+      return NULL;
+   }
+
+   CommsChannelRequest *requests = (CommsChannelRequest *)commschannelrequests->data;
+   GArray *id_commsio_pair_array = g_array_new(FALSE, FALSE, sizeof(ChannelIdCommsIOPair));
+
+   for( guint requesti = 0; requesti < commschannelrequests->len; requesti++ )
+   {
+      guint commsio_index = self->priv.bsharedconnection ? 0 : requesti;
+
+      RemoteOffloadCommsIO *commsio = g_array_index(self->priv.commsio_array,
+                                                    RemoteOffloadCommsIO *,
+                                                    commsio_index);
+
+      ChannelIdCommsIOPair pair = {requests[requesti].channel_id, commsio, FALSE, compression};
+      g_array_append_val(id_commsio_pair_array, pair);
+      GST_DEBUG_OBJECT (self, "id_commsio_pair_array[%d] = (%d,%p)",
+                       requesti, pair.channel_id, pair.commsio);
+   }
+
+   //the stripe connections follow the ncomms channel connections
+   for( guint commsi = 0; commsi < ncomms; commsi++ )
+   {
+      for( guint stripei = 0; stripei < nstripes; stripei++ )
+      {
+         RemoteOffloadCommsIO *commsio = g_array_index(self->priv.commsio_array,
+                                                       RemoteOffloadCommsIO *,
+                                                       ncomms + commsi*nstripes + stripei);
+
+         ChannelIdCommsIOPair pair = {requests[commsi].channel_id, commsio, TRUE};
+         g_array_append_val(id_commsio_pair_array, pair);
+         GST_DEBUG_OBJECT (self, "stripe %u of channel-id=%d: commsio=%p",
+                           stripei, pair.channel_id, pair.commsio);
+      }
+   }
+
+   GHashTable *id_to_channel_hash = NULL;
+   if( remote_offload_request_new_pipeline(id_commsio_pair_array) )
+   {
+      id_to_channel_hash = id_commsio_pair_array_to_id_to_channel_hash(id_commsio_pair_array);
+
+      if( !id_to_channel_hash )
+      {
+         GST_ERROR_OBJECT (self, "Error in id_commsio_pair_array_to_id_to_channel_hash");
+      }
+   }
+   else
+   {
+      GST_ERROR_OBJECT (self, "Error in remote_offload_request_new_pipeline");
+   }
+
+   g_array_free(id_commsio_pair_array, TRUE);
+
+   return id_to_channel_hash;
+}
+
+static gboolean
+tcp_deviceproxy_set_arguments(RemoteOffloadDeviceProxy *proxy,
+                              gchar *arguments_string)
+{
+   if( !DEVICEPROXY_IS_TCP(proxy) )
+      return FALSE;
+
+   if( !arguments_string )
+      return TRUE;
+
+   TCPDeviceProxy *self = DEVICEPROXY_TCP (proxy);
+
+   gboolean ret =
+         remote_offload_deviceproxy_parse_arguments_string(self->priv.option_context,
+                                                           arguments_string);
+
+   return ret;
+}
+
+static void
+tcp_device_proxy_interface_init (RemoteOffloadDeviceProxyInterface *iface)
+{
+   iface->deviceproxy_generate_commschannels = tcp_deviceproxy_generate;
+   iface->deviceproxy_set_arguments = tcp_deviceproxy_set_arguments;
+}
+
+static void
+tcp_device_proxy_finalize (GObject *gobject)
+{
+  TCPDeviceProxy *self = DEVICEPROXY_TCP (gobject);
+
+  if( self->priv.commsio_array )
+  {
+     for( guint i = 0; i < self->priv.commsio_array->len; i++ )
+     {
+        RemoteOffloadCommsIO *commsio =
+              g_array_index(self->priv.commsio_array,
+                            RemoteOffloadCommsIO *,
+                            i);
+        g_object_unref(commsio);
+     }
+
+     g_array_free(self->priv.commsio_array, TRUE);
+  }
+
+  g_free(self->priv.host);
+  g_free(self->priv.compression);
+
+  g_option_context_free(self->priv.option_context);
+  g_array_free(self->priv.option_entries, TRUE);
+
+  G_OBJECT_CLASS (tcp_device_proxy_parent_class)->finalize (gobject);
+}
+
+static void
+tcp_device_proxy_class_init (TCPDeviceProxyClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = tcp_device_proxy_finalize;
+}
+
+static void
+tcp_device_proxy_init (TCPDeviceProxy *self)
+{
+   self->priv.commsio_array = NULL;
+
+   self->priv.option_context = g_option_context_new(" - TCP Comms Channel Generator");
+   self->priv.option_entries = g_array_new(FALSE, FALSE, sizeof(GOptionEntry));
+
+   self->priv.host = NULL;
+   GOptionEntry host_entry =
+     { "host", 0, 0, G_OPTION_ARG_STRING,
+       &self->priv.host,
+     "Hostname or IP address of the TCP server (default=" DEFAULT_TCP_HOST ")", NULL};
+   g_array_append_val(self->priv.option_entries, host_entry);
+
+   self->priv.port = TCP_COMMSIO_DEFAULT_PORT;
+   GOptionEntry port_entry =
+     { "port", 0, 0, G_OPTION_ARG_INT,
+       &self->priv.port,
+     "Port that the TCP server is listening on", NULL};
+   g_array_append_val(self->priv.option_entries, port_entry);
+
+   self->priv.bsharedconnection = FALSE;
+   GOptionEntry sharedconnection_entry =
+     { "sharedconnection", 0, 0, G_OPTION_ARG_NONE,
+     &self->priv.bsharedconnection,
+     "Share a single TCP connection for all data/control streams", NULL};
+   g_array_append_val(self->priv.option_entries, sharedconnection_entry);
+
+   self->priv.nstripes = 0;
+   GOptionEntry stripes_entry =
+     { "stripes", 0, 0, G_OPTION_ARG_INT,
+     &self->priv.nstripes,
+     "Number of additional TCP connections that large transfers of each connection "
+     "are striped across (default=0)", NULL};
+   g_array_append_val(self->priv.option_entries, stripes_entry);
+
+   self->priv.compression = NULL;
+   GOptionEntry compression_entry =
+     { "compression", 0, 0, G_OPTION_ARG_STRING,
+     &self->priv.compression,
+     "Compress large data segments with the given codec: none, lz4 or zstd (default=none). "
+     "Falls back to none if either side doesn't support it", NULL};
+   g_array_append_val(self->priv.option_entries, compression_entry);
+
+   self->priv.compression_threshold = REMOTEOFFLOAD_COMPRESSION_DEFAULT_THRESHOLD;
+   GOptionEntry compression_threshold_entry =
+     { "compression-threshold", 0, 0, G_OPTION_ARG_INT,
+     &self->priv.compression_threshold,
+     "Only compress data segments of at least this many bytes (default=4096)", NULL};
+   g_array_append_val(self->priv.option_entries, compression_threshold_entry);
+
+   self->priv.bdisable_nodelay = FALSE;
+   GOptionEntry nodelay_entry =
+     { "disable_nodelay", 0, 0, G_OPTION_ARG_NONE,
+     &self->priv.bdisable_nodelay,
+     "Don't set TCP_NODELAY (i.e. allow Nagle's algorithm to coalesce small writes)", NULL};
+   g_array_append_val(self->priv.option_entries, nodelay_entry);
+
+   self->priv.sndbuf = 0;
+   GOptionEntry sndbuf_entry =
+     { "sndbuf", 0, 0, G_OPTION_ARG_INT,
+     &self->priv.sndbuf,
+     "Socket send buffer size, in bytes (0=OS default)", NULL};
+   g_array_append_val(self->priv.option_entries, sndbuf_entry);
+
+   self->priv.rcvbuf = 0;
+   GOptionEntry rcvbuf_entry =
+     { "rcvbuf", 0, 0, G_OPTION_ARG_INT,
+     &self->priv.rcvbuf,
+     "Socket receive buffer size, in bytes (0=OS default)", NULL};
+   g_array_append_val(self->priv.option_entries, rcvbuf_entry);
+
+   GOptionEntry null_entry = { NULL };
+   g_array_append_val(self->priv.option_entries, null_entry);
+
+   g_option_context_set_help_enabled(self->priv.option_context, FALSE);
+   g_option_context_add_main_entries (self->priv.option_context,
+                                      (GOptionEntry*)self->priv.option_entries->data, NULL);
+}
+
+TCPDeviceProxy *tcp_device_proxy_new ()
+{
+   return g_object_new(TCPDEVICEPROXY_TYPE, NULL);
+}
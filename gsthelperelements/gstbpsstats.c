@@ -0,0 +1,191 @@
+/*
+ *  gstbpsstats.c - Fixed-memory, lock-free statistics for the bps element
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#include "gstbpsstats.h"
+
+static inline guint bit_storage64(guint64 value)
+{
+   if( value >> 32 )
+      return 32 + g_bit_storage((gulong)(value >> 32));
+
+   return g_bit_storage((gulong)value);
+}
+
+static inline guint histogram_index(guint64 value)
+{
+   if( value < 2 * BPS_HISTOGRAM_SUB_COUNT )
+      return (guint)value;
+
+   guint shift = bit_storage64(value) - (BPS_HISTOGRAM_SUB_BITS + 1);
+   if( shift > BPS_HISTOGRAM_MAX_SHIFT )
+      return BPS_HISTOGRAM_NBINS - 1;
+
+   return shift * BPS_HISTOGRAM_SUB_COUNT + (guint)(value >> shift);
+}
+
+static inline guint64 histogram_highest_equivalent_value(guint index)
+{
+   if( index < 2 * BPS_HISTOGRAM_SUB_COUNT )
+      return index;
+
+   guint shift = index / BPS_HISTOGRAM_SUB_COUNT - 1;
+   guint64 sub = index - shift * BPS_HISTOGRAM_SUB_COUNT;
+
+   return (sub << shift) + (G_GUINT64_CONSTANT(1) << shift) - 1;
+}
+
+void gst_bps_histogram_reset(GstBpsHistogram *histogram)
+{
+   for( guint bin = 0; bin < BPS_HISTOGRAM_NBINS; bin++ )
+      g_atomic_pointer_set(&histogram->bins[bin], 0);
+
+   g_atomic_pointer_set(&histogram->count, 0);
+   g_atomic_pointer_set(&histogram->sum, 0);
+   g_atomic_pointer_set(&histogram->max, 0);
+}
+
+void gst_bps_histogram_record(GstBpsHistogram *histogram, guint64 value)
+{
+   g_atomic_pointer_add(&histogram->bins[histogram_index(value)], 1);
+   g_atomic_pointer_add(&histogram->count, 1);
+   g_atomic_pointer_add(&histogram->sum, (gsize)value);
+
+   gsize max = (gsize)g_atomic_pointer_get(&histogram->max);
+   while( (gsize)value > max )
+   {
+      if( g_atomic_pointer_compare_and_exchange(&histogram->max,
+                                                (gpointer)max, (gpointer)(gsize)value) )
+         break;
+      max = (gsize)g_atomic_pointer_get(&histogram->max);
+   }
+}
+
+void gst_bps_histogram_snapshot(GstBpsHistogram *histogram,
+                                GstBpsHistogram *snapshot)
+{
+   for( guint bin = 0; bin < BPS_HISTOGRAM_NBINS; bin++ )
+      snapshot->bins[bin] = (gsize)g_atomic_pointer_get(&histogram->bins[bin]);
+
+   snapshot->count = (gsize)g_atomic_pointer_get(&histogram->count);
+   snapshot->sum = (gsize)g_atomic_pointer_get(&histogram->sum);
+   snapshot->max = (gsize)g_atomic_pointer_get(&histogram->max);
+}
+
+guint64 gst_bps_histogram_percentile(const GstBpsHistogram *snapshot,
+                                     gdouble percentile)
+{
+   //count may be ahead of the bins, if a value was being recorded
+   // as the snapshot was taken. So total up the bins instead.
+   guint64 total = 0;
+   for( guint bin = 0; bin < BPS_HISTOGRAM_NBINS; bin++ )
+      total += snapshot->bins[bin];
+
+   if( !total )
+      return 0;
+
+   guint64 rank = (guint64)((CLAMP(percentile, 0., 100.) / 100.) * total + 0.5);
+   if( rank < 1 )
+      rank = 1;
+
+   guint64 accumulated = 0;
+   guint bin = 0;
+   for( ; bin < BPS_HISTOGRAM_NBINS - 1; bin++ )
+   {
+      accumulated += snapshot->bins[bin];
+      if( accumulated >= rank )
+         break;
+   }
+
+   return MIN(histogram_highest_equivalent_value(bin), (guint64)snapshot->max);
+}
+
+gdouble gst_bps_histogram_mean(const GstBpsHistogram *snapshot)
+{
+   if( !snapshot->count )
+      return 0.;
+
+   return (gdouble)snapshot->sum / (gdouble)snapshot->count;
+}
+
+GstBpsTimestampRing *gst_bps_timestamp_ring_new(void)
+{
+   GstBpsTimestampRing *ring = g_new0(GstBpsTimestampRing, 1);
+   for( guint i = 0; i < BPS_TIMESTAMP_RING_SIZE; i++ )
+      ring->slots[i].clock_id = GST_CLOCK_TIME_NONE;
+
+   return ring;
+}
+
+void gst_bps_timestamp_ring_free(GstBpsTimestampRing *ring)
+{
+   g_free(ring);
+}
+
+static inline GstBpsTimestampSlot *timestamp_ring_slot(GstBpsTimestampRing *ring,
+                                                       GstClockTime clock_id)
+{
+   //timestamps are usually evenly spaced, so scatter them (fibonacci hashing)
+   guint64 hash = (guint64)clock_id * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+   return &ring->slots[hash >> (64 - BPS_TIMESTAMP_RING_BITS)];
+}
+
+void gst_bps_timestamp_ring_put(GstBpsTimestampRing *ring,
+                                GstClockTime clock_id,
+                                GstClockTime ts)
+{
+   GstBpsTimestampSlot *slot = timestamp_ring_slot(ring, clock_id);
+
+   gint seq = g_atomic_int_get(&slot->seq);
+   g_atomic_int_set(&slot->seq, seq + 1);
+   slot->clock_id = clock_id;
+   slot->ts = ts;
+   g_atomic_int_set(&slot->seq, seq + 2);
+}
+
+gboolean gst_bps_timestamp_ring_get(GstBpsTimestampRing *ring,
+                                    GstClockTime clock_id,
+                                    GstClockTime *ts)
+{
+   GstBpsTimestampSlot *slot = timestamp_ring_slot(ring, clock_id);
+
+   //the writer holds a slot only for a couple of stores, so a reader that
+   // catches it mid-write just retries.
+   for( guint attempt = 0; attempt < 64; attempt++ )
+   {
+      gint seq = g_atomic_int_get(&slot->seq);
+      if( seq & 1 )
+         continue;
+
+      GstClockTime slot_clock_id = slot->clock_id;
+      GstClockTime slot_ts = slot->ts;
+
+      if( g_atomic_int_get(&slot->seq) != seq )
+         continue;
+
+      if( slot_clock_id != clock_id )
+         return FALSE;
+
+      *ts = slot_ts;
+      return TRUE;
+   }
+
+   return FALSE;
+}
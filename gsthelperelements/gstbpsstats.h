@@ -0,0 +1,99 @@
+/*
+ *  gstbpsstats.h - Fixed-memory, lock-free statistics for the bps element
+ *
+ *  Copyright (C) 2019 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifndef __GST_BPSSTATS_H__
+#define __GST_BPSSTATS_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+//HDR-style histogram: values below 2*SUB_COUNT are counted exactly. Above that,
+// each power-of-2 range is split into SUB_COUNT linear bins, so a value is
+// reported to within 1/SUB_COUNT (~3%) of itself. Values of 2^(MAX_SHIFT+6)
+// and above are counted in the last bin.
+#define BPS_HISTOGRAM_SUB_BITS 5
+#define BPS_HISTOGRAM_SUB_COUNT (1 << BPS_HISTOGRAM_SUB_BITS)
+#define BPS_HISTOGRAM_MAX_SHIFT 32
+#define BPS_HISTOGRAM_NBINS ((BPS_HISTOGRAM_MAX_SHIFT + 2) * BPS_HISTOGRAM_SUB_COUNT)
+
+//All fields are updated atomically, so values can be recorded from the
+// streaming thread while other threads take snapshots.
+typedef struct _GstBpsHistogram
+{
+   gsize bins[BPS_HISTOGRAM_NBINS];
+   gsize count;
+   gsize sum;
+   gsize max;
+}GstBpsHistogram;
+
+void gst_bps_histogram_reset(GstBpsHistogram *histogram);
+
+void gst_bps_histogram_record(GstBpsHistogram *histogram, guint64 value);
+
+//Take a (non-atomic) copy of histogram
+void gst_bps_histogram_snapshot(GstBpsHistogram *histogram,
+                                GstBpsHistogram *snapshot);
+
+//Return the given percentile (0-100) of a snapshot, as the highest value
+// that is equivalent to the bin that it falls in. Returns 0 if empty.
+guint64 gst_bps_histogram_percentile(const GstBpsHistogram *snapshot,
+                                     gdouble percentile);
+
+gdouble gst_bps_histogram_mean(const GstBpsHistogram *snapshot);
+
+//A fixed-size map of buffer timestamp (pts/dts) to the (wall-clock) time
+// that the buffer was seen at, used by a latency-source bps to hand its
+// timestamps to the bps that tracks latency from it. It has one writer, and
+// any number of readers. Entries are overwritten as the ring wraps around,
+// so it only needs to be large enough to cover the buffers in flight
+// between the two elements.
+#define BPS_TIMESTAMP_RING_BITS 12
+#define BPS_TIMESTAMP_RING_SIZE (1 << BPS_TIMESTAMP_RING_BITS)
+
+typedef struct _GstBpsTimestampSlot
+{
+   gint seq; //odd while the slot is being written
+   GstClockTime clock_id;
+   GstClockTime ts;
+}GstBpsTimestampSlot;
+
+typedef struct _GstBpsTimestampRing
+{
+   GstBpsTimestampSlot slots[BPS_TIMESTAMP_RING_SIZE];
+}GstBpsTimestampRing;
+
+GstBpsTimestampRing *gst_bps_timestamp_ring_new(void);
+
+void gst_bps_timestamp_ring_free(GstBpsTimestampRing *ring);
+
+void gst_bps_timestamp_ring_put(GstBpsTimestampRing *ring,
+                                GstClockTime clock_id,
+                                GstClockTime ts);
+
+//Returns FALSE if clock_id isn't (or no longer) in the ring
+gboolean gst_bps_timestamp_ring_get(GstBpsTimestampRing *ring,
+                                    GstClockTime clock_id,
+                                    GstClockTime *ts);
+
+G_END_DECLS
+
+#endif /* __GST_BPSSTATS_H__ */
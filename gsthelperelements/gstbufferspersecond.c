@@ -32,6 +32,12 @@
 
 #define DEFAULT_BPS_UPDATE_INTERVAL_MS 500      /* 500 ms */
 
+//Objects that haven't been seen for this many frames are forgotten, so that
+// the set of tracked object id's doesn't grow for the life of the stream.
+// It's pruned every OBJID_PRUNE_INTERVAL frames.
+#define OBJID_EXPIRY_FRAMES 9000
+#define OBJID_PRUNE_INTERVAL 1024
+
 GST_DEBUG_CATEGORY_STATIC (gst_buffers_per_second_debug);
 #define GST_CAT_DEFAULT gst_buffers_per_second_debug
 
@@ -52,7 +58,10 @@ enum
   PROP_LATENCY_TRACK_FROM,
   PROP_DUMP_FRAME_STATS,
   PROP_TRACK_ROI_PER_FRAME,
-  PROP_TRACK_NEW_OBJS_PER_FRAME
+  PROP_TRACK_NEW_OBJS_PER_FRAME,
+  PROP_STATS,
+  PROP_POST_MESSAGES,
+  PROP_LATENCY_TRACE
 };
 
 /* the capabilities of the inputs and outputs.
@@ -86,6 +95,8 @@ static GstFlowReturn gst_buffers_per_second_chain (GstPad * pad, GstObject * par
 
 static gboolean gst_buffers_per_second_memutil_start(GstBuffersPerSecond *self);
 static gboolean gst_buffers_per_second_memutil_stop(GstBuffersPerSecond *self);
+static GstStructure *gst_buffers_per_second_get_stats(GstBuffersPerSecond *self);
+static void gst_buffers_per_second_close_stats_file(GstBuffersPerSecond *self);
 
 /* GObject vmethod implementations */
 static inline long long gst_buffers_per_second_phys_mem_used_now()
@@ -112,6 +123,16 @@ gst_buffers_per_second_finalize (GObject *gobject)
       gst_buffers_per_second_memutil_stop(self);
 
    g_hash_table_destroy(self->objid_hash);
+   g_free(self->latency_hist);
+   g_free(self->nroi_hist);
+   g_free(self->newobjs_hist);
+   if( self->latency_ring )
+      gst_bps_timestamp_ring_free(self->latency_ring);
+   g_free(self->trace_segments);
+
+   if( self->statsfp )
+      gst_buffers_per_second_close_stats_file(self);
+
    if( self->statsfile )
       g_free (self->statsfile);
 
@@ -170,7 +191,8 @@ gst_buffers_per_second_class_init (GstBuffersPerSecondClass * klass)
   g_object_class_install_property (gobject_class, PROP_DUMP_FRAME_STATS,
       g_param_spec_string ("dump-frame-stats",
                            "DumpFrameStats",
-                           "File location to save per-frame stats to (CSV format). You can also "
+                           "File location to write per-frame stats to (CSV format), as frames "
+                           "arrive. You can also "
                            "set this to \"stdout\" , \"stderr\", or \"GST_INFO\" instead of a "
                            "filename",
                            NULL,
@@ -190,6 +212,32 @@ gst_buffers_per_second_class_init (GstBuffersPerSecondClass * klass)
                            FALSE,
                            G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Stats",
+          "Live statistics: buffer counts, rates, and the count, mean, max & "
+          "50/90/99/99.9th percentiles of latency (in ms), ROI's per frame and "
+          "new objects per frame, when those are tracked",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+      g_param_spec_boolean ("post-messages",
+                           "post messages",
+                           "Post an element message, holding the \"stats\", every "
+                           "bps-update-interval",
+                           FALSE,
+                           G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_TRACE,
+      g_param_spec_boolean ("latency-trace",
+                           "latency trace",
+                           "Track latency with a meta that's carried by each buffer, instead of "
+                           "by matching buffer timestamps. This works across remoteoffloadbin's, "
+                           "and gives a breakdown of the latency by stage of the offload path. "
+                           "A latency-source attaches the meta, and other bps elements "
+                           "measure latency from it",
+                           FALSE,
+                           G_PARAM_READWRITE));
+
   gst_element_class_set_details_simple(gstelement_class,
     "Buffers Per Second",
     "Debug",
@@ -252,17 +300,27 @@ gst_buffers_per_second_init (GstBuffersPerSecond * self)
   self->latency_track_from = NULL;
   self->bps_latency_track_source = NULL;
 
-  g_mutex_init (&self->statscollectmutex);
-  self->clockid_list = NULL;
-  self->wallclockts_list = NULL;
+  self->blatency_trace = FALSE;
+  remote_offload_trace_clock_sync_reset(&self->trace_clock_sync);
+  self->trace_segments = NULL;
+  self->ntrace_segments = 0;
+
+  self->latency_ring = NULL;
+  self->latency_hist = g_new0(GstBpsHistogram, 1);
+  self->nroi_hist = g_new0(GstBpsHistogram, 1);
+  self->newobjs_hist = g_new0(GstBpsHistogram, 1);
+  self->latency_unmatched = 0;
+  self->untagged_objs = 0;
+  self->current_bps = -1;
+  self->bpostmessages = FALSE;
+
   self->btracknrois = FALSE;
-  self->perframe_n_roi_list = NULL;
-  self->perframe_new_objs = NULL;
-  self->perframe_untagged_objs = NULL;
   self->objid_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
   self->btracknewobjs = FALSE;
-  self->bclock_wallclock_list_reversed = FALSE;
+  self->frame_index = 0;
 
+  self->statsfp = NULL;
+  self->statsfile_index = 0;
   self->statsfile = NULL;
 
 }
@@ -301,6 +359,10 @@ gst_buffers_per_second_set_property (GObject * object, guint prop_id,
      break;
      case PROP_LATENCY_IS_SOURCE:
         self->blatency_is_source = g_value_get_boolean(value);
+        //this can only be set in NULL state, so the ring stays put while
+        // other bps elements are reading from it.
+        if( self->blatency_is_source && !self->latency_ring )
+           self->latency_ring = gst_bps_timestamp_ring_new();
      break;
      case PROP_LATENCY_TRACK_FROM:
         if (!g_value_get_string (value)) {
@@ -326,6 +388,12 @@ gst_buffers_per_second_set_property (GObject * object, guint prop_id,
      case PROP_TRACK_NEW_OBJS_PER_FRAME:
         self->btracknewobjs = g_value_get_boolean(value);
      break;
+     case PROP_POST_MESSAGES:
+        self->bpostmessages = g_value_get_boolean(value);
+     break;
+     case PROP_LATENCY_TRACE:
+        self->blatency_trace = g_value_get_boolean(value);
+     break;
      default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
      break;
@@ -363,34 +431,264 @@ gst_buffers_per_second_get_property (GObject * object, guint prop_id,
     case PROP_TRACK_NEW_OBJS_PER_FRAME:
        g_value_set_boolean (value, self->btracknewobjs);
      break;
+    case PROP_STATS:
+       g_value_take_boxed (value, gst_buffers_per_second_get_stats(self));
+     break;
+    case PROP_POST_MESSAGES:
+       g_value_set_boolean (value, self->bpostmessages);
+     break;
+    case PROP_LATENCY_TRACE:
+       g_value_set_boolean (value, self->blatency_trace);
+     break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
-static void display_eos_summary(GstBuffersPerSecond *self)
+//Set <prefix>-count, and the mean, max & percentiles (as <prefix>-p50<unit>,
+// etc.) of a histogram snapshot, with values multiplied by scale.
+static void set_histogram_fields(GstStructure *structure,
+                                 const gchar *prefix,
+                                 const gchar *unit,
+                                 const GstBpsHistogram *snapshot,
+                                 gdouble scale)
 {
-   if( !GST_CLOCK_TIME_IS_VALID (self->start_ts) )
-      return;
+   static const struct
+   {
+      const gchar *name;
+      gdouble percentile;
+   }percentiles[] =
+   {
+      {"p50", 50.},
+      {"p90", 90.},
+      {"p99", 99.},
+      {"p99.9", 99.9},
+   };
+
+   gchar *field = g_strdup_printf("%s-count", prefix);
+   gst_structure_set(structure, field, G_TYPE_UINT64, (guint64)snapshot->count, NULL);
+   g_free(field);
+
+   field = g_strdup_printf("%s-mean%s", prefix, unit);
+   gst_structure_set(structure, field, G_TYPE_DOUBLE,
+                     gst_bps_histogram_mean(snapshot) * scale, NULL);
+   g_free(field);
+
+   field = g_strdup_printf("%s-max%s", prefix, unit);
+   gst_structure_set(structure, field, G_TYPE_DOUBLE, snapshot->max * scale, NULL);
+   g_free(field);
+
+   for( guint i = 0; i < G_N_ELEMENTS(percentiles); i++ )
+   {
+      field = g_strdup_printf("%s-%s%s", prefix, percentiles[i].name, unit);
+      gst_structure_set(structure, field, G_TYPE_DOUBLE,
+                        gst_bps_histogram_percentile(snapshot,
+                                                     percentiles[i].percentile) * scale,
+                        NULL);
+      g_free(field);
+   }
+}
 
+//Whether this element measures latency, either from a latency-source bps,
+// or from the trace meta of the buffers.
+static inline gboolean tracks_latency(GstBuffersPerSecond *self)
+{
+   return self->bps_latency_track_source ||
+          (self->blatency_trace && !self->blatency_is_source);
+}
+
+#define TRACE_SEGMENT_KEY(from, to) \
+   (((guint32)(from)->stage << 24) | ((guint32)(from)->domain << 16) | \
+    ((guint32)(to)->stage << 8) | (guint32)(to)->domain)
+
+//The trace starts in domain 0. For an element behind a single remoteoffloadbin,
+// domain 1 is the remote side, and domain 2 is back where it started.
+static gchar *trace_domain_name(guint8 domain)
+{
+   if( (domain == 0) || (domain == 2) )
+      return g_strdup("host");
+
+   if( domain == 1 )
+      return g_strdup("remote");
+
+   return g_strdup_printf("domain%u", domain);
+}
+
+//i.e. "latency-host-send-to-remote-receive"
+static gchar *trace_segment_name(guint32 key)
+{
+   gchar *from_domain = trace_domain_name((key >> 16) & 0xff);
+   gchar *to_domain = trace_domain_name(key & 0xff);
+   gchar *name =
+         g_strdup_printf("latency-%s-%s-to-%s-%s",
+                         from_domain,
+                         remote_offload_trace_stage_name((RemoteOffloadTraceStage)(key >> 24)),
+                         to_domain,
+                         remote_offload_trace_stage_name((RemoteOffloadTraceStage)((key >> 8) & 0xff)));
+   g_free(from_domain);
+   g_free(to_domain);
+
+   return name;
+}
+
+static GstStructure *gst_buffers_per_second_get_stats(GstBuffersPerSecond *self)
+{
    GstClockTime current_ts = gst_util_get_timestamp ();
    guint64 buffers_received = g_atomic_int_get (&self->buffers_received);
-   gdouble time_elapsed = (gdouble) (current_ts - self->start_ts) / GST_SECOND;
+   gsize bytes_received = self->bytes_received;
 
-   if( time_elapsed <= 0 )
+   GST_OBJECT_LOCK (self);
+   GstClockTime start_ts = self->start_ts;
+   gdouble current_bps = self->current_bps;
+   gdouble min_bps = self->min_bps;
+   gdouble max_bps = self->max_bps;
+   GST_OBJECT_UNLOCK (self);
+
+   gdouble average_bps = 0;
+   gdouble average_throughput = 0;
+   if( GST_CLOCK_TIME_IS_VALID (start_ts) && (current_ts > start_ts) )
+   {
+      gdouble time_elapsed = (gdouble) (current_ts - start_ts) / GST_SECOND;
+      average_bps = (gdouble) buffers_received / time_elapsed;
+      average_throughput = (gdouble) bytes_received / time_elapsed;
+   }
+
+   GstStructure *stats =
+         gst_structure_new("bps-stats",
+                           "buffers", G_TYPE_UINT64, buffers_received,
+                           "bytes", G_TYPE_UINT64, (guint64)bytes_received,
+                           "average-bps", G_TYPE_DOUBLE, average_bps,
+                           "current-bps", G_TYPE_DOUBLE, current_bps,
+                           "min-bps", G_TYPE_DOUBLE, min_bps,
+                           "max-bps", G_TYPE_DOUBLE, max_bps,
+                           "average-mbps", G_TYPE_DOUBLE, (average_throughput*8)/1000000.0,
+                           NULL);
+
+   GstBpsHistogram *snapshot = g_new(GstBpsHistogram, 1);
+   if( tracks_latency(self) )
+   {
+      gst_bps_histogram_snapshot(self->latency_hist, snapshot);
+      set_histogram_fields(stats, "latency", "-ms", snapshot, 1. / 1000.);
+      gst_structure_set(stats, "latency-unmatched", G_TYPE_UINT64,
+                        (guint64)(gsize)g_atomic_pointer_get(&self->latency_unmatched),
+                        NULL);
+   }
+
+   //Segments are only ever appended while streaming, and each one is
+   // filled in before the count is incremented.
+   if( self->trace_segments )
+   {
+      GValue stages = G_VALUE_INIT;
+      g_value_init(&stages, GST_TYPE_ARRAY);
+
+      gint nsegments = g_atomic_int_get(&self->ntrace_segments);
+      for( gint i = 0; i < nsegments; i++ )
+      {
+         gchar *name = trace_segment_name(self->trace_segments[i].key);
+         gst_bps_histogram_snapshot(&self->trace_segments[i].hist, snapshot);
+         set_histogram_fields(stats, name, "-ms", snapshot, 1. / 1000.);
+
+         GValue stage = G_VALUE_INIT;
+         g_value_init(&stage, G_TYPE_STRING);
+         g_value_take_string(&stage, name);
+         gst_value_array_append_and_take_value(&stages, &stage);
+      }
+
+      gst_structure_take_value(stats, "latency-stages", &stages);
+   }
+
+   if( self->btracknrois )
+   {
+      gst_bps_histogram_snapshot(self->nroi_hist, snapshot);
+      set_histogram_fields(stats, "rois", "", snapshot, 1.);
+   }
+
+   if( self->btracknewobjs )
+   {
+      gst_bps_histogram_snapshot(self->newobjs_hist, snapshot);
+      set_histogram_fields(stats, "new-objs", "", snapshot, 1.);
+      gst_structure_set(stats,
+                        "new-objs-total", G_TYPE_UINT64, (guint64)snapshot->sum,
+                        "untagged-objs-total", G_TYPE_UINT64,
+                        (guint64)(gsize)g_atomic_pointer_get(&self->untagged_objs),
+                        NULL);
+   }
+   g_free(snapshot);
+
+   return stats;
+}
+
+static void display_histogram_summary(GstBuffersPerSecond *self,
+                                      const GstStructure *stats,
+                                      const gchar *prefix,
+                                      const gchar *unit)
+{
+   gchar *countfield = g_strdup_printf("%s-count", prefix);
+   guint64 count = 0;
+   if( gst_structure_get_uint64(stats, countfield, &count) )
+   {
+      gdouble values[6] = {0};
+      static const gchar *names[] = {"mean", "p50", "p90", "p99", "p99.9", "max"};
+      for( guint vi = 0; vi < G_N_ELEMENTS(names); vi++ )
+      {
+         gchar *field = g_strdup_printf("%s-%s%s", prefix, names[vi], unit);
+         gst_structure_get_double(stats, field, &values[vi]);
+         g_free(field);
+      }
+
+      GST_INFO_OBJECT(self, "EOS SUMMARY: %s%s: count: %" G_GUINT64_FORMAT
+                      " mean: %.2f p50: %.2f p90: %.2f p99: %.2f p99.9: %.2f max: %.2f",
+                      prefix, unit, count, values[0], values[1], values[2],
+                      values[3], values[4], values[5]);
+   }
+   g_free(countfield);
+}
+
+static void display_eos_summary(GstBuffersPerSecond *self)
+{
+   if( !GST_CLOCK_TIME_IS_VALID (self->start_ts) )
       return;
 
-   gdouble average_bps = (gdouble) buffers_received / time_elapsed;
-   gsize bytes_received = self->bytes_received;
-   gdouble average_throughput = (gdouble) bytes_received / time_elapsed;
+   GstStructure *stats = gst_buffers_per_second_get_stats(self);
+
+   guint64 buffers_received = 0;
+   gdouble average_bps = 0;
+   gdouble average_mbps = 0;
+   gst_structure_get(stats,
+                     "buffers", G_TYPE_UINT64, &buffers_received,
+                     "average-bps", G_TYPE_DOUBLE, &average_bps,
+                     "average-mbps", G_TYPE_DOUBLE, &average_mbps,
+                     NULL);
 
    GST_INFO_OBJECT(self, "EOS SUMMARY: buffers_received: %" G_GUINT64_FORMAT
               " average bps: %.2f"
               " average Mbps: %.2f",
               buffers_received,
               average_bps,
-              (average_throughput*8)/1000000.0);
+              average_mbps);
+
+   static const gchar *histograms[][2] =
+   {
+      {"latency", "-ms"},
+      {"rois", ""},
+      {"new-objs", ""},
+   };
+
+   for( guint i = 0; i < G_N_ELEMENTS(histograms); i++ )
+      display_histogram_summary(self, stats, histograms[i][0], histograms[i][1]);
+
+   const GValue *stages = gst_structure_get_value(stats, "latency-stages");
+   if( stages )
+   {
+      for( guint i = 0; i < gst_value_array_get_size(stages); i++ )
+      {
+         const GValue *stage = gst_value_array_get_value(stages, i);
+         display_histogram_summary(self, stats, g_value_get_string(stage), "-ms");
+      }
+   }
+
+   gst_structure_free(stats);
 }
 
 /* GstElement vmethod implementations */
@@ -424,12 +722,15 @@ display_current_bps (gpointer data)
   rr = (gdouble) (buffers_received - self->last_buffers_received) / time_diff;
   average_bps = (gdouble) buffers_received / time_elapsed;
 
+  GST_OBJECT_LOCK (self);
+  self->current_bps = rr;
   if (self->max_bps == -1 || rr > self->max_bps) {
     self->max_bps = rr;
   }
   if (self->min_bps == -1 || rr < self->min_bps) {
     self->min_bps = rr;
   }
+  GST_OBJECT_UNLOCK (self);
 
   rb = (gdouble)(bytes_received - self->last_bytes_received) / time_diff;
   average_throughput = (gdouble) bytes_received / time_elapsed;
@@ -447,40 +748,96 @@ display_current_bps (gpointer data)
   self->last_bytes_received = bytes_received;
   self->last_ts = current_ts;
 
+  if( self->bpostmessages )
+  {
+     gst_element_post_message (GST_ELEMENT (self),
+                               gst_message_new_element (GST_OBJECT (self),
+                                                        gst_buffers_per_second_get_stats(self)));
+  }
+
   return TRUE;
 }
 
-static inline void clear_ts_lists(GstBuffersPerSecond *bps)
+static inline void reset_stats(GstBuffersPerSecond *bps)
 {
-    g_mutex_lock(&bps->statscollectmutex);
-    bps->bclock_wallclock_list_reversed = FALSE;
-    if( bps->clockid_list )
-    {
-       g_slist_free(bps->clockid_list);
-       bps->clockid_list = NULL;
-    }
-    if( bps->wallclockts_list )
-    {
-       g_slist_free(bps->wallclockts_list);
-       bps->wallclockts_list = NULL;
-    }
-    if( bps->perframe_n_roi_list )
-    {
-       g_slist_free(bps->perframe_n_roi_list);
-       bps->perframe_n_roi_list = NULL;
-    }
-    if( bps->perframe_new_objs )
-    {
-       g_slist_free(bps->perframe_new_objs);
-       bps->perframe_new_objs = NULL;
-    }
-    if( bps->perframe_untagged_objs )
-    {
-       g_slist_free(bps->perframe_untagged_objs);
-       bps->perframe_untagged_objs = NULL;
-    }
-    g_hash_table_remove_all(bps->objid_hash);
-    g_mutex_unlock(&bps->statscollectmutex);
+   GST_OBJECT_LOCK (bps);
+   bps->max_bps = -1;
+   bps->min_bps = -1;
+   bps->current_bps = -1;
+   GST_OBJECT_UNLOCK (bps);
+
+   gst_bps_histogram_reset(bps->latency_hist);
+   gst_bps_histogram_reset(bps->nroi_hist);
+   gst_bps_histogram_reset(bps->newobjs_hist);
+   g_atomic_pointer_set(&bps->latency_unmatched, 0);
+   g_atomic_pointer_set(&bps->untagged_objs, 0);
+
+   g_atomic_int_set(&bps->ntrace_segments, 0);
+   remote_offload_trace_clock_sync_reset(&bps->trace_clock_sync);
+
+   g_hash_table_remove_all(bps->objid_hash);
+   bps->frame_index = 0;
+}
+
+static gboolean gst_buffers_per_second_open_stats_file(GstBuffersPerSecond *self)
+{
+   if( !g_strcmp0(self->statsfile, "stderr") )
+   {
+      self->statsfp = stderr;
+   }
+   else
+   if( !g_strcmp0(self->statsfile, "stdout") )
+   {
+      self->statsfp = stdout;
+   }
+   else
+   {
+      self->statsfp = fopen(self->statsfile, "w");
+      if( !self->statsfp )
+      {
+         GST_ERROR_OBJECT(self, "Unable to open file %s for writing.",
+                                 self->statsfile);
+         return FALSE;
+      }
+   }
+
+   self->statsfile_index = 0;
+
+   fprintf(self->statsfp, "BUF_INDEX, BUFFER_TIMESTAMP, ABS_TIMESTAMP, ");
+   if( tracks_latency(self) )
+      fprintf(self->statsfp, "LATENCY, ");
+
+   if( self->btracknrois )
+      fprintf(self->statsfp, "N_ROI, ");
+
+   if( self->btracknewobjs )
+      fprintf(self->statsfp, "NEW_OBJS, UNTAGGED_OBJS");
+
+   fprintf(self->statsfp, "\n");
+
+   return TRUE;
+}
+
+static void gst_buffers_per_second_close_stats_file(GstBuffersPerSecond *self)
+{
+   if( !self->statsfp )
+      return;
+
+   fflush(self->statsfp);
+   if( (self->statsfp != stdout) &&
+       (self->statsfp != stderr) )
+   {
+      fclose(self->statsfp);
+   }
+
+   self->statsfp = NULL;
+}
+
+static gboolean objid_expired(gpointer key, gpointer value, gpointer user_data)
+{
+   GstBuffersPerSecond *self = (GstBuffersPerSecond *)user_data;
+
+   return (self->frame_index - GPOINTER_TO_UINT(value)) > OBJID_EXPIRY_FRAMES;
 }
 
 /* this function handles sink events */
@@ -496,15 +853,15 @@ gst_buffers_per_second_sink_event (GstPad * pad, GstObject * parent, GstEvent *
   {
      case GST_EVENT_STREAM_START:
        //reset / initialize stuff at the start of a stream
+       GST_OBJECT_LOCK (bps);
        bps->last_ts = bps->start_ts = bps->interval_ts = GST_CLOCK_TIME_NONE;
+       GST_OBJECT_UNLOCK (bps);
        bps->buffers_received = 0;
        bps->last_buffers_received = G_GUINT64_CONSTANT (0);
        bps->bytes_received =  0;
        bps->last_bytes_received =  0;
-       bps->max_bps = -1;
-       bps->min_bps = -1;
 
-       clear_ts_lists(bps);
+       reset_stats(bps);
 
      break;
 
@@ -512,6 +869,9 @@ gst_buffers_per_second_sink_event (GstPad * pad, GstObject * parent, GstEvent *
        //display current on EOS, unless we are a latency source
       if( !bps->blatency_is_source )
          display_eos_summary(bps);
+
+      if( bps->statsfp )
+         fflush(bps->statsfp);
      break;
 
      default:
@@ -522,6 +882,113 @@ gst_buffers_per_second_sink_event (GstPad * pad, GstObject * parent, GstEvent *
 }
 
 
+//Attach a trace meta to buf (restarting the trace, if it already had one)
+static GstBuffer *start_trace(GstBuffer *buf)
+{
+   buf = gst_buffer_make_writable(buf);
+
+   RemoteOffloadTraceMeta *meta = remote_offload_buffer_get_trace_meta(buf);
+   if( meta )
+   {
+      meta->domain = 0;
+      meta->overflowed = FALSE;
+      meta->nhops = 0;
+   }
+   else
+   {
+      meta = remote_offload_buffer_add_trace_meta(buf);
+   }
+
+   remote_offload_trace_meta_add_hop(meta, REMOTEOFFLOAD_TRACE_STAGE_SOURCE);
+
+   return buf;
+}
+
+static GstBpsTraceSegment *get_trace_segment(GstBuffersPerSecond *self, guint32 key)
+{
+   gint nsegments = g_atomic_int_get(&self->ntrace_segments);
+   for( gint i = 0; i < nsegments; i++ )
+   {
+      if( self->trace_segments[i].key == key )
+         return &self->trace_segments[i];
+   }
+
+   if( nsegments >= BPS_TRACE_MAX_SEGMENTS )
+      return NULL;
+
+   //only the streaming thread adds segments
+   GstBpsTraceSegment *segment = &self->trace_segments[nsegments];
+   segment->key = key;
+   gst_bps_histogram_reset(&segment->hist);
+   g_atomic_int_set(&self->ntrace_segments, nsegments + 1);
+
+   return segment;
+}
+
+//Record the time spent in between each of the hops of a traced buffer, and
+// return its end-to-end latency. Timestamps taken on the remote side are
+// converted to this side's clock, once the offset between them is known.
+static gboolean record_trace(GstBuffersPerSecond *self,
+                             GstBuffer *buf,
+                             GstClockTime ts,
+                             GstClockTime *latency)
+{
+   RemoteOffloadTraceMeta *meta = remote_offload_buffer_get_trace_meta(buf);
+   if( !meta || !meta->nhops ||
+       (meta->hops[0].stage != REMOTEOFFLOAD_TRACE_STAGE_SOURCE) )
+      return FALSE;
+
+   RemoteOffloadTraceClockSync *sync = &self->trace_clock_sync;
+   remote_offload_trace_clock_sync_update(sync, meta);
+
+   //this element closes the trace
+   RemoteOffloadTraceHop sinkhop = {0};
+   sinkhop.ts = ts;
+   sinkhop.stage = REMOTEOFFLOAD_TRACE_STAGE_SINK;
+   sinkhop.domain = meta->domain;
+
+   //with hops missing, the time between the ones either side of the gap
+   // would be misattributed, so only the end-to-end latency is recorded.
+   if( !meta->overflowed && self->trace_segments )
+   {
+      const RemoteOffloadTraceHop *from = &meta->hops[0];
+      GstClockTime from_ts = remote_offload_trace_clock_sync_to_origin(sync,
+                                                                       from->domain,
+                                                                       from->ts);
+      for( guint i = 1; i <= meta->nhops; i++ )
+      {
+         const RemoteOffloadTraceHop *to = (i < meta->nhops) ? &meta->hops[i] : &sinkhop;
+         GstClockTime to_ts = remote_offload_trace_clock_sync_to_origin(sync,
+                                                                        to->domain,
+                                                                        to->ts);
+         if( GST_CLOCK_TIME_IS_VALID(from_ts) && GST_CLOCK_TIME_IS_VALID(to_ts) )
+         {
+            GstBpsTraceSegment *segment = get_trace_segment(self,
+                                                            TRACE_SEGMENT_KEY(from, to));
+            //error in the offset estimate can make a short segment appear
+            // to go backwards in time. It's counted as 0.
+            if( segment )
+               gst_bps_histogram_record(&segment->hist,
+                                        (to_ts > from_ts) ? (to_ts - from_ts) / GST_USECOND : 0);
+         }
+
+         from = to;
+         from_ts = to_ts;
+      }
+   }
+
+   GstClockTime source_ts = meta->hops[0].ts;
+   GstClockTime sink_ts = remote_offload_trace_clock_sync_to_origin(sync,
+                                                                    meta->domain,
+                                                                    ts);
+   if( !GST_CLOCK_TIME_IS_VALID(sink_ts) )
+      return FALSE;
+
+   *latency = (sink_ts > source_ts) ? sink_ts - source_ts : 0;
+
+   return TRUE;
+}
+
 /* chain function
  * this function does the actual processing
  */
@@ -532,6 +999,13 @@ gst_buffers_per_second_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 
   GstClockTime ts = gst_util_get_timestamp ();
 
+  if (G_UNLIKELY (!GST_CLOCK_TIME_IS_VALID (self->start_ts)))
+  {
+     GST_OBJECT_LOCK (self);
+     self->interval_ts = self->last_ts = self->start_ts = ts;
+     GST_OBJECT_UNLOCK (self);
+  }
+
   //if we are acting as a latency source, it most likely means that there is
   // another bps later in the pipeline... so skip tracking BPS, MBPS by default.
   if( !self->blatency_is_source )
@@ -539,10 +1013,6 @@ gst_buffers_per_second_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
      g_atomic_int_inc (&self->buffers_received);
      self->bytes_received += gst_buffer_get_size(buf);
 
-     if (G_UNLIKELY (!GST_CLOCK_TIME_IS_VALID (self->start_ts)))
-     {
-        self->interval_ts = self->last_ts = self->start_ts = ts;
-     }
      if (GST_CLOCK_DIFF (self->interval_ts, ts) > self->bps_update_interval)
      {
         display_current_bps (self);
@@ -551,27 +1021,57 @@ gst_buffers_per_second_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
   }
 
   GstClockTime clock_id = GST_BUFFER_DTS_OR_PTS(buf);
-  g_mutex_lock(&self->statscollectmutex);
 
-  if( self->statsfile || self->blatency_is_source )
+  if( self->latency_ring && GST_CLOCK_TIME_IS_VALID(clock_id) )
+     gst_bps_timestamp_ring_put(self->latency_ring, clock_id, ts);
+
+  if( self->blatency_trace && self->blatency_is_source )
+     buf = start_trace(buf);
+
+  gboolean blatency_valid = FALSE;
+  GstClockTime latency = 0;
+  if( self->blatency_trace && !self->blatency_is_source )
+  {
+     blatency_valid = record_trace(self, buf, ts, &latency);
+     if( blatency_valid )
+        gst_bps_histogram_record(self->latency_hist, latency / GST_USECOND);
+     else
+        g_atomic_pointer_add(&self->latency_unmatched, 1);
+  }
+  else
+  if( self->bps_latency_track_source )
   {
-     self->clockid_list = g_slist_prepend(self->clockid_list, (gpointer)clock_id);
-     self->wallclockts_list = g_slist_prepend(self->wallclockts_list, (gpointer)ts);
+     GstBuffersPerSecond *source_bps = GST_BUFFERSPERSECOND (self->bps_latency_track_source);
+     GstClockTime source_ts;
+     if( GST_CLOCK_TIME_IS_VALID(clock_id) &&
+         source_bps->latency_ring &&
+         gst_bps_timestamp_ring_get(source_bps->latency_ring, clock_id, &source_ts) &&
+         (ts >= source_ts) )
+     {
+        latency = ts - source_ts;
+        blatency_valid = TRUE;
+        gst_bps_histogram_record(self->latency_hist, latency / GST_USECOND);
+     }
+     else
+     {
+        //the buffer wasn't seen by the source (or has been overwritten there)
+        g_atomic_pointer_add(&self->latency_unmatched, 1);
+     }
   }
 
+  guint nmeta = 0;
   if( self->btracknrois )
   {
-     guint nmeta = gst_buffer_get_n_meta(buf, gst_video_region_of_interest_meta_api_get_type());
-     self->perframe_n_roi_list =  g_slist_prepend(self->perframe_n_roi_list,
-                                                  GUINT_TO_POINTER(nmeta));
+     nmeta = gst_buffer_get_n_meta(buf, gst_video_region_of_interest_meta_api_get_type());
+     gst_bps_histogram_record(self->nroi_hist, nmeta);
 
      GST_DEBUG_OBJECT(self, "%"GST_TIME_FORMAT": n rois = %u", GST_TIME_ARGS(clock_id), nmeta);
   }
 
+  guint new_objs = 0;
+  guint unknown_objs = 0;
   if( self->btracknewobjs )
   {
-     guint new_objs = 0;
-     guint unknown_objs = 0;
      GstVideoRegionOfInterestMeta * meta = NULL;
      gpointer state = NULL;
      guint metai = 0;
@@ -588,13 +1088,14 @@ gst_buffers_per_second_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
           gst_structure_get_int(object_id_struct, "id", &id);
           if( id )
           {
-             //g_hash_table_add returns TRUE if the hash table doesn't
-             // already contain this key.
-             if( g_hash_table_add(self->objid_hash,
-                                  GINT_TO_POINTER(id)))
+             if( !g_hash_table_contains(self->objid_hash, GINT_TO_POINTER(id)) )
              {
                 new_objs++;
              }
+
+             g_hash_table_insert(self->objid_hash,
+                                 GINT_TO_POINTER(id),
+                                 GUINT_TO_POINTER(self->frame_index));
           }
           else
           {
@@ -614,12 +1115,37 @@ gst_buffers_per_second_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
        metai++;
     }
 
-     self->perframe_new_objs =  g_slist_prepend(self->perframe_new_objs,
-                                                  GUINT_TO_POINTER(new_objs));
-     self->perframe_untagged_objs =  g_slist_prepend(self->perframe_untagged_objs,
-                                                  GUINT_TO_POINTER(unknown_objs));
+     gst_bps_histogram_record(self->newobjs_hist, new_objs);
+     g_atomic_pointer_add(&self->untagged_objs, unknown_objs);
+
+     self->frame_index++;
+     if( (self->frame_index % OBJID_PRUNE_INTERVAL) == 0 )
+        g_hash_table_foreach_remove(self->objid_hash, objid_expired, self);
+  }
+
+  if( self->statsfp )
+  {
+     fprintf(self->statsfp, "%" G_GUINT64_FORMAT ", %"GST_TIME_FORMAT", %"GST_TIME_FORMAT", ",
+             self->statsfile_index++,
+             GST_TIME_ARGS(clock_id),
+             GST_TIME_ARGS(ts - self->start_ts));
+
+     if( tracks_latency(self) )
+     {
+        if( blatency_valid )
+           fprintf(self->statsfp, "%.2f, ", (gdouble)latency / GST_MSECOND);
+        else
+           fprintf(self->statsfp, "?, ");
+     }
+
+     if( self->btracknrois )
+        fprintf(self->statsfp, "%u, ", nmeta);
+
+     if( self->btracknewobjs )
+        fprintf(self->statsfp, "%u, %u, ", new_objs, unknown_objs);
+
+     fprintf(self->statsfp, "\n");
   }
-  g_mutex_unlock(&self->statscollectmutex);
 
   /* just push out the incoming buffer without touching it */
   return gst_pad_push (self->srcpad, buf);
@@ -830,193 +1356,6 @@ static GstObject *GetParentPipeline(GstElement * element)
    return parent;
 }
 
-static void dump_stats_file(GstBuffersPerSecond *self)
-{
-   g_mutex_lock(&self->statscollectmutex);
-   FILE *outfile = NULL;
-   if( !g_strcmp0(self->statsfile, "stderr") )
-   {
-      outfile = stderr;
-   }
-   else
-   if( !g_strcmp0(self->statsfile, "stdout") )
-   {
-      outfile = stdout;
-   }
-   else
-   {
-      outfile = fopen(self->statsfile, "w");
-      if( !outfile )
-      {
-         g_mutex_unlock(&self->statscollectmutex);
-         GST_ERROR_OBJECT(self, "Unable to open file %s for writing.",
-                                 self->statsfile);
-         return;
-      }
-   }
-
-   gint nentries_per_row = 3;
-   fprintf(outfile, "BUF_INDEX, BUFFER_TIMESTAMP, ABS_TIMESTAMP, ");
-   if( self->bps_latency_track_source )
-   {
-      fprintf(outfile, "LATENCY, ");
-      nentries_per_row++;
-   }
-
-   if( self->btracknrois )
-   {
-      fprintf(outfile, "N_ROI, ");
-      nentries_per_row++;
-   }
-
-   if( self->btracknewobjs )
-   {
-      fprintf(outfile, "NEW_OBJS, UNTAGGED_OBJS");
-      nentries_per_row+=2;
-   }
-   fprintf(outfile, "\n");
-
-   if( !self->bclock_wallclock_list_reversed )
-   {
-      self->clockid_list = g_slist_reverse(self->clockid_list);
-      self->wallclockts_list = g_slist_reverse(self->wallclockts_list);
-      self->bclock_wallclock_list_reversed = TRUE;
-   }
-   self->perframe_n_roi_list = g_slist_reverse(self->perframe_n_roi_list);
-   self->perframe_new_objs = g_slist_reverse(self->perframe_new_objs);
-   self->perframe_untagged_objs = g_slist_reverse(self->perframe_untagged_objs);
-
-   GstBuffersPerSecond *source_bps = NULL;
-   if( self->bps_latency_track_source )
-   {
-      source_bps =
-        GST_BUFFERSPERSECOND (self->bps_latency_track_source);
-      g_mutex_lock(&source_bps->statscollectmutex);
-      if( !source_bps->bclock_wallclock_list_reversed )
-      {
-         source_bps->clockid_list = g_slist_reverse(source_bps->clockid_list);
-         source_bps->wallclockts_list = g_slist_reverse(source_bps->wallclockts_list);
-         source_bps->bclock_wallclock_list_reversed = TRUE;
-      }
-   }
-   else
-   {
-      source_bps = self;
-   }
-
-   GSList *source_clockid_list = source_bps->clockid_list;
-   GSList *source_wallclockts_list = source_bps->wallclockts_list;
-   GSList *this_clockid_list = self->clockid_list;
-   GSList *wallclockts_list = self->wallclockts_list;
-   GSList *this_nroi_list = self->perframe_n_roi_list;
-   GSList *this_newobj_list = self->perframe_new_objs;
-   GSList *untagged_obj_list = self->perframe_untagged_objs;
-
-   guint buf_index = 0;
-   while( (source_clockid_list != NULL) && (source_wallclockts_list != NULL ) )
-   {
-      GstClockTime source_clock_id = (GstClockTime)source_clockid_list->data;
-      GstClockTime source_ts = (GstClockTime)source_wallclockts_list->data;
-      GstClockTime this_clock_id = GST_CLOCK_TIME_NONE;
-      GstClockTime end_ts = GST_CLOCK_TIME_NONE;
-
-      if( this_clockid_list )
-         this_clock_id = (GstClockTime)this_clockid_list->data;
-
-      if( wallclockts_list )
-         end_ts = (GstClockTime)wallclockts_list->data;
-
-      //always print buf index & pts of buffer
-      fprintf(outfile, "%u, %"GST_TIME_FORMAT", ",
-                              buf_index,
-                              GST_TIME_ARGS(source_clock_id));
-
-      if( this_clock_id == source_clock_id )
-      {
-         //print absolute time
-         fprintf(outfile, "%"GST_TIME_FORMAT", ", GST_TIME_ARGS(end_ts - self->start_ts));
-
-         if( self->bps_latency_track_source )
-         {
-           gdouble time_diff = (gdouble) (end_ts - source_ts) / GST_MSECOND;
-           fprintf(outfile, "%.2f, ", time_diff);
-         }
-
-         if( self->btracknrois )
-         {
-            if( this_nroi_list  )
-            {
-               fprintf(outfile, "%u, ", GPOINTER_TO_UINT(this_nroi_list->data));
-               this_nroi_list = this_nroi_list->next;
-            }
-            else
-            {
-               //this shouldn't ever happen..
-               fprintf(outfile, "?, ");
-            }
-         }
-
-         if( self->btracknewobjs )
-         {
-            if( this_newobj_list  )
-            {
-               fprintf(outfile, "%u, ", GPOINTER_TO_UINT(this_newobj_list->data));
-               this_newobj_list = this_newobj_list->next;
-            }
-            else
-            {
-               //this shouldn't ever happen..
-               fprintf(outfile, "?, ");
-            }
-
-            if( untagged_obj_list )
-            {
-               fprintf(outfile, "%u, ", GPOINTER_TO_UINT(untagged_obj_list->data));
-               untagged_obj_list = untagged_obj_list->next;
-            }
-            else
-            {
-               //this shouldn't ever happen..
-               fprintf(outfile, "?, ");
-            }
-         }
-
-         if( this_clockid_list )
-           this_clockid_list = this_clockid_list->next;
-
-         if( wallclockts_list )
-           wallclockts_list = wallclockts_list->next;
-      }
-      else
-      {
-         for( int i = 0; i < (nentries_per_row-2); i++ )
-         {
-            fprintf(outfile, "dropped, ");
-         }
-      }
-      fprintf(outfile, "\n");
-
-      source_clockid_list = source_clockid_list->next;
-      source_wallclockts_list = source_wallclockts_list->next;
-      buf_index++;
-   }
-
-   if( self->bps_latency_track_source )
-   {
-      g_mutex_unlock(&source_bps->statscollectmutex);
-   }
-
-   if( outfile &&
-      (outfile != stdout) &&
-      (outfile != stderr))
-   {
-      fflush(outfile);
-      fclose(outfile);
-   }
-
-   g_mutex_unlock(&self->statscollectmutex);
-}
-
 static GstStateChangeReturn gst_buffers_per_second_change_state (GstElement * element,
     GstStateChange transition)
 {
@@ -1030,8 +1369,7 @@ static GstStateChangeReturn gst_buffers_per_second_change_state (GstElement * el
        self->last_buffers_received = G_GUINT64_CONSTANT (0);
        self->bytes_received =  0;
        self->last_bytes_received =  0;
-       self->max_bps = -1;
-       self->min_bps = -1;
+       reset_stats(self);
 
        /* init time stamps */
        self->last_ts = self->start_ts = self->interval_ts = GST_CLOCK_TIME_NONE;
@@ -1039,6 +1377,11 @@ static GstStateChangeReturn gst_buffers_per_second_change_state (GstElement * el
        if( self->btrackmemutil )
           gst_buffers_per_second_memutil_start(self);
 
+       //properties can only be set in NULL state, so this stays put while
+       // streaming.
+       if( self->blatency_trace && !self->blatency_is_source && !self->trace_segments )
+          self->trace_segments = g_new0(GstBpsTraceSegment, BPS_TRACE_MAX_SEGMENTS);
+
        if( self->latency_track_from )
        {
           GstObject *pipeline = GetParentPipeline(element);
@@ -1078,6 +1421,11 @@ static GstStateChangeReturn gst_buffers_per_second_change_state (GstElement * el
        }
        break;
 
+       case GST_STATE_CHANGE_READY_TO_PAUSED:
+       if( self->statsfile )
+          gst_buffers_per_second_open_stats_file(self);
+       break;
+
        case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
        if( self->btrackcpuutil )
           if( !gst_buffers_per_second_cpuutil_start(self) )
@@ -1094,18 +1442,9 @@ static GstStateChangeReturn gst_buffers_per_second_change_state (GstElement * el
           }
        break;
 
-       case GST_STATE_CHANGE_PAUSED_TO_READY:
-       {
-          if( self->statsfile )
-          {
-             dump_stats_file(self);
-          }
-       }
-       break;
-
        case GST_STATE_CHANGE_READY_TO_NULL:
 
-       clear_ts_lists(self);
+       reset_stats(self);
 
        if( self->btrackmemutil )
           gst_buffers_per_second_memutil_stop(self);
@@ -1121,7 +1460,15 @@ static GstStateChangeReturn gst_buffers_per_second_change_state (GstElement * el
        break;
     }
 
-    return GST_ELEMENT_CLASS (gst_buffers_per_second_parent_class)->change_state (element, transition);
+    GstStateChangeReturn ret =
+          GST_ELEMENT_CLASS (gst_buffers_per_second_parent_class)->change_state (element, transition);
+
+    //the stats file is written from the chain function, so it's closed
+    // once streaming has stopped.
+    if( transition == GST_STATE_CHANGE_PAUSED_TO_READY )
+       gst_buffers_per_second_close_stats_file(self);
+
+    return ret;
 }
 
 
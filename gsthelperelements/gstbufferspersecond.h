@@ -23,7 +23,10 @@
 #ifndef __GST_BUFFERSPERSECOND_H__
 #define __GST_BUFFERSPERSECOND_H__
 
+#include <stdio.h>
 #include <gst/gst.h>
+#include "gstbpsstats.h"
+#include "remoteoffloadtracemeta.h"
 
 G_BEGIN_DECLS
 
@@ -39,6 +42,18 @@ G_BEGIN_DECLS
 #define GST_IS_BUFFERSPERSECOND_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_BUFFERSPERSECOND))
 
+//Segments of a traced buffer's path (i.e. from the "send" of one host to the
+// "receive" of the other) that are kept track of.
+#define BPS_TRACE_MAX_SEGMENTS 24
+
+typedef struct _GstBpsTraceSegment
+{
+   //stage & domain of the hop that the segment starts at, and of the one it
+   // ends at (a byte each)
+   guint32 key;
+   GstBpsHistogram hist; //in microseconds
+}GstBpsTraceSegment;
+
 typedef struct _GstBuffersPerSecond      GstBuffersPerSecond;
 typedef struct _GstBuffersPerSecondClass GstBuffersPerSecondClass;
 
@@ -83,17 +98,31 @@ struct _GstBuffersPerSecond
   gchar *latency_track_from;
   GstElement *bps_latency_track_source;
 
-  GMutex statscollectmutex;
-  GSList *clockid_list;
-  GSList *wallclockts_list;
-  gboolean bclock_wallclock_list_reversed;
-  GSList *perframe_n_roi_list; //for tracking num. ROI's per frame
-  GSList *perframe_new_objs;
-  GSList *perframe_untagged_objs;
+  //for tracking latency with a RemoteOffloadTraceMeta, carried by the buffers
+  gboolean blatency_trace;
+  RemoteOffloadTraceClockSync trace_clock_sync;
+  GstBpsTraceSegment *trace_segments; //only allocated when measuring from the meta
+  gint ntrace_segments; /* ATOMIC */
+
+  //Per-frame statistics. These are updated on the streaming thread without
+  // locking, and are bounded in size for the life of the element.
+  GstBpsTimestampRing *latency_ring; //only allocated for a latency source
+  GstBpsHistogram *latency_hist;     //in microseconds
+  GstBpsHistogram *nroi_hist;
+  GstBpsHistogram *newobjs_hist;
+  gsize latency_unmatched; /* ATOMIC */
+  gsize untagged_objs;     /* ATOMIC */
+  gdouble current_bps;
+  gboolean bpostmessages;
 
   gboolean btracknrois;
   gboolean btracknewobjs;
-  GHashTable *objid_hash;
+  GHashTable *objid_hash; //object id to the frame index it was last seen at
+  guint frame_index;
+
+  //per-frame CSV rows are written as frames arrive
+  FILE *statsfp;
+  guint64 statsfile_index;
 
   gchar *statsfile;
 
@@ -27,11 +27,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
 #include "gstvideoroicompose.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_video_roi_compose_debug);
 #define GST_CAT_DEFAULT gst_video_roi_compose_debug
 
+//Output size used when downstream doesn't constrain it
+#define DEFAULT_CANVAS_WIDTH 1280
+#define DEFAULT_CANVAS_HEIGHT 720
+
+//Crops are drawn into the canvas as-is, so they need to be in the same
+// format as the output.
+#define COMPOSE_FORMATS "{ BGRx, BGRA, RGBA, NV12, I420 }"
+
 /* Filter signals and args */
 enum
 {
@@ -42,6 +51,7 @@ enum
 enum
 {
   PROP_0,
+  PROP_FULL_CLEAR,
 };
 
 /* the capabilities of the inputs and outputs.
@@ -51,7 +61,7 @@ enum
 static GstStaticPadTemplate sinkvideo_factory = GST_STATIC_PAD_TEMPLATE ("sinkvideo",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE("{ BGRx, BGRA }"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE(COMPOSE_FORMATS))
     );
 
 static GstStaticPadTemplate sinkmeta_factory = GST_STATIC_PAD_TEMPLATE ("sinkmeta",
@@ -63,12 +73,9 @@ static GstStaticPadTemplate sinkmeta_factory = GST_STATIC_PAD_TEMPLATE ("sinkmet
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE("{ BGRx, BGRA }"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE(COMPOSE_FORMATS))
     );
 
-#define VIDEO_SINK_CAPS GST_VIDEO_CAPS_MAKE("{ BGRx, BGRA }")
-#define S GST_VIDEO_CAPS_MAKE("{ BGRx, BGRA }")
-
 #define gst_video_roi_compose_parent_class parent_class
 G_DEFINE_TYPE (GstVideoRoiCompose, gst_video_roi_compose, GST_TYPE_AGGREGATOR);
 
@@ -91,6 +98,15 @@ static gboolean          gst_video_roi_compose_sink_event (GstAggregator    *  a
                                        GstAggregatorPad *  aggregator_pad,
                                        GstEvent         *  event);
 
+static gboolean          gst_video_roi_compose_sink_query (GstAggregator    *  aggregator,
+                                       GstAggregatorPad *  aggregator_pad,
+                                       GstQuery         *  query);
+
+static gboolean          gst_video_roi_compose_decide_allocation (GstAggregator * aggregator,
+                                       GstQuery * query);
+
+static gboolean          gst_video_roi_compose_stop (GstAggregator * aggregator);
+
 /* GObject vmethod implementations */
 
 /* initialize the videoroicompose's class */
@@ -108,6 +124,14 @@ gst_video_roi_compose_class_init (GstVideoRoiComposeClass * klass)
   gobject_class->set_property = gst_video_roi_compose_set_property;
   gobject_class->get_property = gst_video_roi_compose_get_property;
 
+  g_object_class_install_property (gobject_class, PROP_FULL_CLEAR,
+      g_param_spec_boolean ("full-clear", "full clear",
+          "Clear the whole canvas for each output frame. By default, only the regions "
+          "that were drawn to the last time that a (pooled) buffer was used are cleared, "
+          "which assumes that downstream elements don't draw on the frames in-place",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstaggregator_class->aggregate =
         GST_DEBUG_FUNCPTR (gst_video_roi_compose_aggregate);
   gstaggregator_class->update_src_caps =
@@ -116,10 +140,17 @@ gst_video_roi_compose_class_init (GstVideoRoiComposeClass * klass)
         GST_DEBUG_FUNCPTR(gst_video_roi_compose_negotiated_src_caps);
   gstaggregator_class->sink_event =
         GST_DEBUG_FUNCPTR(gst_video_roi_compose_sink_event);
+  gstaggregator_class->sink_query =
+        GST_DEBUG_FUNCPTR(gst_video_roi_compose_sink_query);
+  gstaggregator_class->decide_allocation =
+        GST_DEBUG_FUNCPTR(gst_video_roi_compose_decide_allocation);
+  gstaggregator_class->stop =
+        GST_DEBUG_FUNCPTR(gst_video_roi_compose_stop);
   gst_element_class_set_details_simple(gstelement_class,
     "GVAVideoRoiCompose",
-    "FIXME:Generic",
-    "FIXME:Generic Template Element",
+    "Filter/Editor/Video/Compositor",
+    "Draws cropped ROI's onto a canvas, at the position given by their meta. "
+    "The output size & format are negotiated with downstream",
     "rdmetca <<user@hostname.org>>");
 
   gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
@@ -145,16 +176,26 @@ gst_video_roi_compose_init (GstVideoRoiCompose * filter)
   filter->sinkmetapad =
         (GstAggregatorPad *)gst_element_get_static_pad((GstElement *)filter, "sinkmeta");
 
+  gst_video_info_init(&filter->in_cropped_info);
+  gst_video_info_init(&filter->out_composed_info);
+
   filter->currentbuffer = NULL;
   filter->currenttimestamp = 0;
+  filter->currentdirty = NULL;
+  filter->bfullclear = FALSE;
 }
 
 static void
 gst_video_roi_compose_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
-//  GstVideoRoiCompose *filter = GST_VIDEOROICOMPOSE (object);
+  GstVideoRoiCompose *filter = GST_VIDEOROICOMPOSE (object);
   switch (prop_id) {
+    case PROP_FULL_CLEAR:
+      GST_OBJECT_LOCK (filter);
+      filter->bfullclear = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -165,54 +206,233 @@ static void
 gst_video_roi_compose_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
-  //GstVideoRoiCompose *filter = GST_VIDEOROICOMPOSE (object);
+  GstVideoRoiCompose *filter = GST_VIDEOROICOMPOSE (object);
   switch (prop_id) {
+    case PROP_FULL_CLEAR:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_boolean (value, filter->bfullclear);
+      GST_OBJECT_UNLOCK (filter);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
-static GstBuffer *alloc_new_buffer(GstVideoRoiCompose *vidroicompose)
+static GQuark dirty_regions_quark(void)
+{
+   static GQuark quark = 0;
+   if( G_UNLIKELY(!quark) )
+      quark = g_quark_from_static_string("GstVideoRoiComposeDirtyRegions");
+
+   return quark;
+}
+
+//The region of 'plane' covered by rect, in bytes (x & width) and rows. Chroma
+// planes of subsampled formats are rounded outwards, to cover every pixel.
+static void get_plane_region(const GstVideoFormatInfo *finfo,
+                             guint plane,
+                             const GstVideoRectangle *rect,
+                             guint *x_bytes,
+                             guint *y,
+                             guint *width_bytes,
+                             guint *height)
+{
+   guint comp = 0;
+   for( guint c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS(finfo); c++ )
+   {
+      if( GST_VIDEO_FORMAT_INFO_PLANE(finfo, c) == plane )
+      {
+         comp = c;
+         break;
+      }
+   }
+
+   guint wsub = GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp);
+   guint hsub = GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp);
+   guint pstride = GST_VIDEO_FORMAT_INFO_PSTRIDE(finfo, comp);
+
+   guint x0 = (guint)rect->x >> wsub;
+   guint x1 = GST_VIDEO_SUB_SCALE(wsub, rect->x + rect->w);
+   guint y0 = (guint)rect->y >> hsub;
+   guint y1 = GST_VIDEO_SUB_SCALE(hsub, rect->y + rect->h);
+
+   *x_bytes = x0 * pstride;
+   *width_bytes = (x1 - x0) * pstride;
+   *y = y0;
+   *height = y1 - y0;
+}
+
+//Background of the canvas: white for RGB, and white (full-range luma, neutral
+// chroma) for YUV
+static inline guint8 plane_clear_value(const GstVideoFormatInfo *finfo, guint plane)
+{
+   if( GST_VIDEO_FORMAT_INFO_IS_YUV(finfo) && (plane > 0) )
+      return 128;
+
+   return 255;
+}
+
+static void clear_region(GstVideoFrame *frame, const GstVideoRectangle *rect)
+{
+   const GstVideoFormatInfo *finfo = frame->info.finfo;
+   for( guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(frame); plane++ )
+   {
+      guint x_bytes, y, width_bytes, height;
+      get_plane_region(finfo, plane, rect, &x_bytes, &y, &width_bytes, &height);
+
+      gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane);
+      guint8 *row = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, plane) +
+                    (gsize)y * stride + x_bytes;
+      guint8 value = plane_clear_value(finfo, plane);
+
+      //a region spanning the full stride can be cleared in one go
+      if( (x_bytes == 0) && (width_bytes == (guint)stride) )
+      {
+         memset(row, value, (gsize)height * stride);
+         continue;
+      }
+
+      for( guint r = 0; r < height; r++ )
+      {
+         memset(row, value, width_bytes);
+         row += stride;
+      }
+   }
+}
+
+//Copy the top-left rect->w x rect->h of 'crop' to rect in 'canvas'. Rows are
+// copied with memcpy, which is vectorized by the C library.
+static void copy_region(GstVideoFrame *canvas,
+                        GstVideoFrame *crop,
+                        const GstVideoRectangle *rect)
+{
+   const GstVideoFormatInfo *finfo = canvas->info.finfo;
+   GstVideoRectangle croprect = { 0, 0, rect->w, rect->h };
+
+   for( guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(canvas); plane++ )
+   {
+      guint x_bytes, y, width_bytes, height;
+      get_plane_region(finfo, plane, rect, &x_bytes, &y, &width_bytes, &height);
+
+      guint crop_x_bytes, crop_y, crop_width_bytes, crop_height;
+      get_plane_region(finfo, plane, &croprect, &crop_x_bytes, &crop_y,
+                       &crop_width_bytes, &crop_height);
+
+      width_bytes = MIN(width_bytes, crop_width_bytes);
+      height = MIN(height, crop_height);
+
+      gint canvas_stride = GST_VIDEO_FRAME_PLANE_STRIDE(canvas, plane);
+      gint crop_stride = GST_VIDEO_FRAME_PLANE_STRIDE(crop, plane);
+      guint8 *dst = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(canvas, plane) +
+                    (gsize)y * canvas_stride + x_bytes;
+      const guint8 *src = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(crop, plane);
+
+      for( guint r = 0; r < height; r++ )
+      {
+         memcpy(dst, src, width_bytes);
+         dst += canvas_stride;
+         src += crop_stride;
+      }
+   }
+}
+
+static void release_current_buffer(GstVideoRoiCompose *vidroicompose)
+{
+   if( !vidroicompose->currentbuffer )
+      return;
+
+   gst_video_frame_unmap(&vidroicompose->currentframe);
+   gst_buffer_unref(vidroicompose->currentbuffer);
+   vidroicompose->currentbuffer = NULL;
+   vidroicompose->currentdirty = NULL;
+}
+
+static GstFlowReturn finish_current_buffer(GstVideoRoiCompose *vidroicompose)
+{
+   gst_video_frame_unmap(&vidroicompose->currentframe);
+
+   GstBuffer *buf = vidroicompose->currentbuffer;
+   vidroicompose->currentbuffer = NULL;
+   vidroicompose->currentdirty = NULL;
+
+   return gst_aggregator_finish_buffer((GstAggregator *)vidroicompose, buf);
+}
+
+//Acquire the next canvas from the pool, map it, and clear whatever was drawn
+// to it the last time that it was used.
+static GstFlowReturn acquire_canvas(GstVideoRoiCompose *vidroicompose)
 {
-  GstBuffer *buf = NULL;
   GstBufferPool *pool = gst_aggregator_get_buffer_pool((GstAggregator *)vidroicompose);
-  if( pool )
+  if( !pool )
   {
-     if( !gst_buffer_pool_is_active(pool) )
-     {
-        gst_buffer_pool_set_active(pool, TRUE);
-     }
+     GST_ERROR_OBJECT(vidroicompose, "No buffer pool has been negotiated");
+     return GST_FLOW_NOT_NEGOTIATED;
+  }
 
-     GstFlowReturn ret = gst_buffer_pool_acquire_buffer(pool, &buf, NULL);
-     if( ret != GST_FLOW_OK )
+  if( !gst_buffer_pool_is_active(pool) )
+  {
+     if( !gst_buffer_pool_set_active(pool, TRUE) )
      {
-        fprintf(stderr, "gst_video_roi_compose: gst_buffer_pool_acquire_buffer failed(%d)\n", ret);
-        buf = NULL;
+        GST_ERROR_OBJECT(vidroicompose, "Failed to activate buffer pool");
+        gst_object_unref(pool);
+        return GST_FLOW_ERROR;
      }
-     gst_object_unref(pool);
   }
-  else
+
+  GstBuffer *buf = NULL;
+  GstFlowReturn ret = gst_buffer_pool_acquire_buffer(pool, &buf, NULL);
+  gst_object_unref(pool);
+  if( ret != GST_FLOW_OK )
   {
-     guint outsize;
-     GstAllocator *allocator;
-     GstAllocationParams params;
-     gst_aggregator_get_allocator ((GstAggregator *)vidroicompose, &allocator, &params);
+     GST_WARNING_OBJECT(vidroicompose, "gst_buffer_pool_acquire_buffer failed (%s)",
+                        gst_flow_get_name(ret));
+     return ret;
+  }
 
-     outsize = GST_VIDEO_INFO_SIZE (&vidroicompose->out_composed_info);
-     buf = gst_buffer_new_allocate (allocator, outsize, &params);
+  if( !gst_video_frame_map(&vidroicompose->currentframe,
+                           &vidroicompose->out_composed_info,
+                           buf,
+                           GST_MAP_WRITE) )
+  {
+     GST_ERROR_OBJECT(vidroicompose, "error mapping canvas for writing");
+     gst_buffer_unref(buf);
+     return GST_FLOW_ERROR;
+  }
 
-     if (allocator)
-      gst_object_unref (allocator);
+  GST_OBJECT_LOCK (vidroicompose);
+  gboolean bfullclear = vidroicompose->bfullclear;
+  GST_OBJECT_UNLOCK (vidroicompose);
 
-     if (buf == NULL)
-     {
-        g_print("gst_video_roi_compose: Could not acquire buffer of size: %d\n", outsize);
-     }
+  //A buffer without dirty regions is new to us (or its memory was replaced
+  // while downstream), so its contents are unknown.
+  GArray *dirty = gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(buf), dirty_regions_quark());
+  if( !dirty || bfullclear )
+  {
+     GstVideoRectangle full = { 0, 0,
+                                GST_VIDEO_INFO_WIDTH(&vidroicompose->out_composed_info),
+                                GST_VIDEO_INFO_HEIGHT(&vidroicompose->out_composed_info) };
+     clear_region(&vidroicompose->currentframe, &full);
+  }
+  else
+  {
+     for( guint i = 0; i < dirty->len; i++ )
+        clear_region(&vidroicompose->currentframe,
+                     &g_array_index(dirty, GstVideoRectangle, i));
   }
 
+  if( !dirty )
+  {
+     dirty = g_array_new(FALSE, FALSE, sizeof(GstVideoRectangle));
+     gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(buf), dirty_regions_quark(),
+                               dirty, (GDestroyNotify)g_array_unref);
+  }
+  g_array_set_size(dirty, 0);
+
+  vidroicompose->currentbuffer = buf;
+  vidroicompose->currentdirty = dirty;
 
-  return buf;
+  return GST_FLOW_OK;
 }
 
 static void AddStructureToMeta(gpointer       data,
@@ -223,34 +443,106 @@ static void AddStructureToMeta(gpointer       data,
    gst_video_region_of_interest_meta_add_param(meta, gst_structure_copy(s));
 }
 
+//Draw the crop in videobuf onto the current canvas, at the position of meta
+static GstFlowReturn draw_crop(GstVideoRoiCompose *vidroicompose,
+                               GstBuffer *videobuf,
+                               GstVideoRegionOfInterestMeta *meta)
+{
+   guint canvasWidth = GST_VIDEO_INFO_WIDTH(&vidroicompose->out_composed_info);
+   guint canvasHeight = GST_VIDEO_INFO_HEIGHT(&vidroicompose->out_composed_info);
+
+   if( (meta->x >= canvasWidth) || (meta->y >= canvasHeight) )
+      return GST_FLOW_OK;
+
+   if( GST_VIDEO_INFO_FORMAT(&vidroicompose->in_cropped_info) !=
+       GST_VIDEO_INFO_FORMAT(&vidroicompose->out_composed_info) )
+   {
+      GST_ERROR_OBJECT(vidroicompose, "Crop format %s doesn't match canvas format %s",
+                       GST_VIDEO_INFO_NAME(&vidroicompose->in_cropped_info),
+                       GST_VIDEO_INFO_NAME(&vidroicompose->out_composed_info));
+      return GST_FLOW_NOT_NEGOTIATED;
+   }
+
+   GstVideoFrame crop;
+   if( !gst_video_frame_map(&crop, &vidroicompose->in_cropped_info, videobuf, GST_MAP_READ) )
+   {
+      GST_ERROR_OBJECT(vidroicompose, "error mapping video buffer for reading");
+      return GST_FLOW_ERROR;
+   }
+
+   GstVideoRectangle rect;
+   rect.x = meta->x;
+   rect.y = meta->y;
+   rect.w = MIN(GST_VIDEO_INFO_WIDTH(&vidroicompose->in_cropped_info), canvasWidth - meta->x);
+   rect.h = MIN(GST_VIDEO_INFO_HEIGHT(&vidroicompose->in_cropped_info), canvasHeight - meta->y);
+
+   copy_region(&vidroicompose->currentframe, &crop, &rect);
+   g_array_append_val(vidroicompose->currentdirty, rect);
+
+   gst_video_frame_unmap(&crop);
+
+   //add this meta to the current buffer
+   GstVideoRegionOfInterestMeta *meta_new =
+         gst_buffer_add_video_region_of_interest_meta_id(vidroicompose->currentbuffer,
+                                                         meta->roi_type,
+                                                         meta->x,
+                                                         meta->y,
+                                                         meta->w,
+                                                         meta->h);
+
+   if( meta->params )
+   {
+      g_list_foreach(meta->params, AddStructureToMeta, meta_new);
+   }
+
+   return GST_FLOW_OK;
+}
+
 static GstFlowReturn  gst_video_roi_compose_aggregate(GstAggregator    *aggregator,
                                                       gboolean timeout)
 {
    GstVideoRoiCompose *vidroicompose = (GstVideoRoiCompose*)aggregator;
    GstFlowReturn ret = GST_FLOW_OK;
 
-   if( gst_aggregator_pad_is_eos(vidroicompose->sinkmetapad) )
+   if( gst_aggregator_pad_is_eos(vidroicompose->sinkmetapad) ||
+       gst_aggregator_pad_is_eos(vidroicompose->sinkvideopad) )
    {
-      fprintf(stderr, "META EOS\n");
+      GST_DEBUG_OBJECT(vidroicompose, "%s EOS",
+                       gst_aggregator_pad_is_eos(vidroicompose->sinkmetapad) ? "META" : "VIDEO");
+
+      //push the last frame before going EOS
+      if( vidroicompose->currentbuffer )
+      {
+         ret = finish_current_buffer(vidroicompose);
+         if( ret != GST_FLOW_OK )
+            return ret;
+      }
+
       return GST_FLOW_EOS;
    }
 
-   if( gst_aggregator_pad_is_eos(vidroicompose->sinkvideopad) )
+   //a crop & its meta are consumed together, so leave whichever has arrived
+   // queued until the other one has too.
+   GstBuffer *metabuf = gst_aggregator_pad_peek_buffer(vidroicompose->sinkmetapad);
+   GstBuffer *videobuf = gst_aggregator_pad_peek_buffer(vidroicompose->sinkvideopad);
+
+   if( !metabuf || !videobuf )
    {
-      fprintf(stderr, "VIDEO EOS\n");
-      return GST_FLOW_EOS;
+      if( metabuf )
+         gst_buffer_unref(metabuf);
+      if( videobuf )
+         gst_buffer_unref(videobuf);
+      return GST_FLOW_OK;
    }
 
-   GstBuffer *metabuf = gst_aggregator_pad_pop_buffer(vidroicompose->sinkmetapad);
-   GstBuffer *videobuf = gst_aggregator_pad_pop_buffer(vidroicompose->sinkvideopad);
+   gst_aggregator_pad_drop_buffer(vidroicompose->sinkmetapad);
+   gst_aggregator_pad_drop_buffer(vidroicompose->sinkvideopad);
 
-   //guint64 metapts = GST_BUFFER_PTS(metabuf);
    guint64 videopts = GST_BUFFER_PTS(videobuf);
 
    if( (videopts != vidroicompose->currenttimestamp) &&  vidroicompose->currentbuffer )
    {
-      ret = gst_aggregator_finish_buffer(aggregator, vidroicompose->currentbuffer);
-      vidroicompose->currentbuffer = 0;
+      ret = finish_current_buffer(vidroicompose);
    }
 
    if( ret == GST_FLOW_OK )
@@ -258,21 +550,9 @@ static GstFlowReturn  gst_video_roi_compose_aggregate(GstAggregator    *aggregat
       if( !vidroicompose->currentbuffer )
       {
          vidroicompose->currenttimestamp = videopts;
-         vidroicompose->currentbuffer = alloc_new_buffer(vidroicompose);
-         if( !vidroicompose->currentbuffer )
+         ret = acquire_canvas(vidroicompose);
+         if( ret == GST_FLOW_OK )
          {
-            g_print("gst_video_roi_compose_aggregate: alloc_new_buffer failed\n");
-            ret = GST_FLOW_ERROR;
-         }
-         else
-         {
-           GstMapInfo canvasMemInfo;
-           if( gst_buffer_map(vidroicompose->currentbuffer, &canvasMemInfo, GST_MAP_WRITE) )
-           {
-              memset(canvasMemInfo.data, 255, canvasMemInfo.size);
-              gst_buffer_unmap(vidroicompose->currentbuffer, &canvasMemInfo);
-           }
-
            GST_BUFFER_PTS (vidroicompose->currentbuffer) = GST_BUFFER_PTS(videobuf);
            GST_BUFFER_DTS (vidroicompose->currentbuffer) = GST_BUFFER_DTS(videobuf);
            GST_BUFFER_DURATION (vidroicompose->currentbuffer) = GST_BUFFER_DURATION(videobuf);
@@ -292,98 +572,11 @@ static GstFlowReturn  gst_video_roi_compose_aggregate(GstAggregator    *aggregat
 
          if( meta )
          {
-           GstMapInfo croppedMemInfo;
-           if( gst_buffer_map(videobuf, &croppedMemInfo, GST_MAP_READ) )
-           {
-             GstMapInfo canvasMemInfo;
-             if( gst_buffer_map(vidroicompose->currentbuffer, &canvasMemInfo, GST_MAP_WRITE) )
-             {
-               guint canvasWidth = 1280;
-               guint canvasHeight = 720;
-
-               guint croppedWidth = vidroicompose->in_cropped_info.width;
-               guint croppedHeight = vidroicompose->in_cropped_info.height;
-
-               guint8 *pCanvas = canvasMemInfo.data + canvasWidth*4*meta->y + meta->x*4;
-               guint8 *pCropped = croppedMemInfo.data;
-
-               guint overlayWidth = croppedWidth;
-               guint overlayHeight = croppedHeight;
-
-               if( (meta->x < canvasWidth) && (meta->y < canvasHeight) )
-               {
-                  if( (meta->x + overlayWidth) > canvasWidth )
-                  {
-                     overlayWidth = canvasWidth - meta->x;
-                  }
-
-                  if( (meta->y + overlayHeight) > canvasHeight )
-                  {
-                     overlayHeight = canvasHeight - meta->y;
-                  }
-
-#if 0
-                  fprintf(stderr, "meta->x: %u\n", meta->x);
-                  fprintf(stderr, "meta->y: %u\n", meta->y);
-                  fprintf(stderr, "meta->w: %u\n", meta->w);
-                  fprintf(stderr, "meta->h: %u\n", meta->h);
-                  fprintf(stderr, "croppedWidth: %u\n", croppedWidth);
-                  fprintf(stderr, "croppedHeight: %u\n", croppedHeight);
-                  fprintf(stderr, "overlayWidth: %u\n", overlayWidth);
-                  fprintf(stderr, "overlayHeight: %u\n", overlayHeight);
-                  fprintf(stderr, "cropped mem size: %lu\n", croppedMemInfo.size);
-                  fprintf(stderr, "\n\n\n");
-#endif
-                  guint x,y;
-                  for( y = 0; y < overlayHeight; y++ )
-                  {
-                     for( x = 0; x < overlayWidth; x++ )
-                     {
-                        pCanvas[x*4 + 0] = pCropped[x*4 + 0];  //B
-                        pCanvas[x*4 + 1] = pCropped[x*4 + 1];  //G
-                        pCanvas[x*4 + 2] = pCropped[x*4 + 2];  //R
-                        pCanvas[x*4 + 3] = pCropped[x*4 + 3];  //X
-                     }
-
-                     pCropped += vidroicompose->in_cropped_info.stride[0];
-                     pCanvas += canvasWidth*4;
-                  }
-
-                  //add this meta to the current buffer
-                  GstVideoRegionOfInterestMeta *meta_new =
-                 gst_buffer_add_video_region_of_interest_meta_id(
-                       vidroicompose->currentbuffer,
-                       meta->roi_type,
-                       meta->x,
-                       meta->y,
-                       meta->w,
-                       meta->h);
-
-                  if( meta->params )
-                  {
-                     g_list_foreach(meta->params, AddStructureToMeta, meta_new);
-                  }
-               }
-
-               gst_buffer_unmap(vidroicompose->currentbuffer, &canvasMemInfo);
-             }
-             else
-             {
-                GST_ERROR("error mapping current buffer for writing\n");
-                ret = GST_FLOW_ERROR;
-             }
-             gst_buffer_unmap(videobuf, &croppedMemInfo);
-
-           }
-           else
-           {
-              GST_ERROR("error mapping video buffer for reading\n");
-              ret = GST_FLOW_ERROR;
-           }
+            ret = draw_crop(vidroicompose, videobuf, meta);
          }
          else
          {
-            GST_ERROR("meta is NULL\n");
+            GST_ERROR_OBJECT(vidroicompose, "meta is NULL");
             ret = GST_FLOW_ERROR;
          }
       }
@@ -412,6 +605,9 @@ static gboolean  gst_video_roi_compose_sink_event (GstAggregator    * aggregator
             gst_video_info_from_caps(&vidroicompose->in_cropped_info, caps);
          }
          break;
+         case GST_EVENT_FLUSH_STOP:
+            release_current_buffer(vidroicompose);
+         break;
          default:
          break;
 
@@ -420,37 +616,191 @@ static gboolean  gst_video_roi_compose_sink_event (GstAggregator    * aggregator
    return GST_AGGREGATOR_CLASS(parent_class)->sink_event(aggregator, aggregator_pad, event);
 }
 
+//Crops can be of any size, but need to be in one of the formats that
+// downstream accepts for the canvas.
+static gboolean  gst_video_roi_compose_sink_query (GstAggregator    * aggregator,
+                                                   GstAggregatorPad * aggregator_pad,
+                                                   GstQuery         * query)
+{
+   GstVideoRoiCompose *vidroicompose = (GstVideoRoiCompose*)aggregator;
+
+   if( (aggregator_pad == vidroicompose->sinkvideopad) &&
+       (GST_QUERY_TYPE(query) == GST_QUERY_CAPS) )
+   {
+      GstCaps *filter;
+      gst_query_parse_caps(query, &filter);
+
+      GstCaps *templatecaps = gst_pad_get_pad_template_caps(GST_PAD(aggregator_pad));
+      GstCaps *caps = NULL;
+
+      GstCaps *peercaps = gst_pad_peer_query_caps(GST_AGGREGATOR_SRC_PAD(aggregator), NULL);
+      if( peercaps && !gst_caps_is_any(peercaps) )
+      {
+         peercaps = gst_caps_make_writable(peercaps);
+         for( guint i = 0; i < gst_caps_get_size(peercaps); i++ )
+         {
+            gst_structure_remove_fields(gst_caps_get_structure(peercaps, i),
+                                        "width", "height", "framerate",
+                                        "pixel-aspect-ratio", NULL);
+         }
+         caps = gst_caps_intersect_full(peercaps, templatecaps, GST_CAPS_INTERSECT_FIRST);
+      }
+      else
+      {
+         caps = gst_caps_ref(templatecaps);
+      }
+
+      if( peercaps )
+         gst_caps_unref(peercaps);
+      gst_caps_unref(templatecaps);
+
+      if( filter )
+      {
+         GstCaps *filtered = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+         gst_caps_unref(caps);
+         caps = filtered;
+      }
+
+      gst_query_set_caps_result(query, caps);
+      gst_caps_unref(caps);
+
+      return TRUE;
+   }
+
+   return GST_AGGREGATOR_CLASS(parent_class)->sink_query(aggregator, aggregator_pad, query);
+}
+
+//The output format follows the crops, and the size is whatever downstream
+// wants (or DEFAULT_CANVAS_WIDTH x DEFAULT_CANVAS_HEIGHT, if it doesn't care)
 static GstFlowReturn     gst_video_roi_compose_update_src_caps (GstAggregator *  self,
                                         GstCaps       *  caps,
                                         GstCaps       ** ret)
 {
+   GstVideoRoiCompose *vidroicompose = (GstVideoRoiCompose*)self;
 
+   if( GST_VIDEO_INFO_FORMAT(&vidroicompose->in_cropped_info) == GST_VIDEO_FORMAT_UNKNOWN )
+      return GST_AGGREGATOR_FLOW_NEED_DATA;
 
-  *ret = gst_caps_from_string("video/x-raw, "
-                              "format=(string)BGRx, "
-                              "width=(int)1280, height=(int)720, "
-                              "interlace-mode=(string)progressive, "
-                              "multiview-mode=(string)mono, "
-                              "multiview-flags=(GstVideoMultiviewFlagsSet)0:ffffffff:/"
-                              "right-view-first/left-flipped/left-flopped/right-flipped/"
-                              "right-flopped/half-aspect/mixed-mono, "
-                              "pixel-aspect-ratio=(fraction)1/1, "
-                              "chroma-site=(string)mpeg2, "
-                              "colorimetry=(string)2:1:5:1, "
-                              "framerate=(fraction)24000/1001");
+   GstCaps *formatcaps =
+         gst_caps_new_simple("video/x-raw",
+                             "format", G_TYPE_STRING,
+                             GST_VIDEO_INFO_NAME(&vidroicompose->in_cropped_info),
+                             NULL);
+   GstCaps *outcaps = gst_caps_intersect(caps, formatcaps);
+   gst_caps_unref(formatcaps);
 
-  return GST_FLOW_OK;
+   if( gst_caps_is_empty(outcaps) )
+   {
+      GST_ERROR_OBJECT(vidroicompose, "Downstream doesn't accept %s",
+                       GST_VIDEO_INFO_NAME(&vidroicompose->in_cropped_info));
+      gst_caps_unref(outcaps);
+      return GST_FLOW_NOT_NEGOTIATED;
+   }
+
+   outcaps = gst_caps_truncate(outcaps);
+   outcaps = gst_caps_make_writable(outcaps);
+   GstStructure *s = gst_caps_get_structure(outcaps, 0);
+   gst_structure_fixate_field_nearest_int(s, "width", DEFAULT_CANVAS_WIDTH);
+   gst_structure_fixate_field_nearest_int(s, "height", DEFAULT_CANVAS_HEIGHT);
+
+   if( GST_VIDEO_INFO_FPS_N(&vidroicompose->in_cropped_info) > 0 )
+   {
+      gst_structure_fixate_field_nearest_fraction(s, "framerate",
+                             GST_VIDEO_INFO_FPS_N(&vidroicompose->in_cropped_info),
+                             GST_VIDEO_INFO_FPS_D(&vidroicompose->in_cropped_info));
+   }
+
+   if( gst_structure_has_field(s, "pixel-aspect-ratio") )
+      gst_structure_fixate_field_nearest_fraction(s, "pixel-aspect-ratio", 1, 1);
+
+   *ret = gst_caps_fixate(outcaps);
+
+   return GST_FLOW_OK;
 }
 
 static gboolean          gst_video_roi_compose_negotiated_src_caps (GstAggregator *  self,
                                             GstCaps      *  caps)
 {
    GstVideoRoiCompose *vidroicompose = (GstVideoRoiCompose*)self;
-   gst_video_info_from_caps(&vidroicompose->out_composed_info, caps);
 
-   gchar *capsstr = gst_caps_to_string(caps);
-   fprintf(stderr, "NEGOTIATED SRC CAPS = %s\n", capsstr);
-   g_free(capsstr);
+   GST_DEBUG_OBJECT(vidroicompose, "negotiated src caps = %" GST_PTR_FORMAT, caps);
+
+   //the canvas in progress was drawn for the old caps
+   release_current_buffer(vidroicompose);
+
+   if( !gst_video_info_from_caps(&vidroicompose->out_composed_info, caps) )
+   {
+      GST_ERROR_OBJECT(vidroicompose, "Invalid src caps %" GST_PTR_FORMAT, caps);
+      return FALSE;
+   }
+
+   return GST_AGGREGATOR_CLASS(parent_class)->negotiated_src_caps(self, caps);
+}
+
+//Use downstream's pool if it offered one, or a video pool of our own. Either
+// way, the canvases are recycled from one output frame to the next.
+static gboolean gst_video_roi_compose_decide_allocation (GstAggregator * aggregator,
+                                                         GstQuery * query)
+{
+   GstCaps *caps = NULL;
+   gst_query_parse_allocation(query, &caps, NULL);
+
+   GstVideoInfo info;
+   if( !caps || !gst_video_info_from_caps(&info, caps) )
+   {
+      GST_ERROR_OBJECT(aggregator, "Invalid allocation caps");
+      return FALSE;
+   }
+
+   GstBufferPool *pool = NULL;
+   guint size = 0, min = 0, max = 0;
+   gboolean bupdate = FALSE;
+   if( gst_query_get_n_allocation_pools(query) > 0 )
+   {
+      gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+      bupdate = TRUE;
+   }
+
+   size = MAX(size, GST_VIDEO_INFO_SIZE(&info));
+   if( !pool )
+      pool = gst_video_buffer_pool_new();
+
+   GstStructure *config = gst_buffer_pool_get_config(pool);
+   gst_buffer_pool_config_set_params(config, caps, size, min, max);
+   if( gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL) )
+      gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+   if( !gst_buffer_pool_set_config(pool, config) )
+   {
+      //the pool may have adjusted the parameters. Accept them, if they're valid.
+      config = gst_buffer_pool_get_config(pool);
+      if( !gst_buffer_pool_config_validate_params(config, caps, size, min, max) ||
+          !gst_buffer_pool_set_config(pool, config) )
+      {
+         GST_ERROR_OBJECT(aggregator, "Failed to configure buffer pool");
+         gst_object_unref(pool);
+         return FALSE;
+      }
+   }
+
+   if( bupdate )
+      gst_query_set_nth_allocation_pool(query, 0, pool, size, min, max);
+   else
+      gst_query_add_allocation_pool(query, pool, size, min, max);
+
+   gst_object_unref(pool);
+
+   return TRUE;
+}
+
+static gboolean gst_video_roi_compose_stop (GstAggregator * aggregator)
+{
+   GstVideoRoiCompose *vidroicompose = (GstVideoRoiCompose*)aggregator;
+
+   release_current_buffer(vidroicompose);
+   gst_video_info_init(&vidroicompose->in_cropped_info);
+   gst_video_info_init(&vidroicompose->out_composed_info);
+
    return TRUE;
 }
 
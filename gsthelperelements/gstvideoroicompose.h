@@ -24,6 +24,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstaggregator.h>
+#include <gst/video/video.h>
 
 G_BEGIN_DECLS
 
@@ -53,6 +54,16 @@ struct _GstVideoRoiCompose
 
   guint64 currenttimestamp;
   GstBuffer *currentbuffer;
+
+  //currentbuffer, mapped for writing while crops are drawn to it
+  GstVideoFrame currentframe;
+
+  //regions drawn to currentbuffer (GstVideoRectangle's). This is owned by
+  // the buffer, so that the regions can be cleared the next time that it's
+  // acquired from the pool.
+  GArray *currentdirty;
+
+  gboolean bfullclear;
 };
 
 struct _GstVideoRoiComposeClass
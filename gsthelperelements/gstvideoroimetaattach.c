@@ -40,7 +40,9 @@ enum
 enum
 {
   PROP_0,
-  PROP_SYNCONTIMESTAMP
+  PROP_SYNCONTIMESTAMP,
+  PROP_PTSTOLERANCE,
+  PROP_TRANSFERPARAMS
 };
 
 /* the capabilities of the inputs and outputs.
@@ -98,6 +100,19 @@ gst_videoroi_meta_attach_class_init (GstVideoRoiMetaAttachClass * klass)
       g_param_spec_boolean ("syncontimestamp", "SyncOnTimestamp", "Synchronize based on timestamp(pts)?",
           TRUE, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_PTSTOLERANCE,
+      g_param_spec_uint64 ("pts-tolerance", "PTS Tolerance",
+          "When synchronizing on timestamp, match meta buffers whose pts is within "
+          "this many ns of the video buffer's pts (the closest one wins). Meta older than "
+          "this window is dropped, and newer meta is held for later video buffers",
+          0, G_MAXUINT64, 0, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_TRANSFERPARAMS,
+      g_param_spec_boolean ("transfer-params", "Transfer Params",
+          "Move the params of each GstVideoRegionOfInterestMeta to the video buffer, "
+          "rather than copying them, if nothing else holds a reference to the meta buffer",
+          TRUE, G_PARAM_READWRITE));
+
   gst_element_class_set_details_simple(gstelement_class,
     "VideoRoiMetaAttach",
     "Element",
@@ -147,6 +162,8 @@ gst_videoroi_meta_attach_init (GstVideoRoiMetaAttach * self)
 
   self->syncontimestamp = TRUE;
   self->bmetaEOS = FALSE;
+  self->ptstolerance = 0;
+  self->btransferparams = TRUE;
 }
 
 static void
@@ -159,6 +176,12 @@ gst_videoroi_meta_attach_set_property (GObject * object, guint prop_id,
     case PROP_SYNCONTIMESTAMP:
       self->syncontimestamp = g_value_get_boolean (value);
       break;
+    case PROP_PTSTOLERANCE:
+      self->ptstolerance = g_value_get_uint64 (value);
+      break;
+    case PROP_TRANSFERPARAMS:
+      self->btransferparams = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -175,6 +198,12 @@ gst_videoroi_meta_attach_get_property (GObject * object, guint prop_id,
     case PROP_SYNCONTIMESTAMP:
       g_value_set_boolean (value, self->syncontimestamp);
       break;
+    case PROP_PTSTOLERANCE:
+      g_value_set_uint64 (value, self->ptstolerance);
+      break;
+    case PROP_TRANSFERPARAMS:
+      g_value_set_boolean (value, self->btransferparams);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -267,6 +296,27 @@ static void AddStructureToMeta(gpointer       data,
    gst_video_region_of_interest_meta_add_param(meta, gst_structure_copy(s));
 }
 
+static inline GstClockTime pts_distance(GstClockTime a, GstClockTime b)
+{
+   return (a > b) ? (a - b) : (b - a);
+}
+
+//Returns <0 if meta_pts is older than the tolerance window around video_pts,
+// >0 if it's newer, and 0 if it's within the window.
+static gint compare_pts(GstClockTime meta_pts,
+                        GstClockTime video_pts,
+                        GstClockTime tolerance)
+{
+   //without valid timestamps, fall back to an exact comparison
+   if( !GST_CLOCK_TIME_IS_VALID(meta_pts) || !GST_CLOCK_TIME_IS_VALID(video_pts) )
+      tolerance = 0;
+
+   if( pts_distance(meta_pts, video_pts) <= tolerance )
+      return 0;
+
+   return (meta_pts < video_pts) ? -1 : 1;
+}
+
 static GstFlowReturn
 gst_videoroi_meta_attach_meta_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
@@ -321,18 +371,19 @@ gst_videoroi_meta_attach_video_chain (GstPad * pad, GstObject * parent, GstBuffe
      }
 
      GstClockTime meta_pts = GST_BUFFER_PTS(metabuf);
-     if( meta_pts < video_pts )
+     gint cmp = compare_pts(meta_pts, video_pts, self->ptstolerance);
+     if( cmp < 0 )
      {
-        //The current meta_buf has an older timestamp than our
-        // current video buffer. Maybe there were video frames dropped
-        // or something. Unref the meta_buf and get the next buffer.
+        //The current meta_buf is older than our current video
+        // buffer (beyond the tolerance). Maybe there were video frames
+        // dropped or something. Unref the meta_buf and get the next buffer.
         GST_DEBUG_OBJECT(self, "dropping meta buffer with pts=%"GST_TIME_FORMAT,
                                                        GST_TIME_ARGS(meta_pts));
         gst_buffer_unref(metabuf);
         metabuf = NULL;
      }
      else
-     if( meta_pts > video_pts )
+     if( cmp > 0 )
      {
         //The current meta_buf has a newer timestamp. Not sure
         // in what cases this may happen, but in this case we
@@ -348,7 +399,21 @@ gst_videoroi_meta_attach_video_chain (GstPad * pad, GstObject * parent, GstBuffe
      }
      else
      {
-        //video_pts == meta_pts
+        //meta_pts is within the tolerance window of video_pts. If the meta
+        // buffers that are already queued behind it are within the window
+        // too, pick the closest one. We don't wait for more to arrive, so
+        // that a jittery meta stream doesn't hold up the video.
+        GstBuffer *nextbuf;
+        while( (nextbuf = g_queue_peek_head(self->metabufqueue)) &&
+               (compare_pts(GST_BUFFER_PTS(nextbuf), video_pts, self->ptstolerance) == 0) &&
+               (pts_distance(GST_BUFFER_PTS(nextbuf), video_pts) <
+                pts_distance(GST_BUFFER_PTS(metabuf), video_pts)) )
+        {
+           GST_DEBUG_OBJECT(self, "dropping meta buffer with pts=%"GST_TIME_FORMAT,
+                                  GST_TIME_ARGS(GST_BUFFER_PTS(metabuf)));
+           gst_buffer_unref(metabuf);
+           metabuf = g_queue_pop_head(self->metabufqueue);
+        }
         done = TRUE;
      }
   }
@@ -356,6 +421,11 @@ gst_videoroi_meta_attach_video_chain (GstPad * pad, GstObject * parent, GstBuffe
 
   if( metabuf )
   {
+     //If we hold the only reference to metabuf, nothing else can see its
+     // meta, so the params can be moved rather than deep-copied. This
+     // matters for GVA results, which can carry large tensors.
+     gboolean btransfer = self->btransferparams && gst_buffer_is_writable(metabuf);
+
      //transfer meta from metabuf to buf
      GstVideoRegionOfInterestMeta *meta_orig = NULL;
      gpointer state = NULL;
@@ -373,15 +443,17 @@ gst_videoroi_meta_attach_video_chain (GstPad * pad, GstObject * parent, GstBuffe
                     meta_orig->w,
                     meta_orig->h);
 
-        //This copies every GstStructure in meta_orig->params
-        // to meta_new->params
-        // Is there a more efficient way to do this?
-        //Maybe we can add some property where it actually
-        // transfers meta_old->params to meta_new->params. i.e:
-        //   meta_new->params = meta_orig->params;
-        //   meta_orig->params = NULL;
+        if( btransfer )
+        {
+           //meta_new was just created, so it has no params of its own
+           meta_new->params = meta_orig->params;
+           meta_orig->params = NULL;
+        }
+        else
         if( meta_orig->params )
         {
+           //This copies every GstStructure in meta_orig->params
+           // to meta_new->params
            g_list_foreach(meta_orig->params, AddStructureToMeta, meta_new);
         }
      }
@@ -53,6 +53,12 @@ struct _GstVideoRoiMetaAttach
   gboolean bmetaEOS;
 
   gboolean syncontimestamp;
+
+  //meta buffers within +/- this of a video buffer's pts are matched to it
+  GstClockTime ptstolerance;
+
+  //move the params of uniquely owned meta buffers, rather than copy them
+  gboolean btransferparams;
 };
 
 struct _GstVideoRoiMetaAttachClass
@@ -40,10 +40,39 @@ typedef struct GstVideoRoiMetaFilterExpression_
    GRegex *field_expr;
 }GstVideoRoiMetaFilterExpression;
 
+//Upper bound on the number of structure names that plans are kept for. Names
+// are expected to come from a small, stable set, so this is only reached if
+// they're generated per-frame, in which case the plans are simply rebuilt.
+#define MAX_STRUCTURE_PLANS 256
+
+//What the preserve & remove expressions do to GstStructures of one name. The
+// regular expressions are evaluated once per structure name, and once per
+// field name, after which the decisions are looked up.
+typedef struct GstVideoRoiMetaFilterStructurePlan_
+{
+   //remove the entire structure
+   gboolean bremove;
+
+   //field expressions of the preserve / remove expressions that matched the
+   // structure name. (owned by the expression arrays)
+   GPtrArray *preserve_field_exprs;
+   GPtrArray *remove_field_exprs;
+
+   //field quark -> GINT_TO_POINTER(1 + keep the field?)
+   GHashTable *field_decisions;
+}GstVideoRoiMetaFilterStructurePlan;
+
 typedef struct GstVideoRoiMetaFilterPrivate_
 {
+   //protects the expressions & plans, which are replaced when the
+   // preserve / remove properties are set
+   GMutex lock;
+
    GArray *preserve_expressions;
    GArray *remove_expressions;
+
+   //structure name quark -> GstVideoRoiMetaFilterStructurePlan
+   GHashTable *plans;
 }GstVideoRoiMetaFilterPrivate;
 
 GST_DEBUG_CATEGORY_STATIC (gst_video_roi_meta_filter_debug);
@@ -86,6 +115,7 @@ static void gst_video_roi_meta_filter_set_property (GObject * object, guint prop
     const GValue * value, GParamSpec * pspec);
 static void gst_video_roi_meta_filter_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
+static void gst_video_roi_meta_filter_finalize (GObject * object);
 
 static GstFlowReturn
 gst_video_roi_meta_filter_chain (GstPad * pad, GstObject * parent, GstBuffer * buf);
@@ -104,6 +134,7 @@ gst_video_roi_meta_filter_class_init (GstVideoRoiMetaFilterClass * klass)
 
   gobject_class->set_property = gst_video_roi_meta_filter_set_property;
   gobject_class->get_property = gst_video_roi_meta_filter_get_property;
+  gobject_class->finalize = gst_video_roi_meta_filter_finalize;
 
   g_object_class_install_property (gobject_class, PROP_PRESERVE,
       g_param_spec_string ("preserve",
@@ -138,6 +169,16 @@ gst_video_roi_meta_filter_class_init (GstVideoRoiMetaFilterClass * klass)
       gst_static_pad_template_get (&sink_factory));
 }
 
+static void gst_video_roi_meta_filter_destroy_plan(gpointer data)
+{
+   GstVideoRoiMetaFilterStructurePlan *plan = (GstVideoRoiMetaFilterStructurePlan *)data;
+
+   g_ptr_array_unref(plan->preserve_field_exprs);
+   g_ptr_array_unref(plan->remove_field_exprs);
+   g_hash_table_unref(plan->field_decisions);
+   g_free(plan);
+}
+
 /* initialize the new element
  * instantiate pads and add them to element
  * set pad calback functions
@@ -158,8 +199,13 @@ gst_video_roi_meta_filter_init (GstVideoRoiMetaFilter * filter)
   gst_element_add_pad (GST_ELEMENT (filter), filter->srcpad);
 
   filter->priv = g_malloc(sizeof(GstVideoRoiMetaFilterPrivate));
+  g_mutex_init(&filter->priv->lock);
   filter->priv->preserve_expressions = NULL;
   filter->priv->remove_expressions = NULL;
+  filter->priv->plans = g_hash_table_new_full(g_direct_hash,
+                                              g_direct_equal,
+                                              NULL,
+                                              gst_video_roi_meta_filter_destroy_plan);
 }
 
 static inline GRegex* str_to_regex(gchar *pattern)
@@ -291,18 +337,25 @@ gst_video_roi_meta_filter_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_PRESERVE:
+      g_mutex_lock(&filter->priv->lock);
       if( filter->preserve_filter )
            g_free (filter->preserve_filter);
         filter->preserve_filter = g_strdup (g_value_get_string (value));
+        //plans reference the expressions, so they need to go first
+        g_hash_table_remove_all(filter->priv->plans);
         gst_video_roi_meta_filter_destroy_expression_array(&filter->priv->preserve_expressions);
         filter->priv->preserve_expressions = gst_video_roi_meta_filter_build_expression_array(filter->preserve_filter);
+      g_mutex_unlock(&filter->priv->lock);
       break;
     case PROP_REMOVE:
+      g_mutex_lock(&filter->priv->lock);
       if( filter->remove_filter )
            g_free (filter->remove_filter);
         filter->remove_filter = g_strdup (g_value_get_string (value));
+        g_hash_table_remove_all(filter->priv->plans);
         gst_video_roi_meta_filter_destroy_expression_array(&filter->priv->remove_expressions);
         filter->priv->remove_expressions = gst_video_roi_meta_filter_build_expression_array(filter->remove_filter);
+      g_mutex_unlock(&filter->priv->lock);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -318,10 +371,14 @@ gst_video_roi_meta_filter_get_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_PRESERVE:
+      g_mutex_lock(&filter->priv->lock);
       g_value_set_string (value, filter->preserve_filter);
+      g_mutex_unlock(&filter->priv->lock);
       break;
     case PROP_REMOVE:
+      g_mutex_lock(&filter->priv->lock);
       g_value_set_string (value, filter->remove_filter);
+      g_mutex_unlock(&filter->priv->lock);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -329,32 +386,158 @@ gst_video_roi_meta_filter_get_property (GObject * object, guint prop_id,
   }
 }
 
+static void
+gst_video_roi_meta_filter_finalize (GObject * object)
+{
+  GstVideoRoiMetaFilter *filter = GST_VIDEOROIMETAFILTER (object);
+
+  g_hash_table_unref(filter->priv->plans);
+  gst_video_roi_meta_filter_destroy_expression_array(&filter->priv->preserve_expressions);
+  gst_video_roi_meta_filter_destroy_expression_array(&filter->priv->remove_expressions);
+  g_mutex_clear(&filter->priv->lock);
+  g_free(filter->priv);
+
+  g_free(filter->preserve_filter);
+  g_free(filter->remove_filter);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 /* GstElement vmethod implementations */
 
-static gboolean remove_structure_field_routine (GQuark   field_id,
-                                                  GValue * value,
-                                                  gpointer user_data)
+static inline gboolean expression_matches_structure(GstVideoRoiMetaFilterExpression *expr,
+                                                    const gchar *structure_name)
 {
-   GstVideoRoiMetaFilterExpression *expr = (GstVideoRoiMetaFilterExpression *)user_data;
+   return !expr->structure_expr || g_regex_match(expr->structure_expr,
+                                                 structure_name,
+                                                 (GRegexMatchFlags)0,
+                                                 NULL);
+}
 
-   const gchar *fieldname = g_quark_to_string(field_id);
-   return !g_regex_match(expr->field_expr,
-                         fieldname,
-                         (GRegexMatchFlags)0,
-                         NULL);
+//Evaluate the structure expressions against structure_name.
+//
+//A structure is removed if:
+// * there are preserve expressions, and none of them match its name, or
+// * a matching remove expression has no field expression, or
+// * it had fields, but none of them survive the field filtering.
+//A field survives if every matching preserve field expression matches it,
+// and no matching remove field expression does.
+static GstVideoRoiMetaFilterStructurePlan *
+gst_video_roi_meta_filter_build_plan(GstVideoRoiMetaFilterPrivate *priv,
+                                     const gchar *structure_name)
+{
+   GstVideoRoiMetaFilterStructurePlan *plan = g_malloc(sizeof(GstVideoRoiMetaFilterStructurePlan));
+   plan->bremove = FALSE;
+   plan->preserve_field_exprs = g_ptr_array_new();
+   plan->remove_field_exprs = g_ptr_array_new();
+   plan->field_decisions = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+   if( priv->preserve_expressions )
+   {
+      gboolean bmatched = FALSE;
+      for( guint arrayi = 0; arrayi < priv->preserve_expressions->len; arrayi++ )
+      {
+         GstVideoRoiMetaFilterExpression *expr =
+                &g_array_index(priv->preserve_expressions,
+                               GstVideoRoiMetaFilterExpression,
+                               arrayi);
+
+         if( expression_matches_structure(expr, structure_name) )
+         {
+            bmatched = TRUE;
+            if( expr->field_expr )
+               g_ptr_array_add(plan->preserve_field_exprs, expr->field_expr);
+         }
+      }
+
+      if( !bmatched )
+         plan->bremove = TRUE;
+   }
+
+   if( priv->remove_expressions )
+   {
+      for( guint arrayi = 0; arrayi < priv->remove_expressions->len; arrayi++ )
+      {
+         GstVideoRoiMetaFilterExpression *expr =
+                &g_array_index(priv->remove_expressions,
+                               GstVideoRoiMetaFilterExpression,
+                               arrayi);
+
+         if( expression_matches_structure(expr, structure_name) )
+         {
+            if( expr->field_expr )
+               g_ptr_array_add(plan->remove_field_exprs, expr->field_expr);
+            else
+               plan->bremove = TRUE;
+         }
+      }
+   }
+
+   GST_DEBUG("plan for %s: remove=%d, %u preserve / %u remove field expressions",
+             structure_name, plan->bremove,
+             plan->preserve_field_exprs->len, plan->remove_field_exprs->len);
+
+   return plan;
 }
 
-static gboolean preserve_structure_field_routine (GQuark   field_id,
-                                                  GValue * value,
-                                                  gpointer user_data)
+static gboolean gst_video_roi_meta_filter_keep_field(GstVideoRoiMetaFilterStructurePlan *plan,
+                                                     GQuark field_id)
 {
-   GstVideoRoiMetaFilterExpression *expr = (GstVideoRoiMetaFilterExpression *)user_data;
+   gpointer decision = g_hash_table_lookup(plan->field_decisions, GUINT_TO_POINTER(field_id));
+   if( G_LIKELY(decision) )
+      return GPOINTER_TO_INT(decision) - 1;
 
    const gchar *fieldname = g_quark_to_string(field_id);
-   return g_regex_match(expr->field_expr,
-                        fieldname,
-                        (GRegexMatchFlags)0,
-                        NULL);
+   gboolean bkeep = TRUE;
+   for( guint i = 0; bkeep && i < plan->preserve_field_exprs->len; i++ )
+   {
+      bkeep = g_regex_match((GRegex *)g_ptr_array_index(plan->preserve_field_exprs, i),
+                            fieldname,
+                            (GRegexMatchFlags)0,
+                            NULL);
+   }
+
+   for( guint i = 0; bkeep && i < plan->remove_field_exprs->len; i++ )
+   {
+      bkeep = !g_regex_match((GRegex *)g_ptr_array_index(plan->remove_field_exprs, i),
+                             fieldname,
+                             (GRegexMatchFlags)0,
+                             NULL);
+   }
+
+   g_hash_table_insert(plan->field_decisions,
+                       GUINT_TO_POINTER(field_id),
+                       GINT_TO_POINTER(bkeep + 1));
+
+   return bkeep;
+}
+
+static gboolean filter_structure_field_routine (GQuark   field_id,
+                                                GValue * value,
+                                                gpointer user_data)
+{
+   return gst_video_roi_meta_filter_keep_field((GstVideoRoiMetaFilterStructurePlan *)user_data,
+                                               field_id);
+}
+
+static GstVideoRoiMetaFilterStructurePlan *
+gst_video_roi_meta_filter_get_plan(GstVideoRoiMetaFilterPrivate *priv,
+                                   GstStructure *s)
+{
+   GQuark name_id = gst_structure_get_name_id(s);
+   GstVideoRoiMetaFilterStructurePlan *plan =
+         g_hash_table_lookup(priv->plans, GUINT_TO_POINTER(name_id));
+
+   if( G_UNLIKELY(!plan) )
+   {
+      if( g_hash_table_size(priv->plans) >= MAX_STRUCTURE_PLANS )
+         g_hash_table_remove_all(priv->plans);
+
+      plan = gst_video_roi_meta_filter_build_plan(priv, g_quark_to_string(name_id));
+      g_hash_table_insert(priv->plans, GUINT_TO_POINTER(name_id), plan);
+   }
+
+   return plan;
 }
 
 /* chain function
@@ -366,140 +549,51 @@ gst_video_roi_meta_filter_chain (GstPad * pad, GstObject * parent, GstBuffer * b
   GstVideoRoiMetaFilter *self;
 
   self = GST_VIDEOROIMETAFILTER (parent);
-  GstVideoRegionOfInterestMeta *meta = NULL;
-  gpointer state = NULL;
-  while( (meta = (GstVideoRegionOfInterestMeta *)
-          gst_buffer_iterate_meta_filtered(buf,
-                                           &state,
-                                           gst_video_region_of_interest_meta_api_get_type())) )
+
+  g_mutex_lock(&self->priv->lock);
+  if( self->priv->preserve_expressions || self->priv->remove_expressions )
   {
-     //Filter GstStructures params based on preserve expressions
-     if( self->priv->preserve_expressions )
+     GstVideoRegionOfInterestMeta *meta = NULL;
+     gpointer state = NULL;
+     while( (meta = (GstVideoRegionOfInterestMeta *)
+             gst_buffer_iterate_meta_filtered(buf,
+                                              &state,
+                                              gst_video_region_of_interest_meta_api_get_type())) )
      {
         GList *params = meta->params;
         while( params != NULL )
         {
            GstStructure *s = (GstStructure *)params->data;
+           gboolean bremoveentirestruct = FALSE;
            if( s )
            {
-              gboolean bremoveentirestruct = TRUE;
-              const gchar* structure_name = gst_structure_get_name(s);
-              for( guint arrayi = 0; arrayi < self->priv->preserve_expressions->len; arrayi++ )
-              {
-                 GstVideoRoiMetaFilterExpression *expr =
-                        &g_array_index(self->priv->preserve_expressions,
-                                       GstVideoRoiMetaFilterExpression,
-                                       arrayi);
-
-                 if( !expr->structure_expr || g_regex_match(expr->structure_expr,
-                                                            structure_name,
-                                                            (GRegexMatchFlags)0,
-                                                            NULL) )
-                 {
-                    bremoveentirestruct = FALSE;
-
-                    if( expr->field_expr )
-                    {
-                       //now, dive into this specific structure and filter out fields
-                       gint nfields_before = gst_structure_n_fields(s);
-                       gst_structure_filter_and_map_in_place(s,
-                                                             preserve_structure_field_routine,
-                                                             expr);
-                       gint nfields_after = gst_structure_n_fields(s);
-
-                       //if *we* removed all fields from the structure, let's remove the entire
-                       // structure.
-                       if( nfields_before && !nfields_after )
-                       {
-                          bremoveentirestruct = TRUE;
-                          break;
-                       }
-                    }
-                 }
-              }
+              GstVideoRoiMetaFilterStructurePlan *plan =
+                    gst_video_roi_meta_filter_get_plan(self->priv, s);
 
-              if( bremoveentirestruct )
+              bremoveentirestruct = plan->bremove;
+              if( !bremoveentirestruct &&
+                  (plan->preserve_field_exprs->len || plan->remove_field_exprs->len) )
               {
-                //this structure name didn't match expression from any of our preserve
-                // expressions. So, remove it.
-                gst_structure_free(s);
-                GList *todelete = params;
-                params = params->next;
-                meta->params = g_list_delete_link(meta->params, todelete);
+                 //now, dive into this specific structure and filter out fields
+                 gint nfields_before = gst_structure_n_fields(s);
+                 gst_structure_filter_and_map_in_place(s,
+                                                       filter_structure_field_routine,
+                                                       plan);
+                 gint nfields_after = gst_structure_n_fields(s);
+
+                 //if *we* removed all fields from the structure, let's remove the entire
+                 // structure.
+                 if( nfields_before && !nfields_after )
+                    bremoveentirestruct = TRUE;
               }
-              else
-              {
-                 params = params->next;
-              }
-           }
-           else
-           {
-              params = params->next;
            }
-        }
-     }
 
-     //Filter GstStructures params based on remove expressions
-     if( self->priv->remove_expressions )
-     {
-        GList *params = meta->params;
-        while( params != NULL )
-        {
-           GstStructure *s = (GstStructure *)params->data;
-           if( s )
+           if( bremoveentirestruct )
            {
-              gboolean bremoveentirestruct = FALSE;
-              const gchar* structure_name = gst_structure_get_name(s);
-              for( guint arrayi = 0; arrayi < self->priv->remove_expressions->len; arrayi++ )
-              {
-                 GstVideoRoiMetaFilterExpression *expr =
-                        &g_array_index(self->priv->remove_expressions,
-                                       GstVideoRoiMetaFilterExpression,
-                                       arrayi);
-
-                 if(  !expr->structure_expr || g_regex_match(expr->structure_expr,
-                                                             structure_name,
-                                                             (GRegexMatchFlags)0,
-                                                             NULL) )
-                 {
-                    if( expr->field_expr )
-                    {
-                       //now, dive into this specific structure and filter out fields
-                       gint nfields_before = gst_structure_n_fields(s);
-                       gst_structure_filter_and_map_in_place(s,
-                                                             remove_structure_field_routine,
-                                                             expr);
-                       gint nfields_after = gst_structure_n_fields(s);
-
-                       //if *we* removed all fields from the structure, let's remove the entire
-                       // structure.
-                       if( nfields_before && !nfields_after )
-                       {
-                          bremoveentirestruct = TRUE;
-                          break;
-                       }
-                    }
-                    else
-                    {
-                       bremoveentirestruct = TRUE;
-                       break;
-                    }
-                 }
-              }
-
-              if( bremoveentirestruct )
-              {
-                //this structure name didn't match expression from any of our preserve
-                // expressions. So, remove it.
-                gst_structure_free(s);
-                GList *todelete = params;
-                params = params->next;
-                meta->params = g_list_delete_link(meta->params, todelete);
-              }
-              else
-              {
-                 params = params->next;
-              }
+             gst_structure_free(s);
+             GList *todelete = params;
+             params = params->next;
+             meta->params = g_list_delete_link(meta->params, todelete);
            }
            else
            {
@@ -508,6 +602,7 @@ gst_video_roi_meta_filter_chain (GstPad * pad, GstObject * parent, GstBuffer * b
         }
      }
   }
+  g_mutex_unlock(&self->priv->lock);
 
   return gst_pad_push (self->srcpad, buf);
 }
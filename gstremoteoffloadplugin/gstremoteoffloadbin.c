@@ -35,6 +35,7 @@
 #include "heartbeatdataexchanger.h"
 #include "genericdataexchanger.h"
 #include "remoteoffloadbinserializer.h"
+#include "remoteoffloadfilecache.h"
 #include "remoteoffloaddeviceproxy.h"
 #include "remoteoffloadextregistry.h"
 
@@ -59,7 +60,13 @@ enum
   PROP_DEVICEPARAMS,
   PROP_REMOTE_GST_DEBUG,
   PROP_REMOTE_GST_DEBUG_LOCATION,
-  PROP_REMOTE_GST_DEBUG_LOGMODE
+  PROP_REMOTE_GST_DEBUG_LOGMODE,
+  PROP_MAX_INFLIGHT_BUFFERS,
+  PROP_EARLY_ACK_QUEUE_DEPTH,
+  PROP_STREAMING_RECEIVE,
+  PROP_QUERY_CACHE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL
 };
 
 #define REMOTEOFFLOAD_TYPE_LOGMODE (remoteoffload_logmode_get_type ())
@@ -139,6 +146,12 @@ typedef struct _GstRemoteOffloadBinExchangers
 typedef struct _RemoteOffloadBinPrivate
 {
    FILE *remotelogfile;
+
+   //posts the periodic stats messages
+   GThread *stats_thread;
+   GMutex statsmutex;
+   GCond statscond;
+   gboolean bstatsrun;
 }RemoteOffloadBinPrivate;
 
 static gboolean GstRemoteOffloadBinExchangers_init(GstRemoteOffloadBinExchangers *pExchangers,
@@ -200,6 +213,8 @@ gst_remoteoffload_bin_finalize (GObject *gobject)
 
    if( remoteoffloadbin->pPrivate )
    {
+      g_mutex_clear(&remoteoffloadbin->pPrivate->statsmutex);
+      g_cond_clear(&remoteoffloadbin->pPrivate->statscond);
       g_free(remoteoffloadbin->pPrivate);
    }
 
@@ -285,6 +300,54 @@ gst_remoteoffload_bin_class_init (GstRemoteOffloadBinClass * klass)
           REMOTEOFFLOAD_TYPE_LOGMODE, REMOTEOFFLOAD_LOG_RING,
           G_PARAM_READWRITE  | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MAX_INFLIGHT_BUFFERS,
+      g_param_spec_uint ("max-inflight-buffers", "MaxInflightBuffers",
+          "Max number of buffers that can be sent across the remote connection before "
+          "their flow return has been received. 1 = wait for the flow return of each buffer",
+          1, REMOTEOFFLOAD_MAX_INFLIGHT_BUFFERS, 1,
+          G_PARAM_READWRITE  | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_EARLY_ACK_QUEUE_DEPTH,
+      g_param_spec_uint ("early-ack-queue-depth", "EarlyAckQueueDepth",
+          "Number of buffers that a receiving side of the remote connection will acknowledge "
+          "as soon as they are queued, instead of after they have been pushed downstream. "
+          "0 = acknowledge each buffer after it has been pushed",
+          0, G_MAXUINT16, 0,
+          G_PARAM_READWRITE  | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STREAMING_RECEIVE,
+      g_param_spec_boolean ("streaming-receive", "StreamingReceive",
+          "Have the receiving side of the remote connection push buffers downstream as soon "
+          "as their timestamps & meta have arrived, before their memory has been fully "
+          "received. Mapping the memory blocks until its data has arrived",
+          FALSE,
+          G_PARAM_READWRITE  | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERY_CACHE,
+      g_param_spec_boolean ("query-cache", "QueryCache",
+          "Cache the remote side's answers to CAPS / ACCEPT_CAPS / ALLOCATION queries, "
+          "so that repeated negotiation queries don't each cost a round trip. The cache "
+          "is invalidated by RECONFIGURE & CAPS events",
+          TRUE,
+          G_PARAM_READWRITE  | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Stats",
+          "Transport statistics of each comms channel: messages, bytes & segments "
+          "sent / received, time spent waiting to write, send / receive latency "
+          "histograms, response round-trip percentiles, and responses in flight, "
+          "per type of data transfer, plus the codec & bytes in / out of compression if the "
+          "connection is compressed",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE  | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "StatsInterval",
+          "Interval (in milliseconds) at which the \"stats\" structure is posted as "
+          "an element message while PAUSED or PLAYING. 0 = don't post it",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE  | G_PARAM_STATIC_STRINGS));
+
 
   gst_element_class_set_details_simple(gstelement_class,
     "RemoteOffloadBin",
@@ -327,6 +390,10 @@ gst_remoteoffload_bin_init (GstRemoteOffloadBin * remoteoffloadbin)
   remoteoffloadbin->pPrivate =
         (RemoteOffloadBinPrivate *)g_malloc(sizeof(RemoteOffloadBinPrivate));
   remoteoffloadbin->pPrivate->remotelogfile = NULL;
+  remoteoffloadbin->pPrivate->stats_thread = NULL;
+  g_mutex_init(&remoteoffloadbin->pPrivate->statsmutex);
+  g_cond_init(&remoteoffloadbin->pPrivate->statscond);
+  remoteoffloadbin->pPrivate->bstatsrun = FALSE;
 
   remoteoffloadbin->pExchangers =
         (GstRemoteOffloadBinExchangers *)g_malloc(sizeof(GstRemoteOffloadBinExchangers));
@@ -401,16 +468,106 @@ gst_remoteoffload_bin_init (GstRemoteOffloadBin * remoteoffloadbin)
   remoteoffloadbin->remotegstdebug = NULL;
   remoteoffloadbin->remotegstdebuglocation = NULL;
   remoteoffloadbin->logmode = REMOTEOFFLOAD_LOG_RING;
+  remoteoffloadbin->maxinflightbuffers = 1;
+  remoteoffloadbin->earlyackqueuedepth = 0;
+  remoteoffloadbin->streamingreceive = FALSE;
+  remoteoffloadbin->querycache = TRUE;
+  remoteoffloadbin->statsinterval = 0;
 
   remoteoffloadbin->device_proxy_hash = NULL;
 
   remoteoffloadbin->ext_registry = NULL;
 }
 
+static GstStructure *
+gst_remoteoffload_bin_get_stats(GstRemoteOffloadBin *remoteoffloadbin)
+{
+   GstStructure *stats = gst_structure_new_empty("remoteoffloadbin-stats");
+
+   g_mutex_lock(&remoteoffloadbin->rob_state_mutex);
+   if( remoteoffloadbin->id_to_channel_hash )
+   {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init (&iter, remoteoffloadbin->id_to_channel_hash);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+      {
+         RemoteOffloadCommsChannel *channel = (RemoteOffloadCommsChannel *)value;
+         GstStructure *channelstats = remote_offload_comms_channel_get_stats(channel);
+         if( channelstats )
+         {
+            gchar fieldname[32];
+            g_snprintf(fieldname, sizeof(fieldname), "channel-%d", GPOINTER_TO_INT(key));
+            gst_structure_set(stats, fieldname, GST_TYPE_STRUCTURE, channelstats, NULL);
+            gst_structure_free(channelstats);
+         }
+      }
+   }
+   g_mutex_unlock(&remoteoffloadbin->rob_state_mutex);
+
+   return stats;
+}
+
+static gpointer
+gst_remoteoffload_bin_stats_thread(GstRemoteOffloadBin *remoteoffloadbin)
+{
+   RemoteOffloadBinPrivate *priv = remoteoffloadbin->pPrivate;
+
+   g_mutex_lock(&priv->statsmutex);
+   gint64 next_time = g_get_monotonic_time();
+   while( priv->bstatsrun )
+   {
+      next_time += (gint64)remoteoffloadbin->statsinterval * G_TIME_SPAN_MILLISECOND;
+      if( g_cond_wait_until(&priv->statscond, &priv->statsmutex, next_time) )
+         continue;
+
+      g_mutex_unlock(&priv->statsmutex);
+      GstStructure *stats = gst_remoteoffload_bin_get_stats(remoteoffloadbin);
+      gst_element_post_message(GST_ELEMENT(remoteoffloadbin),
+                               gst_message_new_element(GST_OBJECT(remoteoffloadbin), stats));
+      g_mutex_lock(&priv->statsmutex);
+   }
+   g_mutex_unlock(&priv->statsmutex);
+
+   return NULL;
+}
+
+static void
+gst_remoteoffload_bin_start_stats(GstRemoteOffloadBin *remoteoffloadbin)
+{
+   RemoteOffloadBinPrivate *priv = remoteoffloadbin->pPrivate;
+
+   if( !remoteoffloadbin->statsinterval || priv->stats_thread )
+      return;
+
+   priv->bstatsrun = TRUE;
+   priv->stats_thread = g_thread_new("ROBStats",
+                                     (GThreadFunc)gst_remoteoffload_bin_stats_thread,
+                                     remoteoffloadbin);
+}
+
+static void
+gst_remoteoffload_bin_stop_stats(GstRemoteOffloadBin *remoteoffloadbin)
+{
+   RemoteOffloadBinPrivate *priv = remoteoffloadbin->pPrivate;
+
+   if( !priv->stats_thread )
+      return;
+
+   g_mutex_lock(&priv->statsmutex);
+   priv->bstatsrun = FALSE;
+   g_cond_broadcast(&priv->statscond);
+   g_mutex_unlock(&priv->statsmutex);
+
+   g_thread_join(priv->stats_thread);
+   priv->stats_thread = NULL;
+}
+
 static void
 gst_remoteoffload_bin_cleanup(GstRemoteOffloadBin *remoteoffloadbin)
 {
   //cleanup
+  gst_remoteoffload_bin_stop_stats(remoteoffloadbin);
   GstRemoteOffloadBinExchangers_cleanup(remoteoffloadbin->pExchangers);
 
   if( remoteoffloadbin->pPrivate->remotelogfile &&
@@ -422,12 +579,18 @@ gst_remoteoffload_bin_cleanup(GstRemoteOffloadBin *remoteoffloadbin)
      remoteoffloadbin->pPrivate->remotelogfile = NULL;
   }
 
-  if( remoteoffloadbin->id_to_channel_hash )
+  //the stats property may be read concurrently
+  g_mutex_lock(&remoteoffloadbin->rob_state_mutex);
+  GHashTable *id_to_channel_hash = remoteoffloadbin->id_to_channel_hash;
+  remoteoffloadbin->id_to_channel_hash = NULL;
+  g_mutex_unlock(&remoteoffloadbin->rob_state_mutex);
+
+  if( id_to_channel_hash )
   {
      //unregister from receiving failure callbacks
      GHashTableIter iter;
      gpointer key, value;
-     g_hash_table_iter_init (&iter, remoteoffloadbin->id_to_channel_hash);
+     g_hash_table_iter_init (&iter, id_to_channel_hash);
      while (g_hash_table_iter_next (&iter, &key, &value))
      {
         RemoteOffloadCommsChannel *channel = (RemoteOffloadCommsChannel *)value;
@@ -436,8 +599,7 @@ gst_remoteoffload_bin_cleanup(GstRemoteOffloadBin *remoteoffloadbin)
                                                                 NULL);
         remote_offload_comms_channel_finish(channel);
      }
-     g_hash_table_unref(remoteoffloadbin->id_to_channel_hash);
-     remoteoffloadbin->id_to_channel_hash = NULL;
+     g_hash_table_unref(id_to_channel_hash);
   }
 
   remoteoffloadbin->pDefaultCommsChannel = NULL;
@@ -530,6 +692,26 @@ gst_remoteoffload_bin_set_property (GObject * object, guint prop_id,
       remoteoffloadbin->logmode = g_value_get_enum (value);
       break;
 
+    case PROP_MAX_INFLIGHT_BUFFERS:
+      remoteoffloadbin->maxinflightbuffers = g_value_get_uint (value);
+      break;
+
+    case PROP_EARLY_ACK_QUEUE_DEPTH:
+      remoteoffloadbin->earlyackqueuedepth = g_value_get_uint (value);
+      break;
+
+    case PROP_STREAMING_RECEIVE:
+      remoteoffloadbin->streamingreceive = g_value_get_boolean (value);
+      break;
+
+    case PROP_QUERY_CACHE:
+      remoteoffloadbin->querycache = g_value_get_boolean (value);
+      break;
+
+    case PROP_STATS_INTERVAL:
+      remoteoffloadbin->statsinterval = g_value_get_uint (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -568,6 +750,24 @@ gst_remoteoffload_bin_get_property (GObject * object, guint prop_id,
     case PROP_REMOTE_GST_DEBUG_LOGMODE:
       g_value_set_enum (value, remoteoffloadbin->logmode);
       break;
+    case PROP_MAX_INFLIGHT_BUFFERS:
+      g_value_set_uint (value, remoteoffloadbin->maxinflightbuffers);
+      break;
+    case PROP_EARLY_ACK_QUEUE_DEPTH:
+      g_value_set_uint (value, remoteoffloadbin->earlyackqueuedepth);
+      break;
+    case PROP_STREAMING_RECEIVE:
+      g_value_set_boolean (value, remoteoffloadbin->streamingreceive);
+      break;
+    case PROP_QUERY_CACHE:
+      g_value_set_boolean (value, remoteoffloadbin->querycache);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_remoteoffload_bin_get_stats (remoteoffloadbin));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, remoteoffloadbin->statsinterval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -943,9 +1143,15 @@ static GstStateChangeReturn gst_remoteoffload_bin_change_state (GstElement *
 
          //For each of the remoteconnectioncandidates, create / add / link
          // remoteoffloadingress or remoteoffloadegress elements
+         RemoteConnectionParams connectionparams;
+         connectionparams.max_inflight_buffers = remoteoffloadbin->maxinflightbuffers;
+         connectionparams.early_ack_queue_depth = remoteoffloadbin->earlyackqueuedepth;
+         connectionparams.streaming_receive = remoteoffloadbin->streamingreceive;
+         connectionparams.query_cache = remoteoffloadbin->querycache;
          if( !AssembleRemoteConnections(GST_BIN(remoteoffloadbin),
                                         remoteconnectioncandidates,
-                                        remoteoffloadbin->id_to_channel_hash) )
+                                        remoteoffloadbin->id_to_channel_hash,
+                                        &connectionparams) )
          {
             GST_ERROR_OBJECT (remoteoffloadbin, "AssembleRemoteConnections failed");
             return GST_STATE_CHANGE_FAILURE;
@@ -1035,6 +1241,9 @@ static GstStateChangeReturn gst_remoteoffload_bin_change_state (GstElement *
             if( G_LIKELY(params) )
             {
                params->logmode = remoteoffloadbin->logmode;
+               params->max_inflight_buffers = remoteoffloadbin->maxinflightbuffers;
+               params->early_ack_queue_depth = remoteoffloadbin->earlyackqueuedepth;
+               params->streaming_receive = remoteoffloadbin->streamingreceive;
                if( g_snprintf(params->gst_debug,
                               ROP_INSTANCEPARAMS_GST_DEBUG_STRINGSIZE,
                               "%s",
@@ -1056,17 +1265,28 @@ static GstStateChangeReturn gst_remoteoffload_bin_change_state (GstElement *
                                  sizeof(RemoteOffloadInstanceParams),
                                  TRUE))
                {
-
-                  //send the serialized bin
-                  remote_deserialization_ok =
-                        generic_data_exchanger_send(remoteoffloadbin->pExchangers->m_pGenericDataExchanger,
-                                                    BINPIPELINE_EXCHANGE_BINSERIALIZATION,
-                                                    memBlockArray,
-                                                    TRUE);
-
-                  if( !remote_deserialization_ok )
+                  //make sure that the remote side holds any files that the
+                  // serialized bin refers to, before sending it.
+                  if( remote_offload_file_cache_sync(
+                                 remoteoffloadbin->pExchangers->m_pGenericDataExchanger,
+                                 memBlockArray) )
+                  {
+                     //send the serialized bin
+                     remote_deserialization_ok =
+                           generic_data_exchanger_send(remoteoffloadbin->pExchangers->m_pGenericDataExchanger,
+                                                       BINPIPELINE_EXCHANGE_BINSERIALIZATION,
+                                                       memBlockArray,
+                                                       TRUE);
+
+                     if( !remote_deserialization_ok )
+                        GST_ERROR_OBJECT (remoteoffloadbin,
+                                       "generic_data_exchanger_send for serialized bin memblocks failed");
+                  }
+                  else
+                  {
                      GST_ERROR_OBJECT (remoteoffloadbin,
-                                    "generic_data_exchanger_send for serialized bin memblocks failed");
+                                       "error transferring files to the remote file cache");
+                  }
                }
                else
                {
@@ -1107,6 +1327,8 @@ static GstStateChangeReturn gst_remoteoffload_bin_change_state (GstElement *
          remote_statechange_return = statechange_data_exchanger_send_statechange(
                remoteoffloadbin->pExchangers->m_pStateChangeExchanger,
                GST_STATE_CHANGE_READY_TO_PAUSED);
+
+         gst_remoteoffload_bin_start_stats(remoteoffloadbin);
       }
       break;
 
@@ -1142,6 +1364,9 @@ static GstStateChangeReturn gst_remoteoffload_bin_change_state (GstElement *
       case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
       case GST_STATE_CHANGE_PAUSED_TO_READY:
       {
+         if( transition == GST_STATE_CHANGE_PAUSED_TO_READY )
+            gst_remoteoffload_bin_stop_stats(remoteoffloadbin);
+
          //send this state change notification to the remote pipeline
          remote_statechange_return = statechange_data_exchanger_send_statechange(
                   remoteoffloadbin->pExchangers->m_pStateChangeExchanger,
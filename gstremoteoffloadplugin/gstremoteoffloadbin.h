@@ -60,6 +60,12 @@ struct _GstRemoteOffloadBin
   gchar *remotegstdebuglocation;
   gint32 logmode;
 
+  guint maxinflightbuffers;
+  guint earlyackqueuedepth;
+  gboolean streamingreceive;
+  gboolean querycache;
+  guint statsinterval; //ms between "remoteoffloadbin-stats" messages, 0 = none
+
   //commsmethod-to-commsgenerator hash
   GHashTable *device_proxy_hash;
 
@@ -32,6 +32,8 @@
 #include "queuestatsdataexchanger.h"
 #include "genericdataexchanger.h"
 #include "gstingressegressdefs.h"
+#include "remoteoffloadquerycache.h"
+#include "remoteoffloadtracemeta.h"
 
 #define REMOTEOFFLOADEGRESS_IMPLICIT_QUEUE 1
 
@@ -39,6 +41,11 @@ enum
 {
   PROP_COMMSCHANNEL = 1,
   PROP_COLLECTQUEUESTATS,
+  PROP_EARLYACKQUEUEDEPTH,
+  PROP_STREAMINGRECEIVE,
+  PROP_QUERYCACHE,
+  PROP_QUERYCACHEHITS,
+  PROP_QUERYCACHEMISSES,
   N_PROPERTIES,
 };
 
@@ -67,6 +74,14 @@ struct _GstRemoteOffloadEgressPrivate
    gboolean is_flushing;
    GstFlowReturn last_buffer_push_ret;
 
+   //when non-zero, up to this many queued buffers are acknowledged
+   // to the remote ingress before they are pushed downstream.
+   guint early_ack_queue_depth;
+   gboolean buffer_push_in_progress; //TRUE while a popped buffer is being pushed
+
+   //when TRUE, buffers are pushed before their memory has been fully received
+   gboolean streaming_receive;
+
    BufferDataExchangerCallback bufferCallback;
    BufferDataExchanger *pBufferExchanger;
 
@@ -90,6 +105,10 @@ struct _GstRemoteOffloadEgressPrivate
 
    GMutex caps_query_mutex;
 
+   //answers to CAPS / ACCEPT_CAPS / ALLOCATION queries previously sent to the remote ingress
+   RemoteOffloadQueryCache *query_cache;
+   gboolean bquerycache;
+
 #if REMOTEOFFLOADEGRESS_IMPLICIT_QUEUE
    GstElement *queue;
 #endif
@@ -170,6 +189,34 @@ gst_remoteoffload_egress_class_init (GstRemoteOffloadEgressClass * klass)
           "Collect Queue Statistics",
           FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_EARLYACKQUEUEDEPTH,
+      g_param_spec_uint ("early-ack-queue-depth", "EarlyAckQueueDepth",
+          "Number of queued buffers to acknowledge to the remote ingress before they "
+          "are pushed downstream. 0 = acknowledge each buffer after it has been pushed",
+          0, G_MAXUINT16, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STREAMINGRECEIVE,
+      g_param_spec_boolean ("streaming-receive", "StreamingReceive",
+          "Push buffers downstream as soon as their timestamps & meta have been received. "
+          "Mapping the memory of such a buffer blocks until its data has arrived",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERYCACHE,
+      g_param_spec_boolean ("query-cache", "QueryCache",
+          "Cache the remote side's answers to CAPS / ACCEPT_CAPS / ALLOCATION queries, "
+          "until the next RECONFIGURE or CAPS event",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERYCACHEHITS,
+      g_param_spec_uint64 ("query-cache-hits", "QueryCacheHits",
+          "Number of queries answered from the query cache",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERYCACHEMISSES,
+      g_param_spec_uint64 ("query-cache-misses", "QueryCacheMisses",
+          "Number of cacheable queries that were sent to the remote side",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_set_static_metadata (gstelement_class,
       "Remote Offload Egress",
       "Egress",
@@ -218,8 +265,13 @@ gst_remoteoffload_egress_init (GstRemoteOffloadEgress * self)
   self->priv->queueStatsCallback.priv = self;
 
   g_mutex_init(&self->priv->caps_query_mutex);
+  self->priv->query_cache = remote_offload_query_cache_new();
+  self->priv->bquerycache = FALSE;
   self->priv->was_last_qos_bad = FALSE;
   self->priv->is_flushing = TRUE;
+  self->priv->early_ack_queue_depth = 0;
+  self->priv->buffer_push_in_progress = FALSE;
+  self->priv->streaming_receive = FALSE;
 
   self->priv->srcpad = gst_pad_new_from_static_template (&srctemplate, "src");
   gst_pad_set_activatemode_function (self->priv->srcpad,
@@ -237,6 +289,7 @@ gst_remoteoffload_egress_finalize (GObject * object)
   g_cond_clear (&self->priv->queuecond);
   g_mutex_clear(&self->priv->queueprotectmutex);
   g_mutex_clear(&self->priv->caps_query_mutex);
+  remote_offload_query_cache_free(self->priv->query_cache);
   g_queue_free(self->priv->topush_queue);
   g_array_unref (self->priv->queue_stats);
   g_free(self->priv);
@@ -257,6 +310,22 @@ gst_remoteoffload_egress_set_property (GObject * object, guint prop_id,
         self->priv->channel = g_object_ref(tmp);
     }
     break;
+    case PROP_EARLYACKQUEUEDEPTH:
+      g_mutex_lock (&self->priv->queueprotectmutex);
+      self->priv->early_ack_queue_depth = g_value_get_uint(value);
+      g_mutex_unlock (&self->priv->queueprotectmutex);
+      break;
+    case PROP_STREAMINGRECEIVE:
+      self->priv->streaming_receive = g_value_get_boolean(value);
+      if( self->priv->pBufferExchanger )
+         buffer_data_exchanger_set_streaming(self->priv->pBufferExchanger,
+                                             self->priv->streaming_receive);
+      break;
+    case PROP_QUERYCACHE:
+      self->priv->bquerycache = g_value_get_boolean(value);
+      if( !self->priv->bquerycache )
+         remote_offload_query_cache_invalidate(self->priv->query_cache);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -273,6 +342,24 @@ gst_remoteoffload_egress_get_property (GObject * object, guint prop_id,
     case PROP_COLLECTQUEUESTATS:
       g_value_set_boolean (value, self->priv->collectqueuestats);
       break;
+    case PROP_EARLYACKQUEUEDEPTH:
+      g_value_set_uint (value, self->priv->early_ack_queue_depth);
+      break;
+    case PROP_STREAMINGRECEIVE:
+      g_value_set_boolean (value, self->priv->streaming_receive);
+      break;
+    case PROP_QUERYCACHE:
+      g_value_set_boolean (value, self->priv->bquerycache);
+      break;
+    case PROP_QUERYCACHEHITS:
+    case PROP_QUERYCACHEMISSES:
+    {
+      RemoteOffloadQueryCacheStats stats;
+      remote_offload_query_cache_get_stats(self->priv->query_cache, &stats);
+      g_value_set_uint64 (value,
+                          (prop_id == PROP_QUERYCACHEHITS) ? stats.hits : stats.misses);
+    }
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -290,12 +377,15 @@ gst_remoteoffload_egress_flush_queue(GstRemoteOffloadEgress * egress)
       if (GST_IS_BUFFER (object))
       {
          GstBuffer *buf = GST_BUFFER (object);
-         GST_DEBUG_OBJECT (egress,
-                          "sending GST_FLOW_FLUSHING for buf=%p with pts=%"GST_TIME_FORMAT,
-                           buf, GST_TIME_ARGS(GST_BUFFER_DTS_OR_PTS(buf)));
-         buffer_data_exchanger_send_buffer_flowreturn(egress->priv->pBufferExchanger,
-                                                   buf,
-                                                   GST_FLOW_FLUSHING);
+         if( buffer_data_exchanger_flowreturn_pending(egress->priv->pBufferExchanger, buf) )
+         {
+            GST_DEBUG_OBJECT (egress,
+                             "sending GST_FLOW_FLUSHING for buf=%p with pts=%"GST_TIME_FORMAT,
+                              buf, GST_TIME_ARGS(GST_BUFFER_DTS_OR_PTS(buf)));
+            buffer_data_exchanger_send_buffer_flowreturn(egress->priv->pBufferExchanger,
+                                                      buf,
+                                                      GST_FLOW_FLUSHING);
+         }
          gst_buffer_unref(buf);
       }
       else
@@ -326,6 +416,39 @@ gst_remoteoffload_egress_flush_queue(GstRemoteOffloadEgress * egress)
    g_mutex_unlock (&egress->priv->queueprotectmutex);
 }
 
+//Early-ack mode: acknowledge buffers sitting at the head of the push queue,
+// up to early_ack_queue_depth of them, including the one currently being
+// pushed (which has already left the queue). Buffers queued beyond that depth are
+// acknowledged as the streaming thread drains the queue, which is what provides
+// backpressure to the remote ingress. The ack carries the sticky result of the
+// last failed push (if any), so errors are reported on the next acknowledgement.
+// Note: queueprotectmutex must be held by the caller.
+static void
+gst_remoteoffload_egress_early_ack (GstRemoteOffloadEgress * egress)
+{
+   guint nbuffers = egress->priv->buffer_push_in_progress ? 1 : 0;
+   for( GList *li = egress->priv->topush_queue->head;
+        li != NULL && nbuffers < egress->priv->early_ack_queue_depth;
+        li = li->next )
+   {
+      if( !GST_IS_BUFFER (li->data) )
+         continue;
+
+      GstBuffer *buf = GST_BUFFER (li->data);
+      nbuffers++;
+
+      if( buffer_data_exchanger_flowreturn_pending(egress->priv->pBufferExchanger, buf) )
+      {
+         GST_LOG_OBJECT (egress, "early ack (%s) for buf=%p with pts=%"GST_TIME_FORMAT,
+                         gst_flow_get_name(egress->priv->last_buffer_push_ret),
+                         buf, GST_TIME_ARGS(GST_BUFFER_DTS_OR_PTS(buf)));
+         buffer_data_exchanger_send_buffer_flowreturn(egress->priv->pBufferExchanger,
+                                                      buf,
+                                                      egress->priv->last_buffer_push_ret);
+      }
+   }
+}
+
 static void
 gst_remoteoffload_egress_stream_thread_routine (GstRemoteOffloadEgress * egress)
 {
@@ -350,6 +473,10 @@ gst_remoteoffload_egress_stream_thread_routine (GstRemoteOffloadEgress * egress)
    }
 
    object = g_queue_pop_head(egress->priv->topush_queue);
+
+   //the popped buffer still counts against the early-ack window until it's pushed
+   if( GST_IS_BUFFER (object) )
+      egress->priv->buffer_push_in_progress = TRUE;
    g_mutex_unlock (&egress->priv->queueprotectmutex);
 
    if (GST_IS_BUFFER (object))
@@ -366,6 +493,11 @@ gst_remoteoffload_egress_stream_thread_routine (GstRemoteOffloadEgress * egress)
       }
 #endif
 
+      //This buffer was created by the buffer exchanger, so it's stamped in
+      // place (it's still tracked by pointer, for its flow return).
+      remote_offload_trace_meta_add_hop(remote_offload_buffer_get_trace_meta(buf),
+                                        REMOTEOFFLOAD_TRACE_STAGE_EGRESS);
+
       gst_buffer_ref(buf);
       GST_LOG_OBJECT (egress,
                       "gst_pad_push for buf=%p with pts=%"GST_TIME_FORMAT,
@@ -373,9 +505,32 @@ gst_remoteoffload_egress_stream_thread_routine (GstRemoteOffloadEgress * egress)
       GstFlowReturn ret = gst_pad_push (egress->priv->srcpad, buf);
       GST_LOG_OBJECT (egress, "gst_pad_push returned %s", gst_flow_get_name(ret));
 
-      buffer_data_exchanger_send_buffer_flowreturn(egress->priv->pBufferExchanger,
-                                                   buf,
-                                                   ret);
+      gboolean bearlyacked = TRUE;
+      if( buffer_data_exchanger_flowreturn_pending(egress->priv->pBufferExchanger, buf) )
+      {
+         buffer_data_exchanger_send_buffer_flowreturn(egress->priv->pBufferExchanger,
+                                                      buf,
+                                                      ret);
+         bearlyacked = FALSE;
+      }
+
+      g_mutex_lock (&egress->priv->queueprotectmutex);
+      if( bearlyacked && (ret < GST_FLOW_OK) && (ret != GST_FLOW_FLUSHING) )
+      {
+         //This buffer was already acknowledged, so the remote ingress
+         // will find out about this (EOS, NOT_LINKED, ERROR, etc.) on the
+         // next acknowledgement. FLUSHING isn't latched, as it's only
+         // returned for buffers that were queued before a flush.
+         if( egress->priv->last_buffer_push_ret == GST_FLOW_OK )
+            egress->priv->last_buffer_push_ret = ret;
+      }
+
+      //pushing this buffer made room for the next one to be acknowledged
+      egress->priv->buffer_push_in_progress = FALSE;
+      if( egress->priv->early_ack_queue_depth )
+         gst_remoteoffload_egress_early_ack(egress);
+      g_mutex_unlock (&egress->priv->queueprotectmutex);
+
       gst_buffer_unref(buf);
 
    }
@@ -420,6 +575,7 @@ gst_remoteoffload_egress_start_stream_thread (GstRemoteOffloadEgress * egress)
   g_mutex_lock (&egress->priv->queueprotectmutex);
   egress->priv->is_flushing = FALSE;
   egress->priv->last_buffer_push_ret = GST_FLOW_OK;
+  egress->priv->buffer_push_in_progress = FALSE;
   g_mutex_unlock (&egress->priv->queueprotectmutex);
   gst_pad_start_task (egress->priv->srcpad,
                       (GstTaskFunction) gst_remoteoffload_egress_stream_thread_routine,
@@ -496,6 +652,10 @@ gst_remoteoffload_egress_srcpad_event (GstPad * pad, GstObject * parent,
         bforward = FALSE;
      break;
 
+     case GST_EVENT_RECONFIGURE:
+        remote_offload_query_cache_invalidate(egress->priv->query_cache);
+     break;
+
      case GST_EVENT_QOS:
      {
         GstQOSType type;
@@ -558,6 +718,27 @@ gst_remoteoffload_egress_srcpad_event (GstPad * pad, GstObject * parent,
     return gst_pad_event_default (pad, parent, event);
 }
 
+//Send a query to the remote side, unless its answer is cached.
+static gboolean send_query(GstRemoteOffloadEgress *self,
+                           GstQuery * query)
+{
+   gboolean ret = FALSE;
+   guint generation = 0;
+   if( self->priv->bquerycache &&
+       remote_offload_query_cache_lookup(self->priv->query_cache, query, &ret, &generation) )
+   {
+      GST_DEBUG_OBJECT(self, "%s answered from query cache", GST_QUERY_TYPE_NAME(query));
+      return ret;
+   }
+
+   ret = query_data_exchanger_send_query(self->priv->pQueryExchanger, query);
+
+   if( self->priv->bquerycache )
+      remote_offload_query_cache_store(self->priv->query_cache, query, ret, generation);
+
+   return ret;
+}
+
 static gboolean
 gst_remoteoffload_egress_srcpad_query (GstPad * pad, GstObject * parent,
     GstQuery * query)
@@ -625,7 +806,7 @@ gst_remoteoffload_egress_srcpad_query (GstPad * pad, GstObject * parent,
       }
       else
       {
-         ret = query_data_exchanger_send_query(self->priv->pQueryExchanger, query);
+         ret = send_query(self, query);
       }
       g_mutex_unlock(&self->priv->caps_query_mutex);
 
@@ -636,7 +817,7 @@ gst_remoteoffload_egress_srcpad_query (GstPad * pad, GstObject * parent,
       break;
   }
 
-  return query_data_exchanger_send_query(self->priv->pQueryExchanger, query);
+  return send_query(self, query);
 }
 
 static gboolean
@@ -664,6 +845,8 @@ static gboolean init_comm_objects(GstRemoteOffloadEgress *self)
    {
       self->priv->pBufferExchanger =
            buffer_data_exchanger_new(self->priv->channel, &self->priv->bufferCallback);
+      buffer_data_exchanger_set_streaming(self->priv->pBufferExchanger,
+                                          self->priv->streaming_receive);
       self->priv->pQueryExchanger =
            query_data_exchanger_new(self->priv->channel, &self->priv->queryCallback);
       self->priv->pStateChangeExchanger =
@@ -700,6 +883,18 @@ static void deinit_comm_objects(GstRemoteOffloadEgress *self)
    if( self->priv->channel )
       remote_offload_comms_channel_cancel_all(self->priv->channel);
 
+   if( self->priv->bquerycache )
+   {
+      RemoteOffloadQueryCacheStats stats;
+      remote_offload_query_cache_get_stats(self->priv->query_cache, &stats);
+      GST_INFO_OBJECT(self, "query cache: %"G_GUINT64_FORMAT" hits, %"G_GUINT64_FORMAT
+                      " misses, %"G_GUINT64_FORMAT" invalidations",
+                      stats.hits, stats.misses, stats.invalidations);
+   }
+
+   //the remote pipeline won't survive a transition to NULL
+   remote_offload_query_cache_invalidate(self->priv->query_cache);
+
    g_mutex_lock(&self->priv->caps_query_mutex);
    if( self->priv->pQueryExchanger )
       g_object_unref(self->priv->pQueryExchanger);
@@ -977,6 +1172,8 @@ static void BufferReceivedCallback(GstBuffer *buffer, void *priv)
 
    }
    g_queue_push_tail(self->priv->topush_queue, buffer);
+   if( self->priv->early_ack_queue_depth )
+      gst_remoteoffload_egress_early_ack(self);
    g_cond_broadcast (&self->priv->queuecond);
    g_mutex_unlock (&self->priv->queueprotectmutex);
 
@@ -1018,6 +1215,11 @@ static void EventReceivedCallback(GstEvent *event, void *priv)
    GST_DEBUG_OBJECT(self, "name=%s, serialized=%d",
                     GST_EVENT_TYPE_NAME(event),
                     GST_EVENT_IS_SERIALIZED (event));
+
+   //the remote side's caps changed, so its answers to negotiation queries may have too
+   if( GST_EVENT_TYPE(event) == GST_EVENT_CAPS )
+      remote_offload_query_cache_invalidate(self->priv->query_cache);
+
    if (GST_EVENT_IS_SERIALIZED (event))
    {
       g_mutex_lock (&self->priv->queueprotectmutex);
@@ -1031,6 +1233,25 @@ static void EventReceivedCallback(GstEvent *event, void *priv)
                                                 FALSE);
          return;
       }
+
+      //A flush clears any flow error latched for early-acked buffers. This is done
+      // here, instead of after the event is pushed, so that buffers which arrive
+      // after FLUSH_STOP aren't rejected while it sits in the queue.
+      if( (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) &&
+          (self->priv->last_buffer_push_ret != GST_FLOW_FLUSHING) )
+      {
+         self->priv->last_buffer_push_ret = GST_FLOW_OK;
+      }
+
+      //Let the buffer exchanger size its receive pool for the new caps
+      // before any buffers using them arrive.
+      if( GST_EVENT_TYPE(event) == GST_EVENT_CAPS )
+      {
+         GstCaps *caps = NULL;
+         gst_event_parse_caps(event, &caps);
+         buffer_data_exchanger_set_caps(self->priv->pBufferExchanger, caps);
+      }
+
       g_queue_push_tail(self->priv->topush_queue, event);
       g_cond_broadcast (&self->priv->queuecond);
       g_mutex_unlock (&self->priv->queueprotectmutex);
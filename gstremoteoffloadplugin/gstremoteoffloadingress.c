@@ -33,6 +33,8 @@
 #include "queuestatsdataexchanger.h"
 #include "genericdataexchanger.h"
 #include "gstingressegressdefs.h"
+#include "remoteoffloadquerycache.h"
+#include "remoteoffloadtracemeta.h"
 
 #define REMOTEOFFLOADINGRESS_IMPLICIT_QUEUE 1
 
@@ -40,6 +42,10 @@ enum
 {
   PROP_COMMSCHANNEL = 1,
   PROP_COLLECTQUEUESTATS,
+  PROP_MAXINFLIGHTBUFFERS,
+  PROP_QUERYCACHE,
+  PROP_QUERYCACHEHITS,
+  PROP_QUERYCACHEMISSES,
   N_PROPERTIES
 };
 
@@ -68,6 +74,8 @@ struct _GstRemoteOffloadIngressPrivate
    StateChangeDataExchanger *pStateChangeExchanger;
 
    BufferDataExchanger *pBufferExchanger;
+   guint max_inflight_buffers;
+   GstFlowReturn reported_flowret; //failing flow return already returned by chain
 
    QueryDataExchangerCallback queryCallback;
    QueryDataExchanger *pQueryExchanger;
@@ -83,6 +91,10 @@ struct _GstRemoteOffloadIngressPrivate
    GArray *queue_stats;
    gboolean collectqueuestats;
 
+   //answers to CAPS / ACCEPT_CAPS queries previously sent to the remote egress
+   RemoteOffloadQueryCache *query_cache;
+   gboolean bquerycache;
+
    GMutex caps_query_mutex;
    GMutex async_transition_mutex;
    gboolean async_transition_in_progress;
@@ -166,6 +178,28 @@ gst_remoteoffload_ingress_class_init (GstRemoteOffloadIngressClass * klass)
           "Collect Queue Statistics",
           FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MAXINFLIGHTBUFFERS,
+      g_param_spec_uint ("max-inflight-buffers", "MaxInflightBuffers",
+          "Max number of buffers sent to the remote side before their flow return "
+          "has been received. 1 = wait for the flow return of each buffer",
+          1, REMOTEOFFLOAD_MAX_INFLIGHT_BUFFERS, 1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERYCACHE,
+      g_param_spec_boolean ("query-cache", "QueryCache",
+          "Cache the remote side's answers to CAPS / ACCEPT_CAPS queries, until the next "
+          "RECONFIGURE or CAPS event",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERYCACHEHITS,
+      g_param_spec_uint64 ("query-cache-hits", "QueryCacheHits",
+          "Number of queries answered from the query cache",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUERYCACHEMISSES,
+      g_param_spec_uint64 ("query-cache-misses", "QueryCacheMisses",
+          "Number of cacheable queries that were sent to the remote side",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_set_static_metadata (gstelement_class,
       "Remote Offload Ingress",
       "Ingress",
@@ -192,6 +226,8 @@ gst_remoteoffload_ingress_init (GstRemoteOffloadIngress * self)
   self->priv->consumable_mem_features = NULL;
 
   self->priv->pBufferExchanger = NULL;
+  self->priv->max_inflight_buffers = 1;
+  self->priv->reported_flowret = GST_FLOW_OK;
 
   self->priv->pQueryExchanger = NULL;
   self->priv->queryCallback.query_received = QueryReceivedCallback;
@@ -215,6 +251,9 @@ gst_remoteoffload_ingress_init (GstRemoteOffloadIngress * self)
   self->priv->queueStatsCallback.request_received = RequestQueueStats;
   self->priv->queueStatsCallback.priv = self;
 
+  self->priv->query_cache = remote_offload_query_cache_new();
+  self->priv->bquerycache = FALSE;
+
   g_mutex_init(&self->priv->async_transition_mutex);
   g_mutex_init(&self->priv->caps_query_mutex);
   self->priv->async_transition_in_progress = FALSE;
@@ -246,6 +285,7 @@ gst_remoteoffload_ingress_finalize (GObject * object)
   GstRemoteOffloadIngress *self = GST_REMOTEOFFLOAD_INGRESS (object);
   g_thread_pool_free (self->priv->upstream_push_threads, TRUE, TRUE);
   g_array_unref (self->priv->queue_stats);
+  remote_offload_query_cache_free(self->priv->query_cache);
   g_mutex_clear(&self->priv->async_transition_mutex);
   g_mutex_clear(&self->priv->caps_query_mutex);
   g_mutex_clear(&self->priv->streamthreadsyncmutex);
@@ -272,6 +312,17 @@ gst_remoteoffload_ingress_set_property (GObject * object, guint prop_id,
     case PROP_COLLECTQUEUESTATS:
       self->priv->collectqueuestats = g_value_get_boolean(value);
       break;
+    case PROP_MAXINFLIGHTBUFFERS:
+      self->priv->max_inflight_buffers = g_value_get_uint(value);
+      if( self->priv->pBufferExchanger )
+         buffer_data_exchanger_set_max_inflight(self->priv->pBufferExchanger,
+                                                self->priv->max_inflight_buffers);
+      break;
+    case PROP_QUERYCACHE:
+      self->priv->bquerycache = g_value_get_boolean(value);
+      if( !self->priv->bquerycache )
+         remote_offload_query_cache_invalidate(self->priv->query_cache);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -288,12 +339,33 @@ gst_remoteoffload_ingress_get_property (GObject * object, guint prop_id,
     case PROP_COLLECTQUEUESTATS:
       g_value_set_boolean (value, self->priv->collectqueuestats);
       break;
+    case PROP_MAXINFLIGHTBUFFERS:
+      g_value_set_uint (value, self->priv->max_inflight_buffers);
+      break;
+    case PROP_QUERYCACHE:
+      g_value_set_boolean (value, self->priv->bquerycache);
+      break;
+    case PROP_QUERYCACHEHITS:
+    case PROP_QUERYCACHEMISSES:
+    {
+      RemoteOffloadQueryCacheStats stats;
+      remote_offload_query_cache_get_stats(self->priv->query_cache, &stats);
+      g_value_set_uint64 (value,
+                          (prop_id == PROP_QUERYCACHEHITS) ? stats.hits : stats.misses);
+    }
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+//Same criteria that GstBaseSrc uses to decide whether a flow return is an error
+static inline gboolean is_fatal_flowreturn(GstFlowReturn ret)
+{
+   return (ret == GST_FLOW_NOT_LINKED) || (ret < GST_FLOW_EOS);
+}
+
 static inline int gst_remoteoffload_ingress_serialized_stream_call(GstRemoteOffloadIngress *self,
                                                                     gpointer object)
 {
@@ -310,6 +382,8 @@ static inline int gst_remoteoffload_ingress_serialized_stream_call(GstRemoteOffl
          GstBuffer *buf = GST_BUFFER (object);
          ret = (int)buffer_data_exchanger_send_buffer(self->priv->pBufferExchanger,
                                                       buf);
+         if( ret < GST_FLOW_OK )
+            self->priv->reported_flowret = (GstFlowReturn)ret;
       }
       else
       {
@@ -322,8 +396,34 @@ static inline int gst_remoteoffload_ingress_serialized_stream_call(GstRemoteOffl
       if( self->priv->bingressstreamthreadrunning )
       {
          GstEvent *event = GST_EVENT (object);
-         ret = (int)event_data_exchanger_send_event(self->priv->pEventExchanger,
-                                                    event);
+
+         //Buffers sent before this event must be acknowledged first, so that
+         // any error they hit is reported before the event is handled.
+         GstFlowReturn drainret = buffer_data_exchanger_drain(self->priv->pBufferExchanger);
+         if( GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP )
+         {
+            buffer_data_exchanger_reset_flowreturn(self->priv->pBufferExchanger);
+            self->priv->reported_flowret = GST_FLOW_OK;
+            drainret = GST_FLOW_OK;
+         }
+
+         if( is_fatal_flowreturn(drainret) && (drainret != self->priv->reported_flowret) )
+         {
+            //A buffer within the window failed, and no chain call has returned
+            // it yet. For EOS there won't be another chain call, so post it here.
+            if( GST_EVENT_TYPE(event) == GST_EVENT_EOS )
+            {
+               self->priv->reported_flowret = drainret;
+               GST_ELEMENT_FLOW_ERROR (self, drainret);
+            }
+
+            ret = (int)FALSE;
+         }
+         else
+         {
+            ret = (int)event_data_exchanger_send_event(self->priv->pEventExchanger,
+                                                       event);
+         }
       }
       else
       {
@@ -336,8 +436,12 @@ static inline int gst_remoteoffload_ingress_serialized_stream_call(GstRemoteOffl
       if( self->priv->bingressstreamthreadrunning )
       {
          GstQuery *query = GST_QUERY (object);
-         ret = (int)query_data_exchanger_send_query(self->priv->pQueryExchanger,
-                                                   query);
+         GstFlowReturn drainret = buffer_data_exchanger_drain(self->priv->pBufferExchanger);
+         if( is_fatal_flowreturn(drainret) )
+            ret = (int)FALSE;
+         else
+            ret = (int)query_data_exchanger_send_query(self->priv->pQueryExchanger,
+                                                      query);
       }
       else
       {
@@ -453,6 +557,27 @@ gst_caps_set_features_simple (GstCaps * caps, GstCapsFeatures * features)
 }
 #endif
 
+//Send a CAPS / ACCEPT_CAPS query to the remote side, unless its answer is cached.
+static gboolean send_negotiation_query(GstRemoteOffloadIngress *self,
+                                       GstQuery * query)
+{
+   gboolean ret = FALSE;
+   guint generation = 0;
+   if( self->priv->bquerycache &&
+       remote_offload_query_cache_lookup(self->priv->query_cache, query, &ret, &generation) )
+   {
+      GST_DEBUG_OBJECT(self, "%s answered from query cache", GST_QUERY_TYPE_NAME(query));
+      return ret;
+   }
+
+   ret = query_data_exchanger_send_query(self->priv->pQueryExchanger, query);
+
+   if( self->priv->bquerycache )
+      remote_offload_query_cache_store(self->priv->query_cache, query, ret, generation);
+
+   return ret;
+}
+
 static gboolean handle_caps_query(GstRemoteOffloadIngress *self,
                                   GstQuery * query)
 {
@@ -572,7 +697,7 @@ static gboolean handle_caps_query(GstRemoteOffloadIngress *self,
       gst_caps_unref(filter_adjusted);
    }
 
-   gboolean ret = query_data_exchanger_send_query(self->priv->pQueryExchanger, query_copy);
+   gboolean ret = send_negotiation_query(self, query_copy);
 
    if( ret )
    {
@@ -710,7 +835,7 @@ static gboolean handle_accept_caps_query(GstRemoteOffloadIngress *self,
       if( new_query )
       {
          //send the stripped accept-caps query
-         ret = query_data_exchanger_send_query(self->priv->pQueryExchanger, new_query);
+         ret = send_negotiation_query(self, new_query);
 
          //parse the result, and set it to the original query
          gboolean result = FALSE;
@@ -730,7 +855,7 @@ static gboolean handle_accept_caps_query(GstRemoteOffloadIngress *self,
    else
    {
       //we can just send the original query. The result will be set internally
-      ret = query_data_exchanger_send_query(self->priv->pQueryExchanger, query);
+      ret = send_negotiation_query(self, query);
    }
 
    return ret;
@@ -750,6 +875,10 @@ static gboolean handle_caps_event(GstRemoteOffloadIngress *self,
 
   GST_DEBUG_OBJECT(self, "original event caps: %"GST_PTR_FORMAT, caps);
 
+  //the remote side's answers to negotiation queries may depend on the
+  // current caps.
+  remote_offload_query_cache_invalidate(self->priv->query_cache);
+
   //1. Can we consume this caps?
    gboolean can_support = FALSE;
    //2. Is the caps feature for this caps memory:SystemMemory
@@ -847,6 +976,8 @@ gst_remoteoffload_ingress_sinkpad_chain (GstPad * pad, GstObject * parent,
   GstRemoteOffloadIngress *self = GST_REMOTEOFFLOAD_INGRESS (parent);
   GstFlowReturn ret;
 
+  remote_offload_buffer_trace_hop(&buffer, REMOTEOFFLOAD_TRACE_STAGE_INGRESS);
+
 #if REMOTEOFFLOADINGRESS_IMPLICIT_QUEUE
 
   if( self->priv->queue && self->priv->collectqueuestats )
@@ -1030,6 +1161,11 @@ gst_remoteoffload_ingress_pad_activate_mode (GstPad * pad,
   {
       GST_DEBUG_OBJECT(self, "streaming thread start");
       g_mutex_lock(&self->priv->streamthreadsyncmutex);
+      //collect any acks still outstanding from a previous streaming session,
+      // and start fresh.
+      buffer_data_exchanger_drain(self->priv->pBufferExchanger);
+      buffer_data_exchanger_reset_flowreturn(self->priv->pBufferExchanger);
+      self->priv->reported_flowret = GST_FLOW_OK;
       self->priv->bingressstreamthreadrunning = TRUE;
       g_mutex_unlock(&self->priv->streamthreadsyncmutex);
   }
@@ -1055,6 +1191,8 @@ static gboolean init_comm_objects(GstRemoteOffloadIngress *self)
 
       self->priv->pBufferExchanger =
            buffer_data_exchanger_new(self->priv->channel, NULL);
+      buffer_data_exchanger_set_max_inflight(self->priv->pBufferExchanger,
+                                             self->priv->max_inflight_buffers);
       self->priv->pQueryExchanger =
            query_data_exchanger_new(self->priv->channel, &self->priv->queryCallback);
       self->priv->pStateChangeExchanger =
@@ -1091,6 +1229,18 @@ static void deinit_comm_objects(GstRemoteOffloadIngress *self)
    if( self->priv->channel )
       remote_offload_comms_channel_cancel_all(self->priv->channel);
 
+   if( self->priv->bquerycache )
+   {
+      RemoteOffloadQueryCacheStats stats;
+      remote_offload_query_cache_get_stats(self->priv->query_cache, &stats);
+      GST_INFO_OBJECT(self, "query cache: %"G_GUINT64_FORMAT" hits, %"G_GUINT64_FORMAT
+                      " misses, %"G_GUINT64_FORMAT" invalidations",
+                      stats.hits, stats.misses, stats.invalidations);
+   }
+
+   //the remote pipeline won't survive a transition to NULL
+   remote_offload_query_cache_invalidate(self->priv->query_cache);
+
    g_mutex_lock(&self->priv->caps_query_mutex);
    if( self->priv->consumable_mem_features )
    {
@@ -1373,6 +1523,9 @@ static void EventReceivedCallback(GstEvent *event, void *priv)
       return;
    }
 
+   if( GST_EVENT_TYPE(event) == GST_EVENT_RECONFIGURE )
+      remote_offload_query_cache_invalidate(ingress->priv->query_cache);
+
    g_thread_pool_push (ingress->priv->upstream_push_threads, event, NULL);
 }
 
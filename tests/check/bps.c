@@ -0,0 +1,283 @@
+/*
+ *  bps.c - Tests for the bps element
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+#include "remoteoffloadtracemeta.h"
+
+#define NUM_BUFFERS 300
+
+//Run pipeline_str to EOS, and return the "stats" of the bps named 'bpsname'.
+// The number of bps-stats element messages posted is returned in nmessages.
+static GstStructure *run_and_get_stats(const gchar *pipeline_str,
+                                       const gchar *bpsname,
+                                       guint *nmessages)
+{
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   GstElement *bps = gst_bin_get_by_name(GST_BIN(pipeline), bpsname);
+   fail_unless(bps != NULL);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   *nmessages = 0;
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = NULL;
+   while( (msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                            GST_MESSAGE_EOS | GST_MESSAGE_ERROR |
+                                            GST_MESSAGE_ELEMENT)) )
+   {
+      GstMessageType type = GST_MESSAGE_TYPE(msg);
+      if( (type == GST_MESSAGE_ELEMENT) &&
+          gst_message_has_name(msg, "bps-stats") )
+      {
+         (*nmessages)++;
+      }
+      gst_message_unref(msg);
+
+      if( type != GST_MESSAGE_ELEMENT )
+      {
+         fail_unless(type == GST_MESSAGE_EOS);
+         break;
+      }
+   }
+   gst_object_unref(bus);
+
+   GstStructure *stats = NULL;
+   g_object_get(bps, "stats", &stats, NULL);
+   fail_unless(stats != NULL);
+
+   gst_object_unref(bps);
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(pipeline);
+
+   return stats;
+}
+
+//latency between two bps elements
+GST_START_TEST(bps_stats0)
+{
+   gchar *pipeline_str =
+         g_strdup_printf("videotestsrc num-buffers=%d ! video/x-raw,width=64,height=64 ! "
+                         "bps name=srcbps latency-source=true ! queue ! "
+                         "identity sleep-time=1000 ! "
+                         "bps name=sinkbps latency-track-from=srcbps track-roi=true "
+                         "bps-update-interval=10 post-messages=true ! "
+                         "fakesink sync=false", NUM_BUFFERS);
+
+   guint nmessages = 0;
+   GstStructure *stats = run_and_get_stats(pipeline_str, "sinkbps", &nmessages);
+   g_free(pipeline_str);
+
+   guint64 buffers = 0;
+   fail_unless(gst_structure_get_uint64(stats, "buffers", &buffers));
+   fail_unless_equals_uint64(buffers, NUM_BUFFERS);
+
+   guint64 latency_count = 0;
+   guint64 latency_unmatched = 0;
+   fail_unless(gst_structure_get_uint64(stats, "latency-count", &latency_count));
+   fail_unless(gst_structure_get_uint64(stats, "latency-unmatched", &latency_unmatched));
+   fail_unless_equals_uint64(latency_count, NUM_BUFFERS);
+   fail_unless_equals_uint64(latency_unmatched, 0);
+
+   //identity sleeps for 1ms per buffer, in between the two bps elements
+   gdouble p50 = 0, p99 = 0, p999 = 0, max = 0;
+   fail_unless(gst_structure_get_double(stats, "latency-p50-ms", &p50));
+   fail_unless(gst_structure_get_double(stats, "latency-p99-ms", &p99));
+   fail_unless(gst_structure_get_double(stats, "latency-p99.9-ms", &p999));
+   fail_unless(gst_structure_get_double(stats, "latency-max-ms", &max));
+   fail_unless(p50 >= 1.);
+   fail_unless(p50 <= p99);
+   fail_unless(p99 <= p999);
+   fail_unless(p999 <= max);
+
+   //videotestsrc doesn't attach any ROI's
+   guint64 rois_count = 0;
+   gdouble rois_max = -1;
+   fail_unless(gst_structure_get_uint64(stats, "rois-count", &rois_count));
+   fail_unless(gst_structure_get_double(stats, "rois-max", &rois_max));
+   fail_unless_equals_uint64(rois_count, NUM_BUFFERS);
+   fail_unless(rois_max == 0.);
+
+   //at 1ms+ per buffer, the 10ms interval has passed a number of times
+   fail_unless(nmessages > 0);
+
+   gst_structure_free(stats);
+}
+GST_END_TEST
+
+//the stats that aren't being tracked aren't reported
+GST_START_TEST(bps_stats1)
+{
+   gchar *pipeline_str =
+         g_strdup_printf("videotestsrc num-buffers=%d ! video/x-raw,width=64,height=64 ! "
+                         "bps name=bps0 ! fakesink sync=false", NUM_BUFFERS);
+
+   guint nmessages = 0;
+   GstStructure *stats = run_and_get_stats(pipeline_str, "bps0", &nmessages);
+   g_free(pipeline_str);
+
+   guint64 buffers = 0;
+   fail_unless(gst_structure_get_uint64(stats, "buffers", &buffers));
+   fail_unless_equals_uint64(buffers, NUM_BUFFERS);
+
+   fail_unless(!gst_structure_has_field(stats, "latency-count"));
+   fail_unless(!gst_structure_has_field(stats, "rois-count"));
+   fail_unless(!gst_structure_has_field(stats, "new-objs-count"));
+   fail_unless_equals_int(nmessages, 0);
+
+   gst_structure_free(stats);
+}
+GST_END_TEST
+
+//latency traced through a remoteoffloadbin, with the meta
+GST_START_TEST(bps_trace0)
+{
+   gchar *pipeline_str =
+         g_strdup_printf("videotestsrc num-buffers=%d ! video/x-raw,width=64,height=64 ! "
+                         "bps name=srcbps latency-source=true latency-trace=true ! "
+                         "remoteoffloadbin.( queue ! identity sleep-time=1000 ) ! "
+                         "bps name=sinkbps latency-trace=true ! "
+                         "fakesink sync=false", NUM_BUFFERS);
+
+   guint nmessages = 0;
+   GstStructure *stats = run_and_get_stats(pipeline_str, "sinkbps", &nmessages);
+   g_free(pipeline_str);
+
+   guint64 latency_count = 0;
+   guint64 latency_unmatched = 0;
+   fail_unless(gst_structure_get_uint64(stats, "latency-count", &latency_count));
+   fail_unless(gst_structure_get_uint64(stats, "latency-unmatched", &latency_unmatched));
+   fail_unless_equals_uint64(latency_count, NUM_BUFFERS);
+   fail_unless_equals_uint64(latency_unmatched, 0);
+
+   //the buffers make a round trip through the remote pipeline
+   static const gchar *expected_stages[] =
+   {
+      "latency-host-source-to-host-ingress",
+      "latency-host-ingress-to-host-send",
+      "latency-host-send-to-remote-receive",
+      "latency-remote-receive-to-remote-egress",
+      "latency-remote-egress-to-remote-ingress",
+      "latency-remote-ingress-to-remote-send",
+      "latency-remote-send-to-host-receive",
+      "latency-host-receive-to-host-egress",
+      "latency-host-egress-to-host-sink",
+   };
+
+   const GValue *stages = gst_structure_get_value(stats, "latency-stages");
+   fail_unless(stages != NULL);
+   fail_unless_equals_int(gst_value_array_get_size(stages), G_N_ELEMENTS(expected_stages));
+
+   for( guint i = 0; i < G_N_ELEMENTS(expected_stages); i++ )
+   {
+      const GValue *stage = gst_value_array_get_value(stages, i);
+      fail_unless_equals_string(g_value_get_string(stage), expected_stages[i]);
+
+      guint64 count = 0;
+      gchar *field = g_strdup_printf("%s-count", expected_stages[i]);
+      fail_unless(gst_structure_get_uint64(stats, field, &count));
+      fail_unless_equals_uint64(count, NUM_BUFFERS);
+      g_free(field);
+   }
+
+   //identity sleeps for 1ms per buffer, within the remote pipeline
+   gdouble remote_p50 = 0;
+   fail_unless(gst_structure_get_double(stats,
+                                        "latency-remote-egress-to-remote-ingress-p50-ms",
+                                        &remote_p50));
+   fail_unless(remote_p50 >= 1.);
+
+   gst_structure_free(stats);
+}
+GST_END_TEST
+
+//clock offset estimate, from the round trip recorded in a trace meta
+GST_START_TEST(bps_trace1)
+{
+   GstBuffer *buffer = gst_buffer_new();
+   RemoteOffloadTraceMeta *meta = remote_offload_buffer_add_trace_meta(buffer);
+   fail_unless(meta != NULL);
+
+   //remote clock is 5s ahead. 100us each way on the wire, 2ms on the remote side.
+   const gint64 offset = 5 * GST_SECOND;
+   RemoteOffloadTraceHop hops[] =
+   {
+      { .ts = 1000000, .stage = REMOTEOFFLOAD_TRACE_STAGE_SEND, .domain = 0 },
+      { .ts = 1100000 + offset, .stage = REMOTEOFFLOAD_TRACE_STAGE_RECEIVE, .domain = 1 },
+      { .ts = 3100000 + offset, .stage = REMOTEOFFLOAD_TRACE_STAGE_SEND, .domain = 1 },
+      { .ts = 3200000, .stage = REMOTEOFFLOAD_TRACE_STAGE_RECEIVE, .domain = 2 },
+   };
+   memcpy(meta->hops, hops, sizeof(hops));
+   meta->nhops = G_N_ELEMENTS(hops);
+   meta->domain = 2;
+
+   RemoteOffloadTraceClockSync sync;
+   remote_offload_trace_clock_sync_reset(&sync);
+   fail_unless_equals_uint64(remote_offload_trace_clock_sync_to_origin(&sync, 1, 1000),
+                             GST_CLOCK_TIME_NONE);
+
+   fail_unless(remote_offload_trace_clock_sync_update(&sync, meta));
+   fail_unless(sync.valid);
+   fail_unless_equals_int64(sync.offset, offset);
+   fail_unless_equals_uint64(sync.delay, 200000);
+   fail_unless_equals_uint64(remote_offload_trace_clock_sync_to_origin(&sync, 1,
+                                                                       1100000 + offset),
+                             1100000);
+   fail_unless_equals_uint64(remote_offload_trace_clock_sync_to_origin(&sync, 2, 3200000),
+                             3200000);
+
+   //a sample with a longer, asymmetric round trip doesn't replace the estimate
+   meta->hops[3].ts += 1000000;
+   fail_unless(remote_offload_trace_clock_sync_update(&sync, meta));
+   fail_unless_equals_int64(sync.offset, offset);
+
+   //no round trip
+   meta->nhops = 2;
+   fail_unless(!remote_offload_trace_clock_sync_update(&sync, meta));
+
+   gst_buffer_unref(buffer);
+}
+GST_END_TEST
+
+static Suite *
+bps_suite (void)
+{
+  Suite *s = suite_create ("bps");
+
+  ROB_ADD_TEST_CASE(bps_stats0);
+  ROB_ADD_TEST_CASE(bps_stats1);
+  ROB_ADD_TEST_CASE(bps_trace0);
+  ROB_ADD_TEST_CASE(bps_trace1);
+
+  return s;
+}
+
+GST_CHECK_MAIN (bps);
@@ -0,0 +1,111 @@
+/*
+ *  filecache.c - Tests of the host side of the remote file cache
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+#include "remoteoffloadfilecache.h"
+
+static void get_file_ref(const gchar *filename, RemoteOffloadFileRef *ref)
+{
+   GstMemory *mem = remote_offload_file_ref_new(filename);
+   fail_unless(mem != NULL);
+   fail_unless(remote_offload_file_ref_is_ref(mem));
+
+   GstMapInfo map;
+   fail_unless(gst_memory_map(mem, &map, GST_MAP_READ));
+   fail_unless(map.size == sizeof(*ref));
+   memcpy(ref, map.data, sizeof(*ref));
+   gst_memory_unmap(mem, &map);
+   gst_memory_unref(mem);
+}
+
+//Overwrite the contents of filename, and give it back its modification time
+static void rewrite_keeping_mtime(const gchar *filename, const gchar *contents)
+{
+   struct stat st;
+   fail_unless(stat(filename, &st) == 0);
+   fail_unless(g_file_set_contents(filename, contents, -1, NULL));
+
+   struct timespec times[2] = { st.st_atim, st.st_mtim };
+   fail_unless(utimensat(AT_FDCWD, filename, times, 0) == 0);
+}
+
+//The digest of a file is computed once, and again only once its size or
+// modification time changes.
+GST_START_TEST(filecache_digest_memo)
+{
+   gchar *tmpdir = g_dir_make_tmp("filecache_XXXXXX", NULL);
+   fail_unless(tmpdir != NULL);
+   gchar *filename = g_build_filename(tmpdir, "model.bin", NULL);
+
+   fail_unless(g_file_set_contents(filename, "model version 1", -1, NULL));
+   RemoteOffloadFileRef ref1;
+   get_file_ref(filename, &ref1);
+   fail_unless(ref1.size == strlen("model version 1"));
+
+   //same size & modification time, so the memoized digest is used
+   rewrite_keeping_mtime(filename, "model version 2");
+   RemoteOffloadFileRef ref2;
+   get_file_ref(filename, &ref2);
+   fail_unless(strcmp(ref1.digest, ref2.digest) == 0);
+
+   //a change in size makes it read the file again
+   rewrite_keeping_mtime(filename, "model version 10");
+   RemoteOffloadFileRef ref3;
+   get_file_ref(filename, &ref3);
+   fail_unless(ref3.size == strlen("model version 10"));
+   fail_unless(strcmp(ref1.digest, ref3.digest) != 0);
+
+   //so does a change in modification time
+   rewrite_keeping_mtime(filename, "model version 20");
+   struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000000, 0 } };
+   fail_unless(utimensat(AT_FDCWD, filename, times, 0) == 0);
+   RemoteOffloadFileRef ref4;
+   get_file_ref(filename, &ref4);
+   fail_unless(strcmp(ref3.digest, ref4.digest) != 0);
+
+   g_unlink(filename);
+   g_rmdir(tmpdir);
+   g_free(filename);
+   g_free(tmpdir);
+}
+GST_END_TEST
+
+static Suite *
+filecache_suite (void)
+{
+  Suite *s = suite_create ("filecache");
+
+  ROB_ADD_TEST_CASE(filecache_digest_memo);
+
+  return s;
+}
+
+GST_CHECK_MAIN (filecache);
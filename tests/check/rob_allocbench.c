@@ -0,0 +1,325 @@
+/*
+ *  rob_allocbench.c - Heap allocations per frame of the remoteoffloadbin
+ *                     buffer send path
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  Counts the heap allocations made by the streaming thread that pushes
+ *  buffers into a remoteoffloadbin, once streaming has reached a steady
+ *  state. malloc/calloc/realloc are interposed (glibc only), and counted
+ *  per-thread.
+ *
+ *  The dummy CommsIO that these tests run with copies & queues whatever is
+ *  written to it, which a real CommsIO wouldn't. Its write functions are
+ *  wrapped, so that the allocations made within them are measured and left
+ *  out. Everything else that is counted is made by the framework, which
+ *  shouldn't allocate at all per frame once streaming.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include <gst/video/gstvideometa.h>
+#include "robtestutils.h"
+#include "remoteoffloadcommsio.h"
+#include "remoteoffloadcommsio_dummy.h"
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static __thread guint64 thread_alloc_count = 0;
+
+void *malloc(size_t size)
+{
+   thread_alloc_count++;
+   return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+   thread_alloc_count++;
+   return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+   thread_alloc_count++;
+   return __libc_realloc(ptr, size);
+}
+#endif
+
+//Frames to let pass before counting, so that pools, caches & meta
+// id's have been set up.
+#define WARMUP_FRAMES 32
+
+#ifdef __GLIBC__
+//allocations made by this thread within the dummy CommsIO's write functions
+static __thread guint64 thread_dummy_alloc_count = 0;
+
+static RemoteOffloadCommsIOResult (*dummy_write)(RemoteOffloadCommsIO *commsio,
+                                                 guint8 *buf,
+                                                 guint64 size) = NULL;
+static RemoteOffloadCommsIOResult (*dummy_write_mem_list)(RemoteOffloadCommsIO *commsio,
+                                                          GList *mem_list) = NULL;
+
+static RemoteOffloadCommsIOResult counted_dummy_write(RemoteOffloadCommsIO *commsio,
+                                                      guint8 *buf,
+                                                      guint64 size)
+{
+   guint64 start = thread_alloc_count;
+   RemoteOffloadCommsIOResult res = dummy_write(commsio, buf, size);
+   thread_dummy_alloc_count += thread_alloc_count - start;
+
+   return res;
+}
+
+static RemoteOffloadCommsIOResult counted_dummy_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                                               GList *mem_list)
+{
+   guint64 start = thread_alloc_count;
+   RemoteOffloadCommsIOResult res = dummy_write_mem_list(commsio, mem_list);
+   thread_dummy_alloc_count += thread_alloc_count - start;
+
+   return res;
+}
+
+//Wrap the write functions of the dummy CommsIO's interface, which every
+// instance of it uses.
+static void count_dummy_write_allocs()
+{
+   //already wrapped (by a previous test, if they aren't forked)
+   if( dummy_write )
+      return;
+
+   gpointer klass = g_type_class_ref(REMOTEOFFLOADCOMMSIODUMMY_TYPE);
+   RemoteOffloadCommsIOInterface *iface =
+         (RemoteOffloadCommsIOInterface *)g_type_interface_peek(klass, REMOTEOFFLOADCOMMSIO_TYPE);
+   fail_unless(iface != NULL);
+
+   dummy_write = iface->write;
+   dummy_write_mem_list = iface->write_mem_list;
+   fail_unless(dummy_write != NULL);
+   fail_unless(dummy_write_mem_list != NULL);
+   iface->write = counted_dummy_write;
+   iface->write_mem_list = counted_dummy_write_mem_list;
+}
+#endif
+
+typedef struct
+{
+   guint nrois;
+   guint64 frames;
+   guint64 counted_frames;
+   guint64 counted_allocs;
+   guint64 counted_dummy_allocs;
+   guint64 last_count;
+   guint64 last_dummy_count;
+}AllocBenchEntry;
+
+//Runs upstream of benchq, so its allocations aren't counted
+static GstPadProbeReturn add_roi_metas_probe(GstPad *pad,
+                                             GstPadProbeInfo *info,
+                                             gpointer user_data)
+{
+   AllocBenchEntry *entry = (AllocBenchEntry *)user_data;
+
+   GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+   GST_PAD_PROBE_INFO_DATA(info) = buf;
+
+   for( guint i = 0; i < entry->nrois; i++ )
+   {
+      GstVideoRegionOfInterestMeta *meta =
+            gst_buffer_add_video_region_of_interest_meta(buf, "test_roi",
+                                                         i * 10, i * 20, 30, 40);
+      gst_video_region_of_interest_meta_add_param(meta,
+            gst_structure_new("detection",
+                              "label", G_TYPE_STRING, (i & 1) ? "cat" : "dog",
+                              "roi", G_TYPE_UINT, i,
+                              "confidence", G_TYPE_DOUBLE, 0.5, NULL));
+   }
+
+   return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn count_allocs_probe(GstPad *pad,
+                                            GstPadProbeInfo *info,
+                                            gpointer user_data)
+{
+#ifdef __GLIBC__
+   AllocBenchEntry *entry = (AllocBenchEntry *)user_data;
+
+   //This probe runs on the streaming thread that pushes into the
+   // remoteoffloadbin, so the allocations counted since the last call are
+   // the ones made to send the previous frame.
+   guint64 count = thread_alloc_count;
+   guint64 dummy_count = thread_dummy_alloc_count;
+   if( entry->frames > WARMUP_FRAMES )
+   {
+      entry->counted_allocs += count - entry->last_count;
+      entry->counted_dummy_allocs += dummy_count - entry->last_dummy_count;
+      entry->counted_frames++;
+   }
+   entry->frames++;
+
+   //the probe's own bookkeeping above doesn't allocate
+   entry->last_count = thread_alloc_count;
+   entry->last_dummy_count = thread_dummy_alloc_count;
+#endif
+
+   return GST_PAD_PROBE_OK;
+}
+
+static void run_alloc_bench(const gchar *pipeline_str, guint nrois, AllocBenchEntry *entry)
+{
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   memset(entry, 0, sizeof(*entry));
+   entry->nrois = nrois;
+
+   if( nrois )
+   {
+      GstElement *roigen = gst_bin_get_by_name(GST_BIN(pipeline), "roigen");
+      fail_unless(roigen != NULL);
+      GstPad *roipad = gst_element_get_static_pad(roigen, "src");
+      fail_unless(roipad != NULL);
+      gst_pad_add_probe(roipad, GST_PAD_PROBE_TYPE_BUFFER,
+                        add_roi_metas_probe, entry, NULL);
+      gst_object_unref(roipad);
+      gst_object_unref(roigen);
+   }
+
+   GstElement *benchq = gst_bin_get_by_name(GST_BIN(pipeline), "benchq");
+   fail_unless(benchq != NULL);
+   GstPad *srcpad = gst_element_get_static_pad(benchq, "src");
+   fail_unless(srcpad != NULL);
+
+   gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_BUFFER,
+                     count_allocs_probe, entry, NULL);
+   gst_object_unref(srcpad);
+   gst_object_unref(benchq);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(pipeline);
+
+   fail_unless(entry->counted_frames > 0);
+}
+
+static void check_alloc_bench(const gchar *name, const gchar *pipeline_str, guint nrois)
+{
+#ifdef __GLIBC__
+   count_dummy_write_allocs();
+
+   AllocBenchEntry entry;
+   run_alloc_bench(pipeline_str, nrois, &entry);
+
+   guint64 framework_allocs = entry.counted_allocs - entry.counted_dummy_allocs;
+   GST_INFO("%s: %.2f allocations per frame, of which %.2f by the dummy CommsIO",
+            name, (gdouble)entry.counted_allocs / entry.counted_frames,
+            (gdouble)entry.counted_dummy_allocs / entry.counted_frames);
+
+   fail_unless(framework_allocs == 0,
+               "%s: the framework made %" G_GUINT64_FORMAT " allocations over %"
+               G_GUINT64_FORMAT " frames (%.2f per frame)",
+               name, framework_allocs, entry.counted_frames,
+               (gdouble)framework_allocs / entry.counted_frames);
+#else
+   GST_INFO("%s: skipped (malloc interposition requires glibc)", name);
+#endif
+}
+
+static const gchar *allocbench0_str = "videotestsrc num-buffers=512 ! "
+                                      "video/x-raw,format=I420,width=320,height=240 ! "
+                                      "queue name=benchq ! "
+                                      "remoteoffloadbin.( queue ) ! "
+                                      "fakesink sync=false";
+
+GST_START_TEST(allocbench0)
+{
+   check_alloc_bench("allocbench0", allocbench0_str, 0);
+}
+GST_END_TEST
+
+static const gchar *allocbench1_str = "videotestsrc num-buffers=512 ! "
+                                      "video/x-raw,format=I420,width=320,height=240 ! "
+                                      "queue name=benchq ! "
+                                      "remoteoffloadbin.( max-inflight-buffers=4 queue ) ! "
+                                      "fakesink sync=false";
+
+GST_START_TEST(allocbench1)
+{
+   check_alloc_bench("allocbench1", allocbench1_str, 0);
+}
+GST_END_TEST
+
+//ROI metas are added upstream of benchq, so only their serialization &
+// transfer is counted
+static const gchar *allocbench2_str = "videotestsrc num-buffers=512 ! "
+                                      "video/x-raw,format=I420,width=320,height=240 ! "
+                                      "identity name=roigen ! "
+                                      "queue name=benchq ! "
+                                      "remoteoffloadbin.( queue ) ! "
+                                      "fakesink sync=false";
+
+GST_START_TEST(allocbench2)
+{
+   check_alloc_bench("allocbench2", allocbench2_str, 3);
+}
+GST_END_TEST
+
+static Suite *
+rob_allocbench_suite (void)
+{
+  Suite *s = suite_create ("rob_allocbench");
+
+  ROB_ADD_TEST_CASE(allocbench0);
+  ROB_ADD_TEST_CASE(allocbench1);
+  ROB_ADD_TEST_CASE(allocbench2);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  //Count slice allocations as well (GLib < 2.76 doesn't allocate
+  // GSlice's with malloc otherwise).
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  return gst_check_run_suite (rob_allocbench_suite (), "rob_allocbench", __FILE__);
+}
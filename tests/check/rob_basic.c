@@ -36,6 +36,7 @@
 #include <gst/check/gstcheck.h>
 #include <gst/check/gstconsistencychecker.h>
 #include "robtestutils.h"
+#include "remoteoffloadcompression.h"
 
 //1 in, 1 out
 static const gchar *basic0_str = "videotestsrc num-buffers=32 ! videoconvert ! "
@@ -561,6 +562,425 @@ GST_START_TEST(live_rob1)
 }
 GST_END_TEST
 
+//same as basic1 & basic6, except allow multiple buffers to be in-flight
+// across each remote connection.
+static const gchar *inflight_str0 = "videotestsrc num-buffers=256 pattern=ball motion=wavy ! "
+                                    "remoteoffloadbin.( max-inflight-buffers=4 videoconvert !  queue ) ! "
+                                    "appsink name=appsink0 sync=false qos=false";
+
+GST_START_TEST(inflight0)
+{
+   fail_unless(test_rob_pipeline(inflight_str0, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+GST_START_TEST(inflight0_playing_ready_playing)
+{
+   fail_unless(test_rob_pipeline(inflight_str0, TESTROBPIPELINE_FLAG_PLAYING_READY_PLAYING));
+}
+GST_END_TEST
+
+static const gchar *inflight_str1 = "videotestsrc num-buffers=127 pattern=snow ! tee name=t ! "
+                                    "queue name=q0 t. ! queue name=q1  "
+                                    "remoteoffloadbin.( max-inflight-buffers=8 q0. ! queue name=q2 "
+                                    "q1. ! queue name=q3 ) "
+                                    "q2. ! videoconvert ! appsink name=appsink0 sync=false qos=false "
+                                    "q3. ! videoconvert ! appsink name=appsink1 sync=false qos=false";
+
+GST_START_TEST(inflight1)
+{
+   fail_unless(test_rob_pipeline(inflight_str1, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+//acknowledge buffers as soon as they are queued on the receiving side
+// of each remote connection, instead of after they are pushed.
+static const gchar *earlyack_str0 = "videotestsrc num-buffers=256 pattern=ball motion=wavy ! "
+                                    "remoteoffloadbin.( early-ack-queue-depth=2 videoconvert !  queue ) ! "
+                                    "appsink name=appsink0 sync=false qos=false";
+
+GST_START_TEST(earlyack0)
+{
+   fail_unless(test_rob_pipeline(earlyack_str0, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+GST_START_TEST(earlyack0_playing_ready_playing)
+{
+   fail_unless(test_rob_pipeline(earlyack_str0, TESTROBPIPELINE_FLAG_PLAYING_READY_PLAYING));
+}
+GST_END_TEST
+
+//early ack combined with multiple buffers in-flight
+static const gchar *earlyack_str1 = "videotestsrc num-buffers=117 pattern=snow ! videoconvert !  "
+                                    "remoteoffloadbin.( max-inflight-buffers=4 early-ack-queue-depth=4 "
+                                    "queue  ! fakesink name=fakesink0 sync=false qos=false )";
+
+GST_START_TEST(earlyack1)
+{
+   fail_unless(test_rob_pipeline(earlyack_str1, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+//push buffers downstream of each remote connection before their
+// memory has been fully received.
+static const gchar *streaming_str0 = "videotestsrc num-buffers=200 pattern=ball ! "
+                                     "video/x-raw,width=1920,height=1080 ! "
+                                     "remoteoffloadbin.( streaming-receive=true videoconvert ! queue ) ! "
+                                     "appsink name=appsink0 sync=false qos=false";
+
+GST_START_TEST(streaming0)
+{
+   fail_unless(test_rob_pipeline(streaming_str0, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+GST_START_TEST(streaming0_playing_ready_playing)
+{
+   fail_unless(test_rob_pipeline(streaming_str0, TESTROBPIPELINE_FLAG_PLAYING_READY_PLAYING));
+}
+GST_END_TEST
+
+//stripe the (large) video frames across additional connections
+static const gchar *striping_str0 = "videotestsrc num-buffers=100 pattern=ball ! "
+                                    "video/x-raw,width=1920,height=1080 ! "
+                                    "remoteoffloadbin.( deviceparams=\"--stripes=2\" videoconvert ! queue ) ! "
+                                    "appsink name=appsink0 sync=false qos=false";
+
+GST_START_TEST(striping0)
+{
+   fail_unless(test_rob_pipeline(striping_str0, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+GST_START_TEST(striping0_playing_ready_playing)
+{
+   fail_unless(test_rob_pipeline(striping_str0, TESTROBPIPELINE_FLAG_PLAYING_READY_PLAYING));
+}
+GST_END_TEST
+
+//compress the video frames (falls back to no compression if lz4 / zstd support
+// wasn't built in)
+static const gchar *compression_str0 = "videotestsrc num-buffers=100 pattern=ball ! "
+                                       "video/x-raw,width=1920,height=1080 ! "
+                                       "remoteoffloadbin.( deviceparams=\"--compression=lz4\" videoconvert ! queue ) ! "
+                                       "appsink name=appsink0 sync=false qos=false";
+
+//compressed segments are striped too
+static const gchar *compression_str1 = "videotestsrc num-buffers=100 pattern=ball ! "
+                                       "video/x-raw,width=1920,height=1080 ! "
+                                       "remoteoffloadbin.( deviceparams=\"--compression=zstd --stripes=2\" videoconvert ! queue ) ! "
+                                       "appsink name=appsink0 sync=false qos=false";
+
+//Run pipeline_str (holding a remoteoffloadbin named rob0) until EOS, and check
+// from its stats that the frames were compressed with the given codec, or
+// weren't compressed at all if this build doesn't support it.
+static void check_compression_stats(const gchar *pipeline_str,
+                                    RemoteOffloadCompressionCodec codec)
+{
+   GstElement *pipeline = gst_parse_launch(pipeline_str, NULL);
+   fail_unless(pipeline != NULL);
+   GstElement *rob = gst_bin_get_by_name(GST_BIN(pipeline), "rob0");
+   fail_unless(rob != NULL);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   GstStructure *stats = NULL;
+   g_object_get(rob, "stats", &stats, NULL);
+   fail_unless(stats != NULL);
+   const GValue *channelvalue = gst_structure_get_value(stats, "channel-0");
+   fail_unless(channelvalue != NULL);
+   const GValue *compressionvalue =
+         gst_structure_get_value(gst_value_get_structure(channelvalue), "compression");
+
+   if( remote_offload_compression_codec_supported(codec) )
+   {
+      fail_unless(compressionvalue != NULL);
+      const GstStructure *compression = gst_value_get_structure(compressionvalue);
+
+      fail_unless(g_strcmp0(gst_structure_get_string(compression, "codec"),
+                            remote_offload_compression_codec_name(codec)) == 0);
+
+      guint64 nsegments = 0, bytes_in = 0, bytes_out = 0;
+      fail_unless(gst_structure_get_uint64(compression, "segments-compressed", &nsegments));
+      fail_unless(gst_structure_get_uint64(compression, "bytes-in", &bytes_in));
+      fail_unless(gst_structure_get_uint64(compression, "bytes-out", &bytes_out));
+      fail_unless(nsegments > 0);
+      fail_unless(bytes_out < bytes_in);
+
+      GST_INFO("%s: %" G_GUINT64_FORMAT " segments compressed from %" G_GUINT64_FORMAT
+               " to %" G_GUINT64_FORMAT " bytes", remote_offload_compression_codec_name(codec),
+               nsegments, bytes_in, bytes_out);
+   }
+   else
+   {
+      fail_unless(compressionvalue == NULL);
+      GST_INFO("%s isn't supported by this build", remote_offload_compression_codec_name(codec));
+   }
+   gst_structure_free(stats);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(rob);
+   gst_object_unref(pipeline);
+}
+
+static const gchar *compression_stats_str0 = "videotestsrc num-buffers=16 pattern=ball ! "
+                                             "video/x-raw,width=1920,height=1080 ! "
+                                             "remoteoffloadbin.( name=rob0 deviceparams=\"--compression=lz4\" queue ) ! "
+                                             "fakesink sync=false";
+
+static const gchar *compression_stats_str1 = "videotestsrc num-buffers=16 pattern=ball ! "
+                                             "video/x-raw,width=1920,height=1080 ! "
+                                             "remoteoffloadbin.( name=rob0 deviceparams=\"--compression=zstd --stripes=2\" queue ) ! "
+                                             "fakesink sync=false";
+
+GST_START_TEST(compression0)
+{
+   fail_unless(test_rob_pipeline(compression_str0, TESTROBPIPELINE_FLAG_NONE));
+   check_compression_stats(compression_stats_str0, REMOTEOFFLOAD_COMPRESSION_LZ4);
+}
+GST_END_TEST
+
+GST_START_TEST(compression1)
+{
+   fail_unless(test_rob_pipeline(compression_str1, TESTROBPIPELINE_FLAG_NONE));
+   check_compression_stats(compression_stats_str1, REMOTEOFFLOAD_COMPRESSION_ZSTD);
+}
+GST_END_TEST
+
+//the query cache is enabled by default, so every other test covers it.
+// Make sure that negotiation still works with it disabled, and across
+// a renegotiation (PLAYING->READY->PLAYING) with it enabled.
+static const gchar *querycache_str0 = "videotestsrc num-buffers=100 ! "
+                                      "video/x-raw,width=320,height=240 ! "
+                                      "remoteoffloadbin.( query-cache=false videoconvert ! queue ) ! "
+                                      "video/x-raw,format=I420 ! "
+                                      "appsink name=appsink0 sync=false qos=false";
+
+static const gchar *querycache_str1 = "videotestsrc num-buffers=100 ! "
+                                      "video/x-raw,width=320,height=240 ! "
+                                      "remoteoffloadbin.( query-cache=true videoconvert ! queue ) ! "
+                                      "video/x-raw,format=I420 ! "
+                                      "appsink name=appsink0 sync=false qos=false";
+
+GST_START_TEST(querycache0)
+{
+   fail_unless(test_rob_pipeline(querycache_str0, TESTROBPIPELINE_FLAG_NONE));
+}
+GST_END_TEST
+
+GST_START_TEST(querycache1_playing_ready_playing)
+{
+   fail_unless(test_rob_pipeline(querycache_str1, TESTROBPIPELINE_FLAG_PLAYING_READY_PLAYING));
+}
+GST_END_TEST
+
+static gint find_egress(const GValue *value, gconstpointer user_data)
+{
+   GstElement *element = (GstElement *)g_value_get_object(value);
+   GstElementFactory *factory = gst_element_get_factory(element);
+
+   return (factory &&
+           g_strcmp0(GST_OBJECT_NAME(factory), "remoteoffloadegress") == 0) ? 0 : 1;
+}
+
+static void get_query_cache_counts(GstElement *egress, guint64 *hits, guint64 *misses)
+{
+   g_object_get(egress, "query-cache-hits", hits, "query-cache-misses", misses, NULL);
+}
+
+//Repeated CAPS & ACCEPT_CAPS queries on the remoteoffloadbin's src pad are
+// answered from the cache, until a RECONFIGURE event invalidates it.
+static const gchar *querycache_str2 = "videotestsrc num-buffers=16 ! "
+                                      "video/x-raw,width=320,height=240 ! "
+                                      "remoteoffloadbin.( name=rob0 query-cache=true videoconvert ! queue ) ! "
+                                      "video/x-raw,format=I420 ! "
+                                      "fakesink sync=false";
+
+GST_START_TEST(querycache2)
+{
+   GstElement *pipeline = gst_parse_launch(querycache_str2, NULL);
+   fail_unless(pipeline != NULL);
+   GstElement *rob = gst_bin_get_by_name(GST_BIN(pipeline), "rob0");
+   fail_unless(rob != NULL);
+
+   //run it to EOS, so that negotiation is done & the remote side is still up
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   GstIterator *it = gst_bin_iterate_recurse(GST_BIN(rob));
+   GValue item = G_VALUE_INIT;
+   fail_unless(gst_iterator_find_custom(it, (GCompareFunc)find_egress, &item, NULL));
+   gst_iterator_free(it);
+   GstElement *egress = GST_ELEMENT(g_value_dup_object(&item));
+   g_value_unset(&item);
+   GstPad *srcpad = gst_element_get_static_pad(egress, "src");
+   fail_unless(srcpad != NULL);
+
+   GstCaps *caps = gst_pad_get_current_caps(srcpad);
+   fail_unless(caps != NULL);
+
+   guint64 hits0, misses0;
+   get_query_cache_counts(egress, &hits0, &misses0);
+
+   //the first of each may have to go to the remote side, the second can't
+   for( guint i = 0; i < 2; i++ )
+   {
+      GstQuery *query = gst_query_new_caps(NULL);
+      fail_unless(gst_pad_query(srcpad, query));
+      gst_query_unref(query);
+
+      query = gst_query_new_accept_caps(caps);
+      fail_unless(gst_pad_query(srcpad, query));
+      gboolean baccepted = FALSE;
+      gst_query_parse_accept_caps_result(query, &baccepted);
+      fail_unless(baccepted);
+      gst_query_unref(query);
+   }
+
+   guint64 hits1, misses1;
+   get_query_cache_counts(egress, &hits1, &misses1);
+   fail_unless(hits1 >= hits0 + 2);
+   fail_unless(misses1 <= misses0 + 2);
+
+   //after a RECONFIGURE, the next caps query is a miss, and the one after that a hit
+   gst_pad_send_event(srcpad, gst_event_new_reconfigure());
+
+   GstQuery *query = gst_query_new_caps(NULL);
+   fail_unless(gst_pad_query(srcpad, query));
+   gst_query_unref(query);
+
+   guint64 hits2, misses2;
+   get_query_cache_counts(egress, &hits2, &misses2);
+   fail_unless(hits2 == hits1);
+   fail_unless(misses2 == misses1 + 1);
+
+   query = gst_query_new_caps(NULL);
+   fail_unless(gst_pad_query(srcpad, query));
+   gst_query_unref(query);
+
+   guint64 hits3, misses3;
+   get_query_cache_counts(egress, &hits3, &misses3);
+   fail_unless(hits3 == hits2 + 1);
+   fail_unless(misses3 == misses2);
+
+   GST_INFO("query cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses",
+            hits3, misses3);
+
+   gst_caps_unref(caps);
+   gst_object_unref(srcpad);
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(egress);
+   gst_object_unref(rob);
+   gst_object_unref(pipeline);
+}
+GST_END_TEST
+
+//stats property & periodic stats messages
+static const gchar *stats_str0 = "videotestsrc num-buffers=64 ! "
+                                 "remoteoffloadbin.( name=rob0 stats-interval=5 queue ) ! "
+                                 "fakesink sync=false";
+
+GST_START_TEST(stats0)
+{
+   GstElement *pipeline = gst_parse_launch(stats_str0, NULL);
+   fail_unless(pipeline != NULL);
+   GstElement *rob = gst_bin_get_by_name(GST_BIN(pipeline), "rob0");
+   fail_unless(rob != NULL);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   guint nstatsmessages = 0;
+   gboolean btxcounted = FALSE;
+   gboolean beos = FALSE;
+   GstBus *bus = gst_element_get_bus(pipeline);
+
+   //The stats keep being posted after EOS (until the bin leaves PLAYING), so
+   // if none of the messages posted while streaming had counted a sent
+   // buffer yet, wait for the next one.
+   while( !beos || !btxcounted )
+   {
+      GstMessage *msg = gst_bus_timed_pop_filtered(bus,
+                                                   beos ? GST_SECOND : GST_CLOCK_TIME_NONE,
+                                                   GST_MESSAGE_EOS | GST_MESSAGE_ERROR |
+                                                   GST_MESSAGE_ELEMENT);
+      fail_unless(msg != NULL);
+      GstMessageType type = GST_MESSAGE_TYPE(msg);
+      if( (type == GST_MESSAGE_ELEMENT) &&
+          gst_message_has_name(msg, "remoteoffloadbin-stats") )
+      {
+         nstatsmessages++;
+
+         const GstStructure *msgstats = gst_message_get_structure(msg);
+         const GValue *msgchannelvalue = gst_structure_get_value(msgstats, "channel-0");
+         if( msgchannelvalue )
+         {
+            const GValue *msgbuffervalue =
+                  gst_structure_get_value(gst_value_get_structure(msgchannelvalue), "buffer");
+            fail_unless(msgbuffervalue != NULL);
+            guint64 msgtxmessages = 0;
+            fail_unless(gst_structure_get_uint64(gst_value_get_structure(msgbuffervalue),
+                                                 "tx-messages", &msgtxmessages));
+            if( msgtxmessages > 0 )
+               btxcounted = TRUE;
+         }
+      }
+      gst_message_unref(msg);
+
+      fail_unless(type != GST_MESSAGE_ERROR);
+      if( type == GST_MESSAGE_EOS )
+         beos = TRUE;
+   }
+   gst_object_unref(bus);
+
+   fail_unless(nstatsmessages > 0);
+   fail_unless(btxcounted);
+
+   GstStructure *stats = NULL;
+   g_object_get(rob, "stats", &stats, NULL);
+   fail_unless(stats != NULL);
+
+   //the buffers were sent through the default channel
+   const GValue *channelvalue = gst_structure_get_value(stats, "channel-0");
+   fail_unless(channelvalue != NULL);
+   const GstStructure *channelstats = gst_value_get_structure(channelvalue);
+   const GValue *buffervalue = gst_structure_get_value(channelstats, "buffer");
+   fail_unless(buffervalue != NULL);
+   const GstStructure *bufferstats = gst_value_get_structure(buffervalue);
+
+   guint64 txmessages = 0;
+   fail_unless(gst_structure_get_uint64(bufferstats, "tx-messages", &txmessages));
+   fail_unless(txmessages >= 64);
+   guint64 rttp50 = 0;
+   fail_unless(gst_structure_get_uint64(bufferstats, "response-rtt-p50-us", &rttp50));
+   fail_unless(rttp50 > 0);
+   gint inflight = -1;
+   fail_unless(gst_structure_get_int(bufferstats, "in-flight", &inflight));
+   fail_unless(inflight == 0);
+   gst_structure_free(stats);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(rob);
+   gst_object_unref(pipeline);
+
+   GST_INFO("%u stats messages", nstatsmessages);
+}
+GST_END_TEST
+
 static Suite *
 rob_basic_suite (void)
 {
@@ -623,6 +1043,22 @@ rob_basic_suite (void)
   ROB_ADD_TEST_CASE(basic18_LIVE);
   ROB_ADD_TEST_CASE(live_rob0);
   ROB_ADD_TEST_CASE(live_rob1);
+  ROB_ADD_TEST_CASE(inflight0);
+  ROB_ADD_TEST_CASE(inflight0_playing_ready_playing);
+  ROB_ADD_TEST_CASE(inflight1);
+  ROB_ADD_TEST_CASE(earlyack0);
+  ROB_ADD_TEST_CASE(earlyack0_playing_ready_playing);
+  ROB_ADD_TEST_CASE(earlyack1);
+  ROB_ADD_TEST_CASE(streaming0);
+  ROB_ADD_TEST_CASE(streaming0_playing_ready_playing);
+  ROB_ADD_TEST_CASE(striping0);
+  ROB_ADD_TEST_CASE(striping0_playing_ready_playing);
+  ROB_ADD_TEST_CASE(compression0);
+  ROB_ADD_TEST_CASE(compression1);
+  ROB_ADD_TEST_CASE(querycache0);
+  ROB_ADD_TEST_CASE(querycache1_playing_ready_playing);
+  ROB_ADD_TEST_CASE(querycache2);
+  ROB_ADD_TEST_CASE(stats0);
 
   return s;
 }
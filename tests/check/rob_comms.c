@@ -0,0 +1,535 @@
+/*
+ *  rob_comms.c - Tests of the interleaving of transfers by RemoteOffloadComms
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  A host & remote comms are connected to each other within this process,
+ *  through a pair of dummy CommsIO's. The host side writes through a gate,
+ *  which holds back a large frame after its first chunk until the test is
+ *  about to start another write, and then slows down the rest of it, so that
+ *  the other write is sent while the frame is still being written.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+#include "remoteoffloadcomms.h"
+#include "remoteoffloadcommschannel.h"
+#include "remoteoffloadcommsio_dummy.h"
+#include "genericdataexchanger.h"
+#include "eventdataexchanger.h"
+
+//many chunks, so that the interleaved write has plenty of chunk boundaries to go at
+#define LARGE_FRAME_SIZE (32 * 1024 * 1024)
+
+//sent from another channel while the large frame is being written
+#define SMALL_FRAME_SIZE (1024 * 1024)
+
+#define EVENT_PAYLOAD_SIZE 4096
+
+//how long the gate waits for the test to start its other write
+#define GATE_TIMEOUT_US (5 * G_USEC_PER_SEC)
+
+//delay of each write once the gate has opened
+#define GATE_THROTTLE_US 1000
+
+//how long to wait for a transfer to be received
+#define RECEIVE_TIMEOUT_US (10 * G_USEC_PER_SEC)
+
+static inline guint8 pattern_byte(gsize offset, guint8 seed)
+{
+   return (guint8)((offset * 31) + (offset >> 8) + seed);
+}
+
+static GstMemory *new_pattern_mem(gsize size, guint8 seed)
+{
+   GstMemory *mem = gst_allocator_alloc(NULL, size, NULL);
+   GstMapInfo map;
+   fail_unless(gst_memory_map(mem, &map, GST_MAP_WRITE));
+   for( gsize i = 0; i < size; i++ )
+      map.data[i] = pattern_byte(i, seed);
+   gst_memory_unmap(mem, &map);
+
+   return mem;
+}
+
+static void check_pattern_mem(GstMemory *mem, gsize size, guint8 seed)
+{
+   GstMapInfo map;
+   fail_unless(gst_memory_map(mem, &map, GST_MAP_READ));
+   fail_unless(map.size == size);
+   for( gsize i = 0; i < map.size; i++ )
+   {
+      fail_unless(map.data[i] == pattern_byte(i, seed),
+                  "byte %" G_GSIZE_FORMAT " differs", i);
+   }
+   gst_memory_unmap(mem, &map);
+}
+
+/* GatedCommsIO: passes everything through to a wrapped CommsIO. Once armed,
+ * the 2nd write (and any after it) waits for the gate to be opened, and each
+ * write is delayed by GATE_THROTTLE_US.
+ */
+#define GATEDCOMMSIO_TYPE (gated_comms_io_get_type ())
+G_DECLARE_FINAL_TYPE (GatedCommsIO, gated_comms_io, GATED, COMMSIO, GObject)
+
+struct _GatedCommsIO
+{
+   GObject parent_instance;
+
+   RemoteOffloadCommsIO *commsio;
+   GMutex gatemutex;
+   GCond gatecond;
+   gboolean armed;
+   gboolean opened;
+   guint nwrites;
+};
+
+static void gated_comms_io_interface_init (RemoteOffloadCommsIOInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GatedCommsIO, gated_comms_io, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (REMOTEOFFLOADCOMMSIO_TYPE,
+                         gated_comms_io_interface_init))
+
+static RemoteOffloadCommsIOResult gated_comms_io_read(RemoteOffloadCommsIO *commsio,
+                                                      guint8 *buf,
+                                                      guint64 size)
+{
+   return remote_offload_comms_io_read(GATED_COMMSIO(commsio)->commsio, buf, size);
+}
+
+static RemoteOffloadCommsIOResult gated_comms_io_read_mem_ref(RemoteOffloadCommsIO *commsio,
+                                                              guint64 size,
+                                                              GstMemory **mem)
+{
+   return remote_offload_comms_io_read_mem_ref(GATED_COMMSIO(commsio)->commsio, size, mem);
+}
+
+static RemoteOffloadCommsIOResult gated_comms_io_write_mem_list(RemoteOffloadCommsIO *commsio,
+                                                                GList *mem_list)
+{
+   GatedCommsIO *self = GATED_COMMSIO(commsio);
+
+   g_mutex_lock(&self->gatemutex);
+   gboolean bthrottle = self->armed;
+   if( self->armed )
+   {
+      self->nwrites++;
+      g_cond_broadcast(&self->gatecond);
+
+      gint64 end_time = g_get_monotonic_time() + GATE_TIMEOUT_US;
+      while( (self->nwrites > 1) && !self->opened )
+      {
+         if( !g_cond_wait_until(&self->gatecond, &self->gatemutex, end_time) )
+            break;
+      }
+   }
+   g_mutex_unlock(&self->gatemutex);
+
+   if( bthrottle )
+      g_usleep(GATE_THROTTLE_US);
+
+   return remote_offload_comms_io_write_mem_list(self->commsio, mem_list);
+}
+
+static void gated_comms_io_shutdown(RemoteOffloadCommsIO *commsio)
+{
+   remote_offload_comms_io_shutdown(GATED_COMMSIO(commsio)->commsio);
+}
+
+static void gated_comms_io_interface_init (RemoteOffloadCommsIOInterface *iface)
+{
+   iface->read = gated_comms_io_read;
+   iface->read_mem_ref = gated_comms_io_read_mem_ref;
+   iface->write_mem_list = gated_comms_io_write_mem_list;
+   iface->shutdown = gated_comms_io_shutdown;
+}
+
+static void gated_comms_io_finalize (GObject *gobject)
+{
+   GatedCommsIO *self = GATED_COMMSIO(gobject);
+
+   g_object_unref(self->commsio);
+   g_mutex_clear(&self->gatemutex);
+   g_cond_clear(&self->gatecond);
+
+   G_OBJECT_CLASS (gated_comms_io_parent_class)->finalize (gobject);
+}
+
+static void gated_comms_io_class_init (GatedCommsIOClass *klass)
+{
+   G_OBJECT_CLASS(klass)->finalize = gated_comms_io_finalize;
+}
+
+static void gated_comms_io_init (GatedCommsIO *self)
+{
+   g_mutex_init(&self->gatemutex);
+   g_cond_init(&self->gatecond);
+}
+
+//Takes ownership of commsio
+static GatedCommsIO *gated_comms_io_new(RemoteOffloadCommsIO *commsio)
+{
+   GatedCommsIO *gate = g_object_new(GATEDCOMMSIO_TYPE, NULL);
+   gate->commsio = commsio;
+
+   return gate;
+}
+
+static void gated_comms_io_arm(GatedCommsIO *gate)
+{
+   g_mutex_lock(&gate->gatemutex);
+   gate->armed = TRUE;
+   g_mutex_unlock(&gate->gatemutex);
+}
+
+//Wait until the first write since the gate was armed has been made
+static void gated_comms_io_wait_first_write(GatedCommsIO *gate)
+{
+   gint64 end_time = g_get_monotonic_time() + GATE_TIMEOUT_US;
+   g_mutex_lock(&gate->gatemutex);
+   while( !gate->nwrites )
+   {
+      if( !g_cond_wait_until(&gate->gatecond, &gate->gatemutex, end_time) )
+         break;
+   }
+   guint nwrites = gate->nwrites;
+   g_mutex_unlock(&gate->gatemutex);
+
+   fail_unless(nwrites > 0, "the large frame wasn't written");
+}
+
+static void gated_comms_io_open(GatedCommsIO *gate)
+{
+   g_mutex_lock(&gate->gatemutex);
+   gate->opened = TRUE;
+   g_cond_broadcast(&gate->gatecond);
+   g_mutex_unlock(&gate->gatemutex);
+}
+
+/* The receiving end of a channel. Records the order in which transfers are
+ * received (across all channels), and keeps what was received for the test to check.
+ */
+typedef struct
+{
+   GMutex *mutex;
+   GCond *cond;
+   guint *nreceived;
+
+   EventDataExchanger *eventexchanger;
+   guint frame_order;
+   GstMemory *frame;
+   guint event_order;
+   gchar *event_payload;
+}ChannelReceiver;
+
+static gboolean frame_received(guint32 transfer_type,
+                               GArray *memblocks,
+                               void *priv)
+{
+   ChannelReceiver *receiver = (ChannelReceiver *)priv;
+
+   g_mutex_lock(receiver->mutex);
+   if( memblocks->len == 1 )
+      receiver->frame = gst_memory_ref(g_array_index(memblocks, GstMemory *, 0));
+   receiver->frame_order = ++(*receiver->nreceived);
+   g_cond_broadcast(receiver->cond);
+   g_mutex_unlock(receiver->mutex);
+
+   return TRUE;
+}
+
+static void event_received(GstEvent *event, void *priv)
+{
+   ChannelReceiver *receiver = (ChannelReceiver *)priv;
+
+   const GstStructure *s = gst_event_get_structure(event);
+   const gchar *payload = s ? gst_structure_get_string(s, "payload") : NULL;
+
+   g_mutex_lock(receiver->mutex);
+   receiver->event_payload = g_strdup(payload);
+   receiver->event_order = ++(*receiver->nreceived);
+   g_cond_broadcast(receiver->cond);
+   g_mutex_unlock(receiver->mutex);
+
+   event_data_exchanger_send_event_result(receiver->eventexchanger, event, TRUE);
+   gst_event_unref(event);
+}
+
+#define NUM_TEST_CHANNELS 2
+
+//One side of the connection
+typedef struct
+{
+   RemoteOffloadComms *comms;
+   RemoteOffloadCommsChannel *channels[NUM_TEST_CHANNELS];
+   GenericDataExchanger *generic[NUM_TEST_CHANNELS];
+   EventDataExchanger *event[NUM_TEST_CHANNELS];
+}CommsEnd;
+
+typedef struct
+{
+   GatedCommsIO *gate;
+   CommsEnd host;
+   CommsEnd remote;
+
+   GMutex mutex;
+   GCond cond;
+   guint nreceived;
+   GenericDataExchangerCallback genericcallbacks[NUM_TEST_CHANNELS];
+   EventDataExchangerCallback eventcallbacks[NUM_TEST_CHANNELS];
+   ChannelReceiver receivers[NUM_TEST_CHANNELS];
+}CommsTest;
+
+static void comms_end_init(CommsEnd *end,
+                           RemoteOffloadCommsIO *commsio,
+                           GenericDataExchangerCallback *genericcallbacks,
+                           EventDataExchangerCallback *eventcallbacks)
+{
+   end->comms = remote_offload_comms_new(commsio);
+   fail_unless(end->comms != NULL);
+
+   //the exchangers are registered in the same order on both ends
+   for( guint i = 0; i < NUM_TEST_CHANNELS; i++ )
+   {
+      end->channels[i] = remote_offload_comms_channel_new(end->comms, i);
+      fail_unless(end->channels[i] != NULL);
+      end->generic[i] = generic_data_exchanger_new(end->channels[i],
+                                                   genericcallbacks ? &genericcallbacks[i] : NULL);
+      end->event[i] = event_data_exchanger_new(end->channels[i],
+                                               eventcallbacks ? &eventcallbacks[i] : NULL);
+   }
+}
+
+static void comms_end_clear(CommsEnd *end)
+{
+   for( guint i = 0; i < NUM_TEST_CHANNELS; i++ )
+   {
+      g_object_unref(end->generic[i]);
+      g_object_unref(end->event[i]);
+      g_object_unref(end->channels[i]);
+   }
+   g_object_unref(end->comms);
+}
+
+static void comms_test_init(CommsTest *test)
+{
+   memset(test, 0, sizeof(*test));
+   g_mutex_init(&test->mutex);
+   g_cond_init(&test->cond);
+
+   for( guint i = 0; i < NUM_TEST_CHANNELS; i++ )
+   {
+      ChannelReceiver *receiver = &test->receivers[i];
+      receiver->mutex = &test->mutex;
+      receiver->cond = &test->cond;
+      receiver->nreceived = &test->nreceived;
+
+      test->genericcallbacks[i].received = frame_received;
+      test->genericcallbacks[i].priv = receiver;
+      test->eventcallbacks[i].event_received = event_received;
+      test->eventcallbacks[i].priv = receiver;
+   }
+
+   RemoteOffloadCommsIODummy *hostio = remote_offload_comms_io_dummy_new();
+   RemoteOffloadCommsIODummy *remoteio = remote_offload_comms_io_dummy_new();
+   fail_unless(connect_dummyio_pair(hostio, remoteio));
+
+   test->gate = gated_comms_io_new((RemoteOffloadCommsIO *)hostio);
+   comms_end_init(&test->host, (RemoteOffloadCommsIO *)test->gate, NULL, NULL);
+   comms_end_init(&test->remote, (RemoteOffloadCommsIO *)remoteio,
+                  test->genericcallbacks, test->eventcallbacks);
+
+   //the comms hold their own references
+   g_object_unref(test->gate);
+   g_object_unref(remoteio);
+
+   for( guint i = 0; i < NUM_TEST_CHANNELS; i++ )
+      test->receivers[i].eventexchanger = test->remote.event[i];
+}
+
+static void comms_test_clear(CommsTest *test)
+{
+   //each side tells the other's reader thread to end
+   remote_offload_comms_finish(test->host.comms);
+   remote_offload_comms_finish(test->remote.comms);
+
+   comms_end_clear(&test->host);
+   comms_end_clear(&test->remote);
+
+   for( guint i = 0; i < NUM_TEST_CHANNELS; i++ )
+   {
+      if( test->receivers[i].frame )
+         gst_memory_unref(test->receivers[i].frame);
+      g_free(test->receivers[i].event_payload);
+   }
+
+   g_mutex_clear(&test->mutex);
+   g_cond_clear(&test->cond);
+}
+
+//Wait until the given number of transfers have been received
+static void comms_test_wait_received(CommsTest *test, guint nreceived)
+{
+   gint64 end_time = g_get_monotonic_time() + RECEIVE_TIMEOUT_US;
+   g_mutex_lock(&test->mutex);
+   while( test->nreceived < nreceived )
+   {
+      if( !g_cond_wait_until(&test->cond, &test->mutex, end_time) )
+         break;
+   }
+   guint received = test->nreceived;
+   g_mutex_unlock(&test->mutex);
+
+   fail_unless(received == nreceived, "received %u of %u transfers", received, nreceived);
+}
+
+typedef struct
+{
+   GenericDataExchanger *exchanger;
+   GstMemory *frame;
+   gint done;
+}FrameSend;
+
+static gpointer send_frame_thread(gpointer data)
+{
+   FrameSend *send = (FrameSend *)data;
+
+   GArray *memblocks = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
+   g_array_append_val(memblocks, send->frame);
+   gboolean ret = generic_data_exchanger_send(send->exchanger, 0, memblocks, FALSE);
+   g_array_free(memblocks, TRUE);
+
+   g_atomic_int_set(&send->done, 1);
+
+   return GINT_TO_POINTER(ret);
+}
+
+//Start writing a large frame on the given channel, and wait until its first
+// chunk has been written.
+static GThread *start_large_frame(CommsTest *test, guint channel, FrameSend *send)
+{
+   send->exchanger = test->host.generic[channel];
+   send->frame = new_pattern_mem(LARGE_FRAME_SIZE, 0x11);
+   send->done = 0;
+
+   gated_comms_io_arm(test->gate);
+   GThread *thread = g_thread_new("largeframe", send_frame_thread, send);
+   gated_comms_io_wait_first_write(test->gate);
+
+   return thread;
+}
+
+//An event sent on the channel of a large frame that's being written arrives
+// before that frame does, and neither is corrupted by the other.
+GST_START_TEST(control_interleaved_within_frame)
+{
+   CommsTest test;
+   comms_test_init(&test);
+
+   FrameSend send;
+   GThread *thread = start_large_frame(&test, 0, &send);
+
+   gchar *payload = g_malloc(EVENT_PAYLOAD_SIZE + 1);
+   for( gsize i = 0; i < EVENT_PAYLOAD_SIZE; i++ )
+      payload[i] = 'a' + (pattern_byte(i, 0x22) % 26);
+   payload[EVENT_PAYLOAD_SIZE] = 0;
+
+   GstEvent *event = gst_event_new_custom(GST_EVENT_CUSTOM_DOWNSTREAM,
+                                          gst_structure_new("rob-comms-test",
+                                                            "payload", G_TYPE_STRING, payload,
+                                                            NULL));
+
+   //this returns once the remote side has handled the event
+   gated_comms_io_open(test.gate);
+   fail_unless(event_data_exchanger_send_event(test.host.event[0], event));
+   gst_event_unref(event);
+
+   fail_unless(!g_atomic_int_get(&send.done),
+               "the event waited for the frame to be completely written");
+
+   fail_unless(GPOINTER_TO_INT(g_thread_join(thread)));
+   comms_test_wait_received(&test, 2);
+
+   ChannelReceiver *receiver = &test.receivers[0];
+   fail_unless(receiver->event_order == 1);
+   fail_unless(receiver->frame_order == 2);
+   fail_unless(g_strcmp0(receiver->event_payload, payload) == 0);
+   fail_unless(receiver->frame != NULL);
+   check_pattern_mem(receiver->frame, LARGE_FRAME_SIZE, 0x11);
+
+   gst_memory_unref(send.frame);
+   g_free(payload);
+   comms_test_clear(&test);
+}
+GST_END_TEST
+
+//A frame sent on one channel while another channel's large frame is being
+// written over the same comms goes in between the chunks of that frame.
+GST_START_TEST(channels_interleaved)
+{
+   CommsTest test;
+   comms_test_init(&test);
+
+   FrameSend send;
+   GThread *thread = start_large_frame(&test, 0, &send);
+
+   //blocking, so this returns once the remote side has received it
+   GstMemory *small = new_pattern_mem(SMALL_FRAME_SIZE, 0x33);
+   GArray *memblocks = g_array_new(FALSE, FALSE, sizeof(GstMemory *));
+   g_array_append_val(memblocks, small);
+   gated_comms_io_open(test.gate);
+   fail_unless(generic_data_exchanger_send(test.host.generic[1], 0, memblocks, TRUE));
+   g_array_free(memblocks, TRUE);
+
+   fail_unless(!g_atomic_int_get(&send.done),
+               "channel 1 waited for the frame of channel 0 to be completely written");
+
+   fail_unless(GPOINTER_TO_INT(g_thread_join(thread)));
+   comms_test_wait_received(&test, 2);
+
+   fail_unless(test.receivers[1].frame_order == 1);
+   fail_unless(test.receivers[0].frame_order == 2);
+   fail_unless(test.receivers[1].frame != NULL);
+   check_pattern_mem(test.receivers[1].frame, SMALL_FRAME_SIZE, 0x33);
+   fail_unless(test.receivers[0].frame != NULL);
+   check_pattern_mem(test.receivers[0].frame, LARGE_FRAME_SIZE, 0x11);
+
+   gst_memory_unref(small);
+   gst_memory_unref(send.frame);
+   comms_test_clear(&test);
+}
+GST_END_TEST
+
+static Suite *
+rob_comms_suite (void)
+{
+  Suite *s = suite_create ("rob_comms");
+
+  ROB_ADD_TEST_CASE(control_interleaved_within_frame);
+  ROB_ADD_TEST_CASE(channels_interleaved);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rob_comms);
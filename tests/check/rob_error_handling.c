@@ -35,6 +35,7 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/check/gstconsistencychecker.h>
+#include <gst/app/gstappsink.h>
 #include "robtestutils.h"
 
 //Error happens on ROB-side, half way through execution
@@ -187,6 +188,60 @@ GST_START_TEST(error_sublaunch)
 }
 GST_END_TEST
 
+//The host-side sink fails the last buffer. With a window of in-flight buffers,
+// no later chain call collects that failure, so it must be reported at EOS.
+#define ERRORWINDOW_NUM_BUFFERS 32
+static const gchar *errorwindow_str = "videotestsrc num-buffers=" xstr(ERRORWINDOW_NUM_BUFFERS) " ! "
+                                      "video/x-raw,width=64,height=48 ! "
+                                      "remoteoffloadbin.( max-inflight-buffers=8 identity ) ! "
+                                      "appsink name=sink sync=false";
+
+static GstFlowReturn FailLastSample(GstAppSink *appsink, gpointer user_data)
+{
+   guint *nsamples = (guint *)user_data;
+   GstSample *sample = gst_app_sink_pull_sample(appsink);
+   if( sample )
+      gst_sample_unref(sample);
+
+   (*nsamples)++;
+
+   //appsink doesn't post an error message for this, the flow return is all there is.
+   return (*nsamples == ERRORWINDOW_NUM_BUFFERS) ? GST_FLOW_ERROR : GST_FLOW_OK;
+}
+
+GST_START_TEST(error_window)
+{
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(errorwindow_str, &error);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   guint nsamples = 0;
+   GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+   fail_unless(sink != NULL);
+   GstAppSinkCallbacks callbacks = { NULL, NULL, FailLastSample };
+   gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, &nsamples, NULL);
+   gst_object_unref(sink);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR,
+               "Expected the failed buffer to be reported, got %s",
+               GST_MESSAGE_TYPE_NAME(msg));
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   fail_unless_equals_int(nsamples, ERRORWINDOW_NUM_BUFFERS);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(pipeline);
+}
+GST_END_TEST
+
 
 
 static Suite *
@@ -214,6 +269,8 @@ rob_error_handling_suite (void)
 
   ROB_ADD_TEST_CASE(error_sublaunch)
 
+  ROB_ADD_TEST_CASE(error_window)
+
   return s;
 }
 
@@ -0,0 +1,185 @@
+/*
+ *  rob_meta.c - Tests of meta being transferred across remoteoffloadbin
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  GstVideoRegionOfInterestMeta's are added to each buffer before it enters
+ *  a remoteoffloadbin, and checked once it leaves.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/video/gstvideometa.h>
+#include "robtestutils.h"
+
+typedef struct
+{
+   guint nrois;
+   guint64 produced;
+   guint64 checked;
+}RoiMetaTestEntry;
+
+static void add_roi_metas(GstBuffer *buf, guint nrois, guint64 frame)
+{
+   for( guint i = 0; i < nrois; i++ )
+   {
+      GstVideoRegionOfInterestMeta *meta =
+            gst_buffer_add_video_region_of_interest_meta(buf, "test_roi",
+                                                         i * 10, i * 20, 30, 40);
+      fail_unless(meta != NULL);
+      gst_video_region_of_interest_meta_add_param(meta,
+            gst_structure_new("detection",
+                              "label", G_TYPE_STRING, (i & 1) ? "cat" : "dog",
+                              "frame", G_TYPE_UINT64, frame,
+                              "roi", G_TYPE_UINT, i,
+                              "confidence", G_TYPE_DOUBLE, 0.5 + i / 100.0, NULL));
+   }
+}
+
+static GstPadProbeReturn AddRoiMetaProbe(GstPad *pad,
+                                         GstPadProbeInfo *info,
+                                         gpointer user_data)
+{
+   RoiMetaTestEntry *entry = (RoiMetaTestEntry *)user_data;
+
+   GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+   GST_PAD_PROBE_INFO_DATA(info) = buf;
+
+   add_roi_metas(buf, entry->nrois, entry->produced++);
+
+   return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn CheckRoiMetaProbe(GstPad *pad,
+                                           GstPadProbeInfo *info,
+                                           gpointer user_data)
+{
+   RoiMetaTestEntry *entry = (RoiMetaTestEntry *)user_data;
+   GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+   guint i = 0;
+   GstVideoRegionOfInterestMeta *meta = NULL;
+   gpointer state = NULL;
+   while( (meta = (GstVideoRegionOfInterestMeta *)
+           gst_buffer_iterate_meta_filtered(buf,
+                                            &state,
+                                            gst_video_region_of_interest_meta_api_get_type())) )
+   {
+      fail_unless(meta->roi_type == g_quark_from_string("test_roi"));
+      fail_unless((meta->x == i * 10) && (meta->y == i * 20));
+      fail_unless((meta->w == 30) && (meta->h == 40));
+
+      GstStructure *s = gst_video_region_of_interest_meta_get_param(meta, "detection");
+      fail_unless(s != NULL);
+      fail_unless(!g_strcmp0(gst_structure_get_string(s, "label"), (i & 1) ? "cat" : "dog"));
+      guint64 frame = 0;
+      fail_unless(gst_structure_get_uint64(s, "frame", &frame));
+      fail_unless(frame == entry->checked);
+      guint roi = 0;
+      fail_unless(gst_structure_get_uint(s, "roi", &roi));
+      fail_unless(roi == i);
+      gdouble confidence = 0;
+      fail_unless(gst_structure_get_double(s, "confidence", &confidence));
+      fail_unless(confidence == 0.5 + i / 100.0);
+      i++;
+   }
+
+   fail_unless(i == entry->nrois);
+   entry->checked++;
+
+   return GST_PAD_PROBE_OK;
+}
+
+static void run_roi_meta_pipeline(const gchar *pipeline_str,
+                                  RoiMetaTestEntry *entry)
+{
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   GstElement *roigen = gst_bin_get_by_name(GST_BIN(pipeline), "roigen");
+   fail_unless(roigen != NULL);
+   GstPad *pad = gst_element_get_static_pad(roigen, "src");
+   gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, AddRoiMetaProbe, entry, NULL);
+   gst_object_unref(pad);
+   gst_object_unref(roigen);
+
+   GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+   fail_unless(sink != NULL);
+   pad = gst_element_get_static_pad(sink, "sink");
+   gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, CheckRoiMetaProbe, entry, NULL);
+   gst_object_unref(pad);
+   gst_object_unref(sink);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(pipeline);
+
+   fail_unless(entry->produced > 0);
+   fail_unless(entry->checked == entry->produced);
+}
+
+static const gchar *roimeta_str = "videotestsrc num-buffers=32 ! "
+                                  "video/x-raw,width=320,height=240 ! "
+                                  "identity name=roigen ! "
+                                  "remoteoffloadbin.( queue ) ! "
+                                  "fakesink name=sink sync=false";
+
+//one ROI per buffer
+GST_START_TEST(roimeta0)
+{
+   RoiMetaTestEntry entry = {1, 0, 0};
+   run_roi_meta_pipeline(roimeta_str, &entry);
+}
+GST_END_TEST
+
+//several ROI's per buffer, the first of which carries the meta type
+// definition across the ROB
+GST_START_TEST(roimeta1)
+{
+   RoiMetaTestEntry entry = {5, 0, 0};
+   run_roi_meta_pipeline(roimeta_str, &entry);
+}
+GST_END_TEST
+
+static Suite *
+rob_meta_suite (void)
+{
+  Suite *s = suite_create ("rob_meta");
+
+  ROB_ADD_TEST_CASE(roimeta0);
+  ROB_ADD_TEST_CASE(roimeta1);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rob_meta);
@@ -0,0 +1,180 @@
+/*
+ *  rob_replay.c - Tests of recording a remoteoffloadbin session, and replaying it
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  A session is recorded with GST_REMOTEOFFLOAD_RECORD, using the dummy device,
+ *  and the host-side trace is then replayed into the same pipeline, without
+ *  a remote pipeline.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+
+static GstPadProbeReturn CountBuffersProbe(GstPad *pad,
+                                           GstPadProbeInfo *info,
+                                           gpointer user_data)
+{
+   guint *nbuffers = (guint *)user_data;
+   (*nbuffers)++;
+
+   return GST_PAD_PROBE_OK;
+}
+
+//Run pipeline_str until EOS, and return the number of buffers
+// that reached the element named "sink".
+static guint run_replay_pipeline(const gchar *pipeline_str)
+{
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   guint nbuffers = 0;
+   GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+   fail_unless(sink != NULL);
+   GstPad *pad = gst_element_get_static_pad(sink, "sink");
+   gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, CountBuffersProbe, &nbuffers, NULL);
+   gst_object_unref(pad);
+   gst_object_unref(sink);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(pipeline);
+
+   return nbuffers;
+}
+
+//The dummy device creates (and so records) the host-side connection before
+// the remote one, so the host-side trace is the one with the lowest index.
+static gchar *find_host_trace(const gchar *tracedir)
+{
+   GDir *dir = g_dir_open(tracedir, 0, NULL);
+   fail_unless(dir != NULL);
+
+   gchar *hosttrace = NULL;
+   gint64 hostindex = G_MAXINT64;
+   const gchar *name;
+   while( (name = g_dir_read_name(dir)) )
+   {
+      if( !g_str_has_suffix(name, ".rotrace") )
+         continue;
+
+      const gchar *index_str = strrchr(name, '-');
+      fail_unless(index_str != NULL);
+      gint64 index = g_ascii_strtoll(index_str + 1, NULL, 10);
+      if( index < hostindex )
+      {
+         hostindex = index;
+         g_free(hosttrace);
+         hosttrace = g_build_filename(tracedir, name, NULL);
+      }
+   }
+   g_dir_close(dir);
+
+   fail_unless(hosttrace != NULL);
+
+   return hosttrace;
+}
+
+static void remove_traces(const gchar *tracedir)
+{
+   GDir *dir = g_dir_open(tracedir, 0, NULL);
+   if( dir )
+   {
+      const gchar *name;
+      while( (name = g_dir_read_name(dir)) )
+      {
+         gchar *filename = g_build_filename(tracedir, name, NULL);
+         g_remove(filename);
+         g_free(filename);
+      }
+      g_dir_close(dir);
+   }
+   g_rmdir(tracedir);
+}
+
+static const gchar *record_str = "videotestsrc num-buffers=30 ! "
+                                 "video/x-raw,width=320,height=240 ! "
+                                 "remoteoffloadbin.( videoconvert ! queue ) ! "
+                                 "video/x-raw,format=BGRA ! fakesink name=sink sync=false";
+
+static const gchar *replay_str = "videotestsrc num-buffers=30 ! "
+                                 "video/x-raw,width=320,height=240 ! "
+                                 "remoteoffloadbin.( deviceparams=\"--replay=%s --replay-speed=0\" "
+                                 "videoconvert ! queue ) ! "
+                                 "video/x-raw,format=BGRA ! fakesink name=sink sync=false";
+
+//Record a session, and replay it as fast as possible. The replayed reads are
+// paced by the pipeline's writes, so it must run to EOS, producing the same
+// number of buffers as the recording.
+GST_START_TEST(replay0)
+{
+   gchar *tracedir = g_dir_make_tmp("rob_replay-XXXXXX", NULL);
+   fail_unless(tracedir != NULL);
+
+   gchar *prefix = g_build_filename(tracedir, "session", NULL);
+   g_setenv("GST_REMOTEOFFLOAD_RECORD", prefix, TRUE);
+   g_unsetenv("GST_REMOTEOFFLOAD_RECORD_HASH_ONLY");
+   guint nrecorded = run_replay_pipeline(record_str);
+   g_unsetenv("GST_REMOTEOFFLOAD_RECORD");
+   g_free(prefix);
+
+   fail_unless(nrecorded == 30);
+
+   gchar *hosttrace = find_host_trace(tracedir);
+   gchar *pipeline_str = g_strdup_printf(replay_str, hosttrace);
+   guint nreplayed = run_replay_pipeline(pipeline_str);
+   g_free(pipeline_str);
+   g_free(hosttrace);
+
+   fail_unless(nreplayed == nrecorded);
+
+   remove_traces(tracedir);
+   g_free(tracedir);
+}
+GST_END_TEST
+
+static Suite *
+rob_replay_suite (void)
+{
+  Suite *s = suite_create ("rob_replay");
+
+  ROB_ADD_TEST_CASE(replay0);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rob_replay);
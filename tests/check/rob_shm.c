@@ -0,0 +1,318 @@
+/*
+ *  rob_shm.c - Tests of the shared-memory CommsIO
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  The CommsIO tests run both ends of the rings within this process. The
+ *  pipeline tests spawn gst_offload_shm_server, and run remoteoffloadbin
+ *  with device=shm against it.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <signal.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+#include "remoteoffloadcommsio.h"
+#include "remoteoffloadcommsio_shm.h"
+
+#define TEST_RING_SIZE (256 * 1024)
+
+//large enough to be wrapped, instead of copied
+#define WRAP_SEGMENT_SIZE (64 * 1024)
+
+static inline guint8 pattern_byte(gsize offset)
+{
+   return (guint8)((offset * 31) + (offset >> 8));
+}
+
+typedef struct
+{
+   gchar *tmpdir;
+   gchar *socket_path;
+}ShmTestDir;
+
+static void shm_test_dir_init(ShmTestDir *dir)
+{
+   dir->tmpdir = g_dir_make_tmp("rob_shm_XXXXXX", NULL);
+   fail_unless(dir->tmpdir != NULL);
+   dir->socket_path = g_build_filename(dir->tmpdir, "sock", NULL);
+}
+
+static void shm_test_dir_clear(ShmTestDir *dir)
+{
+   g_unlink(dir->socket_path);
+   g_rmdir(dir->tmpdir);
+   g_free(dir->socket_path);
+   g_free(dir->tmpdir);
+}
+
+//Connect both ends of a shared-memory region within this process. The client
+// end writes to the server end.
+static void connect_commsio_pair(const gchar *socket_path,
+                                 RemoteOffloadCommsIO **writer,
+                                 RemoteOffloadCommsIO **reader)
+{
+   int listenfd = remote_offload_comms_io_shm_listen(socket_path);
+   fail_unless(listenfd >= 0);
+
+   //the handshake is buffered by the unix socket until it's accepted
+   *writer = (RemoteOffloadCommsIO *)remote_offload_comms_io_shm_connect(socket_path,
+                                                                         TEST_RING_SIZE);
+   fail_unless(*writer != NULL);
+
+   gboolean listen_error = FALSE;
+   *reader = (RemoteOffloadCommsIO *)remote_offload_comms_io_shm_accept(listenfd,
+                                                                        &listen_error);
+   fail_unless(*reader != NULL);
+   close(listenfd);
+}
+
+static void write_pattern(RemoteOffloadCommsIO *writer, gsize size, gsize *offset)
+{
+   guint8 *buf = g_malloc(size);
+   for( gsize i = 0; i < size; i++ )
+      buf[i] = pattern_byte((*offset)++);
+
+   fail_unless(remote_offload_comms_io_write(writer, buf, size) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+   g_free(buf);
+}
+
+static void check_pattern(GstMemory *mem, gsize *offset)
+{
+   GstMapInfo map;
+   fail_unless(gst_memory_map(mem, &map, GST_MAP_READ));
+   for( gsize i = 0; i < map.size; i++, (*offset)++ )
+   {
+      fail_unless(map.data[i] == pattern_byte(*offset),
+                  "byte %" G_GSIZE_FORMAT " differs", *offset);
+   }
+   gst_memory_unmap(mem, &map);
+}
+
+static GstMemory *read_copy(RemoteOffloadCommsIO *reader, gsize size)
+{
+   GstMemory *mem = gst_allocator_alloc(NULL, size, NULL);
+   GList *mem_list = g_list_append(NULL, mem);
+   fail_unless(remote_offload_comms_io_read_mem_list(reader, mem_list) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+   g_list_free(mem_list);
+
+   return mem;
+}
+
+typedef struct
+{
+   RemoteOffloadCommsIO *writer;
+   gsize size;
+   gsize offset;
+}PatternWrite;
+
+static gpointer write_pattern_thread(gpointer data)
+{
+   PatternWrite *write = (PatternWrite *)data;
+   write_pattern(write->writer, write->size, &write->offset);
+
+   return NULL;
+}
+
+//Large segments are handed over as memories that wrap the ring, small ones
+// (and ones that would hold back too much of the ring) are left for the caller
+// to copy, and the ring space is given back once the wrapping memories are freed.
+GST_START_TEST(shm_mem_ref)
+{
+   ShmTestDir dir;
+   shm_test_dir_init(&dir);
+
+   RemoteOffloadCommsIO *writer, *reader;
+   connect_commsio_pair(dir.socket_path, &writer, &reader);
+
+   gsize woffset = 0;
+   gsize roffset = 0;
+   GstMemory *mem;
+
+   //too small to be worth wrapping
+   write_pattern(writer, 100, &woffset);
+   fail_unless(remote_offload_comms_io_read_mem_ref(reader, 100, &mem) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+   fail_unless(mem == NULL);
+   mem = read_copy(reader, 100);
+   check_pattern(mem, &roffset);
+   gst_memory_unref(mem);
+
+   //two segments that are wrapped
+   write_pattern(writer, WRAP_SEGMENT_SIZE, &woffset);
+   write_pattern(writer, WRAP_SEGMENT_SIZE, &woffset);
+   GstMemory *wrapped[2];
+   for( guint i = 0; i < 2; i++ )
+   {
+      fail_unless(remote_offload_comms_io_read_mem_ref(reader, WRAP_SEGMENT_SIZE, &wrapped[i]) ==
+                  REMOTEOFFLOADCOMMSIO_SUCCESS);
+      fail_unless(wrapped[i] != NULL);
+      check_pattern(wrapped[i], &roffset);
+   }
+
+   //this would hold back more than half of the ring, so it's copied
+   write_pattern(writer, WRAP_SEGMENT_SIZE, &woffset);
+   fail_unless(remote_offload_comms_io_read_mem_ref(reader, WRAP_SEGMENT_SIZE, &mem) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+   fail_unless(mem == NULL);
+   mem = read_copy(reader, WRAP_SEGMENT_SIZE);
+   check_pattern(mem, &roffset);
+   gst_memory_unref(mem);
+
+   //release them out of order. Once both are gone, the whole ring is usable
+   // again, which the writer below needs in order to finish.
+   gst_memory_unref(wrapped[1]);
+   gst_memory_unref(wrapped[0]);
+
+   PatternWrite write = { writer, 2 * TEST_RING_SIZE, woffset };
+   GThread *thread = g_thread_new("shmwriter", write_pattern_thread, &write);
+   mem = read_copy(reader, 2 * TEST_RING_SIZE);
+   g_thread_join(thread);
+   check_pattern(mem, &roffset);
+   gst_memory_unref(mem);
+
+   //the next segment spans the end of the ring, so it can't be wrapped
+   woffset = write.offset;
+   gsize to_end = TEST_RING_SIZE - (roffset % TEST_RING_SIZE);
+   gsize fill = (to_end > 1024) ? to_end - 1024 : to_end + TEST_RING_SIZE - 1024;
+   write_pattern(writer, fill, &woffset);
+   mem = read_copy(reader, fill);
+   check_pattern(mem, &roffset);
+   gst_memory_unref(mem);
+
+   write_pattern(writer, WRAP_SEGMENT_SIZE, &woffset);
+   fail_unless(remote_offload_comms_io_read_mem_ref(reader, WRAP_SEGMENT_SIZE, &mem) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+   fail_unless(mem == NULL);
+   mem = read_copy(reader, WRAP_SEGMENT_SIZE);
+   check_pattern(mem, &roffset);
+   gst_memory_unref(mem);
+
+   //a wrapped memory keeps the region mapped, after the CommsIO's are gone
+   write_pattern(writer, WRAP_SEGMENT_SIZE, &woffset);
+   fail_unless(remote_offload_comms_io_read_mem_ref(reader, WRAP_SEGMENT_SIZE, &mem) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+   fail_unless(mem != NULL);
+
+   remote_offload_comms_io_shutdown(writer);
+   g_object_unref(writer);
+   g_object_unref(reader);
+
+   check_pattern(mem, &roffset);
+   gst_memory_unref(mem);
+
+   shm_test_dir_clear(&dir);
+}
+GST_END_TEST
+
+//Start gst_offload_shm_server, and wait until it's listening.
+static GSubprocess *start_shm_server(const gchar *socket_path)
+{
+   gchar *socketarg = g_strdup_printf("--socket=%s", socket_path);
+   GError *error = NULL;
+   GSubprocess *server = g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error,
+                                          SHM_SERVER_PATH, socketarg, NULL);
+   g_free(socketarg);
+   fail_unless(server != NULL, "Error spawning %s: %s", SHM_SERVER_PATH,
+               error ? error->message : "unknown");
+
+   GDataInputStream *out =
+         g_data_input_stream_new(g_subprocess_get_stdout_pipe(server));
+   gboolean blistening = FALSE;
+   gchar *line;
+   while( !blistening &&
+          (line = g_data_input_stream_read_line(out, NULL, NULL, NULL)) )
+   {
+      blistening = g_str_has_prefix(line, "Listening on");
+      g_free(line);
+   }
+   g_object_unref(out);
+   fail_unless(blistening, "gst_offload_shm_server didn't start listening");
+
+   return server;
+}
+
+static void stop_shm_server(GSubprocess *server)
+{
+   g_subprocess_send_signal(server, SIGTERM);
+   g_subprocess_wait(server, NULL, NULL);
+   g_object_unref(server);
+}
+
+//Two channels in each direction, so that per-channel mode opens several
+// connections. The frames are small enough to be sent unchunked, and
+// so are received by wrapping the ring.
+static const gchar *shm_pipeline_fmt = "videotestsrc num-buffers=64 pattern=ball ! "
+                                       "video/x-raw,format=I420,width=160,height=120 ! tee name=t ! "
+                                       "queue name=q0 t. ! queue name=q1 "
+                                       "remoteoffloadbin.( device=shm deviceparams=\"--socket=%s%s\" "
+                                       "q0. ! videoconvert ! queue name=q2 "
+                                       "q1. ! queue name=q3 ) "
+                                       "q2. ! appsink name=appsink0 sync=false qos=false "
+                                       "q3. ! appsink name=appsink1 sync=false qos=false";
+
+static void run_shm_pipeline(const gchar *extra_params)
+{
+   ShmTestDir dir;
+   shm_test_dir_init(&dir);
+   GSubprocess *server = start_shm_server(dir.socket_path);
+
+   gchar *pipeline_str = g_strdup_printf(shm_pipeline_fmt, dir.socket_path, extra_params);
+   fail_unless(test_rob_pipeline(pipeline_str, TESTROBPIPELINE_FLAG_NONE));
+   g_free(pipeline_str);
+
+   stop_shm_server(server);
+   shm_test_dir_clear(&dir);
+}
+
+//one connection per channel
+GST_START_TEST(shm_pipeline_per_channel)
+{
+   run_shm_pipeline("");
+}
+GST_END_TEST
+
+//all channels share a single connection
+GST_START_TEST(shm_pipeline_shared_connection)
+{
+   run_shm_pipeline(" --sharedconnection");
+}
+GST_END_TEST
+
+static Suite *
+rob_shm_suite (void)
+{
+  Suite *s = suite_create ("rob_shm");
+
+  ROB_ADD_TEST_CASE(shm_mem_ref);
+  ROB_ADD_TEST_CASE(shm_pipeline_per_channel);
+  ROB_ADD_TEST_CASE(shm_pipeline_shared_connection);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rob_shm);
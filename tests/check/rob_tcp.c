@@ -0,0 +1,274 @@
+/*
+ *  rob_tcp.c - Tests of the TCP CommsIO, over loopback
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  The CommsIO tests connect two TCP CommsIO's to each other within this
+ *  process. The pipeline tests spawn gst_offload_tcp_server on 127.0.0.1,
+ *  and run remoteoffloadbin with device=tcp against it.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <gio/gio.h>
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+#include "remoteoffloadcommsio.h"
+#include "remoteoffloadcommsio_tcp.h"
+
+//more than the number of iovec's that the TCP CommsIO keeps on the stack
+#define MEMLIST_NUM_WRITE_MEMS 40
+
+//larger than the socket buffers, so that writev / readv complete partially
+#define MEMLIST_LARGE_MEM_SIZE (4 * 1024 * 1024)
+
+static inline guint8 pattern_byte(gsize offset)
+{
+   return (guint8)((offset * 31) + (offset >> 8));
+}
+
+//Create a socket listening on 127.0.0.1, on a port chosen by the OS.
+static int listen_loopback(guint16 *port)
+{
+   int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+   fail_unless(listenfd >= 0);
+
+   struct sockaddr_in addr = {0};
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = 0;
+   fail_unless(bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+   fail_unless(listen(listenfd, 4) == 0);
+
+   socklen_t addrlen = sizeof(addr);
+   fail_unless(getsockname(listenfd, (struct sockaddr *)&addr, &addrlen) == 0);
+   *port = ntohs(addr.sin_port);
+
+   return listenfd;
+}
+
+//Connect a pair of TCP CommsIO's to each other over loopback
+static void connect_commsio_pair(RemoteOffloadCommsIO **writer,
+                                 RemoteOffloadCommsIO **reader)
+{
+   guint16 port;
+   int listenfd = listen_loopback(&port);
+
+   TCPCommsIOSocketParams params = { TRUE, 0, 0 };
+   *writer = (RemoteOffloadCommsIO *)remote_offload_comms_io_tcp_connect("127.0.0.1",
+                                                                         port,
+                                                                         &params);
+   fail_unless(*writer != NULL);
+
+   int connfd = accept(listenfd, NULL, NULL);
+   fail_unless(connfd >= 0);
+   close(listenfd);
+
+   *reader = (RemoteOffloadCommsIO *)remote_offload_comms_io_tcp_new(connfd, &params);
+   fail_unless(*reader != NULL);
+}
+
+//Allocate a memory of the given size, filled with the pattern starting at *offset
+static GstMemory *new_pattern_mem(gsize size, gsize *offset)
+{
+   GstMemory *mem = gst_allocator_alloc(NULL, size, NULL);
+   GstMapInfo map;
+   fail_unless(gst_memory_map(mem, &map, GST_MAP_WRITE));
+   for( gsize i = 0; i < size; i++ )
+      map.data[i] = pattern_byte((*offset)++);
+   gst_memory_unmap(mem, &map);
+
+   return mem;
+}
+
+typedef struct
+{
+   RemoteOffloadCommsIO *commsio;
+   GList *mem_list;
+}MemListWrite;
+
+static gpointer write_mem_list_thread(gpointer data)
+{
+   MemListWrite *write = (MemListWrite *)data;
+   RemoteOffloadCommsIOResult ret =
+         remote_offload_comms_io_write_mem_list(write->commsio, write->mem_list);
+
+   return GINT_TO_POINTER(ret);
+}
+
+//A list of many memories (including empty ones, and one that's larger than
+// the socket buffers) written with writev is received byte-exact by readv
+// into a differently split list of memories.
+GST_START_TEST(tcp_mem_list)
+{
+   RemoteOffloadCommsIO *writer, *reader;
+   connect_commsio_pair(&writer, &reader);
+
+   gsize total = 0;
+   GList *write_list = NULL;
+   for( guint memi = 0; memi < MEMLIST_NUM_WRITE_MEMS; memi++ )
+   {
+      gsize size;
+      if( memi == MEMLIST_NUM_WRITE_MEMS / 2 )
+         size = MEMLIST_LARGE_MEM_SIZE;
+      else
+      if( (memi % 7) == 3 )
+         size = 0;
+      else
+         size = 1 + memi * 13;
+
+      write_list = g_list_append(write_list, new_pattern_mem(size, &total));
+   }
+
+   MemListWrite write = { writer, write_list };
+   GThread *thread = g_thread_new("tcpwriter", write_mem_list_thread, &write);
+
+   //read it back as: 1 byte, nothing, half of the rest, the remainder
+   gsize offset = 0;
+   gsize sizes[] = { 1, 0, (total - 1) / 2, total - 1 - (total - 1) / 2 };
+   GList *read_list = NULL;
+   for( guint i = 0; i < G_N_ELEMENTS(sizes); i++ )
+      read_list = g_list_append(read_list, gst_allocator_alloc(NULL, sizes[i], NULL));
+
+   fail_unless(remote_offload_comms_io_read_mem_list(reader, read_list) ==
+               REMOTEOFFLOADCOMMSIO_SUCCESS);
+
+   fail_unless(GPOINTER_TO_INT(g_thread_join(thread)) == REMOTEOFFLOADCOMMSIO_SUCCESS);
+
+   for( GList *li = read_list; li != NULL; li = li->next )
+   {
+      GstMapInfo map;
+      fail_unless(gst_memory_map((GstMemory *)li->data, &map, GST_MAP_READ));
+      for( gsize i = 0; i < map.size; i++, offset++ )
+      {
+         fail_unless(map.data[i] == pattern_byte(offset),
+                     "byte %" G_GSIZE_FORMAT " differs", offset);
+      }
+      gst_memory_unmap((GstMemory *)li->data, &map);
+   }
+   fail_unless(offset == total);
+
+   //after the writer shuts down, the reader sees the connection close
+   remote_offload_comms_io_shutdown(writer);
+   guint8 byte;
+   fail_unless(remote_offload_comms_io_read(reader, &byte, 1) ==
+               REMOTEOFFLOADCOMMSIO_CONNECTION_CLOSED);
+
+   g_list_free_full(write_list, (GDestroyNotify)gst_memory_unref);
+   g_list_free_full(read_list, (GDestroyNotify)gst_memory_unref);
+   g_object_unref(writer);
+   g_object_unref(reader);
+}
+GST_END_TEST
+
+//Start gst_offload_tcp_server on 127.0.0.1, and wait until it's listening.
+static GSubprocess *start_tcp_server(guint16 *port)
+{
+   //let the OS pick a free port for the server to use
+   int fd = listen_loopback(port);
+   close(fd);
+
+   gchar *portarg = g_strdup_printf("--port=%u", *port);
+   GError *error = NULL;
+   GSubprocess *server = g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error,
+                                          TCP_SERVER_PATH, "--bind=127.0.0.1", portarg,
+                                          NULL);
+   g_free(portarg);
+   fail_unless(server != NULL, "Error spawning %s: %s", TCP_SERVER_PATH,
+               error ? error->message : "unknown");
+
+   GDataInputStream *out =
+         g_data_input_stream_new(g_subprocess_get_stdout_pipe(server));
+   gboolean blistening = FALSE;
+   gchar *line;
+   while( !blistening &&
+          (line = g_data_input_stream_read_line(out, NULL, NULL, NULL)) )
+   {
+      blistening = g_str_has_prefix(line, "Listening on");
+      g_free(line);
+   }
+   g_object_unref(out);
+   fail_unless(blistening, "gst_offload_tcp_server didn't start listening");
+
+   return server;
+}
+
+static void stop_tcp_server(GSubprocess *server)
+{
+   g_subprocess_send_signal(server, SIGTERM);
+   g_subprocess_wait(server, NULL, NULL);
+   g_object_unref(server);
+}
+
+//two channels in each direction, so that per-channel mode opens several connections
+static const gchar *tcp_pipeline_fmt = "videotestsrc num-buffers=64 pattern=ball ! "
+                                       "video/x-raw,width=640,height=480 ! tee name=t ! "
+                                       "queue name=q0 t. ! queue name=q1 "
+                                       "remoteoffloadbin.( device=tcp deviceparams=\"--port=%u%s\" "
+                                       "q0. ! videoconvert ! queue name=q2 "
+                                       "q1. ! queue name=q3 ) "
+                                       "q2. ! appsink name=appsink0 sync=false qos=false "
+                                       "q3. ! appsink name=appsink1 sync=false qos=false";
+
+static void run_tcp_pipeline(const gchar *extra_params)
+{
+   guint16 port;
+   GSubprocess *server = start_tcp_server(&port);
+
+   gchar *pipeline_str = g_strdup_printf(tcp_pipeline_fmt, port, extra_params);
+   fail_unless(test_rob_pipeline(pipeline_str, TESTROBPIPELINE_FLAG_NONE));
+   g_free(pipeline_str);
+
+   stop_tcp_server(server);
+}
+
+//one connection per channel
+GST_START_TEST(tcp_pipeline_per_channel)
+{
+   run_tcp_pipeline("");
+}
+GST_END_TEST
+
+//all channels share a single connection
+GST_START_TEST(tcp_pipeline_shared_connection)
+{
+   run_tcp_pipeline(" --sharedconnection");
+}
+GST_END_TEST
+
+static Suite *
+rob_tcp_suite (void)
+{
+  Suite *s = suite_create ("rob_tcp");
+
+  ROB_ADD_TEST_CASE(tcp_mem_list);
+  ROB_ADD_TEST_CASE(tcp_pipeline_per_channel);
+  ROB_ADD_TEST_CASE(tcp_pipeline_shared_connection);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rob_tcp);
@@ -0,0 +1,173 @@
+/*
+ *  structureserializer.c - Tests of the binary GstStructure serialization
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include "robtestutils.h"
+#include "remoteoffloadstructureserializer.h"
+
+static GstStructure *make_detection(guint index)
+{
+   return gst_structure_new("detection",
+                            "label", G_TYPE_STRING, "dog",
+                            "index", G_TYPE_UINT, index,
+                            "confidence", G_TYPE_DOUBLE, 0.75,
+                            "is_valid", G_TYPE_BOOLEAN, TRUE, NULL);
+}
+
+//Write s, and return the encoding as a newly allocated GBytes
+static GBytes *write_structure(RemoteOffloadStructureWriter *writer,
+                               const GstStructure *s)
+{
+   GstByteWriter bw;
+   gst_byte_writer_init(&bw);
+   fail_unless(remote_offload_structure_write(writer, s, NULL, &bw));
+
+   gsize size = gst_byte_writer_get_pos(&bw);
+   return g_bytes_new_take(gst_byte_writer_reset_and_get_data(&bw), size);
+}
+
+static GstStructure *read_structure(RemoteOffloadStructureReader *reader,
+                                    GBytes *bytes)
+{
+   gsize size;
+   const guint8 *data = g_bytes_get_data(bytes, &size);
+   GstByteReader br;
+   gst_byte_reader_init(&br, data, size);
+
+   return remote_offload_structure_read(reader, &br);
+}
+
+//names are only sent in full the first time
+GST_START_TEST(structureserializer_roundtrip)
+{
+   RemoteOffloadStructureWriter *writer = remote_offload_structure_writer_new();
+   RemoteOffloadStructureReader *reader = remote_offload_structure_reader_new();
+
+   for( guint i = 0; i < 4; i++ )
+   {
+      GstStructure *s = make_detection(i);
+      GBytes *bytes = write_structure(writer, s);
+      GstStructure *r = read_structure(reader, bytes);
+      fail_unless(r != NULL);
+      fail_unless(gst_structure_is_equal(s, r));
+      gst_structure_free(r);
+      gst_structure_free(s);
+      g_bytes_unref(bytes);
+   }
+
+   remote_offload_structure_reader_free(reader);
+   remote_offload_structure_writer_free(writer);
+}
+GST_END_TEST
+
+//The encoding of the first structure (which defines the names) is discarded,
+// i.e. because the buffer that it was serialized for was never sent. Once the
+// writer is rolled back, the names are defined again by the next structure.
+GST_START_TEST(structureserializer_discarded)
+{
+   RemoteOffloadStructureWriter *writer = remote_offload_structure_writer_new();
+   RemoteOffloadStructureReader *reader = remote_offload_structure_reader_new();
+
+   guint mark = remote_offload_structure_writer_get_mark(writer);
+   GstStructure *s = make_detection(0);
+   GBytes *discarded = write_structure(writer, s);
+   gst_structure_free(s);
+   g_bytes_unref(discarded);
+   remote_offload_structure_writer_rollback(writer, mark);
+
+   for( guint i = 1; i < 4; i++ )
+   {
+      s = make_detection(i);
+      GBytes *bytes = write_structure(writer, s);
+      GstStructure *r = read_structure(reader, bytes);
+      fail_unless(r != NULL);
+      fail_unless(gst_structure_is_equal(s, r));
+      gst_structure_free(r);
+      gst_structure_free(s);
+      g_bytes_unref(bytes);
+   }
+
+   remote_offload_structure_reader_free(reader);
+   remote_offload_structure_writer_free(writer);
+}
+GST_END_TEST
+
+//Only the names defined after the mark are forgotten. Names that were sent
+// before it are still referenced by id.
+GST_START_TEST(structureserializer_discarded_partial)
+{
+   RemoteOffloadStructureWriter *writer = remote_offload_structure_writer_new();
+   RemoteOffloadStructureReader *reader = remote_offload_structure_reader_new();
+
+   GstStructure *s = make_detection(0);
+   GBytes *bytes = write_structure(writer, s);
+   GstStructure *r = read_structure(reader, bytes);
+   fail_unless(r != NULL);
+   gst_structure_free(r);
+   g_bytes_unref(bytes);
+
+   guint mark = remote_offload_structure_writer_get_mark(writer);
+   GstStructure *t = gst_structure_new("tracking",
+                                       "label", G_TYPE_STRING, "cat",
+                                       "object_id", G_TYPE_INT, 7, NULL);
+   GBytes *discarded = write_structure(writer, t);
+   g_bytes_unref(discarded);
+   remote_offload_structure_writer_rollback(writer, mark);
+
+   bytes = write_structure(writer, t);
+   r = read_structure(reader, bytes);
+   fail_unless(r != NULL);
+   fail_unless(gst_structure_is_equal(t, r));
+   gst_structure_free(r);
+   g_bytes_unref(bytes);
+
+   bytes = write_structure(writer, s);
+   r = read_structure(reader, bytes);
+   fail_unless(r != NULL);
+   fail_unless(gst_structure_is_equal(s, r));
+   gst_structure_free(r);
+   g_bytes_unref(bytes);
+
+   gst_structure_free(t);
+   gst_structure_free(s);
+   remote_offload_structure_reader_free(reader);
+   remote_offload_structure_writer_free(writer);
+}
+GST_END_TEST
+
+static Suite *
+structureserializer_suite (void)
+{
+  Suite *s = suite_create ("structureserializer");
+
+  ROB_ADD_TEST_CASE(structureserializer_roundtrip);
+  ROB_ADD_TEST_CASE(structureserializer_discarded);
+  ROB_ADD_TEST_CASE(structureserializer_discarded_partial);
+
+  return s;
+}
+
+GST_CHECK_MAIN (structureserializer);
@@ -0,0 +1,311 @@
+/*
+ *  videoroicompose.c - Set of tests for videoroicompose element
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  Crops filled with known values are pushed (along with a buffer carrying
+ *  the GstVideoRegionOfInterestMeta that places each one) into a
+ *  videoroicompose, and every pixel of each composed frame is checked.
+ *  The crops move from one frame to the next, so regions drawn into a
+ *  recycled canvas that weren't cleared show up as mismatches.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include "robtestutils.h"
+
+#define CANVAS_WIDTH 64
+#define CANVAS_HEIGHT 48
+#define CROP_WIDTH 16
+#define CROP_HEIGHT 8
+#define CROPS_PER_FRAME 2
+#define NUM_FRAMES 6
+
+//Positions are even, so that they land on whole chroma samples
+static void get_crop_rect(guint frame, guint crop, GstVideoRectangle *rect)
+{
+   if( crop == 0 )
+   {
+      rect->x = 8 + 8 * (frame % 3);
+      rect->y = 4 + 6 * (frame % 2);
+   }
+   else
+   {
+      rect->x = 40 - 8 * (frame % 2);
+      rect->y = 26;
+   }
+   rect->w = CROP_WIDTH;
+   rect->h = CROP_HEIGHT;
+}
+
+//Each plane of each crop gets its own value, none of which is the
+// background (255, or 128 for chroma)
+static guint8 get_crop_value(guint frame, guint crop, guint plane)
+{
+   return 20 + 10 * frame + 5 * crop + plane;
+}
+
+static guint plane_component(const GstVideoFormatInfo *finfo, guint plane)
+{
+   for( guint c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS(finfo); c++ )
+   {
+      if( GST_VIDEO_FORMAT_INFO_PLANE(finfo, c) == plane )
+         return c;
+   }
+
+   return 0;
+}
+
+static GstBuffer *make_crop(GstVideoInfo *cropinfo, guint frame, guint crop)
+{
+   GstBuffer *buf = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(cropinfo), NULL);
+   fail_unless(buf != NULL);
+
+   GstVideoFrame vframe;
+   fail_unless(gst_video_frame_map(&vframe, cropinfo, buf, GST_MAP_WRITE));
+   for( guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&vframe); plane++ )
+   {
+      guint comp = plane_component(vframe.info.finfo, plane);
+      memset(GST_VIDEO_FRAME_PLANE_DATA(&vframe, plane),
+             get_crop_value(frame, crop, plane),
+             (gsize)GST_VIDEO_FRAME_PLANE_STRIDE(&vframe, plane) *
+             GST_VIDEO_FRAME_COMP_HEIGHT(&vframe, comp));
+   }
+   gst_video_frame_unmap(&vframe);
+
+   GST_BUFFER_PTS(buf) = frame * GST_SECOND / 30;
+   GST_BUFFER_DURATION(buf) = GST_SECOND / 30;
+
+   return buf;
+}
+
+static GstBuffer *make_crop_meta(guint frame, guint crop)
+{
+   GstVideoRectangle rect;
+   get_crop_rect(frame, crop, &rect);
+
+   GstBuffer *buf = gst_buffer_new();
+   gst_buffer_add_video_region_of_interest_meta(buf, "test_roi",
+                                                rect.x, rect.y, rect.w, rect.h);
+   GST_BUFFER_PTS(buf) = frame * GST_SECOND / 30;
+   GST_BUFFER_DURATION(buf) = GST_SECOND / 30;
+
+   return buf;
+}
+
+//Every byte of every plane must either be inside one of this frame's crops
+// (and hold its value), or be background.
+static void check_composed_frame(GstSample *sample, guint frame)
+{
+   GstVideoInfo info;
+   fail_unless(gst_video_info_from_caps(&info, gst_sample_get_caps(sample)));
+   fail_unless(GST_VIDEO_INFO_WIDTH(&info) == CANVAS_WIDTH);
+   fail_unless(GST_VIDEO_INFO_HEIGHT(&info) == CANVAS_HEIGHT);
+
+   GstBuffer *buf = gst_sample_get_buffer(sample);
+   fail_unless(GST_BUFFER_PTS(buf) == frame * GST_SECOND / 30);
+
+   guint nmetas = 0;
+   gpointer state = NULL;
+   while( gst_buffer_iterate_meta_filtered(buf, &state,
+                                           gst_video_region_of_interest_meta_api_get_type()) )
+      nmetas++;
+   fail_unless(nmetas == CROPS_PER_FRAME);
+
+   GstVideoFrame vframe;
+   fail_unless(gst_video_frame_map(&vframe, &info, buf, GST_MAP_READ));
+
+   const GstVideoFormatInfo *finfo = info.finfo;
+   for( guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&vframe); plane++ )
+   {
+      guint comp = plane_component(finfo, plane);
+      guint wsub = GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp);
+      guint hsub = GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp);
+      guint pstride = GST_VIDEO_FORMAT_INFO_PSTRIDE(finfo, comp);
+      guint8 background = (GST_VIDEO_FORMAT_INFO_IS_YUV(finfo) && (plane > 0)) ? 128 : 255;
+
+      const guint8 *data = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&vframe, plane);
+      gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(&vframe, plane);
+      guint width_bytes = GST_VIDEO_FRAME_COMP_WIDTH(&vframe, comp) * pstride;
+      guint height = GST_VIDEO_FRAME_COMP_HEIGHT(&vframe, comp);
+
+      for( guint y = 0; y < height; y++ )
+      {
+         for( guint x = 0; x < width_bytes; x++ )
+         {
+            guint8 expected = background;
+            for( guint crop = 0; crop < CROPS_PER_FRAME; crop++ )
+            {
+               GstVideoRectangle rect;
+               get_crop_rect(frame, crop, &rect);
+               if( (x >= (guint)(rect.x >> wsub) * pstride) &&
+                   (x < (guint)((rect.x + rect.w) >> wsub) * pstride) &&
+                   (y >= (guint)(rect.y >> hsub)) &&
+                   (y < (guint)((rect.y + rect.h) >> hsub)) )
+               {
+                  expected = get_crop_value(frame, crop, plane);
+               }
+            }
+
+            guint8 actual = data[(gsize)y * stride + x];
+            fail_unless(actual == expected,
+                        "%s frame %u plane %u (%u,%u): got %u, expected %u",
+                        GST_VIDEO_INFO_NAME(&info), frame, plane, x, y,
+                        actual, expected);
+         }
+      }
+   }
+
+   gst_video_frame_unmap(&vframe);
+}
+
+static void run_compose(const gchar *format, gboolean bfullclear)
+{
+   gchar *pipeline_str =
+         g_strdup_printf("videoroicompose name=compose full-clear=%s ! "
+                         "video/x-raw,width=%d,height=%d ! "
+                         "appsink name=sink sync=false enable-last-sample=false "
+                         "appsrc name=videosrc format=time "
+                         "caps=\"video/x-raw,format=%s,width=%d,height=%d,framerate=30/1\" ! "
+                         "compose.sinkvideo "
+                         "appsrc name=metasrc format=time ! compose.sinkmeta",
+                         bfullclear ? "true" : "false",
+                         CANVAS_WIDTH, CANVAS_HEIGHT,
+                         format, CROP_WIDTH, CROP_HEIGHT);
+
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+   g_free(pipeline_str);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   GstElement *videosrc = gst_bin_get_by_name(GST_BIN(pipeline), "videosrc");
+   GstElement *metasrc = gst_bin_get_by_name(GST_BIN(pipeline), "metasrc");
+   GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+   fail_unless(videosrc && metasrc && sink);
+
+   GstVideoInfo cropinfo;
+   gst_video_info_set_format(&cropinfo, gst_video_format_from_string(format),
+                             CROP_WIDTH, CROP_HEIGHT);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   //(unowned) canvases that the composed frames were drawn into
+   GPtrArray *canvases = g_ptr_array_new();
+
+   //A frame is finished when the first crop of the next one arrives, so
+   // frame-1 is pulled (and its canvas given back to the pool) once frame
+   // has been pushed.
+   for( guint frame = 0; frame <= NUM_FRAMES; frame++ )
+   {
+      if( frame < NUM_FRAMES )
+      {
+         for( guint crop = 0; crop < CROPS_PER_FRAME; crop++ )
+         {
+            fail_unless(gst_app_src_push_buffer(GST_APP_SRC(videosrc),
+                                                make_crop(&cropinfo, frame, crop)) == GST_FLOW_OK);
+            fail_unless(gst_app_src_push_buffer(GST_APP_SRC(metasrc),
+                                                make_crop_meta(frame, crop)) == GST_FLOW_OK);
+         }
+      }
+      else
+      {
+         gst_app_src_end_of_stream(GST_APP_SRC(videosrc));
+         gst_app_src_end_of_stream(GST_APP_SRC(metasrc));
+      }
+
+      if( frame > 0 )
+      {
+         GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+         fail_unless(sample != NULL);
+         check_composed_frame(sample, frame - 1);
+
+         GstBuffer *canvas = gst_sample_get_buffer(sample);
+         if( !g_ptr_array_find(canvases, canvas, NULL) )
+            g_ptr_array_add(canvases, canvas);
+         gst_sample_unref(sample);
+      }
+   }
+
+   //the canvases were recycled, so some of the frames that were checked
+   // above were drawn into a canvas that held an earlier frame.
+   GST_INFO("%s: %u frames were composed into %u canvases",
+            format, NUM_FRAMES, canvases->len);
+   fail_unless(canvases->len < NUM_FRAMES);
+   g_ptr_array_free(canvases, TRUE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(videosrc);
+   gst_object_unref(metasrc);
+   gst_object_unref(sink);
+   gst_object_unref(pipeline);
+}
+
+GST_START_TEST(videoroicompose_nv12)
+{
+   run_compose("NV12", FALSE);
+}
+GST_END_TEST
+
+GST_START_TEST(videoroicompose_i420)
+{
+   run_compose("I420", FALSE);
+}
+GST_END_TEST
+
+GST_START_TEST(videoroicompose_rgba)
+{
+   run_compose("RGBA", FALSE);
+}
+GST_END_TEST
+
+//recycled canvases are cleared entirely, instead of only where they were drawn
+GST_START_TEST(videoroicompose_fullclear)
+{
+   run_compose("NV12", TRUE);
+}
+GST_END_TEST
+
+static Suite *
+videoroicompose_suite (void)
+{
+  Suite *s = suite_create ("videoroicompose");
+  ROB_ADD_TEST_CASE(videoroicompose_nv12);
+  ROB_ADD_TEST_CASE(videoroicompose_i420);
+  ROB_ADD_TEST_CASE(videoroicompose_rgba);
+  ROB_ADD_TEST_CASE(videoroicompose_fullclear);
+
+  return s;
+}
+
+GST_CHECK_MAIN (videoroicompose);
@@ -0,0 +1,194 @@
+/*
+ *  videoroimetaattach.c - Set of tests for videoroimetaattach element
+ *
+ *  Copyright (C) 2020 Intel Corporation
+ *    Author: Metcalfe, Ryan <ryan.d.metcalfe@intel.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ *
+ *  The video is tee'd into the sinkvideo & sinkmeta pads of a
+ *  videoroimetaattach. On the meta branch, each buffer gets a
+ *  GstVideoRegionOfInterestMeta, and (optionally) its pts is jittered.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/video/gstvideometa.h>
+#include "robtestutils.h"
+
+#define NUM_BUFFERS 30
+
+typedef struct
+{
+   GstClockTime jitter;
+   guint metabufs;
+   guint matched;
+}MetaAttachTestEntry;
+
+static GstPadProbeReturn AddMetaProbe(GstPad *pad,
+                                      GstPadProbeInfo *info,
+                                      gpointer user_data)
+{
+   MetaAttachTestEntry *entry = (MetaAttachTestEntry *)user_data;
+
+   //the buffer is shared with the video branch, so work on a copy
+   GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+   GST_PAD_PROBE_INFO_DATA(info) = buf;
+
+   //alternate between late & early meta
+   if( entry->jitter )
+   {
+      if( entry->metabufs & 1 )
+         GST_BUFFER_PTS(buf) -= MIN(entry->jitter, GST_BUFFER_PTS(buf));
+      else
+         GST_BUFFER_PTS(buf) += entry->jitter;
+   }
+
+   GstVideoRegionOfInterestMeta *meta =
+         gst_buffer_add_video_region_of_interest_meta(buf, "test_roi", 0, 50, 100, 200);
+   fail_unless(meta != NULL);
+   gst_video_region_of_interest_meta_add_param(meta,
+         gst_structure_new("detection",
+                           "label", G_TYPE_STRING, "dog",
+                           "index", G_TYPE_UINT, entry->metabufs, NULL));
+   entry->metabufs++;
+
+   return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn CheckMetaProbe(GstPad *pad,
+                                        GstPadProbeInfo *info,
+                                        gpointer user_data)
+{
+   MetaAttachTestEntry *entry = (MetaAttachTestEntry *)user_data;
+   GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+   GstVideoRegionOfInterestMeta *meta = (GstVideoRegionOfInterestMeta *)
+         gst_buffer_get_meta(buf, gst_video_region_of_interest_meta_api_get_type());
+   if( meta )
+   {
+      //the meta that was made for this frame, and only that one, is attached
+      fail_unless(g_list_length(meta->params) == 1);
+      GstStructure *s = gst_video_region_of_interest_meta_get_param(meta, "detection");
+      fail_unless(s != NULL);
+      fail_unless(!g_strcmp0(gst_structure_get_string(s, "label"), "dog"));
+      guint index = 0;
+      fail_unless(gst_structure_get_uint(s, "index", &index));
+      fail_unless(index == entry->matched);
+      entry->matched++;
+   }
+
+   return GST_PAD_PROBE_OK;
+}
+
+static void run_pipeline(MetaAttachTestEntry *entry,
+                         GstClockTime tolerance,
+                         gboolean btransfer)
+{
+   gchar *pipeline_str =
+         g_strdup_printf("videoroimetaattach name=attach pts-tolerance=%" G_GUINT64_FORMAT
+                         " transfer-params=%s ! fakesink name=sink "
+                         "videotestsrc num-buffers=%d ! video/x-raw,framerate=30/1 ! tee name=t "
+                         "t. ! queue ! identity name=metagen ! attach.sinkmeta "
+                         "t. ! queue ! attach.sinkvideo",
+                         tolerance, btransfer ? "true" : "false", NUM_BUFFERS);
+
+   GError *error = NULL;
+   GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+   g_free(pipeline_str);
+   fail_unless(pipeline != NULL);
+   fail_unless(error == NULL);
+
+   GstElement *metagen = gst_bin_get_by_name(GST_BIN(pipeline), "metagen");
+   GstPad *pad = gst_element_get_static_pad(metagen, "src");
+   gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, AddMetaProbe, entry, NULL);
+   gst_object_unref(pad);
+   gst_object_unref(metagen);
+
+   GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+   pad = gst_element_get_static_pad(sink, "sink");
+   gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, CheckMetaProbe, entry, NULL);
+   gst_object_unref(pad);
+   gst_object_unref(sink);
+
+   fail_unless(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+   GstBus *bus = gst_element_get_bus(pipeline);
+   GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+   fail_unless(msg != NULL);
+   fail_unless(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+   gst_message_unref(msg);
+   gst_object_unref(bus);
+
+   gst_element_set_state(pipeline, GST_STATE_NULL);
+   gst_object_unref(pipeline);
+}
+
+//exact timestamps, params transferred
+GST_START_TEST(videoroimetaattach_exact)
+{
+   MetaAttachTestEntry entry = {0};
+   run_pipeline(&entry, 0, TRUE);
+   fail_unless(entry.matched == NUM_BUFFERS);
+}
+GST_END_TEST
+
+//exact timestamps, params copied
+GST_START_TEST(videoroimetaattach_copy)
+{
+   MetaAttachTestEntry entry = {0};
+   run_pipeline(&entry, 0, FALSE);
+   fail_unless(entry.matched == NUM_BUFFERS);
+}
+GST_END_TEST
+
+//jittered meta doesn't match without a tolerance (but the video still flows)
+GST_START_TEST(videoroimetaattach_jitter0)
+{
+   MetaAttachTestEntry entry = {0};
+   entry.jitter = GST_MSECOND;
+   run_pipeline(&entry, 0, TRUE);
+   fail_unless(entry.matched == 0);
+}
+GST_END_TEST
+
+//jittered meta matches, within the tolerance window
+GST_START_TEST(videoroimetaattach_jitter1)
+{
+   MetaAttachTestEntry entry = {0};
+   entry.jitter = GST_MSECOND;
+   run_pipeline(&entry, 2 * GST_MSECOND, TRUE);
+   fail_unless(entry.matched == NUM_BUFFERS);
+}
+GST_END_TEST
+
+static Suite *
+videoroimetaattach_suite (void)
+{
+  Suite *s = suite_create ("videoroimetaattach");
+  ROB_ADD_TEST_CASE(videoroimetaattach_exact);
+  ROB_ADD_TEST_CASE(videoroimetaattach_copy);
+  ROB_ADD_TEST_CASE(videoroimetaattach_jitter0);
+  ROB_ADD_TEST_CASE(videoroimetaattach_jitter1);
+
+  return s;
+}
+
+GST_CHECK_MAIN (videoroimetaattach);
@@ -36,6 +36,7 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/check/gstconsistencychecker.h>
+#include <gst/check/gstharness.h>
 #include <gst/video/gstvideometa.h>
 #include "robtestutils.h"
 
@@ -143,10 +144,12 @@ static GstPadProbeReturn CheckProbe(GstPad *pad,
             {
                GstStructure *param = (GstStructure *)params_list->data;
                GstStructure *check = (GstStructure *)check_list->data;
-#if 0
-               g_print("param: %s\n", gst_structure_to_string(param));
-               g_print("check: %s\n", gst_structure_to_string(check));
-#endif
+               gchar *paramstr = gst_structure_to_string(param);
+               gchar *checkstr = gst_structure_to_string(check);
+               GST_DEBUG("param: %s", paramstr);
+               GST_DEBUG("check: %s", checkstr);
+               g_free(paramstr);
+               g_free(checkstr);
                fail_unless(gst_structure_is_equal(param, check));
 
                params_list = params_list->next;
@@ -647,6 +650,158 @@ GST_START_TEST(videoroimetafilter_preserveremove4)
 GST_END_TEST
 
 
+#define BENCH_BUFFERS 2000
+#define BENCH_ROIS_PER_BUFFER 16
+#define BENCH_PRESERVE "dog|cat|bear;color|sound|trick|location"
+#define BENCH_REMOVE "koala"
+
+static GstBuffer *make_bench_buffer(void)
+{
+   GstBuffer *buf = gst_buffer_new();
+   for( guint i = 0; i < BENCH_ROIS_PER_BUFFER; i++ )
+   {
+      GstVideoRegionOfInterestMeta *meta =
+            gst_buffer_add_video_region_of_interest_meta(buf, "test_roi", 0, 50, 100, 200);
+
+      GstStructure *dog,*cat,*grizzly,*koala;
+      GenerateAnimalStructs(&dog, &cat, &grizzly, &koala);
+      gst_video_region_of_interest_meta_add_param(meta, dog);
+      gst_video_region_of_interest_meta_add_param(meta, cat);
+      gst_video_region_of_interest_meta_add_param(meta, grizzly);
+      gst_video_region_of_interest_meta_add_param(meta, koala);
+   }
+
+   return buf;
+}
+
+static gboolean bench_match_field(GQuark field_id, GValue *value, gpointer user_data)
+{
+   return g_regex_match((GRegex *)user_data, g_quark_to_string(field_id), 0, NULL);
+}
+
+//Per-buffer work of the filter before its decisions were memoized: every
+// expression is matched against every structure & field name, on every buffer.
+static void regex_filter_buffer(GstBuffer *buf,
+                                GRegex *preserve_struct,
+                                GRegex *preserve_field,
+                                GRegex *remove_struct)
+{
+   GstVideoRegionOfInterestMeta *meta = NULL;
+   gpointer state = NULL;
+   while( (meta = (GstVideoRegionOfInterestMeta *)
+           gst_buffer_iterate_meta_filtered(buf,
+                                            &state,
+                                            gst_video_region_of_interest_meta_api_get_type())) )
+   {
+      GList *params = meta->params;
+      while( params )
+      {
+         GstStructure *s = (GstStructure *)params->data;
+         const gchar *name = gst_structure_get_name(s);
+         gboolean bremove = TRUE;
+         if( g_regex_match(preserve_struct, name, 0, NULL) )
+         {
+            gst_structure_filter_and_map_in_place(s, bench_match_field, preserve_field);
+            bremove = (gst_structure_n_fields(s) == 0);
+         }
+
+         if( !bremove && g_regex_match(remove_struct, name, 0, NULL) )
+            bremove = TRUE;
+
+         GList *next = params->next;
+         if( bremove )
+         {
+            gst_structure_free(s);
+            meta->params = g_list_delete_link(meta->params, params);
+         }
+         params = next;
+      }
+   }
+}
+
+static void check_bench_buffer(GstBuffer *buf)
+{
+   GstStructure *dog,*cat,*grizzly;
+   GenerateAnimalStructs(&dog, &cat, &grizzly, NULL);
+   remove_field(grizzly, "does_hibernate");
+   remove_field(cat, "num_lives");
+   GList *check_list = structs_to_checklist(dog,cat,grizzly,NULL);
+
+   guint nmeta = 0;
+   GstVideoRegionOfInterestMeta *meta = NULL;
+   gpointer state = NULL;
+   while( (meta = (GstVideoRegionOfInterestMeta *)
+           gst_buffer_iterate_meta_filtered(buf,
+                                            &state,
+                                            gst_video_region_of_interest_meta_api_get_type())) )
+   {
+      nmeta++;
+      fail_unless(g_list_length(meta->params) == g_list_length(check_list));
+      GList *check = check_list;
+      for( GList *l = meta->params; l; l = l->next, check = check->next )
+         fail_unless(gst_structure_is_equal((GstStructure *)l->data, (GstStructure *)check->data));
+   }
+   fail_unless(nmeta == BENCH_ROIS_PER_BUFFER);
+
+   destroy_checklist(check_list);
+}
+
+//Per-buffer cost of filtering with regular expressions on every buffer, vs.
+// the element, which evaluates them only for the first structure of each
+// name, and the first field of each name within it.
+GST_START_TEST(videoroimetafilter_bench0)
+{
+   GstBuffer **bufs = g_new(GstBuffer *, BENCH_BUFFERS);
+
+   //regular expressions, every buffer
+   GRegex *preserve_struct = g_regex_new("dog|cat|bear", G_REGEX_OPTIMIZE, 0, NULL);
+   GRegex *preserve_field = g_regex_new("color|sound|trick|location", G_REGEX_OPTIMIZE, 0, NULL);
+   GRegex *remove_struct = g_regex_new(BENCH_REMOVE, G_REGEX_OPTIMIZE, 0, NULL);
+   for( guint i = 0; i < BENCH_BUFFERS; i++ )
+      bufs[i] = make_bench_buffer();
+
+   gint64 start = g_get_monotonic_time();
+   for( guint i = 0; i < BENCH_BUFFERS; i++ )
+      regex_filter_buffer(bufs[i], preserve_struct, preserve_field, remove_struct);
+   gint64 regex_us = g_get_monotonic_time() - start;
+
+   check_bench_buffer(bufs[BENCH_BUFFERS - 1]);
+   for( guint i = 0; i < BENCH_BUFFERS; i++ )
+      gst_buffer_unref(bufs[i]);
+   g_regex_unref(preserve_struct);
+   g_regex_unref(preserve_field);
+   g_regex_unref(remove_struct);
+
+   //the element
+   GstHarness *h = gst_harness_new("videoroimetafilter");
+   g_object_set(h->element, "preserve", BENCH_PRESERVE, "remove", BENCH_REMOVE, NULL);
+   gst_harness_set_src_caps_str(h, "video/x-raw");
+   for( guint i = 0; i < BENCH_BUFFERS; i++ )
+      bufs[i] = make_bench_buffer();
+
+   start = g_get_monotonic_time();
+   for( guint i = 0; i < BENCH_BUFFERS; i++ )
+   {
+      fail_unless(gst_harness_push(h, bufs[i]) == GST_FLOW_OK);
+      bufs[i] = gst_harness_pull(h);
+   }
+   gint64 element_us = g_get_monotonic_time() - start;
+
+   check_bench_buffer(bufs[0]);
+   check_bench_buffer(bufs[BENCH_BUFFERS - 1]);
+   for( guint i = 0; i < BENCH_BUFFERS; i++ )
+      gst_buffer_unref(bufs[i]);
+   gst_harness_teardown(h);
+   g_free(bufs);
+
+   GST_INFO("videoroimetafilter_bench0: %d ROI's x 4 params per buffer: "
+            "regex per buffer %.2f us, videoroimetafilter %.2f us",
+            BENCH_ROIS_PER_BUFFER,
+            (gdouble)regex_us / BENCH_BUFFERS,
+            (gdouble)element_us / BENCH_BUFFERS);
+}
+GST_END_TEST
+
 static Suite *
 videoroimetafilter_suite (void)
 {
@@ -679,6 +834,8 @@ videoroimetafilter_suite (void)
   ROB_ADD_TEST_CASE(videoroimetafilter_preserveremove3);
   ROB_ADD_TEST_CASE(videoroimetafilter_preserveremove4);
 
+  ROB_ADD_TEST_CASE(videoroimetafilter_bench0);
+
   return s;
 }
 
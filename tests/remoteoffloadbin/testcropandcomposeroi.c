@@ -231,6 +231,8 @@ int main(int argc, char *argv[])
      fprintf(stderr, "Error creating videoroicompose\n");
      return -1;
   }
+  //gvawatermark draws on the composed frames in-place
+  g_object_set (G_OBJECT (videoroicompose), "full-clear", (gboolean)TRUE, NULL);
 
   GstElement *videoroimetadetach = gst_element_factory_make("videoroimetadetach", "myvideoroimetadetach");
   if( !videoroimetadetach )